@@ -0,0 +1,205 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the resolution of client-side addresses to handles with 100k live allocations,
+ *          comparing
+ *          [1] map: the previous std::map based lookup of POSHandleManager (count, then lower_bound)
+ *          [2] index: POSAddressIndex, a sorted flat array with a per-thread cache of last hits
+ *  \note   the address space is populated by a bump allocator as the handle manager does, with a
+ *          fraction of buffers freed and reallocated at out-of-order addresses; every lookup result
+ *          of the index is checked against the map
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "pos/include/common.h"
+#include "pos/include/utils/address_index.h"
+
+
+constexpr uint64_t kNbAllocations = 100000;
+constexpr uint64_t kNbLookups = 4000000;
+constexpr uint64_t kBaseAddr = 0x555500000000;
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  mocked handle
+ */
+typedef struct mock_handle {
+    uint64_t client_addr;
+    uint64_t size;
+} mock_handle_t;
+
+
+/*!
+ *  \brief  previous lookup of POSHandleManager
+ */
+static inline mock_handle_t* map_lookup(std::map<uint64_t, mock_handle_t*>& map, uint64_t addr){
+    std::map<uint64_t, mock_handle_t*>::iterator iter;
+    mock_handle_t *handle;
+
+    if(map.count(addr) > 0){ return map[addr]; }
+    iter = map.lower_bound(addr);
+    if(iter != map.begin()){
+        iter--;
+        handle = iter->second;
+        if(handle->client_addr <= addr && addr < handle->client_addr + handle->size){ return handle; }
+    }
+    return nullptr;
+}
+
+
+/*!
+ *  \brief  generate addresses to resolve
+ *  \param  pattern     name of the pattern
+ *  \param  handles     live handles
+ *  \param  rng         random generator
+ *  \return the addresses
+ */
+static std::vector<uint64_t> generate_queries(
+    const char* pattern, std::vector<mock_handle_t*>& handles, std::mt19937_64& rng
+){
+    uint64_t i, j, layer, nb_layers;
+    std::vector<uint64_t> queries;
+    mock_handle_t *h;
+
+    queries.reserve(kNbLookups);
+
+    if(std::string(pattern) == "training"){
+        /*!
+         *  \note   a training step sweeps over layers, each kernel launch passes a few buffers of the
+         *          layer (weights, activations, gradients), mostly at their bases and sometimes at an
+         *          offset (sub-buffers / views); consecutive launches of a layer reuse the same buffers
+         */
+        nb_layers = handles.size() / 8;
+        layer = 0;
+        while(queries.size() < kNbLookups){
+            for(i=0; i<4 && queries.size() < kNbLookups; i++){
+                for(j=0; j<6 && queries.size() < kNbLookups; j++){
+                    h = handles[(layer * 8 + (j + i) % 8) % handles.size()];
+                    queries.push_back(rng() % 4 == 0 ? h->client_addr + rng() % h->size : h->client_addr);
+                }
+            }
+            layer = (layer + 1) % nb_layers;
+        }
+    } else if(std::string(pattern) == "random"){
+        // uniformly random sub-buffer pointers over all live buffers
+        for(i=0; i<kNbLookups; i++){
+            h = handles[rng() % handles.size()];
+            queries.push_back(h->client_addr + rng() % h->size);
+        }
+    } else { // "miss"
+        // addresses that aren't within any buffer, e.g., host pointers
+        for(i=0; i<kNbLookups; i++){ queries.push_back(0x7f0000000000 + (rng() % GB(1))); }
+    }
+
+    return queries;
+}
+
+
+int main(){
+    uint64_t i, s_ns, e_ns, base_ptr = kBaseAddr, nb_found, checksum_map, checksum_index, size;
+    std::mt19937_64 rng(0);
+    std::vector<mock_handle_t*> handles, live_handles;
+    std::map<uint64_t, mock_handle_t*> map;
+    POSAddressIndex<mock_handle_t*> index;
+    mock_handle_t *h;
+
+    // populate with a bump allocator, sizes from 256B to 64MB, dominated by small ones
+    s_ns = get_ns();
+    for(i=0; i<kNbAllocations; i++){
+        size = 256ul << (rng() % 19);
+        POS_CHECK_POINTER(h = new mock_handle_t({ base_ptr, size }));
+        handles.push_back(h);
+        base_ptr += size;
+    }
+    for(mock_handle_t *h : handles){ map[h->client_addr] = h; }
+    e_ns = get_ns();
+    printf("[map  ] insert %lu ranges: %8.2f ns/op\n", kNbAllocations, (double)(e_ns - s_ns) / kNbAllocations);
+
+    s_ns = get_ns();
+    for(mock_handle_t *h : handles){ index.insert(h->client_addr, h->size, h); }
+    e_ns = get_ns();
+    printf("[index] insert %lu ranges: %8.2f ns/op\n", kNbAllocations, (double)(e_ns - s_ns) / kNbAllocations);
+
+    // free 10% of buffers, and reallocate within the freed ranges (out-of-order addresses)
+    s_ns = get_ns();
+    for(i=0; i<kNbAllocations/10; i++){
+        h = handles[rng() % handles.size()];
+        if(map.erase(h->client_addr) == 0){ continue; }
+        POS_ASSERT(index.erase(h->client_addr));
+        if(h->size > 256){
+            h->size /= 2;
+            map[h->client_addr] = h;
+            index.insert(h->client_addr, h->size, h);
+        }
+    }
+    e_ns = get_ns();
+    printf(
+        "[both ] churn %lu ranges:  %8.2f ns/op, #live: %lu / %lu, #compactions: %lu\n",
+        kNbAllocations/10, (double)(e_ns - s_ns) / (kNbAllocations/10), map.size(), index.size(),
+        index.get_stat().nb_compactions
+    );
+    POS_ASSERT(map.size() == index.size());
+    for(auto &kv : map){ live_handles.push_back(kv.second); }
+
+    for(const char* pattern : { "training", "random", "miss" }){
+        std::vector<uint64_t> queries = generate_queries(pattern, live_handles, rng);
+
+        // correctness
+        for(uint64_t addr : queries){ POS_ASSERT(map_lookup(map, addr) == index.lookup(addr)); }
+
+        checksum_map = 0;
+        s_ns = get_ns();
+        for(uint64_t addr : queries){ checksum_map += (uint64_t)(map_lookup(map, addr)); }
+        e_ns = get_ns();
+        printf(
+            "[map  ] %-8s lookups: %8.2f ns/op\n", pattern, (double)(e_ns - s_ns) / queries.size()
+        );
+
+        checksum_index = 0;
+        nb_found = index.get_stat().nb_cache_hits;
+        s_ns = get_ns();
+        for(uint64_t addr : queries){ checksum_index += (uint64_t)(index.lookup(addr)); }
+        e_ns = get_ns();
+        printf(
+            "[index] %-8s lookups: %8.2f ns/op, cache hit: %6.2f%%\n",
+            pattern, (double)(e_ns - s_ns) / queries.size(),
+            (double)(index.get_stat().nb_cache_hits - nb_found) / queries.size() * 100.0
+        );
+        fflush(stdout);
+
+        POS_ASSERT(checksum_map == checksum_index);
+    }
+
+    for(mock_handle_t *h : handles){ delete h; }
+
+    return 0;
+}
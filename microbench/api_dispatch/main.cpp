@@ -0,0 +1,225 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the throughput of parser / worker dispatch, comparing the previous per-call lookup
+ *          (std::map of functions, and copying POSAPIMeta_t out of api_metas) against the dense tables of
+ *          POSApiManager
+ *  \note   the API set is the one registered by POSApiManager_CUDA, while the parser / launch functions are
+ *          trivial functions, so that the measured time is dominated by dispatching
+ */
+
+#include <iostream>
+#include <map>
+#include <vector>
+#include <random>
+
+#include <stdint.h>
+
+#include "pos/include/api_context.h"
+#include "pos/cuda_impl/api_index.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbCalls = 10000000;
+constexpr uint64_t kNbTraceCalls = 4096;
+
+
+/*!
+ *  \brief  mock work queue element, as the parser / launch functions only touch the api context
+ */
+typedef struct mock_qe {
+    uint64_t api_id;
+    uint64_t nb_parsed;
+    uint64_t nb_launched;
+    int return_code;
+} mock_qe_t;
+
+using mock_function_t = pos_retval_t(*)(void*, mock_qe_t*);
+
+
+__attribute__((noinline)) static pos_retval_t mock_parse(void* /* ws */, mock_qe_t* qe){
+    qe->nb_parsed += 1;
+    return POS_SUCCESS;
+}
+
+__attribute__((noinline)) static pos_retval_t mock_launch(void* /* ws */, mock_qe_t* qe){
+    qe->nb_launched += 1;
+    return POS_SUCCESS;
+}
+
+
+/*!
+ *  \brief  API manager with the API set of POSApiManager_CUDA
+ */
+class MockApiManager : public POSApiManager {
+ public:
+    void init() override {
+        uint64_t i;
+        std::vector<std::pair<uint64_t, std::string>> apis({
+            { CUDA_MALLOC, "cudaMalloc" }, { CUDA_FREE, "cudaFree" },
+            { CUDA_MEMCPY_HTOD, "cudaMemcpyH2D" }, { CUDA_MEMCPY_DTOH, "cudaMemcpyD2H" },
+            { CUDA_MEMCPY_DTOD, "cudaMemcpyD2D" }, { CUDA_MEMCPY_HTOD_ASYNC, "cudaMemcpyH2DAsync" },
+            { CUDA_MEMCPY_DTOH_ASYNC, "cudaMemcpyD2HAsync" }, { CUDA_MEMCPY_DTOD_ASYNC, "cudaMemcpyD2DAsync" },
+            { CUDA_MEMSET_ASYNC, "cudaMemsetAsync" }, { CUDA_LAUNCH_KERNEL, "cudaLaunchKernel" },
+            { CUDA_SET_DEVICE, "cudaSetDevice" }, { CUDA_GET_LAST_ERROR, "cudaGetLastError" },
+            { CUDA_GET_ERROR_STRING, "cudaGetErrorString" }, { CUDA_PEEK_AT_LAST_ERROR, "cudaPeekAtLastError" },
+            { CUDA_GET_DEVICE_COUNT, "cudaGetDeviceCount" }, { CUDA_GET_DEVICE_PROPERTIES, "cudaGetDeviceProperties" },
+            { CUDA_DEVICE_GET_ATTRIBUTE, "cudaDeviceGetAttribute" }, { CUDA_GET_DEVICE, "cudaGetDevice" },
+            { CUDA_FUNC_GET_ATTRIBUTES, "cudaFuncGetAttributes" },
+            { CUDA_OCCUPANCY_MAX_ACTIVE_BPM_WITH_FLAGS, "cudaOccupancyMaxActiveBlocksPerMultiprocessorWithFlags" },
+            { CUDA_STREAM_SYNCHRONIZE, "cudaStreamSynchronize" }, { CUDA_STREAM_IS_CAPTURING, "cudaStreamIsCapturing" },
+            { CUDA_EVENT_CREATE_WITH_FLAGS, "cudaEventCreateWithFlags" }, { CUDA_EVENT_DESTROY, "cudaEventDestroy" },
+            { CUDA_EVENT_RECORD, "cudaEventRecord" }, { CUDA_EVENT_QUERY, "cudaEventQuery" },
+            { rpc_cuModuleLoad, "cuModuleLoad" }, { rpc_cuModuleLoadData, "cuModuleLoadData" },
+            { rpc_register_function, "__cudaRegisterFunction" }, { rpc_cuModuleGetFunction, "cuModuleGetFunction" },
+            { rpc_register_var, "__cudaRegisterVar" }, { rpc_cuCtxGetCurrent, "cuCtxGetCurrent" },
+            { rpc_cuDevicePrimaryCtxGetState, "cuDevicePrimaryCtxGetState" }, { rpc_cuLaunchKernel, "cuLaunchKernel" },
+            { rpc_cuGetErrorString, "cuGetErrorString" }, { rpc_cublasCreate, "cublasCreate_v2" },
+            { rpc_cublasSetStream, "cublasSetStream_v2" }, { rpc_cublasSetMathMode, "cublasSetMathMode" },
+            { rpc_cublasSgemm, "cublasSgemm_v2" }, { rpc_cublasSgemmStridedBatched, "cublasSgemmStridedBatched" },
+            { rpc_deinit, "deinit" }
+        });
+
+        for(i=0; i<apis.size(); i++){
+            this->api_metas.insert({
+                apis[i].first,
+                {
+                    /* is_sync */       i % 3 == 0,
+                    /* api_type */      kPOS_API_Type_Set_Resource,
+                    /* library_id */    static_cast<uint8_t>(i % 4),
+                    /* api_name */      apis[i].second
+                }
+            });
+            parser_functions[apis[i].first] = mock_parse;
+            launch_functions[apis[i].first] = mock_launch;
+        }
+    }
+
+    int cast_pos_retval(pos_retval_t pos_retval, uint8_t library_id) override {
+        return pos_retval == POS_SUCCESS ? 0 : (int)(library_id) + 1;
+    }
+
+    std::map<uint64_t, mock_function_t> parser_functions;
+    std::map<uint64_t, mock_function_t> launch_functions;
+};
+
+
+/*!
+ *  \brief  dispatch as the previous parser / worker did
+ *  \return duration (ms)
+ */
+static double dispatch_map(MockApiManager& mgnr, std::vector<mock_qe_t>& trace, bool is_worker){
+    uint64_t i, s_tick, e_tick, api_id;
+    POSAPIMeta_t api_meta;
+    pos_retval_t retval;
+    mock_qe_t *qe;
+    std::map<uint64_t, mock_function_t> &functions = is_worker ? mgnr.launch_functions : mgnr.parser_functions;
+
+    s_tick = get_tsc();
+    for(i=0; i<kNbCalls; i++){
+        qe = &trace[i % trace.size()];
+        api_id = qe->api_id;
+        api_meta = mgnr.api_metas[api_id];
+        retval = (*(functions[api_id]))(nullptr, qe);
+        qe->return_code = mgnr.cast_pos_retval(retval, api_meta.library_id);
+        if(is_worker == false && api_meta.api_type == kPOS_API_Type_Delete_Resource){ qe->return_code += 1; }
+    }
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+/*!
+ *  \brief  dispatch through the dense tables
+ *  \return duration (ms)
+ */
+static double dispatch_dense(MockApiManager& mgnr, std::vector<mock_qe_t>& trace, bool is_worker){
+    uint64_t i, s_tick, e_tick;
+    uint32_t api_index;
+    const POSAPIMeta_t *api_meta;
+    pos_retval_t retval;
+    mock_qe_t *qe;
+    std::vector<mock_function_t> table;
+
+    mgnr.build_dispatch_table(is_worker ? mgnr.launch_functions : mgnr.parser_functions, table);
+
+    s_tick = get_tsc();
+    for(i=0; i<kNbCalls; i++){
+        qe = &trace[i % trace.size()];
+        api_index = mgnr.get_api_index(qe->api_id);
+        api_meta = &(mgnr.get_api_meta_by_index(api_index));
+        retval = (*(table[api_index]))(nullptr, qe);
+        qe->return_code = mgnr.cast_pos_retval(retval, api_meta->library_id);
+        if(is_worker == false && api_meta->api_type == kPOS_API_Type_Delete_Resource){ qe->return_code += 1; }
+    }
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+int main(){
+    uint64_t i, nb_parsed = 0, nb_launched = 0;
+    double duration_ms;
+    MockApiManager mgnr;
+    std::vector<uint64_t> api_ids;
+    std::vector<mock_qe_t> trace(kNbTraceCalls);
+    std::mt19937_64 rng(0);
+
+    mgnr.init();
+    mgnr.build_dense_index();
+    for(auto& meta : mgnr.api_metas){ api_ids.push_back(meta.first); }
+
+    // the trace is dominated by kernel launches and async memcpy, as in training / inference workloads
+    for(i=0; i<trace.size(); i++){
+        switch(rng() % 8){
+        case 0: case 1: case 2: case 3:
+            trace[i].api_id = CUDA_LAUNCH_KERNEL; break;
+        case 4:
+            trace[i].api_id = CUDA_MEMCPY_HTOD_ASYNC; break;
+        case 5:
+            trace[i].api_id = rpc_cublasSgemm; break;
+        default:
+            trace[i].api_id = api_ids[rng() % api_ids.size()]; break;
+        }
+        trace[i].nb_parsed = trace[i].nb_launched = 0;
+    }
+
+    printf(
+        "#apis: %u, max api id: %lu, #calls: %lu\n",
+        mgnr.get_nb_apis(), mgnr.api_metas.rbegin()->first, kNbCalls
+    );
+
+    for(bool is_worker : { false, true }){
+        duration_ms = dispatch_map(mgnr, trace, is_worker);
+        printf(
+            "[%-6s] map:   %8.2f Mcalls/s, %6.2f ns/call\n",
+            is_worker ? "worker" : "parser", (double)kNbCalls / duration_ms / 1000.0, duration_ms * 1e6 / kNbCalls
+        );
+        duration_ms = dispatch_dense(mgnr, trace, is_worker);
+        printf(
+            "[%-6s] dense: %8.2f Mcalls/s, %6.2f ns/call\n",
+            is_worker ? "worker" : "parser", (double)kNbCalls / duration_ms / 1000.0, duration_ms * 1e6 / kNbCalls
+        );
+    }
+
+    for(mock_qe_t &qe : trace){ nb_parsed += qe.nb_parsed; nb_launched += qe.nb_launched; }
+    POS_ASSERT(nb_parsed == kNbCalls * 2 && nb_launched == kNbCalls * 2);
+
+    return 0;
+}
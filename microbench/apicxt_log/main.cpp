@@ -0,0 +1,247 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure dump / restore latency of unexecuted API contexts under different queue depths, persisted
+ *          as one checkpoint image record per API context versus framed into the API context log
+ *  \note   serialized API contexts are emulated by random-sized payloads, so that the protobuf cost (which is
+ *          the same for both ways) is excluded
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pos/include/apicxt_log.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/persist_executor.h"
+#include "mb_common/ticks.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kMinPayloadSize = 128;
+constexpr uint64_t kMaxPayloadSize = 2048;
+constexpr uint64_t kNbRepeats = 5;
+
+
+static inline uint8_t payload_byte(uint64_t id, uint64_t i){
+    return static_cast<uint8_t>(id * 31 + i);
+}
+
+
+/*!
+ *  \brief  emulate serializing an API context into the given buffer
+ */
+static void serialize(uint64_t id, uint8_t* dst, uint64_t size){
+    uint64_t i;
+    for(i=0; i<size; i++){ dst[i] = payload_byte(id, i); }
+}
+
+
+static bool is_valid_payload(uint64_t id, const uint8_t* data, uint64_t size, uint64_t expected_size){
+    if(size != expected_size){ return false; }
+    return data[0] == payload_byte(id, 0) && data[size - 1] == payload_byte(id, size - 1);
+}
+
+
+/*!
+ *  \brief  drop page cache of the image, which is fsync-ed during sealing
+ */
+static void drop_cache(const std::string& ckpt_dir){
+    int fd = open((ckpt_dir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), O_RDONLY);
+    check(fd >= 0, "open image");
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+
+/*!
+ *  \brief  dump as one record per API context, each persisted by a task of the persist executor
+ */
+static double dump_records(const std::string& ckpt_dir, const std::vector<uint64_t>& sizes){
+    uint64_t id, s_tick, e_tick;
+
+    std::filesystem::remove_all(ckpt_dir);
+    std::filesystem::create_directories(ckpt_dir);
+
+    s_tick = get_tsc();
+    for(id=0; id<sizes.size(); id++){
+        uint64_t size = sizes[id];
+        POSPersistExecutor::get_instance()->submit(
+            [id, size, ckpt_dir]() -> pos_retval_t {
+                std::string serialized(size, 0);
+                POSCheckpointImageWriter *writer;
+                serialize(id, reinterpret_cast<uint8_t*>(serialized.data()), size);
+                POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(ckpt_dir));
+                return writer->append(kPOS_CkptImageRecord_APIContext, 0, id, 0, serialized.data(), serialized.size());
+            },
+            /* tag */ ckpt_dir
+        );
+    }
+    check(POS_SUCCESS == POSPersistExecutor::get_instance()->flush(ckpt_dir).get(), "persist records");
+    check(POS_SUCCESS == POSCheckpointImageWriter::seal(ckpt_dir), "seal image");
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double restore_records(const std::string& ckpt_dir, const std::vector<uint64_t>& sizes, bool& is_matched){
+    uint64_t i, s_tick, e_tick;
+    std::vector<const pos_ckpt_image_entry_t*> entries;
+    POSCheckpointImage image;
+
+    drop_cache(ckpt_dir);
+    is_matched = true;
+
+    s_tick = get_tsc();
+    check(POS_SUCCESS == image.open(ckpt_dir), "open image");
+    image.get_entries(kPOS_CkptImageRecord_APIContext, entries);
+    for(i=0; i<entries.size(); i++){
+        check(POS_SUCCESS == image.verify(entries[i]), "verify record");
+        if(!is_valid_payload(
+            entries[i]->id, reinterpret_cast<const uint8_t*>(image.get_data(entries[i])), entries[i]->size, sizes[i]
+        )){
+            is_matched = false;
+        }
+    }
+    e_tick = get_tsc();
+
+    if(entries.size() != sizes.size()){ is_matched = false; }
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+/*!
+ *  \brief  dump as frames of the API context log
+ */
+static double dump_log(const std::string& ckpt_dir, const std::vector<uint64_t>& sizes, uint64_t& nb_segments){
+    uint64_t id, s_tick, e_tick;
+    void *frame;
+
+    std::filesystem::remove_all(ckpt_dir);
+    std::filesystem::create_directories(ckpt_dir);
+
+    s_tick = get_tsc();
+    {
+        POSAPIContextLogWriter log(ckpt_dir);
+        for(id=0; id<sizes.size(); id++){
+            check((frame = log.append_frame(id, kPOS_APICxtLogFrameFlag_WithParams, sizes[id])) != nullptr, "append frame");
+            serialize(id, reinterpret_cast<uint8_t*>(frame), sizes[id]);
+        }
+        check(POS_SUCCESS == log.flush(), "flush log");
+        nb_segments = log.get_stat().nb_segments;
+    }
+    check(POS_SUCCESS == POSPersistExecutor::get_instance()->flush(ckpt_dir).get(), "persist log");
+    check(POS_SUCCESS == POSCheckpointImageWriter::seal(ckpt_dir), "seal image");
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double restore_log(const std::string& ckpt_dir, const std::vector<uint64_t>& sizes, bool& is_matched){
+    uint64_t nb_frames = 0, s_tick, e_tick;
+    pos_retval_t retval;
+    const pos_apicxt_log_frame_header_t *header;
+    const void *data;
+    POSCheckpointImage image;
+    POSAPIContextLogReader log;
+
+    drop_cache(ckpt_dir);
+    is_matched = true;
+
+    s_tick = get_tsc();
+    check(POS_SUCCESS == image.open(ckpt_dir), "open image");
+    check(POS_SUCCESS == log.open(&image), "open log");
+    while(POS_SUCCESS == (retval = log.next(&header, &data))){
+        if(header->id != nb_frames || !is_valid_payload(
+            header->id, reinterpret_cast<const uint8_t*>(data), header->size, sizes[nb_frames]
+        )){
+            is_matched = false;
+        }
+        nb_frames += 1;
+    }
+    e_tick = get_tsc();
+
+    check(retval == POS_FAILED_NOT_EXIST, "walk log");
+    if(nb_frames != sizes.size()){ is_matched = false; }
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double median(std::vector<double>& values){
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+
+int main(int argc, char** argv){
+    uint64_t i, r, nb_segments = 0, total_size;
+    bool is_matched, is_all_matched = true;
+    std::vector<uint64_t> sizes;
+    std::vector<double> rec_dump, rec_restore, log_dump, log_restore;
+    const std::string ckpt_dir = "/tmp/pos_mb_apicxt_log";
+    std::vector<uint64_t> depths({ 64, 256, 1024, 4096, 8192 });
+
+    if(argc > 1){ POSAPIContextLogWriter::batch_size = KB(strtoull(argv[1], nullptr, 10)); }
+
+    check(POS_SUCCESS == POSPersistExecutor::get_instance()->init(), "init persist executor");
+    srand(2024);
+
+    printf("batch size: %lu KB, payload size: [%lu, %lu] B\n", POSAPIContextLogWriter::batch_size / KB(1), kMinPayloadSize, kMaxPayloadSize);
+    for(uint64_t depth : depths){
+        sizes.clear();
+        total_size = 0;
+        for(i=0; i<depth; i++){
+            sizes.push_back(kMinPayloadSize + static_cast<uint64_t>(rand()) % (kMaxPayloadSize - kMinPayloadSize));
+            total_size += sizes.back();
+        }
+
+        rec_dump.clear(); rec_restore.clear(); log_dump.clear(); log_restore.clear();
+        for(r=0; r<kNbRepeats; r++){
+            rec_dump.push_back(dump_records(ckpt_dir, sizes));
+            rec_restore.push_back(restore_records(ckpt_dir, sizes, is_matched));
+            is_all_matched &= is_matched;
+
+            log_dump.push_back(dump_log(ckpt_dir, sizes, nb_segments));
+            log_restore.push_back(restore_log(ckpt_dir, sizes, is_matched));
+            is_all_matched &= is_matched;
+        }
+
+        printf(
+            "[depth %4lu, %6.2f MB] per-record: dump %8.2f ms, restore %7.2f ms | log (%3lu segments):"
+            " dump %7.2f ms, restore %7.2f ms | speedup: dump %5.1fx, restore %5.1fx\n",
+            depth, (double)(total_size) / (double)(MB(1)),
+            median(rec_dump), median(rec_restore), nb_segments, median(log_dump), median(log_restore),
+            median(rec_dump) / median(log_dump), median(rec_restore) / median(log_restore)
+        );
+    }
+    printf("content %s\n", is_all_matched ? "matched" : "MISMATCHED");
+
+    std::filesystem::remove_all(ckpt_dir);
+    POSPersistExecutor::get_instance()->deinit();
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  soak test of API context allocation under sustained kernel-launch load, comparing
+ *          [1] leak: the previous behaviour, i.e., contexts are heap-allocated and never released
+ *          [2] heap: contexts are heap-allocated and released by the worker
+ *          [3] pool: contexts are drawn from and recycled to the per-client POSAPIContextPool
+ *  \note   the RPC thread allocates contexts and pushes them to the worker thread, which touches the
+ *          parameters and releases them, so that allocation and release happen on different threads
+ *          as in the runtime
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pos/include/api_context.h"
+#include "pos/include/utils/lockfree_queue.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbCalls = 4000000;
+constexpr uint64_t kNbLeakCalls = 400000;
+constexpr uint64_t kNbRssSamples = 4;
+constexpr uint64_t kMaxInflightCalls = 1024;
+constexpr uint64_t kNbTraceCalls = 4096;
+
+enum bench_mode_t : uint8_t {
+    kBench_Leak = 0,
+    kBench_Heap,
+    kBench_Pool
+};
+
+static const char* bench_mode_names[] = { "leak", "heap", "pool" };
+
+
+/*!
+ *  \brief  parameter sizes of one simulated API call
+ */
+typedef struct mock_call {
+    uint64_t api_id;
+    std::vector<uint64_t> param_sizes;
+} mock_call_t;
+
+
+/*!
+ *  \brief  obtain the resident set size of this process
+ *  \return RSS in MB
+ */
+static double get_rss_mb(){
+    FILE *fp;
+    uint64_t nb_pages = 0, nb_resident_pages = 0;
+
+    if((fp = fopen("/proc/self/statm", "r")) == nullptr){ return 0; }
+    if(fscanf(fp, "%lu %lu", &nb_pages, &nb_resident_pages) != 2){ nb_resident_pages = 0; }
+    fclose(fp);
+
+    return (double)(nb_resident_pages * sysconf(_SC_PAGESIZE)) / (double)MB(1);
+}
+
+
+/*!
+ *  \brief  run the soak test with given mode
+ *  \param  mode    allocation mode
+ *  \param  trace   simulated API calls
+ *  \param  nb_calls number of calls to issue
+ */
+static void run(bench_mode_t mode, std::vector<mock_call_t>& trace, uint64_t nb_calls){
+    uint64_t i, s_tick, e_tick, alloc_ticks = 0, tick, checksum = 0;
+    double rss_begin;
+    uint8_t src[KB(8)];
+    std::vector<POSAPIParamDesp_t> param_desps;
+    POSAPIContext_QE_t *wqe;
+    POSAPIContextPool *pool = nullptr;
+    POSLockFreeQueue<POSAPIContext_QE_t*> wq;
+    std::atomic<uint64_t> nb_inflight(0);
+    std::atomic<bool> is_stop(false);
+    std::thread *worker;
+    pos_apicxt_pool_stat_t pool_stat;
+
+    // the contexts only record the client, any non-null pointer works here
+    POSClient *client = reinterpret_cast<POSClient*>(&is_stop);
+
+    memset(src, 0x5a, sizeof(src));
+    if(mode == kBench_Pool){ POS_CHECK_POINTER(pool = new POSAPIContextPool()); }
+    rss_begin = get_rss_mb();
+
+    worker = new std::thread([&](){
+        POSAPIContext_QE_t *qe;
+        while(true){
+            if(wq.dequeue(qe) != POS_SUCCESS){
+                if(is_stop.load() && nb_inflight.load() == 0){ break; }
+                std::this_thread::yield();
+                continue;
+            }
+            for(auto param : qe->api_cxt->params){
+                checksum += reinterpret_cast<uint8_t*>(param->param_value)[param->param_size - 1];
+            }
+            if(mode == kBench_Heap){ delete qe; }
+            else if(mode == kBench_Pool){ qe->put_ref(); }
+            nb_inflight.fetch_sub(1);
+        }
+    });
+
+    s_tick = get_tsc();
+    for(i=0; i<nb_calls; i++){
+        mock_call_t &call = trace[i % trace.size()];
+
+        while(nb_inflight.load() >= kMaxInflightCalls){ std::this_thread::yield(); }
+
+        param_desps.clear();
+        for(uint64_t size : call.param_sizes){ param_desps.push_back({ .value = src, .size = size }); }
+
+        tick = get_tsc();
+        if(mode == kBench_Pool){
+            wqe = pool->alloc_qe(call.api_id, 0, param_desps, i, nullptr, 0, client);
+        } else {
+            wqe = new POSAPIContext_QE_t(call.api_id, 0, param_desps, i, nullptr, 0, client);
+        }
+        alloc_ticks += get_tsc() - tick;
+
+        nb_inflight.fetch_add(1);
+        wq.push(wqe);
+
+        if((i + 1) % (nb_calls / kNbRssSamples) == 0){
+            printf(
+                "  [%s] %9lu calls, rss: %8.2f MB (+%.2f MB)\n",
+                bench_mode_names[mode], i + 1, get_rss_mb(), get_rss_mb() - rss_begin
+            );
+        }
+    }
+    is_stop.store(true);
+    worker->join();
+    e_tick = get_tsc();
+    delete worker;
+
+    printf(
+        "[%s] #calls: %lu, end-to-end: %7.2f ns/api, alloc: %7.2f ns/api, rss growth: %.2f MB\n",
+        bench_mode_names[mode], nb_calls,
+        POS_TSC_RANGE_TO_USEC(e_tick, s_tick) * 1000.0 / nb_calls,
+        POS_TSC_TO_USEC(alloc_ticks) * 1000.0 / nb_calls,
+        get_rss_mb() - rss_begin
+    );
+
+    if(pool != nullptr){
+        pool->get_stat(pool_stat);
+        printf(
+            "[%s] #qes: %lu, #qe allocs: %lu, #param allocs: %lu, slab bytes: %.2f MB\n",
+            bench_mode_names[mode], pool_stat.nb_qes, pool_stat.nb_qe_allocs, pool_stat.nb_param_allocs,
+            (double)pool_stat.nb_slab_bytes / (double)MB(1)
+        );
+        POS_ASSERT(pool_stat.nb_free_qes == pool_stat.nb_qes && pool_stat.nb_allocated_params == 0);
+        delete pool;
+    }
+
+    // every touched byte is 0x5a
+    POS_ASSERT(checksum % 0x5a == 0);
+}
+
+
+int main(){
+    uint64_t i;
+    std::vector<mock_call_t> trace(kNbTraceCalls);
+    std::mt19937_64 rng(0);
+
+    /*!
+     *  \note   the trace mimics a training loop, dominated by kernel launches whose arguments are
+     *          mostly small, with a few larger argument blobs and occasional host-to-device copies
+     */
+    for(i=0; i<trace.size(); i++){
+        switch(rng() % 16){
+        case 0:
+            // cudaMemcpyAsync (H2D) with 8KB payload
+            trace[i].api_id = 1;
+            trace[i].param_sizes = { 8, KB(8), 8, 8 };
+            break;
+        case 1: case 2:
+            // cublasSgemm
+            trace[i].api_id = 2;
+            trace[i].param_sizes = { 8, 4, 4, 4, 4, 4, 8, 8, 4, 8, 4, 8, 8, 4 };
+            break;
+        case 3: case 4: case 5:
+            // kernel launch with large argument blob
+            trace[i].api_id = 3;
+            trace[i].param_sizes = { 8, 12, 12, 8, 8, 128 + rng() % 512 };
+            break;
+        default:
+            // kernel launch with small argument blob
+            trace[i].api_id = 3;
+            trace[i].param_sizes = { 8, 12, 12, 8, 8, 16 + rng() % 48 };
+            break;
+        }
+    }
+
+    run(kBench_Leak, trace, kNbLeakCalls);
+    run(kBench_Heap, trace, kNbCalls);
+    run(kBench_Pool, trace, kNbCalls);
+
+    return 0;
+}
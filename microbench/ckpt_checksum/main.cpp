@@ -0,0 +1,205 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure integrity checking of checkpoint images: the share of dump time spent on computing CRC32C
+ *          inline, and the throughput of verifying a sealed image in parallel with different numbers of
+ *          persist threads; then flip a byte of a record and of a deduplicated chunk and check that both
+ *          are detected
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <filesystem>
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pos/include/common.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/persist_executor.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kStateSize = MB(16);
+constexpr uint64_t kNbStates = 24;
+const std::string kCkptDir = "/tmp/pos_mb_ckpt_checksum";
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  write all states to a new image
+ *  \return the checksum statistics of the dump
+ */
+static pos_ckpt_image_checksum_stat_t dump(std::vector<uint8_t*>& states){
+    uint64_t i;
+    POSCheckpointImageWriter *writer;
+    pos_ckpt_image_checksum_stat_t checksum_stat;
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<states.size(); i++){
+        check(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, /* rid */ 1, i, 0, &i, sizeof(i), states[i], kStateSize
+        ), "append");
+    }
+    checksum_stat = writer->get_checksum_stat();
+    check(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir), "seal");
+
+    return checksum_stat;
+}
+
+
+/*!
+ *  \brief  flip a byte of the image file at the given offset
+ */
+static void corrupt(uint64_t offset){
+    int fd;
+    uint8_t byte;
+
+    check((fd = ::open((kCkptDir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), O_RDWR)) >= 0, "open image");
+    check(pread(fd, &byte, 1, offset) == 1, "read image");
+    byte ^= 0xff;
+    check(pwrite(fd, &byte, 1, offset) == 1, "write image");
+    close(fd);
+}
+
+
+/*!
+ *  \brief  corrupt one byte of the state of the given handle, and check that verification fails
+ *  \param  name        name of the case
+ *  \param  id          index of the corrupted state
+ *  \param  is_chunked  whether the state is stored as deduplicated chunks
+ *  \param  nb_sharers  number of records that refer to the corrupted state
+ */
+static void run_corruption(
+    const std::string& name, uint64_t id, bool is_chunked, uint64_t nb_sharers, std::vector<uint8_t*>& states
+){
+    const pos_ckpt_image_entry_t *entry;
+    pos_ckpt_image_verify_stat_t stat;
+    uint64_t offset;
+
+    dump(states);
+
+    // locate the byte in the middle of the state through the reader, before it's corrupted
+    {
+        POSCheckpointImage image;
+        check(POS_SUCCESS == image.open(kCkptDir), "open");
+        check((entry = image.find(kPOS_CkptImageRecord_Handle, 1, id)) != nullptr, "find");
+        check(((entry->flags & kPOS_CkptImageEntryFlag_Chunked) != 0) == is_chunked, "layout of the record");
+        if(is_chunked){
+            // new chunks of a state are stored back to back, right ahead of its record
+            offset = entry->offset - kStateSize / 2;
+        } else {
+            offset = entry->offset + entry->size - kStateSize / 2;
+        }
+    }
+    corrupt(offset);
+
+    POSCheckpointImage image;
+    check(POS_SUCCESS == image.open(kCkptDir), "open");
+    check(POS_FAILED_INCORRECT_OUTPUT == image.verify_all(&stat), "corruption detected");
+    check(POS_FAILED_INCORRECT_OUTPUT == image.verify(image.find(kPOS_CkptImageRecord_Handle, 1, id)), "corrupted record");
+    check(POS_SUCCESS == image.verify(image.find(kPOS_CkptImageRecord_Handle, 1, id + nb_sharers)), "intact record");
+    check(stat.nb_corrupted_records == nb_sharers, "number of corrupted records");
+
+    printf(
+        "[corrupt %-6s] #records: %2lu, #corrupted records: %lu, #chunks: %4lu, #corrupted chunks: %lu\n",
+        name.c_str(), stat.nb_records, stat.nb_corrupted_records, stat.nb_chunks, stat.nb_corrupted_chunks
+    );
+    fflush(stdout);
+}
+
+
+int main(){
+    uint64_t i, s_ns, dump_ns;
+    std::mt19937_64 rng(1);
+    std::vector<uint8_t*> states;
+    uint8_t *state;
+    pos_ckpt_image_checksum_stat_t checksum_stat;
+    pos_ckpt_image_verify_stat_t verify_stat;
+
+    for(i=0; i<kNbStates; i++){
+        POS_CHECK_POINTER(state = (uint8_t*)aligned_alloc(KB(4), kStateSize));
+        for(uint64_t k=0; k<kStateSize; k+=8){ *reinterpret_cast<uint64_t*>(state + k) = rng(); }
+        states.push_back(state);
+    }
+
+    // checksum overhead on the persist path, for raw records and for deduplicated chunks
+    for(uint64_t chunk_size : { 0ul, MB(1) }){
+        POSCheckpointImageWriter::dedup_chunk_size = chunk_size;
+        s_ns = get_ns();
+        checksum_stat = dump(states);
+        dump_ns = get_ns() - s_ns;
+        printf(
+            "[dump, %-7s] size: %lu MB, dump: %6.2f ms, checksum: %5.2f ms (%4.1f%% of dump, %4.1f%% before seal), "
+            "checksum: %5.2f GB/s\n",
+            chunk_size > 0 ? "chunked" : "raw", checksum_stat.nb_bytes / MB(1), (double)dump_ns / 1e6,
+            (double)checksum_stat.checksum_ns / 1e6, (double)checksum_stat.checksum_ns * 100.0 / dump_ns,
+            checksum_stat.get_overhead_percent(),
+            (double)checksum_stat.nb_bytes / checksum_stat.checksum_ns
+        );
+        fflush(stdout);
+
+        // parallel verification of the whole image
+        for(uint32_t nb_threads : { 1u, 2u, 4u, 8u }){
+            POSCheckpointImage image;
+            check(POS_SUCCESS == POSPersistExecutor::get_instance()->init(nb_threads), "init persist executor");
+            check(POS_SUCCESS == image.open(kCkptDir), "open");
+            check(POS_SUCCESS == image.verify_all(&verify_stat), "verify");
+            // the chunk table is a record as well
+            check(
+                verify_stat.nb_records == kNbStates + (chunk_size > 0 ? 1 : 0) && verify_stat.nb_corrupted_records == 0,
+                "verified records"
+            );
+            printf(
+                "[verify, %-7s, %u threads] #records: %lu, #chunks: %3lu, size: %lu MB, duration: %6.2f ms, "
+                "throughput: %5.2f GB/s\n",
+                chunk_size > 0 ? "chunked" : "raw", nb_threads, verify_stat.nb_records, verify_stat.nb_chunks,
+                verify_stat.nb_bytes / MB(1), verify_stat.duration_ms,
+                (double)verify_stat.nb_bytes / verify_stat.duration_ms / 1e6
+            );
+            fflush(stdout);
+        }
+    }
+
+    // corrupt a byte of a raw record, and of a chunk shared by two records
+    POSCheckpointImageWriter::dedup_chunk_size = 0;
+    run_corruption("record", /* id */ 3, /* is_chunked */ false, /* nb_sharers */ 1, states);
+
+    memcpy(states[4], states[3], kStateSize);
+    POSCheckpointImageWriter::dedup_chunk_size = MB(1);
+    run_corruption("chunk", /* id */ 3, /* is_chunked */ true, /* nb_sharers */ 2, states);
+
+    for(uint8_t *s : states){ free(s); }
+    std::filesystem::remove_all(kCkptDir);
+
+    return 0;
+}
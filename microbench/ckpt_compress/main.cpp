@@ -0,0 +1,193 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure compression of persisted state, write the states of mocked memory handles to a
+ *          checkpoint image with each codec and number of persist threads, then read them back through
+ *          the image reader (which decompresses frames in parallel) and check them
+ *  \note   the mocked states mix what a training job checkpoints: activations after ReLU (fp16, about half
+ *          are zero, in runs), optimizer states (fp32 with narrow exponents), and weights (fp32, close to
+ *          random); each kind is a resource type, so that codecs could be chosen by type
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <filesystem>
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "pos/include/common.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_codec.h"
+#include "pos/include/persist_executor.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kStateSize = MB(16);
+constexpr uint64_t kNbStatesPerKind = 8;
+const std::string kCkptDir = "/tmp/pos_mb_ckpt_compress";
+
+enum state_kind_t : pos_resource_typeid_t {
+    kActivation = 1,
+    kOptimizerState,
+    kWeight
+};
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+static void fill_state(state_kind_t kind, uint8_t* data, uint64_t size, std::mt19937_64& rng){
+    uint64_t i, run_length = 0;
+    uint16_t half;
+    bool is_zero_run = false;
+    float value;
+    std::normal_distribution<float> weight_dist(0.0f, 0.02f);
+    std::uniform_real_distribution<float> moment_dist(1e-6f, 4e-6f);
+
+    switch(kind){
+    case kActivation:
+        // fp16 after ReLU: non-negative, about half are zero, and zeros come in runs as neighbouring
+        // elements of a feature map are correlated
+        for(i=0; i+2<=size; i+=2){
+            if(run_length == 0){ run_length = 1 + rng() % 32; is_zero_run = rng() & 1; }
+            half = is_zero_run ? 0 : static_cast<uint16_t>(0x3000 + (rng() & 0x0fff));
+            memcpy(data + i, &half, 2);
+            run_length -= 1;
+        }
+        break;
+    case kOptimizerState:
+        for(i=0; i+4<=size; i+=4){ value = moment_dist(rng); memcpy(data + i, &value, 4); }
+        break;
+    default:
+        for(i=0; i+4<=size; i+=4){ value = weight_dist(rng); memcpy(data + i, &value, 4); }
+    }
+}
+
+
+static void run(
+    const std::string& name, const std::map<pos_resource_typeid_t, pos_ckpt_codec_t>& codecs, uint32_t nb_threads,
+    std::vector<std::pair<state_kind_t, uint8_t*>>& states
+){
+    uint64_t i, s_ns, write_ns, read_ns, meta_size, section_size, stored_size[3] = { 0 };
+    POSCheckpointImageWriter *writer;
+    POSCheckpointImage image;
+    pos_ckpt_image_compress_stat_t compress_stat;
+    const pos_ckpt_image_entry_t *entry;
+    void *meta, *section;
+    struct stat sb;
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+    check(POS_SUCCESS == POSPersistExecutor::get_instance()->init(nb_threads), "init persist executor");
+
+    POSCheckpointImageWriter::compress_codecs = codecs;
+
+    s_ns = get_ns();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<states.size(); i++){
+        check(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, states[i].first, i, 0, &i, sizeof(i), states[i].second, kStateSize
+        ), "append");
+    }
+    compress_stat = writer->get_compress_stat();
+    check(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir), "seal");
+    write_ns = get_ns() - s_ns;
+
+    check(stat((kCkptDir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), &sb) == 0, "stat");
+
+    // read back, compressed sections are decompressed on access
+    s_ns = get_ns();
+    check(POS_SUCCESS == image.open(kCkptDir), "open");
+    for(i=0; i<states.size(); i++){
+        check((entry = image.find(kPOS_CkptImageRecord_Handle, states[i].first, i)) != nullptr, "find");
+        check(POS_SUCCESS == image.get_section(entry, &meta, &meta_size, &section, &section_size), "get section");
+        check(section_size == kStateSize && memcmp(section, states[i].second, kStateSize) == 0, "restored state");
+        stored_size[states[i].first - kActivation] += entry->size;
+    }
+    read_ns = get_ns() - s_ns;
+
+    printf(
+        "[%-5s, %u threads] image: %7.2f MB, ratio: %4.2f (act %4.2f, opt %4.2f, weight %4.2f), "
+        "#raw frames: %3lu/%3lu, write: %5.2f GB/s, read: %5.2f GB/s\n",
+        name.c_str(), nb_threads, (double)sb.st_size / MB(1),
+        (double)(states.size() * kStateSize) / sb.st_size,
+        (double)(kNbStatesPerKind * kStateSize) / stored_size[0], (double)(kNbStatesPerKind * kStateSize) / stored_size[1],
+        (double)(kNbStatesPerKind * kStateSize) / stored_size[2],
+        compress_stat.nb_raw_frames, compress_stat.nb_frames,
+        (double)(states.size() * kStateSize) / write_ns, (double)(states.size() * kStateSize) / read_ns
+    );
+    fflush(stdout);
+}
+
+
+int main(){
+    uint64_t i;
+    std::mt19937_64 rng(1);
+    std::vector<std::pair<state_kind_t, uint8_t*>> states;
+    uint8_t *state;
+    std::map<pos_resource_typeid_t, pos_ckpt_codec_t> codecs;
+
+    for(state_kind_t kind : { kActivation, kOptimizerState, kWeight }){
+        for(i=0; i<kNbStatesPerKind; i++){
+            POS_CHECK_POINTER(state = (uint8_t*)aligned_alloc(KB(4), kStateSize));
+            fill_state(kind, state, kStateSize, rng);
+            states.push_back(std::make_pair(kind, state));
+        }
+    }
+
+    for(pos_ckpt_codec_t codec : { kPOS_CkptCodec_None, kPOS_CkptCodec_LZ4, kPOS_CkptCodec_Zstd }){
+        if(!POSCheckpointCodec::get_instance()->is_available(codec)){
+            printf("[%-4s] unavailable, skipped\n", POSCheckpointCodec::get_name(codec));
+            continue;
+        }
+        codecs.clear();
+        if(codec != kPOS_CkptCodec_None){
+            for(state_kind_t kind : { kActivation, kOptimizerState, kWeight }){ codecs[kind] = codec; }
+        }
+        for(uint32_t nb_threads : { 1u, 2u, 4u, 8u }){
+            run(POSCheckpointCodec::get_name(codec), codecs, nb_threads, states);
+        }
+    }
+
+    // codec chosen by type: LZ4 for activations, zstd for optimizer states, weights are stored as is
+    if(     POSCheckpointCodec::get_instance()->is_available(kPOS_CkptCodec_LZ4)
+        &&  POSCheckpointCodec::get_instance()->is_available(kPOS_CkptCodec_Zstd)
+    ){
+        codecs.clear();
+        codecs[kActivation] = kPOS_CkptCodec_LZ4;
+        codecs[kOptimizerState] = kPOS_CkptCodec_Zstd;
+        for(uint32_t nb_threads : { 1u, 2u, 4u, 8u }){
+            run("mixed", codecs, nb_threads, states);
+        }
+    }
+
+    for(auto &pair : states){ free(pair.second); }
+    std::filesystem::remove_all(kCkptDir);
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure content-addressed deduplication of checkpoint chunks
+ *          [1] hashing: throughput of the chunk hash and zero detection on a single core, along with
+ *              CRC32C as the reference
+ *          [2] image: write the states of mocked memory handles to a checkpoint image with and without
+ *              deduplication, then read them back through the image reader and check them
+ *  \note   the mocked states mix what a training job checkpoints: zero-initialized buffers (gradients,
+ *          optimizer states at step 0), replicated weights, partially zero buffers (padded embeddings),
+ *          and unique weights
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <filesystem>
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "pos/include/common.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/utils/chunk_hash.h"
+#include "pos/include/utils/crc32c.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kHashBufferSize = MB(256);
+constexpr uint64_t kStateSize = MB(4);
+constexpr uint64_t kNbUniqueStates = 32;
+constexpr uint64_t kNbReplicas = 4;
+constexpr uint64_t kNbZeroStates = 64;
+constexpr uint64_t kNbPaddedStates = 32;
+const std::string kCkptDir = "/tmp/pos_mb_ckpt_dedup";
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+static void fill_random(uint8_t* data, uint64_t size, std::mt19937_64& rng){
+    uint64_t i, word;
+    for(i=0; i+8<=size; i+=8){ word = rng(); memcpy(data + i, &word, 8); }
+    for(; i<size; i++){ data[i] = rng() & 0xff; }
+}
+
+
+static void run_hash(){
+    uint64_t i, s_ns, e_ns, checksum = 0, nb_zero = 0;
+    std::mt19937_64 rng(0);
+    uint8_t *buffer, *zeros;
+    pos_chunk_hash_t hash;
+
+    POS_CHECK_POINTER(buffer = (uint8_t*)aligned_alloc(KB(4), kHashBufferSize));
+    POS_CHECK_POINTER(zeros = (uint8_t*)aligned_alloc(KB(4), kHashBufferSize));
+    fill_random(buffer, kHashBufferSize, rng);
+    memset(zeros, 0, kHashBufferSize);
+
+    for(uint64_t chunk_size : { (uint64_t)KB(4), (uint64_t)KB(64), (uint64_t)MB(1) }){
+        s_ns = get_ns();
+        for(i=0; i<kHashBufferSize; i+=chunk_size){
+            hash = POSUtilChunkHash::calculate(buffer + i, chunk_size);
+            checksum ^= hash.lo ^ hash.hi;
+        }
+        e_ns = get_ns();
+        printf("[hash     ] chunk %5lu KB: %6.2f GB/s\n", chunk_size / KB(1), (double)kHashBufferSize / (e_ns - s_ns));
+
+        s_ns = get_ns();
+        for(i=0; i<kHashBufferSize; i+=chunk_size){
+            nb_zero += POSUtilChunkHash::is_zero(zeros + i, chunk_size);
+        }
+        e_ns = get_ns();
+        printf("[zero scan] chunk %5lu KB: %6.2f GB/s\n", chunk_size / KB(1), (double)kHashBufferSize / (e_ns - s_ns));
+
+        s_ns = get_ns();
+        for(i=0; i<kHashBufferSize; i+=chunk_size){ checksum ^= POSUtilCrc32c::calculate(buffer + i, chunk_size); }
+        e_ns = get_ns();
+        printf("[crc32c   ] chunk %5lu KB: %6.2f GB/s\n", chunk_size / KB(1), (double)kHashBufferSize / (e_ns - s_ns));
+        fflush(stdout);
+    }
+
+    // a chunk differing in a single byte must hash differently
+    hash = POSUtilChunkHash::calculate(buffer, KB(64));
+    buffer[KB(32)] ^= 1;
+    check(hash != POSUtilChunkHash::calculate(buffer, KB(64)), "single-byte difference changes the hash");
+    check(nb_zero == kHashBufferSize / KB(4) + kHashBufferSize / KB(64) + kHashBufferSize / MB(1), "zero scan");
+    check(!POSUtilChunkHash::is_zero(buffer, kHashBufferSize), "non-zero scan");
+    printf("[hash     ] digest of all hashes / checksums: %016lx\n", checksum);
+
+    free(buffer);
+    free(zeros);
+}
+
+
+static void run_image(uint64_t chunk_size, std::vector<uint8_t*>& states){
+    uint64_t i, s_ns, write_ns, read_ns, meta_size, section_size;
+    POSCheckpointImageWriter *writer;
+    POSCheckpointImage image;
+    pos_ckpt_image_dedup_stat_t dedup_stat;
+    const pos_ckpt_image_entry_t *entry;
+    void *meta, *section;
+    struct stat sb;
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+    POSCheckpointImageWriter::dedup_chunk_size = chunk_size;
+
+    s_ns = get_ns();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<states.size(); i++){
+        check(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, 0, i, 0, &i, sizeof(i), states[i], kStateSize
+        ), "append");
+    }
+    dedup_stat = writer->get_dedup_stat();
+    check(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir), "seal");
+    write_ns = get_ns() - s_ns;
+
+    check(stat((kCkptDir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), &sb) == 0, "stat");
+
+    // read back, chunked sections are assembled on access
+    s_ns = get_ns();
+    check(POS_SUCCESS == image.open(kCkptDir), "open");
+    for(i=0; i<states.size(); i++){
+        check((entry = image.find(kPOS_CkptImageRecord_Handle, 0, i)) != nullptr, "find");
+        check(POS_SUCCESS == image.verify(entry), "verify");
+        check(POS_SUCCESS == image.get_section(entry, &meta, &meta_size, &section, &section_size), "get section");
+        check(section_size == kStateSize && memcmp(section, states[i], kStateSize) == 0, "restored state");
+        // as the client does once the state is reloaded
+        image.release_section(entry);
+    }
+    read_ns = get_ns() - s_ns;
+
+    // a released section is assembled again on its next access
+    check((entry = image.find(kPOS_CkptImageRecord_Handle, 0, 0)) != nullptr, "find");
+    check(POS_SUCCESS == image.get_section(entry, &meta, &meta_size, &section, &section_size), "get released section");
+    check(section_size == kStateSize && memcmp(section, states[0], kStateSize) == 0, "reassembled state");
+
+    if(chunk_size == 0){
+        printf(
+            "[no dedup      ] image: %7.2f MB, write: %7.2f ms, read: %7.2f ms\n",
+            (double)sb.st_size / MB(1), (double)write_ns / 1e6, (double)read_ns / 1e6
+        );
+    } else {
+        printf(
+            "[dedup %5lu KB] image: %7.2f MB, write: %7.2f ms, read: %7.2f ms, dedup ratio: %5.2f, "
+            "#chunks: %6lu, #zero: %6lu, #unique: %6lu\n",
+            chunk_size / KB(1), (double)sb.st_size / MB(1), (double)write_ns / 1e6, (double)read_ns / 1e6,
+            dedup_stat.get_dedup_ratio(), dedup_stat.nb_chunks, dedup_stat.nb_zero_chunks, dedup_stat.nb_unique_chunks
+        );
+    }
+    fflush(stdout);
+}
+
+
+int main(){
+    uint64_t i, j;
+    std::mt19937_64 rng(1);
+    std::vector<uint8_t*> states;
+    uint8_t *state;
+
+    run_hash();
+
+    // unique weights, each replicated several times (e.g., data-parallel replicas in one process)
+    for(i=0; i<kNbUniqueStates; i++){
+        POS_CHECK_POINTER(state = (uint8_t*)aligned_alloc(KB(4), kStateSize));
+        fill_random(state, kStateSize, rng);
+        states.push_back(state);
+        for(j=1; j<kNbReplicas; j++){
+            POS_CHECK_POINTER(state = (uint8_t*)aligned_alloc(KB(4), kStateSize));
+            memcpy(state, states.back(), kStateSize);
+            states.push_back(state);
+        }
+    }
+
+    // zero-initialized buffers
+    for(i=0; i<kNbZeroStates; i++){
+        POS_CHECK_POINTER(state = (uint8_t*)aligned_alloc(KB(4), kStateSize));
+        memset(state, 0, kStateSize);
+        states.push_back(state);
+    }
+
+    // partially zero buffers, only the leading part is written
+    for(i=0; i<kNbPaddedStates; i++){
+        POS_CHECK_POINTER(state = (uint8_t*)aligned_alloc(KB(4), kStateSize));
+        memset(state, 0, kStateSize);
+        fill_random(state, rng() % kStateSize, rng);
+        states.push_back(state);
+    }
+
+    for(uint64_t chunk_size : { 0ul, (uint64_t)KB(4), (uint64_t)KB(64), (uint64_t)MB(1) }){
+        run_image(chunk_size, states);
+    }
+
+    for(uint8_t *state : states){ free(state); }
+    std::filesystem::remove_all(kCkptDir);
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure incremental checkpoint of a memory handle with delta chains, comparing
+ *          [1] full: copy the whole state on every checkpoint
+ *          [2] delta: copy only the chunks modified since the previous checkpoint (POSCheckpointDeltaChain)
+ *  \note   the "device" state is a host buffer split into tensors; each training step rewrites a
+ *          fraction of the tensors (by bytes), then a checkpoint is taken; after all steps, the state
+ *          is restored by applying the base and then deltas in order, through the same serialized
+ *          metadata that is appended to checkpoint images, and checked against the live state
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <random>
+#include <algorithm>
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pos/include/common.h"
+#include "pos/include/checkpoint_delta.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kStateSize = MB(64);
+constexpr uint64_t kNbTensors = 256;
+constexpr uint64_t kNbSteps = 32;
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  pooled allocator of slots by power-of-two size classes, as slots are recycled by the
+ *          checkpoint arena at runtime, so that commits aren't charged with page faults of fresh memory
+ */
+static std::map<uint64_t, std::vector<void*>> slot_pool;
+static std::map<void*, uint64_t> slot_classes;
+
+static void* slot_alloc(uint64_t size){
+    uint64_t size_class = 1;
+    void *ptr;
+
+    while(size_class < size){ size_class <<= 1; }
+    if(slot_pool[size_class].size() > 0){
+        ptr = slot_pool[size_class].back();
+        slot_pool[size_class].pop_back();
+        return ptr;
+    }
+    POS_CHECK_POINTER(ptr = malloc(size_class));
+    slot_classes[ptr] = size_class;
+    return ptr;
+}
+
+static void slot_free(void* ptr){ slot_pool[slot_classes[ptr]].push_back(ptr); }
+
+static void slot_pool_clear(){
+    for(auto &pair : slot_classes){ free(pair.first); }
+    slot_classes.clear();
+    slot_pool.clear();
+}
+
+
+static void run(uint64_t dirty_percent, uint64_t chunk_size){
+    uint64_t i, j, s_ns, offset, nb_dirty_bytes, full_ns = 0, delta_ns = 0, full_restore_ns, delta_restore_ns;
+    std::mt19937_64 rng(dirty_percent * 131 + chunk_size);
+    std::vector<uint64_t> tensor_offsets, tensor_sizes, order;
+    std::string meta;
+    uint8_t *state, *full_slot, *restored;
+    POSCheckpointDeltaChain chain(kStateSize, slot_alloc, slot_free, chunk_size, /* base_interval */ 8);
+
+    POS_CHECK_POINTER(state = (uint8_t*)malloc(kStateSize));
+    POS_CHECK_POINTER(full_slot = (uint8_t*)malloc(kStateSize));
+    POS_CHECK_POINTER(restored = (uint8_t*)malloc(kStateSize));
+    memset(state, 1, kStateSize);
+    memset(full_slot, 1, kStateSize);
+    memset(restored, 1, kStateSize);
+
+    // tensors of random sizes, not aligned to chunks
+    for(offset=0, i=0; i<kNbTensors; i++){
+        tensor_offsets.push_back(offset);
+        tensor_sizes.push_back(i == kNbTensors - 1 ? kStateSize - offset : (kStateSize / kNbTensors) / 2 + rng() % (kStateSize / kNbTensors));
+        if(offset + tensor_sizes.back() > kStateSize){ tensor_sizes.back() = kStateSize - offset; }
+        offset += tensor_sizes.back();
+        order.push_back(i);
+    }
+
+    for(i=0; i<kNbSteps; i++){
+        // rewrite tensors until the dirty ratio is reached, as the worker records output views
+        if(i > 0){
+            std::shuffle(order.begin(), order.end(), rng);
+            for(nb_dirty_bytes=0, j=0; j<kNbTensors && nb_dirty_bytes * 100 < kStateSize * dirty_percent; j++){
+                memset(state + tensor_offsets[order[j]], (int)(rng() & 0xff), tensor_sizes[order[j]]);
+                chain.record_modified_range(tensor_offsets[order[j]], tensor_sizes[order[j]]);
+                nb_dirty_bytes += tensor_sizes[order[j]];
+            }
+        }
+
+        s_ns = get_ns();
+        memcpy(full_slot, state, kStateSize);
+        full_ns += get_ns() - s_ns;
+
+        s_ns = get_ns();
+        check(POS_SUCCESS == chain.commit(
+            /* version */ i,
+            [&](void* dst, uint64_t offset, uint64_t size) -> pos_retval_t {
+                memcpy(dst, state + offset, size);
+                return POS_SUCCESS;
+            }
+        ), "commit");
+        delta_ns += get_ns() - s_ns;
+    }
+
+    // restore: a single full copy
+    s_ns = get_ns();
+    memcpy(restored, full_slot, kStateSize);
+    full_restore_ns = get_ns() - s_ns;
+    check(memcmp(restored, state, kStateSize) == 0, "restored state from the full copy");
+    memset(restored, 1, kStateSize);
+
+    // restore: the base and then deltas in order, through serialized metadata
+    const std::vector<pos_ckpt_delta_link_t>& links = chain.get_links();
+    s_ns = get_ns();
+    memcpy(restored, links[0].slot->expose_pointer(), kStateSize);
+    for(j=1; j<links.size(); j++){
+        chain.serialize_delta_meta(links[j], /* seq */ j, meta);
+        check(POS_SUCCESS == POSCheckpointDeltaChain::apply_delta(
+            meta.data(), meta.size(), links[j].slot->expose_pointer(), links[j].slot->get_state_size(),
+            [&](const void* src, uint64_t offset, uint64_t size) -> pos_retval_t {
+                memcpy(restored + offset, src, size);
+                return POS_SUCCESS;
+            }
+        ), "apply delta");
+    }
+    delta_restore_ns = get_ns() - s_ns;
+    check(memcmp(restored, state, kStateSize) == 0, "restored state from the chain");
+
+    const pos_ckpt_delta_stat_t& stat = chain.get_stat();
+    printf(
+        "[dirty %3lu%%, chunk %5lu KB] full: %7.2f ms/ckpt, delta: %7.2f ms/ckpt, copied: %6.2f%%, "
+        "#bases: %2lu, #deltas: %2lu, restore full: %6.2f ms, restore chain(%lu links): %6.2f ms\n",
+        dirty_percent, chunk_size / KB(1),
+        (double)full_ns / kNbSteps / 1e6, (double)delta_ns / kNbSteps / 1e6,
+        (double)stat.nb_copied_bytes * 100.0 / stat.nb_full_bytes,
+        stat.nb_bases, stat.nb_deltas,
+        (double)full_restore_ns / 1e6, links.size(), (double)delta_restore_ns / 1e6
+    );
+    fflush(stdout);
+
+    free(state);
+    free(full_slot);
+    free(restored);
+}
+
+
+int main(){
+    for(uint64_t dirty_percent : { 1ul, 10ul, 40ul, 100ul }){
+        for(uint64_t chunk_size : { (uint64_t)KB(4), (uint64_t)KB(64), (uint64_t)MB(1) }){
+            run(dirty_percent, chunk_size);
+            slot_pool_clear();
+        }
+    }
+
+    return 0;
+}
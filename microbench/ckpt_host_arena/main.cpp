@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare checkpoint copy bandwidth into slots allocated by new[] (first-touch faults on
+ *          every round) against slots drawn from the pre-faulted checkpoint arena (host mode)
+ *  \note   also check per-client quota and statistics of the arena
+ */
+
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pos/include/checkpoint.h"
+#include "pos/include/checkpoint_arena.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbHandles = 64;
+constexpr uint64_t kStateSize = MB(4);
+constexpr uint64_t kNbRounds = 10;
+
+
+static double copy_round(std::vector<uint8_t*>& dsts, uint8_t* src){
+    uint64_t i, s_tick, e_tick;
+    double duration_s;
+
+    s_tick = get_tsc();
+    for(i=0; i<dsts.size(); i++){
+        memcpy(dsts[i], src, kStateSize);
+    }
+    e_tick = get_tsc();
+
+    duration_s = POS_TSC_RANGE_TO_SEC(e_tick, s_tick);
+    return (double)(kNbHandles * kStateSize) / (double)MB(1) / duration_s;
+}
+
+
+int main(){
+    uint64_t r, i;
+    uint8_t *src;
+    std::vector<uint8_t*> dsts;
+    std::vector<POSCheckpointSlot*> slots;
+    POSCheckpointArena *arena;
+    pos_ckpt_arena_stat_t stat;
+    POSCheckpointSlot *slot;
+    double bw;
+
+    src = new uint8_t[kStateSize];
+    memset(src, 1, kStateSize);
+
+    printf("#handles: %lu, state size: %lu MB, #rounds: %lu\n", kNbHandles, kStateSize / MB(1), kNbRounds);
+
+    // case 1: new[] on every round
+    for(r=0; r<kNbRounds; r++){
+        for(i=0; i<kNbHandles; i++){ dsts.push_back(new uint8_t[kStateSize]); }
+        bw = copy_round(dsts, src);
+        printf("[new[]]  round %2lu: %8.2f MB/s\n", r, bw);
+        for(i=0; i<kNbHandles; i++){ delete[] dsts[i]; }
+        dsts.clear();
+    }
+
+    // case 2: slots drawn from the pre-faulted arena
+    arena = POSCheckpointArena::get_instance();
+    if(POS_SUCCESS != arena->init(kPOS_CkptArenaMode_Host, MB(64), (kNbHandles * kStateSize) / MB(64) + 1)){
+        printf("failed to init checkpoint arena\n");
+        return 1;
+    }
+    for(r=0; r<kNbRounds; r++){
+        for(i=0; i<kNbHandles; i++){
+            slot = new POSCheckpointSlot(
+                kStateSize, nullptr, nullptr, kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host
+            );
+            slots.push_back(slot);
+            dsts.push_back(reinterpret_cast<uint8_t*>(slot->expose_pointer()));
+        }
+        bw = copy_round(dsts, src);
+        printf("[arena]  round %2lu: %8.2f MB/s\n", r, bw);
+        for(i=0; i<kNbHandles; i++){ delete slots[i]; }
+        slots.clear();
+        dsts.clear();
+    }
+
+    arena->get_stat(stat);
+    printf(
+        "arena: reserved(%lu MB), allocated(%lu MB), #chunks(%lu), #hugepage_chunks(%lu), "
+        "#alloc(%lu), #free(%lu), #reuse(%lu)\n",
+        stat.reserved_size / MB(1), stat.allocated_size / MB(1), stat.nb_chunks, stat.nb_hugepage_chunks,
+        stat.nb_alloc, stat.nb_free, stat.nb_reuse
+    );
+
+    // case 3: quota of a client
+    POSCheckpointArena::set_thread_client(1);
+    arena->set_client_quota(1, 2 * kStateSize);
+    for(i=0; i<3; i++){
+        slot = new POSCheckpointSlot(
+            kStateSize, nullptr, nullptr, kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host
+        );
+        slots.push_back(slot);
+    }
+    arena->get_client_stat(1, stat);
+    printf(
+        "client 1: quota(%lu MB), allocated(%lu MB), #rejected(%lu), 3rd slot %s\n",
+        stat.quota / MB(1), stat.allocated_size / MB(1), stat.nb_rejected,
+        slots[2]->expose_pointer() == nullptr ? "rejected as expected" : "NOT rejected"
+    );
+    for(i=0; i<slots.size(); i++){ delete slots[i]; }
+
+    delete[] src;
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare dumping / restoring checkpoint records as one file per record (the previous
+ *          h-<rid>-<id>.bin layout) against the single-file checkpoint image with trailing index
+ */
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/utils/crc32c.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbSmallRecords = 20000;
+constexpr uint64_t kNbLargeRecords = 64;
+constexpr uint64_t kLargeRecordSize = MB(1);
+constexpr pos_resource_typeid_t kNbResourceTypes = 8;
+
+
+typedef struct record {
+    pos_resource_typeid_t rid;
+    pos_u64id_t hid;
+    std::string data;
+} record_t;
+
+
+static void generate_records(std::vector<record_t>& records){
+    uint64_t i, size;
+    record_t record;
+
+    srand(0);
+    for(i=0; i<kNbSmallRecords + kNbLargeRecords; i++){
+        record.rid = i % kNbResourceTypes;
+        record.hid = i / kNbResourceTypes;
+        size = i < kNbSmallRecords ? 64 + rand() % 4096 : kLargeRecordSize;
+        record.data.assign(size, static_cast<char>(i));
+        records.push_back(record);
+    }
+}
+
+
+/* ==================== one file per record ==================== */
+static double dump_files(const std::string& dir, std::vector<record_t>& records){
+    uint64_t i, s_tick, e_tick;
+    std::ofstream stream;
+
+    s_tick = get_tsc();
+    for(i=0; i<records.size(); i++){
+        stream.open(
+            dir + "/h-" + std::to_string(records[i].rid) + "-" + std::to_string(records[i].hid) + ".bin",
+            std::ios::binary | std::ios::out
+        );
+        stream.write(records[i].data.data(), records[i].data.size());
+        stream.close();
+    }
+    sync();
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double restore_files(const std::string& dir, uint64_t& nb_restored, uint32_t& crc){
+    uint64_t s_tick, e_tick;
+    int fd;
+    struct stat sb;
+    void *mapped;
+    std::string name, part;
+    std::vector<std::string> parts;
+    std::map<std::pair<pos_resource_typeid_t, pos_u64id_t>, std::string> files;
+
+    s_tick = get_tsc();
+
+    // walk the directory and parse file names
+    for(const auto& entry : std::filesystem::directory_iterator(dir)){
+        if(!entry.is_regular_file() || entry.path().extension() != ".bin"){ continue; }
+        name = entry.path().filename().string();
+        std::stringstream ss(name.substr(0, name.find_last_of('.')));
+        parts.clear();
+        while(std::getline(ss, part, '-')){ parts.push_back(part); }
+        files[std::make_pair(std::stoul(parts[1]), std::stoull(parts[2]))] = entry.path().string();
+    }
+
+    // open and mmap each file
+    nb_restored = 0; crc = 0;
+    for(auto& file : files){
+        fd = open(file.second.c_str(), O_RDONLY);
+        fstat(fd, &sb);
+        mapped = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        crc = POSUtilCrc32c::calculate(mapped, sb.st_size, crc);
+        munmap(mapped, sb.st_size);
+        close(fd);
+        nb_restored += 1;
+    }
+
+    e_tick = get_tsc();
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+/* ==================== single checkpoint image ==================== */
+static double dump_image(const std::string& dir, std::vector<record_t>& records){
+    uint64_t i, s_tick, e_tick;
+    POSCheckpointImageWriter *writer;
+
+    s_tick = get_tsc();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(dir));
+    for(i=0; i<records.size(); i++){
+        writer->append(
+            kPOS_CkptImageRecord_Handle, records[i].rid, records[i].hid, 0,
+            records[i].data.data(), records[i].data.size()
+        );
+    }
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(dir));
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double restore_image(const std::string& dir, uint64_t& nb_restored, uint32_t& crc){
+    uint64_t i, s_tick, e_tick;
+    POSCheckpointImage image;
+    std::vector<const pos_ckpt_image_entry_t*> entries;
+
+    s_tick = get_tsc();
+    POS_ASSERT(POS_SUCCESS == image.open(dir));
+    image.get_entries(kPOS_CkptImageRecord_Handle, entries);
+    nb_restored = 0; crc = 0;
+    for(i=0; i<entries.size(); i++){
+        POS_ASSERT(POS_SUCCESS == image.verify(entries[i]));
+        crc = POSUtilCrc32c::calculate(image.get_data(entries[i]), entries[i]->size, crc);
+        nb_restored += 1;
+    }
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+int main(){
+    std::vector<record_t> records;
+    std::string files_dir = "/tmp/pos_mb_ckpt_image/files", image_dir = "/tmp/pos_mb_ckpt_image/image";
+    uint64_t i, nb_restored_files, nb_restored_image, total_size = 0;
+    uint32_t crc_files, crc_image;
+    double dump_files_ms, dump_image_ms, restore_files_ms, restore_image_ms;
+
+    generate_records(records);
+    for(i=0; i<records.size(); i++){ total_size += records[i].data.size(); }
+
+    std::filesystem::remove_all("/tmp/pos_mb_ckpt_image");
+    std::filesystem::create_directories(files_dir);
+    std::filesystem::create_directories(image_dir);
+
+    dump_files_ms = dump_files(files_dir, records);
+    dump_image_ms = dump_image(image_dir, records);
+    restore_files_ms = restore_files(files_dir, nb_restored_files, crc_files);
+    restore_image_ms = restore_image(image_dir, nb_restored_image, crc_image);
+
+    printf("#records: %lu, total size: %lu MB\n", records.size(), total_size / MB(1));
+    printf("[per-record files] dump: %9.2f ms, restore: %9.2f ms, #restored: %lu\n", dump_files_ms, restore_files_ms, nb_restored_files);
+    printf("[checkpoint image] dump: %9.2f ms, restore: %9.2f ms, #restored: %lu\n", dump_image_ms, restore_image_ms, nb_restored_image);
+    printf("content %s\n", crc_files == crc_image ? "matched" : "MISMATCHED");
+
+    std::filesystem::remove_all("/tmp/pos_mb_ckpt_image");
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure throughput and p99 per-file latency of persisting / restoring checkpoint images
+ *          through the POSIX and io_uring I/O backends, under different queue depths and with / without
+ *          direct I/O, on tmpfs and local disk
+ *  \note   the state is stored in checkpoint slots drawn from the checkpoint arena, which are registered
+ *          to the backend
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pos/include/checkpoint_arena.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_io.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kDefaultFileSize = MB(16);
+constexpr uint64_t kDefaultNbFiles = 64;
+
+
+typedef struct mb_result {
+    double gbps;
+    double p99_ms;
+} mb_result_t;
+
+
+static mb_result_t summarize(std::vector<double>& latencies_ms, uint64_t total_size){
+    mb_result_t result;
+    double sum_ms = 0;
+
+    for(double latency_ms : latencies_ms){ sum_ms += latency_ms; }
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    result.gbps = (double)(total_size) / (double)(GB(1)) / (sum_ms / 1000.0);
+    result.p99_ms = latencies_ms[(latencies_ms.size() * 99 - 1) / 100];
+    return result;
+}
+
+
+/*!
+ *  \brief  persist each file as a sealed checkpoint image holding one raw section
+ */
+static mb_result_t persist_files(const std::string& root_dir, uint8_t* state, uint64_t file_size, uint64_t nb_files){
+    uint64_t i, s_tick, e_tick;
+    uint64_t meta = 0;
+    std::string ckpt_dir;
+    std::vector<double> latencies_ms;
+    POSCheckpointImageWriter *writer;
+
+    for(i=0; i<nb_files; i++){
+        ckpt_dir = root_dir + std::string("/") + std::to_string(i);
+        std::filesystem::create_directories(ckpt_dir);
+        state[0] = static_cast<uint8_t>(i);
+
+        s_tick = get_tsc();
+        POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(ckpt_dir));
+        meta = i;
+        POS_ASSERT(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, 1, i, 0, &meta, sizeof(meta), state, file_size
+        ));
+        POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(ckpt_dir));
+        e_tick = get_tsc();
+
+        latencies_ms.push_back(POS_TSC_RANGE_TO_MSEC(e_tick, s_tick));
+    }
+
+    return summarize(latencies_ms, file_size * nb_files);
+}
+
+
+/*!
+ *  \brief  restore the raw section of each file, with page cache of the file dropped in advance
+ */
+static mb_result_t restore_files(
+    const std::string& root_dir, uint8_t* dst, uint64_t file_size, uint64_t nb_files, bool& is_matched
+){
+    uint64_t i, s_tick, e_tick;
+    int fd;
+    std::string ckpt_dir;
+    std::vector<double> latencies_ms;
+    const pos_ckpt_image_entry_t *entry;
+
+    is_matched = true;
+    for(i=0; i<nb_files; i++){
+        ckpt_dir = root_dir + std::string("/") + std::to_string(i);
+
+        // the image is fsync-ed during sealing, so its pages are clean and could be dropped
+        fd = open((ckpt_dir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), O_RDONLY);
+        POS_ASSERT(fd >= 0);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+
+        s_tick = get_tsc();
+        {
+            POSCheckpointImage image;
+            POS_ASSERT(POS_SUCCESS == image.open(ckpt_dir));
+            POS_CHECK_POINTER(entry = image.find(kPOS_CkptImageRecord_Handle, 1, i));
+            POS_ASSERT(POS_SUCCESS == image.read_section(entry, dst, file_size));
+        }
+        e_tick = get_tsc();
+
+        latencies_ms.push_back(POS_TSC_RANGE_TO_MSEC(e_tick, s_tick));
+        if(dst[0] != static_cast<uint8_t>(i) || dst[file_size - 1] != 0x5a){ is_matched = false; }
+    }
+
+    return summarize(latencies_ms, file_size * nb_files);
+}
+
+
+int main(int argc, char** argv){
+    uint64_t file_size = kDefaultFileSize, nb_files = kDefaultNbFiles;
+    uint8_t *state, *dst;
+    bool is_matched;
+    pos_retval_t retval;
+    mb_result_t persist_result, restore_result;
+    pos_ckpt_io_options_t options;
+    pos_ckpt_io_stat_t stat;
+    POSCheckpointArena *arena;
+
+    typedef struct mb_config {
+        pos_ckpt_io_backend_type_t type;
+        uint32_t queue_depth;
+    } mb_config_t;
+    std::vector<mb_config_t> configs({
+        { kPOS_CkptIOBackend_Posix,     1   },
+        { kPOS_CkptIOBackend_IoUring,   1   },
+        { kPOS_CkptIOBackend_IoUring,   8   },
+        { kPOS_CkptIOBackend_IoUring,   32  },
+    });
+    std::vector<std::pair<std::string, std::string>> targets({
+        { "tmpfs",      "/dev/shm/pos_mb_ckpt_io_backend"   },
+        { "local disk", "/tmp/pos_mb_ckpt_io_backend"       },
+    });
+
+    if(argc > 1){ file_size = MB(strtoull(argv[1], nullptr, 10)); }
+    if(argc > 2){ nb_files = strtoull(argv[2], nullptr, 10); }
+
+    // checkpoint slots are registered to the I/O backend once the arena maps them
+    POS_CHECK_POINTER(arena = POSCheckpointArena::get_instance());
+    POS_ASSERT(POS_SUCCESS == arena->init(kPOS_CkptArenaMode_Host, file_size * 2 + MB(2)));
+    POS_CHECK_POINTER(state = reinterpret_cast<uint8_t*>(arena->alloc(file_size)));
+    POS_CHECK_POINTER(dst = reinterpret_cast<uint8_t*>(arena->alloc(file_size)));
+    memset(state, 0x5a, file_size);
+
+    printf(
+        "#files: %lu, file size: %lu MB, io_uring supported: %s\n",
+        nb_files, file_size / MB(1), POSCheckpointIOBackend_IoUring::is_supported() ? "yes" : "no"
+    );
+
+    for(auto &target : targets){
+        for(bool use_direct_io : { false, true }){
+            for(mb_config_t &config : configs){
+                options.type = config.type;
+                options.queue_depth = config.queue_depth;
+                options.use_direct_io = use_direct_io;
+                retval = POSCheckpointIOBackend::init(options);
+                if(retval != POS_SUCCESS && config.type == kPOS_CkptIOBackend_IoUring){ continue; }
+
+                std::filesystem::remove_all(target.second);
+                std::filesystem::create_directories(target.second);
+
+                persist_result = persist_files(target.second, state, file_size, nb_files);
+                restore_result = restore_files(target.second, dst, file_size, nb_files, is_matched);
+                POSCheckpointIOBackend::get_instance()->get_stat(stat);
+
+                printf(
+                    "[%-10s] %-8s qd: %2u, direct: %-3s | persist: %6.2f GB/s, p99: %8.2f ms"
+                    " | restore: %6.2f GB/s, p99: %8.2f ms | fixed: %3lu%%, content %s\n",
+                    target.first.c_str(), config.type == kPOS_CkptIOBackend_Posix ? "posix" : "io_uring",
+                    config.queue_depth, use_direct_io ? "on" : "off",
+                    persist_result.gbps, persist_result.p99_ms, restore_result.gbps, restore_result.p99_ms,
+                    stat.nb_requests > 0 ? stat.nb_fixed_requests * 100 / stat.nb_requests : 0,
+                    is_matched ? "matched" : "MISMATCHED"
+                );
+            }
+        }
+        std::filesystem::remove_all(target.second);
+    }
+
+    arena->free(state);
+    arena->free(dst);
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare dump / restore throughput of large handle states serialized inside the protobuf
+ *          (set_state + SerializeToString, ParseFromArray + copy out) against the raw state section
+ *          of the checkpoint image (written straight from the buffer, used in-place after mmap)
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pos/include/checkpoint_image.h"
+#include "mb_common/ticks.h"
+#include "handle.pb.h"
+
+
+constexpr uint64_t kDefaultBufferSize = MB(512);
+constexpr uint64_t kDefaultNbBuffers = 4;
+const std::string kCkptDir = "/tmp/pos_mb_ckpt_raw_section";
+
+
+/*!
+ *  \brief  generate the metadata of a mock memory handle
+ */
+static void fill_metadata(pos_protobuf::Bin_POSHandle& binary, uint64_t id, uint64_t size){
+    binary.set_id(id);
+    binary.set_resource_type_id(1);
+    binary.set_client_addr(0x7f0000000000ul + id * size);
+    binary.set_server_addr(0x7f0000000000ul + id * size);
+    binary.set_size(size);
+    binary.set_state_size(size);
+}
+
+
+/* ==================== state inside protobuf ==================== */
+static double dump_protobuf(std::vector<uint8_t*>& buffers, uint64_t buffer_size){
+    uint64_t i, s_tick, e_tick;
+    std::string serialized;
+    POSCheckpointImageWriter *writer;
+
+    s_tick = get_tsc();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<buffers.size(); i++){
+        pos_protobuf::Bin_POSHandle binary;
+        fill_metadata(binary, i, buffer_size);
+        binary.set_state(reinterpret_cast<const char*>(buffers[i]), buffer_size);
+        POS_ASSERT(binary.SerializeToString(&serialized));
+        POS_ASSERT(POS_SUCCESS == writer->append(
+            kPOS_CkptImageRecord_Handle, 1, i, 0, serialized.data(), serialized.size()
+        ));
+    }
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir));
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_SEC(e_tick, s_tick);
+}
+
+
+static double restore_protobuf(uint8_t* dst, uint64_t buffer_size, uint64_t nb_buffers, uint64_t& checksum){
+    uint64_t i, s_tick, e_tick;
+    POSCheckpointImage image;
+    const pos_ckpt_image_entry_t *entry;
+
+    checksum = 0;
+    s_tick = get_tsc();
+    POS_ASSERT(POS_SUCCESS == image.open(kCkptDir));
+    for(i=0; i<nb_buffers; i++){
+        pos_protobuf::Bin_POSHandle binary;
+        POS_CHECK_POINTER(entry = image.find(kPOS_CkptImageRecord_Handle, 1, i));
+        POS_ASSERT(binary.ParseFromArray(image.get_data(entry), entry->size));
+        POS_ASSERT(binary.state().size() == buffer_size);
+        // mimic cudaMemcpy to the device
+        memcpy(dst, binary.state().data(), buffer_size);
+        checksum += dst[i % buffer_size];
+    }
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_SEC(e_tick, s_tick);
+}
+
+
+/* ==================== raw state section ==================== */
+static double dump_raw_section(std::vector<uint8_t*>& buffers, uint64_t buffer_size){
+    uint64_t i, s_tick, e_tick;
+    std::string serialized;
+    POSCheckpointImageWriter *writer;
+
+    s_tick = get_tsc();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<buffers.size(); i++){
+        pos_protobuf::Bin_POSHandle binary;
+        fill_metadata(binary, i, buffer_size);
+        POS_ASSERT(binary.SerializeToString(&serialized));
+        POS_ASSERT(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, 1, i, 0, serialized.data(), serialized.size(), buffers[i], buffer_size
+        ));
+    }
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir));
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_SEC(e_tick, s_tick);
+}
+
+
+static double restore_raw_section(uint8_t* dst, uint64_t buffer_size, uint64_t nb_buffers, uint64_t& checksum){
+    uint64_t i, s_tick, e_tick, meta_size, section_size;
+    void *meta, *section;
+    POSCheckpointImage image;
+    const pos_ckpt_image_entry_t *entry;
+
+    checksum = 0;
+    s_tick = get_tsc();
+    POS_ASSERT(POS_SUCCESS == image.open(kCkptDir));
+    for(i=0; i<nb_buffers; i++){
+        pos_protobuf::Bin_POSHandle binary;
+        POS_CHECK_POINTER(entry = image.find(kPOS_CkptImageRecord_Handle, 1, i));
+        POS_ASSERT(POS_SUCCESS == image.get_section(entry, &meta, &meta_size, &section, &section_size));
+        POS_ASSERT(binary.ParseFromArray(meta, meta_size));
+        POS_ASSERT(section_size == buffer_size);
+        POS_ASSERT(reinterpret_cast<uint64_t>(section) % POSCheckpointImageWriter::kSectionAlignment == 0);
+        // mimic cudaMemcpy to the device
+        memcpy(dst, section, buffer_size);
+        checksum += dst[i % buffer_size];
+    }
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_SEC(e_tick, s_tick);
+}
+
+
+int main(int argc, char** argv){
+    uint64_t i, buffer_size = kDefaultBufferSize, nb_buffers = kDefaultNbBuffers, total_size;
+    uint64_t checksum_protobuf, checksum_raw_section, expected = 0;
+    double dump_protobuf_s, dump_raw_section_s, restore_protobuf_s, restore_raw_section_s;
+    std::vector<uint8_t*> buffers;
+    uint8_t *dst;
+
+    if(argc > 1){ buffer_size = MB(strtoull(argv[1], nullptr, 10)); }
+    if(argc > 2){ nb_buffers = strtoull(argv[2], nullptr, 10); }
+    total_size = buffer_size * nb_buffers;
+
+    for(i=0; i<nb_buffers; i++){
+        POS_CHECK_POINTER(buffers.emplace_back(reinterpret_cast<uint8_t*>(malloc(buffer_size))));
+        memset(buffers[i], static_cast<int>(i + 1), buffer_size);
+        expected += i + 1;
+    }
+    POS_CHECK_POINTER(dst = reinterpret_cast<uint8_t*>(malloc(buffer_size)));
+    memset(dst, 0, buffer_size);
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+    dump_protobuf_s = dump_protobuf(buffers, buffer_size);
+    restore_protobuf_s = restore_protobuf(dst, buffer_size, nb_buffers, checksum_protobuf);
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+    dump_raw_section_s = dump_raw_section(buffers, buffer_size);
+    restore_raw_section_s = restore_raw_section(dst, buffer_size, nb_buffers, checksum_raw_section);
+
+    printf("#buffers: %lu, buffer size: %lu MB, total size: %lu MB\n", nb_buffers, buffer_size / MB(1), total_size / MB(1));
+    printf(
+        "[protobuf state] dump: %8.2f MB/s, restore: %8.2f MB/s, content %s\n",
+        (double)(total_size / MB(1)) / dump_protobuf_s, (double)(total_size / MB(1)) / restore_protobuf_s,
+        checksum_protobuf == expected ? "matched" : "MISMATCHED"
+    );
+    printf(
+        "[raw section]    dump: %8.2f MB/s, restore: %8.2f MB/s, content %s\n",
+        (double)(total_size / MB(1)) / dump_raw_section_s, (double)(total_size / MB(1)) / restore_raw_section_s,
+        checksum_raw_section == expected ? "matched" : "MISMATCHED"
+    );
+
+    std::filesystem::remove_all(kCkptDir);
+    for(i=0; i<nb_buffers; i++){ free(buffers[i]); }
+    free(dst);
+
+    return 0;
+}
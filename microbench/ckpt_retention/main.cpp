@@ -0,0 +1,291 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  check the retention engine of checkpointed versions with mocked handles, and measure the
+ *          memory it keeps retained across checkpoint rounds and the cost of a sweep
+ *  \note   a mocked handle retains versions like a checkpoint bag: each round adds a version of the
+ *          handle's size, and reclaimed versions go to a free list that later rounds reuse
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pos/include/common.h"
+#include "pos/include/checkpoint_retention.h"
+#include "pos/include/utils/timer.h"
+#include "mb_common/check.h"
+
+
+/*!
+ *  \brief  mocked handle retaining checkpointed versions
+ */
+class MockHandle : public POSCheckpointRetentionTarget {
+ public:
+    MockHandle(uint64_t size) : size(size), nb_free_slots(0) {
+        POSCheckpointRetention::get_instance()->add_target(this);
+    }
+    ~MockHandle(){
+        POSCheckpointRetention::get_instance()->remove_target(this);
+    }
+
+    void checkpoint(uint64_t version, uint64_t tick){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        // reuse a reclaimed slot if any, as the bag does
+        if(this->nb_free_slots > 0){ this->nb_free_slots -= 1; }
+        this->_versions[version] = tick;
+    }
+
+    void get_retained_versions(std::vector<pos_ckpt_retained_version_t>& versions) override {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        pos_ckpt_retained_version_t retained;
+        for(auto &pair : this->_versions){
+            retained.target = this;
+            retained.version = pair.first;
+            retained.size = this->size;
+            retained.tick = pair.second;
+            versions.push_back(retained);
+        }
+    }
+
+    pos_retval_t reclaim_version(uint64_t version) override {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(this->_versions.erase(version) == 0){ return POS_FAILED_NOT_EXIST; }
+        this->nb_free_slots += 1;
+        return POS_SUCCESS;
+    }
+
+    uint64_t get_nb_versions(){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_versions.size();
+    }
+
+    bool has_version(uint64_t version){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_versions.count(version) > 0;
+    }
+
+    uint64_t size;
+    uint64_t nb_free_slots;
+
+ private:
+    std::map<uint64_t, uint64_t> _versions;
+    std::mutex _mutex;
+};
+
+
+static void set_policies(const std::string& desp){
+    std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>> policies;
+    check(POS_SUCCESS == POSCheckpointRetention::parse(desp, policies), "parse");
+    POSCheckpointRetention::get_instance()->set_policies(policies);
+}
+
+
+static void check_parse(){
+    std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>> policies;
+
+    check(POS_SUCCESS == POSCheckpointRetention::parse("budget:1024,last:2,age_ms:500", policies), "parse");
+    check(policies.size() == 3, "#policies");
+    check(policies[0]->get_name() == "last:2", "1st policy");
+    check(policies[1]->get_name() == "age_ms:500", "2nd policy");
+    check(policies[2]->get_name() == "budget:1024", "budget goes last");
+
+    check(POS_SUCCESS == POSCheckpointRetention::parse("", policies) && policies.size() == 0, "empty");
+    for(const char *desp : { "last:0", "last", "last:x", "keep:1", "last:2,budget:" }){
+        check(POS_FAILED_INVALID_INPUT == POSCheckpointRetention::parse(desp, policies), desp);
+        check(policies.size() == 0, "no policy on failure");
+    }
+    printf("[parse] passed\n");
+}
+
+
+static void check_keep_last(){
+    std::vector<std::unique_ptr<MockHandle>> handles;
+    uint64_t version, now_tick = POSUtilTscTimer::get_tsc();
+
+    for(int i=0; i<4; i++){ handles.push_back(std::make_unique<MockHandle>(MB(1))); }
+    for(version=1; version<=5; version++){
+        // the last handle isn't checkpointed in later rounds
+        for(int i=0; i<4; i++){ if(i < 3 || version <= 2){ handles[i]->checkpoint(version, now_tick); } }
+    }
+
+    set_policies("last:2");
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(now_tick), "sweep");
+    for(int i=0; i<3; i++){
+        check(handles[i]->get_nb_versions() == 2, "#versions");
+        check(handles[i]->has_version(5) && handles[i]->has_version(4), "last versions kept");
+        check(handles[i]->nb_free_slots == 3, "reclaimed to free list");
+    }
+    check(handles[3]->get_nb_versions() == 2 && handles[3]->has_version(2), "versions of idle handle kept");
+    printf("[last:2] passed\n");
+}
+
+
+static void check_keep_by_age(){
+    POSUtilTscTimer tsc_timer;
+    MockHandle handle(MB(1));
+    uint64_t version = 0, now_tick = POSUtilTscTimer::get_tsc();
+
+    // ages are far from the limit, as TSC calibration of two timers could differ a lot on VMs
+    for(uint64_t age_ms : { 40000, 20000, 200, 100, 0 }){
+        version += 1;
+        handle.checkpoint(version, now_tick - static_cast<uint64_t>(tsc_timer.ms_to_tick(age_ms)));
+    }
+
+    set_policies("age_ms:2000");
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(now_tick), "sweep");
+    check(handle.get_nb_versions() == 3, "#versions");
+    check(!handle.has_version(2) && handle.has_version(3), "versions older than 2 s reclaimed");
+
+    // the latest version is kept however old it is
+    set_policies("age_ms:1");
+    now_tick += static_cast<uint64_t>(tsc_timer.ms_to_tick(100000));
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(now_tick), "sweep");
+    check(handle.get_nb_versions() == 1 && handle.has_version(5), "latest version kept");
+    printf("[age_ms] passed\n");
+}
+
+
+static void check_memory_budget(){
+    std::vector<std::unique_ptr<MockHandle>> handles;
+    pos_ckpt_retention_stat_t stat;
+    uint64_t tick = 1;
+
+    // versions 1..3 of three handles of 1, 2 and 4 MB, checkpointed in the order of version, then handle
+    for(uint64_t size : { MB(1), MB(2), MB(4) }){ handles.push_back(std::make_unique<MockHandle>(size)); }
+    for(uint64_t version=1; version<=3; version++){
+        for(auto &handle : handles){ handle->checkpoint(version, tick++); }
+    }
+
+    // 21 MB retained, the latest versions take 7 MB; the oldest go first until 13 MB is left
+    set_policies("last:3,budget:" + std::to_string(MB(13)));
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(tick), "sweep");
+    POSCheckpointRetention::get_instance()->get_stat(stat);
+    check(stat.retained_bytes == MB(13), "retained bytes");
+    check(!handles[0]->has_version(1) && !handles[1]->has_version(1) && !handles[2]->has_version(1), "version 1 reclaimed");
+    check(!handles[0]->has_version(2) && handles[1]->has_version(2), "oldest of version 2 reclaimed");
+
+    // the budget is exceeded by the latest versions alone, which are kept anyway
+    set_policies("budget:" + std::to_string(MB(1)));
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(tick), "sweep");
+    POSCheckpointRetention::get_instance()->get_stat(stat);
+    check(stat.retained_bytes == MB(7) && stat.nb_retained_versions == 3, "only latest versions retained");
+    for(auto &handle : handles){ check(handle->has_version(3), "latest version kept"); }
+    printf("[budget] passed\n");
+}
+
+
+/*!
+ *  \brief  checkpoint rounds with the engine sweeping in the background, and report the retained memory
+ */
+static void run_rounds(const std::string& desp, uint64_t nb_handles, uint64_t nb_rounds){
+    std::vector<std::unique_ptr<MockHandle>> handles;
+    pos_ckpt_retention_stat_t stat;
+    uint64_t round, i, max_retained_bytes = 0, nb_free_slots = 0;
+
+    for(i=0; i<nb_handles; i++){ handles.push_back(std::make_unique<MockHandle>(MB(1) * (1 + i % 4))); }
+
+    set_policies(desp);
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->start(/* interval_ms */ 1000), "start");
+    for(round=1; round<=nb_rounds; round++){
+        // a quarter of the handles are dirty in each round
+        for(i=round%4; i<nb_handles; i+=4){ handles[i]->checkpoint(round, POSUtilTscTimer::get_tsc()); }
+        POSCheckpointRetention::get_instance()->notify();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        POSCheckpointRetention::get_instance()->get_stat(stat);
+        max_retained_bytes = std::max(max_retained_bytes, stat.retained_bytes);
+    }
+    POSCheckpointRetention::get_instance()->stop();
+
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(), "final sweep");
+    POSCheckpointRetention::get_instance()->get_stat(stat);
+    for(auto &handle : handles){ nb_free_slots += handle->nb_free_slots; }
+
+    printf(
+        "[rounds, %-24s] #handles: %lu, #rounds: %lu, retained: %7.2f MB (max %7.2f MB, %4lu versions), "
+        "#free slots: %4lu\n",
+        desp.size() > 0 ? desp.c_str() : "(none)", nb_handles, nb_rounds, (double)stat.retained_bytes / MB(1),
+        (double)max_retained_bytes / MB(1), stat.nb_retained_versions, nb_free_slots
+    );
+}
+
+
+/*!
+ *  \brief  measure the duration of a sweep over many targets, and the latency of notifying the engine
+ *          while it's sweeping in the background, as the worker does after each checkpoint round
+ */
+static void run_sweep_cost(uint64_t nb_handles, uint64_t nb_versions){
+    std::vector<std::unique_ptr<MockHandle>> handles;
+    pos_ckpt_retention_stat_t stat;
+    uint64_t i, version, nb_sweeps;
+    std::chrono::steady_clock::time_point s_time;
+    double notify_us;
+
+    for(i=0; i<nb_handles; i++){
+        handles.push_back(std::make_unique<MockHandle>(KB(4)));
+        for(version=1; version<=nb_versions; version++){ handles.back()->checkpoint(version, version); }
+    }
+
+    // keep everything, which is the worst case of collecting and applying
+    set_policies("last:" + std::to_string(nb_versions));
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->sweep(), "sweep");
+    POSCheckpointRetention::get_instance()->get_stat(stat);
+    check(stat.nb_retained_versions == nb_handles * nb_versions, "#retained versions");
+    nb_sweeps = stat.nb_sweeps;
+
+    // notify in the middle of a background sweep
+    check(POS_SUCCESS == POSCheckpointRetention::get_instance()->start(/* interval_ms */ 1000), "start");
+    POSCheckpointRetention::get_instance()->notify();
+    std::this_thread::sleep_for(std::chrono::microseconds(static_cast<uint64_t>(stat.last_sweep_ms * 500)));
+    s_time = std::chrono::steady_clock::now();
+    POSCheckpointRetention::get_instance()->notify();
+    notify_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - s_time).count();
+    POSCheckpointRetention::get_instance()->stop();
+    POSCheckpointRetention::get_instance()->get_stat(stat);
+    check(stat.nb_sweeps > nb_sweeps, "swept in the background");
+
+    printf(
+        "[sweep cost] #handles: %6lu, #versions: %7lu, duration: %8.3f ms, notify during sweep: %6.2f us\n",
+        nb_handles, stat.nb_retained_versions, stat.last_sweep_ms, notify_us
+    );
+}
+
+
+int main(){
+    check_parse();
+    check_keep_last();
+    check_keep_by_age();
+    check_memory_budget();
+
+    for(const char *desp : { "", "last:2", "age_ms:20", "last:4,budget:268435456" }){
+        run_rounds(desp, 64, 64);
+    }
+
+    for(uint64_t nb_handles : { 1000ul, 10000ul, 100000ul }){
+        run_sweep_cost(nb_handles, 4);
+    }
+
+    return 0;
+}
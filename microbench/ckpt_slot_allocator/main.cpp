@@ -0,0 +1,203 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare the size-class free list used by POSCheckpointBag against the
+ *          previous version-keyed map free list, under mixed checkpoint sizes
+ *  \note   each round applies one slot per handle with a random (log-uniform) state size,
+ *          then invalidates all of them, just like continuous checkpoint rounds
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <unordered_map>
+
+#include <stdint.h>
+
+#include "pos/include/checkpoint.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbHandles = 256;
+constexpr uint64_t kNbRounds = 200;
+constexpr uint64_t kMinStateSize = KB(1);
+constexpr uint64_t kMaxStateSize = MB(4);
+
+
+typedef struct bench_result {
+    uint64_t nb_apply;
+    uint64_t nb_hit;
+    uint64_t apply_ticks;
+    uint64_t held_size;
+    uint64_t state_size;
+
+    bench_result() : nb_apply(0), nb_hit(0), apply_ticks(0), held_size(0), state_size(0) {}
+} bench_result_t;
+
+
+static void generate_sizes(std::vector<uint64_t>& sizes){
+    std::mt19937_64 rng(20240721);
+    std::uniform_real_distribution<double> dist(
+        std::log2((double)kMinStateSize), std::log2((double)kMaxStateSize)
+    );
+    uint64_t i;
+
+    sizes.clear();
+    for(i=0; i<kNbHandles*kNbRounds; i++){
+        sizes.push_back((uint64_t)std::exp2(dist(rng)));
+    }
+}
+
+
+/*!
+ *  \brief  previous policy: take whatever cached slot comes first, reallocate if it can't hold the state
+ */
+static void bench_map_freelist(std::vector<uint64_t>& sizes, bench_result_t& result){
+    std::unordered_map<uint64_t, POSCheckpointSlot*> cached_map;
+    std::vector<POSCheckpointSlot*> active_slots;
+    typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    POSCheckpointSlot *slot;
+    uint64_t r, i, version = 0, s_tick, e_tick, size;
+
+    for(r=0; r<kNbRounds; r++){
+        for(i=0; i<kNbHandles; i++){
+            size = sizes[r*kNbHandles+i];
+            s_tick = get_tsc();
+            slot = nullptr;
+            if(cached_map.size() > 0){
+                map_iter = cached_map.begin();
+                slot = map_iter->second;
+                cached_map.erase(map_iter);
+                if(slot->get_capacity() < size){
+                    delete slot;
+                    slot = nullptr;
+                } else {
+                    slot->set_state_size(size);
+                    result.nb_hit += 1;
+                }
+            }
+            if(slot == nullptr){
+                slot = new POSCheckpointSlot(
+                    size, nullptr, nullptr, kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host
+                );
+            }
+            e_tick = get_tsc();
+            result.apply_ticks += e_tick - s_tick;
+            result.nb_apply += 1;
+            active_slots.push_back(slot);
+        }
+
+        // account memory at the peak of each round
+        for(i=0; i<active_slots.size(); i++){
+            result.state_size += active_slots[i]->get_state_size();
+            result.held_size += active_slots[i]->get_capacity();
+        }
+        for(map_iter = cached_map.begin(); map_iter != cached_map.end(); map_iter++){
+            result.held_size += map_iter->second->get_capacity();
+        }
+
+        for(i=0; i<active_slots.size(); i++){
+            cached_map.insert(std::pair<uint64_t, POSCheckpointSlot*>(version++, active_slots[i]));
+        }
+        active_slots.clear();
+    }
+
+    for(map_iter = cached_map.begin(); map_iter != cached_map.end(); map_iter++){
+        delete map_iter->second;
+    }
+}
+
+
+/*!
+ *  \brief  current policy: best-fit reuse from size-classed bins
+ */
+static void bench_size_class_freelist(std::vector<uint64_t>& sizes, bench_result_t& result){
+    POSSizeClassFreeList<POSCheckpointSlot> cached_slots;
+    std::vector<POSCheckpointSlot*> active_slots, drained_slots;
+    POSCheckpointSlot *slot;
+    uint64_t r, i, s_tick, e_tick, size, capacity;
+
+    for(r=0; r<kNbRounds; r++){
+        for(i=0; i<kNbHandles; i++){
+            size = sizes[r*kNbHandles+i];
+            s_tick = get_tsc();
+            slot = cached_slots.get(size, capacity);
+            if(slot != nullptr){
+                slot->set_state_size(size);
+                result.nb_hit += 1;
+            } else {
+                slot = new POSCheckpointSlot(
+                    size, nullptr, nullptr, kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host,
+                    POSSizeClass::round_up(size)
+                );
+            }
+            e_tick = get_tsc();
+            result.apply_ticks += e_tick - s_tick;
+            result.nb_apply += 1;
+            active_slots.push_back(slot);
+        }
+
+        // account memory at the peak of each round
+        for(i=0; i<active_slots.size(); i++){
+            result.state_size += active_slots[i]->get_state_size();
+            result.held_size += active_slots[i]->get_capacity();
+        }
+        result.held_size += cached_slots.get_cached_size();
+
+        for(i=0; i<active_slots.size(); i++){
+            cached_slots.put(active_slots[i], active_slots[i]->get_capacity());
+        }
+        active_slots.clear();
+    }
+
+    cached_slots.drain(drained_slots);
+    for(i=0; i<drained_slots.size(); i++){
+        delete drained_slots[i];
+    }
+}
+
+
+static void print_result(const char* name, bench_result_t& result){
+    printf(
+        "%-20s hit rate: %6.2f%%, avg apply latency: %10.3f us, avg held: %8.2f MB, fragmentation: %6.2f%%\n",
+        name,
+        (double)result.nb_hit / (double)result.nb_apply * 100.0,
+        POS_TSC_TO_USEC(result.apply_ticks) / (double)result.nb_apply,
+        (double)result.held_size / (double)kNbRounds / (double)MB(1),
+        (double)(result.held_size - result.state_size) / (double)result.held_size * 100.0
+    );
+}
+
+
+int main(){
+    std::vector<uint64_t> sizes;
+    bench_result_t map_result, size_class_result;
+
+    generate_sizes(sizes);
+    printf(
+        "#handles: %lu, #rounds: %lu, state size: [%lu, %lu] bytes\n",
+        kNbHandles, kNbRounds, kMinStateSize, kMaxStateSize
+    );
+
+    bench_map_freelist(sizes, map_result);
+    bench_size_class_freelist(sizes, size_class_result);
+
+    print_result("map free list", map_result);
+    print_result("size-class free list", size_class_result);
+
+    return 0;
+}
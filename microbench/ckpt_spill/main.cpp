@@ -0,0 +1,356 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  check the budget of host checkpoint memory and its spill tier with mocked handles, and
+ *          measure checkpoint / restore throughput under budgets smaller than the working set
+ *  \note   a mocked handle keeps its checkpointed versions in host memory like a checkpoint bag: each
+ *          round admits the handle's size, reuses a cached slot or allocates a new one, and fills it;
+ *          the last few versions are kept, older ones go to the cache
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pos/include/common.h"
+#include "pos/include/checkpoint_spill.h"
+#include "pos/include/utils/timer.h"
+#include "mb_common/check.h"
+
+
+/*!
+ *  \brief  mocked handle keeping checkpointed versions in host memory
+ */
+class MockHandle : public POSCheckpointSpillTarget {
+ public:
+    MockHandle(uint64_t id, uint64_t size, uint64_t nb_kept) : id(id), size(size), nb_kept(nb_kept) {
+        POSCheckpointSpill::get_instance()->add_target(this);
+    }
+    ~MockHandle(){
+        POSCheckpointSpill::get_instance()->remove_target(this);
+        for(auto &pair : this->_slots){ this->__drop(pair.second); }
+        this->trim_cached();
+    }
+
+    /*!
+     *  \brief  checkpoint a new version, as the bag does from checkpoint_add to settle
+     */
+    void checkpoint(uint64_t version){
+        slot_t *slot;
+
+        POSCheckpointSpill::get_instance()->admit(this->size);
+
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            std::lock_guard<std::mutex> trim_lock(this->_trim_mutex);
+            slot = &(this->_slots[version]);
+            if(this->_cached.size() > 0){
+                slot->data = this->_cached.back();
+                this->_cached.pop_back();
+            } else {
+                check((slot->data = (uint64_t*)malloc(this->size)) != nullptr, "malloc");
+                POSCheckpointSpill::get_instance()->on_allocated(this->size);
+            }
+            slot->tick = POSUtilTscTimer::get_tsc();
+            slot->is_committing = true;
+        }
+
+        // the slot is committing, so it's never spilled while being written
+        this->__fill(slot->data, version);
+
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            slot->is_committing = false;
+
+            // older versions go to the cache
+            while(this->_slots.size() > this->nb_kept){
+                this->__invalidate(this->_slots.begin()->second);
+                this->_slots.erase(this->_slots.begin());
+            }
+        }
+    }
+
+    /*!
+     *  \brief  read a version back as restore does, loading it from the spill tier if spilled
+     *  \return whether the version holds the expected content
+     */
+    bool restore(uint64_t version){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        slot_t *slot;
+
+        if(this->_slots.count(version) == 0){ return false; }
+        slot = &(this->_slots[version]);
+        if(slot->is_spilled){
+            check((slot->data = (uint64_t*)malloc(this->size)) != nullptr, "malloc");
+            POSCheckpointSpill::get_instance()->on_allocated(this->size);
+            check(POS_SUCCESS == POSCheckpointSpill::get_instance()->spill_in(slot->offset, slot->data, this->size), "spill in");
+            slot->is_spilled = false;
+        }
+        return this->__verify(slot->data, version);
+    }
+
+    void pin(uint64_t version, bool is_pinned){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_slots[version].nb_pins += is_pinned ? 1 : -1;
+    }
+
+    void get_spill_candidates(std::vector<pos_ckpt_spill_candidate_t>& candidates) override {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        pos_ckpt_spill_candidate_t candidate;
+        for(auto &pair : this->_slots){
+            if(pair.second.is_spilled || pair.second.is_committing || pair.second.nb_pins > 0){ continue; }
+            candidate.target = this;
+            candidate.version = pair.first;
+            candidate.size = this->size;
+            candidate.tick = pair.second.tick;
+            candidates.push_back(candidate);
+        }
+    }
+
+    pos_retval_t spill_version(uint64_t version) override {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        pos_retval_t retval;
+        slot_t *slot;
+
+        if(this->_slots.count(version) == 0){ return POS_FAILED_NOT_EXIST; }
+        slot = &(this->_slots[version]);
+        if(slot->is_spilled || slot->is_committing || slot->nb_pins > 0){ return POS_FAILED_NOT_EXIST; }
+
+        retval = POSCheckpointSpill::get_instance()->spill_out(slot->data, this->size, &slot->offset);
+        if(likely(retval == POS_SUCCESS)){
+            free(slot->data);
+            slot->data = nullptr;
+            slot->is_spilled = true;
+            POSCheckpointSpill::get_instance()->on_released(this->size);
+        }
+        return retval;
+    }
+
+    uint64_t trim_cached() override {
+        std::lock_guard<std::mutex> lock(this->_trim_mutex);
+        uint64_t released = 0;
+        for(uint64_t *data : this->_cached){
+            free(data);
+            POSCheckpointSpill::get_instance()->on_released(this->size);
+            released += this->size;
+        }
+        this->_cached.clear();
+        return released;
+    }
+
+    uint64_t id;
+    uint64_t size;
+    uint64_t nb_kept;
+
+ private:
+    typedef struct slot {
+        uint64_t *data;
+        uint64_t tick;
+        bool is_committing;
+        int64_t nb_pins;
+        bool is_spilled;
+        uint64_t offset;
+        slot() : data(nullptr), tick(0), is_committing(false), nb_pins(0), is_spilled(false), offset(0) {}
+    } slot_t;
+
+    void __fill(uint64_t *data, uint64_t version){
+        uint64_t i, seed = (this->id << 48) ^ (version << 24);
+        for(i=0; i<this->size/sizeof(uint64_t); i++){ data[i] = seed ^ i; }
+    }
+
+    bool __verify(uint64_t *data, uint64_t version){
+        uint64_t i, seed = (this->id << 48) ^ (version << 24);
+        for(i=0; i<this->size/sizeof(uint64_t); i++){ if(unlikely(data[i] != (seed ^ i))){ return false; } }
+        return true;
+    }
+
+    // should be called with _mutex held
+    void __invalidate(slot_t& slot){
+        if(slot.is_spilled){
+            POSCheckpointSpill::get_instance()->spill_discard(slot.offset, this->size);
+        } else {
+            std::lock_guard<std::mutex> lock(this->_trim_mutex);
+            this->_cached.push_back(slot.data);
+        }
+    }
+
+    void __drop(slot_t& slot){
+        if(slot.is_spilled){
+            POSCheckpointSpill::get_instance()->spill_discard(slot.offset, this->size);
+        } else {
+            free(slot.data);
+            POSCheckpointSpill::get_instance()->on_released(this->size);
+        }
+    }
+
+    std::map<uint64_t, slot_t> _slots;
+    std::mutex _mutex;
+
+    // cached slots, trimmed by the spill tier without taking _mutex, as the bag does
+    std::vector<uint64_t*> _cached;
+    std::mutex _trim_mutex;
+};
+
+
+static void check_spill_dir(){
+    check(POS_FAILED_NOT_EXIST == POSCheckpointSpill::get_instance()->set_spill_dir("/nonexistent/spill"), "invalid dir");
+    check(POS_SUCCESS == POSCheckpointSpill::get_instance()->set_spill_dir("/tmp"), "valid dir");
+    printf("[spill dir] passed\n");
+}
+
+
+static void check_spill_and_load(){
+    pos_ckpt_spill_stat_t stat;
+    uint64_t version;
+
+    {
+        MockHandle handle(1, MB(1), 4);
+
+        // four versions within a budget of two, the oldest two are spilled
+        POSCheckpointSpill::get_instance()->set_budget(MB(2));
+        for(version=1; version<=4; version++){ handle.checkpoint(version); }
+        POSCheckpointSpill::get_instance()->get_stat(stat);
+        check(stat.resident_bytes == MB(2), "resident within budget");
+        check(stat.nb_spills == 2 && stat.file_used_size == MB(2), "oldest versions spilled");
+
+        // all versions are read back intact, and the spill file is dropped once nothing is spilled
+        for(version=1; version<=4; version++){ check(handle.restore(version), "restored content"); }
+        POSCheckpointSpill::get_instance()->get_stat(stat);
+        check(stat.nb_loads == 2 && stat.file_size == 0, "spilled versions loaded back");
+        check(stat.resident_bytes == MB(4), "loading back exceeds the soft budget");
+    }
+
+    POSCheckpointSpill::get_instance()->get_stat(stat);
+    check(stat.resident_bytes == 0, "all memory released");
+    POSCheckpointSpill::get_instance()->set_budget(0);
+    printf("[spill and load] passed\n");
+}
+
+
+static void check_overcommit(){
+    pos_ckpt_spill_stat_t before, after;
+    POSUtilHpetTimer timer;
+    double duration_ms;
+
+    {
+        MockHandle handle(2, MB(1), 1);
+
+        POSCheckpointSpill::get_instance()->set_budget(MB(1));
+        POSCheckpointSpill::admit_timeout_ms = 50;
+        handle.checkpoint(1);
+
+        // the only version is pinned (e.g., under persisting), so the admission waits and then overcommits
+        handle.pin(1, true);
+        POSCheckpointSpill::get_instance()->get_stat(before);
+        timer.start();
+        POSCheckpointSpill::get_instance()->admit(MB(1));
+        duration_ms = timer.stop_get_ms();
+        POSCheckpointSpill::get_instance()->get_stat(after);
+        check(after.nb_overcommits == before.nb_overcommits + 1, "overcommitted");
+        check(after.nb_stalls == before.nb_stalls + 1 && duration_ms >= 50, "stalled until timeout");
+        check(after.nb_spills == before.nb_spills, "pinned version not spilled");
+
+        // once unpinned, the version is spilled to make room
+        handle.pin(1, false);
+        POSCheckpointSpill::get_instance()->admit(MB(1));
+        POSCheckpointSpill::get_instance()->get_stat(after);
+        check(after.nb_overcommits == before.nb_overcommits + 1, "no more overcommit");
+        check(after.nb_spills == before.nb_spills + 1, "unpinned version spilled");
+    }
+
+    POSCheckpointSpill::admit_timeout_ms = 5000;
+    POSCheckpointSpill::get_instance()->set_budget(0);
+    printf("[overcommit] passed\n");
+}
+
+
+/*!
+ *  \brief  checkpoint rounds over all handles under the budget, then restore the kept versions
+ *  \param  budget_ratio    budget relative to the working set (i.e., kept versions of all handles),
+ *                          0 for unlimited
+ */
+static void run_rounds(double budget_ratio, uint64_t nb_handles, uint64_t size, uint64_t nb_kept, uint64_t nb_rounds){
+    std::vector<std::unique_ptr<MockHandle>> handles;
+    pos_ckpt_spill_stat_t before, after;
+    POSUtilHpetTimer timer;
+    uint64_t i, round, peak_resident_bytes = 0;
+    double ckpt_ms, restore_ms;
+
+    // a new version is written before the oldest kept one goes to the cache
+    uint64_t working_set = nb_handles * size * (nb_kept + 1);
+
+    for(i=0; i<nb_handles; i++){ handles.push_back(std::make_unique<MockHandle>(i, size, nb_kept)); }
+    POSCheckpointSpill::get_instance()->set_budget(static_cast<uint64_t>(budget_ratio * working_set));
+    POSCheckpointSpill::get_instance()->get_stat(before);
+
+    timer.start();
+    for(round=1; round<=nb_rounds; round++){
+        for(auto &handle : handles){
+            handle->checkpoint(round);
+            POSCheckpointSpill::get_instance()->get_stat(after);
+            peak_resident_bytes = std::max(peak_resident_bytes, after.resident_bytes);
+        }
+    }
+    ckpt_ms = timer.stop_get_ms();
+    POSCheckpointSpill::get_instance()->get_stat(after);
+
+    timer.start();
+    for(round=nb_rounds-nb_kept+1; round<=nb_rounds; round++){
+        for(auto &handle : handles){ check(handle->restore(round), "restored content"); }
+    }
+    restore_ms = timer.stop_get_ms();
+
+    printf(
+        "[rounds, budget %4s of %lu MB] ckpt: %6.2f GB/s, restore: %6.2f GB/s, peak: %6.1f MB, #stalls: %4lu (%8.2f ms), "
+        "trimmed: %6.1f MB, spilled: %7.1f MB, #overcommits: %lu\n",
+        budget_ratio > 0 ? (std::to_string(static_cast<int>(budget_ratio * 100)) + "%").c_str() : "none",
+        working_set / MB(1),
+        (double)(nb_handles * size * nb_rounds) / GB(1) / (ckpt_ms / 1000),
+        (double)(nb_handles * size * nb_kept) / GB(1) / (restore_ms / 1000),
+        (double)peak_resident_bytes / MB(1),
+        after.nb_stalls - before.nb_stalls, after.stall_ms - before.stall_ms,
+        (double)(after.trimmed_bytes - before.trimmed_bytes) / MB(1),
+        (double)(after.spilled_bytes - before.spilled_bytes) / MB(1),
+        after.nb_overcommits - before.nb_overcommits
+    );
+
+    handles.clear();
+    POSCheckpointSpill::get_instance()->get_stat(after);
+    check(after.resident_bytes == 0 && after.file_used_size == 0, "all memory released");
+    POSCheckpointSpill::get_instance()->set_budget(0);
+}
+
+
+int main(){
+    check_spill_dir();
+    check_spill_and_load();
+    check_overcommit();
+
+    // 16 handles of 8 MB with the last 2 versions kept, i.e., a working set of 384 MB
+    for(double budget_ratio : { 0.0, 1.0, 0.5, 0.25 }){
+        run_rounds(budget_ratio, 16, MB(8), 2, 16);
+    }
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure put / get throughput of large checkpoint objects through the memory, local and object
+ *          storage backends, with parts transferred concurrently versus as a single part, and round-trip
+ *          a checkpoint image through each backend by its URI
+ *  \note   the object store is served by an in-process object server rooted under /tmp
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_storage.h"
+#include "mb_common/ticks.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kDefaultObjectSize = MB(256);
+constexpr uint64_t kDefaultNbRounds = 4;
+constexpr uint64_t kImageSectionSize = MB(32);
+
+
+/*!
+ *  \brief  put and get the object for several rounds
+ *  \return put / get throughput in GB/s
+ */
+static std::pair<double, double> transfer(
+    POSCheckpointStorage* storage, const uint8_t* src, uint8_t* dst, uint64_t size, uint64_t nb_rounds, bool& is_matched
+){
+    uint64_t i, s_tick, e_tick;
+    double put_ms = 0, get_ms = 0;
+
+    is_matched = true;
+    for(i=0; i<nb_rounds; i++){
+        s_tick = get_tsc();
+        check(POS_SUCCESS == storage->put("object", src, size), "put");
+        e_tick = get_tsc();
+        put_ms += POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+
+        memset(dst, 0, size);
+        s_tick = get_tsc();
+        check(POS_SUCCESS == storage->get("object", dst, size), "get");
+        e_tick = get_tsc();
+        get_ms += POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+
+        if(memcmp(src, dst, size) != 0){ is_matched = false; }
+    }
+    check(POS_SUCCESS == storage->remove("object"), "remove");
+
+    return {
+        (double)(size * nb_rounds) / (double)(GB(1)) / (put_ms / 1000.0),
+        (double)(size * nb_rounds) / (double)(GB(1)) / (get_ms / 1000.0)
+    };
+}
+
+
+/*!
+ *  \brief  dump a checkpoint image with several raw sections into the location, and read them back
+ */
+static bool round_trip_image(const std::string& uri, const uint8_t* src, uint8_t* dst, double& dump_ms, double& restore_ms){
+    uint64_t i, s_tick, e_tick, meta;
+    bool is_matched = true;
+    POSCheckpointImageWriter *writer;
+    const pos_ckpt_image_entry_t *entry;
+    std::shared_ptr<POSCheckpointStorage> storage;
+
+    check(POS_SUCCESS == POSCheckpointStorage::open(uri, storage), "open storage");
+    check(POS_SUCCESS == storage->prepare(), "prepare storage");
+
+    s_tick = get_tsc();
+    check((writer = POSCheckpointImageWriter::open(uri)) != nullptr, "open image writer");
+    for(i=0; i<4; i++){
+        meta = i;
+        check(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, 1, i, 0, &meta, sizeof(meta), src + i * kImageSectionSize, kImageSectionSize
+        ), "append section");
+    }
+    check(POS_SUCCESS == POSCheckpointImageWriter::seal(uri), "seal image");
+    e_tick = get_tsc();
+    dump_ms = POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+
+    memset(dst, 0, 4 * kImageSectionSize);
+    s_tick = get_tsc();
+    {
+        POSCheckpointImage image;
+        check(POSCheckpointStorage::exists(uri), "image location exists");
+        check(POS_SUCCESS == image.open(uri), "open image");
+        for(i=0; i<4; i++){
+            check((entry = image.find(kPOS_CkptImageRecord_Handle, 1, i)) != nullptr, "find section");
+            check(POS_SUCCESS == image.read_section(entry, dst + i * kImageSectionSize, kImageSectionSize), "read section");
+        }
+    }
+    e_tick = get_tsc();
+    restore_ms = POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+
+    if(memcmp(src, dst, 4 * kImageSectionSize) != 0){ is_matched = false; }
+    return is_matched;
+}
+
+
+int main(int argc, char** argv){
+    uint64_t i, size = kDefaultObjectSize, nb_rounds = kDefaultNbRounds, default_part_size;
+    uint8_t *src, *dst;
+    bool is_matched;
+    double dump_ms, restore_ms;
+    std::pair<double, double> multi_part, single_part;
+    std::shared_ptr<POSCheckpointStorage> storage;
+    POSCheckpointObjectServer server;
+    const std::string obj_root = "/tmp/pos_mb_ckpt_storage_obj";
+    const std::string file_root = "/tmp/pos_mb_ckpt_storage_file";
+
+    std::vector<std::pair<std::string, std::string>> targets({
+        { "mem",  "mem://pos_mb_ckpt_storage"                                           },
+        { "file", std::string("file://") + file_root                                    },
+        { "obj",  "obj://pos_mb_ckpt_storage"                                           },
+    });
+
+    if(argc > 1){ size = MB(strtoull(argv[1], nullptr, 10)); }
+    if(argc > 2){ nb_rounds = strtoull(argv[2], nullptr, 10); }
+    size = std::max<uint64_t>(size, 4 * kImageSectionSize);
+
+    src = reinterpret_cast<uint8_t*>(malloc(size));
+    dst = reinterpret_cast<uint8_t*>(malloc(size));
+    check(src != nullptr && dst != nullptr, "alloc buffers");
+    for(i=0; i<size; i++){ src[i] = static_cast<uint8_t>(i * 131 + (i >> 12)); }
+
+    std::filesystem::remove_all(obj_root);
+    std::filesystem::remove_all(file_root);
+    POSCheckpointStorage_Object::endpoint = "/tmp/pos_mb_ckpt_storage.sock";
+    check(POS_SUCCESS == server.start(POSCheckpointStorage_Object::endpoint, obj_root), "start object server");
+
+    default_part_size = POSCheckpointStorage::part_size;
+    printf(
+        "object size: %lu MB, #rounds: %lu, part size: %lu MB\n",
+        size / MB(1), nb_rounds, default_part_size / MB(1)
+    );
+
+    for(auto &target : targets){
+        check(POS_SUCCESS == POSCheckpointStorage::open(target.second, storage), "open storage");
+        check(POS_SUCCESS == storage->prepare(), "prepare storage");
+
+        POSCheckpointStorage::part_size = size;
+        single_part = transfer(storage.get(), src, dst, size, nb_rounds, is_matched);
+        check(is_matched, "single-part content");
+
+        POSCheckpointStorage::part_size = default_part_size;
+        multi_part = transfer(storage.get(), src, dst, size, nb_rounds, is_matched);
+        check(is_matched, "multi-part content");
+
+        is_matched = round_trip_image(target.second + "/image", src, dst, dump_ms, restore_ms);
+
+        printf(
+            "[%-4s] put: %6.2f GB/s (single part: %6.2f GB/s) | get: %6.2f GB/s (single part: %6.2f GB/s)"
+            " | image dump: %7.2f ms, restore: %7.2f ms, content %s\n",
+            target.first.c_str(), multi_part.first, single_part.first, multi_part.second, single_part.second,
+            dump_ms, restore_ms, is_matched ? "matched" : "MISMATCHED"
+        );
+    }
+
+    server.stop();
+    std::filesystem::remove_all(obj_root);
+    std::filesystem::remove_all(file_root);
+    free(src);
+    free(dst);
+
+    return 0;
+}
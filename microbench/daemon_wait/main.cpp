@@ -0,0 +1,177 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the idle CPU consumption and wake-up latency of a daemon polling a POSLockFreeQueue,
+ *          comparing busy-spinning (the previous behaviour of parser / worker daemons) against
+ *          POSWaitStrategy (spin, then yield, then park on a futex)
+ *  \note   latencies are measured with CLOCK_MONOTONIC, from right before the push to right after the
+ *          daemon dequeues the element
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "pos/include/common.h"
+#include "pos/include/utils/lockfree_queue.h"
+#include "pos/include/utils/wait_strategy.h"
+
+
+constexpr uint64_t kIdleDurationMs = 2000;
+constexpr uint64_t kNbWakeups = 2000;
+
+
+static inline uint64_t get_ns(clockid_t clock = CLOCK_MONOTONIC){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  mock daemon, which polls a queue as the parser / worker daemons do
+ */
+class MockDaemon {
+ public:
+    MockDaemon(bool use_wait_strategy, const pos_wait_policy_t& policy)
+        : _use_wait_strategy(use_wait_strategy), _policy(policy), _stop_flag(false), _cpu_ns(0)
+    {
+        this->_q.set_wait_event(use_wait_strategy ? &this->_event : nullptr);
+        this->_latencies.reserve(kNbWakeups);
+        this->_thread = new std::thread(&MockDaemon::__daemon, this);
+    }
+
+    ~MockDaemon(){ this->stop(); }
+
+    void stop(){
+        if(this->_thread == nullptr){ return; }
+        this->_stop_flag = true;
+        this->_event.notify();
+        this->_thread->join();
+        delete this->_thread;
+        this->_thread = nullptr;
+    }
+
+    // push the issue timestamp to the daemon
+    inline void push(){ this->_q.push(get_ns()); }
+
+    // CPU time consumed by the daemon thread
+    inline uint64_t get_cpu_ns() const { return this->_cpu_ns.load(); }
+
+    inline uint64_t get_nb_received(){ return this->_nb_received.load(); }
+
+    std::vector<uint64_t>& get_latencies(){ return this->_latencies; }
+
+    pos_wait_stat_t wait_stat;
+
+ private:
+    void __daemon(){
+        uint64_t issue_ns, nb_polled;
+        uint64_t s_cpu_ns = get_ns(CLOCK_THREAD_CPUTIME_ID);
+        POSWaitStrategy wait_strategy(&this->_event, this->_policy);
+
+        while(!this->_stop_flag){
+            wait_strategy.begin_round();
+            nb_polled = 0;
+            while(POS_SUCCESS == this->_q.dequeue(issue_ns)){
+                this->_latencies.push_back(get_ns() - issue_ns);
+                nb_polled += 1;
+            }
+            this->_nb_received.fetch_add(nb_polled);
+            if(this->_use_wait_strategy){ wait_strategy.end_round(nb_polled > 0); }
+        }
+
+        this->_cpu_ns.store(get_ns(CLOCK_THREAD_CPUTIME_ID) - s_cpu_ns);
+        this->wait_stat = wait_strategy.get_stat();
+    }
+
+    bool _use_wait_strategy;
+    pos_wait_policy_t _policy;
+    POSWaitEvent _event;
+    POSLockFreeQueue<uint64_t> _q;
+    std::thread *_thread;
+    volatile bool _stop_flag;
+    std::atomic<uint64_t> _cpu_ns;
+    std::atomic<uint64_t> _nb_received{0};
+    std::vector<uint64_t> _latencies;
+};
+
+
+static void run_idle(const char* name, bool use_wait_strategy, const pos_wait_policy_t& policy){
+    MockDaemon daemon(use_wait_strategy, policy);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(kIdleDurationMs));
+    daemon.stop();
+
+    printf(
+        "[idle] %-8s cpu: %6.2f%% of a core, #spins: %lu, #yields: %lu, #parks: %lu\n",
+        name, (double)daemon.get_cpu_ns() / (double)(kIdleDurationMs * 1000000ul) * 100.0,
+        daemon.wait_stat.nb_spins, daemon.wait_stat.nb_yields, daemon.wait_stat.nb_parks
+    );
+}
+
+
+static void run_wakeup(const char* name, bool use_wait_strategy, const pos_wait_policy_t& policy, uint64_t gap_us){
+    uint64_t i;
+    double p50, p90, p99, p999;
+    MockDaemon daemon(use_wait_strategy, policy);
+
+    for(i=0; i<kNbWakeups; i++){
+        std::this_thread::sleep_for(std::chrono::microseconds(gap_us));
+        daemon.push();
+    }
+    while(daemon.get_nb_received() < kNbWakeups){ std::this_thread::yield(); }
+    daemon.stop();
+
+    std::vector<uint64_t> &latencies = daemon.get_latencies();
+    std::sort(latencies.begin(), latencies.end());
+    p50 = latencies[latencies.size() * 50 / 100] / 1000.0;
+    p90 = latencies[latencies.size() * 90 / 100] / 1000.0;
+    p99 = latencies[latencies.size() * 99 / 100] / 1000.0;
+    p999 = latencies[latencies.size() * 999 / 1000] / 1000.0;
+
+    printf(
+        "[wake] %-8s gap: %5lu us, p50: %8.2f us, p90: %8.2f us, p99: %8.2f us, p99.9: %8.2f us, #parks: %lu\n",
+        name, gap_us, p50, p90, p99, p999, daemon.wait_stat.nb_parks
+    );
+}
+
+
+int main(){
+    pos_wait_policy_t policy;
+
+    printf(
+        "wait policy: #spin_rounds(%lu), #yield_rounds(%lu), park_timeout(%lu us)\n",
+        policy.nb_spin_rounds, policy.nb_yield_rounds, policy.park_timeout_us
+    );
+
+    run_idle("spin", false, policy);
+    run_idle("adaptive", true, policy);
+
+    for(uint64_t gap_us : { 0ul, 50ul, 1000ul }){
+        run_wakeup("spin", false, policy, gap_us);
+        run_wakeup("adaptive", true, policy, gap_us);
+    }
+
+    return 0;
+}
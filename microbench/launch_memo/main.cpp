@@ -0,0 +1,248 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the latency to resolve pointer arguments of kernel launches to memory handles, as the
+ *          cuda_launch_kernel parser does, comparing
+ *          [1] resolve: resolve every pointer argument through the address index on every launch
+ *          [2] memo: memoize the resolved views per kernel by the pointer-argument tuple, under the
+ *              address epoch (generation) of the index
+ *  \note   launches replay a training step: kernels are shared across layers, and each launch passes
+ *          the buffers of its layer; in the churn scenarios a buffer used by the step is freed and a new
+ *          one is allocated in place every few launches, which changes the epoch, so that memoized
+ *          views are revalidated, and those referring the freed buffer are resolved again
+ *  \note   each path resolves against its own (identical) index, so that neither benefits from the
+ *          per-thread cache of the index warmed by the other; the views recorded by both paths are
+ *          checked to be identical
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "pos/include/common.h"
+#include "pos/include/utils/address_index.h"
+#include "pos/include/utils/resolution_memo.h"
+
+
+constexpr uint64_t kNbAllocations = 100000;
+constexpr uint64_t kNbKernels = 64;
+constexpr uint64_t kNbLayers = 48;
+constexpr uint64_t kNbSteps = 200;
+constexpr uint64_t kBaseAddr = 0x555500000000;
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  mocked memory handle
+ */
+typedef struct mock_handle {
+    uint64_t client_addr;
+    uint64_t size;
+    bool is_live;
+} mock_handle_t;
+
+
+/*!
+ *  \brief  resolved view, same layout as pos_cuda_arg_resolution_t
+ */
+typedef struct mock_view {
+    mock_handle_t *handle;
+    uint32_t param_index;
+    uint8_t dir;
+    uint64_t offset;
+
+    bool operator==(const mock_view& other) const {
+        return handle == other.handle && param_index == other.param_index && dir == other.dir && offset == other.offset;
+    }
+} mock_view_t;
+
+
+/*!
+ *  \brief  mocked kernel: directions of its pointer parameters, and its memo
+ */
+typedef struct mock_kernel {
+    std::vector<uint8_t> dirs;
+    POSResolutionMemo<mock_view_t> memo;
+} mock_kernel_t;
+
+
+/*!
+ *  \brief  mocked launch: the kernel and its pointer arguments
+ */
+typedef struct mock_launch {
+    mock_kernel_t *kernel;
+    std::vector<uint64_t> args;
+} mock_launch_t;
+
+
+/*!
+ *  \brief  resolve all pointer arguments of a launch through the index
+ */
+static inline void resolve(
+    POSAddressIndex<mock_handle_t*>& index, mock_launch_t& launch, std::vector<mock_view_t>& views,
+    std::vector<mock_view_t> *memo_resolved
+){
+    uint64_t i, base;
+    mock_handle_t *handle;
+
+    for(i=0; i<launch.args.size(); i++){
+        if(unlikely(launch.args[i] == 0)){ continue; }
+        handle = index.lookup(launch.args[i], &base);
+        if(unlikely(handle == nullptr)){ continue; }
+        views.push_back({ handle, (uint32_t)i, launch.kernel->dirs[i], launch.args[i] - base });
+        if(memo_resolved != nullptr){ memo_resolved->push_back(views.back()); }
+    }
+}
+
+
+/*!
+ *  \brief  resolve all pointer arguments of a launch, with the memo of the kernel
+ */
+static inline void resolve_with_memo(
+    POSAddressIndex<mock_handle_t*>& index, mock_launch_t& launch, std::vector<mock_view_t>& views
+){
+    uint64_t i, epoch = index.get_generation(), nb_pointers = 0;
+    const std::vector<mock_view_t> *memo_views;
+    std::vector<mock_view_t> *memo_resolved;
+
+    // same revalidation as the parser: all pointers were resolved, and to handles that are still alive
+    auto revalidate = [&](const std::vector<mock_view_t>& views) -> bool {
+        for(i=0; i<launch.args.size(); i++){ nb_pointers += (launch.args[i] != 0); }
+        if(views.size() != nb_pointers){ return false; }
+        for(const mock_view_t &view : views){ if(unlikely(!view.handle->is_live)){ return false; } }
+        return true;
+    };
+
+    memo_views = launch.kernel->memo.get(launch.args.data(), launch.args.size(), epoch, revalidate);
+    if(likely(memo_views != nullptr)){
+        views.insert(views.end(), memo_views->begin(), memo_views->end());
+        return;
+    }
+    memo_resolved = launch.kernel->memo.put(launch.args.data(), launch.args.size(), epoch);
+    resolve(index, launch, views, memo_resolved);
+}
+
+
+static void run(const char* scenario, uint64_t churn_interval){
+    uint64_t i, j, s_ns, e_ns, base_ptr = kBaseAddr, size, nb_launches = 0;
+    uint64_t resolve_ns = 0, memo_ns = 0;
+    std::mt19937_64 rng(0);
+    std::vector<mock_handle_t*> handles, freed_handles;
+    std::vector<uint64_t> churn_targets;
+    std::vector<mock_kernel_t*> kernels;
+    std::vector<mock_launch_t> step;
+    std::vector<mock_view_t> views, memo_views;
+    POSAddressIndex<mock_handle_t*> index, memo_index;
+    pos_resolution_memo_stat_t stat;
+    mock_handle_t *h;
+
+    // populate with a bump allocator
+    for(i=0; i<kNbAllocations; i++){
+        size = 256ul << (rng() % 19);
+        POS_CHECK_POINTER(h = new mock_handle_t({ base_ptr, size, true }));
+        handles.push_back(h);
+        index.insert(h->client_addr, h->size, h);
+        memo_index.insert(h->client_addr, h->size, h);
+        base_ptr += size;
+    }
+
+    // kernels with 2 to 12 pointer parameters, the last one or two are outputs
+    for(i=0; i<kNbKernels; i++){
+        POS_CHECK_POINTER(kernels.emplace_back(new mock_kernel_t()));
+        for(j=0; j<2+rng()%11; j++){ kernels.back()->dirs.push_back(kPOS_Edge_Direction_In); }
+        kernels.back()->dirs.back() = kPOS_Edge_Direction_Out;
+        if(rng() % 2 == 0){ kernels.back()->dirs.front() = kPOS_Edge_Direction_InOut; }
+    }
+
+    // a step launches each layer's kernels with the buffers of the layer, some of which are views
+    for(i=0; i<kNbLayers; i++){
+        for(j=0; j<16; j++){
+            mock_launch_t launch;
+            launch.kernel = kernels[(i * 7 + j) % kNbKernels];
+            for(uint64_t k=0; k<launch.kernel->dirs.size(); k++){
+                churn_targets.push_back((i * 2048 + j * 16 + k * 3) % kNbAllocations);
+                h = handles[churn_targets.back()];
+                launch.args.push_back(rng() % 8 == 0 ? h->client_addr + rng() % h->size : h->client_addr);
+            }
+            // some pointers are nullptr, as pytorch sometimes passes
+            if(rng() % 8 == 0){ launch.args.back() = 0; }
+            step.push_back(launch);
+        }
+    }
+
+    for(i=0; i<kNbSteps; i++){
+        for(mock_launch_t &launch : step){
+            // free a buffer and allocate a new one in place, which changes the epoch of the index
+            if(churn_interval > 0 && nb_launches % churn_interval == 0){
+                j = churn_targets[rng() % churn_targets.size()];
+                h = handles[j];
+                POS_ASSERT(index.erase(h->client_addr) && memo_index.erase(h->client_addr));
+                h->is_live = false;
+                freed_handles.push_back(h);
+                POS_CHECK_POINTER(h = handles[j] = new mock_handle_t({ h->client_addr, h->size, true }));
+                index.insert(h->client_addr, h->size, h);
+                memo_index.insert(h->client_addr, h->size, h);
+            }
+
+            views.clear();
+            s_ns = get_ns();
+            resolve(index, launch, views, nullptr);
+            e_ns = get_ns();
+            resolve_ns += e_ns - s_ns;
+
+            memo_views.clear();
+            s_ns = get_ns();
+            resolve_with_memo(memo_index, launch, memo_views);
+            e_ns = get_ns();
+            memo_ns += e_ns - s_ns;
+
+            POS_ASSERT(views == memo_views);
+            nb_launches += 1;
+        }
+    }
+
+    for(mock_kernel_t *kernel : kernels){ stat += kernel->memo.get_stat(); }
+    printf(
+        "[%-8s] #launches: %7lu, resolve: %7.2f ns/launch, memo: %7.2f ns/launch, "
+        "hit rate: %6.2f%%, #revalidations: %lu, #stale: %lu\n",
+        scenario, nb_launches, (double)resolve_ns / nb_launches, (double)memo_ns / nb_launches,
+        stat.get_hit_rate() * 100.0, stat.nb_revalidations, stat.nb_stale
+    );
+    fflush(stdout);
+
+    for(mock_kernel_t *kernel : kernels){ delete kernel; }
+    for(mock_handle_t *h : handles){ delete h; }
+    for(mock_handle_t *h : freed_handles){ delete h; }
+}
+
+
+int main(){
+    run("steady", 0);
+    run("churn768", kNbLayers * 16);
+    run("churn64", 64);
+    return 0;
+}
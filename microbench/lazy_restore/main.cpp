@@ -0,0 +1,431 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare eager restore (all states reloaded before the client becomes active) against lazy
+ *          restore (states reloaded on their first use, and by a background filler in priority order),
+ *          in terms of time-to-first-API and total restore time, under different working set sizes
+ *  \note   the mock handles replicate POSHandle::reload_state_if_pending, and the flow of lazy restore
+ *          replicates POSClient::restore_handles / POSWorker::__restore_broken_handles, so no GPU is required
+ *  \note   a corrupted record is restored at last, to check that a sync API relying on it fails instead of
+ *          blocking its caller
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <future>
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/restore_scheduler.h"
+#include "mb_common/ticks.h"
+#include "mb_common/check.h"
+
+
+constexpr uint64_t kNbMemories = 128;
+constexpr uint64_t kMemoryStateSize = MB(4);
+const std::string kCkptDir = "/tmp/pos_mb_lazy_restore";
+
+
+/*!
+ *  \brief  mock handle, with the members used by the restore scheduler and lazy restore
+ */
+class MockHandle {
+ public:
+    MockHandle(pos_u64id_t id_, uint64_t restore_us_, uint64_t state_size_, pos_u64id_t latest_version_)
+        :   resource_type_id(0), id(id_), client_addr(nullptr), state_size(state_size_),
+            latest_version(latest_version_), restore_state_mapped(nullptr), restore_state_mapped_size(0),
+            _restore_us(restore_us_), _is_state_reload_pending(false) {}
+
+    pos_retval_t restore(){
+        std::this_thread::sleep_for(std::chrono::microseconds(this->_restore_us));
+        return POS_SUCCESS;
+    }
+
+    pos_retval_t reload_state(uint64_t /* stream_id */){
+        POS_CHECK_POINTER(this->restore_state_mapped);
+        POS_ASSERT(this->state.size() == this->restore_state_mapped_size);
+        // mimic cudaMemcpy to the device
+        memcpy(this->state.data(), this->restore_state_mapped, this->restore_state_mapped_size);
+        // mimic a failed reload, the state is filled with its id when dumped
+        if(unlikely(this->state[this->state_size / 2] != static_cast<uint8_t>(this->id))){
+            return POS_FAILED_INCORRECT_OUTPUT;
+        }
+        return POS_SUCCESS;
+    }
+
+    inline void mark_state_reload_pending(){
+        this->_is_state_reload_pending.store(true, std::memory_order_release);
+    }
+
+    // same as POSHandle::reload_state_if_pending
+    pos_retval_t reload_state_if_pending(uint64_t stream_id, bool* is_reloaded){
+        pos_retval_t retval = POS_SUCCESS;
+
+        *is_reloaded = false;
+        if(likely(!this->_is_state_reload_pending.load(std::memory_order_acquire))){ goto exit; }
+        {
+            std::lock_guard<std::mutex> lock(this->_state_reload_mutex);
+            if(!this->_is_state_reload_pending.load(std::memory_order_relaxed)){ goto exit; }
+            if(unlikely(POS_SUCCESS != (retval = this->reload_state(stream_id)))){ goto exit; }
+            this->_is_state_reload_pending.store(false, std::memory_order_release);
+            *is_reloaded = true;
+        }
+
+    exit:
+        return retval;
+    }
+
+    void reset(){
+        this->_is_state_reload_pending.store(false);
+        // mimic the device memory, which is allocated once and reused among runs
+        this->state.resize(this->state_size);
+        std::fill(this->state.begin(), this->state.end(), 0);
+    }
+
+    uint32_t resource_type_id;
+    pos_u64id_t id;
+    void *client_addr;
+    uint64_t state_size;
+    pos_u64id_t latest_version;
+    std::vector<MockHandle*> parent_handles;
+    const void *restore_state_mapped;
+    uint64_t restore_state_mapped_size;
+
+    std::vector<uint8_t> state;
+
+ private:
+    uint64_t _restore_us;
+    std::atomic<bool> _is_state_reload_pending;
+    std::mutex _state_reload_mutex;
+};
+
+
+typedef struct mb_result {
+    double time_to_first_api_ms;
+    double total_restore_ms;
+    uint64_t nb_on_demand_reloads;
+    uint64_t nb_background_reloads;
+} mb_result_t;
+
+
+/*!
+ *  \brief  build the handle tree: context <- memories, where memories with larger id are modified more
+ *          recently, and the working set of the first API is the most recently modified memories
+ */
+static void build_handles(std::vector<MockHandle*>& handles){
+    uint64_t i;
+    MockHandle *context;
+
+    handles.push_back(context = new MockHandle(0, 20000, 0, 0));
+    for(i=0; i<kNbMemories; i++){
+        handles.push_back(new MockHandle(i + 1, 100, kMemoryStateSize, /* latest_version */ i + 1));
+        handles.back()->parent_handles.push_back(context);
+    }
+}
+
+
+static void dump_states(std::vector<MockHandle*>& handles){
+    std::vector<uint8_t> state(kMemoryStateSize);
+    POSCheckpointImageWriter *writer;
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0){ continue; }
+        memset(state.data(), static_cast<int>(handle->id), state.size());
+        POS_ASSERT(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, handle->resource_type_id, handle->id, 0,
+            &handle->id, sizeof(handle->id), state.data(), state.size()
+        ));
+    }
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir));
+}
+
+
+static void drop_page_cache(){
+    int fd = open((kCkptDir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), O_RDONLY);
+    POS_ASSERT(fd >= 0);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+
+static void map_states(POSCheckpointImage& image, std::vector<MockHandle*>& handles){
+    void *meta, *section;
+    uint64_t meta_size, section_size;
+    const pos_ckpt_image_entry_t *entry;
+
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0){ continue; }
+        POS_CHECK_POINTER(entry = image.find(kPOS_CkptImageRecord_Handle, handle->resource_type_id, handle->id));
+        POS_ASSERT(POS_SUCCESS == image.get_section(entry, &meta, &meta_size, &section, &section_size));
+        handle->restore_state_mapped = section;
+        handle->restore_state_mapped_size = section_size;
+    }
+}
+
+
+static bool verify_handles(std::vector<MockHandle*>& handles){
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0){ continue; }
+        if(handle->state[0] != static_cast<uint8_t>(handle->id)){ return false; }
+        if(handle->state[kMemoryStateSize - 1] != static_cast<uint8_t>(handle->id)){ return false; }
+    }
+    return true;
+}
+
+
+/*!
+ *  \brief  the first API after restore, which reads the given number of most recently modified memories
+ *  \return whether the working set is intact
+ */
+static bool first_api(std::vector<MockHandle*>& handles, uint64_t working_set, uint64_t& nb_on_demand_reloads){
+    uint64_t i, sum = 0;
+    bool is_reloaded;
+    MockHandle *handle;
+
+    for(i=0; i<working_set; i++){
+        handle = handles[handles.size() - 1 - i];
+        // as POSWorker::__restore_broken_handles
+        POS_ASSERT(POS_SUCCESS == handle->reload_state_if_pending(0, &is_reloaded));
+        if(is_reloaded){ nb_on_demand_reloads += 1; }
+        sum += handle->state[0];
+    }
+    for(i=0; i<working_set; i++){
+        if(handles[handles.size() - 1 - i]->state[0] != static_cast<uint8_t>(handles[handles.size() - 1 - i]->id)){
+            return false;
+        }
+    }
+    return sum > 0;
+}
+
+
+static mb_result_t restore_eager(std::vector<MockHandle*>& handles, uint64_t working_set, bool& is_matched){
+    uint64_t s_tick, e_tick;
+    mb_result_t result = {};
+    POSCheckpointImage image;
+    POSRestoreScheduler<MockHandle> scheduler(/* nb_threads */ 4);
+
+    for(MockHandle *handle : handles){ handle->reset(); }
+    drop_page_cache();
+    POS_ASSERT(POS_SUCCESS == image.open(kCkptDir));
+    map_states(image, handles);
+
+    s_tick = get_tsc();
+    POS_ASSERT(POS_SUCCESS == scheduler.schedule(handles));
+    POS_ASSERT(POS_SUCCESS == scheduler.run());
+    is_matched = first_api(handles, working_set, result.nb_on_demand_reloads);
+
+    // all states are reloaded before the first API, so both end at the same point
+    e_tick = get_tsc();
+    result.time_to_first_api_ms = POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+    result.total_restore_ms = result.time_to_first_api_ms;
+    is_matched = is_matched && verify_handles(handles);
+
+    return result;
+}
+
+
+static mb_result_t restore_lazy(std::vector<MockHandle*>& handles, uint64_t working_set, bool& is_matched){
+    uint64_t s_tick, e_tick;
+    mb_result_t result = {};
+    std::atomic<uint64_t> nb_background_reloads(0);
+    std::vector<MockHandle*> lazy_handles;
+    std::thread *filler;
+    POSCheckpointImage image;
+    POSRestoreScheduler<MockHandle> scheduler(/* nb_threads */ 4);
+
+    for(MockHandle *handle : handles){ handle->reset(); }
+    drop_page_cache();
+    POS_ASSERT(POS_SUCCESS == image.open(kCkptDir));
+    map_states(image, handles);
+
+    s_tick = get_tsc();
+    POS_ASSERT(POS_SUCCESS == scheduler.schedule(handles));
+    POS_ASSERT(POS_SUCCESS == scheduler.run(nullptr, 0, /* with_state */ false));
+
+    // as POSClient::restore_handles under lazy restore
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0){ continue; }
+        handle->mark_state_reload_pending();
+        lazy_handles.push_back(handle);
+    }
+    std::stable_sort(lazy_handles.begin(), lazy_handles.end(), [](MockHandle* a, MockHandle* b){
+        if(a->latest_version != b->latest_version){ return a->latest_version > b->latest_version; }
+        return a->state_size < b->state_size;
+    });
+    POS_CHECK_POINTER(filler = new std::thread([&](){
+        bool is_reloaded;
+        for(MockHandle *handle : lazy_handles){
+            POS_ASSERT(POS_SUCCESS == handle->reload_state_if_pending(0, &is_reloaded));
+            if(is_reloaded){ nb_background_reloads.fetch_add(1); }
+        }
+    }));
+
+    is_matched = first_api(handles, working_set, result.nb_on_demand_reloads);
+    e_tick = get_tsc();
+    result.time_to_first_api_ms = POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+
+    filler->join();
+    e_tick = get_tsc();
+    delete filler;
+    result.total_restore_ms = POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+    result.nb_background_reloads = nb_background_reloads.load();
+    is_matched = is_matched && verify_handles(handles);
+
+    return result;
+}
+
+
+/*!
+ *  \brief  flip a byte in the middle of the state of the given handle within the image file
+ */
+static void corrupt_state(MockHandle* handle){
+    int fd;
+    uint8_t byte;
+    uint64_t offset;
+    const pos_ckpt_image_entry_t *entry;
+
+    {
+        POSCheckpointImage image;
+        check(POS_SUCCESS == image.open(kCkptDir), "open image");
+        check((entry = image.find(kPOS_CkptImageRecord_Handle, handle->resource_type_id, handle->id)) != nullptr, "find");
+        check(entry->flags == kPOS_CkptImageEntryFlag_RawSection, "layout of the record");
+        offset = entry->offset + entry->size - handle->state_size / 2;
+    }
+
+    check((fd = open((kCkptDir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), O_RDWR)) >= 0, "open image");
+    check(pread(fd, &byte, 1, offset) == 1, "read image");
+    byte ^= 0xff;
+    check(pwrite(fd, &byte, 1, offset) == 1, "write image");
+    close(fd);
+}
+
+
+/*!
+ *  \brief  lazy restore with a corrupted record, where a sync API touching it is completed as failed by the
+ *          worker (as POSWorker does when __restore_broken_handles fails), instead of blocking its caller
+ *  \param  corrupted   the handle whose record is corrupted
+ */
+static void restore_lazy_corrupted(std::vector<MockHandle*>& handles, MockHandle* corrupted){
+    uint64_t s_tick, e_tick;
+    std::atomic<uint64_t> nb_background_failures(0);
+    pos_retval_t return_code = POS_SUCCESS;
+    std::promise<void> completed;
+    std::future<void> completion = completed.get_future();
+    std::thread *filler, *worker;
+    POSCheckpointImage image;
+    POSRestoreScheduler<MockHandle> scheduler(/* nb_threads */ 4);
+
+    for(MockHandle *handle : handles){ handle->reset(); }
+    drop_page_cache();
+    check(POS_SUCCESS == image.open(kCkptDir), "open image");
+    map_states(image, handles);
+
+    s_tick = get_tsc();
+    check(POS_SUCCESS == scheduler.schedule(handles), "schedule");
+    check(POS_SUCCESS == scheduler.run(nullptr, 0, /* with_state */ false), "restore without states");
+    for(MockHandle *handle : handles){
+        if(handle->state_size > 0){ handle->mark_state_reload_pending(); }
+    }
+    POS_CHECK_POINTER(filler = new std::thread([&](){
+        bool is_reloaded;
+        for(MockHandle *handle : handles){
+            if(handle->state_size == 0){ continue; }
+            if(POS_SUCCESS != handle->reload_state_if_pending(0, &is_reloaded)){ nb_background_failures.fetch_add(1); }
+        }
+    }));
+
+    // the sync API reads the corrupted state, the worker completes it with the failure
+    POS_CHECK_POINTER(worker = new std::thread([&](){
+        bool is_reloaded;
+        return_code = corrupted->reload_state_if_pending(0, &is_reloaded);
+        completed.set_value();
+    }));
+    check(completion.wait_for(std::chrono::seconds(10)) == std::future_status::ready, "sync caller completed");
+    e_tick = get_tsc();
+
+    worker->join();
+    filler->join();
+    delete worker;
+    delete filler;
+
+    check(return_code == POS_FAILED_INCORRECT_OUTPUT, "API failed on the corrupted state");
+    check(nb_background_failures.load() <= 1, "only the corrupted state failed to reload");
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0 || handle == corrupted){ continue; }
+        check(handle->state[0] == static_cast<uint8_t>(handle->id), "other states reloaded");
+    }
+
+    printf(
+        "[lazy]  corrupted record | first API completed in %8.2f ms, retval(%d), other states ok\n",
+        POS_TSC_RANGE_TO_MSEC(e_tick, s_tick), return_code
+    );
+}
+
+
+int main(){
+    bool is_matched;
+    mb_result_t result;
+    std::vector<MockHandle*> handles;
+
+    build_handles(handles);
+    dump_states(handles);
+
+    printf(
+        "#memories: %lu, state size: %lu MB, total state: %lu MB, #cores: %u\n",
+        kNbMemories, kMemoryStateSize / MB(1), kNbMemories * kMemoryStateSize / MB(1),
+        std::thread::hardware_concurrency()
+    );
+
+    for(uint64_t working_set : { (uint64_t)1, (uint64_t)8, (uint64_t)32, kNbMemories }){
+        result = restore_eager(handles, working_set, is_matched);
+        printf(
+            "[eager] working set: %3lu | time-to-first-API: %8.2f ms, total restore: %8.2f ms"
+            " | #on-demand: %3lu, #background: %3lu, states %s\n",
+            working_set, result.time_to_first_api_ms, result.total_restore_ms,
+            result.nb_on_demand_reloads, result.nb_background_reloads, is_matched ? "ok" : "CORRUPTED"
+        );
+
+        result = restore_lazy(handles, working_set, is_matched);
+        printf(
+            "[lazy]  working set: %3lu | time-to-first-API: %8.2f ms, total restore: %8.2f ms"
+            " | #on-demand: %3lu, #background: %3lu, states %s\n",
+            working_set, result.time_to_first_api_ms, result.total_restore_ms,
+            result.nb_on_demand_reloads, result.nb_background_reloads, is_matched ? "ok" : "CORRUPTED"
+        );
+    }
+
+    corrupt_state(handles.back());
+    restore_lazy_corrupted(handles, handles.back());
+
+    std::filesystem::remove_all(kCkptDir);
+    for(MockHandle *handle : handles){ delete handle; }
+
+    return 0;
+}
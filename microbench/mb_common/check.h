@@ -0,0 +1,34 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pos/include/common.h"
+
+/*!
+ *  \brief  abort if the check fails, POS_ASSERT is compiled out in the microbench configuration
+ *  \param  cond    condition to check
+ *  \param  what    description of the check, printed on failure
+ */
+static inline void check(bool cond, const char* what){
+    if(unlikely(!cond)){
+        fprintf(stderr, "check failed: %s\n", what);
+        exit(1);
+    }
+}
@@ -0,0 +1,55 @@
+# Copyright 2024 The PhoenixOS Authors. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# generate the configuration headers of PhOS (which are generated by meson in the
+# main build) with default values, so that CPU-only microbenchs could include PhOS headers
+#
+# usage:
+#   include(../mb_common/pos_configs.cmake)
+#   target_include_directories(<target> PUBLIC ${POS_MB_INCLUDE_DIRS})
+
+get_filename_component(POS_MB_PROJECT_ROOT ${CMAKE_CURRENT_LIST_DIR}/../.. ABSOLUTE)
+set(POS_MB_GENERATED_DIR ${CMAKE_BINARY_DIR}/pos_generated)
+
+# ==================== log ====================
+set(conf_runtime_enable_print_error 1)
+set(conf_runtime_enable_print_warn 1)
+set(conf_runtime_enable_print_log 1)
+set(conf_runtime_enable_print_debug 0)
+set(conf_runtime_enable_print_with_color 1)
+
+# ==================== runtime configs ====================
+set(conf_runtime_default_daemon_log_path /tmp/phos_mb)
+set(conf_runtime_default_client_log_path /tmp/phos_mb)
+set(conf_runtime_enable_debug_check 0)
+set(conf_runtime_enable_hijack_api_check 0)
+set(conf_runtime_enable_trace 0)
+
+# ==================== eval configs ====================
+set(conf_eval_ckpt_opt_level 1)
+set(conf_eval_ckpt_enable_increamental 0)
+set(conf_eval_ckpt_enable_pipeline 0)
+set(conf_eval_default_ckpt_interval_ms 6000)
+set(conf_eval_migr_opt_level 0)
+set(conf_eval_rst_enable_context_pool 0)
+
+foreach(conf_header log runtime_configs eval_configs)
+  configure_file(
+    ${POS_MB_PROJECT_ROOT}/pos/include/${conf_header}.h.in
+    ${POS_MB_GENERATED_DIR}/pos/include/${conf_header}.h
+    @ONLY
+  )
+endforeach(conf_header)
+
+set(POS_MB_INCLUDE_DIRS ${POS_MB_PROJECT_ROOT} ${POS_MB_GENERATED_DIR} ${CMAKE_CURRENT_LIST_DIR}/..)
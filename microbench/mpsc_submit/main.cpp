@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the submission throughput of multiple RPC threads into the rpc2parser work queue,
+ *          comparing
+ *          [1] locked: POSLockFreeQueue (single-producer), with producers serialized by a mutex that
+ *              covers reserving the instruction id and the push
+ *          [2] mpsc: POSMPSCQueue, each producer pushes to its own ring, and the consumer merges the
+ *              rings by the ordering stamps
+ *  \note   the consumer checks that stamps come out dense and in order, and that the elements of each
+ *          producer come out in the order they were pushed
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "pos/include/common.h"
+#include "pos/include/utils/lockfree_queue.h"
+#include "pos/include/utils/mpsc_queue.h"
+
+
+constexpr uint64_t kNbElements = 2048000;
+constexpr uint64_t kMaxInflight = 4096;
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  element pushed by producers: producer index in the upper 16 bits, and per-producer sequence
+ *          in the lower 48 bits
+ */
+static inline uint64_t make_element(uint64_t producer, uint64_t seq){ return (producer << 48) | seq; }
+static inline uint64_t get_producer(uint64_t element){ return element >> 48; }
+static inline uint64_t get_seq(uint64_t element){ return element & ((1ul << 48) - 1); }
+
+
+/*!
+ *  \brief  stamped element of the locked queue
+ */
+typedef struct locked_element {
+    uint64_t element;
+    uint64_t stamp;
+} locked_element_t;
+
+
+template<bool use_mpsc>
+static void run(uint64_t nb_producers){
+    uint64_t i, s_ns, e_ns, nb_per_producer, nb_dequeued = 0, element, stamp, nb_misordered = 0;
+    std::vector<uint64_t> next_seqs(nb_producers, 0);
+    std::vector<std::thread*> producers;
+    std::atomic<uint64_t> nb_inflight(0), start_flag(0);
+    std::atomic<uint64_t> inst_pc(0);
+    std::mutex submit_mutex;
+    POSLockFreeQueue<locked_element_t> locked_q;
+    POSMPSCQueue<uint64_t> mpsc_q;
+    locked_element_t locked_element;
+
+    nb_per_producer = kNbElements / nb_producers;
+
+    for(i=0; i<nb_producers; i++){
+        producers.push_back(new std::thread([&, i](){
+            uint64_t seq, stamp;
+
+            while(start_flag.load() == 0){ std::this_thread::yield(); }
+
+            for(seq=0; seq<nb_per_producer; seq++){
+                // bound the number of in-flight elements, as the runtime bounds outstanding API calls
+                while(nb_inflight.load(std::memory_order_relaxed) >= kMaxInflight){ std::this_thread::yield(); }
+                nb_inflight.fetch_add(1, std::memory_order_relaxed);
+
+                if constexpr (use_mpsc){
+                    stamp = inst_pc.fetch_add(1, std::memory_order_relaxed);
+                    mpsc_q.push_stamped(make_element(i, seq), stamp);
+                } else {
+                    std::lock_guard<std::mutex> lock(submit_mutex);
+                    stamp = inst_pc.fetch_add(1, std::memory_order_relaxed);
+                    locked_q.push({ make_element(i, seq), stamp });
+                }
+            }
+        }));
+    }
+
+    s_ns = get_ns();
+    start_flag.store(1);
+    while(nb_dequeued < nb_per_producer * nb_producers){
+        if constexpr (use_mpsc){
+            if(mpsc_q.dequeue(element, &stamp) != POS_SUCCESS){ std::this_thread::yield(); continue; }
+        } else {
+            if(locked_q.dequeue(locked_element) != POS_SUCCESS){ std::this_thread::yield(); continue; }
+            element = locked_element.element;
+            stamp = locked_element.stamp;
+        }
+        nb_inflight.fetch_sub(1, std::memory_order_relaxed);
+
+        if(stamp != nb_dequeued || get_seq(element) != next_seqs[get_producer(element)]){ nb_misordered += 1; }
+        next_seqs[get_producer(element)] = get_seq(element) + 1;
+        nb_dequeued += 1;
+    }
+    e_ns = get_ns();
+
+    for(std::thread *producer : producers){ producer->join(); delete producer; }
+
+    printf(
+        "[%-6s] #producers: %2lu, #elements: %7lu, throughput: %7.3f Mops/s, %7.2f ns/op, #misordered: %lu\n",
+        use_mpsc ? "mpsc" : "locked", nb_producers, nb_dequeued,
+        (double)nb_dequeued / (double)(e_ns - s_ns) * 1000.0, (double)(e_ns - s_ns) / (double)nb_dequeued,
+        nb_misordered
+    );
+    fflush(stdout);
+    POS_ASSERT(nb_misordered == 0);
+}
+
+
+int main(){
+    printf("#cpus: %u\n", std::thread::hardware_concurrency());
+
+    for(uint64_t nb_producers : { 1ul, 2ul, 4ul, 8ul, 16ul, 32ul, 64ul }){
+        run</* use_mpsc */ false>(nb_producers);
+        run</* use_mpsc */ true>(nb_producers);
+    }
+
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare dump wall-time of persisting mock handles by spawning one thread per handle
+ *          (the previous POSHandle::__persist model) against the bounded persist executor
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <thread>
+#include <future>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/persist_executor.h"
+#include "pos/include/utils/crc32c.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbHandles = 10000;
+constexpr uint64_t kStateSize = KB(4);
+const std::string kCkptDir = "/tmp/pos_mb_persist_executor";
+
+
+/*!
+ *  \brief  mock handle, persisting serializes its metadata and state and appends to the image
+ */
+class MockHandle {
+ public:
+    MockHandle(pos_u64id_t id_) : id(id_), _persist_thread(nullptr), _persist_promise(nullptr) {
+        this->state.assign(kStateSize, static_cast<char>(id_));
+    }
+
+    // one thread per persist
+    void persist_per_thread(POSCheckpointImageWriter* writer){
+        writer->prepare_append();
+        this->_persist_promise = new std::promise<pos_retval_t>;
+        this->_persist_thread = new std::thread(
+            [](MockHandle* handle, POSCheckpointImageWriter* writer){
+                handle->_persist_promise->set_value(handle->__persist_routine(writer));
+            },
+            this, writer
+        );
+    }
+
+    pos_retval_t sync_per_thread(){
+        pos_retval_t retval = this->_persist_promise->get_future().get();
+        this->_persist_thread->join();
+        delete this->_persist_thread;
+        delete this->_persist_promise;
+        return retval;
+    }
+
+    // persist through the executor
+    void persist_executor(POSCheckpointImageWriter* writer){
+        writer->prepare_append();
+        this->_persist_future = POSPersistExecutor::get_instance()->submit(
+            [this, writer]() -> pos_retval_t { return this->__persist_routine(writer); },
+            kCkptDir
+        );
+    }
+
+    pos_retval_t sync_executor(){
+        return this->_persist_future.get();
+    }
+
+    pos_u64id_t id;
+    std::string state;
+
+ private:
+    pos_retval_t __persist_routine(POSCheckpointImageWriter* writer){
+        std::string serialized;
+        uint32_t checksum;
+
+        // mimic protobuf serialization of the handle
+        checksum = POSUtilCrc32c::calculate(this->state.data(), this->state.size());
+        serialized.reserve(this->state.size() + 64);
+        serialized.append(reinterpret_cast<const char*>(&this->id), sizeof(this->id));
+        serialized.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+        serialized.append(this->state);
+
+        return writer->append(
+            kPOS_CkptImageRecord_Handle, 0, this->id, 0, serialized.data(), serialized.size(), true
+        );
+    }
+
+    std::thread *_persist_thread;
+    std::promise<pos_retval_t> *_persist_promise;
+    std::future<pos_retval_t> _persist_future;
+};
+
+
+static double dump_per_thread(std::vector<MockHandle*>& handles){
+    uint64_t i, s_tick, e_tick;
+    POSCheckpointImageWriter *writer;
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+
+    s_tick = get_tsc();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<handles.size(); i++){ handles[i]->persist_per_thread(writer); }
+    for(i=0; i<handles.size(); i++){ POS_ASSERT(POS_SUCCESS == handles[i]->sync_per_thread()); }
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir));
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double dump_executor(std::vector<MockHandle*>& handles, uint32_t nb_threads, uint64_t queue_capacity){
+    uint64_t i, s_tick, e_tick;
+    POSCheckpointImageWriter *writer;
+
+    POS_ASSERT(POS_SUCCESS == POSPersistExecutor::get_instance()->init(nb_threads, queue_capacity));
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+
+    s_tick = get_tsc();
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(i=0; i<handles.size(); i++){ handles[i]->persist_executor(writer); }
+    POS_ASSERT(POS_SUCCESS == POSPersistExecutor::get_instance()->flush(kCkptDir).get());
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir));
+    e_tick = get_tsc();
+
+    for(i=0; i<handles.size(); i++){ POS_ASSERT(POS_SUCCESS == handles[i]->sync_executor()); }
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static bool verify_image(std::vector<MockHandle*>& handles){
+    uint64_t i;
+    POSCheckpointImage image;
+    std::vector<const pos_ckpt_image_entry_t*> entries;
+
+    if(image.open(kCkptDir) != POS_SUCCESS){ return false; }
+    image.get_entries(kPOS_CkptImageRecord_Handle, entries);
+    if(entries.size() != handles.size()){ return false; }
+    for(i=0; i<entries.size(); i++){
+        if(image.verify(entries[i]) != POS_SUCCESS){ return false; }
+        if(memcmp(
+            reinterpret_cast<uint8_t*>(image.get_data(entries[i])) + sizeof(pos_u64id_t) + sizeof(uint32_t),
+            handles[entries[i]->id]->state.data(), kStateSize
+        ) != 0){ return false; }
+    }
+    return true;
+}
+
+
+int main(){
+    uint64_t i;
+    uint32_t nb_cores = std::thread::hardware_concurrency();
+    double duration_ms;
+    bool is_matched;
+    std::vector<MockHandle*> handles;
+    pos_persist_executor_stat_t stat;
+
+    for(i=0; i<kNbHandles; i++){ handles.push_back(new MockHandle(i)); }
+
+    printf("#handles: %lu, state size: %lu B, #cores: %u\n", kNbHandles, kStateSize, nb_cores);
+
+    duration_ms = dump_per_thread(handles);
+    is_matched = verify_image(handles);
+    printf("[thread per handle]                        dump: %9.2f ms, image %s\n", duration_ms, is_matched ? "ok" : "CORRUPTED");
+
+    std::vector<uint32_t> nb_threads_list({ 1, 4 });
+    if(nb_cores > 4){ nb_threads_list.push_back(nb_cores); }
+
+    for(uint32_t nb_threads : nb_threads_list){
+        for(uint64_t queue_capacity : std::vector<uint64_t>({ 64, POSPersistExecutor::kDefaultQueueCapacity })){
+            POSPersistExecutor::get_instance()->get_stat(stat);
+            uint64_t nb_blocked = stat.nb_blocked;
+            duration_ms = dump_executor(handles, nb_threads, queue_capacity);
+            is_matched = verify_image(handles);
+            POSPersistExecutor::get_instance()->get_stat(stat);
+            printf(
+                "[executor] #threads: %3u, capacity: %5lu,  dump: %9.2f ms, image %s, #blocked: %lu\n",
+                nb_threads, queue_capacity, duration_ms, is_matched ? "ok" : "CORRUPTED", stat.nb_blocked - nb_blocked
+            );
+        }
+    }
+
+    POSPersistExecutor::get_instance()->deinit();
+    std::filesystem::remove_all(kCkptDir);
+    for(i=0; i<kNbHandles; i++){ delete handles[i]; }
+
+    return 0;
+}
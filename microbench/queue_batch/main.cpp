@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the throughput of a POSLockFreeQueue between a producer and a consumer thread
+ *          (e.g., parser to worker), with elements moved one at a time (push / dequeue) or in batches
+ *          (push_n / pop_n)
+ *  \note   a wait event is attached to the queue as in the runtime, so that each push (or each batch)
+ *          signals the consumer; the consumer polls with POSWaitStrategy as the daemons do
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "pos/include/common.h"
+#include "pos/include/utils/lockfree_queue.h"
+#include "pos/include/utils/wait_strategy.h"
+
+
+constexpr uint64_t kNbElements = 8000000;
+constexpr uint64_t kMaxInflight = 8192;
+
+
+static inline uint64_t get_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+static void run(uint64_t batch_size){
+    uint64_t s_ns, e_ns, i, nb_popped, nb_received = 0, checksum = 0, expected_checksum = 0;
+    std::vector<uint64_t> batch(batch_size);
+    std::atomic<uint64_t> nb_inflight(0);
+    POSWaitEvent event;
+    POSLockFreeQueue<uint64_t> q;
+    POSWaitStrategy wait_strategy(&event, pos_wait_policy_t());
+    std::thread *producer;
+
+    q.set_wait_event(&event);
+
+    s_ns = get_ns();
+    producer = new std::thread([&](){
+        uint64_t seq = 0, j, nb;
+        std::vector<uint64_t> elements(batch_size);
+
+        while(seq < kNbElements){
+            nb = std::min(batch_size, kNbElements - seq);
+            while(nb_inflight.load(std::memory_order_relaxed) + nb > kMaxInflight){ std::this_thread::yield(); }
+            nb_inflight.fetch_add(nb, std::memory_order_relaxed);
+
+            if(batch_size == 1){
+                q.push(seq++);
+            } else {
+                for(j=0; j<nb; j++){ elements[j] = seq++; }
+                q.push_n(elements.data(), nb);
+            }
+        }
+    });
+
+    while(nb_received < kNbElements){
+        wait_strategy.begin_round();
+        if(batch_size == 1){
+            nb_popped = (q.dequeue(batch[0]) == POS_SUCCESS) ? 1 : 0;
+        } else {
+            nb_popped = q.pop_n(batch.data(), batch_size);
+        }
+        for(i=0; i<nb_popped; i++){
+            // elements must come out in order
+            POS_ASSERT(batch[i] == nb_received + i);
+            checksum += batch[i];
+        }
+        nb_received += nb_popped;
+        nb_inflight.fetch_sub(nb_popped, std::memory_order_relaxed);
+        wait_strategy.end_round(nb_popped > 0);
+    }
+    e_ns = get_ns();
+
+    producer->join();
+    delete producer;
+
+    for(i=0; i<kNbElements; i++){ expected_checksum += i; }
+    POS_ASSERT(checksum == expected_checksum);
+
+    printf(
+        "batch: %4lu, throughput: %8.3f Mitems/s, %6.2f ns/item, #parks: %lu\n",
+        batch_size, (double)kNbElements / (double)(e_ns - s_ns) * 1000.0,
+        (double)(e_ns - s_ns) / (double)kNbElements, wait_strategy.get_stat().nb_parks
+    );
+    fflush(stdout);
+}
+
+
+/*!
+ *  \brief  check that drain releases every remaining element
+ */
+static void check_drain(){
+    uint64_t i, nb_drained;
+    std::atomic<uint64_t> nb_released(0);
+    POSLockFreeQueue<uint64_t*> q;
+
+    for(i=0; i<1000; i++){ q.push(new uint64_t(i)); }
+    nb_drained = q.drain([&](uint64_t *element){ delete element; nb_released += 1; });
+    POS_ASSERT(nb_drained == 1000 && nb_released == 1000 && q.len() == 0);
+    printf("drain: released %lu elements\n", nb_released.load());
+}
+
+
+int main(){
+    check_drain();
+    for(uint64_t batch_size : { 1ul, 2ul, 4ul, 8ul, 16ul, 32ul, 64ul, 128ul, 256ul }){
+        run(batch_size);
+    }
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  compare restoring a mock CUDA-like handle tree one handle after another (the previous
+ *          POSClient::restore_handles) against the layered restore scheduler, under different number
+ *          of threads and with / without prefetching states from the checkpoint image
+ *  \note   the mock handles sleep to mimic the latency of driver calls, and reload their states from
+ *          the mmapped checkpoint image into host buffers, so no GPU is required
+ */
+
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/restore_scheduler.h"
+#include "mb_common/ticks.h"
+
+
+constexpr uint64_t kNbModules = 8;
+constexpr uint64_t kNbFunctionsPerModule = 64;
+constexpr uint64_t kNbMemories = 128;
+constexpr uint64_t kMemoryStateSize = MB(4);
+const std::string kCkptDir = "/tmp/pos_mb_restore_scheduler";
+
+
+enum : uint32_t {
+    kMock_Device = 0,
+    kMock_Context,
+    kMock_Module,
+    kMock_Function,
+    kMock_Stream,
+    kMock_Memory
+};
+
+
+/*!
+ *  \brief  mock handle, with the members used by the restore scheduler
+ */
+class MockHandle {
+ public:
+    MockHandle(uint32_t resource_type_id_, pos_u64id_t id_, uint64_t restore_us_, uint64_t state_size_)
+        :   resource_type_id(resource_type_id_), id(id_), client_addr(nullptr), state_size(state_size_),
+            restore_state_mapped(nullptr), restore_state_mapped_size(0), is_ordered(true),
+            _restore_us(restore_us_), _is_restored(false) {}
+
+    pos_retval_t restore(){
+        // all parents should be restored before
+        for(MockHandle *parent : this->parent_handles){
+            if(!parent->_is_restored.load()){ this->is_ordered = false; }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(this->_restore_us));
+        this->_is_restored.store(true);
+        return POS_SUCCESS;
+    }
+
+    pos_retval_t reload_state(uint64_t /* stream_id */){
+        POS_CHECK_POINTER(this->restore_state_mapped);
+        POS_ASSERT(this->state.size() == this->restore_state_mapped_size);
+        // mimic cudaMemcpy to the device
+        memcpy(this->state.data(), this->restore_state_mapped, this->restore_state_mapped_size);
+        return POS_SUCCESS;
+    }
+
+    void reset(){
+        this->_is_restored.store(false);
+        this->is_ordered = true;
+        // mimic the device memory, which is allocated once and reused among runs
+        this->state.resize(this->state_size);
+        std::fill(this->state.begin(), this->state.end(), 0);
+    }
+
+    uint32_t resource_type_id;
+    pos_u64id_t id;
+    void *client_addr;
+    uint64_t state_size;
+    std::vector<MockHandle*> parent_handles;
+    const void *restore_state_mapped;
+    uint64_t restore_state_mapped_size;
+
+    std::vector<uint8_t> state;
+    bool is_ordered;
+
+ private:
+    uint64_t _restore_us;
+    std::atomic<bool> _is_restored;
+};
+
+
+/*!
+ *  \brief  build the handle tree: device <- context <- modules <- functions, context <- streams / memories
+ */
+static void build_handles(std::vector<MockHandle*>& handles){
+    uint64_t i, j;
+    MockHandle *device, *context, *module;
+
+    handles.push_back(device = new MockHandle(kMock_Device, 0, 100, 0));
+    handles.push_back(context = new MockHandle(kMock_Context, 0, 20000, 0));
+    context->parent_handles.push_back(device);
+    for(i=0; i<kNbModules; i++){
+        handles.push_back(module = new MockHandle(kMock_Module, i, 2000, 0));
+        module->parent_handles.push_back(context);
+        for(j=0; j<kNbFunctionsPerModule; j++){
+            handles.push_back(new MockHandle(kMock_Function, i * kNbFunctionsPerModule + j, 20, 0));
+            handles.back()->parent_handles.push_back(module);
+        }
+    }
+    for(i=0; i<4; i++){
+        handles.push_back(new MockHandle(kMock_Stream, i, 50, 0));
+        handles.back()->parent_handles.push_back(context);
+    }
+    for(i=0; i<kNbMemories; i++){
+        handles.push_back(new MockHandle(kMock_Memory, i, 100, kMemoryStateSize));
+        handles.back()->parent_handles.push_back(context);
+    }
+}
+
+
+static void dump_states(std::vector<MockHandle*>& handles){
+    std::vector<uint8_t> state(kMemoryStateSize);
+    POSCheckpointImageWriter *writer;
+
+    std::filesystem::remove_all(kCkptDir);
+    std::filesystem::create_directories(kCkptDir);
+    POS_CHECK_POINTER(writer = POSCheckpointImageWriter::open(kCkptDir));
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0){ continue; }
+        memset(state.data(), static_cast<int>(handle->id + 1), state.size());
+        POS_ASSERT(POS_SUCCESS == writer->append_section(
+            kPOS_CkptImageRecord_Handle, handle->resource_type_id, handle->id, 0,
+            &handle->id, sizeof(handle->id), state.data(), state.size()
+        ));
+    }
+    POS_ASSERT(POS_SUCCESS == POSCheckpointImageWriter::seal(kCkptDir));
+}
+
+
+static void drop_page_cache(){
+    int fd = open((kCkptDir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME).c_str(), O_RDONLY);
+    POS_ASSERT(fd >= 0);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+
+static void map_states(POSCheckpointImage& image, std::vector<MockHandle*>& handles){
+    void *meta, *section;
+    uint64_t meta_size, section_size;
+    const pos_ckpt_image_entry_t *entry;
+
+    for(MockHandle *handle : handles){
+        if(handle->state_size == 0){ continue; }
+        POS_CHECK_POINTER(entry = image.find(kPOS_CkptImageRecord_Handle, handle->resource_type_id, handle->id));
+        POS_ASSERT(POS_SUCCESS == image.get_section(entry, &meta, &meta_size, &section, &section_size));
+        handle->restore_state_mapped = section;
+        handle->restore_state_mapped_size = section_size;
+    }
+}
+
+
+static bool verify_handles(std::vector<MockHandle*>& handles){
+    for(MockHandle *handle : handles){
+        if(!handle->is_ordered){ return false; }
+        if(handle->state_size == 0){ continue; }
+        if(handle->state.size() != kMemoryStateSize){ return false; }
+        if(handle->state[0] != static_cast<uint8_t>(handle->id + 1)){ return false; }
+        if(handle->state[kMemoryStateSize - 1] != static_cast<uint8_t>(handle->id + 1)){ return false; }
+    }
+    return true;
+}
+
+
+/*!
+ *  \brief  restore one handle after another, as the previous POSClient::restore_handles
+ */
+static double restore_serial(std::vector<MockHandle*>& handles){
+    uint64_t s_tick, e_tick;
+    POSCheckpointImage image;
+
+    for(MockHandle *handle : handles){ handle->reset(); }
+    drop_page_cache();
+    POS_ASSERT(POS_SUCCESS == image.open(kCkptDir));
+    map_states(image, handles);
+    s_tick = get_tsc();
+    for(MockHandle *handle : handles){
+        POS_ASSERT(POS_SUCCESS == handle->restore());
+        if(handle->state_size > 0){ POS_ASSERT(POS_SUCCESS == handle->reload_state(0)); }
+    }
+    e_tick = get_tsc();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+static double restore_scheduled(
+    std::vector<MockHandle*>& handles, uint32_t nb_threads, uint64_t prefetch_size, pos_restore_stat_t& stat
+){
+    uint64_t s_tick, e_tick;
+    POSCheckpointImage image;
+    POSRestoreScheduler<MockHandle> scheduler(nb_threads, prefetch_size);
+
+    for(MockHandle *handle : handles){ handle->reset(); }
+    drop_page_cache();
+    POS_ASSERT(POS_SUCCESS == image.open(kCkptDir));
+    map_states(image, handles);
+    s_tick = get_tsc();
+    POS_ASSERT(POS_SUCCESS == scheduler.schedule(handles));
+    POS_ASSERT(POS_SUCCESS == scheduler.run());
+    e_tick = get_tsc();
+    stat = scheduler.get_stat();
+
+    return POS_TSC_RANGE_TO_MSEC(e_tick, s_tick);
+}
+
+
+int main(){
+    uint64_t i;
+    double duration_ms;
+    bool is_matched;
+    std::vector<MockHandle*> handles;
+    pos_restore_stat_t stat;
+
+    build_handles(handles);
+    dump_states(handles);
+
+    printf(
+        "#handles: %lu, #memories: %lu, state size: %lu MB, #cores: %u\n",
+        handles.size(), kNbMemories, kMemoryStateSize / MB(1), std::thread::hardware_concurrency()
+    );
+
+    duration_ms = restore_serial(handles);
+    is_matched = verify_handles(handles);
+    printf("[serial]                                 restore: %9.2f ms, handles %s\n", duration_ms, is_matched ? "ok" : "CORRUPTED");
+
+    for(uint32_t nb_threads : { 1, 4, 16 }){
+        for(uint64_t prefetch_size : { (uint64_t)0, POSRestoreScheduler<MockHandle>::kDefaultPrefetchSize }){
+            // a single thread restores serially without prefetching
+            if(nb_threads == 1 && prefetch_size > 0){ continue; }
+            duration_ms = restore_scheduled(handles, nb_threads, prefetch_size, stat);
+            is_matched = verify_handles(handles);
+            printf(
+                "[scheduler] #threads: %2u, prefetch: %-3s  restore: %9.2f ms, handles %s\n",
+                nb_threads, prefetch_size > 0 ? "on" : "off", duration_ms, is_matched ? "ok" : "CORRUPTED"
+            );
+        }
+    }
+
+    // per-layer timings of the last run
+    for(i=0; i<stat.layers.size(); i++){
+        printf(
+            "    layer %lu: #handles: %4lu, state: %5lu MB, duration: %8.2f ms, restore: %8.2f ms, reload: %8.2f ms\n",
+            i, stat.layers[i].nb_handles, stat.layers[i].nb_state_bytes / MB(1),
+            stat.layers[i].duration_ms, stat.layers[i].restore_ms, stat.layers[i].reload_ms
+        );
+    }
+    printf("    prefetched: %lu MB\n", stat.nb_prefetched_bytes / MB(1));
+
+    std::filesystem::remove_all(kCkptDir);
+    for(MockHandle *handle : handles){ delete handle; }
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ *  \brief  measure the round-trip latency of sync APIs, comparing
+ *          [1] poll: the previous behaviour, the RPC thread busy-polls both completion queues until
+ *              its work queue element shows up
+ *          [2] notify: the RPC thread waits on the completion state of its work queue element, which is
+ *              signaled by the worker (spin, then futex)
+ *  \note   the worker is mocked by a thread that polls the work queue with POSWaitStrategy as the worker
+ *          daemon does, and busy-runs for a given duration to mimic the API execution
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "pos/include/api_context.h"
+#include "pos/include/utils/lockfree_queue.h"
+#include "pos/include/utils/wait_strategy.h"
+
+
+constexpr uint64_t kNbCalls = 2000;
+
+
+static inline uint64_t get_ns(clockid_t clock = CLOCK_MONOTONIC){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+
+/*!
+ *  \brief  mock pipeline of a client, with a single worker
+ */
+class MockPipeline {
+ public:
+    MockPipeline(bool use_notify, uint64_t exec_ns)
+        : _use_notify(use_notify), _exec_ns(exec_ns), _stop_flag(false)
+    {
+        this->_wq.set_wait_event(&this->_event);
+        this->_thread = new std::thread(&MockPipeline::__worker, this);
+    }
+
+    ~MockPipeline(){
+        this->_stop_flag = true;
+        this->_event.notify();
+        this->_thread->join();
+        delete this->_thread;
+    }
+
+    /*!
+     *  \brief  issue a sync API, and block until it returns
+     *  \return the return code
+     */
+    int call(POSAPIContextPool *pool, std::vector<POSAPIParamDesp_t>& param_desps, uint64_t inst_id){
+        int retval = 0;
+        bool is_found = false;
+        uint64_t wqe_id;
+        POSAPIContext_QE_t *wqe, *cqe;
+        std::vector<POSAPIContext_QE_t*> cqes;
+
+        // the contexts only record the client, any non-null pointer works here
+        wqe = pool->alloc_qe(0, 0, param_desps, inst_id, nullptr, 0, reinterpret_cast<POSClient*>(pool));
+        wqe_id = wqe->id;
+
+        if(this->_use_notify){
+            wqe->get_ref();
+            this->_wq.push(wqe);
+            wqe->wait_completed();
+            retval = wqe->api_cxt->return_code;
+            while(POS_SUCCESS == this->_parser_cq.dequeue(cqe)){ cqe->put_ref(); }
+            while(POS_SUCCESS == this->_worker_cq.dequeue(cqe)){ cqe->put_ref(); }
+            wqe->put_ref();
+        } else {
+            this->_wq.push(wqe);
+            while(!is_found){
+                cqes.clear();
+                while(POS_SUCCESS == this->_parser_cq.dequeue(cqe)){ cqes.push_back(cqe); }
+                while(POS_SUCCESS == this->_worker_cq.dequeue(cqe)){ cqes.push_back(cqe); }
+                for(POSAPIContext_QE_t *qe : cqes){
+                    if(qe->id == wqe_id){
+                        retval = qe->api_cxt->return_code;
+                        is_found = true;
+                    }
+                    qe->put_ref();
+                }
+            }
+        }
+
+        return retval;
+    }
+
+ private:
+    void __worker(){
+        uint64_t s_ns;
+        bool has_work;
+        POSAPIContext_QE_t *wqe;
+        POSWaitStrategy wait_strategy(&this->_event, pos_wait_policy_t());
+
+        while(!this->_stop_flag){
+            wait_strategy.begin_round();
+            has_work = false;
+            while(POS_SUCCESS == this->_wq.dequeue(wqe)){
+                has_work = true;
+
+                // mimic the execution of the API
+                s_ns = get_ns();
+                while(get_ns() - s_ns < this->_exec_ns){}
+                wqe->api_cxt->return_code = 0;
+
+                wqe->has_return = true;
+                wqe->get_ref();
+                this->_worker_cq.push(wqe);
+                if(this->_use_notify){ wqe->mark_completed(); }
+                wqe->put_ref();
+            }
+            wait_strategy.end_round(has_work);
+        }
+    }
+
+    bool _use_notify;
+    uint64_t _exec_ns;
+    volatile bool _stop_flag;
+    std::thread *_thread;
+    POSWaitEvent _event;
+    POSLockFreeQueue<POSAPIContext_QE_t*> _wq;
+    POSLockFreeQueue<POSAPIContext_QE_t*> _parser_cq;
+    POSLockFreeQueue<POSAPIContext_QE_t*> _worker_cq;
+};
+
+
+static void run(bool use_notify, uint64_t exec_ns){
+    uint64_t i, s_ns, s_cpu_ns, e_cpu_ns, s_wall_ns, e_wall_ns;
+    uint64_t params[4] = { 0 };
+    std::vector<uint64_t> latencies(kNbCalls);
+    std::vector<POSAPIParamDesp_t> param_desps({ { &params[0], sizeof(uint64_t) }, { &params[1], sizeof(uint64_t) } });
+    POSAPIContextPool pool;
+
+    {
+        MockPipeline pipeline(use_notify, exec_ns);
+
+        s_wall_ns = get_ns();
+        s_cpu_ns = get_ns(CLOCK_THREAD_CPUTIME_ID);
+        for(i=0; i<kNbCalls; i++){
+            s_ns = get_ns();
+            POS_ASSERT(pipeline.call(&pool, param_desps, i) == 0);
+            latencies[i] = get_ns() - s_ns;
+        }
+        e_cpu_ns = get_ns(CLOCK_THREAD_CPUTIME_ID);
+        e_wall_ns = get_ns();
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    printf(
+        "[%-6s] exec: %4lu us, p50: %8.2f us, p90: %8.2f us, p99: %8.2f us, p99.9: %8.2f us, rpc cpu: %6.2f%%\n",
+        use_notify ? "notify" : "poll", exec_ns / 1000,
+        latencies[kNbCalls * 50 / 100] / 1000.0, latencies[kNbCalls * 90 / 100] / 1000.0,
+        latencies[kNbCalls * 99 / 100] / 1000.0, latencies[kNbCalls * 999 / 1000] / 1000.0,
+        (double)(e_cpu_ns - s_cpu_ns) / (double)(e_wall_ns - s_wall_ns) * 100.0
+    );
+    fflush(stdout);
+}
+
+
+int main(){
+    for(uint64_t exec_ns : { 0ul, 20000ul, 200000ul }){
+        run(/* use_notify */ false, exec_ns);
+        run(/* use_notify */ true, exec_ns);
+    }
+
+    return 0;
+}
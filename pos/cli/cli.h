@@ -55,7 +55,8 @@ enum pos_cli_arg : int {
 
     /*!
      *  \brief  restore the state of an XPU process, and continue the execution
-     *  \param  dir     [Required] path to the checkpoint file
+     *  \param  dir         [Required] path to the checkpoint file
+     *  \param  subaction   [Optional] "verify" to only verify checksums of the checkpoint image
      */
     kPOS_CliAction_Restore,
 
@@ -135,6 +136,9 @@ static std::string pos_cli_action_name(pos_cli_arg action_type){
 typedef struct pos_cli_ckpt_metas {
     uint64_t pid;
     char ckpt_dir[oob_functions::cli_ckpt_predump::kCkptFilePathMaxLen];
+
+    // only verify the checkpoint image, without restoring it
+    bool is_verify_only;
 } pos_cli_ckpt_metas_t;
 
 typedef struct pos_cli_start_metas {
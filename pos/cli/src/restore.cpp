@@ -27,12 +27,47 @@
 
 #include "pos/include/common.h"
 #include "pos/include/utils/command_caller.h"
+#include "pos/include/checkpoint_image.h"
 #include "pos/include/oob.h"
 #include "pos/include/oob/restore.h"
 
 #include "pos/cli/cli.h"
 
 
+/*!
+ *  \brief  verify checksums of all records and chunks of the checkpoint image, without contacting posd
+ *  \param  clio    all cli infomations
+ *  \return POS_SUCCESS for intact image;
+ *          POS_FAILED_INCORRECT_OUTPUT for corrupted image;
+ *          others for failed to open the image
+ */
+static pos_retval_t __verify_image(pos_cli_options_t &clio){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointImage ckpt_image;
+    pos_ckpt_image_verify_stat_t stat;
+
+    if(unlikely(POS_SUCCESS != (retval = ckpt_image.open(clio.metas.ckpt.ckpt_dir)))){
+        POS_WARN("failed to open checkpoint image: dir(%s)", clio.metas.ckpt.ckpt_dir);
+        goto exit;
+    }
+
+    retval = ckpt_image.verify_all(&stat);
+    POS_LOG(
+        "verified checkpoint image: dir(%s), #records(%lu), #corrupted records(%lu), #chunks(%lu), "
+        "#corrupted chunks(%lu), size(%lu Bytes), duration(%lf ms), throughput(%lf GB/s)",
+        clio.metas.ckpt.ckpt_dir, stat.nb_records, stat.nb_corrupted_records, stat.nb_chunks,
+        stat.nb_corrupted_chunks, stat.nb_bytes, stat.duration_ms,
+        stat.duration_ms > 0 ? (double)stat.nb_bytes / stat.duration_ms / 1e6 : 0
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN("checkpoint image is corrupted: dir(%s)", clio.metas.ckpt.ckpt_dir);
+    }
+
+exit:
+    return retval;
+}
+
+
 pos_retval_t handle_restore(pos_cli_options_t &clio){
     pos_retval_t retval = POS_SUCCESS, criu_retval;
     oob_functions::cli_restore::oob_call_data_t call_data;
@@ -41,6 +76,7 @@ pos_retval_t handle_restore(pos_cli_options_t &clio){
     std::promise<pos_retval_t> criu_thread_promise;
     std::future<pos_retval_t> criu_thread_future = criu_thread_promise.get_future();
 
+    clio.metas.ckpt.is_verify_only = false;
     validate_and_cast_args(clio, {
         {
             /* meta_type */ kPOS_CliMeta_Dir,
@@ -64,9 +100,32 @@ pos_retval_t handle_restore(pos_cli_options_t &clio){
                 return retval;
             },
             /* is_required */ true
+        },
+        {
+            /* meta_type */ kPOS_CliMeta_SubAction,
+            /* meta_name */ "subaction",
+            /* meta_desp */ "'verify' to only verify the checkpoint image",
+            /* cast_func */ [](pos_cli_options_t &clio, std::string& meta_val) -> pos_retval_t {
+                pos_retval_t retval = POS_SUCCESS;
+
+                if(meta_val == "verify"){
+                    clio.metas.ckpt.is_verify_only = true;
+                } else {
+                    POS_WARN("unrecognized subaction to restore: %s", meta_val.c_str());
+                    retval = POS_FAILED_INVALID_INPUT;
+                }
+
+                return retval;
+            },
+            /* is_required */ false
         }
     });
 
+    if(clio.metas.ckpt.is_verify_only){
+        retval = __verify_image(clio);
+        goto exit;
+    }
+
     // send restore request to posd
     memcpy(
         call_data.ckpt_dir,
@@ -97,12 +97,17 @@ class POSClient_CUDA : public POSClient {
     /*!
      *  \brief  restore a single handle with specific type
      *  \note   this function is called by POSClient::restore_handles
-     *  \param  ckpt_file   path to the checkpoint file of the handle
+     *  \param  mapped      pointer to the metadata of the handle inside the mmapped checkpoint image
+     *  \param  size        size of the metadata
+     *  \param  state       pointer to the raw state section of the handle inside the mmapped checkpoint image
+     *  \param  state_size  size of the raw state section
      *  \param  rid         resource type index of the handle
      *  \param  hid         index of the handle
      *  \return POS_SUCCESS for successfully restore
      */
-    pos_retval_t __reallocate_single_handle(const std::string& ckpt_file, pos_resource_typeid_t rid, pos_u64id_t hid) override;
+    pos_retval_t __reallocate_single_handle(
+        void* mapped, uint64_t size, const void* state, uint64_t state_size, pos_resource_typeid_t rid, pos_u64id_t hid
+    ) override;
 
 
     /*!
@@ -111,6 +116,14 @@ class POSClient_CUDA : public POSClient {
      *  \return POS_SUCCESS for successfully reassigned
      */
     pos_retval_t __reassign_handle_parents(POSHandle* handle) override;
+
+
+    /*!
+     *  \brief  obtain the function to bind the CUDA context of the calling thread to restore threads
+     *  \note   this function is called by POSClient::restore_handles within the calling thread
+     *  \return the function
+     */
+    std::function<pos_retval_t()> __get_restore_thread_init() override;
     /* =============== checkpoint / restore ============== */
 
 
@@ -196,8 +196,8 @@ class POSHandleManager_CUDA_Context : public POSHandleManager<POSHandle_CUDA_Con
      *  \brief  restore the extra fields of handle with specific type
      *  \note   this function is called by reallocate_single_handle, and implemented by
      *          specific handle type
-     *  \param  mapped          mmap handle of the file
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
+     *  \param  mapped          record of the handle inside the mmapped checkpoint image
+     *  \param  ckpt_file_size  size of the record
      *  \param  handle          pointer to the restored handle
      *  \return POS_SUCCESS for successfully restore
      */
@@ -27,6 +27,7 @@
 
 #include "pos/include/common.h"
 #include "pos/include/handle.h"
+#include "pos/include/utils/resolution_memo.h"
 #include "pos/cuda_impl/handle.h"
 #include "pos/cuda_impl/utils/fatbin.h"
 
@@ -35,6 +36,24 @@
 class POSHandleManager_CUDA_Function;
 
 
+/*!
+ *  \brief  memory handle resolved from a pointer argument of a kernel launch
+ */
+typedef struct pos_cuda_arg_resolution {
+    // the resolved memory handle
+    POSHandle *handle;
+
+    // index of the parameter that carries the pointer
+    uint32_t param_index;
+
+    // direction of the parameter
+    pos_edge_direction_t dir;
+
+    // offset of the pointer from the base address of the handle
+    uint64_t offset;
+} pos_cuda_arg_resolution_t;
+
+
 /*!
  *  \brief  handle for cuda function
  */
@@ -120,6 +139,14 @@ class POSHandle_CUDA_Function final : public POSHandle_CUDA {
 
     // cbank parameter size (p.s., what is this?)
     uint64_t cbank_param_size;
+
+    /*!
+     *  \brief  memo of memory handles resolved from pointer arguments of launches, keyed by values of all
+     *          pointer arguments (input, inout, output and confirmed suspicious ones), and valid under
+     *          the address epoch of the memory handle manager
+     *  \note   runtime-only, not checkpointed
+     */
+    POSResolutionMemo<pos_cuda_arg_resolution_t> arg_memo;
     /* ======================== handle specific fields ======================= */
 
 
@@ -234,13 +261,20 @@ class POSHandleManager_CUDA_Function : public POSHandleManager<POSHandle_CUDA_Fu
     pos_retval_t try_restore_from_pool(POSHandle_CUDA_Function* handle) override;
 
 
+    /*!
+     *  \brief  obtain statistics of argument memo summed across all functions
+     *  \return the summed statistics
+     */
+    pos_resolution_memo_stat_t get_arg_memo_stat();
+
+
  private:
     /*!
      *  \brief  restore the extra fields of handle with specific type
      *  \note   this function is called by reallocate_single_handle, and implemented by
      *          specific handle type
-     *  \param  mapped          mmap handle of the file
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
+     *  \param  mapped          record of the handle inside the mmapped checkpoint image
+     *  \param  ckpt_file_size  size of the record
      *  \param  handle          pointer to the restored handle
      *  \return POS_SUCCESS for successfully restore
      */
@@ -29,6 +29,7 @@
 
 #include "pos/include/common.h"
 #include "pos/include/handle.h"
+#include "pos/include/checkpoint_arena.h"
 #include "pos/cuda_impl/handle.h"
 #include "pos/cuda_impl/handle/device.h"
 
@@ -86,10 +87,11 @@ class POSHandle_CUDA_Memory final : public POSHandle_CUDA {
  protected:
     /*!
      *  \brief  allocator of the host-side checkpoint memory
+     *  \note   the memory is drawn from the process-wide checkpoint arena, which is pinned
+     *          by cudaHostRegister (see POSWorkspace_CUDA::__init)
      *  \param  state_size  size of the area to store checkpoint
      */
     static void* __checkpoint_allocator(uint64_t state_size) {
-        cudaError_t cuda_rt_retval;
         void *ptr;
 
         if(unlikely(state_size == 0)){
@@ -97,9 +99,9 @@ class POSHandle_CUDA_Memory final : public POSHandle_CUDA {
             return nullptr;
         }
 
-        cuda_rt_retval = cudaMallocHost(&ptr, state_size);
-        if(unlikely(cuda_rt_retval != cudaSuccess)){
-            POS_WARN_DETAIL("failed cudaMallocHost, error: %d", cuda_rt_retval);
+        ptr = POSCheckpointArena::get_instance()->alloc(state_size);
+        if(unlikely(ptr == nullptr)){
+            POS_WARN_DETAIL("failed to allocate from checkpoint arena: state_size(%lu)", state_size);
             return nullptr;
         }
 
@@ -112,12 +114,8 @@ class POSHandle_CUDA_Memory final : public POSHandle_CUDA {
      *  \param  data    pointer of the buffer to be deallocated
      */
     static void __checkpoint_deallocator(void* data){
-        cudaError_t cuda_rt_retval;
         if(likely(data != nullptr)){
-            cuda_rt_retval = cudaFreeHost(data);
-            if(unlikely(cuda_rt_retval != cudaSuccess)){
-                POS_WARN_DETAIL("failed cudaFreeHost, error: %d", cuda_rt_retval);
-            }
+            POSCheckpointArena::get_instance()->free(data);
         }
     }
 
@@ -194,6 +192,19 @@ class POSHandle_CUDA_Memory final : public POSHandle_CUDA {
     ) override;
 
 
+    /*!
+     *  \brief  commit the state of the resource behind this handle from origin buffer through the
+     *          checkpoint delta chain, only chunks modified since the previous commit are copied,
+     *          unless a new base is due
+     *  \param  version_id  version of this checkpoint
+     *  \param  stream_id   index of the stream to do this checkpoint
+     *  \param  is_sync     whether the commit process should be sync
+     *  \param  ckpt_dir    directory to store the checkpoint
+     *  \return POS_SUCCESS for successfully checkpointed
+     */
+    pos_retval_t __commit_incremental(uint64_t version_id, uint64_t stream_id, bool is_sync, std::string ckpt_dir);
+
+
     /*!
      *  \brief  generate protobuf message for this handle
      *  \param  binary      pointer to the generated binary
@@ -221,11 +232,21 @@ class POSHandle_CUDA_Memory final : public POSHandle_CUDA {
 
     /*!
      *  \brief  reload state of this handle back to the device
-     *  \param  mapped          mmap area of the checkpoint file of this handle
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
-     *  \param  stream_id       stream for reloading the state
+     *  \param  state       raw state section of this handle inside the mmapped checkpoint image
+     *  \param  state_size  size of the raw state section
+     *  \param  stream_id   stream for reloading the state
+     */
+    pos_retval_t __reload_state(const void* state, uint64_t state_size, uint64_t stream_id) override;
+
+
+    /*!
+     *  \brief  reload a range of state of this handle back to the device asynchronously
+     *  \param  state       the state of the range
+     *  \param  offset      offset of the range from the start of the state
+     *  \param  size        size of the range
+     *  \param  stream_id   stream for reloading the state
      */
-    pos_retval_t __reload_state(void* mapped, uint64_t ckpt_file_size, uint64_t stream_id) override;
+    pos_retval_t __reload_state_range(const void* state, uint64_t offset, uint64_t size, uint64_t stream_id) override;
     /* ======================== restore handle & state ======================= */
 };
 
@@ -323,8 +344,8 @@ class POSHandleManager_CUDA_Memory : public POSHandleManager<POSHandle_CUDA_Memo
      *  \brief  restore the extra fields of handle with specific type
      *  \note   this function is called by reallocate_single_handle, and implemented by
      *          specific handle type
-     *  \param  mapped          mmap handle of the file
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
+     *  \param  mapped          record of the handle inside the mmapped checkpoint image
+     *  \param  ckpt_file_size  size of the record
      *  \param  handle          pointer to the restored handle
      *  \return POS_SUCCESS for successfully restore
      */
@@ -160,11 +160,11 @@ class POSHandle_CUDA_Module final : public POSHandle_CUDA {
 
     /*!
      *  \brief  reload state of this handle back to the device
-     *  \param  mapped          mmap area of the checkpoint file of this handle
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
-     *  \param  stream_id       stream for reloading the state
+     *  \param  state       raw state section of this handle inside the mmapped checkpoint image
+     *  \param  state_size  size of the raw state section
+     *  \param  stream_id   stream for reloading the state
      */
-    pos_retval_t __reload_state(void* mapped, uint64_t ckpt_file_size, uint64_t stream_id) override;
+    pos_retval_t __reload_state(const void* state, uint64_t state_size, uint64_t stream_id) override;
     /* ======================== restore handle & state ======================= */
 };
 
@@ -240,8 +240,8 @@ class POSHandleManager_CUDA_Module : public POSHandleManager<POSHandle_CUDA_Modu
      *  \brief  restore the extra fields of handle with specific type
      *  \note   this function is called by reallocate_single_handle, and implemented by
      *          specific handle type
-     *  \param  mapped          mmap handle of the file
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
+     *  \param  mapped          record of the handle inside the mmapped checkpoint image
+     *  \param  ckpt_file_size  size of the record
      *  \param  handle          pointer to the restored handle
      *  \return POS_SUCCESS for successfully restore
      */
@@ -231,6 +231,17 @@ exit:
 
 
 void POSClient_CUDA::deinit_handle_managers(){
+    POSHandleManager_CUDA_Function *hm_function;
+    pos_resolution_memo_stat_t memo_stat;
+
+    hm_function = pos_get_client_typed_hm(this, kPOS_ResourceTypeId_CUDA_Function, POSHandleManager_CUDA_Function);
+    POS_CHECK_POINTER(hm_function);
+    memo_stat = hm_function->get_arg_memo_stat();
+    POS_LOG_C(
+        "kernel argument memo: #lookups(%lu), hit rate(%.2f%%), #stale(%lu), #evictions(%lu)",
+        memo_stat.nb_lookups, memo_stat.get_hit_rate() * 100.0, memo_stat.nb_stale, memo_stat.nb_evictions
+    );
+
     this->__dump_hm_cuda_functions();
 }
 
@@ -275,6 +286,10 @@ pos_retval_t POSClient_CUDA::persist_handles(bool with_state){
     for(i=0; i<wqes.size(); i++){
         POS_CHECK_POINTER(wqe = wqes[i]);
         wqe->persist</* with_params */ false>(apicxt_dir);
+        wqe->put_ref();
+    }
+    if(unlikely(POS_SUCCESS != POSCheckpointImageWriter::seal(apicxt_dir))){
+        POS_WARN_C("failed to seal trace image of API contexts");
     }
 
     // dumping resources
@@ -292,6 +307,10 @@ pos_retval_t POSClient_CUDA::persist_handles(bool with_state){
             }
         }
     }
+    POSPersistExecutor::get_instance()->flush(resource_dir).wait();
+    if(unlikely(POS_SUCCESS != POSCheckpointImageWriter::seal(resource_dir))){
+        POS_WARN_C("failed to seal trace image of resources");
+    }
 
     POS_BACK_LINE;
     POS_LOG_C("dumping trace resource result to %s [done]", trace_dir.c_str());
@@ -301,11 +320,13 @@ exit:
 }
 
 
-pos_retval_t POSClient_CUDA::__reallocate_single_handle(const std::string& ckpt_file, pos_resource_typeid_t rid, pos_u64id_t hid){
+pos_retval_t POSClient_CUDA::__reallocate_single_handle(
+    void* mapped, uint64_t size, const void* state, uint64_t state_size, pos_resource_typeid_t rid, pos_u64id_t hid
+){
     pos_retval_t retval = POS_SUCCESS;
     POSHandle *restored_handle = nullptr;
 
-    POS_ASSERT(ckpt_file.size() > 0);
+    POS_CHECK_POINTER(mapped);
     POS_ASSERT(
         std::find(
             this->_ws->resource_type_idx.begin(),
@@ -315,11 +336,11 @@ pos_retval_t POSClient_CUDA::__reallocate_single_handle(const std::string& ckpt_
     );
     POS_CHECK_POINTER(this->handle_managers[rid]);
 
-    retval = this->handle_managers[rid]->reallocate_single_handle(ckpt_file, hid, &restored_handle);
+    retval = this->handle_managers[rid]->reallocate_single_handle(mapped, size, state, state_size, hid, &restored_handle);
     if(unlikely(retval != POS_SUCCESS)){
         POS_WARN_C(
-            "failed to restore single handle from file: rid(%u), hid(%lu), ckpt_file(%s), retval(%u)",
-            rid, hid, ckpt_file.c_str(), retval
+            "failed to restore single handle from checkpoint image: rid(%u), hid(%lu), retval(%u)",
+            rid, hid, retval
         );
         goto exit;
     }
@@ -360,6 +381,22 @@ exit:
 }
 
 
+std::function<pos_retval_t()> POSClient_CUDA::__get_restore_thread_init(){
+    CUcontext cu_context = nullptr;
+    CUresult dr_retval;
+
+    dr_retval = cuCtxGetCurrent(&cu_context);
+    if(unlikely(dr_retval != CUDA_SUCCESS || cu_context == nullptr)){
+        POS_WARN_C("no CUDA context is bound to the restoring thread: dr_retval(%d)", dr_retval);
+        return nullptr;
+    }
+
+    return [cu_context]() -> pos_retval_t {
+        return cuCtxSetCurrent(cu_context) == CUDA_SUCCESS ? POS_SUCCESS : POS_FAILED_DRIVER;
+    };
+}
+
+
 std::set<pos_resource_typeid_t> POSClient_CUDA::__get_resource_idx(){
     return  std::set<pos_resource_typeid_t>({
         kPOS_ResourceTypeId_CUDA_Context,
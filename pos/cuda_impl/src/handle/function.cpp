@@ -195,6 +195,20 @@ pos_retval_t POSHandleManager_CUDA_Function::try_restore_from_pool(POSHandle_CUD
 }
 
 
+pos_resolution_memo_stat_t POSHandleManager_CUDA_Function::get_arg_memo_stat(){
+    uint64_t i;
+    POSHandle_CUDA_Function *function_handle;
+    pos_resolution_memo_stat_t stat;
+
+    for(i=0; i<this->get_nb_handles(); i++){
+        POS_CHECK_POINTER(function_handle = this->get_handle_by_id(i));
+        stat += function_handle->arg_memo.get_stat();
+    }
+
+    return stat;
+}
+
+
 pos_retval_t POSHandleManager_CUDA_Function::__reallocate_single_handle(void* mapped, uint64_t ckpt_file_size, POSHandle_CUDA_Function** handle){
     pos_retval_t retval = POS_SUCCESS;
     pos_protobuf::Bin_POSHandle_CUDA_Function cuda_function_binary;
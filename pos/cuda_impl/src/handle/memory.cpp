@@ -129,6 +129,16 @@ pos_retval_t POSHandle_CUDA_Memory::__init_ckpt_bag(){
         this->__checkpoint_dev_deallocator
     );
     POS_CHECK_POINTER(this->ckpt_bag);
+
+#if POS_CONF_EVAL_CkptEnableIncremental == 1 && POS_CONF_EVAL_CkptOptLevel == 1
+    if(this->state_size > 0){
+        this->ckpt_delta_chain = new POSCheckpointDeltaChain(
+            this->state_size, this->__checkpoint_allocator, this->__checkpoint_deallocator
+        );
+        POS_CHECK_POINTER(this->ckpt_delta_chain);
+    }
+#endif // POS_CONF_EVAL_CkptEnableIncremental
+
     return POS_SUCCESS;
 }
 
@@ -192,6 +202,12 @@ pos_retval_t POSHandle_CUDA_Memory::__commit(
     
     cudaSetDevice(0);
 
+    // commit from origin buffer through the delta chain, so that only modified chunks are copied
+    if(this->ckpt_delta_chain != nullptr && from_cache == false){
+        retval = this->__commit_incremental(version_id, stream_id, is_sync, ckpt_dir);
+        goto exit;
+    }
+
     // apply new host-side checkpoint slot for device-side state
     if(unlikely(POS_SUCCESS != (
         this->ckpt_bag->template apply_checkpoint_slot<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Device>(
@@ -273,6 +289,66 @@ exit:
 }
 
 
+pos_retval_t POSHandle_CUDA_Memory::__commit_incremental(
+    uint64_t version_id, uint64_t stream_id, bool is_sync, std::string ckpt_dir
+){
+    pos_retval_t retval = POS_SUCCESS, prev_retval;
+    cudaError_t cuda_rt_retval;
+
+    POS_CHECK_POINTER(this->ckpt_delta_chain);
+
+    // the slots of the chain might be released by this commit, previous persisting must be finished
+    if(this->_persist_future.valid()){
+        if(unlikely(POS_SUCCESS != (prev_retval = this->sync_persist()))){
+            POS_WARN_C("pervious persisting is failed: retval(%u)", prev_retval);
+        }
+    }
+
+    retval = this->ckpt_delta_chain->commit(
+        /* version */ version_id,
+        /* copy */ [&](void* dst, uint64_t offset, uint64_t size) -> pos_retval_t {
+            cuda_rt_retval = cudaMemcpyAsync(
+                /* dst */ dst,
+                /* src */ reinterpret_cast<uint8_t*>(this->server_addr) + offset,
+                /* size */ size,
+                /* kind */ cudaMemcpyDeviceToHost,
+                /* stream */ (cudaStream_t)(stream_id)
+            );
+            if(unlikely(cuda_rt_retval != cudaSuccess)){
+                POS_WARN_C(
+                    "failed to checkpoint memory handle incrementally: server_addr(%p), offset(%lu), size(%lu), retval(%d)",
+                    this->server_addr, offset, size, cuda_rt_retval
+                );
+                return POS_FAILED;
+            }
+            return POS_SUCCESS;
+        }
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to commit to the checkpoint delta chain: server_addr(%p), retval(%u)", this->server_addr, retval);
+        goto exit;
+    }
+
+    if(is_sync){
+        cuda_rt_retval = cudaStreamSynchronize((cudaStream_t)(stream_id));
+        if(unlikely(cuda_rt_retval != cudaSuccess)){
+            POS_WARN_C(
+                "failed to synchronize after commiting memory handle: server_addr(%p), retval(%d)",
+                this->server_addr, cuda_rt_retval
+            );
+            retval = POS_FAILED;
+            goto exit;
+        }
+    }
+
+    // persist the whole chain, which is led by the base
+    retval = this->__persist(this->ckpt_delta_chain->get_links()[0].slot, ckpt_dir, stream_id);
+
+exit:
+    return retval;
+}
+
+
 pos_retval_t POSHandle_CUDA_Memory::__generate_protobuf_binary(google::protobuf::Message** binary, google::protobuf::Message** base_binary){
     pos_retval_t retval = POS_SUCCESS;
     pos_protobuf::Bin_POSHandle_CUDA_Memory *cuda_memory_binary;
@@ -395,23 +471,25 @@ exit:
 
 
 
-pos_retval_t POSHandle_CUDA_Memory::__reload_state(void* mapped, uint64_t ckpt_file_size, uint64_t stream_id){
+pos_retval_t POSHandle_CUDA_Memory::__reload_state(const void* state, uint64_t state_size, uint64_t stream_id){
     pos_retval_t retval = POS_SUCCESS;
-    pos_protobuf::Bin_POSHandle_CUDA_Memory memory_binary;
     cudaError_t cuda_rt_retval;
 
-    POS_CHECK_POINTER(mapped);
+    POS_CHECK_POINTER(state);
 
-    if(!memory_binary.ParseFromArray(mapped, ckpt_file_size)){
-        POS_WARN_C("failed to restore handle state, failed to deserialize from mmap area");
+    if(unlikely(state_size < this->state_size)){
+        POS_WARN_C(
+            "failed to restore handle state, truncated state section: state_size(%lu), expected(%lu)",
+            state_size, this->state_size
+        );
         retval = POS_FAILED;
         goto exit;
     }
-    POS_CHECK_POINTER(memory_binary.mutable_base());
 
+    // copy straight from the mmapped checkpoint image
     cuda_rt_retval = cudaMemcpyAsync(
         /* dst */ this->server_addr,
-        /* src */ reinterpret_cast<const void*>(memory_binary.mutable_base()->state().c_str()),
+        /* src */ state,
         /* count */ this->state_size,
         /* kind */ cudaMemcpyHostToDevice,
         /* stream */ (cudaStream_t)(stream_id)
@@ -430,8 +508,32 @@ pos_retval_t POSHandle_CUDA_Memory::__reload_state(void* mapped, uint64_t ckpt_f
     }
 
 exit:
-    // this should be the end of using this mmap area, so we release it here
-    munmap(mapped, ckpt_file_size);
+    return retval;
+}
+
+
+pos_retval_t POSHandle_CUDA_Memory::__reload_state_range(const void* state, uint64_t offset, uint64_t size, uint64_t stream_id){
+    pos_retval_t retval = POS_SUCCESS;
+    cudaError_t cuda_rt_retval;
+
+    POS_CHECK_POINTER(state);
+    POS_ASSERT(offset + size <= this->state_size);
+
+    cuda_rt_retval = cudaMemcpyAsync(
+        /* dst */ reinterpret_cast<uint8_t*>(this->server_addr) + offset,
+        /* src */ state,
+        /* count */ size,
+        /* kind */ cudaMemcpyHostToDevice,
+        /* stream */ (cudaStream_t)(stream_id)
+    );
+    if(unlikely(cuda_rt_retval != cudaSuccess)){
+        POS_WARN_DETAIL(
+            "failed to reload state range of CUDA memory: server_addr(%p), offset(%lu), size(%lu), retval(%d)",
+            this->server_addr, offset, size, cuda_rt_retval
+        );
+        retval = POS_FAILED;
+    }
+
     return retval;
 }
 
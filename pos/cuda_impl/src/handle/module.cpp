@@ -150,24 +150,17 @@ exit:
 }
 
 
-pos_retval_t POSHandle_CUDA_Module::__reload_state(void* mapped, uint64_t ckpt_file_size, uint64_t stream_id){
+pos_retval_t POSHandle_CUDA_Module::__reload_state(const void* state, uint64_t state_size, uint64_t stream_id){
     pos_retval_t retval = POS_SUCCESS;
     CUresult cuda_dv_retval;
-    pos_protobuf::Bin_POSHandle_CUDA_Module module_binary;
     CUmodule module = NULL;
 
-    POS_CHECK_POINTER(mapped);
-
-    if(!module_binary.ParseFromArray(mapped, ckpt_file_size)){
-        POS_WARN_C("failed to restore handle state, failed to deserialize from mmap area");
-        retval = POS_FAILED;
-        goto exit;
-    }
-    POS_CHECK_POINTER(module_binary.mutable_base());
+    POS_CHECK_POINTER(state);
+    POS_ASSERT(state_size > 0);
 
     cuda_dv_retval = cuModuleLoadData(
         /* module */ &module,
-        /* image */  reinterpret_cast<const void*>(module_binary.mutable_base()->state().c_str())
+        /* image */  state
     );
     if(unlikely(CUDA_SUCCESS != cuda_dv_retval)){
         POS_WARN_C_DETAIL("failed to restore CUDA module, cuModuleLoadData failed: %d", cuda_dv_retval);
@@ -180,8 +173,6 @@ pos_retval_t POSHandle_CUDA_Module::__reload_state(void* mapped, uint64_t ckpt_f
     this->mark_state_status(kPOS_HandleStatus_StateReady);
 
 exit:
-    // this should be the end of using this mmap area, so we release it here
-    munmap(mapped, ckpt_file_size);
     return retval;
 }
 
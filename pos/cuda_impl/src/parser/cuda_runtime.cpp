@@ -186,6 +186,11 @@ namespace cuda_launch_kernel {
         uint8_t *struct_base_ptr;
         uint64_t arg_size, struct_offset;
 
+        uint64_t memo_epoch, memo_nb_pointers;
+        const std::vector<pos_cuda_arg_resolution_t> *memo_views;
+        std::vector<pos_cuda_arg_resolution_t> *memo_resolved = nullptr;
+        static thread_local std::vector<uint64_t> memo_key;
+
         POSHandleManager_CUDA_Function *hm_function;
         POSHandleManager_CUDA_Stream *hm_stream;
         POSHandleManager_CUDA_Memory *hm_memory;
@@ -253,6 +258,52 @@ namespace cuda_launch_kernel {
             __unit_print_inout(function_handle->confirmed_suspicious_params, "inout");
         };
 
+        /*!
+         *  \brief  record a memory handle resolved from a pointer argument to the wqe, and to the memo of
+         *          the function if the resolution is being memoized
+         *  \param  dir             direction of the parameter
+         *  \param  memory_handle   the resolved memory handle
+         *  \param  param_index     index of the parameter
+         *  \param  offset          offset of the pointer from the base address of the handle
+         */
+        auto __record_memory_handle = [&](
+            pos_edge_direction_t dir, POSHandle_CUDA_Memory *memory_handle, uint32_t param_index, uint64_t offset
+        ){
+            if(dir == kPOS_Edge_Direction_In){
+                wqe->record_handle<kPOS_Edge_Direction_In>({ memory_handle, param_index, offset });
+            } else if(dir == kPOS_Edge_Direction_Out){
+                wqe->record_handle<kPOS_Edge_Direction_Out>({ memory_handle, param_index, offset });
+                hm_memory->record_modified_handle(memory_handle);
+            } else {
+                wqe->record_handle<kPOS_Edge_Direction_InOut>({ memory_handle, param_index, offset });
+                hm_memory->record_modified_handle(memory_handle);
+            }
+            if(memo_resolved != nullptr){
+                memo_resolved->push_back({ memory_handle, param_index, dir, offset });
+            }
+        };
+
+        /*!
+         *  \brief  check whether memoized views resolved under an older address epoch still hold
+         *  \note   live memory handles never overlap, so a memoized pointer keeps resolving to the same
+         *          handle as long as the handle is alive, and only pointers that failed to resolve might
+         *          resolve differently after new allocations
+         *  \param  views   the memoized views
+         *  \return whether the views still hold
+         */
+        auto __revalidate_memo_views = [&](const std::vector<pos_cuda_arg_resolution_t>& views) -> bool {
+            if(views.size() != memo_nb_pointers){ return false; }
+            for(const pos_cuda_arg_resolution_t &view : views){
+                if(unlikely(
+                    view.handle->status == kPOS_HandleStatus_Delete_Pending
+                    || view.handle->status == kPOS_HandleStatus_Deleted
+                )){
+                    return false;
+                }
+            }
+            return true;
+        };
+
         POS_CHECK_POINTER(wqe);
         POS_CHECK_POINTER(ws);
 
@@ -325,7 +376,56 @@ namespace cuda_launch_kernel {
 
         // [Cricket Adapt] skip the metadata used by cricket
         args += (sizeof(size_t) + sizeof(uint16_t) * function_handle->nb_params);
-        
+
+        /*!
+         *  \note   training loops launch the same kernels with the same buffers over and over, so we
+         *          memoize the resolved memory handles by values of all pointer arguments, which stay
+         *          valid until any memory handle is allocated or freed (i.e., the address epoch changes),
+         *          and are revalidated after that; the launch that verifies suspicious parameters isn't
+         *          memoized, as the confirmed suspicious parameters (part of the key) are still being
+         *          collected
+         */
+        if(likely(function_handle->has_verified_params == true)){
+            memo_key.clear();
+            memo_nb_pointers = 0;
+            for(i=0; i<function_handle->input_pointer_params.size(); i++){
+                param_index = function_handle->input_pointer_params[i];
+                memo_key.push_back(*((uint64_t*)(args + function_handle->param_offsets[param_index])));
+            }
+            for(i=0; i<function_handle->inout_pointer_params.size(); i++){
+                param_index = function_handle->inout_pointer_params[i];
+                memo_key.push_back(*((uint64_t*)(args + function_handle->param_offsets[param_index])));
+            }
+            for(i=0; i<function_handle->output_pointer_params.size(); i++){
+                param_index = function_handle->output_pointer_params[i];
+                memo_key.push_back(*((uint64_t*)(args + function_handle->param_offsets[param_index])));
+            }
+            for(i=0; i<function_handle->confirmed_suspicious_params.size(); i++){
+                param_index = function_handle->confirmed_suspicious_params[i].first;
+                struct_offset = function_handle->confirmed_suspicious_params[i].second;
+                memo_key.push_back(*((uint64_t*)(args + function_handle->param_offsets[param_index] + struct_offset)));
+            }
+
+            for(i=0; i<memo_key.size(); i++){ memo_nb_pointers += (memo_key[i] != 0); }
+
+            memo_epoch = hm_memory->get_address_epoch();
+            memo_views = function_handle->arg_memo.get(
+                memo_key.data(), memo_key.size(), memo_epoch, __revalidate_memo_views
+            );
+            if(likely(memo_views != nullptr)){
+                for(const pos_cuda_arg_resolution_t &view : *memo_views){
+                    __record_memory_handle(
+                        view.dir, (POSHandle_CUDA_Memory*)(view.handle), view.param_index, view.offset
+                    );
+                }
+                goto args_resolved;
+            }
+
+            // miss, memoize the resolution below
+            memo_resolved = function_handle->arg_memo.put(memo_key.data(), memo_key.size(), memo_epoch);
+            POS_CHECK_POINTER(memo_resolved);
+        }
+
         /*!
          *  \note   record all input memory areas
          */
@@ -358,11 +458,12 @@ namespace cuda_launch_kernel {
                 continue;
             }
 
-            wqe->record_handle<kPOS_Edge_Direction_In>({
-                /* handle */ memory_handle,
+            __record_memory_handle(
+                /* dir */ kPOS_Edge_Direction_In,
+                /* memory_handle */ memory_handle,
                 /* param_index */ param_index,
                 /* offset */ (uint64_t)(arg_value) - (uint64_t)(memory_handle->client_addr)
-            });
+            );
         }
         
         /*!
@@ -397,13 +498,12 @@ namespace cuda_launch_kernel {
                 continue;
             }
 
-            wqe->record_handle<kPOS_Edge_Direction_InOut>({
-                /* handle */ memory_handle,
+            __record_memory_handle(
+                /* dir */ kPOS_Edge_Direction_InOut,
+                /* memory_handle */ memory_handle,
                 /* param_index */ param_index,
                 /* offset */ (uint64_t)(arg_value) - (uint64_t)(memory_handle->client_addr)
-            });
-
-            hm_memory->record_modified_handle(memory_handle);
+            );
         }
 
         /*!
@@ -438,13 +538,12 @@ namespace cuda_launch_kernel {
                 continue;
             }
 
-            wqe->record_handle<kPOS_Edge_Direction_Out>({
-                /* handle */ memory_handle,
+            __record_memory_handle(
+                /* dir */ kPOS_Edge_Direction_Out,
+                /* memory_handle */ memory_handle,
                 /* param_index */ param_index,
                 /* offset */ (uint64_t)(arg_value) - (uint64_t)(memory_handle->client_addr)
-            });
-
-            hm_memory->record_modified_handle(memory_handle);
+            );
         }
 
         /*!
@@ -539,16 +638,17 @@ namespace cuda_launch_kernel {
                     continue;
                 }
 
-                wqe->record_handle<kPOS_Edge_Direction_InOut>({
-                    /* handle */ memory_handle,
+                __record_memory_handle(
+                    /* dir */ kPOS_Edge_Direction_InOut,
+                    /* memory_handle */ memory_handle,
                     /* param_index */ param_index,
                     /* offset */ (uint64_t)(arg_value) - (uint64_t)(memory_handle->client_addr)
-                });
-
-                hm_memory->record_modified_handle(memory_handle);
+                );
             }
         }
 
+    args_resolved:
+
     #if POS_PRINT_DEBUG
         typedef struct __dim3 { uint32_t x; uint32_t y; uint32_t z; } __dim3_t;
         POS_DEBUG(
@@ -624,7 +724,8 @@ namespace cuda_memcpy_h2d {
             wqe->record_handle<kPOS_Edge_Direction_InOut>({
                 /* handle */ memory_handle,
                 /* param_index */ 0,
-                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(memory_handle->client_addr)
+                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(memory_handle->client_addr),
+                /* size */ pos_api_param_size(wqe, 1)
             });
             hm_memory->record_modified_handle(memory_handle);
         }
@@ -752,7 +853,8 @@ namespace cuda_memcpy_d2d {
             wqe->record_handle<kPOS_Edge_Direction_Out>({
                 /* handle */ dst_memory_handle,
                 /* param_index */ 0,
-                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(dst_memory_handle->client_addr)
+                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(dst_memory_handle->client_addr),
+                /* size */ pos_api_param_value(wqe, 2, uint64_t)
             });
             hm_memory->record_modified_handle(dst_memory_handle);
         }
@@ -843,7 +945,8 @@ namespace cuda_memcpy_h2d_async {
             wqe->record_handle<kPOS_Edge_Direction_InOut>({
                 /* handle */ memory_handle,
                 /* param_index */ 0,
-                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(memory_handle->client_addr)
+                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(memory_handle->client_addr),
+                /* size */ pos_api_param_size(wqe, 1)
             });
             hm_memory->record_modified_handle(memory_handle);
         }
@@ -1018,7 +1121,8 @@ namespace cuda_memcpy_d2d_async {
             wqe->record_handle<kPOS_Edge_Direction_Out>({
                 /* handle */ dst_memory_handle,
                 /* param_index */ 0,
-                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(dst_memory_handle->client_addr)
+                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(dst_memory_handle->client_addr),
+                /* size */ pos_api_param_value(wqe, 2, uint64_t)
             });
             hm_memory->record_modified_handle(dst_memory_handle);
         }
@@ -1125,7 +1229,8 @@ namespace cuda_memset_async {
             wqe->record_handle<kPOS_Edge_Direction_Out>({
                 /* handle */ memory_handle,
                 /* param_index */ 0,
-                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(memory_handle->client_addr)
+                /* offset */ pos_api_param_value(wqe, 0, uint64_t) - (uint64_t)(memory_handle->client_addr),
+                /* size */ pos_api_param_value(wqe, 2, uint64_t)
             });
             hm_memory->record_modified_handle(memory_handle);
         }
@@ -20,6 +20,27 @@
 POSWorkspace_CUDA::POSWorkspace_CUDA() : POSWorkspace(){}
 
 
+/*!
+ *  \brief  pin / unpin function of the checkpoint arena
+ */
+static pos_retval_t __ckpt_arena_pin(void* ptr, uint64_t size){
+    cudaError_t cuda_rt_retval = cudaHostRegister(ptr, size, cudaHostRegisterPortable);
+    if(unlikely(cuda_rt_retval != cudaSuccess)){
+        POS_WARN_DETAIL("failed cudaHostRegister: ptr(%p), size(%lu), error(%d)", ptr, size, cuda_rt_retval);
+        return POS_FAILED_DRIVER;
+    }
+    return POS_SUCCESS;
+}
+static pos_retval_t __ckpt_arena_unpin(void* ptr){
+    cudaError_t cuda_rt_retval = cudaHostUnregister(ptr);
+    if(unlikely(cuda_rt_retval != cudaSuccess)){
+        POS_WARN_DETAIL("failed cudaHostUnregister: ptr(%p), error(%d)", ptr, cuda_rt_retval);
+        return POS_FAILED_DRIVER;
+    }
+    return POS_SUCCESS;
+}
+
+
 pos_retval_t POSWorkspace_CUDA::__init(){
     pos_retval_t retval = POS_SUCCESS;
     CUresult dr_retval;
@@ -112,6 +133,21 @@ pos_retval_t POSWorkspace_CUDA::__init(){
         goto exit;
     }
 
+#if POS_CONF_EVAL_CkptOptLevel > 0 || POS_CONF_EVAL_MigrOptLevel > 0
+    // host-side checkpoint memory is drawn from pinned arena, to reach full D2H bandwidth
+    retval = POSCheckpointArena::get_instance()->init(
+        /* mode */ kPOS_CkptArenaMode_Pinned,
+        /* chunk_size */ POSCheckpointArena::kDefaultChunkSize,
+        /* nb_prefill_chunks */ 1,
+        /* pin_func */ __ckpt_arena_pin,
+        /* unpin_func */ __ckpt_arena_unpin
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to initialize pinned checkpoint arena");
+        goto exit;
+    }
+#endif
+
 exit:
     if(unlikely(retval != POS_SUCCESS)){
         for(i=0; i<this->_cu_contexts.size(); i++){
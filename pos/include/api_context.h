@@ -21,6 +21,9 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <set>
 
 #include <string.h>
 #include <stdint.h>
@@ -31,6 +34,12 @@
 #include "pos/include/handle.h"
 #include "pos/include/client.h"
 #include "pos/include/utils/timer.h"
+#include "pos/include/utils/slab_pool.h"
+#include "pos/include/utils/wait_strategy.h"
+
+
+// forward declaration
+class POSAPIContextLogWriter;
 
 
 /*!
@@ -105,10 +114,95 @@ class POSApiManager {
      */
     virtual int cast_pos_retval(pos_retval_t pos_retval, uint8_t library_id){ return -1; };
 
+    /*!
+     *  \brief  remap registered API ids to dense indices, for O(1) dispatch on the hot path
+     *  \note   should be called once all metadata are registered, i.e., after init
+     */
+    inline void build_dense_index(){
+        uint64_t max_api_id;
+        typename std::map<uint64_t, POSAPIMeta_t>::iterator meta_iter;
+
+        this->_api_indices.clear();
+        this->_dense_api_metas.clear();
+        if(unlikely(this->api_metas.size() == 0)){
+            POS_WARN_C("no API metadata registered, dense index is empty");
+            return;
+        }
+
+        max_api_id = this->api_metas.rbegin()->first;
+        POS_ASSERT(max_api_id < kMaxApiId);
+
+        this->_api_indices.resize(max_api_id + 1, kInvalidApiIndex);
+        this->_dense_api_metas.reserve(this->api_metas.size());
+        for(meta_iter = this->api_metas.begin(); meta_iter != this->api_metas.end(); meta_iter++){
+            this->_api_indices[meta_iter->first] = this->_dense_api_metas.size();
+            this->_dense_api_metas.push_back(&(meta_iter->second));
+        }
+
+        POS_DEBUG_C(
+            "built dense API index: #apis(%lu), max_api_id(%lu)", this->_dense_api_metas.size(), max_api_id
+        );
+    }
+
+    /*!
+     *  \brief  obtain the dense index of the given API
+     *  \param  api_id  id of the API
+     *  \return dense index of the API, kInvalidApiIndex for unregistered API
+     */
+    inline uint32_t get_api_index(uint64_t api_id) const {
+        if(unlikely(api_id >= this->_api_indices.size())){ return kInvalidApiIndex; }
+        return this->_api_indices[api_id];
+    }
+
+    /*!
+     *  \brief  obtain the metadata of the API by its dense index
+     *  \param  api_index   dense index of the API
+     *  \return metadata of the API
+     */
+    inline const POSAPIMeta_t& get_api_meta_by_index(uint32_t api_index) const {
+        return *(this->_dense_api_metas[api_index]);
+    }
+
+    /*!
+     *  \brief  obtain the number of registered APIs, i.e., the size of dense tables
+     */
+    inline uint32_t get_nb_apis() const { return this->_dense_api_metas.size(); }
+
+    /*!
+     *  \brief  flatten the given function map (api_id -> function) into a table indexed by dense index
+     *  \param  functions   the function map
+     *  \param  table       the resulting table, nullptr for APIs without function
+     */
+    template<typename T_function>
+    void build_dispatch_table(const std::map<uint64_t, T_function>& functions, std::vector<T_function>& table) const {
+        uint32_t api_index;
+
+        table.assign(this->get_nb_apis(), nullptr);
+        for(auto& function : functions){
+            api_index = this->get_api_index(function.first);
+            if(unlikely(api_index == kInvalidApiIndex)){
+                POS_WARN_C("function of unregistered api is omitted from dispatch table: api_id(%lu)", function.first);
+                continue;
+            }
+            table[api_index] = function.second;
+        }
+    }
+
     // map: api_id -> metadata of the api
     std::map<uint64_t, POSAPIMeta_t> api_metas;
 
+    // dense index of unregistered APIs
+    static constexpr uint32_t kInvalidApiIndex = UINT32_MAX;
+
+    // maximum API id that could be remapped
+    static constexpr uint64_t kMaxApiId = 1 << 20;
+
  protected:
+    // api_id -> dense index
+    std::vector<uint32_t> _api_indices;
+
+    // dense index -> metadata of the api, points to the nodes of api_metas
+    std::vector<const POSAPIMeta_t*> _dense_api_metas;
 };
 
 
@@ -124,8 +218,23 @@ enum pos_api_execute_status_t : uint8_t {
 };
 
 
+/*!
+ *  \brief  completion state of an API instance, waited by the RPC thread of sync APIs
+ */
+enum pos_api_completion_state_t : uint32_t {
+    kPOS_API_Completion_Pending = 0,
+    kPOS_API_Completion_Waiting,
+    kPOS_API_Completion_Done
+};
+
+
+class POSAPIContextPool;
+
+
 /*!
  *  \brief  descriptor of one parameter of an API call
+ *  \note   parameters up to kInlineSize are stored inline, larger ones are drawn from the pool of
+ *          the client (if any, and the size is within the pool's range) or the heap
  */
 typedef struct POSAPIParam {
     // payload of the parameter
@@ -134,22 +243,28 @@ typedef struct POSAPIParam {
     // size of the parameter
     size_t param_size;
 
+    // maximum size of a parameter to be stored inline
+    static constexpr uint64_t kInlineSize = 64;
+
     /*!
      *  \brief  constructor
      *  \param  src_value   pointer to the actual value of the parameter
      *  \param  size        size of the parameter
+     *  \param  pool        pool to draw the storage of large parameter, nullptr for the heap
      */
-    POSAPIParam(void *src_value, size_t size) : param_size(size) {
-        POS_CHECK_POINTER(param_value = malloc(size));
-        memcpy(param_value, src_value, param_size);
-    }
+    POSAPIParam(const void *src_value, size_t size, POSAPIContextPool *pool = nullptr);
 
     /*!
      *  \brief  deconstructor
      */
-    ~POSAPIParam(){
-        POS_CHECK_POINTER(param_value); free(param_value);
-    }
+    ~POSAPIParam();
+
+ private:
+    // pool that the storage is drawn from, nullptr for inline / heap storage
+    POSAPIContextPool *_pool;
+
+    // inline storage of small parameter
+    alignas(16) uint8_t _inline_value[kInlineSize];
 } POSAPIParam_t;
 
 
@@ -194,6 +309,9 @@ typedef struct POSAPIContext {
 
     uint64_t retval_size;
 
+    // pool that the parameters are drawn from, nullptr for the heap
+    POSAPIContextPool *pool;
+
 
     /*!
      *  \brief  constructor
@@ -203,19 +321,9 @@ typedef struct POSAPIContext {
      *  \param  retval_size_    size of the return value
      */
     POSAPIContext(uint64_t api_id_, std::vector<POSAPIParamDesp_t>& param_desps, void* ret_data_=nullptr, uint64_t retval_size_=0) 
-        : api_id(api_id_), ret_data(ret_data_), retval_size(retval_size_)
+        : pool(nullptr)
     {
-        POSAPIParam_t *param;
-
-        overall_param_size = 0;
-        params.reserve(16);
-
-        // insert parameters
-        for(auto& param_desp : param_desps){
-            POS_CHECK_POINTER(param = new POSAPIParam_t(param_desp.value, param_desp.size));
-            params.push_back(param);
-            overall_param_size += param_desp.size;
-        }
+        this->init(api_id_, param_desps, ret_data_, retval_size_);
     }
 
     /*!
@@ -223,17 +331,30 @@ typedef struct POSAPIContext {
      *  \note   this constructor is for restoring
      *  \param  api_id_ specialized API index of the checkpointing op
      */
-    POSAPIContext(uint64_t api_id_) : api_id(api_id_), overall_param_size(0) {}
+    POSAPIContext(uint64_t api_id_) : api_id(api_id_), overall_param_size(0), pool(nullptr) {}
 
     /*!
      *  \brief  constructor
-     *  \note   this constructor is used during restore phrase
+     *  \note   this constructor is used during restore phrase, and by the pool of API contexts
+     *  \param  pool_   pool to draw parameters from
      */
-    POSAPIContext() : api_id(0), overall_param_size(0) {}
+    POSAPIContext(POSAPIContextPool *pool_ = nullptr) : api_id(0), overall_param_size(0), pool(pool_) {}
 
-    ~POSAPIContext(){
-        for(auto param : params){ POS_CHECK_POINTER(param); delete param; }
-    }
+    ~POSAPIContext(){ this->reset(); }
+
+    /*!
+     *  \brief  (re)initialize the context with a new API call
+     *  \param  api_id_         index of the called API
+     *  \param  param_desps     descriptors of all involved parameters
+     *  \param  ret_data_       pointer to the memory area that store the returned value
+     *  \param  retval_size_    size of the return value
+     */
+    void init(uint64_t api_id_, std::vector<POSAPIParamDesp_t>& param_desps, void* ret_data_, uint64_t retval_size_);
+
+    /*!
+     *  \brief  release all parameters, the capacity of the parameter list is kept for reuse
+     */
+    void reset();
 } POSAPIContext_t;
 
 
@@ -272,21 +393,29 @@ typedef struct POSHandleView {
      */
     uint64_t offset;
 
+    /*!
+     *  \brief      size of the range accessed from the offset, 0 for unknown (i.e., till the end of the handle)
+     *  \example    for memory handle written by memcpy / memset, the written range is known, so that
+     *              incremental checkpoint only needs to copy the chunks within the range
+     */
+    uint64_t size;
+
     /*!
      *  \brief  constructor
      *  \param  handle_             pointer to the handle which is view targeted on
      *  \param  param_index_        index of the corresponding parameter of this handle view
      *  \param  offset_             offset from the base address of the handle
+     *  \param  size_               size of the range accessed from the offset, 0 for unknown
      */
     POSHandleView(
-        POSHandle* handle_, uint64_t param_index_ = 0, uint64_t offset_ = 0
-    ) : handle(handle_), param_index(param_index_), offset(offset_){}
+        POSHandle* handle_, uint64_t param_index_ = 0, uint64_t offset_ = 0, uint64_t size_ = 0
+    ) : handle(handle_), param_index(param_index_), offset(offset_), size(size_){}
 
     /*!
      *  \brief  constructor
      *  \note   this constructor is used only during restore phrase
      */
-    POSHandleView() : handle(nullptr), param_index(0), offset(0){}
+    POSHandleView() : handle(nullptr), param_index(0), offset(0), size(0){}
 } POSHandleView_t;
 
 
@@ -346,6 +475,27 @@ typedef struct POSAPIContext_QE {
 
     /* ======= end of checkpoint op specific fields ======== */
 
+    /* =========== lifetime fields =========== */
+    /*!
+     *  \brief  number of references to this API instance
+     *  \note   references are held by the processing pipeline (parser / worker), the completion queue
+     *          until polled by the RPC thread, the checkpoint DAG and the trace queue; the instance is
+     *          recycled once the last reference is released
+     */
+    std::atomic<uint32_t> nb_refs;
+
+    // pool that this instance is drawn from, nullptr for the heap
+    POSAPIContextPool *pool;
+
+    /*!
+     *  \brief  completion state of this API instance (pos_api_completion_state_t)
+     *  \note   set once the instance is pushed to the completion queue, a waiter parks on this word
+     *          after spinning for kCompletionSpinRounds
+     */
+    std::atomic<uint32_t> completion_state;
+    static constexpr uint64_t kCompletionSpinRounds = 2048;
+    /* ======= end of lifetime fields ======== */
+
     /*!
      *  \brief  constructor
      *  \param  api_id          index of the called API
@@ -359,21 +509,9 @@ typedef struct POSAPIContext_QE {
     POSAPIContext_QE(
         uint64_t api_id, pos_client_uuid_t uuid, std::vector<POSAPIParamDesp_t>& param_desps,
         uint64_t inst_id, void* retval_data, uint64_t retval_size, POSClient* pos_client
-    ) : client_id(uuid), client(pos_client), has_return(false),
-        status(kPOS_API_Execute_Status_Init), id(inst_id), is_ckpt_pruned(false)
+    ) : api_cxt(nullptr), pool(nullptr)
     {
-        POS_CHECK_POINTER(pos_client);
-        this->api_cxt = new POSAPIContext_t(api_id, param_desps, retval_data, retval_size);
-        POS_CHECK_POINTER(this->api_cxt);
-        create_tick = POSUtilTimestamp::get_tsc();
-        parser_s_tick = parser_e_tick = worker_s_tick = worker_e_tick = 0;
-
-        // initialization of checkpoint op specific fields
-        nb_ckpt_handles = 0;
-        nb_abandon_handles = 0;
-        ckpt_size = 0;
-        abandon_ckpt_size = 0;
-        ckpt_memory_consumption = 0;
+        POS_CHECK_POINTER(this->api_cxt = new POSAPIContext_t());
 
         // reserve space
         input_handle_views.reserve(5);
@@ -381,37 +519,178 @@ typedef struct POSAPIContext_QE {
         inout_handle_views.reserve(5);
         create_handle_views.reserve(1);
         delete_handle_views.reserve(1);
+
+        this->init(api_id, uuid, param_desps, inst_id, retval_data, retval_size, pos_client);
     }
 
 
     /*!
      *  \brief  constructor
-     *  \note   this constructor is used only during restore phrase
-     *  \param  pos_client          pointer to the POSClient instance
+     *  \note   this constructor is used only during restore phrase, and by the pool of API contexts
+     *  \param  pos_client  pointer to the POSClient instance
+     *  \param  pool_       pool that this instance is drawn from
      */
-    POSAPIContext_QE(POSClient* pos_client) 
-        : client(pos_client), has_return(false), is_ckpt_pruned(false){}
+    POSAPIContext_QE(POSClient* pos_client, POSAPIContextPool* pool_ = nullptr) 
+        :   client(pos_client), api_cxt(nullptr), has_return(false), is_ckpt_pruned(false), nb_refs(1), pool(pool_),
+            completion_state(kPOS_API_Completion_Pending)
+    {
+        if(pool_ != nullptr){
+            POS_CHECK_POINTER(this->api_cxt = new POSAPIContext_t(pool_));
+            input_handle_views.reserve(5);
+            output_handle_views.reserve(5);
+            inout_handle_views.reserve(5);
+            create_handle_views.reserve(1);
+            delete_handle_views.reserve(1);
+        }
+    }
 
 
     /*!
      *  \brief  constructor
-     *  \note   this constructor is for restoring from binary checkpoint file
+     *  \note   this constructor is for restoring from the checkpoint image
      *  \param  client      pointer to the POSClient instance
-     *  \param  ckpt_file   path to the checkpoint file
+     *  \param  mapped      pointer to the record inside the mmapped checkpoint image
+     *  \param  size        size of the record
      */
-    POSAPIContext_QE(POSClient* client, const std::string& ckpt_file);
+    POSAPIContext_QE(POSClient* client, const void* mapped, uint64_t size);
 
 
     /*!
      *  \brief  deconstructor
      */
     ~POSAPIContext_QE(){
-        // TODO: release handle views
+        if(this->api_cxt != nullptr){ delete this->api_cxt; }
+    }
+
+
+    /*!
+     *  \brief  (re)initialize this instance with a new API call
+     *  \note   the instance is held by a single reference after initialization
+     *  \param  api_id          index of the called API
+     *  \param  uuid            uuid of the remote client
+     *  \param  param_desps     description of all parameters of the call
+     *  \param  inst_id         uuid of this API call instance within the client
+     *  \param  retval_data     pointer to the memory area that store the returned value
+     *  \param  retval_size     size of the return value
+     *  \param  pos_client      pointer to the POSClient instance
+     */
+    inline void init(
+        uint64_t api_id, pos_client_uuid_t uuid, std::vector<POSAPIParamDesp_t>& param_desps,
+        uint64_t inst_id, void* retval_data, uint64_t retval_size, POSClient* pos_client
+    ){
+        POS_CHECK_POINTER(pos_client);
+        POS_CHECK_POINTER(this->api_cxt);
+
+        this->client_id = uuid;
+        this->client = pos_client;
+        this->id = inst_id;
+        this->has_return = false;
+        this->status = kPOS_API_Execute_Status_Init;
+        this->is_ckpt_pruned = false;
+        this->nb_refs.store(1, std::memory_order_relaxed);
+        this->completion_state.store(kPOS_API_Completion_Pending, std::memory_order_relaxed);
+
+        this->api_cxt->init(api_id, param_desps, retval_data, retval_size);
+        create_tick = POSUtilTimestamp::get_tsc();
+        return_tick = 0;
+        parser_s_tick = parser_e_tick = worker_s_tick = worker_e_tick = 0;
+
+        // initialization of checkpoint op specific fields
+        nb_ckpt_handles = 0;
+        nb_abandon_handles = 0;
+        ckpt_size = 0;
+        abandon_ckpt_size = 0;
+        ckpt_memory_consumption = 0;
+    }
+
+
+    /*!
+     *  \brief  release the parameters and handle views of the API call, the capacity of all lists is
+     *          kept for reuse
+     */
+    inline void reset(){
+        if(likely(this->api_cxt != nullptr)){ this->api_cxt->reset(); }
+        input_handle_views.clear();
+        output_handle_views.clear();
+        create_handle_views.clear();
+        delete_handle_views.clear();
+        inout_handle_views.clear();
+        checkpoint_handles.clear();
+    }
+
+
+    /*!
+     *  \brief  acquire references to this instance
+     *  \param  nb  number of references to acquire
+     */
+    inline void get_ref(uint32_t nb = 1){
+        this->nb_refs.fetch_add(nb, std::memory_order_relaxed);
+    }
+
+
+    /*!
+     *  \brief  mark this instance as completed, and wake up the waiter (if any)
+     *  \note   the return code and return data should be ready before calling this function
+     */
+    inline void mark_completed(){
+        if(unlikely(
+            this->completion_state.exchange(kPOS_API_Completion_Done, std::memory_order_acq_rel)
+                == kPOS_API_Completion_Waiting
+        )){
+            syscall(
+                SYS_futex, reinterpret_cast<uint32_t*>(&this->completion_state), FUTEX_WAKE_PRIVATE,
+                INT32_MAX, nullptr, nullptr, 0
+            );
+        }
+    }
+
+
+    /*!
+     *  \brief  identify whether this instance is completed
+     */
+    inline bool is_completed() const {
+        return this->completion_state.load(std::memory_order_acquire) == kPOS_API_Completion_Done;
+    }
+
+
+    /*!
+     *  \brief  block until this instance is completed, spin for kCompletionSpinRounds before parking
+     *  \note   the caller should hold a reference to this instance while waiting
+     */
+    inline void wait_completed(){
+        uint64_t i;
+        uint32_t state;
+
+        for(i=0; i<kCompletionSpinRounds; i++){
+            if(likely(this->is_completed())){ return; }
+            pos_cpu_relax();
+        }
+
+        while(true){
+            state = kPOS_API_Completion_Pending;
+            if(!this->completion_state.compare_exchange_strong(state, kPOS_API_Completion_Waiting, std::memory_order_acq_rel)){
+                if(state == kPOS_API_Completion_Done){ return; }
+            }
+            syscall(
+                SYS_futex, reinterpret_cast<uint32_t*>(&this->completion_state), FUTEX_WAIT_PRIVATE,
+                kPOS_API_Completion_Waiting, nullptr, nullptr, 0
+            );
+            if(this->is_completed()){ return; }
+        }
     }
 
 
     /*!
-     *  \brief  persist the state of this APIcontext to specified directory
+     *  \brief  release a reference to this instance, and recycle it if it's the last one
+     *  \note   the instance shouldn't be accessed by the caller after this call
+     */
+    inline void put_ref(){
+        if(this->nb_refs.fetch_sub(1, std::memory_order_acq_rel) == 1){ this->__recycle(); }
+    }
+
+
+    /*!
+     *  \brief  persist the state of this APIcontext to the checkpoint image of specified directory
      *  \tparam with_params whether to persist with parameter information,
      *          if this persist is for tracing, then false; otherwise for
      *          checkpointing, then true   
@@ -422,6 +701,16 @@ typedef struct POSAPIContext_QE {
     pos_retval_t persist(std::string ckpt_dir);
 
 
+    /*!
+     *  \brief  persist the state of this APIcontext as a frame of the given API context log
+     *  \tparam with_params whether to persist with parameter information
+     *  \param  log the API context log of the dump
+     *  \return POS_SUCCESS for successfully checkpointing
+     */
+    template<bool with_params>
+    pos_retval_t persist(POSAPIContextLogWriter* log);
+
+
     /*!
      *  \brief  record involved handles of this API instance
      *  \param  handle_view     view of the API instance to use this handle
@@ -467,6 +756,11 @@ typedef struct POSAPIContext_QE {
         POS_ERROR_C_DETAIL("not implemented");
     }
 
+ private:
+    /*!
+     *  \brief  return this instance to its pool, or delete it if it's drawn from the heap
+     */
+    void __recycle();
 } POSAPIContext_QE_t;
 
 
@@ -510,3 +804,275 @@ typedef struct POSAPIContext_QE {
 
 #define pos_api_inout_handle_offset_server_addr(qe_ptr, index)  \
     ((void*)((uint64_t)(qe_ptr->inout_handle_views[index].handle->server_addr) + (qe_ptr->inout_handle_views[index].offset)))
+
+
+/*!
+ *  \brief  statistics of the pool of API contexts
+ */
+typedef struct pos_apicxt_pool_stat {
+    // number of work queue elements constructed / currently free for reuse
+    uint64_t nb_qes;
+    uint64_t nb_free_qes;
+
+    // overall number of work queue elements served
+    uint64_t nb_qe_allocs;
+
+    // number of parameters currently drawn from the pool, and overall served
+    uint64_t nb_allocated_params;
+    uint64_t nb_param_allocs;
+
+    // overall size of slabs
+    uint64_t nb_slab_bytes;
+
+    pos_apicxt_pool_stat()
+        :   nb_qes(0), nb_free_qes(0), nb_qe_allocs(0), nb_allocated_params(0), nb_param_allocs(0),
+            nb_slab_bytes(0) {}
+} pos_apicxt_pool_stat_t;
+
+
+/*!
+ *  \brief  per-client pool of API contexts, which recycles the memory of completed API calls
+ *  \note   work queue elements are constructed once within slabs and reused among API calls, so that
+ *          their parameter list and handle view lists keep their capacity
+ *  \note   parameters larger than POSAPIParam::kInlineSize and up to kMaxPooledParamSize are stored
+ *          in power-of-2 size-class slabs, larger ones are stored on the heap
+ *  \note   all methods are thread-safe
+ */
+class POSAPIContextPool {
+ public:
+    POSAPIContextPool()
+        :   _qe_slab(sizeof(POSAPIContext_QE_t), kNbQEsPerSlab),
+            _param_slab(sizeof(POSAPIParam_t), kNbParamsPerSlab),
+            _nb_qe_allocs(0)
+    {
+        uint32_t i;
+        for(i=0; i<kNbParamValueClasses; i++){
+            POS_CHECK_POINTER(this->_param_value_slabs[i] = new POSSlabPool(
+                kMinParamValueClassSize << i, kParamValueSlabSize / (kMinParamValueClassSize << i)
+            ));
+        }
+    }
+
+
+    ~POSAPIContextPool(){
+        uint32_t i;
+        for(POSAPIContext_QE_t *qe : this->_qes){ qe->~POSAPIContext_QE(); }
+        for(i=0; i<kNbParamValueClasses; i++){ delete this->_param_value_slabs[i]; }
+    }
+
+
+    /*!
+     *  \brief  obtain a work queue element for a new API call
+     *  \note   the returned element is held by a single reference
+     *  \param  api_id          index of the called API
+     *  \param  uuid            uuid of the remote client
+     *  \param  param_desps     description of all parameters of the call
+     *  \param  inst_id         uuid of this API call instance within the client
+     *  \param  retval_data     pointer to the memory area that store the returned value
+     *  \param  retval_size     size of the return value
+     *  \param  pos_client      pointer to the POSClient instance
+     *  \return pointer to the work queue element
+     */
+    inline POSAPIContext_QE_t* alloc_qe(
+        uint64_t api_id, pos_client_uuid_t uuid, std::vector<POSAPIParamDesp_t>& param_desps,
+        uint64_t inst_id, void* retval_data, uint64_t retval_size, POSClient* pos_client
+    ){
+        POSAPIContext_QE_t *qe = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(this->_qe_mutex);
+            if(likely(!this->_free_qes.empty())){
+                qe = this->_free_qes.back();
+                this->_free_qes.pop_back();
+            }
+        }
+
+        if(unlikely(qe == nullptr)){
+            qe = new (this->_qe_slab.alloc()) POSAPIContext_QE_t(pos_client, this);
+            std::lock_guard<std::mutex> lock(this->_qe_mutex);
+            this->_qes.push_back(qe);
+            this->_free_qes.reserve(this->_qes.size());
+        }
+
+        qe->init(api_id, uuid, param_desps, inst_id, retval_data, retval_size, pos_client);
+        this->_nb_qe_allocs.fetch_add(1, std::memory_order_relaxed);
+
+        return qe;
+    }
+
+
+    /*!
+     *  \brief  return a work queue element to the pool
+     *  \note   this function is called by POSAPIContext_QE::put_ref once the last reference is released
+     *  \param  qe  the work queue element
+     */
+    inline void recycle_qe(POSAPIContext_QE_t* qe){
+        POS_CHECK_POINTER(qe);
+        qe->reset();
+        std::lock_guard<std::mutex> lock(this->_qe_mutex);
+        this->_free_qes.push_back(qe);
+    }
+
+
+    /*!
+     *  \brief  allocate / free the storage of a parameter descriptor
+     */
+    inline void* alloc_param(){ return this->_param_slab.alloc(); }
+    inline void free_param(void* param){ this->_param_slab.free(param); }
+
+
+    /*!
+     *  \brief  allocate the storage of a parameter value
+     *  \param  size    size of the value
+     *  \return pointer to the storage, nullptr for the size is out of the range of the pool
+     */
+    inline void* alloc_param_value(uint64_t size){
+        if(unlikely(size <= POSAPIParam_t::kInlineSize || size > kMaxPooledParamSize)){ return nullptr; }
+        return this->_param_value_slabs[__get_param_value_class(size)]->alloc();
+    }
+
+
+    /*!
+     *  \brief  free the storage of a parameter value
+     *  \param  value   pointer to the storage, should be allocated by alloc_param_value
+     *  \param  size    size of the value
+     */
+    inline void free_param_value(void* value, uint64_t size){
+        this->_param_value_slabs[__get_param_value_class(size)]->free(value);
+    }
+
+
+    /*!
+     *  \brief  obtain the statistics of the pool
+     *  \param  stat    the returned statistics
+     */
+    inline void get_stat(pos_apicxt_pool_stat_t& stat){
+        uint32_t i;
+        pos_slab_pool_stat_t slab_stat;
+
+        stat = pos_apicxt_pool_stat_t();
+        {
+            std::lock_guard<std::mutex> lock(this->_qe_mutex);
+            stat.nb_qes = this->_qes.size();
+            stat.nb_free_qes = this->_free_qes.size();
+        }
+        stat.nb_qe_allocs = this->_nb_qe_allocs.load();
+
+        this->_qe_slab.get_stat(slab_stat);
+        stat.nb_slab_bytes += slab_stat.nb_slab_bytes;
+        this->_param_slab.get_stat(slab_stat);
+        stat.nb_slab_bytes += slab_stat.nb_slab_bytes;
+        stat.nb_allocated_params = slab_stat.nb_allocated_elts;
+        stat.nb_param_allocs = slab_stat.nb_allocs;
+        for(i=0; i<kNbParamValueClasses; i++){
+            this->_param_value_slabs[i]->get_stat(slab_stat);
+            stat.nb_slab_bytes += slab_stat.nb_slab_bytes;
+        }
+    }
+
+
+    // maximum size of a parameter value to be drawn from the pool
+    static constexpr uint64_t kMaxPooledParamSize = KB(4);
+
+    // size classes of parameter values: 128, 256, ..., kMaxPooledParamSize
+    static constexpr uint64_t kMinParamValueClassSize = POSAPIParam_t::kInlineSize * 2;
+    static constexpr uint32_t kNbParamValueClasses = 6;
+    static_assert(kMinParamValueClassSize << (kNbParamValueClasses - 1) == kMaxPooledParamSize);
+
+    // size of slabs
+    static constexpr uint64_t kNbQEsPerSlab = 128;
+    static constexpr uint64_t kNbParamsPerSlab = 1024;
+    static constexpr uint64_t kParamValueSlabSize = KB(256);
+
+ private:
+    /*!
+     *  \brief  obtain the size class of a parameter value
+     *  \param  size    size of the value, within (POSAPIParam::kInlineSize, kMaxPooledParamSize]
+     *  \return index of the size class
+     */
+    static inline uint32_t __get_param_value_class(uint64_t size){
+        return (64 - __builtin_clzll(size - 1)) - (__builtin_ctzll(kMinParamValueClassSize));
+    }
+
+    // all constructed work queue elements, and those free for reuse
+    std::vector<POSAPIContext_QE_t*> _qes;
+    std::vector<POSAPIContext_QE_t*> _free_qes;
+    std::mutex _qe_mutex;
+
+    POSSlabPool _qe_slab;
+    POSSlabPool _param_slab;
+    POSSlabPool* _param_value_slabs[kNbParamValueClasses];
+
+    std::atomic<uint64_t> _nb_qe_allocs;
+};
+
+
+inline POSAPIParam::POSAPIParam(const void *src_value, size_t size, POSAPIContextPool *pool)
+    : param_size(size), _pool(nullptr)
+{
+    if(likely(size <= kInlineSize)){
+        this->param_value = this->_inline_value;
+    } else if(pool != nullptr && nullptr != (this->param_value = pool->alloc_param_value(size))){
+        this->_pool = pool;
+    } else {
+        POS_CHECK_POINTER(this->param_value = malloc(size));
+    }
+    memcpy(this->param_value, src_value, size);
+}
+
+
+inline POSAPIParam::~POSAPIParam(){
+    if(this->_pool != nullptr){
+        this->_pool->free_param_value(this->param_value, this->param_size);
+    } else if(this->param_value != this->_inline_value){
+        POS_CHECK_POINTER(this->param_value); free(this->param_value);
+    }
+}
+
+
+inline void POSAPIContext::init(
+    uint64_t api_id_, std::vector<POSAPIParamDesp_t>& param_desps, void* ret_data_, uint64_t retval_size_
+){
+    POSAPIParam_t *param;
+
+    this->api_id = api_id_;
+    this->ret_data = ret_data_;
+    this->retval_size = retval_size_;
+    this->overall_param_size = 0;
+    this->params.reserve(16);
+
+    // insert parameters
+    for(auto& param_desp : param_desps){
+        if(this->pool != nullptr){
+            param = new (this->pool->alloc_param()) POSAPIParam_t(param_desp.value, param_desp.size, this->pool);
+        } else {
+            POS_CHECK_POINTER(param = new POSAPIParam_t(param_desp.value, param_desp.size));
+        }
+        this->params.push_back(param);
+        this->overall_param_size += param_desp.size;
+    }
+}
+
+
+inline void POSAPIContext::reset(){
+    for(auto param : this->params){
+        POS_CHECK_POINTER(param);
+        if(this->pool != nullptr){
+            param->~POSAPIParam();
+            this->pool->free_param(param);
+        } else {
+            delete param;
+        }
+    }
+    this->params.clear();
+    this->overall_param_size = 0;
+}
+
+
+inline void POSAPIContext_QE::__recycle(){
+    if(this->pool != nullptr){
+        this->pool->recycle_qe(this);
+    } else {
+        delete this;
+    }
+}
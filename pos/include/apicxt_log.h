@@ -0,0 +1,170 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_image.h"
+
+
+/*!
+ *  \brief  flags of a frame inside the API context log
+ */
+enum pos_apicxt_log_frame_flag_t : uint32_t {
+    // the API context is serialized along with its parameters
+    kPOS_APICxtLogFrameFlag_WithParams = 0x1
+};
+
+
+/*!
+ *  \brief  header of a frame inside the API context log
+ *  \note   the layout of a segment is: [header][serialized API context][header][serialized API context]...,
+ *          frames are packed back to back in the order of appending
+ */
+typedef struct pos_apicxt_log_frame_header {
+    // size of the serialized API context, which follows the header immediately
+    uint32_t size;
+
+    // flags of the frame, see pos_apicxt_log_frame_flag_t
+    uint32_t flags;
+
+    // index of the API context
+    pos_u64id_t id;
+} __attribute__((packed)) pos_apicxt_log_frame_header_t;
+
+
+/*!
+ *  \brief  statistics of the API context log
+ */
+typedef struct pos_apicxt_log_stat {
+    uint64_t nb_frames;
+    uint64_t nb_segments;
+
+    // overall size of all frames, including headers
+    uint64_t size;
+
+    pos_apicxt_log_stat() : nb_frames(0), nb_segments(0), size(0) {}
+} pos_apicxt_log_stat_t;
+
+
+/*!
+ *  \brief  append-only log of API contexts within the checkpoint image of a dump
+ *  \note   API contexts are serialized straight into a batch buffer as length-prefixed frames, and each full
+ *          batch is flushed as one segment record (kPOS_CkptImageRecord_APIContextLog) of the image by the
+ *          persist executor, under the tag of the checkpoint directory; so that deep queues of unexecuted
+ *          API contexts cost a few large appends instead of one record (and one index entry) per context
+ *  \note   the writer isn't thread-safe, it's expected to be driven by a single thread (i.e., the worker)
+ */
+class POSAPIContextLogWriter {
+ public:
+    /*!
+     *  \param  ckpt_dir    checkpoint directory (i.e., the storage location) of the image
+     */
+    POSAPIContextLogWriter(const std::string& ckpt_dir);
+    ~POSAPIContextLogWriter();
+
+
+    /*!
+     *  \brief  append a frame to the log
+     *  \note   the current batch is flushed in advance if the frame doesn't fit into it
+     *  \param  id      index of the API context
+     *  \param  flags   flags of the frame, see pos_apicxt_log_frame_flag_t
+     *  \param  size    size of the serialized API context
+     *  \return pointer to the payload of the frame to serialize the API context into, which is valid until
+     *          the next call to the writer; nullptr for oversized frame or failed flushing
+     */
+    void* append_frame(pos_u64id_t id, uint32_t flags, uint64_t size);
+
+
+    /*!
+     *  \brief  flush the current batch as a segment of the log
+     *  \note   the segment is appended to the image asynchronously, the caller should wait for it by
+     *          flushing the persist executor under the tag of the checkpoint directory
+     *  \return POS_SUCCESS for successfully submitted (or nothing to flush)
+     */
+    pos_retval_t flush();
+
+
+    /*!
+     *  \brief  obtain statistics of the log
+     */
+    inline pos_apicxt_log_stat_t get_stat(){ return this->_stat; }
+
+
+    // size of a batch, i.e., a segment
+    static inline uint64_t batch_size = MB(1);
+
+ private:
+    std::string _ckpt_dir;
+
+    // the batch being filled
+    std::shared_ptr<std::vector<uint8_t>> _batch;
+
+    pos_apicxt_log_stat_t _stat;
+};
+
+
+/*!
+ *  \brief  sequential reader of the API context log within a checkpoint image
+ *  \note   frames are accessed in-place from the mmapped image, segment by segment in the order of flushing
+ */
+class POSAPIContextLogReader {
+ public:
+    POSAPIContextLogReader() : _image(nullptr), _segment_idx(0), _offset(0) {}
+    ~POSAPIContextLogReader() = default;
+
+
+    /*!
+     *  \brief  open the log within the given image, and verify the checksums of its segments in parallel
+     *  \param  image   the opened checkpoint image
+     *  \return POS_SUCCESS for successfully opened (an image without log is regarded as an empty log);
+     *          POS_FAILED_INCORRECT_OUTPUT for corrupted segment
+     */
+    pos_retval_t open(POSCheckpointImage* image);
+
+
+    /*!
+     *  \brief  obtain the next frame of the log
+     *  \param  header  returned header of the frame
+     *  \param  data    returned pointer to the serialized API context
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_NOT_EXIST for reaching the end of the log;
+     *          POS_FAILED_INVALID_INPUT for truncated frame
+     */
+    pos_retval_t next(const pos_apicxt_log_frame_header_t** header, const void** data);
+
+
+    /*!
+     *  \brief  obtain the number of segments of the log
+     */
+    inline uint64_t get_nb_segments(){ return this->_segments.size(); }
+
+ private:
+    POSCheckpointImage *_image;
+
+    // segments of the log, in the order of flushing
+    std::vector<const pos_ckpt_image_entry_t*> _segments;
+
+    // position of the next frame
+    uint64_t _segment_idx;
+    uint64_t _offset;
+};
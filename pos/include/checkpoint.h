@@ -20,9 +20,15 @@
 #include <vector>
 #include <set>
 #include <unordered_map>
+#include <mutex>
+#include <atomic>
 #include <stdint.h>
 #include "pos/include/common.h"
 #include "pos/include/log.h"
+#include "pos/include/checkpoint_arena.h"
+#include "pos/include/checkpoint_retention.h"
+#include "pos/include/checkpoint_spill.h"
+#include "pos/include/utils/size_class_freelist.h"
 
 
 // forward declaration
@@ -67,6 +73,18 @@ class POSCheckpointSlot {
     pos_ckpt_state_type_t state_type;
 
 
+    // TSC tick when the slot was applied for its current version
+    uint64_t tick;
+
+
+    // whether the state is still being committed into the slot
+    bool is_committing;
+
+
+    // number of users reading the memory of the slot directly (e.g., ongoing persisting)
+    std::atomic<uint32_t> nb_pins;
+
+
     /*!
      *  \brief  construtor
      *  \param  state_size      size of the data inside this slot
@@ -74,40 +92,42 @@ class POSCheckpointSlot {
      *  \param  deallocator     deallocator for deallocating host-side memory region that stores checkpoint
      *  \param  ckpt_position   position of this checkpoint slot (device/host)
      *  \param  state_type      type of state stored inside this checkpoint slot (device/host)
+     *  \param  capacity        size of the memory region to allocate, should be no smaller than
+     *                          state_size; 0 for using state_size
      */
     POSCheckpointSlot(
         uint64_t state_size,
         pos_custom_ckpt_allocate_func_t allocator,
         pos_custom_ckpt_deallocate_func_t deallocator,
         pos_ckptslot_position_t ckpt_position,
-        pos_ckpt_state_type_t state_type
-    ) : _state_size(state_size),
+        pos_ckpt_state_type_t state_type,
+        uint64_t capacity = 0
+    ) : ckpt_position(ckpt_position),
+        state_type(state_type),
+        tick(0),
+        is_committing(false),
+        nb_pins(0),
+        _state_size(state_size),
+        _capacity(capacity > state_size ? capacity : state_size),
+        _custom_allocator(allocator),
         _custom_deallocator(deallocator),
-        ckpt_position(ckpt_position),
-        state_type(state_type)
+        _is_spilled(false),
+        _spill_offset(0)
     {
         POS_ASSERT(state_size > 0);
-        if(likely(allocator != nullptr)){
-            POS_CHECK_POINTER(this->_data = allocator(state_size));
-        } else {
-            POS_CHECK_POINTER(this->_data = reinterpret_cast<void*>(new uint8_t[state_size]));
-        }
+
+        /*!
+         *  \note   the allocation might fail (e.g., exceed the quota of the client inside
+         *          the checkpoint arena), caller should check expose_pointer() before using this slot
+         */
+        this->__allocate();
     }
 
     /*!
      *  \brief  deconstrutor
      */
     ~POSCheckpointSlot(){
-        if(likely(_custom_deallocator != nullptr)){
-            _custom_deallocator(_data);
-        } else {
-            // default deallocate using free
-            if(unlikely(this->_data != nullptr && this->_state_size > 0)){
-                uint8_t *data_u8;
-                POS_CHECK_POINTER(data_u8 = reinterpret_cast<uint8_t*>(this->_data));
-                delete[] data_u8;
-            }
-        }
+        if(likely(!this->_is_spilled)){ this->__deallocate(); }
     }
 
     /*!
@@ -122,15 +142,110 @@ class POSCheckpointSlot {
      */
     inline uint64_t get_state_size(){ return this->_state_size; }
 
+    /*!
+     *  \brief  obtain the size of the memory region owned by this slot
+     *  \return the size of the memory region owned by this slot
+     */
+    inline uint64_t get_capacity(){ return this->_capacity; }
+
+    /*!
+     *  \brief  reset the size of the state in this slot, used while reusing a cached slot
+     *  \param  state_size  the new state size, should be no larger than the capacity
+     */
+    inline void set_state_size(uint64_t state_size){
+        POS_ASSERT(state_size > 0 && state_size <= this->_capacity);
+        this->_state_size = state_size;
+    }
+
+    /*!
+     *  \brief  release the memory of the slot after its state is written to the spill tier
+     *  \param  spill_offset    offset of the state inside the spill file
+     */
+    inline void release_memory(uint64_t spill_offset){
+        POS_ASSERT(!this->_is_spilled);
+        this->__deallocate();
+        this->_data = nullptr;
+        this->_is_spilled = true;
+        this->_spill_offset = spill_offset;
+    }
+
+    /*!
+     *  \brief  allocate the memory of a spilled slot again, so that its state could be loaded back
+     *  \note   the slot stays spilled until mark_loaded(), so that no one reads the memory before the
+     *          state is loaded into it
+     *  \return POS_SUCCESS for successfully allocated;
+     *          POS_FAILED_OOM for failed to allocate
+     */
+    inline pos_retval_t reacquire_memory(){
+        POS_ASSERT(this->_is_spilled && this->_data == nullptr);
+        this->__allocate();
+        if(unlikely(this->_data == nullptr)){ return POS_FAILED_OOM; }
+        return POS_SUCCESS;
+    }
+
+    /*!
+     *  \brief  mark the state of a spilled slot as loaded into the reacquired memory
+     */
+    inline void mark_loaded(){
+        POS_ASSERT(this->_is_spilled && this->_data != nullptr);
+        this->_is_spilled = false;
+    }
+
+    /*!
+     *  \brief  release the reacquired memory of a spilled slot whose state failed to be loaded, the state
+     *          stays in the spill tier
+     */
+    inline void release_reacquired_memory(){
+        POS_ASSERT(this->_is_spilled && this->_data != nullptr);
+        this->__deallocate();
+        this->_data = nullptr;
+    }
+
+    /*!
+     *  \brief  check whether the state of the slot is in the spill tier instead of memory
+     */
+    inline bool is_spilled(){ return this->_is_spilled; }
+
+    /*!
+     *  \brief  obtain the offset of the spilled state inside the spill file
+     */
+    inline uint64_t get_spill_offset(){ return this->_spill_offset; }
+
  protected:
     // size of the data inside this slot
     uint64_t _state_size;
 
+    // size of the memory region owned by this slot
+    uint64_t _capacity;
+
     // pointer to the checkpoint memory region
     void *_data;
 
-    // deallocator for deallocating memory region that stores checkpoint
+    // allocator / deallocator of the memory region that stores checkpoint, nullptr for the checkpoint arena
+    pos_custom_ckpt_allocate_func_t _custom_allocator;
     pos_custom_ckpt_deallocate_func_t _custom_deallocator;
+
+    // whether the state is spilled, and where it is inside the spill file
+    bool _is_spilled;
+    uint64_t _spill_offset;
+
+ private:
+    inline void __allocate(){
+        if(likely(this->_custom_allocator != nullptr)){
+            this->_data = this->_custom_allocator(this->_capacity);
+        } else {
+            this->_data = POSCheckpointArena::get_instance()->alloc(this->_capacity);
+        }
+    }
+
+    inline void __deallocate(){
+        if(likely(this->_custom_deallocator != nullptr)){
+            this->_custom_deallocator(this->_data);
+        } else {
+            // default return to the checkpoint arena
+            POSCheckpointArena::get_instance()->free(this->_data);
+        }
+    }
 };
 
 
@@ -152,10 +267,49 @@ typedef struct pos_host_ckpt {
 } pos_host_ckpt_t;
 
 
+/*!
+ *  \brief  memory statistics of a checkpoint bag
+ */
+typedef struct pos_ckptbag_memory_stat {
+    // overall size of the states stored inside active slots
+    uint64_t state_size;
+
+    // overall size of the memory regions owned by active slots
+    uint64_t active_capacity;
+
+    // overall size of the memory regions owned by cached (freed) slots
+    uint64_t cached_capacity;
+
+    // overall size of the states spilled out of memory by active slots
+    uint64_t spilled_size;
+
+    // number of slot applications that hit / miss the cached slots
+    uint64_t nb_reuse_hit;
+    uint64_t nb_reuse_miss;
+
+    /*!
+     *  \brief  ratio of memory that doesn't store any valid state
+     *  \return fragmentation ratio, within [0, 1)
+     */
+    inline double get_fragmentation() const {
+        uint64_t overall = active_capacity + cached_capacity;
+        return overall == 0 ? 0.0 : (double)(overall - state_size) / (double)(overall);
+    }
+
+    pos_ckptbag_memory_stat()
+        :   state_size(0), active_capacity(0), cached_capacity(0), spilled_size(0),
+            nb_reuse_hit(0), nb_reuse_miss(0) {}
+} pos_ckptbag_memory_stat_t;
+
+
 /*!
  *  \brief  collection of checkpoint slots of a handle
+ *  \note   the bag registers itself to the retention engine, which reclaims old host-side versions of the
+ *          device state back to the cached slots in the background, so all methods are thread-safe
+ *  \note   the bag also accounts host-side slots of the device state to the spill tier, which might spill
+ *          settled slots out of memory under the budget; spilled slots are loaded back on access
  */
-class POSCheckpointBag {
+class POSCheckpointBag : public POSCheckpointRetentionTarget, public POSCheckpointSpillTarget {
  public:
     /*!
      *  \brief  construtor
@@ -172,7 +326,7 @@ class POSCheckpointBag {
         pos_custom_ckpt_allocate_func_t dev_allocator,
         pos_custom_ckpt_deallocate_func_t dev_deallocator
     );
-    ~POSCheckpointBag() = default;
+    ~POSCheckpointBag();
 
 
     /*!
@@ -204,6 +358,8 @@ class POSCheckpointBag {
      *  \brief  obtain checkpointed data by given checkpoint version
      *  \tparam ckpt_slot_pos       position of the checkpoint slot to be obtained
      *  \tparam ckpt_state_type     type of the checkpointed state
+     *  \note   a spilled host-side slot of the device state is loaded back into memory; callers that read it
+     *          after it's settled should pin it (nb_pins), otherwise it might be spilled again
      *  \param  ckpt_slot   pointer to the checkpoint slot if successfully obtained
      *  \param  version     the specified version
      *  \return POS_SUCCESS for successfully obtained
@@ -213,13 +369,27 @@ class POSCheckpointBag {
     pos_retval_t get_checkpoint_slot(POSCheckpointSlot** ckpt_slot, uint64_t version);
 
 
+    /*!
+     *  \brief  mark the host-side slot of the device state with given version as settled, i.e., the state
+     *          has been committed into it, so that it could be spilled once no one reads it
+     *  \note   readers of the slot (e.g., persisting) should pin it before it's settled
+     *  \param  version the version of the slot
+     *  \return POS_SUCCESS for successfully settled;
+     *          POS_FAILED_NOT_EXIST for no slot of the version
+     */
+    pos_retval_t settle_checkpoint_slot(uint64_t version);
+
+
     /*!
      *  \brief  obtain all checkpointed slots
      *  \tparam ckpt_slot_pos       position of the checkpoint slot to be obtained
      *  \tparam ckpt_state_type     type of the checkpointed state
-     *  \param  ckpt_slots          pointer to the vector that stores checkpoint slots
+     *  \note   spilled host-side slots of the device state are loaded back into memory, see get_checkpoint_slot
+     *  \param  ckpt_slots          pointer to the vector that stores checkpoint slots, empty on failure
      *  \return POS_SUCCESS for successfully obtained
      *          POS_FAILED_NOT_EXIST for no checkpoint is found
+     *          POS_FAILED for failed to load any spilled slot; slots loaded before the failure stay in
+     *          memory as settled slots, which could be spilled again
      */
     template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
     pos_retval_t get_all_scheckpoint_slots(std::vector<POSCheckpointSlot*>& ckpt_slots);
@@ -272,10 +442,11 @@ class POSCheckpointBag {
      *  \brief  obtain overall memory consumption of this checkpoint bag
      *  \tparam ckpt_slot_pos       position of the checkpoint slot to be quried
      *  \tparam ckpt_state_type     type of the checkpointed state
-     *  \return overall memory consumption of this checkpoint bag
+     *  \param  stat                returned detailed statistics (e.g., fragmentation), could be nullptr
+     *  \return overall memory consumption of this checkpoint bag, including both active and cached slots
      */
     template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
-    uint64_t get_memory_consumption();
+    uint64_t get_memory_consumption(pos_ckptbag_memory_stat_t *stat = nullptr);
 
 
     /*!
@@ -296,6 +467,47 @@ class POSCheckpointBag {
     std::vector<pos_host_ckpt_t> get_host_checkpoint_records();
 
 
+    /*!
+     *  \brief  collect the versions of host-side slots that store device state, for the retention engine
+     *  \param  versions    vector to append the versions to
+     */
+    void get_retained_versions(std::vector<pos_ckpt_retained_version_t>& versions) override;
+
+
+    /*!
+     *  \brief  return the host-side slot of the given version back to the cached slots, for the retention engine
+     *  \param  version the version to reclaim
+     *  \return POS_SUCCESS for successfully reclaimed;
+     *          POS_FAILED_NOT_EXIST for the version doesn't exist;
+     *          POS_FAILED_NOT_READY for the slot is being committed or persisted
+     */
+    pos_retval_t reclaim_version(uint64_t version) override;
+
+
+    /*!
+     *  \brief  collect settled and unpinned host-side slots of the device state, for the spill tier
+     *  \param  candidates  vector to append the versions to
+     */
+    void get_spill_candidates(std::vector<pos_ckpt_spill_candidate_t>& candidates) override;
+
+
+    /*!
+     *  \brief  spill the host-side slot of the given version out of memory, for the spill tier
+     *  \param  version the version to spill
+     *  \return POS_SUCCESS for successfully spilled;
+     *          POS_FAILED_NOT_EXIST for the slot doesn't exist, is spilled or is accessed;
+     *          POS_FAILED for failed to write the spill tier
+     */
+    pos_retval_t spill_version(uint64_t version) override;
+
+
+    /*!
+     *  \brief  release the cached host-side slots of the device state, for the spill tier
+     *  \return size of the released memory
+     */
+    uint64_t trim_cached() override;
+
+
     // waitlist of the host-side checkpoint record, populated during restore phrase
     std::vector<std::tuple<
         /* wqe_id */ pos_u64id_t, /* param_id */ uint32_t, /* offset */ uint64_t, /* size */ uint64_t>
@@ -312,11 +524,11 @@ class POSCheckpointBag {
     std::unordered_map<uint64_t, POSCheckpointSlot*> _dev_state_host_slot_map;
 
     /*!
-     *  \brief  map of version to cached host-side checkpoint slot for device state 
-     *  \note   we store thost cached version so that we can reuse their memory
+     *  \brief  cached host-side checkpoint slots for device state 
+     *  \note   we store those cached slots so that we can reuse their memory
      *          space in the next time we apply for a new checkpoint slot
      */
-    std::unordered_map<uint64_t, POSCheckpointSlot*> _cached_dev_state_host_slot_map;
+    POSSizeClassFreeList<POSCheckpointSlot> _cached_dev_state_host_slots;
 
     /*!
      *  \brief  map of version to device-side checkpoint slot for device state 
@@ -324,11 +536,11 @@ class POSCheckpointBag {
     std::unordered_map<uint64_t, POSCheckpointSlot*> _dev_state_dev_slot_map;
 
     /*!
-     *  \brief  map of version to cached device-side checkpoint slot for device state
-     *  \note   we store thost cached version so that we can reuse their memory
+     *  \brief  cached device-side checkpoint slots for device state
+     *  \note   we store those cached slots so that we can reuse their memory
      *          space in the next time we apply for a new checkpoint slot
      */
-    std::unordered_map<uint64_t, POSCheckpointSlot*> _cached_dev_state_dev_slot_map;
+    POSSizeClassFreeList<POSCheckpointSlot> _cached_dev_state_dev_slots;
 
     /*!
      *  \brief  map of version to host-side checkpoint slot for host state 
@@ -336,11 +548,11 @@ class POSCheckpointBag {
     std::unordered_map<uint64_t, POSCheckpointSlot*> _host_state_host_slot_map;
 
     /*!
-     *  \brief  map of version to cached host-side checkpoint slot for host state
-     *  \note   we store thost cached version so that we can reuse their memory
+     *  \brief  cached host-side checkpoint slots for host state
+     *  \note   we store those cached slots so that we can reuse their memory
      *          space in the next time we apply for a new checkpoint slot
      */
-    std::unordered_map<uint64_t, POSCheckpointSlot*> _cached_host_state_host_slot_map;
+    POSSizeClassFreeList<POSCheckpointSlot> _cached_host_state_host_slots;
 
     // all versions of host-side checkpoint slots that store device state
     std::set<uint64_t> _dev_state_host_slot_version_set;
@@ -366,4 +578,27 @@ class POSCheckpointBag {
      *  \brief  list of host-side checkpoint
      */
     std::unordered_map<uint64_t, pos_host_ckpt_t> _host_ckpt_map;
+
+    /*!
+     *  \brief  load the state of a spilled host-side slot back into memory
+     *  \note   should be called without _mutex held, and with the slot pinned (nb_pins) so that it's
+     *          neither reclaimed nor spilled again during the read; if the load fails, the slot stays
+     *          spilled (with its state kept in the spill tier) and isn't handed out
+     *  \param  ckpt_slot   the spilled slot
+     *  \return POS_SUCCESS for successfully loaded (or loaded by another caller meanwhile)
+     */
+    pos_retval_t __load_spilled(POSCheckpointSlot* ckpt_slot);
+
+    /*!
+     *  \brief  delete a host-side slot of the device state, and release its memory or spilled state
+     *  \note   should be called with _mutex held
+     *  \param  ckpt_slot   the slot
+     */
+    void __delete_dev_state_host_slot(POSCheckpointSlot* ckpt_slot);
+
+    // protects slots against the retention engine and the spill tier
+    std::mutex _mutex;
+
+    // serializes loading spilled slots, so that the spill file is read outside _mutex
+    std::mutex _load_mutex;
 };
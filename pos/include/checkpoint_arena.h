@@ -0,0 +1,280 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+/*!
+ *  \brief  mode of the checkpoint arena
+ */
+enum pos_ckpt_arena_mode_t : uint8_t {
+    // plain host memory, usable without any XPU
+    kPOS_CkptArenaMode_Host = 0,
+    // host memory pinned via the registered pin function (e.g., cudaHostRegister)
+    kPOS_CkptArenaMode_Pinned
+};
+
+
+using pos_ckpt_arena_pin_func_t = pos_retval_t(*)(void* ptr, uint64_t size);
+using pos_ckpt_arena_unpin_func_t = pos_retval_t(*)(void* ptr);
+
+
+/*!
+ *  \brief  client index used by threads that don't belong to any client
+ */
+constexpr pos_client_uuid_t kPOS_CkptArena_NoClient = UINT64_MAX;
+
+
+/*!
+ *  \brief  allocation statistics of the checkpoint arena (or of a client inside it)
+ */
+typedef struct pos_ckpt_arena_stat {
+    // overall size of memory mapped from OS
+    uint64_t reserved_size;
+
+    // overall size of memory that has been handed out
+    uint64_t allocated_size;
+
+    // upper bound of allocated_size, 0 for unlimited
+    uint64_t quota;
+
+    // number of chunks mapped from OS, and how many of them are backed by hugepages
+    uint64_t nb_chunks;
+    uint64_t nb_hugepage_chunks;
+
+    // number of allocation / deallocation
+    uint64_t nb_alloc;
+    uint64_t nb_free;
+
+    // number of allocation served by previously freed blocks
+    uint64_t nb_reuse;
+
+    // number of allocation rejected due to quota / OOM
+    uint64_t nb_rejected;
+
+    pos_ckpt_arena_stat()
+        :   reserved_size(0), allocated_size(0), quota(0), nb_chunks(0), nb_hugepage_chunks(0),
+            nb_alloc(0), nb_free(0), nb_reuse(0), nb_rejected(0) {}
+} pos_ckpt_arena_stat_t;
+
+
+/*!
+ *  \brief  process-wide slab arena for host-side checkpoint memory
+ *  \note   memory is mapped from OS in large pre-faulted (and hugepage-backed if possible) chunks,
+ *          and handed out in size-classed blocks that are recycled after being freed, so that
+ *          checkpoint rounds don't pay for allocation and first-touch page faults
+ *  \note   blocks larger than a quarter of the chunk are mapped dedicatedly, and cached after freed
+ *  \note   size-classed blocks are carved from chunks and kept on free lists after freed, chunks are never
+ *          returned to OS until the process exits, so the footprint of small blocks is bounded by their peak
+ *  \note   all methods are thread-safe
+ */
+class POSCheckpointArena {
+ public:
+    /*!
+     *  \brief  obtain the process-wide arena
+     *  \return pointer to the arena
+     */
+    static POSCheckpointArena* get_instance();
+
+
+    /*!
+     *  \brief  initialize the arena, should be called before any allocation; otherwise the arena
+     *          will be lazily initialized under host mode with default parameters
+     *  \param  mode                mode of the arena
+     *  \param  chunk_size          size of each chunk mapped from OS
+     *  \param  nb_prefill_chunks   number of chunks to be mapped and pre-faulted during initialization
+     *  \param  pin_func            function to pin memory, must be provided under pinned mode
+     *  \param  unpin_func          function to unpin memory, must be provided under pinned mode
+     *  \return POS_SUCCESS for successfully initialization;
+     *          POS_FAILED_ALREADY_EXIST for the arena has already been initialized;
+     *          POS_FAILED_INVALID_INPUT for invalid parameters
+     */
+    pos_retval_t init(
+        pos_ckpt_arena_mode_t mode,
+        uint64_t chunk_size = kDefaultChunkSize,
+        uint64_t nb_prefill_chunks = 0,
+        pos_ckpt_arena_pin_func_t pin_func = nullptr,
+        pos_ckpt_arena_unpin_func_t unpin_func = nullptr
+    );
+
+
+    /*!
+     *  \brief  allocate a memory block from the arena
+     *  \note   the block is accounted to the client bound to the calling thread
+     *  \param  size    size of the block
+     *  \return pointer to the block, nullptr for exceeding the quota or OOM
+     */
+    void* alloc(uint64_t size);
+
+
+    /*!
+     *  \brief  return a memory block to the arena
+     *  \param  ptr pointer to the block
+     */
+    void free(void* ptr);
+
+
+    /*!
+     *  \brief  bind the calling thread to a client, following allocations from this
+     *          thread will be accounted to the client
+     *  \param  client_id   index of the client
+     */
+    static void set_thread_client(pos_client_uuid_t client_id);
+
+
+    /*!
+     *  \brief  set the quota of a client
+     *  \note   the workspace applies kRuntimeCkptHostMemClientQuota to each client on its creation
+     *  \param  client_id   index of the client
+     *  \param  quota       maximum size of memory the client could allocate, 0 for unlimited
+     */
+    void set_client_quota(pos_client_uuid_t client_id, uint64_t quota);
+
+
+    /*!
+     *  \brief  obtain statistics of the whole arena
+     *  \param  stat    returned statistics
+     */
+    void get_stat(pos_ckpt_arena_stat_t& stat);
+
+
+    /*!
+     *  \brief  obtain statistics of a specific client
+     *  \param  client_id   index of the client
+     *  \param  stat        returned statistics
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_NOT_EXIST for no record of the client
+     */
+    pos_retval_t get_client_stat(pos_client_uuid_t client_id, pos_ckpt_arena_stat_t& stat);
+
+
+    /*!
+     *  \brief  release all cached (freed) dedicated mappings back to OS
+     *  \note   freed size-classed blocks aren't released, as they're carved from shared chunks
+     *  \return size of memory that has been released
+     */
+    uint64_t trim();
+
+
+    // default size of each chunk
+    static constexpr uint64_t kDefaultChunkSize = MB(256);
+
+    // size of hugepage
+    static constexpr uint64_t kHugepageSize = MB(2);
+
+ private:
+    POSCheckpointArena();
+    ~POSCheckpointArena();
+
+    /*!
+     *  \brief  metadata of an allocated block
+     */
+    typedef struct pos_ckpt_arena_block {
+        // size of the block, i.e., size of its class or of its dedicated mapping
+        uint64_t size;
+
+        // index of the size class, or kNbClasses for dedicated mapping
+        uint32_t class_id;
+
+        // owner of the block
+        pos_client_uuid_t client_id;
+    } pos_ckpt_arena_block_t;
+
+    /*!
+     *  \brief  metadata of a region mapped from OS
+     */
+    typedef struct pos_ckpt_arena_chunk {
+        // size of the region
+        uint64_t size;
+
+        // whether the region is backed by explicit hugepages
+        bool is_hugepage;
+    } pos_ckpt_arena_chunk_t;
+
+    /*!
+     *  \brief  map a region from OS, pre-fault it and pin it if needed
+     *  \note   should be called with _mutex held
+     *  \param  size    size of the region, should be aligned to hugepage
+     *  \return pointer to the region, nullptr for failed
+     */
+    void* __map_region(uint64_t size);
+
+    /*!
+     *  \brief  unmap a region that was mapped by __map_region
+     *  \note   should be called with _mutex held
+     *  \param  ptr     pointer to the region
+     *  \param  size    size of the region
+     */
+    void __unmap_region(void* ptr, uint64_t size);
+
+    /*!
+     *  \brief  carve a block with given size from chunks
+     *  \note   should be called with _mutex held
+     *  \param  size    size of the block
+     *  \return pointer to the block, nullptr for failed
+     */
+    void* __carve(uint64_t size);
+
+    /*!
+     *  \brief  initialize the arena with default parameters if not yet initialized
+     *  \note   should be called with _mutex held
+     */
+    pos_retval_t __lazy_init();
+
+    // whether the arena has been initialized
+    bool _is_init;
+
+    // mode of this arena
+    pos_ckpt_arena_mode_t _mode;
+
+    // pin / unpin functions under pinned mode
+    pos_ckpt_arena_pin_func_t _pin_func;
+    pos_ckpt_arena_unpin_func_t _unpin_func;
+
+    // size of each chunk
+    uint64_t _chunk_size;
+
+    // all mapped regions
+    std::map<void*, pos_ckpt_arena_chunk_t> _chunks;
+
+    // bump pointer within the latest chunk
+    uint8_t *_cur_chunk_ptr;
+    uint64_t _cur_chunk_left;
+
+    // freed blocks of each size class
+    std::vector<std::vector<void*>> _free_blocks;
+
+    // freed dedicated mappings: size -> base address
+    std::multimap<uint64_t, void*> _free_large_blocks;
+
+    // metadata of all allocated blocks
+    std::unordered_map<void*, pos_ckpt_arena_block_t> _blocks;
+
+    // statistics of the whole arena and of each client
+    pos_ckpt_arena_stat_t _stat;
+    std::unordered_map<pos_client_uuid_t, pos_ckpt_arena_stat_t> _client_stats;
+
+    std::mutex _mutex;
+};
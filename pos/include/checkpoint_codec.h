@@ -0,0 +1,131 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+/*!
+ *  \brief  codec to compress frames of persisted state
+ */
+enum pos_ckpt_codec_t : uint32_t {
+    // stored as is
+    kPOS_CkptCodec_None = 0,
+    kPOS_CkptCodec_LZ4,
+    kPOS_CkptCodec_Zstd,
+    kPOS_CkptCodec_Unknown
+};
+
+
+/*!
+ *  \brief  process-wide compressor / decompressor of checkpoint frames
+ *  \note   LZ4 and zstd are loaded at runtime from their shared libraries, so that compression stays
+ *          optional: a codec whose library is missing is reported as unavailable, and the image writer
+ *          stores the frames as is
+ *  \note   each frame is compressed independently (LZ4 block / zstd single frame), so that frames
+ *          could be compressed and decompressed by different threads; all methods are thread-safe
+ */
+class POSCheckpointCodec {
+ public:
+    /*!
+     *  \brief  obtain the process-wide codec, libraries are loaded on the first call
+     *  \return pointer to the codec
+     */
+    static POSCheckpointCodec* get_instance();
+
+
+    /*!
+     *  \brief  check whether the given codec is usable
+     *  \param  codec   the codec
+     *  \return true for usable
+     */
+    bool is_available(pos_ckpt_codec_t codec);
+
+
+    /*!
+     *  \brief  obtain the maximum compressed size of a frame
+     *  \param  codec   the codec
+     *  \param  size    size of the frame
+     *  \return maximum compressed size
+     */
+    uint64_t get_bound(pos_ckpt_codec_t codec, uint64_t size);
+
+
+    /*!
+     *  \brief  compress a frame
+     *  \param  codec           the codec
+     *  \param  src             pointer to the frame
+     *  \param  src_size        size of the frame
+     *  \param  dst             buffer to compress into
+     *  \param  dst_capacity    size of the buffer, should be at least get_bound(codec, src_size)
+     *  \param  dst_size        returned compressed size
+     *  \return POS_SUCCESS for successfully compressed;
+     *          POS_FAILED_NOT_ENABLED for unavailable codec;
+     *          POS_FAILED for failed to compress
+     */
+    pos_retval_t compress(
+        pos_ckpt_codec_t codec, const void* src, uint64_t src_size, void* dst, uint64_t dst_capacity, uint64_t* dst_size
+    );
+
+
+    /*!
+     *  \brief  decompress a frame
+     *  \param  codec       the codec
+     *  \param  src         pointer to the compressed frame
+     *  \param  src_size    size of the compressed frame
+     *  \param  dst         buffer to decompress into
+     *  \param  dst_size    size of the decompressed frame
+     *  \return POS_SUCCESS for successfully decompressed;
+     *          POS_FAILED_NOT_ENABLED for unavailable codec;
+     *          POS_FAILED_INVALID_INPUT for corrupted frame or mismatched size
+     */
+    pos_retval_t decompress(pos_ckpt_codec_t codec, const void* src, uint64_t src_size, void* dst, uint64_t dst_size);
+
+
+    /*!
+     *  \brief  convert between the codec and its name ("none", "lz4", "zstd")
+     */
+    static const char* get_name(pos_ckpt_codec_t codec);
+    static pos_ckpt_codec_t parse(const std::string& name);
+
+
+    // compression level of zstd, low levels keep up with the storage
+    static inline int zstd_level = 1;
+
+ private:
+    POSCheckpointCodec();
+    ~POSCheckpointCodec();
+
+    // handles of the loaded libraries, nullptr for unavailable
+    void *_lz4_lib;
+    void *_zstd_lib;
+
+    // LZ4 block API
+    int (*_lz4_compress_bound)(int);
+    int (*_lz4_compress_default)(const char*, char*, int, int);
+    int (*_lz4_decompress_safe)(const char*, char*, int, int);
+
+    // zstd simple API
+    size_t (*_zstd_compress_bound)(size_t);
+    size_t (*_zstd_compress)(void*, size_t, const void*, size_t, int);
+    size_t (*_zstd_decompress)(void*, size_t, const void*, size_t);
+    unsigned (*_zstd_is_error)(size_t);
+};
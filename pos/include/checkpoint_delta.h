@@ -0,0 +1,534 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint.h"
+
+
+/*!
+ *  \brief  run of consecutive chunks inside a delta checkpoint
+ */
+typedef struct pos_ckpt_delta_run {
+    uint64_t first_chunk;
+    uint64_t nb_chunks;
+} __attribute__((packed)) pos_ckpt_delta_run_t;
+
+
+/*!
+ *  \brief  leading header of the metadata of a delta checkpoint record
+ *  \note   the metadata is [header][run 0]...[run n-1], and the raw section of the record stores
+ *          the chunks of all runs back to back, the last chunk of the state might be partial
+ */
+typedef struct pos_ckpt_delta_header {
+    // position of the delta inside its chain, starts from 1 (0 is the base)
+    uint64_t seq;
+
+    // chunk size and state size that the runs are described in
+    uint64_t chunk_size;
+    uint64_t state_size;
+
+    // number of runs follow the header
+    uint64_t nb_runs;
+} __attribute__((packed)) pos_ckpt_delta_header_t;
+
+
+/*!
+ *  \brief  one checkpoint inside a delta chain, either the full base or a delta on top of it
+ */
+typedef struct pos_ckpt_delta_link {
+    // version of the checkpoint
+    uint64_t version;
+
+    // slot that stores the full state (base), or the dirty chunks packed back to back (delta)
+    POSCheckpointSlot *slot;
+
+    // runs of chunks stored in the slot, empty for base
+    std::vector<pos_ckpt_delta_run_t> runs;
+
+    inline bool is_base() const { return this->runs.empty(); }
+} pos_ckpt_delta_link_t;
+
+
+/*!
+ *  \brief  a serialized delta (e.g., mmapped from the checkpoint image) to be applied during restore
+ */
+typedef struct pos_ckpt_delta_section {
+    const void *meta;
+    uint64_t meta_size;
+    const void *section;
+    uint64_t section_size;
+} pos_ckpt_delta_section_t;
+
+
+/*!
+ *  \brief  statistics of delta chains
+ */
+typedef struct pos_ckpt_delta_stat {
+    // number of commits that produce a base / a delta / nothing (no chunk modified)
+    uint64_t nb_bases;
+    uint64_t nb_deltas;
+    uint64_t nb_skipped;
+
+    // bytes a full checkpoint would copy, and bytes actually copied, over all commits
+    uint64_t nb_full_bytes;
+    uint64_t nb_copied_bytes;
+
+    pos_ckpt_delta_stat() : nb_bases(0), nb_deltas(0), nb_skipped(0), nb_full_bytes(0), nb_copied_bytes(0) {}
+
+    inline pos_ckpt_delta_stat& operator+=(const pos_ckpt_delta_stat& other){
+        nb_bases += other.nb_bases;
+        nb_deltas += other.nb_deltas;
+        nb_skipped += other.nb_skipped;
+        nb_full_bytes += other.nb_full_bytes;
+        nb_copied_bytes += other.nb_copied_bytes;
+        return *this;
+    }
+
+    inline uint64_t get_saved_bytes() const { return nb_full_bytes - nb_copied_bytes; }
+} pos_ckpt_delta_stat_t;
+
+
+/*!
+ *  \brief  incremental checkpoint of a state with chunk-granular dirty tracking (e.g., device memory)
+ *  \note   writes to the state are recorded as modified ranges in chunks; a commit copies only the
+ *          chunks modified since the previous commit into a new versioned slot (delta), on top of a
+ *          full copy (base); a new base is taken periodically, or when most chunks are modified, so
+ *          that the chain restored by applying the base and then deltas in order stays short
+ *  \note   not thread-safe, modified ranges should be recorded by the thread that commits (i.e., the
+ *          worker thread, after the API that writes the state is executed)
+ *  \note   slots of the chain live outside the checkpoint bag: their memory counts against the budget of
+ *          the spill tier but is never spilled, and the retention engine doesn't reclaim them, the chain
+ *          is bounded by the base interval instead
+ */
+class POSCheckpointDeltaChain {
+ public:
+    /*!
+     *  \brief  constructor
+     *  \param  state_size      size of the state
+     *  \param  allocator       allocator of the memory of checkpoint slots
+     *  \param  deallocator     deallocator of the memory of checkpoint slots
+     *  \param  chunk_size      granularity of dirty tracking, 0 for the default one
+     *  \param  base_interval   maximum number of deltas on top of a base, 0 for the default one
+     */
+    POSCheckpointDeltaChain(
+        uint64_t state_size,
+        pos_custom_ckpt_allocate_func_t allocator,
+        pos_custom_ckpt_deallocate_func_t deallocator,
+        uint64_t chunk_size = 0,
+        uint64_t base_interval = 0
+    ) : _state_size(state_size),
+        _chunk_size(chunk_size > 0 ? chunk_size : POSCheckpointDeltaChain::default_chunk_size),
+        _base_interval(base_interval > 0 ? base_interval : POSCheckpointDeltaChain::default_base_interval),
+        _allocate_func(allocator),
+        _deallocate_func(deallocator),
+        _last_commit_size(0)
+    {
+        POS_ASSERT(state_size > 0);
+        POS_ASSERT(this->_chunk_size > 0);
+        this->_nb_chunks = (state_size + this->_chunk_size - 1) / this->_chunk_size;
+        this->_modified.resize((this->_nb_chunks + 63) / 64, 0);
+    }
+
+    ~POSCheckpointDeltaChain(){ this->__drop_links(/* keep_base_slot */ false); }
+
+
+    /*!
+     *  \brief  record a modified range of the state
+     *  \param  offset  offset of the range from the start of the state
+     *  \param  size    size of the range, 0 for till the end of the state
+     */
+    inline void record_modified_range(uint64_t offset, uint64_t size){
+        uint64_t first, last;
+
+        if(unlikely(offset >= this->_state_size)){ return; }
+        if(size == 0 || size > this->_state_size - offset){ size = this->_state_size - offset; }
+
+        first = offset / this->_chunk_size;
+        last = (offset + size - 1) / this->_chunk_size;
+        this->__set_range(first, last - first + 1);
+    }
+
+
+    /*!
+     *  \brief  record the whole state as modified
+     */
+    inline void record_modified_all(){ this->__set_range(0, this->_nb_chunks); }
+
+
+    /*!
+     *  \brief  obtain the number of chunks modified since the previous commit
+     */
+    inline uint64_t get_nb_modified_chunks() const {
+        uint64_t nb = 0;
+        for(const uint64_t &word : this->_modified){ nb += __builtin_popcountl(word); }
+        return nb;
+    }
+
+
+    /*!
+     *  \brief  commit the state as a new link of the chain
+     *  \note   the commit is a base if there's no base yet, if the chain reaches the base interval, or if
+     *          no less than kBaseModifiedPercent of chunks are modified; otherwise it's a delta of the
+     *          modified chunks, or nothing if no chunk is modified
+     *  \note   copies might be asynchronous (e.g., cudaMemcpyAsync), the caller should wait for them
+     *          before using the slot; if the commit fails, modified chunks are kept for the next commit
+     *  \param  version     version of the checkpoint
+     *  \param  copy        function to copy a range of the state into the slot, in the form of
+     *                      pos_retval_t(void* dst, uint64_t offset, uint64_t size)
+     *  \param  link        returned new link, nullptr if nothing is committed; could be nullptr
+     *  \return POS_SUCCESS for successfully committed;
+     *          POS_FAILED_OOM for failed to allocate the slot;
+     *          other for failed to copy
+     */
+    template<typename F>
+    pos_retval_t commit(uint64_t version, F&& copy, const pos_ckpt_delta_link_t** link = nullptr){
+        pos_retval_t retval = POS_SUCCESS;
+        uint64_t i, nb_modified, packed_size = 0, offset, size;
+        std::vector<pos_ckpt_delta_run_t> runs;
+        POSCheckpointSlot *slot = nullptr;
+        uint8_t *dst;
+
+        if(link != nullptr){ *link = nullptr; }
+        this->_last_commit_size = 0;
+        this->_stat.nb_full_bytes += this->_state_size;
+
+        nb_modified = this->get_nb_modified_chunks();
+        if(this->_links.size() > 0 && nb_modified == 0){
+            this->_stat.nb_skipped += 1;
+            goto exit;
+        }
+
+        // case: base, reuse the slot of the previous base as the whole chain is replaced
+        if(     this->_links.size() == 0
+            ||  this->_links.size() > this->_base_interval
+            ||  nb_modified * 100 >= this->_nb_chunks * kBaseModifiedPercent
+        ){
+            slot = this->__drop_links(/* keep_base_slot */ true);
+            if(slot == nullptr && unlikely(nullptr == (slot = this->__allocate_slot(this->_state_size)))){
+                this->record_modified_all();
+                retval = POS_FAILED_OOM;
+                goto exit;
+            }
+
+            if(unlikely(POS_SUCCESS != (retval = copy(slot->expose_pointer(), 0, this->_state_size)))){
+                // the previous base might be partially overwritten, the next commit should be a base
+                this->__deallocate_slot(slot);
+                this->record_modified_all();
+                goto exit;
+            }
+
+            this->__clear_modified();
+            this->_links.push_back({ version, slot, {} });
+            this->_last_commit_size = this->_state_size;
+            this->_stat.nb_bases += 1;
+            goto committed;
+        }
+
+        // case: delta of modified chunks
+        this->__collect_runs(runs);
+        for(i=0; i<runs.size(); i++){ packed_size += this->__get_run_size(runs[i]); }
+
+        if(unlikely(nullptr == (slot = this->__allocate_slot(packed_size)))){
+            retval = POS_FAILED_OOM;
+            goto exit;
+        }
+
+        dst = reinterpret_cast<uint8_t*>(slot->expose_pointer());
+        for(i=0; i<runs.size(); i++){
+            offset = runs[i].first_chunk * this->_chunk_size;
+            size = this->__get_run_size(runs[i]);
+            if(unlikely(POS_SUCCESS != (retval = copy(dst, offset, size)))){
+                this->__deallocate_slot(slot);
+                goto exit;
+            }
+            dst += size;
+        }
+
+        this->__clear_modified();
+        this->_links.push_back({ version, slot, std::move(runs) });
+        this->_last_commit_size = packed_size;
+        this->_stat.nb_deltas += 1;
+
+    committed:
+        this->_stat.nb_copied_bytes += this->_last_commit_size;
+        if(link != nullptr){ *link = &(this->_links.back()); }
+
+    exit:
+        return retval;
+    }
+
+
+    /*!
+     *  \brief  obtain all links of the chain, the base comes first
+     */
+    inline const std::vector<pos_ckpt_delta_link_t>& get_links() const { return this->_links; }
+
+
+    /*!
+     *  \brief  serialize the metadata of a delta link, to be stored along with its slot
+     *  \param  link    the delta link
+     *  \param  seq     position of the link inside the chain
+     *  \param  meta    the returned metadata
+     */
+    inline void serialize_delta_meta(const pos_ckpt_delta_link_t& link, uint64_t seq, std::string& meta) const {
+        pos_ckpt_delta_header_t header;
+
+        POS_ASSERT(!link.is_base());
+
+        header.seq = seq;
+        header.chunk_size = this->_chunk_size;
+        header.state_size = this->_state_size;
+        header.nb_runs = link.runs.size();
+
+        meta.resize(sizeof(pos_ckpt_delta_header_t) + link.runs.size() * sizeof(pos_ckpt_delta_run_t));
+        memcpy(meta.data(), &header, sizeof(pos_ckpt_delta_header_t));
+        memcpy(
+            meta.data() + sizeof(pos_ckpt_delta_header_t), link.runs.data(), link.runs.size() * sizeof(pos_ckpt_delta_run_t)
+        );
+    }
+
+
+    /*!
+     *  \brief  apply a serialized delta on top of the restored state
+     *  \param  meta            metadata of the delta
+     *  \param  meta_size       size of the metadata
+     *  \param  section         chunks of the delta
+     *  \param  section_size    size of the chunks
+     *  \param  write           function to write a range of the state, in the form of
+     *                          pos_retval_t(const void* src, uint64_t offset, uint64_t size)
+     *  \param  seq             returned position of the delta inside its chain, could be nullptr
+     *  \return POS_SUCCESS for successfully applied;
+     *          POS_FAILED_INVALID_INPUT for corrupted delta;
+     *          other for failed to write
+     */
+    template<typename F>
+    static pos_retval_t apply_delta(
+        const void* meta, uint64_t meta_size, const void* section, uint64_t section_size, F&& write,
+        uint64_t* seq = nullptr
+    ){
+        pos_retval_t retval = POS_SUCCESS;
+        const pos_ckpt_delta_header_t *header;
+        const pos_ckpt_delta_run_t *runs;
+        const uint8_t *src;
+        uint64_t i, offset, size, consumed = 0;
+
+        POS_CHECK_POINTER(meta);
+
+        if(unlikely(meta_size < sizeof(pos_ckpt_delta_header_t))){
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        header = reinterpret_cast<const pos_ckpt_delta_header_t*>(meta);
+        if(unlikely(
+                header->chunk_size == 0
+            ||  meta_size != sizeof(pos_ckpt_delta_header_t) + header->nb_runs * sizeof(pos_ckpt_delta_run_t)
+        )){
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        if(seq != nullptr){ *seq = header->seq; }
+
+        runs = reinterpret_cast<const pos_ckpt_delta_run_t*>(
+            reinterpret_cast<const uint8_t*>(meta) + sizeof(pos_ckpt_delta_header_t)
+        );
+        src = reinterpret_cast<const uint8_t*>(section);
+        for(i=0; i<header->nb_runs; i++){
+            offset = runs[i].first_chunk * header->chunk_size;
+            if(unlikely(runs[i].nb_chunks == 0 || offset >= header->state_size)){
+                retval = POS_FAILED_INVALID_INPUT;
+                goto exit;
+            }
+            size = std::min(runs[i].nb_chunks * header->chunk_size, header->state_size - offset);
+            if(unlikely(src == nullptr || consumed + size > section_size)){
+                retval = POS_FAILED_INVALID_INPUT;
+                goto exit;
+            }
+            if(unlikely(POS_SUCCESS != (retval = write(src + consumed, offset, size)))){ goto exit; }
+            consumed += size;
+        }
+        if(unlikely(consumed != section_size)){ retval = POS_FAILED_INVALID_INPUT; }
+
+    exit:
+        return retval;
+    }
+
+
+    /*!
+     *  \brief  obtain the seq of a serialized delta without applying it
+     *  \param  meta        metadata of the delta
+     *  \param  meta_size   size of the metadata
+     *  \return the seq, 0 for corrupted delta
+     */
+    static inline uint64_t get_delta_seq(const void* meta, uint64_t meta_size){
+        if(meta == nullptr || meta_size < sizeof(pos_ckpt_delta_header_t)){ return 0; }
+        return reinterpret_cast<const pos_ckpt_delta_header_t*>(meta)->seq;
+    }
+
+
+    /*!
+     *  \brief  obtain the number of bytes copied by the latest commit
+     */
+    inline uint64_t get_last_commit_size() const { return this->_last_commit_size; }
+
+
+    /*!
+     *  \brief  obtain the statistics of this chain
+     */
+    inline const pos_ckpt_delta_stat_t& get_stat() const { return this->_stat; }
+
+
+    inline uint64_t get_chunk_size() const { return this->_chunk_size; }
+    inline uint64_t get_state_size() const { return this->_state_size; }
+
+
+    // default granularity of dirty tracking, and maximum number of deltas on top of a base,
+    // shared by chains created afterwards, set via the workspace configuration
+    static inline uint64_t default_chunk_size = KB(64);
+    static inline uint64_t default_base_interval = 8;
+
+    // percentage of modified chunks from which a commit takes a new base instead of a delta
+    static constexpr uint64_t kBaseModifiedPercent = 50;
+
+
+ private:
+    /*!
+     *  \brief  size of the state covered by a run, the last chunk of the state might be partial
+     */
+    inline uint64_t __get_run_size(const pos_ckpt_delta_run_t& run) const {
+        return std::min(run.nb_chunks * this->_chunk_size, this->_state_size - run.first_chunk * this->_chunk_size);
+    }
+
+    /*!
+     *  \brief  mark a range of chunks as modified
+     */
+    inline void __set_range(uint64_t first, uint64_t nb){
+        uint64_t i = first, end = first + nb, bits;
+
+        while(i < end){
+            bits = std::min(end - i, 64 - (i % 64));
+            this->_modified[i / 64] |= (bits == 64 ? ~0ul : ((1ul << bits) - 1)) << (i % 64);
+            i += bits;
+        }
+    }
+
+    inline void __clear_modified(){ std::fill(this->_modified.begin(), this->_modified.end(), 0); }
+
+    /*!
+     *  \brief  collect runs of modified chunks in ascending order
+     */
+    inline void __collect_runs(std::vector<pos_ckpt_delta_run_t>& runs) const {
+        uint64_t w, bits, chunk;
+
+        for(w=0; w<this->_modified.size(); w++){
+            bits = this->_modified[w];
+            while(bits != 0){
+                chunk = w * 64 + __builtin_ctzl(bits);
+                bits &= bits - 1;
+                if(runs.size() > 0 && runs.back().first_chunk + runs.back().nb_chunks == chunk){
+                    runs.back().nb_chunks += 1;
+                } else {
+                    runs.push_back({ chunk, 1 });
+                }
+            }
+        }
+    }
+
+    /*!
+     *  \brief  allocate a host-side slot of the chain
+     *  \note   the memory is accounted to the spill tier, so that the budget of host checkpoint memory covers
+     *          the chain; slots of the chain are never spilled, as a dump needs the whole chain in memory
+     *  \param  size    size of the slot
+     *  \return the allocated slot, nullptr for failed to allocate
+     */
+    inline POSCheckpointSlot* __allocate_slot(uint64_t size){
+        POSCheckpointSlot *slot;
+
+        POS_CHECK_POINTER(slot = new POSCheckpointSlot(
+            size, this->_allocate_func, this->_deallocate_func, kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Device
+        ));
+        if(unlikely(slot->expose_pointer() == nullptr)){
+            delete slot;
+            return nullptr;
+        }
+        POSCheckpointSpill::get_instance()->on_allocated(slot->get_capacity());
+
+        return slot;
+    }
+
+    /*!
+     *  \brief  release a host-side slot of the chain
+     *  \param  slot    the slot to release
+     */
+    inline void __deallocate_slot(POSCheckpointSlot* slot){
+        POSCheckpointSpill::get_instance()->on_released(slot->get_capacity());
+        delete slot;
+    }
+
+    /*!
+     *  \brief  release all links of the chain
+     *  \param  keep_base_slot  whether to keep the slot of the base for reuse
+     *  \return the kept slot of the base, nullptr for not kept or no base
+     */
+    inline POSCheckpointSlot* __drop_links(bool keep_base_slot){
+        POSCheckpointSlot *base_slot = nullptr;
+        uint64_t i;
+
+        for(i=0; i<this->_links.size(); i++){
+            if(i == 0 && keep_base_slot){
+                base_slot = this->_links[i].slot;
+                continue;
+            }
+            this->__deallocate_slot(this->_links[i].slot);
+        }
+        this->_links.clear();
+
+        return base_slot;
+    }
+
+    // size of the state, and the granularity of dirty tracking
+    uint64_t _state_size;
+    uint64_t _chunk_size;
+    uint64_t _nb_chunks;
+
+    // maximum number of deltas on top of a base
+    uint64_t _base_interval;
+
+    // one bit per chunk, set if the chunk is modified since the previous commit
+    std::vector<uint64_t> _modified;
+
+    // the base and deltas on top of it
+    std::vector<pos_ckpt_delta_link_t> _links;
+
+    // allocator and deallocator of checkpoint slots
+    pos_custom_ckpt_allocate_func_t _allocate_func;
+    pos_custom_ckpt_deallocate_func_t _deallocate_func;
+
+    // bytes copied by the latest commit
+    uint64_t _last_commit_size;
+
+    pos_ckpt_delta_stat_t _stat;
+};
@@ -0,0 +1,795 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_io.h"
+#include "pos/include/checkpoint_storage.h"
+#include "pos/include/checkpoint_codec.h"
+#include "pos/include/utils/chunk_hash.h"
+#include "pos/include/utils/timer.h"
+
+
+/*!
+ *  \brief  name of the checkpoint image object inside the checkpoint directory (i.e., the storage location)
+ */
+#define POS_CKPT_IMAGE_FILE_NAME    "ckpt.img"
+
+
+/*!
+ *  \brief  type of records inside the checkpoint image
+ */
+enum pos_ckpt_image_record_type_t : uint32_t {
+    kPOS_CkptImageRecord_Client = 0,
+    kPOS_CkptImageRecord_Handle,
+    kPOS_CkptImageRecord_APIContext,
+
+    // delta of incremental checkpoint on top of the handle record, see POSCheckpointDeltaChain
+    kPOS_CkptImageRecord_HandleDelta,
+
+    // table of content-addressed chunks, see pos_ckpt_image_chunk_t
+    kPOS_CkptImageRecord_ChunkTable,
+
+    // segment of the API context log, i.e., a batch of framed API contexts, see POSAPIContextLogWriter
+    kPOS_CkptImageRecord_APIContextLog,
+
+    kPOS_CkptImageRecord_Unknown
+};
+
+
+/*!
+ *  \brief  index entry of a record inside the checkpoint image
+ */
+typedef struct pos_ckpt_image_entry {
+    // type of the record
+    pos_ckpt_image_record_type_t type;
+
+    // resource type index of the handle, 0 for other types of record
+    pos_resource_typeid_t resource_type_id;
+
+    // index of the handle / API context, 0 for client record
+    pos_u64id_t id;
+
+    // version of the record, e.g., the checkpointed version of the handle
+    uint64_t version;
+
+    // position of the record within the image
+    uint64_t offset;
+    uint64_t size;
+
+    // CRC32C of the record
+    uint32_t checksum;
+
+    // flags of the record, see pos_ckpt_image_entry_flag_t
+    uint32_t flags;
+} __attribute__((packed)) pos_ckpt_image_entry_t;
+
+
+/*!
+ *  \brief  flags of a record inside the checkpoint image
+ */
+enum pos_ckpt_image_entry_flag_t : uint32_t {
+    // the record consists of a small metadata part and an aligned raw section,
+    // see pos_ckpt_image_section_header_t
+    kPOS_CkptImageEntryFlag_RawSection = 0x1,
+
+    // the raw section is stored as references to content-addressed chunks,
+    // see pos_ckpt_image_chunked_header_t
+    kPOS_CkptImageEntryFlag_Chunked = 0x2,
+
+    // the raw section is stored as independently compressed frames,
+    // see pos_ckpt_image_compressed_header_t
+    kPOS_CkptImageEntryFlag_Compressed = 0x4
+};
+
+
+/*!
+ *  \brief  leading header of a record with raw section
+ *  \note   the layout of the record is: [header][metadata][zero padding][raw section], where the
+ *          raw section starts at an offset within the image that is aligned to
+ *          POSCheckpointImageWriter::kSectionAlignment, so that bulk state (e.g., device memory)
+ *          could be written straight from the checkpoint slot, and used in-place from the
+ *          mmapped image during restore, without passing through protobuf
+ */
+typedef struct pos_ckpt_image_section_header {
+    // size of the metadata, which follows the header immediately
+    uint64_t meta_size;
+
+    // position of the raw section, relative to the start of the record
+    uint64_t section_offset;
+
+    // size of the raw section
+    uint64_t section_size;
+} __attribute__((packed)) pos_ckpt_image_section_header_t;
+
+
+/*!
+ *  \brief  leading header of a chunked raw section
+ *  \note   the layout of the chunked raw section is: [header][hash of chunk 0]...[hash of chunk n-1],
+ *          the raw section is split into chunks of chunk_size, except the last one; all-zero chunks
+ *          are referred by the all-zero hash and not stored
+ */
+typedef struct pos_ckpt_image_chunked_header {
+    uint64_t chunk_size;
+
+    // size of the original raw section
+    uint64_t section_size;
+
+    uint64_t nb_chunks;
+} __attribute__((packed)) pos_ckpt_image_chunked_header_t;
+
+
+/*!
+ *  \brief  entry of the chunk table, locates a unique chunk within the image
+ *  \note   chunks are stored once per image no matter how many records refer to them, at
+ *          positions aligned to POSCheckpointImageWriter::kSectionAlignment
+ */
+typedef struct pos_ckpt_image_chunk {
+    pos_chunk_hash_t hash;
+    uint64_t offset;
+    uint64_t size;
+
+    // CRC32C of the chunk, records only cover the hashes of the chunks they refer to
+    uint32_t checksum;
+    uint32_t reserved;
+} __attribute__((packed)) pos_ckpt_image_chunk_t;
+
+
+/*!
+ *  \brief  deduplication statistics of a checkpoint image
+ */
+typedef struct pos_ckpt_image_dedup_stat {
+    // number of chunks referred by records, and how many of them are all-zero / stored
+    uint64_t nb_chunks;
+    uint64_t nb_zero_chunks;
+    uint64_t nb_unique_chunks;
+
+    // size of raw sections referred by records, and size of stored chunks
+    uint64_t nb_logical_bytes;
+    uint64_t nb_stored_bytes;
+
+    pos_ckpt_image_dedup_stat()
+        :   nb_chunks(0), nb_zero_chunks(0), nb_unique_chunks(0), nb_logical_bytes(0), nb_stored_bytes(0) {}
+
+    inline double get_dedup_ratio() const {
+        return nb_stored_bytes > 0 ? (double)nb_logical_bytes / (double)nb_stored_bytes : 0.0;
+    }
+} pos_ckpt_image_dedup_stat_t;
+
+
+/*!
+ *  \brief  checksum statistics of a checkpoint image writer
+ */
+typedef struct pos_ckpt_image_checksum_stat {
+    // size of checksummed data
+    uint64_t nb_bytes;
+
+    // time spent on calculating checksums, summed over all appending threads
+    uint64_t checksum_ns;
+
+    // time since the image was opened
+    uint64_t elapsed_ns;
+
+    pos_ckpt_image_checksum_stat() : nb_bytes(0), checksum_ns(0), elapsed_ns(0) {}
+
+    inline double get_overhead_percent() const {
+        return elapsed_ns > 0 ? (double)checksum_ns * 100.0 / (double)elapsed_ns : 0.0;
+    }
+} pos_ckpt_image_checksum_stat_t;
+
+
+/*!
+ *  \brief  statistics of verifying a checkpoint image
+ */
+typedef struct pos_ckpt_image_verify_stat {
+    // number of verified records, and how many of them are corrupted (including those refer to corrupted chunks)
+    uint64_t nb_records;
+    uint64_t nb_corrupted_records;
+
+    // number of verified content-addressed chunks, and how many of them are corrupted
+    uint64_t nb_chunks;
+    uint64_t nb_corrupted_chunks;
+
+    // size of verified data
+    uint64_t nb_bytes;
+
+    double duration_ms;
+
+    pos_ckpt_image_verify_stat()
+        :   nb_records(0), nb_corrupted_records(0), nb_chunks(0), nb_corrupted_chunks(0), nb_bytes(0),
+            duration_ms(0) {}
+} pos_ckpt_image_verify_stat_t;
+
+
+/*!
+ *  \brief  leading header of a compressed raw section
+ *  \note   the layout of the compressed raw section is: [header][frame 0]...[frame n-1][data of frames],
+ *          the raw section is split into frames of frame_size, except the last one, and each frame is
+ *          compressed on its own, so that frames could be decompressed in parallel
+ */
+typedef struct pos_ckpt_image_compressed_header {
+    uint64_t frame_size;
+
+    // size of the original raw section
+    uint64_t section_size;
+
+    uint64_t nb_frames;
+} __attribute__((packed)) pos_ckpt_image_compressed_header_t;
+
+
+/*!
+ *  \brief  boundary of a compressed frame
+ */
+typedef struct pos_ckpt_image_frame {
+    // position of the frame data, relative to the end of the frame table
+    uint64_t offset;
+
+    // size of the frame data
+    uint64_t size;
+
+    // codec of the frame, frames that don't shrink are stored as is (kPOS_CkptCodec_None)
+    pos_ckpt_codec_t codec;
+    uint32_t reserved;
+} __attribute__((packed)) pos_ckpt_image_frame_t;
+
+
+/*!
+ *  \brief  compression statistics of a checkpoint image
+ */
+typedef struct pos_ckpt_image_compress_stat {
+    // number of compressed frames, and how many of them are stored as is
+    uint64_t nb_frames;
+    uint64_t nb_raw_frames;
+
+    // size of compressed raw sections before / after compression
+    uint64_t nb_logical_bytes;
+    uint64_t nb_stored_bytes;
+
+    pos_ckpt_image_compress_stat()
+        :   nb_frames(0), nb_raw_frames(0), nb_logical_bytes(0), nb_stored_bytes(0) {}
+
+    inline double get_compress_ratio() const {
+        return nb_stored_bytes > 0 ? (double)nb_logical_bytes / (double)nb_stored_bytes : 0.0;
+    }
+} pos_ckpt_image_compress_stat_t;
+
+
+/*!
+ *  \brief  leading header of the checkpoint image
+ */
+typedef struct pos_ckpt_image_header {
+    uint64_t magic;
+    uint32_t format_version;
+    uint32_t reserved;
+} __attribute__((packed)) pos_ckpt_image_header_t;
+
+
+/*!
+ *  \brief  trailer of the checkpoint image, locates the index
+ *  \note   the layout of the image is: [header][record 0]...[record n-1][index][trailer]
+ */
+typedef struct pos_ckpt_image_trailer {
+    // position of the index within the image
+    uint64_t index_offset;
+
+    // number of entries inside the index
+    uint64_t nb_entries;
+
+    // CRC32C of the index
+    uint32_t index_checksum;
+    uint32_t format_version;
+
+    uint64_t magic;
+} __attribute__((packed)) pos_ckpt_image_trailer_t;
+
+
+/*!
+ *  \brief  append-only writer of the checkpoint image
+ *  \note   all records of a checkpoint (client, handles and unexecuted API contexts) are appended
+ *          to a single image file, instead of one file per record; writers are registered by the
+ *          checkpoint directory, so that persisting routines that only know the directory could
+ *          locate the writer
+ *  \note   append is thread-safe, concurrent appenders write to disjoint ranges of the file
+ *  \note   all writes go through the checkpoint I/O backend; raw sections are written with direct I/O
+ *          if it's enabled and the source buffer is aligned
+ *  \note   the checkpoint directory is the URI of a POSCheckpointStorage; the image is written in-place
+ *          for local and memory storages, otherwise it's staged in a memfd and uploaded in parts once sealed
+ */
+class POSCheckpointImageWriter {
+ public:
+    /*!
+     *  \brief  obtain the writer of the given checkpoint directory, create if not exist
+     *  \param  ckpt_dir    the checkpoint directory, i.e., URI of the storage
+     *  \return pointer to the writer, nullptr for invalid URI or failed to create the image file
+     */
+    static POSCheckpointImageWriter* open(const std::string& ckpt_dir);
+
+
+    /*!
+     *  \brief  finalize the image of the given checkpoint directory by writing the index,
+     *          then close and unregister the writer
+     *  \note   this function waits until all pending appends are finished
+     *  \param  ckpt_dir    the checkpoint directory
+     *  \return POS_SUCCESS for successfully sealed;
+     *          POS_FAILED_NOT_EXIST for no writer of the directory;
+     *          POS_FAILED for failed to write the index or to upload the image
+     */
+    static pos_retval_t seal(const std::string& ckpt_dir);
+
+
+    /*!
+     *  \brief  announce an append that will be issued later (e.g., by async persisting thread),
+     *          so that the sealing would wait for it
+     *  \note   every call should be paired with an append (or cancel_append)
+     */
+    void prepare_append();
+    void cancel_append();
+
+
+    /*!
+     *  \brief  append a record to the image
+     *  \param  type                type of the record
+     *  \param  resource_type_id    resource type index of the handle
+     *  \param  id                  index of the handle / API context
+     *  \param  version             version of the record
+     *  \param  data                pointer to the record
+     *  \param  size                size of the record
+     *  \param  is_prepared         whether this append has been announced by prepare_append
+     *  \return POS_SUCCESS for successfully appended;
+     *          POS_FAILED for failed to write the file
+     */
+    pos_retval_t append(
+        pos_ckpt_image_record_type_t type,
+        pos_resource_typeid_t resource_type_id,
+        pos_u64id_t id,
+        uint64_t version,
+        const void* data,
+        uint64_t size,
+        bool is_prepared = false
+    );
+
+
+    /*!
+     *  \brief  append a record with raw section to the image
+     *  \note   the raw section is written directly from the given buffer with vectored I/O,
+     *          without being copied into the record
+     *  \note   if a codec is configured for the resource type (see compress_codecs), the raw section is
+     *          compressed frame by frame instead, using the worker threads of POSPersistExecutor along
+     *          with the calling thread; compressed raw sections aren't deduplicated
+     *  \param  type                type of the record
+     *  \param  resource_type_id    resource type index of the handle
+     *  \param  id                  index of the handle / API context
+     *  \param  version             version of the record
+     *  \param  meta                pointer to the metadata of the record
+     *  \param  meta_size           size of the metadata
+     *  \param  section             pointer to the raw section
+     *  \param  section_size        size of the raw section
+     *  \param  is_prepared         whether this append has been announced by prepare_append
+     *  \return POS_SUCCESS for successfully appended;
+     *          POS_FAILED for failed to write the file
+     */
+    pos_retval_t append_section(
+        pos_ckpt_image_record_type_t type,
+        pos_resource_typeid_t resource_type_id,
+        pos_u64id_t id,
+        uint64_t version,
+        const void* meta,
+        uint64_t meta_size,
+        const void* section,
+        uint64_t section_size,
+        bool is_prepared = false
+    );
+
+
+    /*!
+     *  \brief  obtain the deduplication statistics of the image
+     */
+    pos_ckpt_image_dedup_stat_t get_dedup_stat();
+
+
+    /*!
+     *  \brief  obtain the compression statistics of the image
+     */
+    pos_ckpt_image_compress_stat_t get_compress_stat();
+
+
+    /*!
+     *  \brief  obtain the checksum statistics of the image
+     */
+    pos_ckpt_image_checksum_stat_t get_checksum_stat();
+
+
+    // alignment of each record within the image
+    static constexpr uint64_t kRecordAlignment = 64;
+
+    // alignment of raw sections within the image
+    static constexpr uint64_t kSectionAlignment = KB(4);
+
+    // size of content-addressed chunks that raw sections are split into, 0 for disabling deduplication;
+    // applies to images opened afterwards
+    static inline uint64_t dedup_chunk_size = 0;
+
+    // resource type index -> codec to compress raw sections of handles in the type, types not in the map
+    // aren't compressed; applies to images opened afterwards
+    static inline std::map<pos_resource_typeid_t, pos_ckpt_codec_t> compress_codecs;
+
+    // size of frames that raw sections are split into before compression
+    static inline uint64_t compress_frame_size = MB(1);
+
+    // maximum size of the staging buffer of compressed raw sections that a persisting thread keeps
+    // between appends, larger buffers are released once the record is written
+    static constexpr uint64_t kCompressStagingKeepSize = MB(64);
+
+ private:
+    POSCheckpointImageWriter()
+        :   _io(nullptr), _is_staged(false), _fd(-1), _direct_fd(-1), _offset(0), _nb_pending(0), _chunk_size(0),
+            _is_chunk_failed(false), _frame_size(0) {}
+    ~POSCheckpointImageWriter();
+
+    /*!
+     *  \brief  write the raw section of a record as content-addressed chunks
+     *  \note   chunks that are not stored in the image yet are written, the returned references
+     *          are written as the raw section of the record instead
+     *  \param  section         pointer to the raw section
+     *  \param  section_size    size of the raw section
+     *  \param  chunked         returned chunked raw section, see pos_ckpt_image_chunked_header_t
+     *  \return POS_SUCCESS for successfully written;
+     *          POS_FAILED for failed to write the file
+     */
+    pos_retval_t __write_chunks(const void* section, uint64_t section_size, std::vector<uint8_t>& chunked);
+
+    /*!
+     *  \brief  compress the raw section of a record frame by frame
+     *  \param  codec           codec of the frames
+     *  \param  section         pointer to the raw section
+     *  \param  section_size    size of the raw section
+     *  \param  compressed      buffer of the compressed raw section (see pos_ckpt_image_compressed_header_t),
+     *                          grown if it's too small but never shrunk
+     *  \param  compressed_size returned size of the compressed raw section
+     *  \return POS_SUCCESS for successfully compressed;
+     *          POS_FAILED for failed to compress
+     */
+    pos_retval_t __compress_frames(
+        pos_ckpt_codec_t codec, const void* section, uint64_t section_size,
+        std::vector<uint8_t>& compressed, uint64_t* compressed_size
+    );
+
+    /*!
+     *  \brief  reserve an aligned range of the image for a raw section
+     *  \note   should be called with _mutex held
+     *  \param  size    size of the range
+     *  \return position of the range
+     */
+    inline uint64_t __reserve_aligned(uint64_t size){
+        uint64_t pos = (this->_offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+        this->_offset = pos + size;
+        return pos;
+    }
+
+    /*!
+     *  \brief  create the image inside the storage and write the header
+     *  \param  storage the storage
+     *  \return POS_SUCCESS for successfully created
+     */
+    pos_retval_t __create(std::shared_ptr<POSCheckpointStorage> storage);
+
+    /*!
+     *  \brief  write the index and the trailer to the end of the image
+     *  \return POS_SUCCESS for successfully written
+     */
+    pos_retval_t __write_index();
+
+    // I/O backend to write the image
+    POSCheckpointIOBackend *_io;
+
+    // storage of the image, and whether the image is staged in a memfd and uploaded to the storage on sealing
+    std::shared_ptr<POSCheckpointStorage> _storage;
+    bool _is_staged;
+
+    // file descriptors of the image, the latter is opened with O_DIRECT, -1 for disabled
+    int _fd;
+    int _direct_fd;
+
+    // path to the image, or URI of the image for non-local storages
+    std::string _path;
+
+    // end of the appended area
+    uint64_t _offset;
+
+    // index of all appended records
+    std::vector<pos_ckpt_image_entry_t> _entries;
+
+    // number of announced but unfinished appends
+    uint64_t _nb_pending;
+
+    // size of content-addressed chunks of this image, 0 for disabled
+    uint64_t _chunk_size;
+
+    // stored chunks of this image: hash -> entry of the chunk table
+    std::unordered_map<pos_chunk_hash_t, pos_ckpt_image_chunk_t, pos_chunk_hash_hasher> _chunks;
+    pos_ckpt_image_dedup_stat_t _dedup_stat;
+
+    // whether any chunk failed to be written, the image won't be sealed as records might refer to it
+    bool _is_chunk_failed;
+
+    // codecs and size of frames of this image
+    std::map<pos_resource_typeid_t, pos_ckpt_codec_t> _codecs;
+    uint64_t _frame_size;
+    pos_ckpt_image_compress_stat_t _compress_stat;
+
+    // checksums are calculated inline by appenders, the time is accounted for the overhead
+    pos_ckpt_image_checksum_stat_t _checksum_stat;
+    POSUtilHpetTimer _open_timer;
+
+    std::mutex _mutex;
+    std::condition_variable _pending_cv;
+};
+
+
+/*!
+ *  \brief  reader of the checkpoint image
+ *  \note   the image is mmapped as a whole, records are accessed in-place through the index
+ *  \note   images of local and memory storages are mmapped in-place, otherwise the image is downloaded into
+ *          a memfd by concurrent range reads first
+ */
+class POSCheckpointImage {
+ public:
+    POSCheckpointImage()
+        :   _mapped(nullptr), _mapped_size(0), _entries(nullptr), _nb_entries(0), _fd(-1), _direct_fd(-1) {}
+    ~POSCheckpointImage();
+
+    /*!
+     *  \brief  open the image inside the given checkpoint directory
+     *  \param  ckpt_dir    the checkpoint directory, i.e., URI of the storage
+     *  \return POS_SUCCESS for successfully opened;
+     *          POS_FAILED_NOT_EXIST for no image exists;
+     *          POS_FAILED_INVALID_INPUT for invalid URI or corrupted image;
+     *          POS_FAILED for failed to download the image
+     */
+    pos_retval_t open(const std::string& ckpt_dir);
+
+
+    /*!
+     *  \brief  locate a record inside the image
+     *  \note   for duplicated records, the one with the largest version is returned
+     *  \param  type                type of the record
+     *  \param  resource_type_id    resource type index of the handle
+     *  \param  id                  index of the handle / API context
+     *  \return pointer to the index entry, nullptr for not found
+     */
+    const pos_ckpt_image_entry_t* find(
+        pos_ckpt_image_record_type_t type, pos_resource_typeid_t resource_type_id = 0, pos_u64id_t id = 0
+    );
+
+
+    /*!
+     *  \brief  obtain all delta records of a handle
+     *  \note   unlike other records, all deltas of a handle are kept, in the order they're appended
+     *  \param  resource_type_id    resource type index of the handle
+     *  \param  id                  index of the handle
+     *  \param  entries             returned index entries
+     */
+    void get_deltas(
+        pos_resource_typeid_t resource_type_id, pos_u64id_t id, std::vector<const pos_ckpt_image_entry_t*>& entries
+    );
+
+
+    /*!
+     *  \brief  obtain all records in the given type, in ascending order of (resource type, id)
+     *  \param  type    type of the records
+     *  \param  entries returned index entries
+     */
+    void get_entries(pos_ckpt_image_record_type_t type, std::vector<const pos_ckpt_image_entry_t*>& entries);
+
+
+    /*!
+     *  \brief  obtain the pointer to the content of a record
+     *  \param  entry   index entry of the record
+     *  \return pointer to the record
+     */
+    inline void* get_data(const pos_ckpt_image_entry_t* entry){
+        POS_CHECK_POINTER(entry);
+        return reinterpret_cast<uint8_t*>(this->_mapped) + entry->offset;
+    }
+
+
+    /*!
+     *  \brief  obtain the metadata and the raw section of a record
+     *  \note   for records without raw section, the whole record is returned as metadata
+     *  \note   chunked raw sections are assembled from the chunks into a buffer held by the image on the
+     *          first access, all-zero chunks are left as untouched (zero) pages of the buffer
+     *  \note   compressed raw sections are likewise decompressed into a buffer held by the image on the first
+     *          access, frames are decompressed in parallel by worker threads of POSPersistExecutor
+     *  \note   both buffers are held until the image is closed or release_section is called
+     *  \param  entry           index entry of the record
+     *  \param  meta            returned pointer to the metadata
+     *  \param  meta_size       returned size of the metadata
+     *  \param  section         returned pointer to the raw section, nullptr for no raw section
+     *  \param  section_size    returned size of the raw section
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_INVALID_INPUT for corrupted record
+     */
+    pos_retval_t get_section(
+        const pos_ckpt_image_entry_t* entry,
+        void** meta, uint64_t* meta_size, void** section, uint64_t* section_size
+    );
+
+
+    /*!
+     *  \brief  read the raw section of a record into the given buffer through the I/O backend,
+     *          instead of accessing the mmapped image
+     *  \note   direct I/O is used if it's enabled and the buffer is aligned
+     *  \param  entry   index entry of the record
+     *  \param  dst     buffer to read into, should be at least as large as the raw section
+     *  \param  size    size of the buffer
+     *  \return POS_SUCCESS for successfully read;
+     *          POS_FAILED_INVALID_INPUT for corrupted record or insufficient buffer;
+     *          POS_FAILED for failed to read
+     */
+    pos_retval_t read_section(const pos_ckpt_image_entry_t* entry, void* dst, uint64_t size);
+
+
+    /*!
+     *  \brief  release the buffer of an assembled chunked / decompressed raw section held by the image
+     *  \note   this function should be called once the raw section is no longer used (e.g., the state
+     *          has been reloaded), otherwise buffers are held until the image is closed; a released raw
+     *          section is assembled again on its next access
+     *  \param  entry   index entry of the record
+     */
+    void release_section(const pos_ckpt_image_entry_t* entry);
+
+
+    /*!
+     *  \brief  verify the checksum of a record, along with the chunks it refers to
+     *  \param  entry   index entry of the record
+     *  \return POS_SUCCESS for checksum matched;
+     *          POS_FAILED_INCORRECT_OUTPUT for mismatched
+     */
+    pos_retval_t verify(const pos_ckpt_image_entry_t* entry);
+
+
+    /*!
+     *  \brief  verify the checksums of records in parallel, along with the chunks they refer to
+     *  \note   records and chunks are split into segments of kVerifySegmentSize, which are checksummed by
+     *          the worker threads of POSPersistExecutor along with the calling thread, and then combined
+     *  \param  entries index entries of the records
+     *  \param  results returned result of each record, in the same order as entries
+     *  \param  stat    returned statistics, nullptr for not required
+     *  \return POS_SUCCESS for all checksums matched;
+     *          POS_FAILED_INCORRECT_OUTPUT for any mismatched
+     */
+    pos_retval_t verify_entries(
+        const std::vector<const pos_ckpt_image_entry_t*>& entries,
+        std::vector<pos_retval_t>& results,
+        pos_ckpt_image_verify_stat_t* stat = nullptr
+    );
+
+
+    /*!
+     *  \brief  verify the checksums of all records and chunks within the image in parallel
+     *  \note   the index is verified when the image is opened
+     *  \param  stat    returned statistics, nullptr for not required
+     *  \return POS_SUCCESS for all checksums matched;
+     *          POS_FAILED_INCORRECT_OUTPUT for any mismatched
+     */
+    pos_retval_t verify_all(pos_ckpt_image_verify_stat_t* stat = nullptr);
+
+
+    // granularity of parallel verification
+    static constexpr uint64_t kVerifySegmentSize = MB(4);
+
+ private:
+    /*!
+     *  \brief  download the image from the storage into a memfd, which is set as _fd
+     *  \param  storage the storage
+     *  \return POS_SUCCESS for successfully downloaded;
+     *          POS_FAILED_NOT_EXIST for no image exists;
+     *          POS_FAILED for failed to download
+     */
+    pos_retval_t __download(POSCheckpointStorage* storage);
+
+    /*!
+     *  \brief  assemble a chunked raw section from the chunks
+     *  \param  index           position of the record inside the index
+     *  \param  chunked         pointer to the chunked raw section
+     *  \param  chunked_size    size of the chunked raw section
+     *  \param  section         returned pointer to the assembled raw section
+     *  \param  section_size    returned size of the assembled raw section
+     *  \return POS_SUCCESS for successfully assembled;
+     *          POS_FAILED_INVALID_INPUT for corrupted chunked raw section or missing chunk;
+     *          POS_FAILED_OOM for failed to allocate the buffer
+     */
+    pos_retval_t __assemble_chunks(
+        uint64_t index, const void* chunked, uint64_t chunked_size, void** section, uint64_t* section_size
+    );
+
+    /*!
+     *  \brief  decompress a compressed raw section
+     *  \param  index           position of the record inside the index
+     *  \param  compressed      pointer to the compressed raw section
+     *  \param  compressed_size size of the compressed raw section
+     *  \param  section         returned pointer to the decompressed raw section
+     *  \param  section_size    returned size of the decompressed raw section
+     *  \return POS_SUCCESS for successfully decompressed;
+     *          POS_FAILED_INVALID_INPUT for corrupted compressed raw section;
+     *          POS_FAILED_NOT_ENABLED for unavailable codec;
+     *          POS_FAILED_OOM for failed to allocate the buffer
+     */
+    pos_retval_t __decompress_frames(
+        uint64_t index, const void* compressed, uint64_t compressed_size, void** section, uint64_t* section_size
+    );
+
+    /*!
+     *  \brief  obtain the chunks that a chunked record refers to, all-zero chunks are excluded
+     *  \param  entry   index entry of the record
+     *  \param  chunks  returned chunks
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_INVALID_INPUT for corrupted chunked raw section or missing chunk
+     */
+    pos_retval_t __get_referred_chunks(
+        const pos_ckpt_image_entry_t* entry, std::vector<const pos_ckpt_image_chunk_t*>& chunks
+    );
+
+    /*!
+     *  \brief  mark a record as reported to be corrupted
+     *  \note   a corrupted record might be detected by several passes (e.g., verifying and then decoding
+     *          its raw section), only the first one warns
+     *  \param  entry   index entry of the record
+     *  \return true for the first report of the record
+     */
+    bool __mark_reported(const pos_ckpt_image_entry_t* entry);
+
+    // mmapped image
+    void *_mapped;
+    uint64_t _mapped_size;
+
+    // index inside the mmapped image
+    const pos_ckpt_image_entry_t *_entries;
+    uint64_t _nb_entries;
+
+    // (type, resource type, id) -> position inside the index
+    std::map<std::tuple<uint32_t, pos_resource_typeid_t, pos_u64id_t>, uint64_t> _lookup;
+
+    // (resource type, id) -> positions of all delta records of the handle inside the index
+    std::map<std::pair<pos_resource_typeid_t, pos_u64id_t>, std::vector<uint64_t>> _delta_lookup;
+
+    // hash -> stored chunk inside the mmapped image
+    std::unordered_map<pos_chunk_hash_t, const pos_ckpt_image_chunk_t*, pos_chunk_hash_hasher> _chunks;
+
+    // position inside the index -> assembled chunked / decompressed raw section (anonymous mapping) and its size
+    std::map<uint64_t, std::pair<void*, uint64_t>> _assembled;
+    std::mutex _assembled_mutex;
+
+    // positions inside the index of records that have been reported to be corrupted
+    std::set<uint64_t> _reported;
+    std::mutex _reported_mutex;
+
+    // file descriptors of the image for read_section, the latter is opened with O_DIRECT, -1 for disabled
+    int _fd;
+    int _direct_fd;
+};
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+/*!
+ *  \brief  type of the checkpoint I/O backend
+ */
+enum pos_ckpt_io_backend_type_t : uint8_t {
+    // blocking pwritev / pread
+    kPOS_CkptIOBackend_Posix = 0,
+    // io_uring, with multiple requests in flight per thread
+    kPOS_CkptIOBackend_IoUring,
+    kPOS_CkptIOBackend_Unknown
+};
+
+
+/*!
+ *  \brief  runtime options of the checkpoint I/O backend
+ */
+typedef struct pos_ckpt_io_options {
+    // type of the backend
+    pos_ckpt_io_backend_type_t type;
+
+    // maximum number of in-flight requests per thread (io_uring only)
+    uint32_t queue_depth;
+
+    // size of each request that a large read / write is split into (io_uring only)
+    uint64_t request_size;
+
+    // whether to bypass the page cache (O_DIRECT) for aligned transfers
+    bool use_direct_io;
+
+    pos_ckpt_io_options()
+        :   type(kPOS_CkptIOBackend_IoUring), queue_depth(32), request_size(MB(1)), use_direct_io(false) {}
+} pos_ckpt_io_options_t;
+
+
+/*!
+ *  \brief  statistics of the checkpoint I/O backend
+ */
+typedef struct pos_ckpt_io_stat {
+    uint64_t nb_write_bytes;
+    uint64_t nb_read_bytes;
+
+    // number of requests issued to the kernel, and how many of them use registered buffers
+    uint64_t nb_requests;
+    uint64_t nb_fixed_requests;
+
+    // number of registered buffers
+    uint64_t nb_registered_buffers;
+
+    pos_ckpt_io_stat()
+        :   nb_write_bytes(0), nb_read_bytes(0), nb_requests(0), nb_fixed_requests(0),
+            nb_registered_buffers(0) {}
+} pos_ckpt_io_stat_t;
+
+
+/*!
+ *  \brief  I/O backend of checkpoint files
+ *  \note   all reads / writes of the checkpoint image go through the process-wide backend, which is
+ *          either the io_uring backend or the POSIX fallback (also used when io_uring is unavailable)
+ *  \note   memory of checkpoint slots (i.e., chunks of POSCheckpointArena) is registered to the backend,
+ *          the io_uring backend issues fixed-buffer requests for transfers within registered buffers
+ *  \note   all methods are thread-safe; calls are synchronous to the caller, while the io_uring
+ *          backend keeps up to queue_depth requests of a call in flight
+ */
+class POSCheckpointIOBackend {
+ public:
+    /*!
+     *  \brief  obtain the process-wide backend, create with default options if not initialized
+     *  \return pointer to the backend
+     */
+    static POSCheckpointIOBackend* get_instance();
+
+
+    /*!
+     *  \brief  (re)create the process-wide backend with the given options
+     *  \note   previous backend is retired but kept alive, as it might still be used by ongoing calls
+     *  \param  options options of the backend
+     *  \return POS_SUCCESS for successfully created;
+     *          POS_FAILED_NOT_ENABLED for io_uring is unavailable and POSIX backend is used instead;
+     *          POS_FAILED_INVALID_INPUT for invalid options
+     */
+    static pos_retval_t init(const pos_ckpt_io_options_t& options);
+
+
+    /*!
+     *  \brief  open a checkpoint file
+     *  \param  path        path to the file
+     *  \param  flags       flags to open the file (e.g., O_WRONLY | O_CREAT)
+     *  \param  is_direct   whether to open with O_DIRECT, ignored if direct I/O isn't enabled
+     *  \return file descriptor, negative for failed
+     */
+    int open(const std::string& path, int flags, bool is_direct = false);
+
+
+    /*!
+     *  \brief  write all given buffers to the given position of the file
+     *  \param  fd      file descriptor
+     *  \param  iov     buffers to write
+     *  \param  iovcnt  number of buffers
+     *  \param  offset  position within the file
+     *  \return POS_SUCCESS for successfully written;
+     *          POS_FAILED for failed to write
+     */
+    virtual pos_retval_t writev(int fd, const struct iovec* iov, int iovcnt, uint64_t offset) = 0;
+
+
+    /*!
+     *  \brief  read from the given position of the file
+     *  \param  fd      file descriptor
+     *  \param  buf     buffer to read into
+     *  \param  size    size to read
+     *  \param  offset  position within the file
+     *  \return POS_SUCCESS for successfully read;
+     *          POS_FAILED for failed to read or reached the end of file
+     */
+    virtual pos_retval_t read(int fd, void* buf, uint64_t size, uint64_t offset) = 0;
+
+
+    /*!
+     *  \brief  register / unregister a memory area that would be used as I/O buffer
+     *  \param  ptr     pointer to the area
+     *  \param  size    size of the area
+     */
+    void register_buffer(void* ptr, uint64_t size);
+    void unregister_buffer(void* ptr);
+
+
+    /*!
+     *  \brief  obtain the options / statistics of the backend
+     */
+    inline const pos_ckpt_io_options_t& get_options(){ return this->_options; }
+    void get_stat(pos_ckpt_io_stat_t& stat);
+
+
+    // alignment required by direct I/O
+    static constexpr uint64_t kDirectIOAlignment = KB(4);
+
+    // maximum size of a registered buffer
+    static constexpr uint64_t kMaxRegisteredBufferSize = GB(1);
+
+    // maximum number of registered buffers
+    static constexpr uint64_t kMaxNbRegisteredBuffers = 1024;
+
+    virtual ~POSCheckpointIOBackend() = default;
+
+ protected:
+    POSCheckpointIOBackend(const pos_ckpt_io_options_t& options) : _options(options), _buffers_version(0) {}
+
+    /*!
+     *  \brief  obtain a snapshot of registered buffers
+     *  \param  buffers returned buffers, in ascending order of address
+     *  \return version of the registered buffers
+     */
+    uint64_t __get_buffers(std::vector<struct iovec>& buffers);
+
+    pos_ckpt_io_options_t _options;
+
+    // registered buffers: address -> size
+    std::map<void*, uint64_t> _buffers;
+    std::atomic<uint64_t> _buffers_version;
+
+    pos_ckpt_io_stat_t _stat;
+
+    std::mutex _mutex;
+};
+
+
+/*!
+ *  \brief  blocking POSIX backend
+ */
+class POSCheckpointIOBackend_Posix : public POSCheckpointIOBackend {
+ public:
+    POSCheckpointIOBackend_Posix(const pos_ckpt_io_options_t& options) : POSCheckpointIOBackend(options) {}
+    ~POSCheckpointIOBackend_Posix() = default;
+
+    pos_retval_t writev(int fd, const struct iovec* iov, int iovcnt, uint64_t offset) override;
+    pos_retval_t read(int fd, void* buf, uint64_t size, uint64_t offset) override;
+};
+
+
+/*!
+ *  \brief  io_uring backend, each thread owns a ring lazily created at its first call
+ */
+class POSCheckpointIOBackend_IoUring : public POSCheckpointIOBackend {
+ public:
+    POSCheckpointIOBackend_IoUring(const pos_ckpt_io_options_t& options)
+        : POSCheckpointIOBackend(options), _id(__nb_instances.fetch_add(1) + 1) {}
+    ~POSCheckpointIOBackend_IoUring() = default;
+
+    pos_retval_t writev(int fd, const struct iovec* iov, int iovcnt, uint64_t offset) override;
+    pos_retval_t read(int fd, void* buf, uint64_t size, uint64_t offset) override;
+
+    /*!
+     *  \brief  check whether io_uring is supported by the kernel
+     *  \return true for supported
+     */
+    static bool is_supported();
+
+ private:
+    /*!
+     *  \brief  split a transfer into requests and keep up to queue_depth of them in flight
+     *  \param  fd          file descriptor
+     *  \param  iov         buffers of the transfer
+     *  \param  iovcnt      number of buffers
+     *  \param  offset      position within the file
+     *  \param  is_write    whether it's a write
+     *  \return POS_SUCCESS for successfully transferred
+     */
+    pos_retval_t __transfer(int fd, const struct iovec* iov, int iovcnt, uint64_t offset, bool is_write);
+
+    // index of this backend, to identify the owner of thread-local rings
+    uint64_t _id;
+    static std::atomic<uint64_t> __nb_instances;
+};
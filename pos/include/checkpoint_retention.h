@@ -0,0 +1,299 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/utils/timer.h"
+
+
+// forward declaration
+class POSCheckpointRetentionTarget;
+
+
+/*!
+ *  \brief  a checkpointed version retained by a target
+ */
+typedef struct pos_ckpt_retained_version {
+    POSCheckpointRetentionTarget *target;
+    uint64_t version;
+
+    // size of the memory held by the version
+    uint64_t size;
+
+    // TSC tick when the version was checkpointed
+    uint64_t tick;
+
+    // filled by the engine: age of the version, and whether it's the latest version of its target,
+    // the latest version is never reclaimed
+    double age_ms;
+    bool is_latest;
+
+    // decided by policies
+    bool is_reclaimed;
+
+    pos_ckpt_retained_version()
+        :   target(nullptr), version(0), size(0), tick(0), age_ms(0), is_latest(false), is_reclaimed(false) {}
+} pos_ckpt_retained_version_t;
+
+
+/*!
+ *  \brief  owner of checkpointed versions whose memory could be reclaimed by the retention engine,
+ *          e.g., the checkpoint bag of a handle
+ *  \note   both methods are called by the retention engine from its own thread, so they should be
+ *          thread-safe against the checkpointing process of the target
+ */
+class POSCheckpointRetentionTarget {
+ public:
+    virtual ~POSCheckpointRetentionTarget() = default;
+
+    /*!
+     *  \brief  collect the versions retained by this target
+     *  \param  versions    vector to append the versions to
+     */
+    virtual void get_retained_versions(std::vector<pos_ckpt_retained_version_t>& versions) = 0;
+
+    /*!
+     *  \brief  reclaim the memory of the given version
+     *  \param  version the version to reclaim
+     *  \return POS_SUCCESS for successfully reclaimed;
+     *          POS_FAILED_NOT_EXIST for the version is no longer retained;
+     *          POS_FAILED_NOT_READY for the version is still in use, and could be reclaimed later
+     */
+    virtual pos_retval_t reclaim_version(uint64_t version) = 0;
+};
+
+
+/*!
+ *  \brief  policy that decides which versions to reclaim
+ */
+class POSCheckpointRetentionPolicy {
+ public:
+    virtual ~POSCheckpointRetentionPolicy() = default;
+
+    /*!
+     *  \brief  mark versions to be reclaimed
+     *  \note   versions are marked by setting is_reclaimed, a policy shouldn't mark the latest version
+     *          of a target, nor unmark versions marked by previous policies
+     *  \param  versions    versions retained by all targets
+     */
+    virtual void apply(std::vector<pos_ckpt_retained_version_t>& versions) = 0;
+
+    /*!
+     *  \brief  obtain the description of the policy, in the format accepted by POSCheckpointRetention::parse
+     */
+    virtual std::string get_name() const = 0;
+};
+
+
+/*!
+ *  \brief  keep the last N versions of each target
+ */
+class POSCheckpointRetentionPolicy_KeepLast : public POSCheckpointRetentionPolicy {
+ public:
+    POSCheckpointRetentionPolicy_KeepLast(uint64_t nb_versions) : _nb_versions(nb_versions) {
+        POS_ASSERT(nb_versions > 0);
+    }
+    void apply(std::vector<pos_ckpt_retained_version_t>& versions) override;
+    std::string get_name() const override { return "last:" + std::to_string(this->_nb_versions); }
+
+ private:
+    uint64_t _nb_versions;
+};
+
+
+/*!
+ *  \brief  keep versions checkpointed within the given duration
+ */
+class POSCheckpointRetentionPolicy_KeepByAge : public POSCheckpointRetentionPolicy {
+ public:
+    POSCheckpointRetentionPolicy_KeepByAge(uint64_t max_age_ms) : _max_age_ms(max_age_ms) {}
+    void apply(std::vector<pos_ckpt_retained_version_t>& versions) override;
+    std::string get_name() const override { return "age_ms:" + std::to_string(this->_max_age_ms); }
+
+ private:
+    uint64_t _max_age_ms;
+};
+
+
+/*!
+ *  \brief  keep the memory of retained versions across all targets under the budget, by reclaiming
+ *          the oldest versions first
+ *  \note   should be the last policy, so that it only reclaims what other policies keep
+ */
+class POSCheckpointRetentionPolicy_MemoryBudget : public POSCheckpointRetentionPolicy {
+ public:
+    POSCheckpointRetentionPolicy_MemoryBudget(uint64_t budget) : _budget(budget) {}
+    void apply(std::vector<pos_ckpt_retained_version_t>& versions) override;
+    std::string get_name() const override { return "budget:" + std::to_string(this->_budget); }
+
+ private:
+    uint64_t _budget;
+};
+
+
+/*!
+ *  \brief  statistics of the retention engine
+ */
+typedef struct pos_ckpt_retention_stat {
+    uint64_t nb_targets;
+
+    // versions / memory retained after the last sweep
+    uint64_t nb_retained_versions;
+    uint64_t retained_bytes;
+
+    // versions / memory reclaimed by all sweeps so far
+    uint64_t nb_reclaimed_versions;
+    uint64_t reclaimed_bytes;
+
+    uint64_t nb_sweeps;
+
+    // duration of the last sweep
+    double last_sweep_ms;
+
+    pos_ckpt_retention_stat()
+        :   nb_targets(0), nb_retained_versions(0), retained_bytes(0), nb_reclaimed_versions(0),
+            reclaimed_bytes(0), nb_sweeps(0), last_sweep_ms(0) {}
+} pos_ckpt_retention_stat_t;
+
+
+/*!
+ *  \brief  process-wide retention engine of checkpointed versions
+ *  \note   targets (checkpoint bags) register themselves on creation; the engine periodically collects
+ *          the versions they retain, lets the policies mark those to be reclaimed, and reclaims them,
+ *          so that old versions are returned to the free list of their bags instead of piling up until
+ *          explicit invalidation
+ *  \note   a version is reclaimed if any policy marks it, and no policy is set by default, i.e., nothing
+ *          is reclaimed; all methods are thread-safe
+ *  \note   links of delta chains (POSCheckpointDeltaChain) aren't targets, as a delta is useless without
+ *          the links before it; a chain instead bounds itself to one base plus at most base_interval
+ *          deltas, and drops all of them once a new base is committed
+ */
+class POSCheckpointRetention {
+ public:
+    /*!
+     *  \brief  obtain the process-wide engine
+     *  \return pointer to the engine
+     */
+    static POSCheckpointRetention* get_instance();
+
+
+    /*!
+     *  \brief  register / unregister a target
+     *  \note   unregistering waits for the ongoing sweep, so the target could be destroyed afterwards
+     *  \param  target  the target
+     */
+    void add_target(POSCheckpointRetentionTarget* target);
+    void remove_target(POSCheckpointRetentionTarget* target);
+
+
+    /*!
+     *  \brief  replace the policies, which are applied in the given order
+     *  \param  policies    the new policies, empty for reclaiming nothing
+     */
+    void set_policies(std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>> policies);
+
+
+    /*!
+     *  \brief  parse policies from their description
+     *  \param  desp        format: <policy>:<value>[,<policy>:<value>...], where the policy is one of
+     *                      "last" (number of versions), "age_ms" (milliseconds) and "budget" (bytes),
+     *                      the budget is always applied last
+     *  \param  policies    returned policies
+     *  \return POS_SUCCESS for successfully parsed;
+     *          POS_FAILED_INVALID_INPUT for invalid description
+     */
+    static pos_retval_t parse(const std::string& desp, std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>>& policies);
+
+
+    /*!
+     *  \brief  start / stop sweeping in the background
+     *  \param  interval_ms interval between two sweeps
+     *  \return POS_SUCCESS for successfully started;
+     *          POS_FAILED_INVALID_INPUT for zero interval
+     */
+    pos_retval_t start(uint64_t interval_ms = kDefaultIntervalMs);
+    void stop();
+
+
+    /*!
+     *  \brief  wake the background thread to sweep now, e.g., after a checkpoint round
+     *  \note   this function doesn't wait for an ongoing sweep, which is followed by another one instead
+     */
+    void notify();
+
+
+    /*!
+     *  \brief  sweep all targets within the calling thread
+     *  \param  now_tick    TSC tick to calculate the age of versions, 0 for current tick
+     *  \return POS_SUCCESS for all marked versions are reclaimed, otherwise the first failure
+     */
+    pos_retval_t sweep(uint64_t now_tick = 0);
+
+
+    /*!
+     *  \brief  obtain statistics of the engine
+     *  \param  stat    returned statistics
+     */
+    void get_stat(pos_ckpt_retention_stat_t& stat);
+
+
+    // default interval between two background sweeps
+    static constexpr uint64_t kDefaultIntervalMs = 1000;
+
+ private:
+    POSCheckpointRetention() : _thread(nullptr), _is_stop(false), _is_notified(false), _interval_ms(kDefaultIntervalMs) {}
+    ~POSCheckpointRetention();
+
+    /*!
+     *  \brief  sweep with _mutex held
+     */
+    pos_retval_t __sweep(uint64_t now_tick);
+
+    /*!
+     *  \brief  processing routine of the background thread
+     */
+    void __sweep_routine();
+
+    std::set<POSCheckpointRetentionTarget*> _targets;
+    std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>> _policies;
+
+    // background thread and its control, the flags are protected by _notify_mutex instead of _mutex,
+    // so that notifying isn't blocked by an ongoing sweep
+    std::thread *_thread;
+    bool _is_stop;
+    bool _is_notified;
+    uint64_t _interval_ms;
+    std::condition_variable _cv;
+    std::mutex _notify_mutex;
+
+    // for converting ticks to ages
+    POSUtilTscTimer _tsc_timer;
+
+    pos_ckpt_retention_stat_t _stat;
+
+    std::mutex _mutex;
+};
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+// forward declaration
+class POSCheckpointSpillTarget;
+
+
+/*!
+ *  \brief  a checkpointed version that could be spilled out of host memory
+ */
+typedef struct pos_ckpt_spill_candidate {
+    POSCheckpointSpillTarget *target;
+    uint64_t version;
+
+    // size of host memory released by spilling the version
+    uint64_t size;
+
+    // TSC tick when the version was checkpointed, older versions are spilled first
+    uint64_t tick;
+
+    pos_ckpt_spill_candidate() : target(nullptr), version(0), size(0), tick(0) {}
+} pos_ckpt_spill_candidate_t;
+
+
+/*!
+ *  \brief  owner of host checkpoint memory that could be spilled, e.g., the checkpoint bag of a handle
+ *  \note   methods are called by the spill tier from the thread under admission, so they should be
+ *          thread-safe against the checkpointing process of the target
+ */
+class POSCheckpointSpillTarget {
+ public:
+    virtual ~POSCheckpointSpillTarget() = default;
+
+    /*!
+     *  \brief  collect versions that are committed, resident in host memory and not accessed by anyone
+     *  \param  candidates  vector to append the versions to
+     */
+    virtual void get_spill_candidates(std::vector<pos_ckpt_spill_candidate_t>& candidates) = 0;
+
+    /*!
+     *  \brief  spill the given version to the spill tier, and release its host memory
+     *  \param  version the version to spill
+     *  \return POS_SUCCESS for successfully spilled;
+     *          POS_FAILED_NOT_EXIST for the version is no longer resident or is accessed meanwhile;
+     *          POS_FAILED for failed to write the spill tier
+     */
+    virtual pos_retval_t spill_version(uint64_t version) = 0;
+
+    /*!
+     *  \brief  release host memory cached for reusing, e.g., freed checkpoint slots
+     *  \return size of the released memory
+     */
+    virtual uint64_t trim_cached() = 0;
+};
+
+
+/*!
+ *  \brief  statistics of the spill tier
+ */
+typedef struct pos_ckpt_spill_stat {
+    // budget of host checkpoint memory, 0 for unlimited
+    uint64_t budget;
+
+    // host checkpoint memory currently accounted, and its peak
+    uint64_t resident_bytes;
+    uint64_t peak_resident_bytes;
+
+    // number of admissions, how many of them stalled for room and for how long, and how many of
+    // them gave up waiting and overcommitted the budget
+    uint64_t nb_admits;
+    uint64_t nb_stalls;
+    double stall_ms;
+    uint64_t nb_overcommits;
+
+    // memory released by trimming cached slots
+    uint64_t trimmed_bytes;
+
+    // versions / bytes spilled to and loaded back from the spill file
+    uint64_t nb_spills;
+    uint64_t spilled_bytes;
+    uint64_t nb_loads;
+    uint64_t loaded_bytes;
+
+    // size of the spill file, and how much of it holds spilled state
+    uint64_t file_size;
+    uint64_t file_used_size;
+
+    pos_ckpt_spill_stat()
+        :   budget(0), resident_bytes(0), peak_resident_bytes(0), nb_admits(0), nb_stalls(0), stall_ms(0),
+            nb_overcommits(0), trimmed_bytes(0), nb_spills(0), spilled_bytes(0), nb_loads(0), loaded_bytes(0),
+            file_size(0), file_used_size(0) {}
+} pos_ckpt_spill_stat_t;
+
+
+/*!
+ *  \brief  process-wide budget of host checkpoint memory, with a file-backed spill tier
+ *  \note   targets (checkpoint bags) account the host memory of their slots here; before a checkpoint
+ *          that needs more host memory, the caller is admitted by admit(), which first releases cached
+ *          slots, then spills the oldest committed slots to the spill file, and waits for room if
+ *          nothing could be released (i.e., backpressure on the caller), rather than failing
+ *  \note   spilled slots are loaded back transparently when they're accessed again (e.g., for persist
+ *          or restore); the budget is soft: loading back and concurrent admissions might exceed it
+ *  \note   slots of delta chains (POSCheckpointDeltaChain) are accounted to the budget as well, but they're
+ *          never spilled, so admit() makes room for them by spilling slots of checkpoint bags only
+ *  \note   all methods are thread-safe; the lock order is: admission, target, spill file
+ */
+class POSCheckpointSpill {
+ public:
+    /*!
+     *  \brief  obtain the process-wide spill tier
+     *  \return pointer to the spill tier
+     */
+    static POSCheckpointSpill* get_instance();
+
+
+    /*!
+     *  \brief  register / unregister a target
+     *  \note   unregistering waits for the ongoing admission, so the target could be destroyed afterwards
+     *  \param  target  the target
+     */
+    void add_target(POSCheckpointSpillTarget* target);
+    void remove_target(POSCheckpointSpillTarget* target);
+
+
+    /*!
+     *  \brief  set the budget of host checkpoint memory
+     *  \param  budget  the budget, 0 for unlimited (i.e., nothing is spilled)
+     */
+    void set_budget(uint64_t budget);
+
+
+    /*!
+     *  \brief  set the directory of the spill file
+     *  \param  dir the directory
+     *  \return POS_SUCCESS for successfully set;
+     *          POS_FAILED_NOT_EXIST for the directory doesn't exist;
+     *          POS_FAILED_ALREADY_EXIST for there're spilled versions in the current spill file
+     */
+    pos_retval_t set_spill_dir(const std::string& dir);
+
+
+    /*!
+     *  \brief  wait until there's room for the given size of host checkpoint memory within the budget
+     *  \note   this function never fails; if no room could be made before admit_timeout_ms, the caller
+     *          is admitted anyway and the overcommit is recorded
+     *  \param  size    size of host memory the caller is about to checkpoint into
+     */
+    void admit(uint64_t size);
+
+
+    /*!
+     *  \brief  account host memory allocated / released by targets
+     *  \param  size    size of the memory
+     */
+    void on_allocated(uint64_t size);
+    void on_released(uint64_t size);
+
+
+    /*!
+     *  \brief  write a state to the spill file
+     *  \param  data    pointer to the state
+     *  \param  size    size of the state
+     *  \param  offset  returned offset of the state inside the spill file
+     *  \return POS_SUCCESS for successfully written;
+     *          POS_FAILED for failed to create or write the spill file
+     */
+    pos_retval_t spill_out(const void* data, uint64_t size, uint64_t* offset);
+
+
+    /*!
+     *  \brief  read a spilled state back, and release its room in the spill file
+     *  \param  offset  offset of the state inside the spill file
+     *  \param  data    buffer to read the state into
+     *  \param  size    size of the state
+     *  \return POS_SUCCESS for successfully read;
+     *          POS_FAILED for failed to read the spill file
+     */
+    pos_retval_t spill_in(uint64_t offset, void* data, uint64_t size);
+
+
+    /*!
+     *  \brief  release the room of a spilled state that is no longer needed
+     *  \param  offset  offset of the state inside the spill file
+     *  \param  size    size of the state
+     */
+    void spill_discard(uint64_t offset, uint64_t size);
+
+
+    /*!
+     *  \brief  obtain statistics of the spill tier
+     *  \param  stat    returned statistics
+     */
+    void get_stat(pos_ckpt_spill_stat_t& stat);
+
+
+    // maximum duration an admission waits for room before overcommitting the budget
+    static inline uint64_t admit_timeout_ms = 5000;
+
+    // interval to retry releasing memory while an admission is waiting
+    static constexpr uint64_t kAdmitRetryMs = 2;
+
+    // alignment of states inside the spill file
+    static constexpr uint64_t kSpillAlignment = KB(4);
+
+ private:
+    POSCheckpointSpill();
+    ~POSCheckpointSpill();
+
+    /*!
+     *  \brief  release at least the given size of host memory from the targets
+     *  \note   should be called with _mutex held
+     *  \param  size    size of memory to release
+     *  \return size of memory released
+     */
+    uint64_t __relieve(uint64_t size);
+
+    /*!
+     *  \brief  create the spill file under the spill directory if not yet created
+     *  \note   should be called with _file_mutex held
+     *  \return POS_SUCCESS for successfully created
+     */
+    pos_retval_t __open_file();
+
+    std::set<POSCheckpointSpillTarget*> _targets;
+
+    // budget of host checkpoint memory, 0 for unlimited
+    std::atomic<uint64_t> _budget;
+
+    // host memory accounted by targets, and its peak
+    std::atomic<uint64_t> _resident_bytes;
+    std::atomic<uint64_t> _peak_resident_bytes;
+
+    // admissions wait on this for memory released by targets
+    std::condition_variable _cv;
+
+    // statistics except for the spill file, protected by _mutex
+    pos_ckpt_spill_stat_t _stat;
+
+    // serializes admissions, and protects targets and statistics
+    std::mutex _mutex;
+
+    // the spill file, which is unlinked once created so that it's gone with the process
+    std::string _spill_dir;
+    int _fd;
+    uint64_t _file_size;
+    uint64_t _file_used_size;
+
+    // free room inside the spill file: size -> offset
+    std::multimap<uint64_t, uint64_t> _free_extents;
+
+    // statistics of spilling / loading, protected by _file_mutex
+    uint64_t _nb_spills;
+    uint64_t _spilled_bytes;
+    uint64_t _nb_loads;
+    uint64_t _loaded_bytes;
+
+    std::mutex _file_mutex;
+};
@@ -0,0 +1,474 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+/*!
+ *  \brief  type of the checkpoint storage backend
+ */
+enum pos_ckpt_storage_type_t : uint8_t {
+    // in-memory objects backed by memfd, within the process
+    kPOS_CkptStorage_Memory = 0,
+    // files under a local directory
+    kPOS_CkptStorage_Local,
+    // object store with put / get, served over a Unix socket
+    kPOS_CkptStorage_Object,
+    kPOS_CkptStorage_Unknown
+};
+
+
+/*!
+ *  \brief  location that checkpoints are dumped to / restored from, e.g., the checkpoint directory
+ *  \note   a location is selected by its URI:
+ *          mem://<name>        in-memory objects backed by memfd, visible within the process only;
+ *          file://<path>       files under the local directory, a URI without scheme is also a local path;
+ *          obj://<key prefix>  objects under the key prefix, inside the object store at endpoint
+ *  \note   objects are uploaded in parts, which could be issued concurrently and in any order, and are
+ *          only visible once the upload completes; objects are read by ranges, which could also be
+ *          issued concurrently; put / get split an object into parts of part_size and transfer them
+ *          in parallel by the worker threads of POSPersistExecutor along with the calling thread
+ *  \note   memory and local backends also expose objects as file descriptors, so that the checkpoint
+ *          image is written and mmapped in-place, other backends stage the image in memory instead
+ *  \note   all methods are thread-safe
+ */
+class POSCheckpointStorage {
+ public:
+    /*!
+     *  \brief  obtain the storage of the given URI
+     *  \note   storages are cached by URI, so this could be called on every access
+     *  \param  uri     URI of the location
+     *  \param  storage returned storage
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_INVALID_INPUT for invalid or unknown URI
+     */
+    static pos_retval_t open(const std::string& uri, std::shared_ptr<POSCheckpointStorage>& storage);
+
+
+    /*!
+     *  \brief  check whether the location is prepared, e.g., before persisting into it
+     *  \param  uri URI of the location
+     *  \return true for prepared
+     */
+    static bool exists(const std::string& uri);
+
+
+    /*!
+     *  \brief  create the location, objects that already exist inside it are removed
+     *  \return POS_SUCCESS for successfully prepared;
+     *          POS_FAILED for failed to create the location
+     */
+    virtual pos_retval_t prepare() = 0;
+
+
+    /*!
+     *  \brief  check whether the location exists
+     *  \return true for exists
+     */
+    virtual bool exists() = 0;
+
+
+    /*!
+     *  \brief  start a multi-part upload of an object
+     *  \param  name        name of the object inside the location
+     *  \param  upload_id   returned index of the upload
+     *  \return POS_SUCCESS for successfully started;
+     *          POS_FAILED for failed to start
+     */
+    virtual pos_retval_t begin_upload(const std::string& name, uint64_t* upload_id) = 0;
+
+
+    /*!
+     *  \brief  upload a part of the object
+     *  \note   parts of an upload could be uploaded concurrently, and in any order
+     *  \param  upload_id   index of the upload
+     *  \param  offset      position of the part inside the object
+     *  \param  data        pointer to the part
+     *  \param  size        size of the part
+     *  \return POS_SUCCESS for successfully uploaded;
+     *          POS_FAILED_NOT_EXIST for no such upload;
+     *          POS_FAILED for failed to upload
+     */
+    virtual pos_retval_t upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size) = 0;
+
+
+    /*!
+     *  \brief  finish a multi-part upload, the object becomes visible (replacing the old one, if any)
+     *  \note   all parts should have been uploaded
+     *  \param  upload_id   index of the upload
+     *  \return POS_SUCCESS for successfully completed;
+     *          POS_FAILED_NOT_EXIST for no such upload;
+     *          POS_FAILED for failed to complete
+     */
+    virtual pos_retval_t complete_upload(uint64_t upload_id) = 0;
+
+
+    /*!
+     *  \brief  drop a multi-part upload along with its uploaded parts
+     *  \param  upload_id   index of the upload
+     */
+    virtual void abort_upload(uint64_t upload_id) = 0;
+
+
+    /*!
+     *  \brief  obtain the size of an object
+     *  \param  name    name of the object
+     *  \param  size    returned size of the object
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_NOT_EXIST for no such object
+     */
+    virtual pos_retval_t get_size(const std::string& name, uint64_t* size) = 0;
+
+
+    /*!
+     *  \brief  read a range of an object
+     *  \param  name    name of the object
+     *  \param  offset  position of the range inside the object
+     *  \param  dst     buffer to read into
+     *  \param  size    size of the range
+     *  \return POS_SUCCESS for successfully read;
+     *          POS_FAILED_NOT_EXIST for no such object;
+     *          POS_FAILED for failed to read or out-of-range
+     */
+    virtual pos_retval_t read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size) = 0;
+
+
+    /*!
+     *  \brief  remove an object
+     *  \param  name    name of the object
+     *  \return POS_SUCCESS for successfully removed;
+     *          POS_FAILED_NOT_EXIST for no such object
+     */
+    virtual pos_retval_t remove(const std::string& name) = 0;
+
+
+    /*!
+     *  \brief  obtain the path of an object on the local filesystem
+     *  \param  name    name of the object
+     *  \return path of the object, empty for objects that aren't local files
+     */
+    virtual std::string get_local_path(const std::string& /* name */){ return ""; }
+
+
+    /*!
+     *  \brief  open an object as a file descriptor, for reading / writing in-place
+     *  \note   opening for writing creates (or truncates) the object, which is visible immediately
+     *  \param  name        name of the object
+     *  \param  is_write    whether to open for writing
+     *  \return file descriptor owned by the caller, negative for unsupported or failed
+     */
+    virtual int open_fd(const std::string& /* name */, bool /* is_write */){ return -1; }
+
+
+    /*!
+     *  \brief  upload an object in parts in parallel
+     *  \param  name    name of the object
+     *  \param  data    pointer to the object
+     *  \param  size    size of the object
+     *  \return POS_SUCCESS for successfully uploaded;
+     *          POS_FAILED for failed to upload
+     */
+    pos_retval_t put(const std::string& name, const void* data, uint64_t size);
+
+
+    /*!
+     *  \brief  read a whole object by ranges in parallel
+     *  \param  name    name of the object
+     *  \param  dst     buffer to read into
+     *  \param  size    size of the object
+     *  \return POS_SUCCESS for successfully read;
+     *          POS_FAILED_NOT_EXIST for no such object;
+     *          POS_FAILED for failed to read
+     */
+    pos_retval_t get(const std::string& name, void* dst, uint64_t size);
+
+
+    inline pos_ckpt_storage_type_t get_type() const { return this->_type; }
+    inline const std::string& get_uri() const { return this->_uri; }
+
+    virtual ~POSCheckpointStorage() = default;
+
+
+    // size of parts that put / get split an object into
+    static inline uint64_t part_size = MB(8);
+
+ protected:
+    POSCheckpointStorage(pos_ckpt_storage_type_t type, const std::string& uri) : _type(type), _uri(uri) {}
+
+    pos_ckpt_storage_type_t _type;
+    std::string _uri;
+};
+
+
+/*!
+ *  \brief  in-memory objects backed by memfd, e.g., for dumping and restoring within the same process
+ *  \note   objects are kept in a process-wide registry, and live until removed or the location is
+ *          prepared again
+ */
+class POSCheckpointStorage_Memory : public POSCheckpointStorage {
+ public:
+    POSCheckpointStorage_Memory(const std::string& uri, const std::string& location)
+        : POSCheckpointStorage(kPOS_CkptStorage_Memory, uri), _location(location) {}
+    ~POSCheckpointStorage_Memory() = default;
+
+    pos_retval_t prepare() override;
+    bool exists() override;
+    pos_retval_t begin_upload(const std::string& name, uint64_t* upload_id) override;
+    pos_retval_t upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size) override;
+    pos_retval_t complete_upload(uint64_t upload_id) override;
+    void abort_upload(uint64_t upload_id) override;
+    pos_retval_t get_size(const std::string& name, uint64_t* size) override;
+    pos_retval_t read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size) override;
+    pos_retval_t remove(const std::string& name) override;
+    int open_fd(const std::string& name, bool is_write) override;
+
+ private:
+    /*!
+     *  \brief  obtain the memfd of an object
+     *  \param  name    name of the object
+     *  \return duplicated file descriptor owned by the caller, negative for no such object
+     */
+    int __dup_fd(const std::string& name);
+
+    std::string _location;
+
+    // ongoing uploads: index -> (name, memfd)
+    std::map<uint64_t, std::pair<std::string, int>> _uploads;
+    std::mutex _mutex;
+};
+
+
+/*!
+ *  \brief  files under a local directory
+ *  \note   uploads are written to a temporary file next to the object, which is renamed to the object
+ *          once completed
+ */
+class POSCheckpointStorage_Local : public POSCheckpointStorage {
+ public:
+    POSCheckpointStorage_Local(const std::string& uri, const std::string& dir)
+        : POSCheckpointStorage(kPOS_CkptStorage_Local, uri), _dir(dir) {}
+    ~POSCheckpointStorage_Local() = default;
+
+    pos_retval_t prepare() override;
+    bool exists() override;
+    pos_retval_t begin_upload(const std::string& name, uint64_t* upload_id) override;
+    pos_retval_t upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size) override;
+    pos_retval_t complete_upload(uint64_t upload_id) override;
+    void abort_upload(uint64_t upload_id) override;
+    pos_retval_t get_size(const std::string& name, uint64_t* size) override;
+    pos_retval_t read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size) override;
+    pos_retval_t remove(const std::string& name) override;
+    std::string get_local_path(const std::string& name) override { return this->_dir + "/" + name; }
+    int open_fd(const std::string& name, bool is_write) override;
+
+ private:
+    // ongoing upload
+    typedef struct pos_ckpt_storage_upload {
+        std::string name;
+        std::string tmp_path;
+        int fd;
+    } pos_ckpt_storage_upload_t;
+
+    std::string _dir;
+
+    // ongoing uploads
+    std::map<uint64_t, pos_ckpt_storage_upload_t> _uploads;
+    std::mutex _mutex;
+};
+
+
+/*!
+ *  \brief  operations of the object store protocol
+ */
+enum pos_ckpt_obj_op_t : uint32_t {
+    kPOS_CkptObjOp_Prepare = 0,
+    kPOS_CkptObjOp_Exists,
+    kPOS_CkptObjOp_BeginUpload,
+    kPOS_CkptObjOp_UploadPart,
+    kPOS_CkptObjOp_CompleteUpload,
+    kPOS_CkptObjOp_AbortUpload,
+    kPOS_CkptObjOp_GetSize,
+    kPOS_CkptObjOp_GetRange,
+    kPOS_CkptObjOp_Remove,
+    kPOS_CkptObjOp_Unknown
+};
+
+
+/*!
+ *  \brief  message of the object store protocol
+ *  \note   a request is [message][key][payload], where the payload is the part of UploadPart;
+ *          a response is [message][payload], where the payload is the range of GetRange
+ */
+typedef struct pos_ckpt_obj_msg {
+    // operation, see pos_ckpt_obj_op_t
+    uint32_t op;
+
+    // return value of the operation, in response only
+    int32_t retval;
+
+    uint64_t upload_id;
+    uint64_t offset;
+
+    // size of the payload, or size of the object in the response of GetSize
+    uint64_t size;
+
+    // size of the key, which follows the message in request
+    uint32_t key_size;
+    uint32_t reserved;
+} __attribute__((packed)) pos_ckpt_obj_msg_t;
+
+
+/*!
+ *  \brief  client of the object store, keys of objects are <key prefix>/<name>
+ *  \note   each in-flight request takes a connection, connections are pooled and reused
+ */
+class POSCheckpointStorage_Object : public POSCheckpointStorage {
+ public:
+    POSCheckpointStorage_Object(const std::string& uri, const std::string& prefix)
+        : POSCheckpointStorage(kPOS_CkptStorage_Object, uri), _prefix(prefix), _is_prepared(false) {}
+    ~POSCheckpointStorage_Object();
+
+    pos_retval_t prepare() override;
+    bool exists() override;
+    pos_retval_t begin_upload(const std::string& name, uint64_t* upload_id) override;
+    pos_retval_t upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size) override;
+    pos_retval_t complete_upload(uint64_t upload_id) override;
+    void abort_upload(uint64_t upload_id) override;
+    pos_retval_t get_size(const std::string& name, uint64_t* size) override;
+    pos_retval_t read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size) override;
+    pos_retval_t remove(const std::string& name) override;
+
+    // path of the Unix socket that the object store listens on, applies to connections opened afterwards
+    static inline std::string endpoint = "/tmp/pos_ckpt_obj.sock";
+
+ private:
+    /*!
+     *  \brief  issue a request and wait for its response
+     *  \param  op          operation of the request
+     *  \param  key         key of the object (or the prefix)
+     *  \param  upload_id   index of the upload
+     *  \param  offset      position inside the object
+     *  \param  size        size of the payload / range
+     *  \param  payload     payload of the request, nullptr for none
+     *  \param  dst         buffer to receive the payload of the response, nullptr for none
+     *  \param  response    returned response
+     *  \return POS_SUCCESS for the request is served (the result of the operation is in the response);
+     *          POS_FAILED for failed to communicate with the object store
+     */
+    pos_retval_t __request(
+        pos_ckpt_obj_op_t op, const std::string& key, uint64_t upload_id, uint64_t offset, uint64_t size,
+        const void* payload, void* dst, pos_ckpt_obj_msg_t& response
+    );
+
+    inline std::string __key(const std::string& name){ return this->_prefix + "/" + name; }
+
+    std::string _prefix;
+
+    // whether the prefix has been prepared by this process, to skip asking the object store
+    std::atomic<bool> _is_prepared;
+
+    // idle connections
+    std::vector<int> _conns;
+    std::mutex _mutex;
+};
+
+
+/*!
+ *  \brief  stand-in of the object store, which keeps objects as files under a local directory
+ *  \note   the server accepts connections on a Unix socket, and serves each connection by its own thread;
+ *          objects are kept as <root>/<key>, and uploads are staged under <root>/.uploads until completed
+ */
+class POSCheckpointObjectServer {
+ public:
+    POSCheckpointObjectServer() : _listen_fd(-1), _is_stop(false), _nb_uploads(0) {}
+    ~POSCheckpointObjectServer(){ this->stop(); }
+
+    /*!
+     *  \brief  start serving
+     *  \param  endpoint    path of the Unix socket to listen on, replaced if exists
+     *  \param  root        directory to keep objects
+     *  \return POS_SUCCESS for successfully started;
+     *          POS_FAILED_ALREADY_EXIST for already started;
+     *          POS_FAILED for failed to create the directory or the socket
+     */
+    pos_retval_t start(const std::string& endpoint, const std::string& root);
+
+
+    /*!
+     *  \brief  stop serving, ongoing uploads are dropped
+     */
+    void stop();
+
+ private:
+    /*!
+     *  \brief  processing routine of accepting connections
+     */
+    void __accept_routine();
+
+    /*!
+     *  \brief  processing routine of serving a connection
+     *  \param  fd  the connection
+     */
+    void __serve_routine(int fd);
+
+    /*!
+     *  \brief  serve a request
+     *  \param  fd          the connection
+     *  \param  request     the request
+     *  \param  key         key of the request
+     *  \param  buf         buffer of payloads, grown on demand
+     *  \return POS_SUCCESS for the connection could be kept;
+     *          POS_FAILED for the connection is broken
+     */
+    pos_retval_t __serve(int fd, const pos_ckpt_obj_msg_t& request, const std::string& key, std::vector<uint8_t>& buf);
+
+    /*!
+     *  \brief  check whether a key stays inside the root, i.e., no empty, "." or ".." component
+     */
+    static bool __is_valid_key(const std::string& key);
+
+    // maximum size of keys, connections sending longer keys are dropped
+    static constexpr uint32_t kMaxKeySize = 4096;
+
+    std::string _endpoint;
+    std::string _root;
+
+    int _listen_fd;
+    bool _is_stop;
+    std::thread _accept_thread;
+
+    // serving threads and their connections
+    std::vector<std::thread> _serve_threads;
+    std::vector<int> _conns;
+
+    // ongoing uploads: index -> (key, file descriptor of the staged object)
+    std::map<uint64_t, std::pair<std::string, int>> _uploads;
+    uint64_t _nb_uploads;
+
+    std::mutex _mutex;
+};
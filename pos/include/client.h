@@ -21,21 +21,32 @@
 #include <set>
 #include <string>
 #include <fstream>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
 #include <stdint.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "pos/include/common.h"
 #include "pos/include/worker.h"
 #include "pos/include/parser.h"
 #include "pos/include/handle.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_io.h"
 #include "pos/include/command.h"
 #include "pos/include/transport.h"
 #include "pos/include/utils/lockfree_queue.h"
+#include "pos/include/utils/mpsc_queue.h"
 #include "pos/include/utils/timer.h"
 
 
 // forward declaration
 class POSWorkspace;
 typedef struct POSAPIContext_QE POSAPIContext_QE_t;
+class POSAPIContextPool;
 
 
 /*!
@@ -178,25 +189,27 @@ typedef struct pos_client_ckpt_station {
      */
     inline pos_retval_t collapse_to_image_file(std::string& file_path){
         pos_retval_t retval = POS_SUCCESS;
-        uint64_t i, chunk_size;
-        void *chunk;
-        std::ofstream output_file;
-        
-        output_file.open(file_path.c_str(), std::ios::binary);
-        if(unlikely(output_file.is_open() == false)){
+        uint64_t i;
+        int fd;
+        std::vector<struct iovec> iov;
+        POSCheckpointIOBackend *io;
+
+        POS_CHECK_POINTER(io = POSCheckpointIOBackend::get_instance());
+        fd = io->open(file_path, O_CREAT | O_TRUNC | O_WRONLY);
+        if(unlikely(fd < 0)){
             POS_WARN("failed to collapse checkpoint to binary file: file_path(%s)", file_path.c_str());
             retval = POS_FAILED;
             goto exit;
         }
 
         for(i=0; i<__chunks.size(); i++){
-            POS_CHECK_POINTER(chunk = __chunks[i].first);
-            chunk_size = __chunks[i].second;
-            output_file.write((const char*)(chunk), chunk_size);
+            POS_CHECK_POINTER(__chunks[i].first);
+            iov.push_back({ .iov_base = __chunks[i].first, .iov_len = __chunks[i].second });
         }
-
-        output_file.flush();
-        output_file.close();
+        if(iov.size() > 0){
+            retval = io->writev(fd, iov.data(), iov.size(), 0);
+        }
+        close(fd);
 
     exit:
         return retval;
@@ -207,6 +220,42 @@ typedef struct pos_client_ckpt_station {
 } pos_client_ckpt_station_t;
 
 
+/*!
+ *  \brief  metrics of restoring a client
+ */
+typedef struct pos_client_restore_stat {
+    // whether states are reloaded lazily
+    bool is_lazy;
+
+    uint64_t nb_handles;
+    uint64_t nb_lazy_handles;
+
+    // number / size of incremental checkpoint deltas applied on top of the restored states
+    uint64_t nb_delta_records;
+    uint64_t nb_delta_bytes;
+
+    // number of deferred states reloaded on first use / by the background filler
+    uint64_t nb_on_demand_reloads;
+    uint64_t nb_background_reloads;
+
+    // size of the verified records and chunks, and the duration of verifying them
+    uint64_t nb_verified_bytes;
+    double verify_ms;
+
+    // duration from the start of restore to the first API executed after restore,
+    // 0 for no API has been executed yet
+    double time_to_first_api_ms;
+
+    // duration from the start of restore to all states being reloaded, 0 for not finished yet
+    double total_restore_ms;
+
+    pos_client_restore_stat()
+        :   is_lazy(false), nb_handles(0), nb_lazy_handles(0), nb_delta_records(0), nb_delta_bytes(0),
+            nb_on_demand_reloads(0), nb_background_reloads(0), nb_verified_bytes(0), verify_ms(0),
+            time_to_first_api_ms(0), total_restore_ms(0) {}
+} pos_client_restore_stat_t;
+
+
 /*!
  *  \brief  base state of a remote client
  */
@@ -222,7 +271,7 @@ class POSClient {
      */
     POSClient(pos_client_uuid_t id, __pid_t pid, pos_client_cxt_t cxt, POSWorkspace *ws);
     POSClient();
-    ~POSClient(){}
+    ~POSClient();
     
 
     /*!
@@ -246,9 +295,18 @@ class POSClient {
 
     /*!
      *  \brief  obtain the current pc, and update it
+     *  \note   thread-safe, the pc is also used as the ordering stamp within the rpc2parser work queue,
+     *          so every obtained pc should be pushed to that queue
      *  \return the current pc
      */
-    inline uint64_t get_and_move_api_inst_pc(){ _api_inst_pc++; return (_api_inst_pc-1); }
+    inline uint64_t get_and_move_api_inst_pc(){ return this->_api_inst_pc.fetch_add(1, std::memory_order_relaxed); }
+
+
+    /*!
+     *  \brief  obtain the pool of API contexts of this client
+     *  \return pointer to the pool
+     */
+    inline POSAPIContextPool* get_apicxt_pool(){ return this->_apicxt_pool; }
 
 
     // client identifier
@@ -271,13 +329,16 @@ class POSClient {
     friend class POSWorker;
 
     // api instance pc
-    uint64_t _api_inst_pc;
+    std::atomic<uint64_t> _api_inst_pc;
 
     // context to initialize this client
     pos_client_cxt_t _cxt;
 
     // the global workspace
     POSWorkspace *_ws;
+
+    // pool to recycle API contexts of this client
+    POSAPIContextPool *_apicxt_pool;
     /* ====================== basic ====================== */
    
 
@@ -304,30 +365,80 @@ class POSClient {
 
     /*!
      *  \brief  restore handles into this client
-     *  \param  ckpt_dir    directory of checkpoing files of handles
+     *  \note   under lazy restore, only resources are restored here, and the image is held by the client
+     *          until all states are reloaded, either on their first use or by the background filler
+     *  \param  ckpt_image  the opened checkpoint image
      *  \return POS_SUCCESS for successfully restore
      */
-    pos_retval_t restore_handles(std::string& ckpt_dir);
+    pos_retval_t restore_handles(std::shared_ptr<POSCheckpointImage> ckpt_image);
+
+
+    /*!
+     *  \brief  reload the state of the given handle if it was deferred under lazy restore
+     *  \note   this function is called by the worker before executing APIs that rely on the handle
+     *  \param  handle  the handle
+     *  \return POS_SUCCESS for the state is ready
+     */
+    inline pos_retval_t reload_pending_state(POSHandle* handle){
+        pos_retval_t retval = POS_SUCCESS;
+        bool is_reloaded;
+
+        POS_CHECK_POINTER(handle);
+        if(unlikely(handle->is_state_reload_pending())){
+            retval = handle->reload_state_if_pending(/* stream_id */ 0, &is_reloaded);
+            if(is_reloaded){
+                this->_restore_nb_on_demand_reloads.fetch_add(1, std::memory_order_relaxed);
+                this->__release_restored_state(this->_lazy_ckpt_image.get(), handle);
+            }
+        }
+
+        return retval;
+    }
+
+
+    /*!
+     *  \brief  record the execution of an API, to obtain the time-to-first-API after restore
+     *  \note   this function is called by the worker after executing each API
+     */
+    inline void record_api_executed(){
+        if(unlikely(this->_is_restore_first_api_pending.load(std::memory_order_relaxed))){
+            this->__record_first_api();
+        }
+    }
+
+
+    /*!
+     *  \brief  obtain metrics of the last restore of this client
+     *  \param  stat    the returned metrics
+     */
+    void get_restore_stat(pos_client_restore_stat_t& stat);
 
     
     /*!
      *  \brief  restore unexecuted API context into this client
-     *  \param  ckpt_dir    directory of checkpoing files of unexecuted API context
+     *  \note   API contexts are reloaded from per-context records first (e.g., of images written before the
+     *          API context log), and then from the API context log, in the order of the log
+     *  \param  ckpt_image  the opened checkpoint image
      *  \return POS_SUCCESS for successfully restore
      */
-    pos_retval_t restore_apicxts(std::string& ckpt_dir);
+    pos_retval_t restore_apicxts(POSCheckpointImage* ckpt_image);
 
 
  protected:
     /*!
      *  \brief  reallocate a single handle with specific type in the handle manager
      *  \note   this function is called by POSClient::restore_handles
-     *  \param  ckpt_file   path to the checkpoint file of the handle
+     *  \param  mapped      pointer to the metadata of the handle inside the mmapped checkpoint image
+     *  \param  size        size of the metadata
+     *  \param  state       pointer to the raw state section of the handle inside the mmapped checkpoint image
+     *  \param  state_size  size of the raw state section
      *  \param  rid         resource type index of the handle
      *  \param  hid         index of the handle
      *  \return POS_SUCCESS for successfully restore
      */
-    virtual pos_retval_t __reallocate_single_handle(const std::string& ckpt_file, pos_resource_typeid_t rid, pos_u64id_t hid){
+    virtual pos_retval_t __reallocate_single_handle(
+        void* mapped, uint64_t size, const void* state, uint64_t state_size, pos_resource_typeid_t rid, pos_u64id_t hid
+    ){
         return POS_FAILED_NOT_IMPLEMENTED;
     }
 
@@ -342,13 +453,37 @@ class POSClient {
     }
 
 
+    /*!
+     *  \brief  obtain the function to initialize restore threads (e.g., to bind the device context
+     *          of the calling thread), which is called at the beginning of each restore thread
+     *  \note   this function is called by POSClient::restore_handles within the calling thread
+     *  \return the function, nullptr for no initialization is needed
+     */
+    virtual std::function<pos_retval_t()> __get_restore_thread_init(){ return nullptr; }
+
+
+    /*!
+     *  \brief  obtain the number of threads to restore handles from the workspace configuration
+     *  \return number of threads, 0 for number of online cores
+     */
+    uint32_t __get_nb_restore_threads();
+
+
+    /*!
+     *  \brief  identify whether lazy restore is enabled in the workspace configuration
+     *  \return true for enabled
+     */
+    bool __is_lazy_restore_enabled();
+
+
     /*!
      *  \brief  reload unexecuted API context from checkpoint file
      *  \note   this function is called by POSClient::restore_apicxts
-     *  \param  ckpt_file   path to the checkpoint file of the handle
-     *  
+     *  \param  mapped      pointer to the record of the API context inside the mmapped checkpoint image
+     *  \param  size        size of the record
+     *  \return POS_SUCCESS for successfully reload
      */
-    pos_retval_t __reload_apicxt(const std::string& ckpt_file);
+    pos_retval_t __reload_apicxt(const void* mapped, uint64_t size);
 
 
  private: 
@@ -357,6 +492,51 @@ class POSClient {
      *          to other machine
      */
     pos_client_ckpt_station_t __ckpt_station;
+
+
+    /*!
+     *  \brief  background filler of lazy restore, reloads deferred states in priority order
+     *  \param  thread_init     function to initialize the thread, could be nullptr
+     */
+    void __lazy_reload_routine(std::function<pos_retval_t()> thread_init);
+
+
+    /*!
+     *  \brief  stop the background filler of lazy restore, and release the checkpoint image
+     */
+    void __stop_lazy_reload();
+
+
+    /*!
+     *  \brief  release the raw sections that the state of a handle was reloaded from, so that
+     *          assembled chunked / decompressed copies aren't held by the image until it's closed
+     *  \param  ckpt_image  the checkpoint image that the handle was restored from
+     *  \param  handle      the handle whose state has been reloaded
+     */
+    void __release_restored_state(POSCheckpointImage* ckpt_image, POSHandle* handle);
+
+
+    /*!
+     *  \brief  record the time-to-first-API after restore
+     */
+    void __record_first_api();
+
+
+    // checkpoint image held under lazy restore, until all deferred states are reloaded
+    std::shared_ptr<POSCheckpointImage> _lazy_ckpt_image;
+
+    // handles with deferred states, in the order of reloading by the background filler
+    std::vector<POSHandle*> _lazy_handles;
+    std::thread *_lazy_reload_thread;
+    std::atomic<bool> _is_lazy_reload_stop;
+
+    // metrics of the last restore
+    uint64_t _restore_s_tick;
+    pos_client_restore_stat_t _restore_stat;
+    std::atomic<uint64_t> _restore_nb_on_demand_reloads;
+    std::atomic<uint64_t> _restore_nb_background_reloads;
+    std::atomic<bool> _is_restore_first_api_pending;
+    std::mutex _restore_stat_mutex;
     /* =============== checkpoint / restore ============== */
 
 
@@ -392,16 +572,28 @@ class POSClient {
     template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
     pos_retval_t push_q(void *qe);
 
+    /*!
+     *  \brief  push a batch of apicxt queue elements to specified queue
+     *  \note   the consumer of the queue is signaled once for the whole batch
+     *  \tparam qdir    queue direction
+     *  \tparam qtype   type of the queue
+     *  \param  qes     queue elements to be pushed
+     *  \return POS_SUCCESS for successfully pushed
+     */
+    template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
+    pos_retval_t push_q(std::vector<POSAPIContext_QE_t*>* qes);
+
     /*!
      *  \brief  poll apicxt queue element from specified queue
      *  \tparam qdir    queue direction
      *  \tparam qtype   type of the queue
-     *  \param  uuid    uuid for specifying client
-     *  \param  cqes    returned queue elements
+     *  \param  qes         returned queue elements, appended to the back
+     *  \param  max_nb_qes  maximum number of queue elements to poll, so that the daemon could bound the
+     *                      work of each wake-up
      *  \return POS_SUCCESS for successfully polling
      */
     template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
-    pos_retval_t poll_q(std::vector<POSAPIContext_QE*>* qes);
+    pos_retval_t poll_q(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes = kPollAllQEs);
 
     /*!
      *  \brief  poll cmd queue element from specified queue
@@ -416,6 +608,8 @@ class POSClient {
 
     /*!
      *  \brief  clear all elements inside the queue
+     *  \note   the references held by apicxt queues are returned, while command elements are owned by
+     *          their issuers
      *  \tparam qdir    queue direction
      *  \tparam qtype   type of the queue
      *  \param  uuid    uuid for specifying client
@@ -424,9 +618,46 @@ class POSClient {
     template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
     pos_retval_t clear_q();
 
+    /*!
+     *  \brief  obtain the event that the parser / worker daemon parks on while its queues are empty
+     *  \note   the event is signaled by pushing to any queue consumed by the daemon
+     */
+    inline POSWaitEvent* get_parser_wait_event(){ return &this->_parser_wait_event; }
+    inline POSWaitEvent* get_worker_wait_event(){ return &this->_worker_wait_event; }
+
+    /*!
+     *  \brief  obtain the budgets of parser / worker daemons before they park
+     *  \param  policy  the returned policy
+     */
+    void get_daemon_wait_policy(pos_wait_policy_t& policy);
+
+    /*!
+     *  \brief  obtain the maximum number of apicxt queue elements that parser / worker daemons process
+     *          per polling round
+     *  \return the batch size
+     */
+    uint64_t get_daemon_poll_batch_size();
+
+    // poll all queue elements within the queue
+    static constexpr uint64_t kPollAllQEs = UINT64_MAX;
+
+    // number of queue elements to pop from a queue at once while polling
+    static constexpr uint64_t kPollChunkSize = 64;
+
+    // default maximum number of apicxt queue elements that daemons process per polling round
+    static constexpr uint64_t kDefaultDaemonPollBatchSize = 64;
+
+    /*!
+     *  \brief  wake up the parked parser / worker daemons, e.g., after the status of the client changed
+     */
+    inline void wake_daemons(){
+        this->_parser_wait_event.notify();
+        this->_worker_wait_event.notify();
+    }
+
  protected:
-    // api context queue pairs from RPC frontend to parser
-    POSLockFreeQueue<POSAPIContext_QE_t*> *_apicxt_rpc2parser_wq;
+    // api context queue pairs from RPC frontend to parser, the work queue accepts multiple RPC threads
+    POSMPSCQueue<POSAPIContext_QE_t*> *_apicxt_rpc2parser_wq;
     POSLockFreeQueue<POSAPIContext_QE_t*> *_apicxt_rpc2parser_cq;
 
     // api context work queue from parser to worker
@@ -449,6 +680,10 @@ class POSClient {
     POSLockFreeQueue<POSCommand_QE_t*> *_cmd_oob2parser_wq;
     POSLockFreeQueue<POSCommand_QE_t*> *_cmd_oob2parser_cq;
 
+    // events that parser / worker daemon parks on
+    POSWaitEvent _parser_wait_event;
+    POSWaitEvent _worker_wait_event;
+
  private:
     /*!
      *  \brief  create queue group for this client
@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include <set>
+#include <vector>
 #include "pos/include/common.h"
 #include "pos/include/log.h"
 
@@ -61,6 +62,13 @@ typedef struct POSCommand_QE {
     std::set<POSHandle*> predump_handles;
     std::set<POSHandle*> dump_handles;
 
+    /*!
+     *  \brief  stateful handles modified since the previous checkpoint op, collected from (and cleared
+     *          within) the dirty bitmaps of handle managers, in the order of handle ids per manager
+     *  \note   if the checkpoint op fails, these handles are marked as modified again
+     */
+    std::vector<POSHandle*> dirty_handles;
+
     /*!
      *  \brief  record all handles that need to be checkpointed within this checkpoint op
      *  \param  handle_set  sets of handles to be added
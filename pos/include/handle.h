@@ -27,6 +27,7 @@
 #include <thread>
 #include <future>
 #include <atomic>
+#include <mutex>
 #include <filesystem>
 #include <stdint.h>
 #include <assert.h>
@@ -38,7 +39,12 @@
 #include "pos/include/common.h"
 #include "pos/include/log.h"
 #include "pos/include/utils/lockfree_queue.h"
+#include "pos/include/utils/address_index.h"
+#include "pos/include/utils/dirty_bitmap.h"
 #include "pos/include/checkpoint.h"
+#include "pos/include/checkpoint_delta.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/persist_executor.h"
 
 
 #define kPOS_HandleDefaultSize   (1<<4)
@@ -154,11 +160,11 @@ class POSHandle {
         state_size(state_size_),
         latest_version(0),
         ckpt_bag(nullptr),
-        _hm(hm),
-        _persist_thread(nullptr),
-        _persist_promise(nullptr)
+        ckpt_delta_chain(nullptr),
+        _hm(hm)
     {
         this->_state_preserve_counter.store(0);
+        this->_is_state_reload_pending.store(false);
     }
 
 
@@ -182,11 +188,11 @@ class POSHandle {
         state_size(state_size_),
         latest_version(0),
         ckpt_bag(nullptr),
-        _hm(hm),
-        _persist_thread(nullptr),
-        _persist_promise(nullptr)
+        ckpt_delta_chain(nullptr),
+        _hm(hm)
     {
         this->_state_preserve_counter.store(0);
+        this->_is_state_reload_pending.store(false);
     }
 
 
@@ -207,11 +213,11 @@ class POSHandle {
         state_size(0),
         latest_version(0),
         ckpt_bag(nullptr),
-        _hm(hm),
-        _persist_thread(nullptr),
-        _persist_promise(nullptr)
+        ckpt_delta_chain(nullptr),
+        _hm(hm)
     {
         this->_state_preserve_counter.store(0);
+        this->_is_state_reload_pending.store(false);
     }
 
 
@@ -470,6 +476,16 @@ class POSHandle {
     POSCheckpointBag *ckpt_bag;
 
 
+    /*!
+     *  \brief  chain of incremental checkpoints of the state, nullptr for the state is always checkpointed
+     *          as a whole
+     *  \note   initialized in __init_ckpt_bag by stateful handles that support incremental checkpoint
+     *          (e.g., memory), under POS_CONF_EVAL_CkptEnableIncremental; the modified ranges are recorded
+     *          by the worker thread from output / inout handle views of each executed API
+     */
+    POSCheckpointDeltaChain *ckpt_delta_chain;
+
+
     /*!
      *  \brief  reset the state preserve counter to zero, to start a new checkpoint round
      */
@@ -508,6 +524,16 @@ class POSHandle {
     pos_retval_t checkpoint_commit_sync(uint64_t version_id, std::string ckpt_dir="", uint64_t stream_id=0);
 
 
+    /*!
+     *  \brief  mark the commit of the given version as finished, i.e., the stream that commits it has been
+     *          synchronized, so that its host-side checkpoint slot could be spilled under the budget of
+     *          host checkpoint memory
+     *  \note   this function should be called at the worker thread after checkpoint_commit_async
+     *  \param  version_id  version of the checkpoint
+     */
+    void checkpoint_settle(uint64_t version_id);
+
+
     /*!
      *  \brief  commit the host-side state of the resource behind this handle
      *  \note   this function should be called at the parser thread
@@ -547,9 +573,12 @@ class POSHandle {
     // counter for exclude copy-on-write and checkpoint process
     std::atomic<uint8_t> _state_preserve_counter;
 
-    // thread to persist checkpoint of the current handle
-    std::thread *_persist_thread;
-    std::promise<pos_retval_t> *_persist_promise;
+    // whether the state is pending to be reloaded under lazy restore
+    std::atomic<bool> _is_state_reload_pending;
+    std::mutex _state_reload_mutex;
+
+    // completion of the persisting task of the current handle, executed by the persist executor
+    std::future<pos_retval_t> _persist_future;
 
 
     /*!
@@ -591,13 +620,14 @@ class POSHandle {
 
 
     /*!
-     *  \brief  async thread to persist the checkpoint to file system
+     *  \brief  async routine to persist the checkpoint to file system, executed by the persist executor
      *  \param  ckpt_slot   the checkopoint slot which stores the host-side checkpoint
-     *  \param  ckpt_dir    directory to store the checkpoint
+     *  \param  ckpt_image  writer of the checkpoint image to append to, the append should
+     *                      has been announced by prepare_append
      *  \param  stream_id   index of the stream on which checkpoint is commited
      *  \return POS_SUCCESS for successfully persist
      */
-    pos_retval_t __persist_async_thread(POSCheckpointSlot* ckpt_slot, std::string ckpt_dir, uint64_t stream_id=0);
+    pos_retval_t __persist_async_thread(POSCheckpointSlot* ckpt_slot, POSCheckpointImageWriter* ckpt_image, uint64_t stream_id=0);
 
 
     /*!
@@ -630,11 +660,50 @@ class POSHandle {
 
 
     /*!
-     *  \note   binary area that mmap the checkpoint file of this handle,
+     *  \note   raw state section of this handle inside the mmapped checkpoint image,
      *          this field is used during restore phrase
+     *  \note   the area is owned by the POSCheckpointImage, don't unmap it
      */
-    void* restore_binary_mapped;
-    uint64_t restore_binary_mapped_size;
+    const void* restore_state_mapped;
+    uint64_t restore_state_mapped_size;
+
+
+    /*!
+     *  \note   delta sections of this handle inside the mmapped checkpoint image, in the order of the chain,
+     *          which are applied on top of restore_state_mapped while reloading the state
+     *  \note   the areas are owned by the POSCheckpointImage, don't unmap them
+     */
+    std::vector<pos_ckpt_delta_section_t> restore_state_deltas;
+
+
+    /*!
+     *  \brief  defer reloading the state of this handle under lazy restore, the state would be reloaded
+     *          by reload_state_if_pending on its first use, or by the background filler of the client
+     *  \note   restore_state_mapped should remain valid until the state is reloaded
+     */
+    inline void mark_state_reload_pending(){
+        this->mark_state_status(kPOS_HandleStatus_StateMiss);
+        this->_is_state_reload_pending.store(true, std::memory_order_release);
+    }
+
+
+    /*!
+     *  \brief  identify whether the state of this handle is still pending to be reloaded
+     */
+    inline bool is_state_reload_pending(){
+        return this->_is_state_reload_pending.load(std::memory_order_acquire);
+    }
+
+
+    /*!
+     *  \brief  reload the state of this handle if it was deferred under lazy restore
+     *  \note   thread-safe, the state is reloaded exactly once among concurrent callers, and all
+     *          callers return after the state is ready
+     *  \param  stream_id       stream for reloading the state
+     *  \param  is_reloaded     whether the state is reloaded by this call, could be nullptr
+     *  \return POS_SUCCESS for the state is ready
+     */
+    pos_retval_t reload_state_if_pending(uint64_t stream_id=0, bool* is_reloaded=nullptr);
 
 
  protected:
@@ -651,11 +720,26 @@ class POSHandle {
     /*!
      *  \brief  reload state of this handle back to the device
      *  \note   implemented by specific handle type
-     *  \param  mapped          mmap area of the checkpoint file of this handle
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
-     *  \param  stream_id       stream for reloading the state
+     *  \param  state       raw state section of this handle inside the mmapped checkpoint image
+     *  \param  state_size  size of the raw state section
+     *  \param  stream_id   stream for reloading the state
+     */
+    virtual pos_retval_t __reload_state(const void* state, uint64_t state_size, uint64_t stream_id){
+        return POS_FAILED_NOT_IMPLEMENTED;
+    }
+
+
+    /*!
+     *  \brief  reload a range of state of this handle back to the device, used to apply deltas of
+     *          incremental checkpoint on top of the reloaded base
+     *  \note   implemented by specific handle type that supports incremental checkpoint, the reload could be
+     *          asynchronous, the caller synchronizes the stream after all ranges are reloaded
+     *  \param  state       the state of the range
+     *  \param  offset      offset of the range from the start of the state
+     *  \param  size        size of the range
+     *  \param  stream_id   stream for reloading the state
      */
-    virtual pos_retval_t __reload_state(void* mapped, uint64_t ckpt_file_size, uint64_t stream_id){
+    virtual pos_retval_t __reload_state_range(const void* state, uint64_t offset, uint64_t size, uint64_t stream_id){
         return POS_FAILED_NOT_IMPLEMENTED;
     }
     /* ======================== restore handle & state ======================= */
@@ -878,7 +962,8 @@ class POSHandleManager {
         POS_CHECK_POINTER(handle);
 
         if(likely(POS_FAILED_NOT_EXIST == __get_handle_by_client_addr(addr, &__tmp))){
-            _handle_address_map[addr_u64] = handle;
+            // zero-sized handle still resolves from its base address
+            _handle_address_index.insert(addr_u64, std::max<uint64_t>(handle->size, 1), handle);
         } else {
             POS_CHECK_POINTER(__tmp);
 
@@ -897,6 +982,18 @@ class POSHandleManager {
         return retval;
     }
 
+
+    /*!
+     *  \brief  obtain the epoch of client-side addresses within this manager
+     *  \note   the epoch changes whenever a handle address is recorded or removed (e.g., allocated or
+     *          freed), so that any result resolved from client-side addresses under the same epoch
+     *          stays valid
+     *  \return the epoch
+     */
+    inline uint64_t get_address_epoch() const {
+        return this->_handle_address_index.get_generation();
+    }
+
  protected:
     uint64_t _base_ptr;
     
@@ -908,7 +1005,8 @@ class POSHandleManager {
 
 
  private:
-    std::map<uint64_t, T_POSHandle*> _handle_address_map;
+    // index from client-side address ranges to handles, only contains handles that are not deleted
+    POSAddressIndex<T_POSHandle*> _handle_address_index;
     /* ======================== address management =========================== */
 
 
@@ -920,7 +1018,7 @@ class POSHandleManager {
      */
     inline void record_modified_handle(T_POSHandle* handle){
         POS_CHECK_POINTER(handle);
-        _modified_handles.insert(handle);
+        _modified_handles.set(handle->id);
     }
 
 
@@ -934,27 +1032,40 @@ class POSHandleManager {
 
     /*!
      *  \brief  get all records of modified handles
-     *  \return all records of modified handles
+     *  \param  handles  vector to append the modified handles, in the order of their ids
      */
-    inline std::set<T_POSHandle*>& get_modified_handles(){
-        return _modified_handles;
+    inline void get_modified_handles(std::vector<T_POSHandle*>* handles){
+        POS_CHECK_POINTER(handles);
+        _modified_handles.for_each([&](uint64_t id){
+            handles->push_back(this->get_handle_by_id(id));
+        });
+    }
+
+
+    /*!
+     *  \brief  check whether a handle is modified since last checkpoint
+     *  \param  handle  the handle to be checked
+     *  \return identify whether the handle is modified
+     */
+    inline bool is_handle_modified(T_POSHandle* handle){
+        POS_CHECK_POINTER(handle);
+        return _modified_handles.test(handle->id);
     }
 
 
  protected:
     /*!
-     *  \brief  this map records all modified buffers since last checkpoint, 
-     *          will be updated during parsing, and cleared during launching
-     *          checkpointing op
+     *  \brief  ids of all modified handles since last checkpoint, will be updated during
+     *          parsing, and cleared during launching checkpointing op
      */
-    std::set<T_POSHandle*> _modified_handles;
+    POSDirtyBitmap _modified_handles;
     /* ======================== incremental support ========================== */
 
 
     /* ===================== handle status management ======================== */
  public:
     inline pos_retval_t mark_handle_status(T_POSHandle *handle, pos_handle_status_t status){
-        typename std::map<uint64_t, T_POSHandle*>::iterator handle_map_iter;
+        T_POSHandle *indexed_handle;
         
         POS_CHECK_POINTER(handle);
         
@@ -988,13 +1099,13 @@ class POSHandleManager {
             handle->status = kPOS_HandleStatus_Delete_Pending;
 
             // remove the handle from the address map
-            handle_map_iter = _handle_address_map.find((uint64_t)(handle->client_addr));
-            if (likely(handle_map_iter != _handle_address_map.end())) {
+            indexed_handle = _handle_address_index.find((uint64_t)(handle->client_addr));
+            if (likely(indexed_handle != nullptr)) {
                 _deleted_handle_address_map.insert({
                     /* client_addr */ (uint64_t)(handle->client_addr),
-                    /* handle */ handle_map_iter->second
+                    /* handle */ indexed_handle
                 });
-                _handle_address_map.erase((uint64_t)(handle->client_addr));   
+                _handle_address_index.erase((uint64_t)(handle->client_addr));
             }
 
             POS_DEBUG_C(
@@ -1007,14 +1118,14 @@ class POSHandleManager {
             handle->status = kPOS_HandleStatus_Deleted;
 
             // remove the handle from the address map (should be already deleted in the last case)
-            handle_map_iter = _handle_address_map.find((uint64_t)(handle->client_addr));
-            if (unlikely(handle_map_iter != _handle_address_map.end())) {
+            indexed_handle = _handle_address_index.find((uint64_t)(handle->client_addr));
+            if (unlikely(indexed_handle != nullptr)) {
                 POS_WARN_C_DETAIL("remove handle from address map when mark it as deleted, is this a bug?");
                 _deleted_handle_address_map.insert({
                     /* client_addr */ (uint64_t)(handle->client_addr),
-                    /* handle */ handle_map_iter->second
+                    /* handle */ indexed_handle
                 });
-                _handle_address_map.erase((uint64_t)(handle->client_addr));
+                _handle_address_index.erase((uint64_t)(handle->client_addr));
             }
 
             POS_DEBUG_C(
@@ -1034,12 +1145,17 @@ class POSHandleManager {
  public:
     /*!
      *  \brief  restore single handle from binary checkpoint file in this handle manager
-     *  \param  ckpt_file   path to the checkpoint file
+     *  \param  mapped      pointer to the metadata of the handle inside the mmapped checkpoint image
+     *  \param  size        size of the metadata
+     *  \param  state       pointer to the raw state section of the handle inside the mmapped checkpoint image
+     *  \param  state_size  size of the raw state section
      *  \param  hid         handle index to be restored
      *  \param  handle      pointer to the handle to be restored
      *  \return POS_SUCCESS for successfully restore
      */
-    pos_retval_t reallocate_single_handle(const std::string& ckpt_file, pos_u64id_t hid, T_POSHandle **handle);
+    pos_retval_t reallocate_single_handle(
+        void* mapped, uint64_t size, const void* state, uint64_t state_size, pos_u64id_t hid, T_POSHandle **handle
+    );
 
 
     /*!
@@ -1117,8 +1233,8 @@ class POSHandleManager {
      *  \brief  reallocate the extra fields of handle with specific type in this handle manager
      *  \note   this function is called by reallocate_single_handle, and implemented by
      *          specific handle type
-     *  \param  mapped          mmap handle of the file
-     *  \param  ckpt_file_size  size of the checkpoint size (mmap area)
+     *  \param  mapped          record of the handle inside the mmapped checkpoint image
+     *  \param  ckpt_file_size  size of the record
      *  \param  handle          pointer to the restored handle
      *  \return POS_SUCCESS for successfully restore
      */
@@ -1280,62 +1396,35 @@ template<class T_POSHandle>
 pos_retval_t POSHandleManager<T_POSHandle>::__get_handle_by_client_addr(void* client_addr, T_POSHandle** handle, uint64_t* offset){
     pos_retval_t ret = POS_SUCCESS;
     T_POSHandle *handle_ptr;
-    uint64_t i;
+    uint64_t base;
     uint64_t client_addr_u64 = (uint64_t)(client_addr);
 
-    typename std::map<uint64_t, T_POSHandle*>::iterator handle_map_iter;
-
     POS_CHECK_POINTER(handle);
-    
+
     /*!
-     *  \note   direct case: the given address is exactly the base address
+     *  \note   resolve to the handle with the greatest base address not beyond the given address, which
+     *          covers both the base address itself and those within the handle (e.g., sub-buffer
+     *          pointers passed to kernels)
      */
-    if(unlikely(this->_handle_address_map.count(client_addr_u64) > 0)){
-        *handle = this->_handle_address_map[client_addr_u64];
-
-        /*!
-         *  \note   those handle that has been deleted (i.e., kPOS_HandleStatus_Deleted) and 
-         *          are going to be deleted (i.e., kPOS_HandleStatus_Delete_Pending) must be
-         *          not in the map! 
-         */
-        POS_ASSERT(
-            (*handle)->status != kPOS_HandleStatus_Deleted 
-            && (*handle)->status != kPOS_HandleStatus_Delete_Pending
-        );
-
-        if(unlikely(offset != nullptr)){
-            *offset = 0;
-        }
-        goto exit;
+    handle_ptr = this->_handle_address_index.lookup(client_addr_u64, &base);
+    if(unlikely(handle_ptr == nullptr)){
+        goto not_found;
     }
-    
+
     /*!
-     *  \brief  indirect case: the given address is beyond the base address
-     *  \note   most of query will fall back to this part
+     *  \note   those handle that has been deleted (i.e., kPOS_HandleStatus_Deleted) and 
+     *          are going to be deleted (i.e., kPOS_HandleStatus_Delete_Pending) must be
+     *          not in the index! 
      */
-    handle_map_iter = this->_handle_address_map.lower_bound(client_addr_u64);
-    if(handle_map_iter != this->_handle_address_map.begin()){
-        // get the first handle less than the given address
-        handle_map_iter--;
-        handle_ptr = handle_map_iter->second;
-
-        POS_ASSERT(
-            handle_ptr->status != kPOS_HandleStatus_Deleted && handle_ptr->status != kPOS_HandleStatus_Delete_Pending
-        );
-
-        if(likely(
-            (uint64_t)(handle_ptr->client_addr) <= client_addr_u64 
-            && client_addr_u64 < (uint64_t)(handle_ptr->client_addr) + handle_ptr->size
-        )){
-            *handle = handle_ptr;
-
-            if(offset != nullptr){
-                *offset = client_addr_u64 - (uint64_t)(handle_ptr->client_addr);
-            }
+    POS_ASSERT(
+        handle_ptr->status != kPOS_HandleStatus_Deleted && handle_ptr->status != kPOS_HandleStatus_Delete_Pending
+    );
 
-            goto exit;
-        }
+    *handle = handle_ptr;
+    if(offset != nullptr){
+        *offset = client_addr_u64 - base;
     }
+    goto exit;
 
 not_found:
     *handle = nullptr;
@@ -1447,64 +1536,31 @@ exit:
 
 
 template<class T_POSHandle>
-pos_retval_t POSHandleManager<T_POSHandle>::reallocate_single_handle(const std::string& ckpt_file, pos_u64id_t hid, T_POSHandle **handle){
+pos_retval_t POSHandleManager<T_POSHandle>::reallocate_single_handle(
+    void* mapped, uint64_t size, const void* state, uint64_t state_size, pos_u64id_t hid, T_POSHandle **handle
+){
     pos_retval_t retval = POS_SUCCESS;
-    int fd;
-    struct stat sb;
-    void* mapped = nullptr;
 
     POS_CHECK_POINTER(handle);
     *handle = nullptr;
 
-    POS_ASSERT(ckpt_file.size() > 0);
-    
-    if (unlikely(!std::filesystem::exists(ckpt_file))) {
-        POS_WARN_C("failed to restore handles, ckpt file not exist: %s", ckpt_file.c_str())
-        retval = POS_FAILED_INVALID_INPUT;
-        goto exit;
-    }
-
-    // open the file
-    fd = open(ckpt_file.c_str(), O_RDONLY);
-    if(unlikely(fd < 0)) {
-        POS_WARN_C("failed to restore handle, failed to open ckpt file: ckpt_file(%s)", ckpt_file.c_str());
-        retval = POS_FAILED;
-        goto exit;
-    }
-
-    // obtain the metadata of the file
-    if(unlikely(fstat(fd, &sb) == -1)) {
-        POS_WARN_C("failed to restore handle, failed obtain medadata of ckpt file: ckpt_file(%s)", ckpt_file.c_str());
-        retval = POS_FAILED;
-        goto exit;
-    }
-
-    // mmap the file
-    mapped = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if(unlikely(mapped == MAP_FAILED)) {
-        POS_WARN_C("failed to restore handle, failed mmap the ckpt file: ckpt_file(%s)", ckpt_file.c_str());
-        retval = POS_FAILED;
-        goto exit;
-    }
+    POS_CHECK_POINTER(mapped);
+    POS_ASSERT(size > 0);
 
-    // deserialize and reallocate new handle from the ckpt file
-    retval = this->__reallocate_single_handle(mapped, sb.st_size, handle);
+    // deserialize and reallocate new handle from the checkpoint record
+    retval = this->__reallocate_single_handle(mapped, size, handle);
     if(unlikely(retval != POS_SUCCESS)){
-        POS_WARN_C("failed to restore handle, restored with specific type: ckpt_file(%s), retval(%u)", ckpt_file.c_str(), retval);
+        POS_WARN_C("failed to restore handle, restored with specific type: hid(%lu), retval(%u)", hid, retval);
         goto exit;
     }
     POS_CHECK_POINTER(*handle);
 
-    // record mmaped area for later reload state
+    // record the raw state section for later reload state
     if((*handle)->state_size > 0){
-        (*handle)->restore_binary_mapped = mapped;
-        (*handle)->restore_binary_mapped_size = sb.st_size;
+        (*handle)->restore_state_mapped = state;
+        (*handle)->restore_state_mapped_size = state_size;
     }
 
 exit:
-    if(unlikely(retval != POS_SUCCESS) || (*handle != nullptr && (*handle)->state_size == 0)){ 
-        if(mapped != nullptr && mapped != MAP_FAILED){ munmap(mapped, sb.st_size); }
-    }
-    close(fd);
     return retval;
 }
@@ -96,6 +96,9 @@ class POSParser {
 
     // parser function map
     std::map<uint64_t, pos_runtime_parser_function_t> _parser_functions;
+
+    // parser functions indexed by dense API index, flattened from _parser_functions during init
+    std::vector<pos_runtime_parser_function_t> _parser_function_table;
     
     /*!
      *  \brief  insertion of parse functions
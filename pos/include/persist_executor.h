@@ -0,0 +1,202 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+/*!
+ *  \brief  statistics of the persist executor
+ */
+typedef struct pos_persist_executor_stat {
+    // number of worker threads
+    uint32_t nb_threads;
+
+    // capacity of the task queue
+    uint64_t queue_capacity;
+
+    // number of submitted / finished / failed tasks
+    uint64_t nb_submitted;
+    uint64_t nb_finished;
+    uint64_t nb_failed;
+
+    // number of submissions that were blocked due to full queue
+    uint64_t nb_blocked;
+
+    pos_persist_executor_stat()
+        :   nb_threads(0), queue_capacity(0), nb_submitted(0), nb_finished(0),
+            nb_failed(0), nb_blocked(0) {}
+} pos_persist_executor_stat_t;
+
+
+/*!
+ *  \brief  process-wide executor of persisting tasks
+ *  \note   persisting of handles is dispatched to a fixed set of worker threads through a bounded
+ *          queue, instead of spawning one thread per handle per persist; submission blocks once
+ *          the queue is full, so that the committer can't run arbitrarily ahead of the storage
+ *  \note   tasks could be tagged by the dump they belong to (i.e., the checkpoint directory), and
+ *          flush returns a future that is ready once all tasks of the dump are finished
+ *  \note   all methods are thread-safe
+ */
+class POSPersistExecutor {
+ public:
+    /*!
+     *  \brief  obtain the process-wide executor
+     *  \return pointer to the executor
+     */
+    static POSPersistExecutor* get_instance();
+
+
+    /*!
+     *  \brief  (re)configure the executor, the executor would otherwise be lazily started
+     *          with default parameters at the first submission
+     *  \note   reconfiguring waits until all queued tasks are finished
+     *  \param  nb_threads      number of worker threads, 0 for number of online cores
+     *  \param  queue_capacity  maximum number of queued tasks
+     *  \return POS_SUCCESS for successfully configured;
+     *          POS_FAILED_INVALID_INPUT for invalid parameters
+     */
+    pos_retval_t init(uint32_t nb_threads = 0, uint64_t queue_capacity = kDefaultQueueCapacity);
+
+
+    /*!
+     *  \brief  stop all worker threads after queued tasks are finished
+     */
+    void deinit();
+
+
+    /*!
+     *  \brief  submit a persisting task
+     *  \note   this function blocks while the queue is full
+     *  \param  task    the task to execute
+     *  \param  tag     tag of the dump that the task belongs to, empty for untagged
+     *  \return future of the return value of the task
+     */
+    std::future<pos_retval_t> submit(std::function<pos_retval_t()> task, const std::string& tag = "");
+
+
+    /*!
+     *  \brief  obtain completion of all tasks submitted under the given tag so far
+     *  \note   the records of the tag are released once the returned future is ready; tags whose tasks
+     *          all succeeded are also released once they're finished without any waiter, while a failure
+     *          is kept until it's collected by the next flush of the tag, so a dump should flush its tag
+     *          before reusing it
+     *  \param  tag the tag of the dump
+     *  \return future which is ready once all tasks of the tag are finished, its value is
+     *          POS_SUCCESS if all of them succeeded, otherwise the first failure
+     */
+    std::future<pos_retval_t> flush(const std::string& tag);
+
+
+    /*!
+     *  \brief  process items in parallel by the calling thread along with worker threads, e.g., to
+     *          split a large state into frames
+     *  \note   helper tasks are only queued while the queue isn't full, and the calling thread never
+     *          waits for items that no thread has claimed, so this could be called from within a task
+     *  \param  nb_items        number of items
+     *  \param  func            function to process the item of the given index
+     *  \param  max_nb_helpers  maximum number of helper tasks to queue, 0 for number of worker threads
+     *  \return POS_SUCCESS if all items succeeded, otherwise the first failure
+     */
+    pos_retval_t parallel_for(uint64_t nb_items, std::function<pos_retval_t(uint64_t)> func, uint32_t max_nb_helpers = 0);
+
+
+    /*!
+     *  \brief  obtain statistics of the executor
+     *  \param  stat    returned statistics
+     */
+    void get_stat(pos_persist_executor_stat_t& stat);
+
+
+    // default capacity of the task queue
+    static constexpr uint64_t kDefaultQueueCapacity = 4096;
+
+ private:
+    POSPersistExecutor() : _is_stop(false) {}
+    ~POSPersistExecutor();
+
+    /*!
+     *  \brief  queued task
+     */
+    typedef struct pos_persist_task {
+        std::function<pos_retval_t()> func;
+        std::promise<pos_retval_t> promise;
+        std::string tag;
+    } pos_persist_task_t;
+
+    /*!
+     *  \brief  completion record of tasks under the same tag
+     */
+    typedef struct pos_persist_group {
+        uint64_t nb_pending;
+        pos_retval_t retval;
+        std::vector<std::promise<pos_retval_t>> waiters;
+        pos_persist_group() : nb_pending(0), retval(POS_SUCCESS) {}
+    } pos_persist_group_t;
+
+    /*!
+     *  \brief  start worker threads, should be called with _mutex held
+     *  \param  nb_threads      number of worker threads, 0 for number of online cores
+     *  \param  queue_capacity  maximum number of queued tasks
+     */
+    void __start(uint32_t nb_threads, uint64_t queue_capacity);
+
+    /*!
+     *  \brief  stop and join all worker threads
+     *  \param  lock    lock guard of _mutex, would be released while joining
+     */
+    void __stop(std::unique_lock<std::mutex>& lock);
+
+    /*!
+     *  \brief  processing routine of worker threads
+     */
+    void __worker_routine();
+
+    // worker threads
+    std::vector<std::thread*> _threads;
+
+    // queued tasks
+    std::deque<pos_persist_task_t*> _queue;
+    uint64_t _queue_capacity;
+
+    // tag -> completion record
+    std::map<std::string, pos_persist_group_t> _groups;
+
+    // whether the worker threads are requested to stop
+    bool _is_stop;
+
+    pos_persist_executor_stat_t _stat;
+
+    std::mutex _mutex;
+    std::condition_variable _not_empty_cv;
+    std::condition_variable _not_full_cv;
+
+    // notified once the reconfiguration (i.e., __stop) is finished
+    std::condition_variable _reconfig_cv;
+};
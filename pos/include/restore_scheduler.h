@@ -0,0 +1,451 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/utils/timer.h"
+
+
+/*!
+ *  \brief  statistics of restoring a layer of handles
+ */
+typedef struct pos_restore_layer_stat {
+    uint64_t nb_handles;
+    uint64_t nb_state_bytes;
+
+    // wall time of the layer
+    double duration_ms;
+
+    // accumulated time of restoring resources / reloading states among all threads
+    double restore_ms;
+    double reload_ms;
+
+    pos_restore_layer_stat()
+        :   nb_handles(0), nb_state_bytes(0), duration_ms(0), restore_ms(0), reload_ms(0) {}
+} pos_restore_layer_stat_t;
+
+
+/*!
+ *  \brief  statistics of a restore run
+ */
+typedef struct pos_restore_stat {
+    uint32_t nb_threads;
+    double duration_ms;
+    uint64_t nb_prefetched_bytes;
+    std::vector<pos_restore_layer_stat_t> layers;
+
+    pos_restore_stat() : nb_threads(0), duration_ms(0), nb_prefetched_bytes(0) {}
+} pos_restore_stat_t;
+
+
+/*!
+ *  \brief  restore handles layer by layer along their parent edges, handles within a layer are
+ *          restored (and their states reloaded) in parallel
+ *  \note   a handle is placed at the layer of its longest path from the roots, so that all of its
+ *          parents are restored in earlier layers; parents outside the given handles are considered
+ *          as available already. this is the reverse of the layering of collect_broken_handles,
+ *          without duplication of shared parents
+ *  \note   a prefetcher thread issues readahead of the mmapped states ahead of the reloading, so that
+ *          reading the checkpoint image overlaps with reloading states of earlier handles
+ *  \note   with a single thread, handles are restored serially in layer order without prefetching
+ *  \note   T_POSHandle should provide parent_handles, restore(), reload_state(stream_id),
+ *          state_size, restore_state_mapped and restore_state_mapped_size, as POSHandle does
+ */
+template<class T_POSHandle>
+class POSRestoreScheduler {
+ public:
+    /*!
+     *  \param  nb_threads      number of restore threads, 0 for number of online cores
+     *  \param  prefetch_size   maximum bytes of states that could be prefetched ahead of reloading,
+     *                          0 for disabling prefetch
+     */
+    POSRestoreScheduler(uint32_t nb_threads = 0, uint64_t prefetch_size = kDefaultPrefetchSize)
+        :   _nb_threads(nb_threads), _prefetch_size(prefetch_size), _nb_handles(0), _is_prefetching(false)
+    {
+        if(this->_nb_threads == 0){
+            this->_nb_threads = std::thread::hardware_concurrency();
+            if(unlikely(this->_nb_threads == 0)){ this->_nb_threads = 1; }
+        }
+    }
+    ~POSRestoreScheduler() = default;
+
+
+    /*!
+     *  \brief  build restore layers of the given handles
+     *  \param  handles handles to be restored
+     *  \return POS_SUCCESS for successfully built;
+     *          POS_FAILED_INVALID_INPUT for cyclic parent edges
+     */
+    pos_retval_t schedule(std::vector<T_POSHandle*>& handles){
+        pos_retval_t retval = POS_SUCCESS;
+        uint64_t i;
+        uint32_t layer_id;
+        std::unordered_map<T_POSHandle*, int64_t> layer_map;
+
+        this->_layers.clear();
+        this->_nb_handles = 0;
+
+        // -1 for not visited
+        for(i=0; i<handles.size(); i++){
+            POS_CHECK_POINTER(handles[i]);
+            layer_map[handles[i]] = -1;
+        }
+
+        for(i=0; i<handles.size(); i++){
+            if(unlikely(POS_SUCCESS != (retval = this->__get_layer(handles[i], layer_map, layer_id)))){
+                POS_WARN_C("failed to schedule restore, cyclic parent edges detected");
+                this->_layers.clear();
+                goto exit;
+            }
+        }
+
+        for(i=0; i<handles.size(); i++){
+            layer_id = static_cast<uint32_t>(layer_map[handles[i]]);
+            if(this->_layers.size() <= layer_id){ this->_layers.resize(layer_id + 1); }
+            this->_layers[layer_id].push_back(handles[i]);
+        }
+        this->_nb_handles = handles.size();
+
+    exit:
+        return retval;
+    }
+
+
+    /*!
+     *  \brief  restore all scheduled handles
+     *  \note   layers are restored one after another, the run stops after the layer where the
+     *          first failure occurs
+     *  \param  thread_init     function to be called at the beginning of each restore thread
+     *                          (e.g., to bind the device context), could be nullptr
+     *  \param  stream_id       index of the stream to reload states
+     *  \param  with_state      whether to reload states, otherwise only resources are restored
+     *  \return POS_SUCCESS for successfully restored; otherwise the first failure
+     */
+    pos_retval_t run(
+        std::function<pos_retval_t()> thread_init = nullptr, uint64_t stream_id = 0, bool with_state = true
+    ){
+        pos_retval_t retval = POS_SUCCESS;
+        uint32_t i, nb_threads;
+        uint64_t layer_id;
+        std::vector<std::thread*> threads;
+        std::thread *prefetch_thread = nullptr;
+        POSUtilHpetTimer run_timer, layer_timer;
+
+        run_timer.start();
+
+        this->_stat = pos_restore_stat_t();
+        this->_stat.layers.resize(this->_layers.size());
+        this->_retval.store(POS_SUCCESS);
+        this->_nb_reloaded_bytes.store(0);
+        this->_is_stop = false;
+        this->_with_state = with_state;
+
+        nb_threads = this->_nb_threads;
+        this->_stat.nb_threads = nb_threads;
+
+        // with a single thread, handles are restored serially within the caller thread, where prefetching
+        // only competes with reloading for the core
+        this->_is_prefetching = this->_prefetch_size > 0 && with_state && nb_threads > 1;
+        if(this->_is_prefetching){
+            POS_CHECK_POINTER(prefetch_thread = new std::thread(&POSRestoreScheduler::__prefetch_routine, this));
+        }
+
+        for(layer_id=0; layer_id<this->_layers.size(); layer_id++){
+            layer_timer.start();
+
+            this->_cur_layer = &(this->_layers[layer_id]);
+            this->_cur_layer_stat = &(this->_stat.layers[layer_id]);
+            this->_cur_index.store(0);
+            this->_cur_layer_stat->nb_handles = this->_cur_layer->size();
+
+            if(this->_cur_layer->size() == 1 || nb_threads == 1){
+                // no need to spawn threads, restore within the caller thread
+                this->__restore_routine(stream_id);
+            } else {
+                for(i=0; i<nb_threads && i<this->_cur_layer->size(); i++){
+                    POS_CHECK_POINTER(threads.emplace_back(new std::thread(
+                        [this, thread_init, stream_id](){
+                            if(thread_init != nullptr){
+                                if(unlikely(POS_SUCCESS != thread_init())){
+                                    POS_WARN_C("failed to initialize restore thread");
+                                }
+                            }
+                            this->__restore_routine(stream_id);
+                        }
+                    )));
+                }
+                for(std::thread *thread : threads){
+                    thread->join();
+                    delete thread;
+                }
+                threads.clear();
+            }
+
+            this->_cur_layer_stat->duration_ms = layer_timer.stop_get_ms();
+
+            if(unlikely(this->_retval.load() != POS_SUCCESS)){
+                retval = this->_retval.load();
+                POS_WARN_C("failed to restore handles: layer_id(%lu), retval(%d)", layer_id, retval);
+                break;
+            }
+        }
+
+        if(prefetch_thread != nullptr){
+            {
+                std::lock_guard<std::mutex> lock(this->_prefetch_mutex);
+                this->_is_stop = true;
+            }
+            this->_prefetch_cv.notify_all();
+            prefetch_thread->join();
+            delete prefetch_thread;
+        }
+
+        this->_stat.duration_ms = run_timer.stop_get_ms();
+
+        return retval;
+    }
+
+
+    /*!
+     *  \brief  obtain scheduled layers / statistics of the last run
+     */
+    inline const std::vector<std::vector<T_POSHandle*>>& get_layers(){ return this->_layers; }
+    inline const pos_restore_stat_t& get_stat(){ return this->_stat; }
+
+
+    /*!
+     *  \brief  print statistics of the last run
+     */
+    inline void print_stat(){
+        uint64_t i;
+        POS_LOG_C(
+            "restored %lu handles in %lu layers: #threads(%u), duration(%.2lf ms), prefetched(%lu bytes)",
+            this->_nb_handles, this->_stat.layers.size(), this->_stat.nb_threads, this->_stat.duration_ms,
+            this->_stat.nb_prefetched_bytes
+        );
+        for(i=0; i<this->_stat.layers.size(); i++){
+            POS_LOG_C(
+                "  layer %lu: #handles(%lu), state(%lu bytes), duration(%.2lf ms), restore(%.2lf ms), reload(%.2lf ms)",
+                i, this->_stat.layers[i].nb_handles, this->_stat.layers[i].nb_state_bytes,
+                this->_stat.layers[i].duration_ms, this->_stat.layers[i].restore_ms, this->_stat.layers[i].reload_ms
+            );
+        }
+    }
+
+
+    // default maximum bytes of states to be prefetched ahead of reloading
+    static constexpr uint64_t kDefaultPrefetchSize = MB(256);
+
+ private:
+    /*!
+     *  \brief  obtain the layer of the given handle, i.e., the longest path from the roots
+     *  \param  handle      the handle
+     *  \param  layer_map   layers of handles, -1 for not visited, -2 for visiting
+     *  \param  layer_id    returned layer
+     *  \return POS_SUCCESS for successfully obtained;
+     *          POS_FAILED_INVALID_INPUT for cyclic parent edges
+     */
+    pos_retval_t __get_layer(
+        T_POSHandle* handle, std::unordered_map<T_POSHandle*, int64_t>& layer_map, uint32_t& layer_id
+    ){
+        pos_retval_t retval = POS_SUCCESS;
+        uint64_t i;
+        uint32_t parent_layer_id;
+        int64_t layer = 0;
+        T_POSHandle *parent;
+        typename std::unordered_map<T_POSHandle*, int64_t>::iterator iter;
+
+        iter = layer_map.find(handle);
+        POS_ASSERT(iter != layer_map.end());
+        if(iter->second >= 0){
+            layer_id = static_cast<uint32_t>(iter->second);
+            goto exit;
+        }
+        if(unlikely(iter->second == -2)){
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        iter->second = -2;
+
+        for(i=0; i<handle->parent_handles.size(); i++){
+            parent = static_cast<T_POSHandle*>(handle->parent_handles[i]);
+            if(layer_map.count(parent) == 0){ continue; }
+            if(unlikely(POS_SUCCESS != (retval = this->__get_layer(parent, layer_map, parent_layer_id)))){
+                goto exit;
+            }
+            if(layer <= parent_layer_id){ layer = parent_layer_id + 1; }
+        }
+
+        layer_map[handle] = layer;
+        layer_id = static_cast<uint32_t>(layer);
+
+    exit:
+        return retval;
+    }
+
+
+    /*!
+     *  \brief  restore handles of the current layer, until all handles are claimed
+     *  \param  stream_id   index of the stream to reload states
+     */
+    void __restore_routine(uint64_t stream_id){
+        pos_retval_t retval;
+        uint64_t index, nb_state_bytes = 0;
+        double restore_ms = 0, reload_ms = 0;
+        T_POSHandle *handle;
+        POSUtilHpetTimer timer;
+
+        while(likely(this->_retval.load() == POS_SUCCESS)){
+            index = this->_cur_index.fetch_add(1);
+            if(index >= this->_cur_layer->size()){ break; }
+            POS_CHECK_POINTER(handle = (*(this->_cur_layer))[index]);
+
+            timer.start();
+            retval = handle->restore();
+            restore_ms += timer.stop_get_ms();
+            if(unlikely(retval != POS_SUCCESS)){
+                POS_WARN_C(
+                    "failed to restore resource on device: client_addr(%p), rid(%u)",
+                    handle->client_addr, handle->resource_type_id
+                );
+                this->__set_retval(retval);
+                break;
+            }
+
+            if(this->_with_state && handle->state_size > 0){
+                timer.start();
+                retval = handle->reload_state(stream_id);
+                reload_ms += timer.stop_get_ms();
+                if(unlikely(retval != POS_SUCCESS)){
+                    POS_WARN_C(
+                        "failed to restore resource state on device: client_addr(%p), rid(%u)",
+                        handle->client_addr, handle->resource_type_id
+                    );
+                    this->__set_retval(retval);
+                    break;
+                }
+                nb_state_bytes += handle->restore_state_mapped_size;
+                if(this->_is_prefetching){
+                    {
+                        std::lock_guard<std::mutex> lock(this->_prefetch_mutex);
+                        this->_nb_reloaded_bytes.fetch_add(handle->restore_state_mapped_size);
+                    }
+                    this->_prefetch_cv.notify_one();
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(this->_stat_mutex);
+        this->_cur_layer_stat->nb_state_bytes += nb_state_bytes;
+        this->_cur_layer_stat->restore_ms += restore_ms;
+        this->_cur_layer_stat->reload_ms += reload_ms;
+    }
+
+
+    /*!
+     *  \brief  issue readahead of mmapped states in the restore order, keeping at most _prefetch_size
+     *          bytes ahead of reloading
+     */
+    void __prefetch_routine(){
+        uint64_t layer_id, i, nb_prefetched_bytes = 0;
+        uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const uint8_t *state;
+        uint64_t state_size;
+        T_POSHandle *handle;
+
+        for(layer_id=0; layer_id<this->_layers.size(); layer_id++){
+            for(i=0; i<this->_layers[layer_id].size(); i++){
+                handle = this->_layers[layer_id][i];
+                if(handle->state_size == 0 || handle->restore_state_mapped == nullptr){ continue; }
+                state = reinterpret_cast<const uint8_t*>(handle->restore_state_mapped);
+                state_size = handle->restore_state_mapped_size;
+
+                {
+                    std::unique_lock<std::mutex> lock(this->_prefetch_mutex);
+                    this->_prefetch_cv.wait(lock, [&]{
+                        return this->_is_stop
+                            || nb_prefetched_bytes < this->_nb_reloaded_bytes.load() + this->_prefetch_size;
+                    });
+                    if(this->_is_stop){ goto exit; }
+                }
+
+                // skip states that have been reloaded already
+                if(nb_prefetched_bytes + state_size <= this->_nb_reloaded_bytes.load()){
+                    nb_prefetched_bytes += state_size;
+                    continue;
+                }
+
+                madvise(
+                    reinterpret_cast<void*>(reinterpret_cast<uint64_t>(state) / page_size * page_size),
+                    state_size + reinterpret_cast<uint64_t>(state) % page_size, MADV_WILLNEED
+                );
+                nb_prefetched_bytes += state_size;
+                this->_stat.nb_prefetched_bytes += state_size;
+            }
+        }
+
+    exit:
+        ;
+    }
+
+
+    inline void __set_retval(pos_retval_t retval){
+        pos_retval_t expected = POS_SUCCESS;
+        this->_retval.compare_exchange_strong(expected, retval);
+    }
+
+
+    uint32_t _nb_threads;
+    uint64_t _prefetch_size;
+
+    // scheduled layers
+    std::vector<std::vector<T_POSHandle*>> _layers;
+    uint64_t _nb_handles;
+
+    // the layer under restoring
+    std::vector<T_POSHandle*> *_cur_layer;
+    pos_restore_layer_stat_t *_cur_layer_stat;
+    std::atomic<uint64_t> _cur_index;
+
+    // first failure during the run
+    std::atomic<pos_retval_t> _retval;
+
+    // whether to reload states during the run
+    bool _with_state;
+
+    // whether the prefetcher thread runs, and the progress of reloading to bound it
+    bool _is_prefetching;
+    std::atomic<uint64_t> _nb_reloaded_bytes;
+    std::mutex _prefetch_mutex;
+    std::condition_variable _prefetch_cv;
+    bool _is_stop;
+
+    pos_restore_stat_t _stat;
+    std::mutex _stat_mutex;
+};
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include <stdint.h>
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  statistics of an address index
+ */
+typedef struct pos_address_index_stat {
+    uint64_t nb_lookups;
+    uint64_t nb_cache_hits;
+    uint64_t nb_compactions;
+
+    pos_address_index_stat() : nb_lookups(0), nb_cache_hits(0), nb_compactions(0) {}
+} pos_address_index_stat_t;
+
+
+/*!
+ *  \brief  index from address ranges [base, base + size) to values, which resolves an address to the
+ *          range with the greatest base not beyond the address, as long as the range contains it
+ *  \note   ranges are kept within a sorted flat array of bases (searched branchlessly), along with a
+ *          small sorted delta array that absorbs out-of-order insertions; insertions with increasing
+ *          bases (e.g., from a bump allocator) append to the flat array directly, erased ranges are
+ *          tombstoned and compacted in bulk
+ *  \note   each thread caches the last few hits per index, a hit is only valid while the index isn't
+ *          modified, and covers the address range up to the next base, so that it returns exactly what
+ *          a full lookup would
+ *  \note   not thread-safe for concurrent modification, same as std::map
+ *  \tparam V   value type, should be a pointer type, nullptr is reserved for tombstones
+ */
+template<typename V>
+class POSAddressIndex {
+ public:
+    POSAddressIndex() : _generation(0), _nb_tombstones(0) {
+        this->_serial = __get_serial_counter().fetch_add(1, std::memory_order_relaxed);
+    }
+    ~POSAddressIndex() = default;
+
+
+    /*!
+     *  \brief  insert a range, or update the range with the same base
+     *  \param  base    base address of the range
+     *  \param  size    size of the range
+     *  \param  value   value of the range, must not be nullptr
+     */
+    void insert(uint64_t base, uint64_t size, V value){
+        uint64_t idx;
+
+        POS_ASSERT(value != nullptr);
+        this->_generation += 1;
+
+        // fast path: bases that keep growing
+        if(likely(this->_bases.empty() || base > this->_bases.back())){
+            if(likely(this->_delta_bases.empty() || base > this->_delta_bases.back())){
+                this->_bases.push_back(base);
+                this->_entries.push_back({ base + size, value });
+                return;
+            }
+        }
+
+        // update in place if the base exists
+        idx = __upper_bound(this->_bases.data(), this->_bases.size(), base);
+        if(idx > 0 && this->_bases[idx - 1] == base){
+            if(this->_entries[idx - 1].value == nullptr){ this->_nb_tombstones -= 1; }
+            this->_entries[idx - 1] = { base + size, value };
+            return;
+        }
+        idx = __upper_bound(this->_delta_bases.data(), this->_delta_bases.size(), base);
+        if(idx > 0 && this->_delta_bases[idx - 1] == base){
+            this->_delta_entries[idx - 1] = { base + size, value };
+            return;
+        }
+
+        this->_delta_bases.insert(this->_delta_bases.begin() + idx, base);
+        this->_delta_entries.insert(this->_delta_entries.begin() + idx, { base + size, value });
+        if(unlikely(this->_delta_bases.size() > __get_max_nb_delta())){ this->__compact(); }
+    }
+
+
+    /*!
+     *  \brief  erase the range with given base
+     *  \param  base    base address of the range
+     *  \return whether the range existed
+     */
+    bool erase(uint64_t base){
+        uint64_t idx;
+
+        idx = __upper_bound(this->_bases.data(), this->_bases.size(), base);
+        if(idx > 0 && this->_bases[idx - 1] == base && this->_entries[idx - 1].value != nullptr){
+            this->_generation += 1;
+            this->_entries[idx - 1].value = nullptr;
+            this->_nb_tombstones += 1;
+            if(unlikely(this->_nb_tombstones > kMinNbTombstonesToCompact && this->_nb_tombstones * 4 > this->_bases.size())){
+                this->__compact();
+            }
+            return true;
+        }
+
+        idx = __upper_bound(this->_delta_bases.data(), this->_delta_bases.size(), base);
+        if(idx > 0 && this->_delta_bases[idx - 1] == base){
+            this->_generation += 1;
+            this->_delta_bases.erase(this->_delta_bases.begin() + (idx - 1));
+            this->_delta_entries.erase(this->_delta_entries.begin() + (idx - 1));
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /*!
+     *  \brief  find the value of the range with exactly the given base
+     *  \param  base    base address of the range
+     *  \return the value, nullptr if not exist
+     */
+    V find(uint64_t base){
+        uint64_t idx;
+
+        idx = __upper_bound(this->_bases.data(), this->_bases.size(), base);
+        if(idx > 0 && this->_bases[idx - 1] == base){ return this->_entries[idx - 1].value; }
+        idx = __upper_bound(this->_delta_bases.data(), this->_delta_bases.size(), base);
+        if(idx > 0 && this->_delta_bases[idx - 1] == base){ return this->_delta_entries[idx - 1].value; }
+
+        return nullptr;
+    }
+
+
+    /*!
+     *  \brief  resolve an address to the range that contains it
+     *  \param  addr    the address to resolve
+     *  \param  base    pointer to store the base of the range, could be nullptr
+     *  \return the value of the range, nullptr if no range contains the address
+     */
+    inline V lookup(uint64_t addr, uint64_t *base = nullptr){
+        uint64_t i;
+        pos_address_index_tls_entry_t &tls = __get_tls_entry();
+
+        this->_stat.nb_lookups += 1;
+
+        if(likely(tls.serial == this->_serial + 1 && tls.generation == this->_generation)){
+            for(i=0; i<kNbCacheWays; i++){
+                if(tls.ways[i].base <= addr && addr < tls.ways[i].end){
+                    this->_stat.nb_cache_hits += 1;
+                    if(base != nullptr){ *base = tls.ways[i].base; }
+                    return tls.ways[i].value;
+                }
+            }
+        } else {
+            // the cached hits are from another index, or this index was modified since
+            tls.serial = this->_serial + 1;
+            tls.generation = this->_generation;
+            for(i=0; i<kNbCacheWays; i++){ tls.ways[i] = { 0, 0, nullptr }; }
+        }
+
+        return this->__lookup_slow(addr, base, tls);
+    }
+
+
+    /*!
+     *  \brief  obtain the number of ranges
+     */
+    inline uint64_t size() const {
+        return this->_bases.size() - this->_nb_tombstones + this->_delta_bases.size();
+    }
+
+
+    /*!
+     *  \brief  obtain the generation of the index, which changes whenever any range is inserted, updated
+     *          or erased, so that results resolved from the index could be memoized by its generation
+     */
+    inline uint64_t get_generation() const { return this->_generation; }
+
+
+    /*!
+     *  \brief  obtain the statistics of the index
+     */
+    inline const pos_address_index_stat_t& get_stat() const { return this->_stat; }
+
+
+    // number of cached hits per index per thread
+    static constexpr uint64_t kNbCacheWays = 8;
+
+    // minimum number of tombstones before compaction
+    static constexpr uint64_t kMinNbTombstonesToCompact = 64;
+
+ private:
+    /*!
+     *  \brief  end address and value of a range
+     */
+    typedef struct pos_address_index_entry {
+        uint64_t end;
+        V value;
+    } pos_address_index_entry_t;
+
+    /*!
+     *  \brief  cached hit: [base, end) resolves to value
+     */
+    typedef struct pos_address_index_way {
+        uint64_t base;
+        uint64_t end;
+        V value;
+    } pos_address_index_way_t;
+
+    /*!
+     *  \brief  per-thread cached hits of an index
+     */
+    typedef struct pos_address_index_tls_entry {
+        uint64_t serial;
+        uint64_t generation;
+        uint64_t next_way;
+        pos_address_index_way_t ways[kNbCacheWays];
+    } pos_address_index_tls_entry_t;
+    static constexpr uint64_t kNbTlsEntries = 16;
+
+
+    /*!
+     *  \brief  resolve an address by searching the flat array and the delta array
+     */
+    V __lookup_slow(uint64_t addr, uint64_t *base, pos_address_index_tls_entry_t &tls){
+        uint64_t idx, delta_idx, range_base = 0, range_end = 0, next_base = UINT64_MAX;
+        V value = nullptr;
+        bool has_range = false;
+
+        // greatest live base within the flat array
+        idx = __upper_bound(this->_bases.data(), this->_bases.size(), addr);
+        if(idx < this->_bases.size()){ next_base = this->_bases[idx]; }
+        while(idx > 0 && this->_entries[idx - 1].value == nullptr){ idx--; }
+        if(idx > 0){
+            has_range = true;
+            range_base = this->_bases[idx - 1];
+            range_end = this->_entries[idx - 1].end;
+            value = this->_entries[idx - 1].value;
+        }
+
+        // greatest base within the delta array
+        delta_idx = __upper_bound(this->_delta_bases.data(), this->_delta_bases.size(), addr);
+        if(delta_idx < this->_delta_bases.size()){ next_base = std::min(next_base, this->_delta_bases[delta_idx]); }
+        if(delta_idx > 0 && (!has_range || this->_delta_bases[delta_idx - 1] > range_base)){
+            has_range = true;
+            range_base = this->_delta_bases[delta_idx - 1];
+            range_end = this->_delta_entries[delta_idx - 1].end;
+            value = this->_delta_entries[delta_idx - 1].value;
+        }
+
+        if(!has_range || addr >= range_end){ return nullptr; }
+
+        // the hit covers addresses up to the next base, beyond which a full lookup might differ
+        tls.ways[tls.next_way % kNbCacheWays] = { range_base, std::min(range_end, next_base), value };
+        tls.next_way += 1;
+
+        if(base != nullptr){ *base = range_base; }
+        return value;
+    }
+
+
+    /*!
+     *  \brief  merge the delta array into the flat array, and drop tombstones
+     */
+    void __compact(){
+        uint64_t i = 0, j = 0;
+        std::vector<uint64_t> bases;
+        std::vector<pos_address_index_entry_t> entries;
+
+        bases.reserve(this->size());
+        entries.reserve(this->size());
+        while(i < this->_bases.size() || j < this->_delta_bases.size()){
+            if(j == this->_delta_bases.size() || (i < this->_bases.size() && this->_bases[i] < this->_delta_bases[j])){
+                if(this->_entries[i].value != nullptr){
+                    bases.push_back(this->_bases[i]);
+                    entries.push_back(this->_entries[i]);
+                }
+                i++;
+            } else {
+                bases.push_back(this->_delta_bases[j]);
+                entries.push_back(this->_delta_entries[j]);
+                j++;
+            }
+        }
+
+        this->_bases.swap(bases);
+        this->_entries.swap(entries);
+        this->_delta_bases.clear();
+        this->_delta_entries.clear();
+        this->_nb_tombstones = 0;
+        this->_stat.nb_compactions += 1;
+    }
+
+
+    /*!
+     *  \brief  number of elements not greater than key within a sorted array, without branches on the
+     *          comparison results
+     */
+    static inline uint64_t __upper_bound(const uint64_t *array, uint64_t len, uint64_t key){
+        const uint64_t *base = array;
+        uint64_t half;
+
+        if(unlikely(len == 0)){ return 0; }
+        while(len > 1){
+            half = len / 2;
+            base = (base[half] <= key) ? base + half : base;
+            len -= half;
+        }
+
+        return (base - array) + (*base <= key);
+    }
+
+
+    /*!
+     *  \brief  maximum size of the delta array, which grows with the square root of the flat array,
+     *          to balance the cost of insertions into the delta array against compactions
+     */
+    inline uint64_t __get_max_nb_delta() const {
+        uint64_t max_nb_delta = 64;
+        while(max_nb_delta * max_nb_delta < this->_bases.size()){ max_nb_delta *= 2; }
+        return max_nb_delta;
+    }
+
+
+    inline pos_address_index_tls_entry_t& __get_tls_entry(){
+        static thread_local pos_address_index_tls_entry_t tls_entries[kNbTlsEntries] = {};
+        return tls_entries[this->_serial % kNbTlsEntries];
+    }
+
+
+    /*!
+     *  \brief  counter to generate the serial of each index
+     */
+    static inline std::atomic<uint64_t>& __get_serial_counter(){
+        static std::atomic<uint64_t> counter(0);
+        return counter;
+    }
+
+    // serial of this index, to index the thread-local cache
+    uint64_t _serial;
+
+    // bumped on every modification of ranges, to invalidate the thread-local cache
+    uint64_t _generation;
+
+    // sorted flat array, tombstones have nullptr value
+    std::vector<uint64_t> _bases;
+    std::vector<pos_address_index_entry_t> _entries;
+    uint64_t _nb_tombstones;
+
+    // sorted delta array of out-of-order insertions
+    std::vector<uint64_t> _delta_bases;
+    std::vector<pos_address_index_entry_t> _delta_entries;
+
+    pos_address_index_stat_t _stat;
+};
@@ -0,0 +1,289 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <functional>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  128-bit content hash of a chunk
+ *  \note   the all-zero hash is reserved for chunks that only contain zeros
+ */
+typedef struct pos_chunk_hash {
+    uint64_t lo;
+    uint64_t hi;
+
+    inline bool operator==(const pos_chunk_hash& other) const { return lo == other.lo && hi == other.hi; }
+    inline bool operator!=(const pos_chunk_hash& other) const { return !(*this == other); }
+    inline bool is_zero() const { return lo == 0 && hi == 0; }
+} __attribute__((packed)) pos_chunk_hash_t;
+
+
+/*!
+ *  \brief  hasher of pos_chunk_hash_t for unordered containers, the hash is already uniform
+ */
+struct pos_chunk_hash_hasher {
+    inline size_t operator()(const pos_chunk_hash_t& hash) const { return hash.lo; }
+};
+
+
+/*!
+ *  \brief  fast non-cryptographic content hash of checkpoint chunks
+ *  \note   modeled after the long-input loop of XXH3: 8 lanes of 64-bit accumulators consume 64-byte
+ *          stripes with a 32x32->64 multiply per lane, and are scrambled every block of 16 stripes;
+ *          the loop runs with AVX2 or SSE2 if the CPU supports it, all paths produce the same hash
+ *  \note   128-bit outputs are used as content addresses, so that a collision between distinct chunks
+ *          within an image is negligible without comparing their bytes
+ */
+class POSUtilChunkHash {
+ public:
+    /*!
+     *  \brief  calculate the hash of the given buffer
+     *  \param  data    pointer to the buffer
+     *  \param  size    size of the buffer
+     *  \return hash of the buffer, never the all-zero hash
+     */
+    static inline pos_chunk_hash_t calculate(const void* data, uint64_t size){
+        const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+        uint64_t acc[kNbLanes] = {
+            kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3, kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1
+        };
+        uint8_t last_stripe[kStripeSize];
+        uint64_t nb_stripes;
+        pos_chunk_hash_t hash;
+
+        static const pos_chunk_hash_simd_t simd = __get_simd_support();
+
+        nb_stripes = size / kStripeSize;
+    #if defined(__x86_64__)
+        if(likely(simd == kPOS_ChunkHashSimd_AVX2)){
+            __consume_avx2(acc, p, nb_stripes);
+        } else {
+            __consume_sse2(acc, p, nb_stripes);
+        }
+    #else
+        __consume_scalar(acc, p, nb_stripes);
+    #endif
+
+        // the partial stripe is zero-padded, the length is mixed in at the end
+        if(size % kStripeSize != 0){
+            memset(last_stripe, 0, kStripeSize);
+            memcpy(last_stripe, p + nb_stripes * kStripeSize, size % kStripeSize);
+            __accumulate(acc, last_stripe, nb_stripes % kNbStripesPerBlock);
+        }
+
+        hash.lo = __merge(acc, size * kPrime64_1, 0);
+        hash.hi = __merge(acc, ~(size * kPrime64_2), kNbLanes);
+        if(unlikely(hash.is_zero())){ hash.lo = 1; }
+
+        return hash;
+    }
+
+
+    /*!
+     *  \brief  check whether the given buffer only contains zeros
+     *  \param  data    pointer to the buffer
+     *  \param  size    size of the buffer
+     *  \return identify whether the buffer only contains zeros
+     */
+    static inline bool is_zero(const void* data, uint64_t size){
+        static const uint8_t zeros[KB(4)] = { 0 };
+        const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+        uint64_t n;
+
+        while(size > 0){
+            n = size < sizeof(zeros) ? size : sizeof(zeros);
+            if(memcmp(p, zeros, n) != 0){ return false; }
+            p += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+
+    // number of bytes consumed by each lane of a stripe, and number of lanes
+    static constexpr uint64_t kNbLanes = 8;
+    static constexpr uint64_t kStripeSize = kNbLanes * sizeof(uint64_t);
+    static constexpr uint64_t kNbStripesPerBlock = 16;
+
+ private:
+    static constexpr uint64_t kPrime32_1 = 0x9E3779B1ul;
+    static constexpr uint64_t kPrime32_2 = 0x85EBCA77ul;
+    static constexpr uint64_t kPrime32_3 = 0xC2B2AE3Dul;
+    static constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ul;
+    static constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Ful;
+    static constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ul;
+    static constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ul;
+    static constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ul;
+
+    // secret keys, each stripe of a block uses the window starting at its index within the block
+    static constexpr uint64_t kNbSecrets = kNbLanes * 2 + kNbStripesPerBlock;
+    static constexpr uint64_t kSecrets[kNbSecrets] = {
+        0xbe4ba423396cfeb8ul, 0x1cad21f72c81017cul, 0xdb979083e96dd4deul, 0x1f67b3b7a4a44072ul,
+        0x78e5c0cc4ee679cbul, 0x2172ffcc7dd05a82ul, 0x8e2443f7744608b8ul, 0x4c263a81e69035e0ul,
+        0xcb00c391bb52283cul, 0xa32e531b8b65d088ul, 0x4ef90da297486471ul, 0xd8acdea946ef1938ul,
+        0x3f349ce33f76faa8ul, 0x1d4f0bc7c7bbdcf9ul, 0x3159b4cd4be0518aul, 0x647378d9c97e9fc8ul,
+        0xc3ebd33483acc5eaul, 0xeb6313faffa081c5ul, 0x49daf0b751dd0d17ul, 0x9e68d429265516d3ul,
+        0xfca1477d58be162bul, 0xce31d07ad1b8f88ful, 0x280416958f3acb45ul, 0x7e404bbbcafbd7aful,
+        0x81d8b8b1ab1ac75aul, 0x5d55f1a3b0d05c58ul, 0xa2ae2c8b06e3cbc2ul, 0x07d2b2b2a9a8d2e7ul,
+        0x54c2b2c7e1c0e0c3ul, 0x8bb3de1bd1c76c8dul, 0x6e4d1f0ca14dc6e8ul, 0xd4f1f1d2df1b64c9ul
+    };
+
+    enum pos_chunk_hash_simd_t : uint8_t {
+        kPOS_ChunkHashSimd_None = 0,
+        kPOS_ChunkHashSimd_SSE2,
+        kPOS_ChunkHashSimd_AVX2
+    };
+
+    static inline pos_chunk_hash_simd_t __get_simd_support(){
+    #if defined(__x86_64__)
+        return __builtin_cpu_supports("avx2") ? kPOS_ChunkHashSimd_AVX2 : kPOS_ChunkHashSimd_SSE2;
+    #else
+        return kPOS_ChunkHashSimd_None;
+    #endif
+    }
+
+    static inline void __consume_scalar(uint64_t* acc, const uint8_t* p, uint64_t nb_stripes){
+        uint64_t i;
+        for(i=0; i<nb_stripes; i++){
+            __accumulate(acc, p + i * kStripeSize, i % kNbStripesPerBlock);
+            if(i % kNbStripesPerBlock == kNbStripesPerBlock - 1){ __scramble(acc); }
+        }
+    }
+
+#if defined(__x86_64__)
+    /*!
+     *  \note   each 128-bit register holds 2 lanes: the product of the low and high halves of the keyed
+     *          data is added to the lane, and the data is added to the neighbour lane
+     */
+    static inline void __consume_sse2(uint64_t* acc, const uint8_t* p, uint64_t nb_stripes){
+        uint64_t i, j;
+        __m128i vacc[kNbLanes / 2], data, keyed, product;
+        const __m128i prime = _mm_set1_epi32(static_cast<int>(kPrime32_1));
+
+        for(j=0; j<kNbLanes/2; j++){ vacc[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 2 * j)); }
+        for(i=0; i<nb_stripes; i++){
+            for(j=0; j<kNbLanes/2; j++){
+                data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * kStripeSize + 16 * j));
+                keyed = _mm_xor_si128(
+                    data, _mm_loadu_si128(reinterpret_cast<const __m128i*>(kSecrets + i % kNbStripesPerBlock + 2 * j))
+                );
+                product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+                vacc[j] = _mm_add_epi64(vacc[j], _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+                vacc[j] = _mm_add_epi64(vacc[j], product);
+            }
+            if(i % kNbStripesPerBlock == kNbStripesPerBlock - 1){
+                for(j=0; j<kNbLanes/2; j++){
+                    vacc[j] = _mm_xor_si128(vacc[j], _mm_srli_epi64(vacc[j], 47));
+                    vacc[j] = _mm_xor_si128(
+                        vacc[j], _mm_loadu_si128(reinterpret_cast<const __m128i*>(kSecrets + kNbStripesPerBlock + 2 * j))
+                    );
+                    vacc[j] = _mm_add_epi64(
+                        _mm_mul_epu32(vacc[j], prime),
+                        _mm_slli_epi64(_mm_mul_epu32(_mm_shuffle_epi32(vacc[j], _MM_SHUFFLE(0, 3, 0, 1)), prime), 32)
+                    );
+                }
+            }
+        }
+        for(j=0; j<kNbLanes/2; j++){ _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2 * j), vacc[j]); }
+    }
+
+    __attribute__((target("avx2")))
+    static inline void __consume_avx2(uint64_t* acc, const uint8_t* p, uint64_t nb_stripes){
+        uint64_t i, j;
+        __m256i vacc[kNbLanes / 4], data, keyed, product;
+        const __m256i prime = _mm256_set1_epi32(static_cast<int>(kPrime32_1));
+
+        for(j=0; j<kNbLanes/4; j++){ vacc[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4 * j)); }
+        for(i=0; i<nb_stripes; i++){
+            for(j=0; j<kNbLanes/4; j++){
+                data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i * kStripeSize + 32 * j));
+                keyed = _mm256_xor_si256(
+                    data, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kSecrets + i % kNbStripesPerBlock + 4 * j))
+                );
+                product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+                vacc[j] = _mm256_add_epi64(vacc[j], _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+                vacc[j] = _mm256_add_epi64(vacc[j], product);
+            }
+            if(i % kNbStripesPerBlock == kNbStripesPerBlock - 1){
+                for(j=0; j<kNbLanes/4; j++){
+                    vacc[j] = _mm256_xor_si256(vacc[j], _mm256_srli_epi64(vacc[j], 47));
+                    vacc[j] = _mm256_xor_si256(
+                        vacc[j], _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kSecrets + kNbStripesPerBlock + 4 * j))
+                    );
+                    vacc[j] = _mm256_add_epi64(
+                        _mm256_mul_epu32(vacc[j], prime),
+                        _mm256_slli_epi64(_mm256_mul_epu32(_mm256_shuffle_epi32(vacc[j], _MM_SHUFFLE(0, 3, 0, 1)), prime), 32)
+                    );
+                }
+            }
+        }
+        for(j=0; j<kNbLanes/4; j++){ _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4 * j), vacc[j]); }
+    }
+#endif
+
+    static inline void __accumulate(uint64_t* acc, const uint8_t* stripe, uint64_t stripe_id){
+        uint64_t i, data[kNbLanes], keyed;
+
+        memcpy(data, stripe, kStripeSize);
+        for(i=0; i<kNbLanes; i++){
+            keyed = data[i] ^ kSecrets[stripe_id + i];
+            acc[i ^ 1] += data[i];
+            acc[i] += (keyed & 0xFFFFFFFFul) * (keyed >> 32);
+        }
+    }
+
+    static inline void __scramble(uint64_t* acc){
+        uint64_t i;
+        for(i=0; i<kNbLanes; i++){
+            acc[i] ^= acc[i] >> 47;
+            acc[i] ^= kSecrets[kNbStripesPerBlock + i];
+            acc[i] *= kPrime32_1;
+        }
+    }
+
+    static inline uint64_t __mul_fold(uint64_t a, uint64_t b){
+        __uint128_t product = static_cast<__uint128_t>(a) * b;
+        return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+    }
+
+    static inline uint64_t __avalanche(uint64_t h){
+        h ^= h >> 37;
+        h *= 0x165667919E3779F9ul;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static inline uint64_t __merge(const uint64_t* acc, uint64_t seed, uint64_t secret_offset){
+        uint64_t i, h = seed;
+        for(i=0; i<kNbLanes; i+=2){
+            h += __mul_fold(acc[i] ^ kSecrets[secret_offset + i], acc[i + 1] ^ kSecrets[secret_offset + i + 1]);
+        }
+        return __avalanche(h);
+    }
+};
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  CRC32C (Castagnoli) checksum, used for verifying checkpoint data
+ *  \note   the SSE4.2 crc32 instruction is used if the CPU supports it, otherwise we
+ *          fall back to a table-driven software implementation
+ */
+class POSUtilCrc32c {
+ public:
+    /*!
+     *  \brief  calculate the checksum of the given buffer
+     *  \param  data    pointer to the buffer
+     *  \param  size    size of the buffer
+     *  \param  crc     checksum of the previous buffers, for calculating the checksum incrementally
+     *  \return checksum of the buffer
+     */
+    static inline uint32_t calculate(const void* data, uint64_t size, uint32_t crc = 0){
+        static const bool has_hw = __has_hw_support();
+        if(likely(has_hw)){
+            return __calculate_hw(reinterpret_cast<const uint8_t*>(data), size, crc);
+        } else {
+            return __calculate_sw(reinterpret_cast<const uint8_t*>(data), size, crc);
+        }
+    }
+
+
+    /*!
+     *  \brief  combine the checksums of two adjacent buffers into the checksum of their concatenation,
+     *          so that a large buffer could be checksummed by several threads in parts
+     *  \param  crc1    checksum of the first buffer
+     *  \param  crc2    checksum of the second buffer (calculated from 0)
+     *  \param  size2   size of the second buffer
+     *  \return checksum of the concatenated buffer
+     */
+    static inline uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t size2){
+        uint32_t op = 1u << 31;     // x^0
+        uint64_t k;
+
+        // op = x^(8 * size2) mod P, by squaring x^(2^k)
+        for(k=3; size2 > 0; size2 >>= 1, k++){
+            if(size2 & 1){ op = __multmodp(__x2n_table().v[k & 31], op); }
+        }
+        return __multmodp(op, crc1) ^ crc2;
+    }
+
+ private:
+    // reversed polynomial of CRC32C
+    static constexpr uint32_t kPolynomial = 0x82F63B78;
+
+    static inline bool __has_hw_support(){
+    #if defined(__x86_64__)
+        return __builtin_cpu_supports("sse4.2");
+    #else
+        return false;
+    #endif
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    static inline uint32_t __calculate_hw(const uint8_t* data, uint64_t size, uint32_t crc){
+        uint64_t crc64 = ~crc, word;
+
+        // align to 8 bytes
+        while(size > 0 && (reinterpret_cast<uint64_t>(data) & 7) != 0){
+            crc64 = __builtin_ia32_crc32qi(static_cast<uint32_t>(crc64), *data);
+            data++; size--;
+        }
+
+        while(size >= 8){
+            memcpy(&word, data, sizeof(uint64_t));
+            crc64 = __builtin_ia32_crc32di(crc64, word);
+            data += 8; size -= 8;
+        }
+
+        while(size > 0){
+            crc64 = __builtin_ia32_crc32qi(static_cast<uint32_t>(crc64), *data);
+            data++; size--;
+        }
+
+        return ~static_cast<uint32_t>(crc64);
+    }
+#else
+    static inline uint32_t __calculate_hw(const uint8_t* data, uint64_t size, uint32_t crc){
+        return __calculate_sw(data, size, crc);
+    }
+#endif
+
+    /*!
+     *  \brief  multiply two polynomials modulo P, in the reflected bit order of the checksum
+     */
+    static inline uint32_t __multmodp(uint32_t a, uint32_t b){
+        uint32_t m = 1u << 31, p = 0;
+        while(true){
+            if(a & m){
+                p ^= b;
+                if((a & (m - 1)) == 0){ break; }
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ kPolynomial : (b >> 1);
+        }
+        return p;
+    }
+
+    /*!
+     *  \brief  table of x^(2^k) mod P
+     */
+    struct x2n_table {
+        uint32_t v[32];
+        x2n_table(){
+            uint32_t k, p = 1u << 30;  // x^1
+            v[0] = p;
+            for(k=1; k<32; k++){ v[k] = p = __multmodp(p, p); }
+        }
+    };
+    static inline const x2n_table& __x2n_table(){
+        static const x2n_table table;
+        return table;
+    }
+
+    static inline uint32_t __calculate_sw(const uint8_t* data, uint64_t size, uint32_t crc){
+        static const struct table {
+            uint32_t v[256];
+            table(){
+                uint32_t i, j, c;
+                for(i=0; i<256; i++){
+                    c = i;
+                    for(j=0; j<8; j++){ c = (c & 1) ? (c >> 1) ^ kPolynomial : (c >> 1); }
+                    v[i] = c;
+                }
+            }
+        } crc_table;
+        uint64_t i;
+
+        crc = ~crc;
+        for(i=0; i<size; i++){
+            crc = crc_table.v[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+};
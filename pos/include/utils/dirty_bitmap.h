@@ -0,0 +1,245 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+
+#include <stdint.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+
+
+/*!
+ *  \brief  dense set of ids (e.g., ids of handles modified since last checkpoint), one bit per id
+ *  \note   bits are kept in fixed-size segments allocated on first use, so that setting a bit never
+ *          moves existing words and is safe against concurrent setters; two levels of summary bitmaps
+ *          mark the segments and the words that might contain set bits, so that enumeration and
+ *          clearing only touch those
+ *  \note   set / test are lock-free, while enumeration / clearing should not run concurrently with
+ *          each other (setting during enumeration is fine, the newly set bit might be missed)
+ */
+class POSDirtyBitmap {
+ public:
+    POSDirtyBitmap() {
+        uint64_t i;
+        for(i=0; i<kMaxNbSegments; i++){ this->_segments[i].store(nullptr, std::memory_order_relaxed); }
+        for(i=0; i<kNbSummaryWords; i++){ this->_summary[i].store(0, std::memory_order_relaxed); }
+    }
+
+    ~POSDirtyBitmap(){
+        uint64_t i;
+        for(i=0; i<kMaxNbSegments; i++){
+            if(this->_segments[i].load(std::memory_order_relaxed) != nullptr){
+                delete this->_segments[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+
+    /*!
+     *  \brief  set the bit of given id
+     *  \param  id  the id
+     */
+    inline void set(uint64_t id){
+        uint64_t segment_id = id / kNbBitsPerSegment, word_id = (id % kNbBitsPerSegment) / 64, mask;
+        pos_dirty_bitmap_segment_t *segment;
+
+        if(unlikely(segment_id >= kMaxNbSegments)){
+            POS_ERROR_C_DETAIL(
+                "id exceeds the capacity of the dirty bitmap: id(%lu), capacity(%lu)",
+                id, kMaxNbSegments * kNbBitsPerSegment
+            );
+        }
+
+        segment = this->_segments[segment_id].load(std::memory_order_acquire);
+        if(unlikely(segment == nullptr)){ segment = this->__allocate_segment(segment_id); }
+
+        // test before the RMW, so that re-dirtying a dirty id doesn't bounce the cache line
+        mask = 1ul << (id % 64);
+        if(likely((segment->words[word_id].load(std::memory_order_relaxed) & mask) != 0)){ return; }
+        segment->words[word_id].fetch_or(mask, std::memory_order_relaxed);
+
+        __set_summary_bit(segment->summary, word_id);
+        __set_summary_bit(this->_summary, segment_id);
+    }
+
+
+    /*!
+     *  \brief  check whether the bit of given id is set
+     *  \param  id  the id
+     *  \return identify whether the bit is set
+     */
+    inline bool test(uint64_t id) const {
+        uint64_t segment_id = id / kNbBitsPerSegment;
+        pos_dirty_bitmap_segment_t *segment;
+
+        if(unlikely(segment_id >= kMaxNbSegments)){ return false; }
+        segment = this->_segments[segment_id].load(std::memory_order_acquire);
+        if(segment == nullptr){ return false; }
+
+        return (segment->words[(id % kNbBitsPerSegment) / 64].load(std::memory_order_relaxed) >> (id % 64)) & 1ul;
+    }
+
+
+    /*!
+     *  \brief  enumerate all set ids in increasing order
+     *  \param  func    function to invoke on each set id
+     */
+    template<typename F>
+    inline void for_each(F&& func) const {
+        __for_each_word([&](uint64_t base_id, std::atomic<uint64_t>& word){
+            uint64_t bits = word.load(std::memory_order_relaxed);
+            while(bits != 0){
+                func(base_id + __builtin_ctzl(bits));
+                bits &= bits - 1;
+            }
+        });
+    }
+
+
+    /*!
+     *  \brief  obtain the number of set ids
+     *  \return the number of set ids
+     */
+    inline uint64_t count() const {
+        uint64_t nb = 0;
+        __for_each_word([&](uint64_t /* base_id */, std::atomic<uint64_t>& word){
+            nb += __builtin_popcountl(word.load(std::memory_order_relaxed));
+        });
+        return nb;
+    }
+
+
+    /*!
+     *  \brief  clear all set ids
+     *  \note   only words marked in the summaries are touched, segments stay allocated for reuse
+     */
+    inline void clear(){
+        uint64_t i, j, k, summary_word, segment_summary_word;
+        pos_dirty_bitmap_segment_t *segment;
+
+        for(i=0; i<kNbSummaryWords; i++){
+            summary_word = this->_summary[i].exchange(0, std::memory_order_relaxed);
+            while(summary_word != 0){
+                j = i * 64 + __builtin_ctzl(summary_word);
+                summary_word &= summary_word - 1;
+                POS_CHECK_POINTER(segment = this->_segments[j].load(std::memory_order_acquire));
+                for(k=0; k<kNbSummaryWordsPerSegment; k++){
+                    segment_summary_word = segment->summary[k].exchange(0, std::memory_order_relaxed);
+                    while(segment_summary_word != 0){
+                        segment->words[k * 64 + __builtin_ctzl(segment_summary_word)].store(0, std::memory_order_relaxed);
+                        segment_summary_word &= segment_summary_word - 1;
+                    }
+                }
+            }
+        }
+    }
+
+
+    // number of ids covered by each segment
+    static constexpr uint64_t kNbBitsPerSegment = 1ul << 16;
+    static constexpr uint64_t kNbWordsPerSegment = kNbBitsPerSegment / 64;
+    static constexpr uint64_t kNbSummaryWordsPerSegment = kNbWordsPerSegment / 64;
+
+    // maximum number of segments, i.e., the bitmap covers ids below 2^26
+    static constexpr uint64_t kMaxNbSegments = 1024;
+    static constexpr uint64_t kNbSummaryWords = kMaxNbSegments / 64;
+
+
+ private:
+    /*!
+     *  \brief  segment of bits, along with a summary that marks words that might be non-zero
+     */
+    typedef struct pos_dirty_bitmap_segment {
+        std::atomic<uint64_t> summary[kNbSummaryWordsPerSegment];
+        std::atomic<uint64_t> words[kNbWordsPerSegment];
+
+        pos_dirty_bitmap_segment(){
+            uint64_t i;
+            for(i=0; i<kNbSummaryWordsPerSegment; i++){ summary[i].store(0, std::memory_order_relaxed); }
+            for(i=0; i<kNbWordsPerSegment; i++){ words[i].store(0, std::memory_order_relaxed); }
+        }
+    } pos_dirty_bitmap_segment_t;
+
+
+    /*!
+     *  \brief  set the bit within a summary if it's not set yet
+     */
+    static inline void __set_summary_bit(std::atomic<uint64_t> *summary, uint64_t index){
+        uint64_t mask = 1ul << (index % 64);
+        if(unlikely((summary[index / 64].load(std::memory_order_relaxed) & mask) == 0)){
+            summary[index / 64].fetch_or(mask, std::memory_order_relaxed);
+        }
+    }
+
+
+    /*!
+     *  \brief  invoke given function on each word marked in the summaries
+     *  \param  func    function to invoke, with the first id covered by the word, and the word
+     */
+    template<typename F>
+    inline void __for_each_word(F&& func) const {
+        uint64_t i, j, k, w, summary_word, segment_summary_word;
+        pos_dirty_bitmap_segment_t *segment;
+
+        for(i=0; i<kNbSummaryWords; i++){
+            summary_word = this->_summary[i].load(std::memory_order_relaxed);
+            while(summary_word != 0){
+                j = i * 64 + __builtin_ctzl(summary_word);
+                summary_word &= summary_word - 1;
+                POS_CHECK_POINTER(segment = this->_segments[j].load(std::memory_order_acquire));
+                for(k=0; k<kNbSummaryWordsPerSegment; k++){
+                    segment_summary_word = segment->summary[k].load(std::memory_order_relaxed);
+                    while(segment_summary_word != 0){
+                        w = k * 64 + __builtin_ctzl(segment_summary_word);
+                        segment_summary_word &= segment_summary_word - 1;
+                        func(j * kNbBitsPerSegment + w * 64, segment->words[w]);
+                    }
+                }
+            }
+        }
+    }
+
+
+    /*!
+     *  \brief  allocate the segment of given index, or obtain the one allocated by another setter
+     *  \param  segment_id  index of the segment
+     *  \return the segment
+     */
+    inline pos_dirty_bitmap_segment_t* __allocate_segment(uint64_t segment_id){
+        pos_dirty_bitmap_segment_t *segment, *expected = nullptr;
+
+        POS_CHECK_POINTER(segment = new pos_dirty_bitmap_segment_t());
+        if(!this->_segments[segment_id].compare_exchange_strong(
+            expected, segment, std::memory_order_acq_rel, std::memory_order_acquire
+        )){
+            delete segment;
+            segment = expected;
+        }
+
+        return segment;
+    }
+
+    // segments of bits
+    std::atomic<pos_dirty_bitmap_segment_t*> _segments[kMaxNbSegments];
+
+    // one bit per segment, set if the segment might contain set bits
+    std::atomic<uint64_t> _summary[kNbSummaryWords];
+};
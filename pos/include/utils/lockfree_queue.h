@@ -17,7 +17,10 @@
 #pragma once
 
 #include <iostream>
+#include <atomic>
 
+#include "pos/include/common.h"
+#include "pos/include/utils/wait_strategy.h"
 #include "pos/include/utils/readerwriterqueue/atomicops.h"
 #include "pos/include/utils/readerwriterqueue/readerwriterqueue.h"
 
@@ -25,26 +28,52 @@
 
 /*!
  *  \brief  lock-free queue
+ *  \note   single-producer / single-consumer, use POSMPSCQueue for multiple producers
  *  \tparam T   elemenet type
  */
 template<typename T>
 class POSLockFreeQueue {
  public:
-    POSLockFreeQueue() : _is_enqueue_locked(false), _is_dequeue_locked(false) {
+    POSLockFreeQueue() : _is_enqueue_locked(false), _is_dequeue_locked(false), _event(nullptr) {
         _q = new moodycamel::ReaderWriterQueue<T, POS_LOCKLESS_QUEUE_LEN>();
         POS_CHECK_POINTER(_q);
     }
-    ~POSLockFreeQueue() = default;
+    ~POSLockFreeQueue(){ delete _q; }
 
     /*!
      *  \brief  generate a new queue node and append to the tail of it
      *  \param  data    the payload that the newly added node points to
      */
     void push(T element){
-        if(this->_is_enqueue_locked == false)
-            _q->enqueue(element); 
+        if(this->_is_enqueue_locked.load(std::memory_order_acquire) == false){
+            _q->enqueue(element);
+            if(this->_event != nullptr){ this->_event->notify(); }
+        }
+    }
+
+    /*!
+     *  \brief  append multiple elements to the tail of the queue
+     *  \note   the consumer is signaled once for the whole batch
+     *  \param  elements    pointer to the elements
+     *  \param  nb_elements number of elements to append
+     */
+    void push_n(const T* elements, uint64_t nb_elements){
+        uint64_t i;
+
+        if(unlikely(nb_elements == 0)){ return; }
+        if(this->_is_enqueue_locked.load(std::memory_order_acquire) == false){
+            for(i=0; i<nb_elements; i++){ _q->enqueue(elements[i]); }
+            if(this->_event != nullptr){ this->_event->notify(); }
+        }
     }
 
+    /*!
+     *  \brief  attach the event that the consumer of this queue parks on
+     *  \note   the event is signaled on every push, should be attached before the queue is used
+     *  \param  event   the event, nullptr to detach
+     */
+    inline void set_wait_event(POSWaitEvent *event){ this->_event = event; }
+
     /*!
      *  \brief  obtain a pointer which points to the payload that the 
      *          head element points to
@@ -53,7 +82,7 @@ class POSLockFreeQueue {
      *          POS_FAILED_NOT_READY for empty queue
      */
     pos_retval_t dequeue(T& element){
-        if(this->_is_dequeue_locked == false){
+        if(this->_is_dequeue_locked.load(std::memory_order_acquire) == false){
             if(_q->try_dequeue(element)){ return POS_SUCCESS; }
             else { return POS_FAILED_NOT_READY; }
         } else {
@@ -61,6 +90,22 @@ class POSLockFreeQueue {
         }
     }
 
+    /*!
+     *  \brief  dequeue multiple elements from the head of the queue
+     *  \param  elements        pointer to store the dequeued elements, with at least max_nb_elements slots
+     *  \param  max_nb_elements maximum number of elements to dequeue
+     *  \return number of dequeued elements, 0 for empty queue
+     */
+    uint64_t pop_n(T* elements, uint64_t max_nb_elements){
+        uint64_t nb_elements = 0;
+
+        if(this->_is_dequeue_locked.load(std::memory_order_acquire) == false){
+            while(nb_elements < max_nb_elements && _q->try_dequeue(elements[nb_elements])){ nb_elements++; }
+        }
+
+        return nb_elements;
+    }
+
     /*!
      *  \brief  removes the front element from the queue, if any, without returning it
      *  \return true if an element is successfully removed, false if the queue is empty
@@ -84,37 +129,45 @@ class POSLockFreeQueue {
 
     /*!
      *  \brief  clear the queue
+     *  \note   should be called by the consumer
+     *  \param  release     function to release each drained element, e.g., return the reference of the
+     *                      element that is held by this queue
+     *  \return number of drained elements
      */
-    inline void drain(){
-        uint64_t i, len;
-        len = this->len();
+    template<typename F>
+    inline uint64_t drain(F&& release){
+        uint64_t nb_elements = 0;
+        T element;
+
+        this->lock();
+        while(_q->try_dequeue(element)){
+            release(element);
+            nb_elements++;
+        }
+        this->unlock();
 
-        this->lock_enqueue();
-        this->lock_dequeue();
-        // TODO: how to deal with memory leak?
-        for(i=0; i<len; i++){ this->pop(); }
-        this->unlock_enqueue();
-        this->unlock_dequeue();
+        return nb_elements;
     }
+    inline uint64_t drain(){ return this->drain([](T&){}); }
 
     /*!
      *  \brief  lock the queue
      */
-    inline void lock_enqueue(){ this->_is_enqueue_locked = true; }
-    inline void lock_dequeue(){ this->_is_dequeue_locked = true; }
+    inline void lock_enqueue(){ this->_is_enqueue_locked.store(true, std::memory_order_release); }
+    inline void lock_dequeue(){ this->_is_dequeue_locked.store(true, std::memory_order_release); }
     inline void lock(){ 
-        this->_is_enqueue_locked = true;
-        this->_is_dequeue_locked = true; 
+        this->lock_enqueue();
+        this->lock_dequeue();
     }
 
     /*!
      *  \brief  unlock the queue
      */
-    inline void unlock_enqueue(){ this->_is_enqueue_locked = false; }
-    inline void unlock_dequeue(){ this->_is_dequeue_locked = false; }
+    inline void unlock_enqueue(){ this->_is_enqueue_locked.store(false, std::memory_order_release); }
+    inline void unlock_dequeue(){ this->_is_dequeue_locked.store(false, std::memory_order_release); }
     inline void unlock(){ 
-        this->_is_enqueue_locked = false;
-        this->_is_dequeue_locked = false; 
+        this->unlock_enqueue();
+        this->unlock_dequeue();
     }
 
  private:
@@ -122,6 +175,9 @@ class POSLockFreeQueue {
     moodycamel::ReaderWriterQueue<T, POS_LOCKLESS_QUEUE_LEN> *_q;
 
     // identify whether this queue is locked, if locked, nothing would be enqueued/dequeued
-    bool _is_enqueue_locked;
-    bool _is_dequeue_locked;
+    std::atomic<bool> _is_enqueue_locked;
+    std::atomic<bool> _is_dequeue_locked;
+
+    // event to wake the parked consumer, nullptr for no consumer parks on this queue
+    POSWaitEvent *_event;
 };
@@ -0,0 +1,421 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <stdint.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/utils/wait_strategy.h"
+
+
+/*!
+ *  \brief  bounded multi-producer / single-consumer queue, whose elements are dequeued in the order of
+ *          their ordering stamps
+ *  \note   each producer thread owns a bounded single-producer ring, which is registered on its first
+ *          push; each pushed element carries a stamp, and the consumer merges all rings by emitting
+ *          stamps strictly one after another, so that
+ *          [1] elements pushed by the same thread keep their order, and
+ *          [2] elements across threads are dequeued in the order that their stamps were reserved
+ *  \note   stamps are either reserved by the queue (push), or provided by the caller (push_stamped), the
+ *          two should not be mixed on the same queue; provided stamps must be dense and start from the
+ *          base stamp of the queue, as the consumer waits for a missing stamp to show up
+ *  \note   producers block (spin, then yield) while their ring is full, this never deadlocks as the
+ *          smallest missing stamp always belongs to a producer whose ring only contains smaller stamps;
+ *          for the same reason rings are never shared among threads, and exceeding the maximum number
+ *          of rings is fatal (a thread that reuses the id of an exited thread reuses its ring)
+ *  \tparam T   element type
+ */
+template<typename T>
+class POSMPSCQueue {
+ public:
+    /*!
+     *  \brief  constructor
+     *  \param  ring_capacity   capacity of each per-thread ring, rounded up to power of 2
+     *  \param  max_nb_rings    maximum number of per-thread rings
+     *  \param  base_stamp      stamp of the first element
+     */
+    POSMPSCQueue(
+        uint64_t ring_capacity = kDefaultRingCapacity,
+        uint64_t max_nb_rings = kDefaultMaxNbRings,
+        uint64_t base_stamp = 0
+    ) : _max_nb_rings(max_nb_rings), _nb_rings(0), _stamp_alloc(base_stamp), _next_stamp(base_stamp),
+        _cursor(0), _is_enqueue_locked(false), _is_dequeue_locked(false), _event(nullptr)
+    {
+        uint64_t i;
+
+        POS_ASSERT(ring_capacity > 0 && max_nb_rings > 0);
+        for(this->_ring_capacity = 1; this->_ring_capacity < ring_capacity; this->_ring_capacity <<= 1){}
+
+        this->_serial = __get_serial_counter().fetch_add(1, std::memory_order_relaxed);
+
+        POS_CHECK_POINTER(this->_rings = new std::atomic<pos_mpsc_ring_t*>[max_nb_rings]);
+        for(i=0; i<max_nb_rings; i++){ this->_rings[i].store(nullptr, std::memory_order_relaxed); }
+    }
+
+
+    ~POSMPSCQueue(){
+        uint64_t i;
+        for(i=0; i<this->_max_nb_rings; i++){ delete this->_rings[i].load(std::memory_order_relaxed); }
+        delete[] this->_rings;
+    }
+
+
+    /*!
+     *  \brief  reserve a stamp and append an element
+     *  \param  element the element to be appended
+     *  \return the ordering stamp of the element
+     */
+    inline uint64_t push(T element){
+        return this->__push(element, /* stamp */ 0, /* reserve_stamp */ true);
+    }
+
+
+    /*!
+     *  \brief  append an element with a stamp provided by the caller
+     *  \param  element the element to be appended
+     *  \param  stamp   ordering stamp of the element
+     */
+    inline void push_stamped(T element, uint64_t stamp){
+        this->__push(element, stamp, /* reserve_stamp */ false);
+    }
+
+
+    /*!
+     *  \brief  attach the event that the consumer of this queue parks on
+     *  \note   the event is signaled on every push, should be attached before the queue is used
+     *  \param  event   the event, nullptr to detach
+     */
+    inline void set_wait_event(POSWaitEvent *event){ this->_event = event; }
+
+
+    /*!
+     *  \brief  dequeue the element with the next stamp
+     *  \note   should only be called by the consumer
+     *  \param  element reference to the variable to stored dequeued element (if any)
+     *  \param  stamp   pointer to store the ordering stamp of the dequeued element, could be nullptr
+     *  \return POS_SUCCESS for successfully dequeued
+     *          POS_FAILED_NOT_READY for empty queue, or the element with next stamp isn't published yet
+     */
+    pos_retval_t dequeue(T& element, uint64_t* stamp = nullptr){
+        uint64_t i, nb_rings;
+        pos_mpsc_ring_t *ring;
+
+        if(unlikely(this->_is_dequeue_locked.load(std::memory_order_acquire))){ return POS_FAILED_NOT_READY; }
+
+        // fast path: the next element is usually from the same producer as the previous one
+        ring = this->_rings[this->_cursor].load(std::memory_order_acquire);
+        if(ring != nullptr && this->__try_pop_from(ring, element, stamp)){ return POS_SUCCESS; }
+
+        nb_rings = this->get_nb_producers();
+        for(i=0; i<nb_rings; i++){
+            if(i == this->_cursor){ continue; }
+            ring = this->_rings[i].load(std::memory_order_acquire);
+            if(ring != nullptr && this->__try_pop_from(ring, element, stamp)){
+                this->_cursor = i;
+                return POS_SUCCESS;
+            }
+        }
+
+        return POS_FAILED_NOT_READY;
+    }
+
+
+    /*!
+     *  \brief  dequeue multiple elements in the order of their stamps
+     *  \note   should only be called by the consumer
+     *  \param  elements        pointer to store the dequeued elements, with at least max_nb_elements slots
+     *  \param  max_nb_elements maximum number of elements to dequeue
+     *  \return number of dequeued elements
+     */
+    uint64_t pop_n(T* elements, uint64_t max_nb_elements){
+        uint64_t nb_elements = 0;
+        while(nb_elements < max_nb_elements && POS_SUCCESS == this->dequeue(elements[nb_elements])){ nb_elements++; }
+        return nb_elements;
+    }
+
+
+    /*!
+     *  \brief  obtain the stamp of the next element to be dequeued
+     */
+    inline uint64_t get_next_stamp() const { return this->_next_stamp; }
+
+
+    /*!
+     *  \brief  obtain the number of registered per-thread rings
+     */
+    inline uint64_t get_nb_producers() const {
+        return std::min<uint64_t>(this->_nb_rings.load(std::memory_order_acquire), this->_max_nb_rings);
+    }
+
+
+    /*!
+     *  \brief  obtain the (approximated) length of the queue
+     *  \return length of the queue
+     */
+    inline uint64_t len(){
+        uint64_t i, len = 0;
+        pos_mpsc_ring_t *ring;
+
+        for(i=0; i<this->get_nb_producers(); i++){
+            if((ring = this->_rings[i].load(std::memory_order_acquire)) == nullptr){ continue; }
+            len += ring->tail.load(std::memory_order_acquire) - ring->head.load(std::memory_order_acquire);
+        }
+
+        return len;
+    }
+
+
+    /*!
+     *  \brief  clear the queue
+     *  \note   should be called by the consumer; elements are dropped regardless of their stamps, and the
+     *          next stamp is moved beyond the largest dropped one
+     *  \param  release     function to release each drained element
+     *  \return number of drained elements
+     */
+    template<typename F>
+    inline uint64_t drain(F&& release){
+        uint64_t i, head, tail, max_stamp_plus_one, nb_elements = 0;
+        pos_mpsc_ring_t *ring;
+
+        this->lock();
+        max_stamp_plus_one = this->_next_stamp;
+        for(i=0; i<this->get_nb_producers(); i++){
+            if((ring = this->_rings[i].load(std::memory_order_acquire)) == nullptr){ continue; }
+            head = ring->head.load(std::memory_order_relaxed);
+            tail = ring->tail.load(std::memory_order_acquire);
+            for(; head<tail; head++){
+                max_stamp_plus_one = std::max(max_stamp_plus_one, ring->slots[head & ring->mask].stamp + 1);
+                release(ring->slots[head & ring->mask].element);
+                nb_elements++;
+            }
+            ring->head.store(tail, std::memory_order_release);
+        }
+        this->_next_stamp = max_stamp_plus_one;
+        this->unlock();
+
+        return nb_elements;
+    }
+    inline uint64_t drain(){ return this->drain([](T&){}); }
+
+
+    /*!
+     *  \brief  lock the queue
+     */
+    inline void lock_enqueue(){ this->_is_enqueue_locked.store(true, std::memory_order_release); }
+    inline void lock_dequeue(){ this->_is_dequeue_locked.store(true, std::memory_order_release); }
+    inline void lock(){
+        this->lock_enqueue();
+        this->lock_dequeue();
+    }
+
+    /*!
+     *  \brief  unlock the queue
+     */
+    inline void unlock_enqueue(){ this->_is_enqueue_locked.store(false, std::memory_order_release); }
+    inline void unlock_dequeue(){ this->_is_dequeue_locked.store(false, std::memory_order_release); }
+    inline void unlock(){
+        this->unlock_enqueue();
+        this->unlock_dequeue();
+    }
+
+    // default capacity of each per-thread ring
+    static constexpr uint64_t kDefaultRingCapacity = 1024;
+
+    // default maximum number of per-thread rings
+    static constexpr uint64_t kDefaultMaxNbRings = 1024;
+
+ private:
+    /*!
+     *  \brief  slot within a ring
+     */
+    typedef struct pos_mpsc_slot {
+        T element;
+        uint64_t stamp;
+    } pos_mpsc_slot_t;
+
+    /*!
+     *  \brief  single-producer ring
+     */
+    typedef struct alignas(64) pos_mpsc_ring {
+        // consumer-owned index of the next slot to dequeue
+        alignas(64) std::atomic<uint64_t> head;
+
+        // producer-owned index of the next slot to enqueue
+        alignas(64) std::atomic<uint64_t> tail;
+
+        // producer thread of this ring
+        std::thread::id owner;
+
+        uint64_t mask;
+        pos_mpsc_slot_t *slots;
+
+        pos_mpsc_ring(uint64_t capacity) : head(0), tail(0), mask(capacity - 1) {
+            POS_CHECK_POINTER(this->slots = new pos_mpsc_slot_t[capacity]);
+        }
+        ~pos_mpsc_ring(){ delete[] this->slots; }
+    } pos_mpsc_ring_t;
+
+    /*!
+     *  \brief  per-thread cache of the rings owned by this thread, indexed by the serial of the queue
+     */
+    typedef struct pos_mpsc_tls_entry {
+        uint64_t serial;
+        pos_mpsc_ring_t *ring;
+    } pos_mpsc_tls_entry_t;
+    static constexpr uint64_t kNbTlsEntries = 8;
+
+
+    /*!
+     *  \brief  append an element to the ring of the calling thread
+     *  \param  element         the element to be appended
+     *  \param  stamp           stamp of the element, if not reserved by the queue
+     *  \param  reserve_stamp   whether to reserve a stamp from the queue
+     *  \return the ordering stamp of the element
+     */
+    inline uint64_t __push(T element, uint64_t stamp, bool reserve_stamp){
+        uint64_t tail;
+        pos_mpsc_ring_t *ring;
+
+        if(unlikely(this->_is_enqueue_locked.load(std::memory_order_acquire))){ return stamp; }
+
+        ring = this->__get_ring();
+
+        /*!
+         *  \note   wait for a free slot before reserving the stamp, so that a reserved stamp is always
+         *          published without blocking on the consumer
+         */
+        tail = ring->tail.load(std::memory_order_relaxed);
+        while(unlikely(tail - ring->head.load(std::memory_order_acquire) > ring->mask)){ __backoff(); }
+
+        if(reserve_stamp){ stamp = this->_stamp_alloc.fetch_add(1, std::memory_order_relaxed); }
+        ring->slots[tail & ring->mask].element = element;
+        ring->slots[tail & ring->mask].stamp = stamp;
+        ring->tail.store(tail + 1, std::memory_order_release);
+
+        if(this->_event != nullptr){ this->_event->notify(); }
+
+        return stamp;
+    }
+
+
+    /*!
+     *  \brief  pop the head element of the given ring, if it carries the next stamp
+     *  \return whether the element is popped
+     */
+    inline bool __try_pop_from(pos_mpsc_ring_t *ring, T& element, uint64_t* stamp){
+        uint64_t head;
+        pos_mpsc_slot_t *slot;
+
+        head = ring->head.load(std::memory_order_relaxed);
+        if(head == ring->tail.load(std::memory_order_acquire)){ return false; }
+
+        slot = &ring->slots[head & ring->mask];
+        if(slot->stamp != this->_next_stamp){ return false; }
+
+        element = slot->element;
+        if(stamp != nullptr){ *stamp = slot->stamp; }
+        ring->head.store(head + 1, std::memory_order_release);
+        this->_next_stamp += 1;
+
+        return true;
+    }
+
+
+    /*!
+     *  \brief  obtain the ring of the calling thread, register one if not exist
+     *  \return the ring of the calling thread
+     */
+    inline pos_mpsc_ring_t* __get_ring(){
+        uint64_t i, nb_rings;
+        pos_mpsc_ring_t *ring = nullptr;
+        std::thread::id self = std::this_thread::get_id();
+        static thread_local pos_mpsc_tls_entry_t tls_entries[kNbTlsEntries] = {};
+        pos_mpsc_tls_entry_t &tls_entry = tls_entries[this->_serial % kNbTlsEntries];
+
+        if(likely(tls_entry.serial == this->_serial + 1)){ return tls_entry.ring; }
+
+        // the cache entry was evicted by another queue, look up the registered rings
+        nb_rings = this->get_nb_producers();
+        for(i=0; i<nb_rings; i++){
+            ring = this->_rings[i].load(std::memory_order_acquire);
+            if(ring != nullptr && ring->owner == self){ goto cache; }
+        }
+
+        // register a new ring
+        i = this->_nb_rings.fetch_add(1, std::memory_order_acq_rel);
+        if(unlikely(i >= this->_max_nb_rings)){
+            POS_ERROR_C_DETAIL("too many producer threads: max_nb_rings(%lu)", this->_max_nb_rings);
+        }
+        POS_CHECK_POINTER(ring = new pos_mpsc_ring_t(this->_ring_capacity));
+        ring->owner = self;
+        this->_rings[i].store(ring, std::memory_order_release);
+
+    cache:
+        // serial is stored plus one, so that zero-initialized entries never hit
+        tls_entry.serial = this->_serial + 1;
+        tls_entry.ring = ring;
+        return ring;
+    }
+
+
+    /*!
+     *  \brief  back off while the ring is full
+     */
+    static inline void __backoff(){
+        static thread_local uint64_t nb_rounds = 0;
+        if(++nb_rounds % 64 != 0){ pos_cpu_relax(); } else { std::this_thread::yield(); }
+    }
+
+
+    /*!
+     *  \brief  counter to generate the serial of each queue
+     */
+    static inline std::atomic<uint64_t>& __get_serial_counter(){
+        static std::atomic<uint64_t> counter(0);
+        return counter;
+    }
+
+    uint64_t _ring_capacity;
+    uint64_t _max_nb_rings;
+
+    // serial of this queue, to index the thread-local ring cache
+    uint64_t _serial;
+
+    // per-thread rings
+    std::atomic<pos_mpsc_ring_t*> *_rings;
+    std::atomic<uint64_t> _nb_rings;
+
+    // allocator of stamps, used by push
+    alignas(64) std::atomic<uint64_t> _stamp_alloc;
+
+    // consumer-owned: stamp of next element to dequeue, and the ring that served the previous element
+    alignas(64) uint64_t _next_stamp;
+    uint64_t _cursor;
+
+    // identify whether this queue is locked, if locked, nothing would be enqueued/dequeued
+    std::atomic<bool> _is_enqueue_locked;
+    std::atomic<bool> _is_dequeue_locked;
+
+    // event to wake the parked consumer, nullptr for no consumer parks on this queue
+    POSWaitEvent *_event;
+};
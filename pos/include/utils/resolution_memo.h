@@ -0,0 +1,242 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  statistics of a resolution memo
+ */
+typedef struct pos_resolution_memo_stat {
+    uint64_t nb_lookups;
+    uint64_t nb_hits;
+
+    // hits on views resolved under an older epoch, which are revalidated
+    uint64_t nb_revalidations;
+
+    // misses on a slot with the same key, yet resolved under an older epoch and failed to revalidate
+    uint64_t nb_stale;
+
+    // stores that replace a slot of another key still valid under the current epoch
+    uint64_t nb_evictions;
+
+    pos_resolution_memo_stat() : nb_lookups(0), nb_hits(0), nb_revalidations(0), nb_stale(0), nb_evictions(0) {}
+
+    inline pos_resolution_memo_stat& operator+=(const pos_resolution_memo_stat& other){
+        nb_lookups += other.nb_lookups;
+        nb_hits += other.nb_hits;
+        nb_revalidations += other.nb_revalidations;
+        nb_stale += other.nb_stale;
+        nb_evictions += other.nb_evictions;
+        return *this;
+    }
+
+    inline double get_hit_rate() const {
+        return nb_lookups > 0 ? (double)nb_hits / (double)nb_lookups : 0.0;
+    }
+} pos_resolution_memo_stat_t;
+
+
+/*!
+ *  \brief  memo of resolution results keyed by a tuple of 64-bit words (e.g., pointer arguments of a
+ *          kernel launch), each result is a list of views resolved from the key
+ *  \note   a result is valid under the epoch it was resolved, the owner passes the current epoch of
+ *          what the results are resolved against (e.g., the address index of memory handles), so that
+ *          any change there invalidates all results without touching the memo; the owner could
+ *          revalidate an invalidated result on its next lookup, if it's cheaper than resolving again
+ *  \note   slots are set-associative by the hash of the key and allocated on the first store, so that
+ *          a memo that is never filled (e.g., of a kernel that is never launched) costs nothing
+ *  \note   not thread-safe, the memo should be accessed by a single parser thread
+ *  \tparam T_View  type of the resolved view
+ */
+template<typename T_View>
+class POSResolutionMemo {
+ public:
+    /*!
+     *  \param  nb_slots    number of slots, rounded up to a power of two of at least kNbWays
+     */
+    POSResolutionMemo(uint64_t nb_slots = kDefaultNbSlots) : _set_mask(0), _clock(0) {
+        POS_ASSERT(nb_slots > 0);
+        while((this->_set_mask + 1) * kNbWays < nb_slots){ this->_set_mask = (this->_set_mask << 1) | 1; }
+    }
+    ~POSResolutionMemo() = default;
+
+
+    /*!
+     *  \brief  obtain the memoized views of given key
+     *  \param  key         the key
+     *  \param  nb_key      number of words within the key
+     *  \param  epoch       current epoch
+     *  \param  revalidate  callback to check whether views resolved under an older epoch still hold
+     *                      under the current one, those revalidated are moved to the current epoch
+     *  \return pointer to the memoized views, nullptr for miss
+     */
+    template<typename F>
+    inline const std::vector<T_View>* get(const uint64_t *key, uint64_t nb_key, uint64_t epoch, F&& revalidate){
+        uint64_t i, hash;
+        pos_resolution_memo_slot_t *set, *slot;
+
+        this->_stat.nb_lookups += 1;
+        if(unlikely(this->_slots.empty())){ return nullptr; }
+
+        hash = __hash(key, nb_key);
+        set = &(this->_slots[(hash & this->_set_mask) * kNbWays]);
+        for(i=0; i<kNbWays; i++){
+            slot = set + i;
+            if(slot->is_valid && slot->hash == hash && __key_equal(slot, key, nb_key)){
+                if(likely(slot->epoch == epoch)){
+                    this->_stat.nb_hits += 1;
+                    slot->last_used = ++this->_clock;
+                    return &(slot->views);
+                }
+                if(revalidate(static_cast<const std::vector<T_View>&>(slot->views))){
+                    this->_stat.nb_hits += 1;
+                    this->_stat.nb_revalidations += 1;
+                    slot->epoch = epoch;
+                    slot->last_used = ++this->_clock;
+                    return &(slot->views);
+                }
+                this->_stat.nb_stale += 1;
+                break;
+            }
+        }
+
+        return nullptr;
+    }
+
+
+    /*!
+     *  \brief  obtain the memoized views of given key, only those resolved under the current epoch
+     *  \param  key     the key
+     *  \param  nb_key  number of words within the key
+     *  \param  epoch   current epoch
+     *  \return pointer to the memoized views, nullptr for miss
+     */
+    inline const std::vector<T_View>* get(const uint64_t *key, uint64_t nb_key, uint64_t epoch){
+        return this->get(key, nb_key, epoch, [](const std::vector<T_View>& views){ return false; });
+    }
+
+
+    /*!
+     *  \brief  reserve the slot of given key to store its views, replacing previous content
+     *  \note   the slot of the same key is reused, otherwise an invalid slot, a slot resolved under an
+     *          older epoch, or the least recently used slot within the set is replaced
+     *  \param  key     the key
+     *  \param  nb_key  number of words within the key
+     *  \param  epoch   epoch that the views to be stored are resolved under
+     *  \return pointer to the (emptied) views of the slot, to be filled by the caller
+     */
+    inline std::vector<T_View>* put(const uint64_t *key, uint64_t nb_key, uint64_t epoch){
+        uint64_t i, hash;
+        pos_resolution_memo_slot_t *set, *slot, *victim = nullptr;
+
+        if(unlikely(this->_slots.empty())){ this->_slots.resize((this->_set_mask + 1) * kNbWays); }
+
+        hash = __hash(key, nb_key);
+        set = &(this->_slots[(hash & this->_set_mask) * kNbWays]);
+        for(i=0; i<kNbWays; i++){
+            slot = set + i;
+            if(slot->is_valid && slot->hash == hash && __key_equal(slot, key, nb_key)){ victim = slot; break; }
+            if(victim == nullptr || __rank(slot, epoch) < __rank(victim, epoch)){ victim = slot; }
+        }
+        if(victim->is_valid && victim->epoch == epoch && !(victim->hash == hash && __key_equal(victim, key, nb_key))){
+            this->_stat.nb_evictions += 1;
+        }
+
+        victim->is_valid = true;
+        victim->hash = hash;
+        victim->epoch = epoch;
+        victim->last_used = ++this->_clock;
+        victim->key.assign(key, key + nb_key);
+        victim->views.clear();
+
+        return &(victim->views);
+    }
+
+
+    /*!
+     *  \brief  drop all memoized views
+     */
+    inline void clear(){
+        for(pos_resolution_memo_slot_t &slot : this->_slots){ slot.is_valid = false; slot.views.clear(); }
+    }
+
+
+    /*!
+     *  \brief  obtain the statistics of the memo
+     */
+    inline const pos_resolution_memo_stat_t& get_stat() const { return this->_stat; }
+
+
+    // default number of slots, covers the distinct argument tuples a kernel is launched with in a step
+    static constexpr uint64_t kDefaultNbSlots = 64;
+
+    // number of slots per set
+    static constexpr uint64_t kNbWays = 4;
+
+
+ private:
+    typedef struct pos_resolution_memo_slot {
+        bool is_valid;
+        uint64_t hash;
+        uint64_t epoch;
+        uint64_t last_used;
+        std::vector<uint64_t> key;
+        std::vector<T_View> views;
+
+        pos_resolution_memo_slot() : is_valid(false), hash(0), epoch(0), last_used(0) {}
+    } pos_resolution_memo_slot_t;
+
+
+    static inline uint64_t __hash(const uint64_t *key, uint64_t nb_key){
+        uint64_t i, hash = nb_key * 0x9e3779b97f4a7c15ul;
+
+        for(i=0; i<nb_key; i++){
+            hash = (hash ^ key[i]) * 0xbf58476d1ce4e5b9ul;
+            hash ^= hash >> 31;
+        }
+
+        return hash;
+    }
+
+
+    static inline bool __key_equal(const pos_resolution_memo_slot_t *slot, const uint64_t *key, uint64_t nb_key){
+        return slot->key.size() == nb_key && (nb_key == 0 || memcmp(slot->key.data(), key, nb_key * sizeof(uint64_t)) == 0);
+    }
+
+    /*!
+     *  \brief  rank of a slot to be replaced, the lower the earlier: invalid slots, then slots resolved
+     *          under an older epoch, then by the time of last use
+     */
+    static inline uint64_t __rank(const pos_resolution_memo_slot_t *slot, uint64_t epoch){
+        if(!slot->is_valid){ return 0; }
+        if(slot->epoch != epoch){ return 1; }
+        return 2 + slot->last_used;
+    }
+
+    uint64_t _set_mask;
+    uint64_t _clock;
+    std::vector<pos_resolution_memo_slot_t> _slots;
+    pos_resolution_memo_stat_t _stat;
+};
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  size classes used by segregated-fit allocators
+ *  \note   size classes are 4 linear steps within each power of 2 (e.g., 64, 80, 96, 112, 128, 160, ...),
+ *          so rounding an allocation up to its class wastes at most 25% of the memory
+ */
+struct POSSizeClass {
+    // log2 of the minimum class size
+    static constexpr uint32_t kMinClassShift = 6;
+
+    // number of classes within each power of 2
+    static constexpr uint32_t kNbSubClassShift = 2;
+    static constexpr uint32_t kNbSubClasses = 1 << kNbSubClassShift;
+
+    // overall number of size classes
+    static constexpr uint32_t kNbClasses = (64 - kMinClassShift) * kNbSubClasses;
+
+    /*!
+     *  \brief  obtain the size of the given class
+     *  \param  class_id    index of the class
+     *  \return size of the class
+     */
+    static inline uint64_t get_class_size(uint32_t class_id){
+        uint32_t shift = kMinClassShift + (class_id >> kNbSubClassShift);
+        uint64_t sub = class_id & (kNbSubClasses - 1);
+        return (1ul << shift) + sub * (1ul << (shift - kNbSubClassShift));
+    }
+
+
+    /*!
+     *  \brief  obtain the index of the smallest class that could hold the given size
+     *  \param  size    the requested size
+     *  \return index of the class
+     */
+    static inline uint32_t get_class_ceil(uint64_t size){
+        uint32_t shift;
+        uint64_t step;
+
+        if(size <= (1ul << kMinClassShift)){ return 0; }
+        shift = 63 - __builtin_clzll(size);
+        step = 1ul << (shift - kNbSubClassShift);
+        return ((shift - kMinClassShift) << kNbSubClassShift)
+                + static_cast<uint32_t>((size - (1ul << shift) + step - 1) / step);
+    }
+
+
+    /*!
+     *  \brief  obtain the index of the largest class that the given capacity could serve
+     *  \note   capacity smaller than the minimum class size falls into class 0
+     *  \param  capacity    capacity of an element
+     *  \return index of the class
+     */
+    static inline uint32_t get_class_floor(uint64_t capacity){
+        uint32_t shift;
+
+        if(capacity <= (1ul << kMinClassShift)){ return 0; }
+        shift = 63 - __builtin_clzll(capacity);
+        return ((shift - kMinClassShift) << kNbSubClassShift)
+                + static_cast<uint32_t>((capacity - (1ul << shift)) >> (shift - kNbSubClassShift));
+    }
+
+
+    /*!
+     *  \brief  round the given size up to its size class, which should be used as the
+     *          capacity while allocating new element
+     *  \param  size    the requested size
+     *  \return rounded size
+     */
+    static inline uint64_t round_up(uint64_t size){
+        return get_class_size(get_class_ceil(size));
+    }
+};
+
+
+/*!
+ *  \brief  segregated-fit free list, which caches freed elements (e.g., checkpoint slots)
+ *          in size-classed bins so that they can be reused by best fit
+ *  \note   all elements within bin i (i > 0) own a memory region no smaller than the size of class i,
+ *          hence only the bin of the requested size needs to be scanned, others can be directly used
+ *  \note   this structure is NOT thread-safe
+ *  \tparam T   type of the cached element, should expose get_capacity()
+ */
+template<typename T>
+class POSSizeClassFreeList {
+ public:
+    static constexpr uint32_t kNbClasses = POSSizeClass::kNbClasses;
+
+    /*!
+     *  \brief  constructor
+     *  \param  max_search_classes  maximum number of classes to search beyond the fitted one,
+     *                              to avoid reusing a huge element for a tiny request; the default
+     *                              value 4 limits the reused element to be at most 2x the request
+     */
+    POSSizeClassFreeList(uint32_t max_search_classes = POSSizeClass::kNbSubClasses)
+        :   _max_search_classes(max_search_classes), _nb_elts(0), _cached_size(0),
+            _nb_hit(0), _nb_miss(0)
+    {
+        this->_bins.resize(kNbClasses);
+        memset(this->_nonempty_bitmap, 0, sizeof(this->_nonempty_bitmap));
+    }
+    ~POSSizeClassFreeList() = default;
+
+
+    /*!
+     *  \brief  cache a freed element
+     *  \param  elt         the element to be cached
+     *  \param  capacity    size of the memory region owned by the element
+     */
+    inline void put(T* elt, uint64_t capacity){
+        uint32_t class_id;
+
+        POS_CHECK_POINTER(elt);
+        class_id = POSSizeClass::get_class_floor(capacity);
+        this->_bins[class_id].push_back(elt);
+        this->_nonempty_bitmap[class_id >> 6] |= (1ul << (class_id & 63));
+        this->_nb_elts += 1;
+        this->_cached_size += capacity;
+    }
+
+
+    /*!
+     *  \brief  obtain the best-fit cached element that could hold the given size
+     *  \param  size        the requested size
+     *  \param  capacity    returned capacity of the obtained element
+     *  \return nullptr for no element fits; otherwise pointer to the obtained element
+     */
+    inline T* get(uint64_t size, uint64_t& capacity){
+        T* elt = nullptr;
+        uint32_t class_id, end_class_id, word_id;
+        uint64_t word, i;
+
+        // step 1: the bin of the requested size might contains elements that are too small,
+        //         so we scan it for the first fitted one
+        class_id = POSSizeClass::get_class_floor(size);
+        for(i=0; i<this->_bins[class_id].size(); i++){
+            if(this->_bins[class_id][i]->get_capacity() >= size){
+                elt = this->_bins[class_id][i];
+                this->_bins[class_id][i] = this->_bins[class_id].back();
+                goto found;
+            }
+        }
+
+        // step 2: locate the first non-empty bin among larger classes, any element there fits
+        class_id += 1;
+        end_class_id = POSSizeClass::get_class_ceil(size) + this->_max_search_classes;
+        if(end_class_id >= kNbClasses){ end_class_id = kNbClasses - 1; }
+        while(class_id <= end_class_id){
+            word_id = class_id >> 6;
+            word = this->_nonempty_bitmap[word_id] & (~0ul << (class_id & 63));
+            if(word != 0){
+                class_id = (word_id << 6) + __builtin_ctzll(word);
+                break;
+            }
+            class_id = (word_id + 1) << 6;
+        }
+        if(unlikely(class_id > end_class_id)){
+            this->_nb_miss += 1;
+            goto exit;
+        }
+        POS_ASSERT(this->_bins[class_id].size() > 0);
+        elt = this->_bins[class_id].back();
+
+    found:
+        this->_bins[class_id].pop_back();
+        if(this->_bins[class_id].size() == 0){
+            this->_nonempty_bitmap[class_id >> 6] &= ~(1ul << (class_id & 63));
+        }
+        capacity = elt->get_capacity();
+        this->_nb_elts -= 1;
+        this->_cached_size -= capacity;
+        this->_nb_hit += 1;
+
+    exit:
+        return elt;
+    }
+
+
+    /*!
+     *  \brief  pop out all cached elements, used while releasing the free list
+     *  \param  elts    returned cached elements
+     */
+    inline void drain(std::vector<T*>& elts){
+        uint32_t i;
+        for(i=0; i<kNbClasses; i++){
+            elts.insert(elts.end(), this->_bins[i].begin(), this->_bins[i].end());
+            this->_bins[i].clear();
+        }
+        memset(this->_nonempty_bitmap, 0, sizeof(this->_nonempty_bitmap));
+        this->_nb_elts = 0;
+        this->_cached_size = 0;
+    }
+
+
+    /*!
+     *  \brief  obtain statistics of the free list
+     */
+    inline uint64_t size() const { return this->_nb_elts; }
+    inline uint64_t get_cached_size() const { return this->_cached_size; }
+    inline uint64_t get_nb_hit() const { return this->_nb_hit; }
+    inline uint64_t get_nb_miss() const { return this->_nb_miss; }
+
+ private:
+    // cached elements of each size class
+    std::vector<std::vector<T*>> _bins;
+
+    // bitmap of non-empty bins
+    uint64_t _nonempty_bitmap[(kNbClasses + 63) / 64];
+
+    // maximum number of classes to search beyond the fitted one
+    uint32_t _max_search_classes;
+
+    // number of cached elements, and overall capacity of them
+    uint64_t _nb_elts;
+    uint64_t _cached_size;
+
+    // number of reuse hit / miss
+    uint64_t _nb_hit;
+    uint64_t _nb_miss;
+};
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  statistics of a slab pool
+ */
+typedef struct pos_slab_pool_stat {
+    // number of slabs, and overall size of them
+    uint64_t nb_slabs;
+    uint64_t nb_slab_bytes;
+
+    // number of elements that are currently allocated
+    uint64_t nb_allocated_elts;
+
+    // overall number of allocations served
+    uint64_t nb_allocs;
+
+    pos_slab_pool_stat() : nb_slabs(0), nb_slab_bytes(0), nb_allocated_elts(0), nb_allocs(0) {}
+} pos_slab_pool_stat_t;
+
+
+/*!
+ *  \brief  pool of fixed-size elements, carved from slabs which are never returned to the system
+ *          until the pool is destroyed
+ *  \note   free elements are chained through their first bytes, so the element size is at least
+ *          the size of a pointer
+ *  \note   alloc / free are thread-safe
+ */
+class POSSlabPool {
+ public:
+    /*!
+     *  \brief  constructor
+     *  \param  elt_size            size of each element
+     *  \param  nb_elts_per_slab    number of elements within each slab
+     */
+    POSSlabPool(uint64_t elt_size, uint64_t nb_elts_per_slab = kDefaultNbEltsPerSlab)
+        :   _elt_size((std::max<uint64_t>(elt_size, sizeof(void*)) + kEltAlignment - 1) / kEltAlignment * kEltAlignment),
+            _nb_elts_per_slab(nb_elts_per_slab), _free_list(nullptr)
+    {
+        POS_ASSERT(nb_elts_per_slab > 0);
+    }
+
+
+    ~POSSlabPool(){
+        for(void *slab : this->_slabs){ ::free(slab); }
+    }
+
+
+    /*!
+     *  \brief  allocate an element
+     *  \return pointer to the element
+     */
+    inline void* alloc(){
+        void *elt;
+        std::lock_guard<std::mutex> lock(this->_mutex);
+
+        if(unlikely(this->_free_list == nullptr)){ this->__grow(); }
+        elt = this->_free_list;
+        this->_free_list = *reinterpret_cast<void**>(elt);
+        this->_stat.nb_allocated_elts += 1;
+        this->_stat.nb_allocs += 1;
+
+        return elt;
+    }
+
+
+    /*!
+     *  \brief  return an element to the pool
+     *  \param  elt the element, should be allocated from this pool
+     */
+    inline void free(void* elt){
+        POS_CHECK_POINTER(elt);
+        std::lock_guard<std::mutex> lock(this->_mutex);
+
+        *reinterpret_cast<void**>(elt) = this->_free_list;
+        this->_free_list = elt;
+        this->_stat.nb_allocated_elts -= 1;
+    }
+
+
+    /*!
+     *  \brief  obtain the size of each element
+     */
+    inline uint64_t get_elt_size() const { return this->_elt_size; }
+
+
+    /*!
+     *  \brief  obtain the statistics of the pool
+     *  \param  stat    the returned statistics
+     */
+    inline void get_stat(pos_slab_pool_stat_t& stat){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        stat = this->_stat;
+    }
+
+
+    // default number of elements within each slab
+    static constexpr uint64_t kDefaultNbEltsPerSlab = 256;
+
+    // alignment of each element
+    static constexpr uint64_t kEltAlignment = 16;
+
+ private:
+    /*!
+     *  \brief  allocate a new slab and chain its elements to the free list
+     *  \note   should be called with the mutex held
+     */
+    inline void __grow(){
+        uint64_t i;
+        uint8_t *slab;
+
+        POS_CHECK_POINTER(slab = reinterpret_cast<uint8_t*>(
+            aligned_alloc(kEltAlignment, this->_elt_size * this->_nb_elts_per_slab)
+        ));
+        for(i=this->_nb_elts_per_slab; i>0; i--){
+            *reinterpret_cast<void**>(slab + (i - 1) * this->_elt_size) = this->_free_list;
+            this->_free_list = slab + (i - 1) * this->_elt_size;
+        }
+        this->_slabs.push_back(slab);
+        this->_stat.nb_slabs += 1;
+        this->_stat.nb_slab_bytes += this->_elt_size * this->_nb_elts_per_slab;
+    }
+
+    uint64_t _elt_size;
+    uint64_t _nb_elts_per_slab;
+
+    // head of the free list
+    void *_free_list;
+
+    std::vector<void*> _slabs;
+    pos_slab_pool_stat_t _stat;
+    std::mutex _mutex;
+};
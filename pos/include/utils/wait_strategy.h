@@ -0,0 +1,207 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "pos/include/common.h"
+
+
+/*!
+ *  \brief  hint the processor that the caller is busy-waiting
+ */
+static inline void pos_cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+
+/*!
+ *  \brief  budgets of a waiting consumer before it parks
+ */
+typedef struct pos_wait_policy {
+    // number of empty polling rounds to busy-spin
+    uint64_t nb_spin_rounds;
+
+    // number of empty polling rounds to yield the processor, after spinning
+    uint64_t nb_yield_rounds;
+
+    // maximum duration (us) of each park, consumers re-poll once it expires
+    uint64_t park_timeout_us;
+
+    static constexpr uint64_t kDefaultNbSpinRounds = 4096;
+    static constexpr uint64_t kDefaultNbYieldRounds = 64;
+    static constexpr uint64_t kDefaultParkTimeoutUs = 10000;
+
+    pos_wait_policy()
+        :   nb_spin_rounds(kDefaultNbSpinRounds), nb_yield_rounds(kDefaultNbYieldRounds),
+            park_timeout_us(kDefaultParkTimeoutUs) {}
+} pos_wait_policy_t;
+
+
+/*!
+ *  \brief  statistics of a waiting consumer
+ */
+typedef struct pos_wait_stat {
+    uint64_t nb_spins;
+    uint64_t nb_yields;
+    uint64_t nb_parks;
+
+    pos_wait_stat() : nb_spins(0), nb_yields(0), nb_parks(0) {}
+} pos_wait_stat_t;
+
+
+/*!
+ *  \brief  event that producers signal and a consumer parks on
+ *  \note   producers bump the epoch on every notify, and only issue the (expensive) futex wake when
+ *          consumers are parked; a consumer records the epoch before polling its queues, and parks
+ *          only if the epoch is unchanged, so that no notification in between is lost
+ */
+class POSWaitEvent {
+ public:
+    POSWaitEvent() : _epoch(0), _nb_parked(0) {}
+    ~POSWaitEvent() = default;
+
+    /*!
+     *  \brief  obtain the current epoch, should be called before polling
+     *  \return the current epoch
+     */
+    inline uint32_t get_epoch() const {
+        return this->_epoch.load(std::memory_order_acquire);
+    }
+
+
+    /*!
+     *  \brief  signal the consumer(s), should be called after the produced element is visible
+     */
+    inline void notify(){
+        this->_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if(unlikely(this->_nb_parked.load(std::memory_order_seq_cst) > 0)){
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&this->_epoch), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+
+    /*!
+     *  \brief  park the caller until notified, or timeout
+     *  \param  epoch       epoch recorded before the caller polled
+     *  \param  timeout_us  maximum duration to park (us)
+     */
+    inline void park(uint32_t epoch, uint64_t timeout_us){
+        struct timespec ts;
+
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+        this->_nb_parked.fetch_add(1, std::memory_order_seq_cst);
+        if(likely(this->_epoch.load(std::memory_order_seq_cst) == epoch)){
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&this->_epoch), FUTEX_WAIT_PRIVATE, epoch, &ts, nullptr, 0);
+        }
+        this->_nb_parked.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+ private:
+    std::atomic<uint32_t> _epoch;
+    std::atomic<uint32_t> _nb_parked;
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+};
+
+
+/*!
+ *  \brief  spin-then-yield-then-park waiting of a polling consumer
+ *  \note   usage within the polling loop:
+ *              wait_strategy.begin_round();
+ *              ... poll all queues attached to the event ...
+ *              wait_strategy.end_round(has_work);
+ */
+class POSWaitStrategy {
+ public:
+    /*!
+     *  \brief  constructor
+     *  \param  event   event that producers of the polled queues signal
+     *  \param  policy  budgets before parking
+     */
+    POSWaitStrategy(POSWaitEvent *event, const pos_wait_policy_t& policy)
+        : _event(event), _policy(policy), _epoch(0), _nb_idle_rounds(0)
+    {
+        POS_CHECK_POINTER(event);
+    }
+    ~POSWaitStrategy() = default;
+
+
+    /*!
+     *  \brief  mark the beginning of a polling round
+     */
+    inline void begin_round(){
+        this->_epoch = this->_event->get_epoch();
+    }
+
+
+    /*!
+     *  \brief  mark the end of a polling round, and wait if nothing was polled
+     *  \param  has_work    whether the round polled any element
+     */
+    inline void end_round(bool has_work){
+        if(likely(has_work)){
+            this->_nb_idle_rounds = 0;
+            return;
+        }
+
+        this->_nb_idle_rounds += 1;
+        if(this->_nb_idle_rounds <= this->_policy.nb_spin_rounds){
+            pos_cpu_relax();
+            this->_stat.nb_spins += 1;
+        } else if(this->_nb_idle_rounds <= this->_policy.nb_spin_rounds + this->_policy.nb_yield_rounds){
+            std::this_thread::yield();
+            this->_stat.nb_yields += 1;
+        } else {
+            this->_event->park(this->_epoch, this->_policy.park_timeout_us);
+            this->_stat.nb_parks += 1;
+        }
+    }
+
+
+    /*!
+     *  \brief  obtain the statistics of waiting
+     */
+    inline const pos_wait_stat_t& get_stat() const { return this->_stat; }
+
+ private:
+    POSWaitEvent *_event;
+    pos_wait_policy_t _policy;
+
+    // epoch recorded at the beginning of current round
+    uint32_t _epoch;
+
+    // number of consecutive rounds that polled nothing
+    uint64_t _nb_idle_rounds;
+
+    pos_wait_stat_t _stat;
+};
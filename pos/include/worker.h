@@ -162,6 +162,9 @@ class POSWorker {
     // worker function map
     std::map<uint64_t, pos_worker_launch_function_t> _launch_functions;
 
+    // launch functions indexed by dense API index, flattened from _launch_functions during init
+    std::vector<pos_worker_launch_function_t> _launch_function_table;
+
     #if POS_CONF_EVAL_CkptOptLevel == 2
         // stream for overlapped memcpy while computing happens
         uint64_t _ckpt_stream_id;
@@ -245,6 +248,14 @@ class POSWorker {
          *  \return POS_SUCCESS for successfully checkpointing
          */
         pos_retval_t __checkpoint_handle_sync(POSCommand_QE_t *cmd);
+
+        /*!
+         *  \brief  record ranges written by an executed API to the checkpoint delta chains of its
+         *          output / inout handles, so that the next incremental checkpoint only copies them
+         *  \note   this function will be invoked by level-1 ckpt, under POS_CONF_EVAL_CkptEnableIncremental
+         *  \param  wqe the executed op
+         */
+        void __record_modified_ranges(POSAPIContext_QE_t* wqe);
     #elif POS_CONF_EVAL_CkptOptLevel == 2
         /*!
          *  \brief  worker daemon with ASYNC checkpoint support (checkpoint optimization level 2)
@@ -280,7 +291,7 @@ class POSWorker {
      *  \param  api_meta    metadata of the called API
      *  \return POS_SUCCESS for successfully checking and restoring
      */
-    pos_retval_t __restore_broken_handles(POSAPIContext_QE_t* wqe, POSAPIMeta_t *api_meta); 
+    pos_retval_t __restore_broken_handles(POSAPIContext_QE_t* wqe, const POSAPIMeta_t *api_meta); 
 
     // maximum index of processed wqe index
     uint64_t _max_wqe_id;
@@ -35,7 +35,11 @@
 #include "pos/include/transport.h"
 #include "pos/include/oob.h"
 #include "pos/include/api_context.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_io.h"
+#include "pos/include/persist_executor.h"
 #include "pos/include/utils/timer.h"
+#include "pos/include/utils/wait_strategy.h"
 
 
 // forward declaration
@@ -70,10 +74,42 @@ class POSWorkspaceConf {
         kRuntimeTraceResourceEnabled,
         kRuntimeTracePerformanceEnabled,
         kRuntimeTraceDir,
+        kRuntimePersistThreads,
+        kRuntimePersistQueueCapacity,
+        kRuntimeCkptIOBackend,
+        kRuntimeCkptIOQueueDepth,
+        kRuntimeCkptIODirectEnabled,
+        kRuntimeCkptDedupChunkSize,
+        kRuntimeCkptCompressCodecs,
+        kRuntimeCkptCompressFrameSize,
+        kRuntimeCkptRetentionPolicies,
+        kRuntimeCkptHostMemBudget,
+        kRuntimeCkptHostMemClientQuota,
+        kRuntimeCkptSpillDir,
+        kRuntimeCkptObjectEndpoint,
+        kRuntimeCkptObjectServeDir,
+        kRuntimeRestoreThreads,
+        kRuntimeRestoreLazyEnabled,
+        kRuntimeDaemonSpinRounds,
+        kRuntimeDaemonYieldRounds,
+        kRuntimeDaemonParkTimeoutUs,
+        kRuntimeDaemonPollBatchSize,
         kEvalCkptIntervfalMs,
+        kEvalCkptChunkSize,
+        kEvalCkptBaseInterval,
         kUnknown
     }; 
 
+    /*!
+     *  \brief  parse an unsigned integer configuration value
+     *  \param  val     value to parse
+     *  \param  what    description of the failed setting, for the warning message
+     *  \param  out     the parsed value
+     *  \return POS_SUCCESS for successfully parsed;
+     *          POS_FAILED_INVALID_INPUT for non-numeric or out-of-range value
+     */
+    static pos_retval_t parse_u64(const std::string& val, const char* what, uint64_t& out);
+
     /*!
      *  \brief  set sepecific configuration in the workspace
      *  \note   should be thread-safe
@@ -102,6 +138,30 @@ class POSWorkspaceConf {
     bool _runtime_trace_resource;
     bool _runtime_trace_performance;
     std::string _runtime_trace_dir;
+    // number of threads / queue capacity of the persist executor, 0 threads for number of online cores
+    uint32_t _runtime_persist_nb_threads;
+    uint64_t _runtime_persist_queue_capacity;
+    // options of the checkpoint I/O backend
+    pos_ckpt_io_options_t _runtime_ckpt_io_options;
+    // retention policies of checkpointed versions, empty for reclaiming nothing
+    std::string _runtime_ckpt_retention_policies;
+    // maximum size of host checkpoint memory that each client could allocate from the checkpoint
+    // arena, applied to clients created afterwards, 0 for unlimited
+    uint64_t _runtime_ckpt_client_quota;
+    // directory of the file that host checkpoint memory spills to under the budget
+    std::string _runtime_ckpt_spill_dir;
+    // endpoint of the object store behind obj:// checkpoint locations, and the directory the
+    // in-process object server serves at that endpoint, empty for not serving
+    std::string _runtime_ckpt_object_serve_dir;
+    POSCheckpointObjectServer _runtime_ckpt_object_server;
+    // number of threads to restore handles, 0 for number of online cores
+    uint32_t _runtime_restore_nb_threads;
+    // whether to defer reloading handle states until their first use after restore
+    bool _runtime_restore_lazy;
+    // budgets of parser / worker daemons before they park on empty queues
+    pos_wait_policy_t _runtime_daemon_wait_policy;
+    // maximum number of apicxt queue elements that parser / worker daemons process per polling round
+    uint64_t _runtime_daemon_poll_batch_size;
 
     // ====== evaluation configurations ======
     // continuous checkpoint interval (ticks)
@@ -162,12 +222,12 @@ class POSWorkspace {
     pos_retval_t remove_client(pos_client_uuid_t uuid);
 
     /*!
-     *  \brief  restore a client to the workspace, based on given ckpt file
-     *  \param  ckpt_file   path to the checkpoint file of the client
+     *  \brief  restore a client to the workspace, based on given checkpoint image
+     *  \param  ckpt_image  the opened checkpoint image
      *  \param  clnt        pointer to the restored client
      *  \return POS_SUCCESS for successfully restore
      */
-    pos_retval_t restore_client(std::string& ckpt_file, POSClient** clnt);
+    pos_retval_t restore_client(POSCheckpointImage* ckpt_image, POSClient** clnt);
 
     /*!
      *  \brief  obtain client by given uuid
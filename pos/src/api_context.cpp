@@ -28,30 +28,27 @@
 #include "pos/include/log.h"
 #include "pos/include/handle.h"
 #include "pos/include/api_context.h"
+#include "pos/include/apicxt_log.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_storage.h"
 #include "pos/include/utils/timer.h"
 #include "pos/include/proto/apicxt.pb.h"
 
 
-POSAPIContext_QE::POSAPIContext_QE(POSClient* client, const std::string& ckpt_file){
+POSAPIContext_QE::POSAPIContext_QE(POSClient* client, const void* mapped, uint64_t size)
+    : api_cxt(nullptr), nb_refs(1), pool(nullptr), completion_state(kPOS_API_Completion_Pending)
+{
     pos_retval_t retval = POS_SUCCESS;
     pos_protobuf::Bin_POSAPIContext apicxt_binary;
     POSHandleView_t hv;
-    std::ifstream input;
     uint64_t i, param_size;
-    void *param_area;
     POSAPIParam_t *api_param;
 
     POS_CHECK_POINTER(client);
+    POS_CHECK_POINTER(mapped);
 
-    input.open(ckpt_file, std::ios::in | std::ios::binary);
-    if(!input){
-        POS_WARN_C("failed to open apicxt ckpt file");
-        retval = POS_FAILED;
-        goto exit;
-    }
-
-    if (!apicxt_binary.ParseFromIstream(&input)) {
-        POS_WARN_C("failed to deserialize apicxt ckpt file");
+    if (!apicxt_binary.ParseFromArray(mapped, size)) {
+        POS_WARN_C("failed to deserialize apicxt ckpt record");
         retval = POS_FAILED;
         goto exit;
     }
@@ -118,20 +115,15 @@ POSAPIContext_QE::POSAPIContext_QE(POSClient* client, const std::string& ckpt_fi
 
     for(i=0; i<apicxt_binary.params_size(); i++){
         POS_ASSERT((param_size = apicxt_binary.params(i).size()) > 0);
-        POS_CHECK_POINTER(param_area = malloc(param_size));
-        memcpy(
-            param_area, 
-            reinterpret_cast<const void*>(apicxt_binary.params(i).state().c_str()),
-            param_size
-        );
-
-        POS_CHECK_POINTER(api_param = new POSAPIParam_t(param_area, param_size));
+        POS_CHECK_POINTER(api_param = new POSAPIParam_t(
+            reinterpret_cast<const void*>(apicxt_binary.params(i).state().c_str()), param_size
+        ));
         this->api_cxt->params.push_back(api_param);
+        this->api_cxt->overall_param_size += param_size;
     }
 
 exit:
-    if(input.is_open()){ input.close(); }
-    if(unlikely(retval = POS_SUCCESS)){
+    if(unlikely(retval != POS_SUCCESS)){
         // we mark client as nullptr to let outside know this APIcontext isn't
         // create successfully
         this->client = nullptr;
@@ -139,22 +131,24 @@ exit:
 }
 
 
+/*!
+ *  \brief  fill the protobuf binary of the given API context
+ *  \tparam with_params whether to fill with parameter information
+ *  \param  wqe             the API context
+ *  \param  apicxt_binary   the binary to fill
+ */
 template<bool with_params>
-pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
-    pos_retval_t retval = POS_SUCCESS;
-    std::string ckpt_file_path;
-    pos_protobuf::Bin_POSAPIContext apicxt_binary;
+static void __fill_apicxt_binary(POSAPIContext_QE* wqe, pos_protobuf::Bin_POSAPIContext& apicxt_binary){
     pos_protobuf::Bin_POSHandleView *hv_binary;
     pos_protobuf::Bin_POSAPIParam *param_binary;
-    std::ofstream ckpt_file_stream;
 
-    POS_ASSERT(std::filesystem::exists(ckpt_dir));
+    POS_CHECK_POINTER(wqe);
 
-    apicxt_binary.set_id(this->id);
-    apicxt_binary.set_has_return(this->has_return);
-    apicxt_binary.set_api_id(this->api_cxt->api_id);
+    apicxt_binary.set_id(wqe->id);
+    apicxt_binary.set_has_return(wqe->has_return);
+    apicxt_binary.set_api_id(wqe->api_cxt->api_id);
 
-    for(POSHandleView_t &hv : this->input_handle_views){
+    for(POSHandleView_t &hv : wqe->input_handle_views){
         POS_CHECK_POINTER(hv_binary = apicxt_binary.add_input_handle_views());
         POS_CHECK_POINTER(hv.handle);
         hv_binary->set_resource_type_id(hv.handle->resource_type_id);
@@ -163,7 +157,7 @@ pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
         hv_binary->set_offset(hv.offset);
     }
 
-    for(POSHandleView_t &hv : this->output_handle_views){
+    for(POSHandleView_t &hv : wqe->output_handle_views){
         POS_CHECK_POINTER(hv_binary = apicxt_binary.add_output_handle_views());
         POS_CHECK_POINTER(hv.handle);
         hv_binary->set_resource_type_id(hv.handle->resource_type_id);
@@ -172,7 +166,7 @@ pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
         hv_binary->set_offset(hv.offset);
     }
 
-    for(POSHandleView_t &hv : this->create_handle_views){
+    for(POSHandleView_t &hv : wqe->create_handle_views){
         POS_CHECK_POINTER(hv_binary = apicxt_binary.add_create_handle_views());
         POS_CHECK_POINTER(hv.handle);
         hv_binary->set_resource_type_id(hv.handle->resource_type_id);
@@ -181,7 +175,7 @@ pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
         hv_binary->set_offset(hv.offset);
     }
 
-    for(POSHandleView_t &hv : this->delete_handle_views){
+    for(POSHandleView_t &hv : wqe->delete_handle_views){
         POS_CHECK_POINTER(hv_binary = apicxt_binary.add_delete_handle_views());
         POS_CHECK_POINTER(hv.handle);
         hv_binary->set_resource_type_id(hv.handle->resource_type_id);
@@ -190,7 +184,7 @@ pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
         hv_binary->set_offset(hv.offset);
     }
 
-    for(POSHandleView_t &hv : this->inout_handle_views){
+    for(POSHandleView_t &hv : wqe->inout_handle_views){
         POS_CHECK_POINTER(hv_binary = apicxt_binary.add_inout_handle_views());
         POS_CHECK_POINTER(hv.handle);
         hv_binary->set_resource_type_id(hv.handle->resource_type_id);
@@ -198,50 +192,94 @@ pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
         hv_binary->set_param_index(hv.param_index);
         hv_binary->set_offset(hv.offset);
     }
-    apicxt_binary.set_create_tick(this->create_tick);
-    apicxt_binary.set_return_tick(this->return_tick);
-    apicxt_binary.set_parser_s_tick(this->parser_s_tick);
-    apicxt_binary.set_parser_e_tick(this->parser_e_tick);
-    apicxt_binary.set_worker_s_tick(this->worker_s_tick);
-    apicxt_binary.set_worker_e_tick(this->worker_e_tick);
+    apicxt_binary.set_create_tick(wqe->create_tick);
+    apicxt_binary.set_return_tick(wqe->return_tick);
+    apicxt_binary.set_parser_s_tick(wqe->parser_s_tick);
+    apicxt_binary.set_parser_e_tick(wqe->parser_e_tick);
+    apicxt_binary.set_worker_s_tick(wqe->worker_s_tick);
+    apicxt_binary.set_worker_e_tick(wqe->worker_e_tick);
 
     if constexpr (with_params) {
-        for(POSAPIParam_t * &param : this->api_cxt->params){
+        for(POSAPIParam_t * &param : wqe->api_cxt->params){
             POS_CHECK_POINTER(param_binary = apicxt_binary.add_params());
             POS_ASSERT(param->param_size > 0);
             param_binary->set_size(param->param_size);
             param_binary->set_state(reinterpret_cast<const char*>(param->param_value), param->param_size);
         }
     }
+}
 
-    // form the path to the checkpoint file of this handle
-    ckpt_file_path = ckpt_dir 
-                    + std::string("/a-")
-                    + std::to_string(this->id) 
-                    + std::string(".bin");
 
-    // write to file
-    ckpt_file_stream.open(ckpt_file_path, std::ios::binary | std::ios::out);
-    if(!ckpt_file_stream){
-        POS_WARN_C(
-            "failed to dump checkpoint to file, failed to open file: path(%s)",
-            ckpt_file_path.c_str()
-        );
+template<bool with_params>
+pos_retval_t POSAPIContext_QE::persist(std::string ckpt_dir){
+    pos_retval_t retval = POS_SUCCESS;
+    std::string serialized;
+    pos_protobuf::Bin_POSAPIContext apicxt_binary;
+    POSCheckpointImageWriter *ckpt_image;
+
+    POS_ASSERT(POSCheckpointStorage::exists(ckpt_dir));
+
+    __fill_apicxt_binary<with_params>(this, apicxt_binary);
+
+    if(!apicxt_binary.SerializeToString(&serialized)){
+        POS_WARN_C("failed to dump checkpoint, protobuf failed to serialize: id(%lu)", this->id);
         retval = POS_FAILED;
         goto exit;
     }
-    if(!apicxt_binary.SerializeToOstream(&ckpt_file_stream)){
-        POS_WARN_C(
-            "failed to dump checkpoint to file, protobuf failed to dump: path(%s)",
-            ckpt_file_path.c_str()
-        );
+
+    // append to the checkpoint image
+    if(unlikely(nullptr == (ckpt_image = POSCheckpointImageWriter::open(ckpt_dir)))){
+        POS_WARN_C("failed to dump checkpoint, failed to open checkpoint image: ckpt_dir(%s)", ckpt_dir.c_str());
         retval = POS_FAILED;
         goto exit;
     }
+    retval = ckpt_image->append(
+        /* type */ kPOS_CkptImageRecord_APIContext,
+        /* resource_type_id */ 0,
+        /* id */ this->id,
+        /* version */ 0,
+        /* data */ serialized.data(),
+        /* size */ serialized.size()
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to dump checkpoint to image: id(%lu), retval(%u)", this->id, retval);
+    }
 
 exit:
-    if(ckpt_file_stream.is_open()){ ckpt_file_stream.close(); }
     return retval;
 }
 template pos_retval_t POSAPIContext_QE::persist<true>(std::string ckpt_dir);
 template pos_retval_t POSAPIContext_QE::persist<false>(std::string ckpt_dir);
+
+
+template<bool with_params>
+pos_retval_t POSAPIContext_QE::persist(POSAPIContextLogWriter* log){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_protobuf::Bin_POSAPIContext apicxt_binary;
+    uint64_t size;
+    void *frame;
+
+    POS_CHECK_POINTER(log);
+
+    __fill_apicxt_binary<with_params>(this, apicxt_binary);
+
+    // serialize straight into the frame of the log
+    size = apicxt_binary.ByteSizeLong();
+    if(unlikely(nullptr == (frame = log->append_frame(
+        this->id, with_params ? kPOS_APICxtLogFrameFlag_WithParams : 0, size
+    )))){
+        POS_WARN_C("failed to dump checkpoint, failed to append to API context log: id(%lu)", this->id);
+        retval = POS_FAILED;
+        goto exit;
+    }
+    if(unlikely(!apicxt_binary.SerializeToArray(frame, static_cast<int>(size)))){
+        POS_WARN_C("failed to dump checkpoint, protobuf failed to serialize: id(%lu)", this->id);
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+exit:
+    return retval;
+}
+template pos_retval_t POSAPIContext_QE::persist<true>(POSAPIContextLogWriter* log);
+template pos_retval_t POSAPIContext_QE::persist<false>(POSAPIContextLogWriter* log);
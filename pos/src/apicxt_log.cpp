@@ -0,0 +1,197 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/apicxt_log.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/persist_executor.h"
+
+
+POSAPIContextLogWriter::POSAPIContextLogWriter(const std::string& ckpt_dir) : _ckpt_dir(ckpt_dir) {
+    POS_CHECK_POINTER(this->_batch = std::make_shared<std::vector<uint8_t>>());
+    this->_batch->reserve(batch_size);
+}
+
+
+POSAPIContextLogWriter::~POSAPIContextLogWriter(){
+    if(unlikely(this->_batch->size() > 0)){
+        POS_WARN_C(
+            "API context log destroyed with unflushed frames, they're dropped: ckpt_dir(%s), size(%lu)",
+            this->_ckpt_dir.c_str(), this->_batch->size()
+        );
+    }
+}
+
+
+void* POSAPIContextLogWriter::append_frame(pos_u64id_t id, uint32_t flags, uint64_t size){
+    pos_apicxt_log_frame_header_t header;
+    uint64_t offset;
+
+    if(unlikely(size > UINT32_MAX)){
+        POS_WARN_C("failed to append frame to API context log, oversized: id(%lu), size(%lu)", id, size);
+        return nullptr;
+    }
+
+    if(this->_batch->size() > 0 && this->_batch->size() + sizeof(header) + size > batch_size){
+        if(unlikely(POS_SUCCESS != this->flush())){ return nullptr; }
+    }
+
+    header.size = static_cast<uint32_t>(size);
+    header.flags = flags;
+    header.id = id;
+
+    offset = this->_batch->size();
+    this->_batch->resize(offset + sizeof(header) + size);
+    memcpy(this->_batch->data() + offset, &header, sizeof(header));
+
+    this->_stat.nb_frames += 1;
+    this->_stat.size += sizeof(header) + size;
+
+    return this->_batch->data() + offset + sizeof(header);
+}
+
+
+pos_retval_t POSAPIContextLogWriter::flush(){
+    pos_retval_t retval = POS_SUCCESS;
+    std::shared_ptr<std::vector<uint8_t>> batch;
+    std::string ckpt_dir = this->_ckpt_dir;
+    uint64_t segment_idx;
+
+    if(this->_batch->size() == 0){ goto exit; }
+
+    batch = this->_batch;
+    segment_idx = this->_stat.nb_segments;
+    POSPersistExecutor::get_instance()->submit(
+        [batch, ckpt_dir, segment_idx]() -> pos_retval_t {
+            pos_retval_t append_retval;
+            POSCheckpointImageWriter *ckpt_image;
+
+            if(unlikely(nullptr == (ckpt_image = POSCheckpointImageWriter::open(ckpt_dir)))){
+                POS_WARN("failed to flush API context log, failed to open checkpoint image: ckpt_dir(%s)", ckpt_dir.c_str());
+                return POS_FAILED;
+            }
+            append_retval = ckpt_image->append(
+                /* type */ kPOS_CkptImageRecord_APIContextLog,
+                /* resource_type_id */ 0,
+                /* id */ segment_idx,
+                /* version */ 0,
+                /* data */ batch->data(),
+                /* size */ batch->size()
+            );
+            if(unlikely(append_retval != POS_SUCCESS)){
+                POS_WARN(
+                    "failed to flush API context log: ckpt_dir(%s), segment(%lu), retval(%u)",
+                    ckpt_dir.c_str(), segment_idx, append_retval
+                );
+            }
+            return append_retval;
+        },
+        /* tag */ ckpt_dir
+    );
+    this->_stat.nb_segments += 1;
+
+    // the submitted batch is owned by the task now
+    POS_CHECK_POINTER(this->_batch = std::make_shared<std::vector<uint8_t>>());
+    this->_batch->reserve(batch_size);
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSAPIContextLogReader::open(POSCheckpointImage* image){
+    pos_retval_t retval = POS_SUCCESS;
+    std::vector<pos_retval_t> results;
+
+    POS_CHECK_POINTER(this->_image = image);
+    this->_segment_idx = 0;
+    this->_offset = 0;
+
+    // segments are returned in ascending order of their index, i.e., the order of flushing
+    image->get_entries(kPOS_CkptImageRecord_APIContextLog, this->_segments);
+    if(this->_segments.size() == 0){ goto exit; }
+
+    if(unlikely(POS_SUCCESS != (retval = image->verify_entries(this->_segments, results)))){
+        POS_WARN_C("failed to open API context log, corrupted segment: nb_segments(%lu)", this->_segments.size());
+        goto exit;
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSAPIContextLogReader::next(const pos_apicxt_log_frame_header_t** header, const void** data){
+    pos_retval_t retval = POS_SUCCESS;
+    const pos_ckpt_image_entry_t *segment;
+    const uint8_t *base;
+    uint64_t page_size, begin, end;
+
+    POS_CHECK_POINTER(header);
+    POS_CHECK_POINTER(data);
+    POS_CHECK_POINTER(this->_image);
+
+    // skip exhausted segments
+    while(this->_segment_idx < this->_segments.size() && this->_offset >= this->_segments[this->_segment_idx]->size){
+        this->_segment_idx += 1;
+        this->_offset = 0;
+    }
+    if(this->_segment_idx >= this->_segments.size()){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+
+    POS_CHECK_POINTER(segment = this->_segments[this->_segment_idx]);
+    base = reinterpret_cast<const uint8_t*>(this->_image->get_data(segment));
+
+    // the segment is walked once from head to tail, let the kernel read ahead aggressively
+    if(this->_offset == 0){
+        page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        begin = reinterpret_cast<uint64_t>(base) & ~(page_size - 1);
+        end = reinterpret_cast<uint64_t>(base) + segment->size;
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_SEQUENTIAL);
+    }
+
+    if(unlikely(this->_offset + sizeof(pos_apicxt_log_frame_header_t) > segment->size)){
+        POS_WARN_C("truncated frame header in API context log: segment(%lu), offset(%lu)", segment->id, this->_offset);
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    *header = reinterpret_cast<const pos_apicxt_log_frame_header_t*>(base + this->_offset);
+    if(unlikely(this->_offset + sizeof(pos_apicxt_log_frame_header_t) + (*header)->size > segment->size)){
+        POS_WARN_C(
+            "truncated frame in API context log: segment(%lu), offset(%lu), size(%u)",
+            segment->id, this->_offset, (*header)->size
+        );
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    *data = base + this->_offset + sizeof(pos_apicxt_log_frame_header_t);
+    this->_offset += sizeof(pos_apicxt_log_frame_header_t) + (*header)->size;
+
+exit:
+    return retval;
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_arena.h"
+#include "pos/include/checkpoint_io.h"
+#include "pos/include/utils/size_class_freelist.h"
+
+
+// client that the calling thread is bound to
+static thread_local pos_client_uuid_t __ckpt_arena_thread_client = kPOS_CkptArena_NoClient;
+
+
+POSCheckpointArena* POSCheckpointArena::get_instance(){
+    static POSCheckpointArena arena;
+    return &arena;
+}
+
+
+POSCheckpointArena::POSCheckpointArena()
+    :   _is_init(false), _mode(kPOS_CkptArenaMode_Host), _pin_func(nullptr), _unpin_func(nullptr),
+        _chunk_size(kDefaultChunkSize), _cur_chunk_ptr(nullptr), _cur_chunk_left(0)
+{
+    this->_free_blocks.resize(POSSizeClass::kNbClasses);
+}
+
+
+POSCheckpointArena::~POSCheckpointArena(){
+    typename std::map<void*, pos_ckpt_arena_chunk_t>::iterator chunk_iter;
+
+    /*!
+     *  \note   we don't unpin here, as the XPU runtime might have been torn down
+     *          before this process-wide object is destructed
+     */
+    for(chunk_iter = this->_chunks.begin(); chunk_iter != this->_chunks.end(); chunk_iter++){
+        munmap(chunk_iter->first, chunk_iter->second.size);
+    }
+    this->_chunks.clear();
+}
+
+
+pos_retval_t POSCheckpointArena::init(
+    pos_ckpt_arena_mode_t mode,
+    uint64_t chunk_size,
+    uint64_t nb_prefill_chunks,
+    pos_ckpt_arena_pin_func_t pin_func,
+    pos_ckpt_arena_unpin_func_t unpin_func
+){
+    pos_retval_t retval = POS_SUCCESS;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely(this->_is_init == true)){
+        POS_WARN_C("failed to init checkpoint arena, already initialized");
+        retval = POS_FAILED_ALREADY_EXIST;
+        goto exit;
+    }
+
+    if(unlikely(mode == kPOS_CkptArenaMode_Pinned && (pin_func == nullptr || unpin_func == nullptr))){
+        POS_WARN_C("failed to init checkpoint arena, no pin / unpin function provided under pinned mode");
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    if(unlikely(chunk_size == 0)){
+        POS_WARN_C("failed to init checkpoint arena, chunk size is 0");
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    this->_mode = mode;
+    this->_pin_func = pin_func;
+    this->_unpin_func = unpin_func;
+    this->_chunk_size = (chunk_size + kHugepageSize - 1) / kHugepageSize * kHugepageSize;
+    this->_is_init = true;
+
+    // prefill chunks as one region, so that blocks could be carved continuously from it
+    if(nb_prefill_chunks > 0){
+        this->_cur_chunk_ptr = reinterpret_cast<uint8_t*>(
+            this->__map_region(nb_prefill_chunks * this->_chunk_size)
+        );
+        if(unlikely(this->_cur_chunk_ptr == nullptr)){
+            POS_WARN_C(
+                "failed to prefill checkpoint arena: nb_prefill_chunks(%lu), chunk_size(%lu)",
+                nb_prefill_chunks, this->_chunk_size
+            );
+            this->_cur_chunk_left = 0;
+            retval = POS_FAILED_OOM;
+            goto exit;
+        }
+        this->_cur_chunk_left = nb_prefill_chunks * this->_chunk_size;
+    }
+
+    POS_DEBUG_C(
+        "checkpoint arena initialized: mode(%s), chunk_size(%lu), nb_prefill_chunks(%lu)",
+        mode == kPOS_CkptArenaMode_Host ? "host" : "pinned", this->_chunk_size, nb_prefill_chunks
+    );
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointArena::__lazy_init(){
+    if(likely(this->_is_init == true)){ return POS_SUCCESS; }
+    this->_mode = kPOS_CkptArenaMode_Host;
+    this->_is_init = true;
+    return POS_SUCCESS;
+}
+
+
+void* POSCheckpointArena::alloc(uint64_t size){
+    void *ptr = nullptr;
+    uint64_t block_size;
+    uint32_t class_id;
+    pos_client_uuid_t client_id = __ckpt_arena_thread_client;
+    pos_ckpt_arena_stat_t *client_stat;
+    pos_ckpt_arena_block_t block;
+    typename std::multimap<uint64_t, void*>::iterator large_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely(size == 0)){
+        POS_WARN_C("try to allocate block with size of 0 from checkpoint arena");
+        goto exit;
+    }
+
+    this->__lazy_init();
+    client_stat = &(this->_client_stats[client_id]);
+
+    if(likely(size <= this->_chunk_size / 4)){
+        class_id = POSSizeClass::get_class_ceil(size);
+        block_size = POSSizeClass::get_class_size(class_id);
+    } else {
+        class_id = POSSizeClass::kNbClasses;
+        block_size = (size + kHugepageSize - 1) / kHugepageSize * kHugepageSize;
+    }
+
+    // check quota of the client
+    if(unlikely(client_stat->quota > 0 && client_stat->allocated_size + block_size > client_stat->quota)){
+        POS_WARN_C(
+            "checkpoint arena rejects allocation, exceed client quota: "
+            "client_id(%lu), size(%lu), allocated_size(%lu), quota(%lu)",
+            client_id, block_size, client_stat->allocated_size, client_stat->quota
+        );
+        client_stat->nb_rejected += 1;
+        this->_stat.nb_rejected += 1;
+        goto exit;
+    }
+
+    if(likely(class_id < POSSizeClass::kNbClasses)){
+        if(this->_free_blocks[class_id].size() > 0){
+            ptr = this->_free_blocks[class_id].back();
+            this->_free_blocks[class_id].pop_back();
+            client_stat->nb_reuse += 1;
+            this->_stat.nb_reuse += 1;
+        } else {
+            ptr = this->__carve(block_size);
+        }
+    } else {
+        // reuse cached dedicated mapping if it's no larger than 2x of the request
+        large_iter = this->_free_large_blocks.lower_bound(block_size);
+        if(large_iter != this->_free_large_blocks.end() && large_iter->first <= 2 * block_size){
+            block_size = large_iter->first;
+            ptr = large_iter->second;
+            this->_free_large_blocks.erase(large_iter);
+            client_stat->nb_reuse += 1;
+            this->_stat.nb_reuse += 1;
+        } else {
+            ptr = this->__map_region(block_size);
+        }
+    }
+
+    if(unlikely(ptr == nullptr)){
+        POS_WARN_C("checkpoint arena failed to allocate block: size(%lu)", block_size);
+        client_stat->nb_rejected += 1;
+        this->_stat.nb_rejected += 1;
+        goto exit;
+    }
+
+    block.size = block_size;
+    block.class_id = class_id;
+    block.client_id = client_id;
+    this->_blocks[ptr] = block;
+
+    client_stat->allocated_size += block_size;
+    client_stat->nb_alloc += 1;
+    this->_stat.allocated_size += block_size;
+    this->_stat.nb_alloc += 1;
+
+exit:
+    return ptr;
+}
+
+
+void POSCheckpointArena::free(void* ptr){
+    typename std::unordered_map<void*, pos_ckpt_arena_block_t>::iterator block_iter;
+    pos_ckpt_arena_stat_t *client_stat;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely(ptr == nullptr)){ return; }
+
+    block_iter = this->_blocks.find(ptr);
+    if(unlikely(block_iter == this->_blocks.end())){
+        POS_WARN_C("try to free block that isn't allocated from checkpoint arena: ptr(%p)", ptr);
+        return;
+    }
+
+    client_stat = &(this->_client_stats[block_iter->second.client_id]);
+    client_stat->allocated_size -= block_iter->second.size;
+    client_stat->nb_free += 1;
+    this->_stat.allocated_size -= block_iter->second.size;
+    this->_stat.nb_free += 1;
+
+    if(likely(block_iter->second.class_id < POSSizeClass::kNbClasses)){
+        this->_free_blocks[block_iter->second.class_id].push_back(ptr);
+    } else {
+        this->_free_large_blocks.insert(
+            std::pair<uint64_t, void*>(block_iter->second.size, ptr)
+        );
+    }
+
+    this->_blocks.erase(block_iter);
+}
+
+
+void POSCheckpointArena::set_thread_client(pos_client_uuid_t client_id){
+    __ckpt_arena_thread_client = client_id;
+}
+
+
+void POSCheckpointArena::set_client_quota(pos_client_uuid_t client_id, uint64_t quota){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_client_stats[client_id].quota = quota;
+}
+
+
+void POSCheckpointArena::get_stat(pos_ckpt_arena_stat_t& stat){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    stat = this->_stat;
+}
+
+
+pos_retval_t POSCheckpointArena::get_client_stat(pos_client_uuid_t client_id, pos_ckpt_arena_stat_t& stat){
+    pos_retval_t retval = POS_SUCCESS;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely(this->_client_stats.count(client_id) == 0)){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+    stat = this->_client_stats[client_id];
+
+exit:
+    return retval;
+}
+
+
+uint64_t POSCheckpointArena::trim(){
+    uint64_t released_size = 0;
+    typename std::multimap<uint64_t, void*>::iterator large_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    for(large_iter = this->_free_large_blocks.begin(); large_iter != this->_free_large_blocks.end(); large_iter++){
+        this->__unmap_region(large_iter->second, large_iter->first);
+        released_size += large_iter->first;
+    }
+    this->_free_large_blocks.clear();
+
+    return released_size;
+}
+
+
+void* POSCheckpointArena::__carve(uint64_t size){
+    void *ptr = nullptr;
+
+    if(unlikely(this->_cur_chunk_left < size)){
+        /*!
+         *  \note   the tail of the previous chunk is abandoned, which is at most
+         *          a quarter of the chunk as large blocks are mapped dedicatedly
+         */
+        this->_cur_chunk_ptr = reinterpret_cast<uint8_t*>(this->__map_region(this->_chunk_size));
+        if(unlikely(this->_cur_chunk_ptr == nullptr)){
+            this->_cur_chunk_left = 0;
+            goto exit;
+        }
+        this->_cur_chunk_left = this->_chunk_size;
+    }
+
+    ptr = this->_cur_chunk_ptr;
+    this->_cur_chunk_ptr += size;
+    this->_cur_chunk_left -= size;
+
+exit:
+    return ptr;
+}
+
+
+void* POSCheckpointArena::__map_region(uint64_t size){
+    void *ptr;
+    uint64_t i, page_size;
+    bool is_hugepage = true;
+
+    // try explicit hugepages first, which are pre-faulted by MAP_POPULATE
+    ptr = mmap(
+        nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0
+    );
+
+    if(ptr == MAP_FAILED){
+        // fallback to normal pages, hint transparent hugepages, then pre-fault by touching
+        is_hugepage = false;
+        ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(unlikely(ptr == MAP_FAILED)){
+            POS_WARN_C("failed to map region for checkpoint arena: size(%lu)", size);
+            ptr = nullptr;
+            goto exit;
+        }
+        madvise(ptr, size, MADV_HUGEPAGE);
+        page_size = sysconf(_SC_PAGESIZE);
+        for(i=0; i<size; i+=page_size){
+            reinterpret_cast<volatile uint8_t*>(ptr)[i] = 0;
+        }
+    }
+
+    if(this->_mode == kPOS_CkptArenaMode_Pinned){
+        POS_CHECK_POINTER(this->_pin_func);
+        if(unlikely(POS_SUCCESS != this->_pin_func(ptr, size))){
+            POS_WARN_C("failed to pin region for checkpoint arena: ptr(%p), size(%lu)", ptr, size);
+            munmap(ptr, size);
+            ptr = nullptr;
+            goto exit;
+        }
+    }
+
+    this->_chunks[ptr].size = size;
+    this->_chunks[ptr].is_hugepage = is_hugepage;
+    this->_stat.reserved_size += size;
+    this->_stat.nb_chunks += 1;
+    if(is_hugepage){ this->_stat.nb_hugepage_chunks += 1; }
+
+    // checkpoint slots are used as I/O buffers when persisting
+    POSCheckpointIOBackend::get_instance()->register_buffer(ptr, size);
+
+exit:
+    return ptr;
+}
+
+
+void POSCheckpointArena::__unmap_region(void* ptr, uint64_t size){
+    POS_CHECK_POINTER(ptr);
+
+    if(this->_mode == kPOS_CkptArenaMode_Pinned){
+        POS_CHECK_POINTER(this->_unpin_func);
+        if(unlikely(POS_SUCCESS != this->_unpin_func(ptr))){
+            POS_WARN_C("failed to unpin region of checkpoint arena: ptr(%p), size(%lu)", ptr, size);
+        }
+    }
+    POSCheckpointIOBackend::get_instance()->unregister_buffer(ptr);
+    munmap(ptr, size);
+
+    this->_stat.reserved_size -= size;
+    this->_stat.nb_chunks -= 1;
+    if(this->_chunks[ptr].is_hugepage){ this->_stat.nb_hugepage_chunks -= 1; }
+    this->_chunks.erase(ptr);
+}
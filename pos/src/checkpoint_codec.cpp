@@ -0,0 +1,233 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <limits>
+#include <algorithm>
+
+#include <stdint.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_codec.h"
+
+
+/*!
+ *  \brief  open the first loadable library among the given names
+ *  \param  names   candidate names of the library, terminated by nullptr
+ *  \return handle of the library, nullptr for none is loadable
+ */
+static void* __open_library(const char* const* names){
+    void *lib = nullptr;
+    for(; *names != nullptr && lib == nullptr; names++){
+        lib = dlopen(*names, RTLD_NOW | RTLD_LOCAL);
+    }
+    return lib;
+}
+
+
+POSCheckpointCodec* POSCheckpointCodec::get_instance(){
+    static POSCheckpointCodec codec;
+    return &codec;
+}
+
+
+POSCheckpointCodec::POSCheckpointCodec()
+    :   _lz4_lib(nullptr), _zstd_lib(nullptr), _lz4_compress_bound(nullptr), _lz4_compress_default(nullptr),
+        _lz4_decompress_safe(nullptr), _zstd_compress_bound(nullptr), _zstd_compress(nullptr),
+        _zstd_decompress(nullptr), _zstd_is_error(nullptr)
+{
+    static const char* const lz4_names[] = { "liblz4.so.1", "liblz4.so", nullptr };
+    static const char* const zstd_names[] = { "libzstd.so.1", "libzstd.so", nullptr };
+
+    if((this->_lz4_lib = __open_library(lz4_names)) != nullptr){
+        this->_lz4_compress_bound = reinterpret_cast<int(*)(int)>(dlsym(this->_lz4_lib, "LZ4_compressBound"));
+        this->_lz4_compress_default = reinterpret_cast<int(*)(const char*, char*, int, int)>(
+            dlsym(this->_lz4_lib, "LZ4_compress_default")
+        );
+        this->_lz4_decompress_safe = reinterpret_cast<int(*)(const char*, char*, int, int)>(
+            dlsym(this->_lz4_lib, "LZ4_decompress_safe")
+        );
+        if(unlikely(
+                this->_lz4_compress_bound == nullptr || this->_lz4_compress_default == nullptr
+            ||  this->_lz4_decompress_safe == nullptr
+        )){
+            POS_WARN_C("failed to load symbols of LZ4, the codec is disabled");
+            dlclose(this->_lz4_lib);
+            this->_lz4_lib = nullptr;
+        }
+    } else {
+        POS_DEBUG_C("LZ4 isn't installed, the codec is disabled");
+    }
+
+    if((this->_zstd_lib = __open_library(zstd_names)) != nullptr){
+        this->_zstd_compress_bound = reinterpret_cast<size_t(*)(size_t)>(dlsym(this->_zstd_lib, "ZSTD_compressBound"));
+        this->_zstd_compress = reinterpret_cast<size_t(*)(void*, size_t, const void*, size_t, int)>(
+            dlsym(this->_zstd_lib, "ZSTD_compress")
+        );
+        this->_zstd_decompress = reinterpret_cast<size_t(*)(void*, size_t, const void*, size_t)>(
+            dlsym(this->_zstd_lib, "ZSTD_decompress")
+        );
+        this->_zstd_is_error = reinterpret_cast<unsigned(*)(size_t)>(dlsym(this->_zstd_lib, "ZSTD_isError"));
+        if(unlikely(
+                this->_zstd_compress_bound == nullptr || this->_zstd_compress == nullptr
+            ||  this->_zstd_decompress == nullptr || this->_zstd_is_error == nullptr
+        )){
+            POS_WARN_C("failed to load symbols of zstd, the codec is disabled");
+            dlclose(this->_zstd_lib);
+            this->_zstd_lib = nullptr;
+        }
+    } else {
+        POS_DEBUG_C("zstd isn't installed, the codec is disabled");
+    }
+}
+
+
+POSCheckpointCodec::~POSCheckpointCodec(){
+    if(this->_lz4_lib != nullptr){ dlclose(this->_lz4_lib); }
+    if(this->_zstd_lib != nullptr){ dlclose(this->_zstd_lib); }
+}
+
+
+bool POSCheckpointCodec::is_available(pos_ckpt_codec_t codec){
+    switch(codec){
+    case kPOS_CkptCodec_None:
+        return true;
+    case kPOS_CkptCodec_LZ4:
+        return this->_lz4_lib != nullptr;
+    case kPOS_CkptCodec_Zstd:
+        return this->_zstd_lib != nullptr;
+    default:
+        return false;
+    }
+}
+
+
+uint64_t POSCheckpointCodec::get_bound(pos_ckpt_codec_t codec, uint64_t size){
+    POS_ASSERT(this->is_available(codec));
+    switch(codec){
+    case kPOS_CkptCodec_LZ4:
+        // LZ4 blocks are limited to LZ4_MAX_INPUT_SIZE (~2GB), frames are far smaller
+        POS_ASSERT(size <= static_cast<uint64_t>(std::numeric_limits<int>::max()));
+        return static_cast<uint64_t>(this->_lz4_compress_bound(static_cast<int>(size)));
+    case kPOS_CkptCodec_Zstd:
+        return this->_zstd_compress_bound(size);
+    default:
+        return size;
+    }
+}
+
+
+pos_retval_t POSCheckpointCodec::compress(
+    pos_ckpt_codec_t codec, const void* src, uint64_t src_size, void* dst, uint64_t dst_capacity, uint64_t* dst_size
+){
+    pos_retval_t retval = POS_SUCCESS;
+    int lz4_size;
+    size_t zstd_size;
+
+    POS_CHECK_POINTER(dst_size);
+
+    if(unlikely(!this->is_available(codec))){
+        retval = POS_FAILED_NOT_ENABLED;
+        goto exit;
+    }
+
+    switch(codec){
+    case kPOS_CkptCodec_LZ4:
+        lz4_size = this->_lz4_compress_default(
+            reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst), static_cast<int>(src_size),
+            static_cast<int>(std::min<uint64_t>(dst_capacity, std::numeric_limits<int>::max()))
+        );
+        if(unlikely(lz4_size <= 0)){ retval = POS_FAILED; goto exit; }
+        *dst_size = static_cast<uint64_t>(lz4_size);
+        break;
+
+    case kPOS_CkptCodec_Zstd:
+        zstd_size = this->_zstd_compress(dst, dst_capacity, src, src_size, POSCheckpointCodec::zstd_level);
+        if(unlikely(this->_zstd_is_error(zstd_size))){ retval = POS_FAILED; goto exit; }
+        *dst_size = zstd_size;
+        break;
+
+    default:
+        if(unlikely(dst_capacity < src_size)){ retval = POS_FAILED; goto exit; }
+        memcpy(dst, src, src_size);
+        *dst_size = src_size;
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointCodec::decompress(
+    pos_ckpt_codec_t codec, const void* src, uint64_t src_size, void* dst, uint64_t dst_size
+){
+    pos_retval_t retval = POS_SUCCESS;
+    int lz4_size;
+    size_t zstd_size;
+
+    if(unlikely(!this->is_available(codec))){
+        retval = POS_FAILED_NOT_ENABLED;
+        goto exit;
+    }
+
+    switch(codec){
+    case kPOS_CkptCodec_LZ4:
+        lz4_size = this->_lz4_decompress_safe(
+            reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+            static_cast<int>(src_size), static_cast<int>(dst_size)
+        );
+        if(unlikely(lz4_size < 0 || static_cast<uint64_t>(lz4_size) != dst_size)){ retval = POS_FAILED_INVALID_INPUT; }
+        break;
+
+    case kPOS_CkptCodec_Zstd:
+        zstd_size = this->_zstd_decompress(dst, dst_size, src, src_size);
+        if(unlikely(this->_zstd_is_error(zstd_size) || zstd_size != dst_size)){ retval = POS_FAILED_INVALID_INPUT; }
+        break;
+
+    default:
+        if(unlikely(src_size != dst_size)){ retval = POS_FAILED_INVALID_INPUT; goto exit; }
+        memcpy(dst, src, src_size);
+    }
+
+exit:
+    return retval;
+}
+
+
+const char* POSCheckpointCodec::get_name(pos_ckpt_codec_t codec){
+    switch(codec){
+    case kPOS_CkptCodec_None:
+        return "none";
+    case kPOS_CkptCodec_LZ4:
+        return "lz4";
+    case kPOS_CkptCodec_Zstd:
+        return "zstd";
+    default:
+        return "unknown";
+    }
+}
+
+
+pos_ckpt_codec_t POSCheckpointCodec::parse(const std::string& name){
+    if(name == "none"){ return kPOS_CkptCodec_None; }
+    if(name == "lz4"){ return kPOS_CkptCodec_LZ4; }
+    if(name == "zstd"){ return kPOS_CkptCodec_Zstd; }
+    return kPOS_CkptCodec_Unknown;
+}
@@ -43,6 +43,9 @@ POSCheckpointBag::POSCheckpointBag(
 }
 
 
+POSCheckpointBag::~POSCheckpointBag(){}
+
+
 void POSCheckpointBag::clear(){}
 
 
@@ -101,10 +104,10 @@ template std::set<uint64_t> POSCheckpointBag::get_checkpoint_version_set<kPOS_Ck
 
 
 template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
-uint64_t POSCheckpointBag::get_memory_consumption(){ return 0; }
-template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Device, kPOS_CkptStateType_Device>();
-template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Device>();
-template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host>();
+uint64_t POSCheckpointBag::get_memory_consumption(pos_ckptbag_memory_stat_t *stat){ return 0; }
+template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Device, kPOS_CkptStateType_Device>(pos_ckptbag_memory_stat_t *stat);
+template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Device>(pos_ckptbag_memory_stat_t *stat);
+template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host>(pos_ckptbag_memory_stat_t *stat);
 
 
 template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
@@ -133,3 +136,29 @@ pos_retval_t POSCheckpointBag::load(uint64_t version, void* ckpt_data){
 std::vector<pos_host_ckpt_t> POSCheckpointBag::get_host_checkpoint_records(){
     return std::vector<pos_host_ckpt_t>();
 }
+
+
+void POSCheckpointBag::get_retained_versions(std::vector<pos_ckpt_retained_version_t>& versions){}
+
+
+pos_retval_t POSCheckpointBag::reclaim_version(uint64_t version){
+    return POS_FAILED_NOT_IMPLEMENTED;
+}
+
+
+pos_retval_t POSCheckpointBag::settle_checkpoint_slot(uint64_t version){
+    return POS_FAILED_NOT_IMPLEMENTED;
+}
+
+
+void POSCheckpointBag::get_spill_candidates(std::vector<pos_ckpt_spill_candidate_t>& candidates){}
+
+
+pos_retval_t POSCheckpointBag::spill_version(uint64_t version){
+    return POS_FAILED_NOT_IMPLEMENTED;
+}
+
+
+uint64_t POSCheckpointBag::trim_cached(){
+    return 0;
+}
@@ -77,6 +77,18 @@ POSCheckpointBag::POSCheckpointBag(
         }
     #undef __DEV_CKPT_PREFILL_SIZE
     }
+
+    POSCheckpointRetention::get_instance()->add_target(this);
+    POSCheckpointSpill::get_instance()->add_target(this);
+}
+
+
+POSCheckpointBag::~POSCheckpointBag(){
+    POSCheckpointRetention::get_instance()->remove_target(this);
+    POSCheckpointSpill::get_instance()->remove_target(this);
+
+    // release the accounted host memory
+    this->clear();
 }
 
 
@@ -85,21 +97,24 @@ POSCheckpointBag::POSCheckpointBag(
  */
 void POSCheckpointBag::clear(){
     typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    std::vector<POSCheckpointSlot*> cached_slots;
+    uint64_t i;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     for(map_iter = _dev_state_host_slot_map.begin(); map_iter != _dev_state_host_slot_map.end(); map_iter++){
         if(likely(map_iter->second != nullptr)){
-            delete map_iter->second;
+            this->__delete_dev_state_host_slot(map_iter->second);
         }
     }
 
-    for(map_iter = _cached_dev_state_host_slot_map.begin(); map_iter != _cached_dev_state_host_slot_map.end(); map_iter++){
-        if(likely(map_iter->second != nullptr)){
-            delete map_iter->second;
+    _cached_dev_state_host_slots.drain(cached_slots);
+    for(i=0; i<cached_slots.size(); i++){
+        if(likely(cached_slots[i] != nullptr)){
+            this->__delete_dev_state_host_slot(cached_slots[i]);
         }
     }
 
     _dev_state_host_slot_map.clear();
-    _cached_dev_state_host_slot_map.clear();
     _dev_state_host_slot_version_set.clear();
 }
 
@@ -109,13 +124,14 @@ pos_retval_t POSCheckpointBag::apply_checkpoint_slot(
     uint64_t version, POSCheckpointSlot** ptr, uint64_t dynamic_state_size, bool force_overwrite
 ){
     pos_retval_t retval = POS_SUCCESS;
-    typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
     uint64_t old_version;
-    std::unordered_map<uint64_t, POSCheckpointSlot*> *cached_map, *active_map;
+    std::unordered_map<uint64_t, POSCheckpointSlot*> *active_map;
+    POSSizeClassFreeList<POSCheckpointSlot> *cached_slots;
     std::set<uint64_t> *version_set;
-    uint64_t state_size;
+    uint64_t state_size, capacity;
     pos_custom_ckpt_allocate_func_t allocate_func;
     pos_custom_ckpt_deallocate_func_t deallocate_func;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     // one can't apply a device-side slot to store host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -138,14 +154,14 @@ pos_retval_t POSCheckpointBag::apply_checkpoint_slot(
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Device){
         if constexpr (ckpt_slot_pos == kPOS_CkptSlotPosition_Device){
             // case: apply device-side slot for device-side state
-            cached_map = &this->_cached_dev_state_dev_slot_map;
+            cached_slots = &this->_cached_dev_state_dev_slots;
             active_map = &this->_dev_state_dev_slot_map;
             version_set = &this->_dev_state_dev_slot_version_set;
             allocate_func = this->_dev_allocate_func;
             deallocate_func = this->_dev_deallocate_func;
         } else { // ckpt_slot_pos == kPOS_CkptSlotPosition_Host
             // case: apply host-side slot for device-side state
-            cached_map = &this->_cached_dev_state_host_slot_map;
+            cached_slots = &this->_cached_dev_state_host_slots;
             active_map = &this->_dev_state_host_slot_map;
             version_set = &this->_dev_state_host_slot_version_set;
             allocate_func = this->_allocate_func;
@@ -153,32 +169,58 @@ pos_retval_t POSCheckpointBag::apply_checkpoint_slot(
         }
     } else { // ckpt_state_type == kPOS_CkptStateType_Host
         // case: apply host-side slot for host-side state
-        cached_map = &this->_cached_host_state_host_slot_map;
+        cached_slots = &this->_cached_host_state_host_slots;
         active_map = &this->_host_state_host_slot_map;
         version_set = &this->_host_state_host_slot_version_set;
         allocate_func = nullptr;    // the slot will use malloc
         deallocate_func = nullptr;  // the slot will use free
     }
 
-    if(likely(cached_map->size() > 0)){
-        // TODO:
-        // here we select the oldest one but for device slot for device state we need to 
-        // implement a memory allocation mechanism to choose the one with closest size
-        // i.e., deal with dynamic_state_size > 0 && force_overwrite == true
-        map_iter = cached_map->begin();
-        POS_CHECK_POINTER(*ptr = map_iter->second);
-        cached_map->erase(map_iter);
-    } else {
-        if(force_overwrite == true && active_map->size() > 0){
-            map_iter = active_map->begin();
-            old_version = map_iter->first;
-            POS_CHECK_POINTER(*ptr = map_iter->second);
-            active_map->erase(map_iter);
+    // reuse the best-fit cached slot
+    *ptr = cached_slots->get(state_size, capacity);
+    if(likely(*ptr != nullptr)){
+        (*ptr)->set_state_size(state_size);
+        goto insert;
+    }
+
+    // overwrite the oldest active slot, if it could hold the state and isn't spilled or read by anyone
+    if(force_overwrite == true && version_set->size() > 0){
+        old_version = *(version_set->begin());
+        POS_CHECK_POINTER(*ptr = (*active_map)[old_version]);
+        if(likely(
+            (*ptr)->get_capacity() >= state_size && !(*ptr)->is_spilled() && (*ptr)->nb_pins == 0
+        )){
+            (*ptr)->set_state_size(state_size);
+            active_map->erase(old_version);
             version_set->erase(old_version);
-        } else { 
-            POS_CHECK_POINTER(*ptr = new POSCheckpointSlot(state_size, allocate_func, deallocate_func, ckpt_slot_pos, ckpt_state_type));
+            goto insert;
         }
     }
+
+    /*!
+     *  \note   for state with dynamic size, we round the allocation up to its size class,
+     *          so that the slot is more likely to be reused by later checkpoints in different sizes
+     */
+    capacity = dynamic_state_size > 0
+                ? POSSizeClass::round_up(state_size)
+                : state_size;
+    POS_CHECK_POINTER(*ptr = new POSCheckpointSlot(
+        state_size, allocate_func, deallocate_func, ckpt_slot_pos, ckpt_state_type, capacity
+    ));
+    if(unlikely((*ptr)->expose_pointer() == nullptr)){
+        POS_WARN_C("failed to allocate memory for new checkpoint slot: state_size(%lu)", state_size);
+        delete (*ptr);
+        *ptr = nullptr;
+        retval = POS_FAILED_OOM;
+        goto exit;
+    }
+    if constexpr (ckpt_slot_pos == kPOS_CkptSlotPosition_Host && ckpt_state_type == kPOS_CkptStateType_Device){
+        POSCheckpointSpill::get_instance()->on_allocated((*ptr)->get_capacity());
+    }
+
+insert:
+    (*ptr)->tick = POSUtilTscTimer::get_tsc();
+    (*ptr)->is_committing = true;
     active_map->insert(std::pair<uint64_t, POSCheckpointSlot*>(version, *ptr));
     version_set->insert(version);
 
@@ -201,6 +243,7 @@ pos_retval_t POSCheckpointBag::get_checkpoint_slot(POSCheckpointSlot** ckpt_slot
     pos_retval_t retval = POS_SUCCESS;
     std::unordered_map<uint64_t, POSCheckpointSlot*> *active_map;
     std::set<uint64_t> *version_set;
+    std::unique_lock<std::mutex> lock(this->_mutex);
 
     // one can't obtain a device-side slot that stores host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -236,6 +279,17 @@ pos_retval_t POSCheckpointBag::get_checkpoint_slot(POSCheckpointSlot** ckpt_slot
     } else {
         *ckpt_slot = nullptr;
         retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+
+    // the slot might be spilled under the budget of host checkpoint memory, it's pinned while being
+    // loaded outside the lock
+    if(unlikely((*ckpt_slot)->is_spilled())){
+        (*ckpt_slot)->nb_pins += 1;
+        lock.unlock();
+        retval = this->__load_spilled(*ckpt_slot);
+        (*ckpt_slot)->nb_pins -= 1;
+        if(unlikely(retval != POS_SUCCESS)){ *ckpt_slot = nullptr; }
     }
 
 exit:
@@ -257,6 +311,8 @@ pos_retval_t POSCheckpointBag::get_all_scheckpoint_slots(std::vector<POSCheckpoi
     pos_retval_t retval = POS_SUCCESS;
     std::unordered_map<uint64_t, POSCheckpointSlot*> *active_map;
     typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    std::vector<POSCheckpointSlot*> spilled_slots;
+    std::unique_lock<std::mutex> lock(this->_mutex);
 
     // one can't obtain device-side slots that stores host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -283,7 +339,23 @@ pos_retval_t POSCheckpointBag::get_all_scheckpoint_slots(std::vector<POSCheckpoi
     ckpt_slots.clear();
     for(map_iter = active_map->begin(); map_iter != active_map->end(); map_iter++){
         ckpt_slots.push_back(map_iter->second);
+
+        // the slot might be spilled under the budget of host checkpoint memory, spilled slots are pinned
+        // and loaded outside the lock
+        if(unlikely(map_iter->second->is_spilled())){
+            map_iter->second->nb_pins += 1;
+            spilled_slots.push_back(map_iter->second);
+        }
     }
+    lock.unlock();
+
+    for(POSCheckpointSlot *spilled_slot : spilled_slots){
+        if(retval == POS_SUCCESS && unlikely(POS_SUCCESS != this->__load_spilled(spilled_slot))){
+            retval = POS_FAILED;
+        }
+        spilled_slot->nb_pins -= 1;
+    }
+    if(unlikely(retval != POS_SUCCESS)){ ckpt_slots.clear(); }
 
 exit:
     return retval;
@@ -302,6 +374,7 @@ template pos_retval_t POSCheckpointBag::get_all_scheckpoint_slots<kPOS_CkptSlotP
 template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
 uint64_t POSCheckpointBag::get_nb_checkpoint_slots(){
     std::unordered_map<uint64_t, POSCheckpointSlot*> *active_map;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     // one can't obtain number of device-side slots that stores host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -335,6 +408,7 @@ template uint64_t POSCheckpointBag::get_nb_checkpoint_slots<kPOS_CkptSlotPositio
 template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
 std::set<uint64_t> POSCheckpointBag::get_checkpoint_version_set(){
     std::set<uint64_t> *version_set;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     // one can't obtain the version set of device-side slots that stores host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -366,10 +440,12 @@ template std::set<uint64_t> POSCheckpointBag::get_checkpoint_version_set<kPOS_Ck
 
 
 template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
-uint64_t POSCheckpointBag::get_memory_consumption(){
+uint64_t POSCheckpointBag::get_memory_consumption(pos_ckptbag_memory_stat_t *stat){
     std::unordered_map<uint64_t, POSCheckpointSlot*> *active_map;
+    POSSizeClassFreeList<POSCheckpointSlot> *cached_slots;
     typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
-    uint64_t size = 0;
+    pos_ckptbag_memory_stat_t tmp_stat;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     // one can't obtain the size of device-side slots that stores host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -384,33 +460,49 @@ uint64_t POSCheckpointBag::get_memory_consumption(){
         if constexpr (ckpt_slot_pos == kPOS_CkptSlotPosition_Device){
             // case: get size of device-side slots for device-side state
             active_map = &this->_dev_state_dev_slot_map;
+            cached_slots = &this->_cached_dev_state_dev_slots;
         } else { // ckpt_slot_pos == kPOS_CkptSlotPosition_Host
             // case: get size of host-side slots for device-side state
             active_map = &this->_dev_state_host_slot_map;
+            cached_slots = &this->_cached_dev_state_host_slots;
         }
     } else { // ckpt_state_type == kPOS_CkptStateType_Host
         // case: get size of host-side slots for host-side state
         active_map = &this->_host_state_host_slot_map;
+        cached_slots = &this->_cached_host_state_host_slots;
     }
 
     for(map_iter = active_map->begin(); map_iter != active_map->end(); map_iter++){
         POS_CHECK_POINTER(map_iter->second);
-        size += map_iter->second->get_state_size();
+        if(unlikely(map_iter->second->is_spilled())){
+            tmp_stat.spilled_size += map_iter->second->get_state_size();
+            continue;
+        }
+        tmp_stat.state_size += map_iter->second->get_state_size();
+        tmp_stat.active_capacity += map_iter->second->get_capacity();
     }
+    tmp_stat.cached_capacity = cached_slots->get_cached_size();
+    tmp_stat.nb_reuse_hit = cached_slots->get_nb_hit();
+    tmp_stat.nb_reuse_miss = cached_slots->get_nb_miss();
+
+    if(stat != nullptr){ *stat = tmp_stat; }
 
-    return size;
+    return tmp_stat.active_capacity + tmp_stat.cached_capacity;
 }
-template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Device, kPOS_CkptStateType_Device>();
-template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Device>();
-template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host>();
+template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Device, kPOS_CkptStateType_Device>(pos_ckptbag_memory_stat_t *stat);
+template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Device>(pos_ckptbag_memory_stat_t *stat);
+template uint64_t POSCheckpointBag::get_memory_consumption<kPOS_CkptSlotPosition_Host, kPOS_CkptStateType_Host>(pos_ckptbag_memory_stat_t *stat);
 
 
 template<pos_ckptslot_position_t ckpt_slot_pos, pos_ckpt_state_type_t ckpt_state_type>
 pos_retval_t POSCheckpointBag::invalidate_by_version(uint64_t version) {
     pos_retval_t retval = POS_SUCCESS;
     POSCheckpointSlot *ckpt_slot;
-    std::unordered_map<uint64_t, POSCheckpointSlot*> *cached_map, *active_map;
+    std::unordered_map<uint64_t, POSCheckpointSlot*> *active_map;
+    POSSizeClassFreeList<POSCheckpointSlot> *cached_slots;
     std::set<uint64_t> *version_set;
+    typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     // one can't invalidate a device-side slot that stores host state
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Host){
@@ -424,32 +516,42 @@ pos_retval_t POSCheckpointBag::invalidate_by_version(uint64_t version) {
     if constexpr (ckpt_state_type == kPOS_CkptStateType_Device){
         if constexpr (ckpt_slot_pos == kPOS_CkptSlotPosition_Device){
             // case: invalidate device-side slot for device-side state
-            cached_map = &this->_cached_dev_state_dev_slot_map;
+            cached_slots = &this->_cached_dev_state_dev_slots;
             active_map = &this->_dev_state_dev_slot_map;
             version_set = &this->_dev_state_dev_slot_version_set;
         } else { // ckpt_slot_pos == kPOS_CkptSlotPosition_Host
             // case: invalidate host-side slot for device-side state
-            cached_map = &this->_cached_dev_state_host_slot_map;
+            cached_slots = &this->_cached_dev_state_host_slots;
             active_map = &this->_dev_state_host_slot_map;
             version_set = &this->_dev_state_host_slot_version_set;
         }
     } else { // ckpt_state_type == kPOS_CkptStateType_Host
         // case: invalidate host-side slot for host-side state
-        cached_map = &this->_cached_host_state_host_slot_map;
+        cached_slots = &this->_cached_host_state_host_slots;
         active_map = &this->_host_state_host_slot_map;
         version_set = &this->_host_state_host_slot_version_set;
     }
 
     // check whether checkpoint exit
-    retval = get_checkpoint_slot<ckpt_slot_pos, ckpt_state_type>(&ckpt_slot, version);
-    if(POS_SUCCESS != retval){
+    if(unlikely(version_set->size() == 0)){
+        retval = POS_FAILED_NOT_READY;
         goto exit;
     }
-    POS_CHECK_POINTER(ckpt_slot);
+    if(unlikely((map_iter = active_map->find(version)) == active_map->end())){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+    POS_CHECK_POINTER(ckpt_slot = map_iter->second);
 
     active_map->erase(version);
     version_set->erase(version);
-    cached_map->insert(std::pair<uint64_t,POSCheckpointSlot*>(version, ckpt_slot));
+
+    // a spilled slot owns no memory to be reused
+    if(unlikely(ckpt_slot->is_spilled())){
+        this->__delete_dev_state_host_slot(ckpt_slot);
+    } else {
+        cached_slots->put(ckpt_slot, ckpt_slot->get_capacity());
+    }
 
 exit:
     return retval;
@@ -468,6 +570,11 @@ pos_retval_t POSCheckpointBag::invalidate_all_version(){
     version_set = this->get_checkpoint_version_set<ckpt_slot_pos, ckpt_state_type>();
     for(version_set_iter = version_set.begin(); version_set_iter != version_set.end(); version_set_iter++){
         retval = this->invalidate_by_version<ckpt_slot_pos, ckpt_state_type>(*version_set_iter);
+        // the version might be reclaimed by the retention engine in the meantime
+        if(unlikely(retval == POS_FAILED_NOT_EXIST || retval == POS_FAILED_NOT_READY)){
+            retval = POS_SUCCESS;
+            continue;
+        }
         if(unlikely(retval != POS_SUCCESS)){
             goto exit;
         }
@@ -497,6 +604,7 @@ pos_retval_t POSCheckpointBag::load(uint64_t version, void* ckpt_data){
     POS_CHECK_POINTER(ckpt_slot);
 
     memcpy(ckpt_slot->expose_pointer(), ckpt_data, this->_fixed_state_size);
+    this->settle_checkpoint_slot(version);
 
 exit:
     return retval;
@@ -506,6 +614,7 @@ exit:
 std::vector<pos_host_ckpt_t> POSCheckpointBag::get_host_checkpoint_records(){
     std::vector<pos_host_ckpt_t> ret_list;
     typename std::unordered_map<uint64_t, pos_host_ckpt_t>::iterator map_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
 
     for(map_iter=this->_host_ckpt_map.begin(); map_iter!=this->_host_ckpt_map.end(); map_iter++){
         POS_CHECK_POINTER(map_iter->second.wqe)
@@ -516,3 +625,184 @@ std::vector<pos_host_ckpt_t> POSCheckpointBag::get_host_checkpoint_records(){
 
     return ret_list;
 }
+
+
+void POSCheckpointBag::get_retained_versions(std::vector<pos_ckpt_retained_version_t>& versions){
+    pos_ckpt_retained_version_t retained_version;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    for(auto &pair : this->_dev_state_host_slot_map){
+        POS_CHECK_POINTER(pair.second);
+        retained_version.target = this;
+        retained_version.version = pair.first;
+        retained_version.size = pair.second->is_spilled() ? 0 : pair.second->get_capacity();
+        retained_version.tick = pair.second->tick;
+        versions.push_back(retained_version);
+    }
+}
+
+
+pos_retval_t POSCheckpointBag::reclaim_version(uint64_t version){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointSlot *ckpt_slot;
+    typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely((map_iter = this->_dev_state_host_slot_map.find(version)) == this->_dev_state_host_slot_map.end())){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+    POS_CHECK_POINTER(ckpt_slot = map_iter->second);
+
+    // the slot is still being committed or persisted, it's reclaimed by a later sweep
+    if(unlikely(ckpt_slot->is_committing || ckpt_slot->nb_pins > 0)){
+        retval = POS_FAILED_NOT_READY;
+        goto exit;
+    }
+
+    this->_dev_state_host_slot_map.erase(map_iter);
+    this->_dev_state_host_slot_version_set.erase(version);
+    if(unlikely(ckpt_slot->is_spilled())){
+        this->__delete_dev_state_host_slot(ckpt_slot);
+    } else {
+        this->_cached_dev_state_host_slots.put(ckpt_slot, ckpt_slot->get_capacity());
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointBag::settle_checkpoint_slot(uint64_t version){
+    pos_retval_t retval = POS_SUCCESS;
+    typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely((map_iter = this->_dev_state_host_slot_map.find(version)) == this->_dev_state_host_slot_map.end())){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+    POS_CHECK_POINTER(map_iter->second);
+    map_iter->second->is_committing = false;
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointBag::get_spill_candidates(std::vector<pos_ckpt_spill_candidate_t>& candidates){
+    pos_ckpt_spill_candidate_t candidate;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    for(auto &pair : this->_dev_state_host_slot_map){
+        POS_CHECK_POINTER(pair.second);
+        if(pair.second->is_spilled() || pair.second->is_committing || pair.second->nb_pins > 0){ continue; }
+        candidate.target = this;
+        candidate.version = pair.first;
+        candidate.size = pair.second->get_capacity();
+        candidate.tick = pair.second->tick;
+        candidates.push_back(candidate);
+    }
+}
+
+
+pos_retval_t POSCheckpointBag::spill_version(uint64_t version){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointSlot *ckpt_slot;
+    uint64_t spill_offset;
+    typename std::unordered_map<uint64_t, POSCheckpointSlot*>::iterator map_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely((map_iter = this->_dev_state_host_slot_map.find(version)) == this->_dev_state_host_slot_map.end())){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+    POS_CHECK_POINTER(ckpt_slot = map_iter->second);
+
+    // the slot might be accessed since it was collected as a candidate
+    if(unlikely(ckpt_slot->is_spilled() || ckpt_slot->is_committing || ckpt_slot->nb_pins > 0)){
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+
+    retval = POSCheckpointSpill::get_instance()->spill_out(
+        ckpt_slot->expose_pointer(), ckpt_slot->get_state_size(), &spill_offset
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to spill checkpoint slot: version(%lu), retval(%u)", version, retval);
+        goto exit;
+    }
+    ckpt_slot->release_memory(spill_offset);
+    POSCheckpointSpill::get_instance()->on_released(ckpt_slot->get_capacity());
+
+exit:
+    return retval;
+}
+
+
+uint64_t POSCheckpointBag::trim_cached(){
+    std::vector<POSCheckpointSlot*> cached_slots;
+    uint64_t i, released = 0;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    this->_cached_dev_state_host_slots.drain(cached_slots);
+    for(i=0; i<cached_slots.size(); i++){
+        POS_CHECK_POINTER(cached_slots[i]);
+        released += cached_slots[i]->get_capacity();
+        this->__delete_dev_state_host_slot(cached_slots[i]);
+    }
+
+    return released;
+}
+
+
+pos_retval_t POSCheckpointBag::__load_spilled(POSCheckpointSlot* ckpt_slot){
+    pos_retval_t retval = POS_SUCCESS;
+    std::lock_guard<std::mutex> load_lock(this->_load_mutex);
+
+    POS_CHECK_POINTER(ckpt_slot);
+    POS_ASSERT(ckpt_slot->nb_pins > 0);
+
+    // the slot might be loaded by another caller while waiting for the load lock
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(!ckpt_slot->is_spilled()){ goto exit; }
+    }
+
+    if(unlikely(POS_SUCCESS != (retval = ckpt_slot->reacquire_memory()))){
+        POS_WARN_C("failed to allocate memory to load spilled checkpoint slot: capacity(%lu)", ckpt_slot->get_capacity());
+        goto exit;
+    }
+    POSCheckpointSpill::get_instance()->on_allocated(ckpt_slot->get_capacity());
+
+    retval = POSCheckpointSpill::get_instance()->spill_in(
+        ckpt_slot->get_spill_offset(), ckpt_slot->expose_pointer(), ckpt_slot->get_state_size()
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        // keep the slot spilled along with its spill extent, so that it's never handed out with the memory
+        POS_WARN_C("failed to load spilled checkpoint slot: retval(%u)", retval);
+        ckpt_slot->release_reacquired_memory();
+        POSCheckpointSpill::get_instance()->on_released(ckpt_slot->get_capacity());
+        goto exit;
+    }
+
+    // spill_in has discarded the spill extent on success
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        ckpt_slot->mark_loaded();
+    }
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointBag::__delete_dev_state_host_slot(POSCheckpointSlot* ckpt_slot){
+    POS_CHECK_POINTER(ckpt_slot);
+    if(unlikely(ckpt_slot->is_spilled())){
+        POSCheckpointSpill::get_instance()->spill_discard(ckpt_slot->get_spill_offset(), ckpt_slot->get_state_size());
+    } else {
+        POSCheckpointSpill::get_instance()->on_released(ckpt_slot->get_capacity());
+    }
+    delete ckpt_slot;
+}
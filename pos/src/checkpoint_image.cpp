@@ -0,0 +1,1483 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_codec.h"
+#include "pos/include/persist_executor.h"
+#include "pos/include/utils/crc32c.h"
+
+
+// magic number of the checkpoint image: "POSCKIMG"
+static constexpr uint64_t kPOS_CkptImageMagic = 0x474D494B43534F50ul;
+
+// format version of the checkpoint image
+static constexpr uint32_t kPOS_CkptImageFormatVersion = 3;
+
+// zeros to pad between the metadata and the raw section of a record
+static const uint8_t __ckpt_image_zero_padding[POSCheckpointImageWriter::kSectionAlignment] = { 0 };
+
+// raw sections start at positions that are valid for direct I/O
+static_assert(POSCheckpointImageWriter::kSectionAlignment % POSCheckpointIOBackend::kDirectIOAlignment == 0);
+
+
+/*!
+ *  \brief  write the whole buffer to the given position of the file through the I/O backend
+ *  \param  io      the I/O backend
+ *  \param  fd      file descriptor
+ *  \param  data    pointer to the buffer
+ *  \param  size    size of the buffer
+ *  \param  offset  position within the file
+ *  \return POS_SUCCESS for successfully written
+ */
+static pos_retval_t __write_all(POSCheckpointIOBackend* io, int fd, const void* data, uint64_t size, uint64_t offset){
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return io->writev(fd, &iov, 1, offset);
+}
+
+
+/* ========================== writer ========================== */
+// registered writers: checkpoint directory -> writer
+static std::map<std::string, POSCheckpointImageWriter*> __ckpt_image_writers;
+static std::mutex __ckpt_image_writers_mutex;
+
+
+POSCheckpointImageWriter* POSCheckpointImageWriter::open(const std::string& ckpt_dir){
+    POSCheckpointImageWriter *writer = nullptr;
+    std::shared_ptr<POSCheckpointStorage> storage;
+    std::lock_guard<std::mutex> lock(__ckpt_image_writers_mutex);
+
+    if(likely(__ckpt_image_writers.count(ckpt_dir) > 0)){
+        writer = __ckpt_image_writers[ckpt_dir];
+        goto exit;
+    }
+
+    if(unlikely(POS_SUCCESS != POSCheckpointStorage::open(ckpt_dir, storage))){
+        POS_WARN("failed to create checkpoint image, invalid storage: ckpt_dir(%s)", ckpt_dir.c_str());
+        goto exit;
+    }
+
+    POS_CHECK_POINTER(writer = new POSCheckpointImageWriter());
+    if(unlikely(POS_SUCCESS != writer->__create(storage))){
+        POS_WARN("failed to create checkpoint image: ckpt_dir(%s)", ckpt_dir.c_str());
+        delete writer;
+        writer = nullptr;
+        goto exit;
+    }
+    __ckpt_image_writers[ckpt_dir] = writer;
+
+exit:
+    return writer;
+}
+
+
+pos_retval_t POSCheckpointImageWriter::seal(const std::string& ckpt_dir){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointImageWriter *writer;
+
+    {
+        std::lock_guard<std::mutex> lock(__ckpt_image_writers_mutex);
+        if(unlikely(__ckpt_image_writers.count(ckpt_dir) == 0)){
+            retval = POS_FAILED_NOT_EXIST;
+            goto exit;
+        }
+        writer = __ckpt_image_writers[ckpt_dir];
+        __ckpt_image_writers.erase(ckpt_dir);
+    }
+    POS_CHECK_POINTER(writer);
+
+    // wait until all announced appends are finished
+    {
+        std::unique_lock<std::mutex> lock(writer->_mutex);
+        writer->_pending_cv.wait(lock, [writer]{ return writer->_nb_pending == 0; });
+    }
+
+    if(unlikely(POS_SUCCESS != (retval = writer->__write_index()))){
+        POS_WARN("failed to write index of checkpoint image: path(%s)", writer->_path.c_str());
+    }
+    delete writer;
+
+exit:
+    return retval;
+}
+
+
+POSCheckpointImageWriter::~POSCheckpointImageWriter(){
+    if(this->_fd >= 0){ close(this->_fd); }
+    if(this->_direct_fd >= 0){ close(this->_direct_fd); }
+}
+
+
+pos_retval_t POSCheckpointImageWriter::__create(std::shared_ptr<POSCheckpointStorage> storage){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_image_header_t header;
+    std::string path;
+
+    POS_CHECK_POINTER(this->_storage = storage);
+    path = storage->get_local_path(POS_CKPT_IMAGE_FILE_NAME);
+    this->_path = path.size() > 0 ? path : storage->get_uri() + std::string("/") + POS_CKPT_IMAGE_FILE_NAME;
+    this->_open_timer.start();
+    this->_chunk_size = POSCheckpointImageWriter::dedup_chunk_size;
+    this->_frame_size = POSCheckpointImageWriter::compress_frame_size;
+    for(auto &pair : POSCheckpointImageWriter::compress_codecs){
+        if(pair.second == kPOS_CkptCodec_None){ continue; }
+        if(unlikely(!POSCheckpointCodec::get_instance()->is_available(pair.second))){
+            POS_WARN_C(
+                "codec is unavailable, raw sections are stored uncompressed: rid(%u), codec(%s)",
+                pair.first, POSCheckpointCodec::get_name(pair.second)
+            );
+            continue;
+        }
+        this->_codecs[pair.first] = pair.second;
+    }
+    POS_CHECK_POINTER(this->_io = POSCheckpointIOBackend::get_instance());
+
+    // non-local storages: write in-place into the object if possible, otherwise stage the image in memory
+    if(path.size() == 0){
+        if((this->_fd = storage->open_fd(POS_CKPT_IMAGE_FILE_NAME, /* is_write */ true)) < 0){
+            this->_fd = memfd_create(POS_CKPT_IMAGE_FILE_NAME, MFD_CLOEXEC);
+            this->_is_staged = true;
+        }
+        if(unlikely(this->_fd < 0)){
+            POS_WARN_C("failed to create checkpoint image: path(%s), errno(%d)", this->_path.c_str(), errno);
+            retval = POS_FAILED;
+            goto exit;
+        }
+        goto write_header;
+    }
+
+    this->_fd = this->_io->open(path, O_CREAT | O_TRUNC | O_WRONLY);
+    if(unlikely(this->_fd < 0)){
+        POS_WARN_C("failed to open checkpoint image: path(%s), errno(%d)", path.c_str(), errno);
+        retval = POS_FAILED;
+        goto exit;
+    }
+    if(this->_io->get_options().use_direct_io){
+        this->_direct_fd = this->_io->open(path, O_WRONLY, /* is_direct */ true);
+        if(unlikely(this->_direct_fd < 0)){
+            POS_WARN_C("failed to open checkpoint image with direct I/O, fallback to buffered I/O: path(%s)", path.c_str());
+        }
+    }
+
+write_header:
+    memset(&header, 0, sizeof(pos_ckpt_image_header_t));
+    header.magic = kPOS_CkptImageMagic;
+    header.format_version = kPOS_CkptImageFormatVersion;
+    if(unlikely(POS_SUCCESS != (retval = __write_all(this->_io, this->_fd, &header, sizeof(header), 0)))){
+        POS_WARN_C("failed to write header of checkpoint image: path(%s), errno(%d)", this->_path.c_str(), errno);
+        goto exit;
+    }
+    this->_offset = sizeof(pos_ckpt_image_header_t);
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointImageWriter::prepare_append(){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_nb_pending += 1;
+}
+
+
+void POSCheckpointImageWriter::cancel_append(){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    POS_ASSERT(this->_nb_pending > 0);
+    this->_nb_pending -= 1;
+    if(this->_nb_pending == 0){ this->_pending_cv.notify_all(); }
+}
+
+
+pos_retval_t POSCheckpointImageWriter::append(
+    pos_ckpt_image_record_type_t type,
+    pos_resource_typeid_t resource_type_id,
+    pos_u64id_t id,
+    uint64_t version,
+    const void* data,
+    uint64_t size,
+    bool is_prepared
+){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_image_entry_t entry;
+    POSUtilHpetTimer checksum_timer;
+    uint64_t checksum_ns;
+
+    POS_ASSERT(size == 0 || data != nullptr);
+
+    memset(&entry, 0, sizeof(pos_ckpt_image_entry_t));
+    entry.type = type;
+    entry.resource_type_id = resource_type_id;
+    entry.id = id;
+    entry.version = version;
+    entry.size = size;
+
+    checksum_timer.start();
+    entry.checksum = POSUtilCrc32c::calculate(data, size);
+    checksum_ns = checksum_timer.stop_get_ns();
+
+    // reserve a range of the file
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        entry.offset = (this->_offset + kRecordAlignment - 1) / kRecordAlignment * kRecordAlignment;
+        this->_offset = entry.offset + size;
+    }
+
+    // write outside the lock, so that concurrent appenders could write in parallel
+    if(unlikely(POS_SUCCESS != (retval = __write_all(this->_io, this->_fd, data, size, entry.offset)))){
+        POS_WARN_C(
+            "failed to append record to checkpoint image: path(%s), type(%u), rid(%u), id(%lu), errno(%d)",
+            this->_path.c_str(), type, resource_type_id, id, errno
+        );
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(likely(retval == POS_SUCCESS)){ this->_entries.push_back(entry); }
+        this->_checksum_stat.nb_bytes += size;
+        this->_checksum_stat.checksum_ns += checksum_ns;
+        if(is_prepared){
+            POS_ASSERT(this->_nb_pending > 0);
+            this->_nb_pending -= 1;
+            if(this->_nb_pending == 0){ this->_pending_cv.notify_all(); }
+        }
+    }
+
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImageWriter::append_section(
+    pos_ckpt_image_record_type_t type,
+    pos_resource_typeid_t resource_type_id,
+    pos_u64id_t id,
+    uint64_t version,
+    const void* meta,
+    uint64_t meta_size,
+    const void* section,
+    uint64_t section_size,
+    bool is_prepared
+){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_image_entry_t entry;
+    pos_ckpt_image_section_header_t header;
+    uint64_t section_pos, padding_size, direct_size = 0, compressed_size, checksum_ns = 0;
+    uint32_t checksum;
+    POSUtilHpetTimer checksum_timer;
+    struct iovec iov[4];
+    std::vector<uint8_t> chunked;
+    typename std::map<pos_resource_typeid_t, pos_ckpt_codec_t>::iterator codec_iter;
+
+    // staging buffer of compressed raw sections, kept by each persisting thread to avoid faulting in
+    // fresh pages on every append, up to kCompressStagingKeepSize
+    static thread_local std::vector<uint8_t> compressed;
+
+    POS_ASSERT(meta_size == 0 || meta != nullptr);
+    POS_ASSERT(section_size == 0 || section != nullptr);
+
+    memset(&entry, 0, sizeof(pos_ckpt_image_entry_t));
+    entry.type = type;
+    entry.resource_type_id = resource_type_id;
+    entry.id = id;
+    entry.version = version;
+    entry.flags = kPOS_CkptImageEntryFlag_RawSection;
+
+    // store the raw section as compressed frames
+    codec_iter = this->_codecs.find(resource_type_id);
+    if(codec_iter != this->_codecs.end() && section_size > 0){
+        retval = this->__compress_frames(codec_iter->second, section, section_size, compressed, &compressed_size);
+        if(unlikely(POS_SUCCESS != retval)){
+            POS_WARN_C(
+                "failed to append record to checkpoint image, failed to compress: path(%s), type(%u), rid(%u), id(%lu)",
+                this->_path.c_str(), type, resource_type_id, id
+            );
+            goto exit;
+        }
+        entry.flags |= kPOS_CkptImageEntryFlag_Compressed;
+        section = compressed.data();
+        section_size = compressed_size;
+    }
+    // store the raw section as content-addressed chunks, the record only keeps the references
+    else if(this->_chunk_size > 0 && section_size > 0){
+        if(unlikely(POS_SUCCESS != (retval = this->__write_chunks(section, section_size, chunked)))){
+            POS_WARN_C(
+                "failed to append record to checkpoint image, failed to write chunks: path(%s), type(%u), rid(%u), id(%lu)",
+                this->_path.c_str(), type, resource_type_id, id
+            );
+            goto exit;
+        }
+        entry.flags |= kPOS_CkptImageEntryFlag_Chunked;
+        section = chunked.data();
+        section_size = chunked.size();
+    }
+
+    // reserve a range of the file, the raw section starts at an aligned position
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        entry.offset = (this->_offset + kRecordAlignment - 1) / kRecordAlignment * kRecordAlignment;
+        section_pos = entry.offset + sizeof(pos_ckpt_image_section_header_t) + meta_size;
+        section_pos = (section_pos + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+        this->_offset = section_pos + section_size;
+    }
+    entry.size = section_pos + section_size - entry.offset;
+    padding_size = section_pos - entry.offset - sizeof(pos_ckpt_image_section_header_t) - meta_size;
+    POS_ASSERT(padding_size < kSectionAlignment);
+
+    header.meta_size = meta_size;
+    header.section_offset = section_pos - entry.offset;
+    header.section_size = section_size;
+
+    checksum_timer.start();
+    checksum = POSUtilCrc32c::calculate(&header, sizeof(pos_ckpt_image_section_header_t));
+    checksum = POSUtilCrc32c::calculate(meta, meta_size, checksum);
+    checksum = POSUtilCrc32c::calculate(__ckpt_image_zero_padding, padding_size, checksum);
+    entry.checksum = POSUtilCrc32c::calculate(section, section_size, checksum);
+    checksum_ns = checksum_timer.stop_get_ns();
+
+    /*!
+     *  \note   the aligned part of the raw section is written with direct I/O if possible,
+     *          while the rest of the record goes through page cache
+     */
+    if(     this->_direct_fd >= 0
+        &&  reinterpret_cast<uint64_t>(section) % POSCheckpointIOBackend::kDirectIOAlignment == 0
+    ){
+        direct_size = section_size / POSCheckpointIOBackend::kDirectIOAlignment * POSCheckpointIOBackend::kDirectIOAlignment;
+    }
+
+    // write outside the lock, the raw section is written from the caller's buffer directly
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(pos_ckpt_image_section_header_t);
+    iov[1].iov_base = const_cast<void*>(meta);
+    iov[1].iov_len = meta_size;
+    iov[2].iov_base = const_cast<uint8_t*>(__ckpt_image_zero_padding);
+    iov[2].iov_len = padding_size;
+    iov[3].iov_base = const_cast<void*>(section);
+    iov[3].iov_len = section_size;
+    if(direct_size == 0){
+        retval = this->_io->writev(this->_fd, iov, 4, entry.offset);
+    } else {
+        retval = this->_io->writev(this->_fd, iov, 3, entry.offset);
+        if(likely(retval == POS_SUCCESS)){
+            retval = __write_all(this->_io, this->_direct_fd, section, direct_size, section_pos);
+        }
+        if(likely(retval == POS_SUCCESS && direct_size < section_size)){
+            retval = __write_all(
+                this->_io, this->_fd, reinterpret_cast<const uint8_t*>(section) + direct_size,
+                section_size - direct_size, section_pos + direct_size
+            );
+        }
+    }
+    if(unlikely(POS_SUCCESS != retval)){
+        POS_WARN_C(
+            "failed to append record to checkpoint image: path(%s), type(%u), rid(%u), id(%lu), errno(%d)",
+            this->_path.c_str(), type, resource_type_id, id, errno
+        );
+    }
+
+exit:
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(likely(retval == POS_SUCCESS)){ this->_entries.push_back(entry); }
+        this->_checksum_stat.nb_bytes += entry.size;
+        this->_checksum_stat.checksum_ns += checksum_ns;
+        if(is_prepared){
+            POS_ASSERT(this->_nb_pending > 0);
+            this->_nb_pending -= 1;
+            if(this->_nb_pending == 0){ this->_pending_cv.notify_all(); }
+        }
+    }
+
+    // don't let a single large section pin its staging buffer on the persisting thread
+    if(unlikely(compressed.capacity() > kCompressStagingKeepSize)){
+        std::vector<uint8_t>().swap(compressed);
+    }
+
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImageWriter::__write_chunks(
+    const void* section, uint64_t section_size, std::vector<uint8_t>& chunked
+){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_image_chunked_header_t header;
+    pos_ckpt_image_chunk_t chunk;
+    pos_chunk_hash_t hash, *hashes;
+    const uint8_t *data;
+    uint64_t i, size, direct_size, nb_zero_chunks = 0, checksum_ns;
+    uint32_t checksum;
+    POSUtilHpetTimer checksum_timer;
+    bool is_new;
+
+    POS_ASSERT(this->_chunk_size > 0);
+
+    header.chunk_size = this->_chunk_size;
+    header.section_size = section_size;
+    header.nb_chunks = (section_size + this->_chunk_size - 1) / this->_chunk_size;
+    chunked.resize(sizeof(pos_ckpt_image_chunked_header_t) + header.nb_chunks * sizeof(pos_chunk_hash_t));
+    memcpy(chunked.data(), &header, sizeof(pos_ckpt_image_chunked_header_t));
+    hashes = reinterpret_cast<pos_chunk_hash_t*>(chunked.data() + sizeof(pos_ckpt_image_chunked_header_t));
+
+    for(i=0; i<header.nb_chunks; i++){
+        data = reinterpret_cast<const uint8_t*>(section) + i * this->_chunk_size;
+        size = std::min<uint64_t>(this->_chunk_size, section_size - i * this->_chunk_size);
+
+        // all-zero chunks are referred by the all-zero hash, and never stored
+        if(POSUtilChunkHash::is_zero(data, size)){
+            memset(&(hashes[i]), 0, sizeof(pos_chunk_hash_t));
+            nb_zero_chunks += 1;
+            continue;
+        }
+        hash = POSUtilChunkHash::calculate(data, size);
+        memcpy(&(hashes[i]), &hash, sizeof(pos_chunk_hash_t));
+
+        // reserve the range of a new chunk, so that concurrent appenders won't store it again
+        is_new = false;
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if(this->_chunks.count(hash) == 0){
+                memset(&chunk, 0, sizeof(pos_ckpt_image_chunk_t));
+                chunk.hash = hash;
+                chunk.size = size;
+                chunk.offset = this->__reserve_aligned(size);
+                this->_chunks[hash] = chunk;
+                this->_dedup_stat.nb_unique_chunks += 1;
+                this->_dedup_stat.nb_stored_bytes += size;
+                is_new = true;
+            }
+        }
+        if(!is_new){ continue; }
+
+        // the chunk is checksummed on its own, as the record only covers the hash
+        checksum_timer.start();
+        checksum = POSUtilCrc32c::calculate(data, size);
+        checksum_ns = checksum_timer.stop_get_ns();
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_chunks[hash].checksum = checksum;
+            this->_checksum_stat.nb_bytes += size;
+            this->_checksum_stat.checksum_ns += checksum_ns;
+        }
+
+        // write outside the lock, the aligned part goes through direct I/O if possible
+        direct_size = 0;
+        if(this->_direct_fd >= 0 && reinterpret_cast<uint64_t>(data) % POSCheckpointIOBackend::kDirectIOAlignment == 0){
+            direct_size = size / POSCheckpointIOBackend::kDirectIOAlignment * POSCheckpointIOBackend::kDirectIOAlignment;
+        }
+        if(direct_size > 0){
+            retval = __write_all(this->_io, this->_direct_fd, data, direct_size, chunk.offset);
+        }
+        if(likely(retval == POS_SUCCESS && direct_size < size)){
+            retval = __write_all(this->_io, this->_fd, data + direct_size, size - direct_size, chunk.offset + direct_size);
+        }
+        if(unlikely(retval != POS_SUCCESS)){
+            // other records might already refer to this chunk, so the image is no longer valid
+            POS_WARN_C("failed to write chunk to checkpoint image: path(%s), errno(%d)", this->_path.c_str(), errno);
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_is_chunk_failed = true;
+            goto exit;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_dedup_stat.nb_chunks += header.nb_chunks;
+        this->_dedup_stat.nb_zero_chunks += nb_zero_chunks;
+        this->_dedup_stat.nb_logical_bytes += section_size;
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImageWriter::__compress_frames(
+    pos_ckpt_codec_t codec, const void* section, uint64_t section_size,
+    std::vector<uint8_t>& compressed, uint64_t* compressed_size
+){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointCodec *codec_inst;
+    pos_ckpt_image_compressed_header_t header;
+    std::vector<pos_ckpt_image_frame_t> frames;
+    uint64_t i, bound, table_size, data_size, nb_raw_frames = 0;
+    uint8_t *slots;
+
+    POS_CHECK_POINTER(codec_inst = POSCheckpointCodec::get_instance());
+    POS_CHECK_POINTER(compressed_size);
+    POS_ASSERT(this->_frame_size > 0);
+
+    header.frame_size = this->_frame_size;
+    header.section_size = section_size;
+    header.nb_frames = (section_size + this->_frame_size - 1) / this->_frame_size;
+    frames.resize(header.nb_frames);
+    table_size = sizeof(pos_ckpt_image_compressed_header_t) + header.nb_frames * sizeof(pos_ckpt_image_frame_t);
+
+    // [1] compress each frame into its own slot after the frame table, in parallel
+    bound = std::max<uint64_t>(codec_inst->get_bound(codec, this->_frame_size), this->_frame_size);
+    if(compressed.size() < table_size + header.nb_frames * bound){
+        compressed.resize(table_size + header.nb_frames * bound);
+    }
+    slots = compressed.data() + table_size;
+
+    retval = POSPersistExecutor::get_instance()->parallel_for(
+        header.nb_frames,
+        [&](uint64_t index) -> pos_retval_t {
+            pos_retval_t retval;
+            const uint8_t *src = reinterpret_cast<const uint8_t*>(section) + index * header.frame_size;
+            uint64_t size = std::min<uint64_t>(header.frame_size, section_size - index * header.frame_size);
+            uint64_t frame_size;
+
+            retval = codec_inst->compress(codec, src, size, slots + index * bound, bound, &frame_size);
+            if(unlikely(retval != POS_SUCCESS)){ return retval; }
+
+            // frames that don't shrink are stored as is
+            frames[index].reserved = 0;
+            if(frame_size < size){
+                frames[index].codec = codec;
+                frames[index].size = frame_size;
+            } else {
+                memcpy(slots + index * bound, src, size);
+                frames[index].codec = kPOS_CkptCodec_None;
+                frames[index].size = size;
+            }
+            return POS_SUCCESS;
+        }
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C(
+            "failed to compress raw section: path(%s), codec(%s), size(%lu)",
+            this->_path.c_str(), POSCheckpointCodec::get_name(codec), section_size
+        );
+        goto exit;
+    }
+
+    // [2] pack frames back to back, frames only move towards the front so it's done in order
+    for(data_size=0, i=0; i<header.nb_frames; i++){
+        frames[i].offset = data_size;
+        if(data_size != i * bound){
+            memmove(slots + data_size, slots + i * bound, frames[i].size);
+        }
+        data_size += frames[i].size;
+        if(frames[i].codec == kPOS_CkptCodec_None){ nb_raw_frames += 1; }
+    }
+    memcpy(compressed.data(), &header, sizeof(pos_ckpt_image_compressed_header_t));
+    memcpy(
+        compressed.data() + sizeof(pos_ckpt_image_compressed_header_t), frames.data(),
+        header.nb_frames * sizeof(pos_ckpt_image_frame_t)
+    );
+    *compressed_size = table_size + data_size;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_compress_stat.nb_frames += header.nb_frames;
+        this->_compress_stat.nb_raw_frames += nb_raw_frames;
+        this->_compress_stat.nb_logical_bytes += section_size;
+        this->_compress_stat.nb_stored_bytes += *compressed_size;
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_ckpt_image_checksum_stat_t POSCheckpointImageWriter::get_checksum_stat(){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    pos_ckpt_image_checksum_stat_t stat = this->_checksum_stat;
+    stat.elapsed_ns = this->_open_timer.stop_get_ns();
+    return stat;
+}
+
+
+pos_ckpt_image_compress_stat_t POSCheckpointImageWriter::get_compress_stat(){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_compress_stat;
+}
+
+
+pos_ckpt_image_dedup_stat_t POSCheckpointImageWriter::get_dedup_stat(){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_dedup_stat;
+}
+
+
+pos_retval_t POSCheckpointImageWriter::__write_index(){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_image_trailer_t trailer;
+    uint64_t index_size, image_size;
+    std::vector<pos_ckpt_image_chunk_t> chunk_table;
+    void *staged;
+
+    if(unlikely(this->_is_chunk_failed)){
+        POS_WARN_C("skip sealing checkpoint image with unwritten chunks: path(%s)", this->_path.c_str());
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+    // the chunk table is appended as the last record, after all records that refer to chunks
+    if(this->_chunks.size() > 0){
+        chunk_table.reserve(this->_chunks.size());
+        for(auto &pair : this->_chunks){ chunk_table.push_back(pair.second); }
+        retval = this->append(
+            /* type */ kPOS_CkptImageRecord_ChunkTable,
+            /* resource_type_id */ 0,
+            /* id */ 0,
+            /* version */ 0,
+            /* data */ chunk_table.data(),
+            /* size */ chunk_table.size() * sizeof(pos_ckpt_image_chunk_t)
+        );
+        if(unlikely(retval != POS_SUCCESS)){
+            POS_WARN_C("failed to write chunk table of checkpoint image: path(%s)", this->_path.c_str());
+            goto exit;
+        }
+        POS_LOG_C(
+            "deduplicated checkpoint image: path(%s), #chunks(%lu), #zero chunks(%lu), #unique chunks(%lu), "
+            "logical size(%lu Bytes), stored size(%lu Bytes), dedup ratio(%.2f)",
+            this->_path.c_str(), this->_dedup_stat.nb_chunks, this->_dedup_stat.nb_zero_chunks,
+            this->_dedup_stat.nb_unique_chunks, this->_dedup_stat.nb_logical_bytes,
+            this->_dedup_stat.nb_stored_bytes, this->_dedup_stat.get_dedup_ratio()
+        );
+    }
+
+    if(this->_compress_stat.nb_frames > 0){
+        POS_LOG_C(
+            "compressed checkpoint image: path(%s), #frames(%lu), #uncompressed frames(%lu), "
+            "logical size(%lu Bytes), stored size(%lu Bytes), compress ratio(%.2f)",
+            this->_path.c_str(), this->_compress_stat.nb_frames, this->_compress_stat.nb_raw_frames,
+            this->_compress_stat.nb_logical_bytes, this->_compress_stat.nb_stored_bytes,
+            this->_compress_stat.get_compress_ratio()
+        );
+    }
+
+    memset(&trailer, 0, sizeof(pos_ckpt_image_trailer_t));
+    trailer.index_offset = (this->_offset + kRecordAlignment - 1) / kRecordAlignment * kRecordAlignment;
+    trailer.nb_entries = this->_entries.size();
+    trailer.format_version = kPOS_CkptImageFormatVersion;
+    trailer.magic = kPOS_CkptImageMagic;
+
+    index_size = this->_entries.size() * sizeof(pos_ckpt_image_entry_t);
+    trailer.index_checksum = POSUtilCrc32c::calculate(this->_entries.data(), index_size);
+
+    if(unlikely(POS_SUCCESS != (
+        retval = __write_all(this->_io, this->_fd, this->_entries.data(), index_size, trailer.index_offset)
+    ))){
+        goto exit;
+    }
+
+    if(unlikely(POS_SUCCESS != (
+        retval = __write_all(this->_io, this->_fd, &trailer, sizeof(trailer), trailer.index_offset + index_size)
+    ))){
+        goto exit;
+    }
+
+    image_size = trailer.index_offset + index_size + sizeof(trailer);
+    if(this->_is_staged){
+        // upload the staged image in parts, straight from the memfd
+        staged = mmap(nullptr, image_size, PROT_READ, MAP_SHARED, this->_fd, 0);
+        if(unlikely(staged == MAP_FAILED)){
+            POS_WARN_C("failed to mmap staged checkpoint image: path(%s), errno(%d)", this->_path.c_str(), errno);
+            retval = POS_FAILED;
+            goto exit;
+        }
+        retval = this->_storage->put(POS_CKPT_IMAGE_FILE_NAME, staged, image_size);
+        munmap(staged, image_size);
+        if(unlikely(retval != POS_SUCCESS)){
+            POS_WARN_C("failed to upload checkpoint image: path(%s)", this->_path.c_str());
+            goto exit;
+        }
+    } else if(unlikely(fsync(this->_fd) != 0)){
+        POS_WARN_C("failed to fsync checkpoint image: path(%s), errno(%d)", this->_path.c_str(), errno);
+        retval = POS_FAILED;
+    }
+
+    POS_DEBUG_C(
+        "checksummed checkpoint image: path(%s), size(%lu Bytes), checksum time(%.2f ms), overhead(%.2f%% of dump time)",
+        this->_path.c_str(), this->_checksum_stat.nb_bytes, (double)this->_checksum_stat.checksum_ns / 1e6,
+        (double)this->_checksum_stat.checksum_ns * 100.0 / this->_open_timer.stop_get_ns()
+    );
+
+    POS_DEBUG_C(
+        "sealed checkpoint image: path(%s), nb_records(%lu), size(%lu)",
+        this->_path.c_str(), this->_entries.size(), image_size
+    );
+
+exit:
+    return retval;
+}
+
+
+/* ========================== reader ========================== */
+POSCheckpointImage::~POSCheckpointImage(){
+    for(auto &pair : this->_assembled){ munmap(pair.second.first, pair.second.second); }
+    if(this->_mapped != nullptr){ munmap(this->_mapped, this->_mapped_size); }
+    if(this->_fd >= 0){ close(this->_fd); }
+    if(this->_direct_fd >= 0){ close(this->_direct_fd); }
+}
+
+
+pos_retval_t POSCheckpointImage::open(const std::string& ckpt_dir){
+    pos_retval_t retval = POS_SUCCESS;
+    std::string path;
+    std::shared_ptr<POSCheckpointStorage> storage;
+    bool is_local;
+    POSCheckpointIOBackend *io;
+    struct stat sb;
+    const pos_ckpt_image_header_t *header;
+    const pos_ckpt_image_trailer_t *trailer;
+    const pos_ckpt_image_entry_t *entry;
+    const pos_ckpt_image_chunk_t *chunks;
+    std::tuple<uint32_t, pos_resource_typeid_t, pos_u64id_t> key;
+    uint64_t i;
+
+    POS_ASSERT(this->_mapped == nullptr);
+
+    if(unlikely(POS_SUCCESS != POSCheckpointStorage::open(ckpt_dir, storage))){
+        POS_WARN_C("failed to open checkpoint image, invalid storage: ckpt_dir(%s)", ckpt_dir.c_str());
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    path = storage->get_local_path(POS_CKPT_IMAGE_FILE_NAME);
+    if(!(is_local = (path.size() > 0))){ path = ckpt_dir + std::string("/") + POS_CKPT_IMAGE_FILE_NAME; }
+
+    POS_CHECK_POINTER(io = POSCheckpointIOBackend::get_instance());
+    if(is_local){
+        this->_fd = io->open(path, O_RDONLY);
+    } else if((this->_fd = storage->open_fd(POS_CKPT_IMAGE_FILE_NAME, /* is_write */ false)) < 0){
+        if(unlikely(POS_SUCCESS != (retval = this->__download(storage.get())))){ goto exit; }
+    }
+    if(unlikely(this->_fd < 0)){
+        POS_WARN_C("failed to open checkpoint image: path(%s)", path.c_str());
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+
+    if(unlikely(fstat(this->_fd, &sb) == -1)){
+        POS_WARN_C("failed to obtain metadata of checkpoint image: path(%s)", path.c_str());
+        retval = POS_FAILED;
+        goto exit;
+    }
+    if(unlikely(
+            sb.st_size < 0
+        ||  static_cast<uint64_t>(sb.st_size) < sizeof(pos_ckpt_image_header_t) + sizeof(pos_ckpt_image_trailer_t)
+    )){
+        POS_WARN_C("checkpoint image is truncated: path(%s), size(%lu)", path.c_str(), sb.st_size);
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    this->_mapped = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, this->_fd, 0);
+    if(unlikely(this->_mapped == MAP_FAILED)){
+        POS_WARN_C("failed to mmap checkpoint image: path(%s)", path.c_str());
+        this->_mapped = nullptr;
+        retval = POS_FAILED;
+        goto exit;
+    }
+    this->_mapped_size = sb.st_size;
+
+    // verify header and trailer
+    header = reinterpret_cast<const pos_ckpt_image_header_t*>(this->_mapped);
+    trailer = reinterpret_cast<const pos_ckpt_image_trailer_t*>(
+        reinterpret_cast<uint8_t*>(this->_mapped) + this->_mapped_size - sizeof(pos_ckpt_image_trailer_t)
+    );
+    if(unlikely(
+            header->magic != kPOS_CkptImageMagic || trailer->magic != kPOS_CkptImageMagic
+        ||  header->format_version != kPOS_CkptImageFormatVersion
+    )){
+        POS_WARN_C("checkpoint image is corrupted or unsealed: path(%s)", path.c_str());
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    if(unlikely(
+        trailer->index_offset + trailer->nb_entries * sizeof(pos_ckpt_image_entry_t)
+            != this->_mapped_size - sizeof(pos_ckpt_image_trailer_t)
+    )){
+        POS_WARN_C("checkpoint image has invalid index: path(%s)", path.c_str());
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    this->_entries = reinterpret_cast<const pos_ckpt_image_entry_t*>(
+        reinterpret_cast<uint8_t*>(this->_mapped) + trailer->index_offset
+    );
+    this->_nb_entries = trailer->nb_entries;
+    if(unlikely(
+        trailer->index_checksum
+            != POSUtilCrc32c::calculate(this->_entries, this->_nb_entries * sizeof(pos_ckpt_image_entry_t))
+    )){
+        POS_WARN_C("checksum of checkpoint image index mismatched: path(%s)", path.c_str());
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    // build lookup table
+    for(i=0; i<this->_nb_entries; i++){
+        entry = &(this->_entries[i]);
+        if(unlikely(entry->offset + entry->size > trailer->index_offset)){
+            POS_WARN_C("checkpoint image has out-of-range record: path(%s), index(%lu)", path.c_str(), i);
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        if(entry->type == kPOS_CkptImageRecord_HandleDelta){
+            this->_delta_lookup[std::make_pair(entry->resource_type_id, entry->id)].push_back(i);
+            continue;
+        }
+        key = std::make_tuple(static_cast<uint32_t>(entry->type), entry->resource_type_id, entry->id);
+        if(this->_lookup.count(key) == 0 || this->_entries[this->_lookup[key]].version <= entry->version){
+            this->_lookup[key] = i;
+        }
+    }
+
+    // load the chunk table, if any record refers to content-addressed chunks
+    if((entry = this->find(kPOS_CkptImageRecord_ChunkTable)) != nullptr){
+        if(unlikely(
+                POS_SUCCESS != this->verify(entry)
+            ||  entry->size % sizeof(pos_ckpt_image_chunk_t) != 0
+        )){
+            POS_WARN_C("checkpoint image has corrupted chunk table: path(%s)", path.c_str());
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        chunks = reinterpret_cast<const pos_ckpt_image_chunk_t*>(this->get_data(entry));
+        for(i=0; i<entry->size / sizeof(pos_ckpt_image_chunk_t); i++){
+            if(unlikely(chunks[i].offset + chunks[i].size > trailer->index_offset)){
+                POS_WARN_C("checkpoint image has out-of-range chunk: path(%s), index(%lu)", path.c_str(), i);
+                retval = POS_FAILED_INVALID_INPUT;
+                goto exit;
+            }
+            this->_chunks[chunks[i].hash] = &(chunks[i]);
+        }
+    }
+
+    POS_DEBUG_C(
+        "opened checkpoint image: path(%s), nb_records(%lu), size(%lu)",
+        path.c_str(), this->_nb_entries, this->_mapped_size
+    );
+
+    // raw sections could also be read through the backend, with direct I/O if enabled
+    if(is_local && io->get_options().use_direct_io){
+        this->_direct_fd = io->open(path, O_RDONLY, /* is_direct */ true);
+    }
+
+exit:
+    if(unlikely(retval != POS_SUCCESS) && this->_fd >= 0){
+        close(this->_fd);
+        this->_fd = -1;
+    }
+    if(unlikely(retval != POS_SUCCESS) && this->_mapped != nullptr){
+        munmap(this->_mapped, this->_mapped_size);
+        this->_mapped = nullptr;
+        this->_mapped_size = 0;
+        this->_entries = nullptr;
+        this->_nb_entries = 0;
+        this->_lookup.clear();
+        this->_delta_lookup.clear();
+        this->_chunks.clear();
+    }
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImage::__download(POSCheckpointStorage* storage){
+    pos_retval_t retval = POS_SUCCESS;
+    uint64_t size;
+    void *staged = nullptr;
+
+    POS_CHECK_POINTER(storage);
+
+    if(unlikely(POS_SUCCESS != (retval = storage->get_size(POS_CKPT_IMAGE_FILE_NAME, &size)))){
+        POS_WARN_C("failed to obtain size of checkpoint image: uri(%s), retval(%u)", storage->get_uri().c_str(), retval);
+        if(retval != POS_FAILED_NOT_EXIST){ retval = POS_FAILED; }
+        goto exit;
+    }
+
+    if(unlikely(
+            (this->_fd = memfd_create(POS_CKPT_IMAGE_FILE_NAME, MFD_CLOEXEC)) < 0
+        ||  ftruncate(this->_fd, size) != 0
+        ||  (size > 0 && (staged = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->_fd, 0)) == MAP_FAILED)
+    )){
+        POS_WARN_C("failed to create memfd for checkpoint image: size(%lu), errno(%d)", size, errno);
+        staged = nullptr;
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+    if(unlikely(POS_SUCCESS != (retval = storage->get(POS_CKPT_IMAGE_FILE_NAME, staged, size)))){
+        POS_WARN_C("failed to download checkpoint image: uri(%s), retval(%u)", storage->get_uri().c_str(), retval);
+        retval = POS_FAILED;
+        goto exit;
+    }
+    POS_DEBUG_C("downloaded checkpoint image: uri(%s), size(%lu)", storage->get_uri().c_str(), size);
+
+exit:
+    if(staged != nullptr){ munmap(staged, size); }
+    if(unlikely(retval != POS_SUCCESS) && this->_fd >= 0){
+        close(this->_fd);
+        this->_fd = -1;
+    }
+    return retval;
+}
+
+
+const pos_ckpt_image_entry_t* POSCheckpointImage::find(
+    pos_ckpt_image_record_type_t type, pos_resource_typeid_t resource_type_id, pos_u64id_t id
+){
+    typename std::map<std::tuple<uint32_t, pos_resource_typeid_t, pos_u64id_t>, uint64_t>::iterator iter;
+
+    iter = this->_lookup.find(std::make_tuple(static_cast<uint32_t>(type), resource_type_id, id));
+    if(unlikely(iter == this->_lookup.end())){ return nullptr; }
+    return &(this->_entries[iter->second]);
+}
+
+
+void POSCheckpointImage::get_deltas(
+    pos_resource_typeid_t resource_type_id, pos_u64id_t id, std::vector<const pos_ckpt_image_entry_t*>& entries
+){
+    typename std::map<std::pair<pos_resource_typeid_t, pos_u64id_t>, std::vector<uint64_t>>::iterator iter;
+
+    iter = this->_delta_lookup.find(std::make_pair(resource_type_id, id));
+    if(iter == this->_delta_lookup.end()){ return; }
+    for(uint64_t index : iter->second){ entries.push_back(&(this->_entries[index])); }
+}
+
+
+void POSCheckpointImage::get_entries(pos_ckpt_image_record_type_t type, std::vector<const pos_ckpt_image_entry_t*>& entries){
+    typename std::map<std::tuple<uint32_t, pos_resource_typeid_t, pos_u64id_t>, uint64_t>::iterator iter;
+
+    iter = this->_lookup.lower_bound(std::make_tuple(static_cast<uint32_t>(type), 0u, 0ul));
+    while(iter != this->_lookup.end() && std::get<0>(iter->first) == static_cast<uint32_t>(type)){
+        entries.push_back(&(this->_entries[iter->second]));
+        iter++;
+    }
+}
+
+
+pos_retval_t POSCheckpointImage::get_section(
+    const pos_ckpt_image_entry_t* entry,
+    void** meta, uint64_t* meta_size, void** section, uint64_t* section_size
+){
+    pos_retval_t retval = POS_SUCCESS;
+    const pos_ckpt_image_section_header_t *header;
+    uint8_t *record;
+
+    POS_CHECK_POINTER(entry);
+    POS_CHECK_POINTER(meta); POS_CHECK_POINTER(meta_size);
+    POS_CHECK_POINTER(section); POS_CHECK_POINTER(section_size);
+
+    record = reinterpret_cast<uint8_t*>(this->get_data(entry));
+
+    if(!(entry->flags & kPOS_CkptImageEntryFlag_RawSection)){
+        *meta = record;
+        *meta_size = entry->size;
+        *section = nullptr;
+        *section_size = 0;
+        goto exit;
+    }
+
+    if(unlikely(entry->size < sizeof(pos_ckpt_image_section_header_t))){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    header = reinterpret_cast<const pos_ckpt_image_section_header_t*>(record);
+    if(unlikely(
+            sizeof(pos_ckpt_image_section_header_t) + header->meta_size > header->section_offset
+        ||  header->section_offset + header->section_size != entry->size
+    )){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    *meta = record + sizeof(pos_ckpt_image_section_header_t);
+    *meta_size = header->meta_size;
+    *section = header->section_size > 0 ? record + header->section_offset : nullptr;
+    *section_size = header->section_size;
+
+    if(entry->flags & kPOS_CkptImageEntryFlag_Chunked){
+        retval = this->__assemble_chunks(
+            /* index */ entry - this->_entries,
+            /* chunked */ record + header->section_offset,
+            /* chunked_size */ header->section_size,
+            /* section */ section,
+            /* section_size */ section_size
+        );
+    } else if(entry->flags & kPOS_CkptImageEntryFlag_Compressed){
+        retval = this->__decompress_frames(
+            /* index */ entry - this->_entries,
+            /* compressed */ record + header->section_offset,
+            /* compressed_size */ header->section_size,
+            /* section */ section,
+            /* section_size */ section_size
+        );
+    }
+
+exit:
+    if(unlikely(retval != POS_SUCCESS) && this->__mark_reported(entry)){
+        POS_WARN_C(
+            "checkpoint record has invalid raw section: type(%u), rid(%u), id(%lu)",
+            entry->type, entry->resource_type_id, entry->id
+        );
+    }
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImage::read_section(const pos_ckpt_image_entry_t* entry, void* dst, uint64_t size){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointIOBackend *io;
+    void *meta, *section;
+    uint64_t meta_size, section_size, section_pos, direct_size = 0;
+
+    POS_CHECK_POINTER(entry);
+    POS_CHECK_POINTER(dst);
+    POS_CHECK_POINTER(io = POSCheckpointIOBackend::get_instance());
+
+    if(unlikely(POS_SUCCESS != (retval = this->get_section(entry, &meta, &meta_size, &section, &section_size)))){
+        goto exit;
+    }
+    if(unlikely(size < section_size)){
+        POS_WARN_C("buffer is too small for the raw section: size(%lu), section_size(%lu)", size, section_size);
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    if(unlikely(section_size == 0)){ goto exit; }
+
+    // chunked / compressed raw sections aren't stored as is within the image, copy from the assembled one
+    if(entry->flags & (kPOS_CkptImageEntryFlag_Chunked | kPOS_CkptImageEntryFlag_Compressed)){
+        memcpy(dst, section, section_size);
+        goto exit;
+    }
+
+    section_pos = entry->offset + (reinterpret_cast<uint8_t*>(section) - reinterpret_cast<uint8_t*>(this->get_data(entry)));
+
+    if(this->_direct_fd >= 0 && reinterpret_cast<uint64_t>(dst) % POSCheckpointIOBackend::kDirectIOAlignment == 0){
+        direct_size = section_size / POSCheckpointIOBackend::kDirectIOAlignment * POSCheckpointIOBackend::kDirectIOAlignment;
+        if(direct_size > 0){
+            retval = io->read(this->_direct_fd, dst, direct_size, section_pos);
+        }
+    }
+    if(likely(retval == POS_SUCCESS && direct_size < section_size)){
+        retval = io->read(
+            this->_fd, reinterpret_cast<uint8_t*>(dst) + direct_size, section_size - direct_size, section_pos + direct_size
+        );
+    }
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C(
+            "failed to read raw section: type(%u), rid(%u), id(%lu)",
+            entry->type, entry->resource_type_id, entry->id
+        );
+    }
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointImage::release_section(const pos_ckpt_image_entry_t* entry){
+    uint64_t index;
+    typename std::map<uint64_t, std::pair<void*, uint64_t>>::iterator iter;
+
+    POS_CHECK_POINTER(entry);
+    index = entry - this->_entries;
+
+    std::lock_guard<std::mutex> lock(this->_assembled_mutex);
+    if((iter = this->_assembled.find(index)) != this->_assembled.end()){
+        munmap(iter->second.first, iter->second.second);
+        this->_assembled.erase(iter);
+    }
+}
+
+
+pos_retval_t POSCheckpointImage::__assemble_chunks(
+    uint64_t index, const void* chunked, uint64_t chunked_size, void** section, uint64_t* section_size
+){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_image_chunked_header_t header;
+    pos_chunk_hash_t hash;
+    const uint8_t *hashes;
+    typename std::unordered_map<pos_chunk_hash_t, const pos_ckpt_image_chunk_t*, pos_chunk_hash_hasher>::iterator iter;
+    uint8_t *assembled = nullptr;
+    uint64_t i, size;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_assembled_mutex);
+        if(this->_assembled.count(index) > 0){
+            *section = this->_assembled[index].first;
+            *section_size = this->_assembled[index].second;
+            goto exit;
+        }
+    }
+
+    if(unlikely(chunked_size < sizeof(pos_ckpt_image_chunked_header_t))){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    memcpy(&header, chunked, sizeof(pos_ckpt_image_chunked_header_t));
+    if(unlikely(
+            header.chunk_size == 0
+        ||  header.nb_chunks != (header.section_size + header.chunk_size - 1) / header.chunk_size
+        ||  chunked_size != sizeof(pos_ckpt_image_chunked_header_t) + header.nb_chunks * sizeof(pos_chunk_hash_t)
+    )){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    hashes = reinterpret_cast<const uint8_t*>(chunked) + sizeof(pos_ckpt_image_chunked_header_t);
+
+    *section = nullptr;
+    *section_size = header.section_size;
+    if(unlikely(header.section_size == 0)){ goto exit; }
+
+    // anonymous pages are zero-filled on first touch, so all-zero chunks need no copy
+    assembled = reinterpret_cast<uint8_t*>(mmap(
+        nullptr, header.section_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    ));
+    if(unlikely(assembled == MAP_FAILED)){
+        assembled = nullptr;
+        retval = POS_FAILED_OOM;
+        goto exit;
+    }
+
+    // chunks are copied outside the lock, as the index of chunks is read-only once the image is opened
+    for(i=0; i<header.nb_chunks; i++){
+        memcpy(&hash, hashes + i * sizeof(pos_chunk_hash_t), sizeof(pos_chunk_hash_t));
+        if(hash.is_zero()){ continue; }
+
+        size = std::min<uint64_t>(header.chunk_size, header.section_size - i * header.chunk_size);
+        iter = this->_chunks.find(hash);
+        if(unlikely(iter == this->_chunks.end() || iter->second->size != size)){
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        memcpy(
+            assembled + i * header.chunk_size,
+            reinterpret_cast<uint8_t*>(this->_mapped) + iter->second->offset,
+            size
+        );
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_assembled_mutex);
+        if(unlikely(this->_assembled.count(index) > 0)){
+            // assembled by another thread meanwhile
+            munmap(assembled, header.section_size);
+            *section = this->_assembled[index].first;
+        } else {
+            this->_assembled[index] = std::pair<void*, uint64_t>(assembled, static_cast<uint64_t>(header.section_size));
+            *section = assembled;
+        }
+        assembled = nullptr;
+    }
+
+exit:
+    if(unlikely(retval != POS_SUCCESS) && assembled != nullptr){
+        munmap(assembled, header.section_size);
+    }
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImage::__decompress_frames(
+    uint64_t index, const void* compressed, uint64_t compressed_size, void** section, uint64_t* section_size
+){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointCodec *codec_inst;
+    pos_ckpt_image_compressed_header_t header;
+    const uint8_t *table, *data;
+    uint64_t table_size, data_size;
+    uint8_t *decompressed = nullptr;
+
+    POS_CHECK_POINTER(codec_inst = POSCheckpointCodec::get_instance());
+
+    {
+        std::lock_guard<std::mutex> lock(this->_assembled_mutex);
+        if(this->_assembled.count(index) > 0){
+            *section = this->_assembled[index].first;
+            *section_size = this->_assembled[index].second;
+            goto exit;
+        }
+    }
+
+    if(unlikely(compressed_size < sizeof(pos_ckpt_image_compressed_header_t))){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    memcpy(&header, compressed, sizeof(pos_ckpt_image_compressed_header_t));
+    table_size = sizeof(pos_ckpt_image_compressed_header_t) + header.nb_frames * sizeof(pos_ckpt_image_frame_t);
+    if(unlikely(
+            header.frame_size == 0
+        ||  header.nb_frames != (header.section_size + header.frame_size - 1) / header.frame_size
+        ||  compressed_size < table_size
+    )){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    table = reinterpret_cast<const uint8_t*>(compressed) + sizeof(pos_ckpt_image_compressed_header_t);
+    data = reinterpret_cast<const uint8_t*>(compressed) + table_size;
+    data_size = compressed_size - table_size;
+
+    *section = nullptr;
+    *section_size = header.section_size;
+    if(unlikely(header.section_size == 0)){ goto exit; }
+
+    decompressed = reinterpret_cast<uint8_t*>(mmap(
+        nullptr, header.section_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    ));
+    if(unlikely(decompressed == MAP_FAILED)){
+        decompressed = nullptr;
+        retval = POS_FAILED_OOM;
+        goto exit;
+    }
+
+    // frames are independent, decompress them in parallel outside the lock
+    retval = POSPersistExecutor::get_instance()->parallel_for(
+        header.nb_frames,
+        [&](uint64_t i) -> pos_retval_t {
+            pos_ckpt_image_frame_t frame;
+            uint64_t size = std::min<uint64_t>(header.frame_size, header.section_size - i * header.frame_size);
+
+            memcpy(&frame, table + i * sizeof(pos_ckpt_image_frame_t), sizeof(pos_ckpt_image_frame_t));
+            if(unlikely(frame.offset > data_size || frame.size > data_size - frame.offset)){
+                return POS_FAILED_INVALID_INPUT;
+            }
+            return codec_inst->decompress(frame.codec, data + frame.offset, frame.size, decompressed + i * header.frame_size, size);
+        }
+    );
+    if(unlikely(retval != POS_SUCCESS)){ goto exit; }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_assembled_mutex);
+        if(unlikely(this->_assembled.count(index) > 0)){
+            // decompressed by another thread meanwhile
+            munmap(decompressed, header.section_size);
+            *section = this->_assembled[index].first;
+        } else {
+            this->_assembled[index] = std::pair<void*, uint64_t>(decompressed, static_cast<uint64_t>(header.section_size));
+            *section = decompressed;
+        }
+        decompressed = nullptr;
+    }
+
+exit:
+    if(unlikely(retval != POS_SUCCESS) && decompressed != nullptr){
+        munmap(decompressed, header.section_size);
+    }
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointImage::verify(const pos_ckpt_image_entry_t* entry){
+    std::vector<const pos_ckpt_image_entry_t*> entries;
+    std::vector<pos_retval_t> results;
+
+    POS_CHECK_POINTER(entry);
+    entries.push_back(entry);
+    return this->verify_entries(entries, results);
+}
+
+
+pos_retval_t POSCheckpointImage::verify_entries(
+    const std::vector<const pos_ckpt_image_entry_t*>& entries,
+    std::vector<pos_retval_t>& results,
+    pos_ckpt_image_verify_stat_t* stat
+){
+    /*!
+     *  \brief  buffer to be checksummed, either a record or a chunk
+     */
+    typedef struct verify_target {
+        const uint8_t *data;
+        uint64_t size;
+        uint32_t checksum;
+
+        // position of the first segment of the target
+        uint64_t segment_begin;
+    } verify_target_t;
+
+    pos_retval_t retval = POS_SUCCESS;
+    POSUtilHpetTimer timer;
+    std::vector<verify_target_t> targets;
+    std::vector<std::pair<const uint8_t*, uint64_t>> segments;
+    std::vector<uint32_t> segment_checksums;
+    std::vector<bool> is_target_matched;
+    std::vector<std::vector<const pos_ckpt_image_chunk_t*>> referred_chunks;
+    std::unordered_map<const pos_ckpt_image_chunk_t*, uint64_t> chunk_targets;
+    uint64_t i, k, offset, nb_bytes = 0, nb_corrupted_records = 0, nb_corrupted_chunks = 0;
+    uint32_t checksum;
+
+    auto __add_target = [&](const void* data, uint64_t size, uint32_t checksum){
+        verify_target_t target;
+        target.data = reinterpret_cast<const uint8_t*>(data);
+        target.size = size;
+        target.checksum = checksum;
+        target.segment_begin = segments.size();
+        targets.push_back(target);
+        for(offset=0; offset==0 || offset<size; offset+=kVerifySegmentSize){
+            segments.push_back(std::make_pair(target.data + offset, std::min<uint64_t>(kVerifySegmentSize, size - offset)));
+        }
+        nb_bytes += size;
+    };
+
+    timer.start();
+    results.assign(entries.size(), POS_SUCCESS);
+    referred_chunks.resize(entries.size());
+
+    // targets [0, #entries) are the records, the chunks they refer to follow
+    for(i=0; i<entries.size(); i++){
+        POS_CHECK_POINTER(entries[i]);
+        __add_target(this->get_data(entries[i]), entries[i]->size, entries[i]->checksum);
+    }
+    for(i=0; i<entries.size(); i++){
+        if(!(entries[i]->flags & kPOS_CkptImageEntryFlag_Chunked)){ continue; }
+        if(unlikely(POS_SUCCESS != this->__get_referred_chunks(entries[i], referred_chunks[i]))){
+            results[i] = POS_FAILED_INCORRECT_OUTPUT;
+            continue;
+        }
+        for(const pos_ckpt_image_chunk_t *chunk : referred_chunks[i]){
+            if(chunk_targets.count(chunk) > 0){ continue; }
+            chunk_targets[chunk] = targets.size();
+            __add_target(reinterpret_cast<uint8_t*>(this->_mapped) + chunk->offset, chunk->size, chunk->checksum);
+        }
+    }
+
+    // checksum all segments in parallel, then combine them per target
+    segment_checksums.resize(segments.size());
+    POSPersistExecutor::get_instance()->parallel_for(
+        segments.size(),
+        [&](uint64_t index) -> pos_retval_t {
+            segment_checksums[index] = POSUtilCrc32c::calculate(segments[index].first, segments[index].second);
+            return POS_SUCCESS;
+        }
+    );
+
+    is_target_matched.resize(targets.size());
+    for(i=0; i<targets.size(); i++){
+        k = targets[i].segment_begin;
+        checksum = segment_checksums[k];
+        for(k+=1; k<segments.size() && (i+1 == targets.size() || k<targets[i+1].segment_begin); k++){
+            checksum = POSUtilCrc32c::combine(checksum, segment_checksums[k], segments[k].second);
+        }
+        is_target_matched[i] = (checksum == targets[i].checksum);
+        if(i >= entries.size() && !is_target_matched[i]){ nb_corrupted_chunks += 1; }
+    }
+
+    for(i=0; i<entries.size(); i++){
+        if(!is_target_matched[i]){ results[i] = POS_FAILED_INCORRECT_OUTPUT; }
+        for(const pos_ckpt_image_chunk_t *chunk : referred_chunks[i]){
+            if(!is_target_matched[chunk_targets[chunk]]){ results[i] = POS_FAILED_INCORRECT_OUTPUT; }
+        }
+        if(unlikely(results[i] != POS_SUCCESS)){
+            if(this->__mark_reported(entries[i])){
+                POS_WARN_C(
+                    "checksum of checkpoint record mismatched: type(%u), rid(%u), id(%lu)",
+                    entries[i]->type, entries[i]->resource_type_id, entries[i]->id
+                );
+            }
+            nb_corrupted_records += 1;
+            retval = POS_FAILED_INCORRECT_OUTPUT;
+        }
+    }
+
+    if(stat != nullptr){
+        stat->nb_records = entries.size();
+        stat->nb_corrupted_records = nb_corrupted_records;
+        stat->nb_chunks = chunk_targets.size();
+        stat->nb_corrupted_chunks = nb_corrupted_chunks;
+        stat->nb_bytes = nb_bytes;
+        stat->duration_ms = timer.stop_get_ms();
+    }
+
+    return retval;
+}
+
+
+bool POSCheckpointImage::__mark_reported(const pos_ckpt_image_entry_t* entry){
+    std::lock_guard<std::mutex> lock(this->_reported_mutex);
+    return this->_reported.insert(entry - this->_entries).second;
+}
+
+
+pos_retval_t POSCheckpointImage::verify_all(pos_ckpt_image_verify_stat_t* stat){
+    std::vector<const pos_ckpt_image_entry_t*> entries;
+    std::vector<pos_retval_t> results;
+    uint64_t i;
+
+    for(i=0; i<this->_nb_entries; i++){ entries.push_back(&(this->_entries[i])); }
+    return this->verify_entries(entries, results, stat);
+}
+
+
+pos_retval_t POSCheckpointImage::__get_referred_chunks(
+    const pos_ckpt_image_entry_t* entry, std::vector<const pos_ckpt_image_chunk_t*>& chunks
+){
+    pos_retval_t retval = POS_SUCCESS;
+    const pos_ckpt_image_section_header_t *header;
+    pos_ckpt_image_chunked_header_t chunked_header;
+    pos_chunk_hash_t hash;
+    const uint8_t *record, *hashes;
+    typename std::unordered_map<pos_chunk_hash_t, const pos_ckpt_image_chunk_t*, pos_chunk_hash_hasher>::iterator iter;
+    uint64_t i;
+
+    record = reinterpret_cast<const uint8_t*>(this->get_data(entry));
+    if(unlikely(entry->size < sizeof(pos_ckpt_image_section_header_t))){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    header = reinterpret_cast<const pos_ckpt_image_section_header_t*>(record);
+    if(unlikely(
+            header->section_offset + header->section_size != entry->size
+        ||  header->section_size < sizeof(pos_ckpt_image_chunked_header_t)
+    )){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    memcpy(&chunked_header, record + header->section_offset, sizeof(pos_ckpt_image_chunked_header_t));
+    if(unlikely(
+        header->section_size
+            != sizeof(pos_ckpt_image_chunked_header_t) + chunked_header.nb_chunks * sizeof(pos_chunk_hash_t)
+    )){
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    hashes = record + header->section_offset + sizeof(pos_ckpt_image_chunked_header_t);
+
+    for(i=0; i<chunked_header.nb_chunks; i++){
+        memcpy(&hash, hashes + i * sizeof(pos_chunk_hash_t), sizeof(pos_chunk_hash_t));
+        if(hash.is_zero()){ continue; }
+        if(unlikely((iter = this->_chunks.find(hash)) == this->_chunks.end())){
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        chunks.push_back(iter->second);
+    }
+
+exit:
+    return retval;
+}
@@ -0,0 +1,552 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_io.h"
+
+
+/* ========================== common ========================== */
+// the process-wide backend, and all retired backends
+static std::atomic<POSCheckpointIOBackend*> __ckpt_io_backend(nullptr);
+static std::vector<std::unique_ptr<POSCheckpointIOBackend>> __ckpt_io_backends;
+static std::mutex __ckpt_io_backend_mutex;
+
+
+POSCheckpointIOBackend* POSCheckpointIOBackend::get_instance(){
+    POSCheckpointIOBackend *backend = __ckpt_io_backend.load(std::memory_order_acquire);
+    pos_ckpt_io_options_t options;
+
+    if(unlikely(backend == nullptr)){
+        POSCheckpointIOBackend::init(options);
+        backend = __ckpt_io_backend.load(std::memory_order_acquire);
+    }
+    POS_CHECK_POINTER(backend);
+
+    return backend;
+}
+
+
+pos_retval_t POSCheckpointIOBackend::init(const pos_ckpt_io_options_t& options){
+    pos_retval_t retval = POS_SUCCESS;
+    POSCheckpointIOBackend *backend = nullptr, *prev_backend;
+    std::lock_guard<std::mutex> lock(__ckpt_io_backend_mutex);
+
+    if(unlikely(
+            options.type >= kPOS_CkptIOBackend_Unknown || options.queue_depth == 0
+        ||  options.request_size == 0 || options.request_size % kDirectIOAlignment != 0
+    )){
+        POS_WARN(
+            "failed to init checkpoint I/O backend, invalid options: type(%u), queue_depth(%u), request_size(%lu)",
+            options.type, options.queue_depth, options.request_size
+        );
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    if(options.type == kPOS_CkptIOBackend_IoUring){
+        if(likely(POSCheckpointIOBackend_IoUring::is_supported())){
+            POS_CHECK_POINTER(backend = new POSCheckpointIOBackend_IoUring(options));
+        } else {
+            POS_WARN("io_uring is unsupported, fallback to POSIX checkpoint I/O backend");
+            pos_ckpt_io_options_t posix_options = options;
+            posix_options.type = kPOS_CkptIOBackend_Posix;
+            POS_CHECK_POINTER(backend = new POSCheckpointIOBackend_Posix(posix_options));
+            retval = POS_FAILED_NOT_ENABLED;
+        }
+    } else {
+        POS_CHECK_POINTER(backend = new POSCheckpointIOBackend_Posix(options));
+    }
+
+    // inherit registered buffers
+    prev_backend = __ckpt_io_backend.load(std::memory_order_acquire);
+    if(prev_backend != nullptr){
+        std::lock_guard<std::mutex> prev_lock(prev_backend->_mutex);
+        backend->_buffers = prev_backend->_buffers;
+        backend->_buffers_version.store(1);
+        backend->_stat.nb_registered_buffers = backend->_buffers.size();
+    }
+
+    __ckpt_io_backends.emplace_back(backend);
+    __ckpt_io_backend.store(backend, std::memory_order_release);
+
+    POS_DEBUG(
+        "checkpoint I/O backend: type(%s), queue_depth(%u), request_size(%lu), direct_io(%s)",
+        backend->_options.type == kPOS_CkptIOBackend_IoUring ? "io_uring" : "posix",
+        backend->_options.queue_depth, backend->_options.request_size,
+        backend->_options.use_direct_io ? "true" : "false"
+    );
+
+exit:
+    return retval;
+}
+
+
+int POSCheckpointIOBackend::open(const std::string& path, int flags, bool is_direct){
+    if(is_direct){
+        if(!this->_options.use_direct_io){ return -1; }
+        flags |= O_DIRECT;
+    }
+    return ::open(path.c_str(), flags, 0644);
+}
+
+
+void POSCheckpointIOBackend::register_buffer(void* ptr, uint64_t size){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    POS_CHECK_POINTER(ptr);
+    if(size == 0 || size > kMaxRegisteredBufferSize || this->_buffers.size() >= kMaxNbRegisteredBuffers){
+        return;
+    }
+
+    this->_buffers[ptr] = size;
+    this->_buffers_version.fetch_add(1);
+    this->_stat.nb_registered_buffers = this->_buffers.size();
+}
+
+
+void POSCheckpointIOBackend::unregister_buffer(void* ptr){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(this->_buffers.erase(ptr) > 0){
+        this->_buffers_version.fetch_add(1);
+        this->_stat.nb_registered_buffers = this->_buffers.size();
+    }
+}
+
+
+void POSCheckpointIOBackend::get_stat(pos_ckpt_io_stat_t& stat){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    stat = this->_stat;
+}
+
+
+uint64_t POSCheckpointIOBackend::__get_buffers(std::vector<struct iovec>& buffers){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    struct iovec buffer;
+
+    buffers.clear();
+    for(auto& iter : this->_buffers){
+        buffer.iov_base = iter.first;
+        buffer.iov_len = iter.second;
+        buffers.push_back(buffer);
+    }
+
+    return this->_buffers_version.load();
+}
+
+
+/* ========================== POSIX backend ========================== */
+pos_retval_t POSCheckpointIOBackend_Posix::writev(int fd, const struct iovec* iov, int iovcnt, uint64_t offset){
+    pos_retval_t retval = POS_SUCCESS;
+    ssize_t nb_written;
+    uint64_t total_size = 0;
+    int i;
+    std::vector<struct iovec> iov_left(iov, iov + iovcnt);
+    struct iovec *cur = iov_left.data();
+
+    for(i=0; i<iovcnt; i++){ total_size += iov[i].iov_len; }
+
+    while(iovcnt > 0){
+        nb_written = pwritev(fd, cur, iovcnt < IOV_MAX ? iovcnt : IOV_MAX, offset);
+        if(unlikely(nb_written < 0)){
+            if(errno == EINTR){ continue; }
+            retval = POS_FAILED;
+            goto exit;
+        }
+        offset += nb_written;
+
+        // skip buffers that have been written
+        while(iovcnt > 0 && static_cast<uint64_t>(nb_written) >= cur->iov_len){
+            nb_written -= cur->iov_len;
+            cur++; iovcnt--;
+        }
+        if(iovcnt > 0){
+            cur->iov_base = reinterpret_cast<uint8_t*>(cur->iov_base) + nb_written;
+            cur->iov_len -= nb_written;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stat.nb_write_bytes += total_size;
+        this->_stat.nb_requests += 1;
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointIOBackend_Posix::read(int fd, void* buf, uint64_t size, uint64_t offset){
+    pos_retval_t retval = POS_SUCCESS;
+    ssize_t nb_read;
+    uint8_t *ptr = reinterpret_cast<uint8_t*>(buf);
+    uint64_t total_size = size;
+
+    while(size > 0){
+        nb_read = pread(fd, ptr, size, offset);
+        if(unlikely(nb_read <= 0)){
+            if(nb_read < 0 && errno == EINTR){ continue; }
+            retval = POS_FAILED;
+            goto exit;
+        }
+        ptr += nb_read;
+        offset += nb_read;
+        size -= nb_read;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stat.nb_read_bytes += total_size;
+        this->_stat.nb_requests += 1;
+    }
+
+exit:
+    return retval;
+}
+
+
+/* ========================== io_uring backend ========================== */
+std::atomic<uint64_t> POSCheckpointIOBackend_IoUring::__nb_instances(0);
+
+
+/*!
+ *  \brief  io_uring instance owned by a thread
+ */
+class POSCheckpointIOUring {
+ public:
+    POSCheckpointIOUring()
+        :   fd(-1), owner_id(0), buffers_version(0), _sq_ptr(nullptr), _cq_ptr(nullptr), _sqes_ptr(nullptr),
+            _sq_size(0), _cq_size(0), _sqes_size(0) {}
+
+    ~POSCheckpointIOUring(){
+        if(this->_sqes_ptr != nullptr){ munmap(this->_sqes_ptr, this->_sqes_size); }
+        if(this->_cq_ptr != nullptr && this->_cq_ptr != this->_sq_ptr){ munmap(this->_cq_ptr, this->_cq_size); }
+        if(this->_sq_ptr != nullptr){ munmap(this->_sq_ptr, this->_sq_size); }
+        if(this->fd >= 0){ close(this->fd); }
+    }
+
+    /*!
+     *  \brief  create the ring
+     *  \param  depth   number of entries of the submission queue
+     *  \return POS_SUCCESS for successfully created
+     */
+    pos_retval_t setup(uint32_t depth){
+        pos_retval_t retval = POS_SUCCESS;
+        struct io_uring_params params;
+        uint8_t *sq_ptr, *cq_ptr;
+
+        memset(&params, 0, sizeof(struct io_uring_params));
+        this->fd = syscall(__NR_io_uring_setup, depth, &params);
+        if(unlikely(this->fd < 0)){
+            retval = POS_FAILED;
+            goto exit;
+        }
+
+        this->_sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        this->_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if(params.features & IORING_FEAT_SINGLE_MMAP){
+            this->_sq_size = this->_cq_size = std::max(this->_sq_size, this->_cq_size);
+        }
+
+        this->_sq_ptr = mmap(
+            nullptr, this->_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING
+        );
+        if(unlikely(this->_sq_ptr == MAP_FAILED)){ this->_sq_ptr = nullptr; retval = POS_FAILED; goto exit; }
+
+        if(params.features & IORING_FEAT_SINGLE_MMAP){
+            this->_cq_ptr = this->_sq_ptr;
+        } else {
+            this->_cq_ptr = mmap(
+                nullptr, this->_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING
+            );
+            if(unlikely(this->_cq_ptr == MAP_FAILED)){ this->_cq_ptr = nullptr; retval = POS_FAILED; goto exit; }
+        }
+
+        this->_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        this->_sqes_ptr = mmap(
+            nullptr, this->_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES
+        );
+        if(unlikely(this->_sqes_ptr == MAP_FAILED)){ this->_sqes_ptr = nullptr; retval = POS_FAILED; goto exit; }
+
+        sq_ptr = reinterpret_cast<uint8_t*>(this->_sq_ptr);
+        cq_ptr = reinterpret_cast<uint8_t*>(this->_cq_ptr);
+        this->sq_tail = reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.tail);
+        this->sq_mask = *reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.ring_mask);
+        this->sq_array = reinterpret_cast<uint32_t*>(sq_ptr + params.sq_off.array);
+        this->sq_entries = params.sq_entries;
+        this->sqes = reinterpret_cast<struct io_uring_sqe*>(this->_sqes_ptr);
+        this->cq_head = reinterpret_cast<uint32_t*>(cq_ptr + params.cq_off.head);
+        this->cq_tail = reinterpret_cast<uint32_t*>(cq_ptr + params.cq_off.tail);
+        this->cq_mask = *reinterpret_cast<uint32_t*>(cq_ptr + params.cq_off.ring_mask);
+        this->cqes = reinterpret_cast<struct io_uring_cqe*>(cq_ptr + params.cq_off.cqes);
+
+    exit:
+        return retval;
+    }
+
+    /*!
+     *  \brief  (re)register buffers to the ring
+     *  \param  new_buffers buffers to register
+     *  \return POS_SUCCESS for successfully registered
+     */
+    pos_retval_t register_buffers(std::vector<struct iovec>& new_buffers){
+        if(this->buffers.size() > 0){
+            syscall(__NR_io_uring_register, this->fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            this->buffers.clear();
+        }
+        if(new_buffers.size() == 0){ return POS_SUCCESS; }
+        if(unlikely(syscall(
+            __NR_io_uring_register, this->fd, IORING_REGISTER_BUFFERS, new_buffers.data(), new_buffers.size()
+        ) < 0)){
+            return POS_FAILED;
+        }
+        this->buffers = new_buffers;
+        return POS_SUCCESS;
+    }
+
+    /*!
+     *  \brief  locate the registered buffer that contains the given area
+     *  \param  ptr     pointer to the area
+     *  \param  size    size of the area
+     *  \return index of the registered buffer, -1 for not found
+     */
+    int find_buffer(const void* ptr, uint64_t size){
+        int left = 0, right = static_cast<int>(this->buffers.size()) - 1, mid;
+        const uint8_t *base, *target = reinterpret_cast<const uint8_t*>(ptr);
+
+        // the last buffer whose base is not larger than ptr
+        while(left <= right){
+            mid = (left + right) / 2;
+            if(reinterpret_cast<const uint8_t*>(this->buffers[mid].iov_base) <= target){
+                left = mid + 1;
+            } else {
+                right = mid - 1;
+            }
+        }
+        if(right < 0){ return -1; }
+
+        base = reinterpret_cast<const uint8_t*>(this->buffers[right].iov_base);
+        return (target + size <= base + this->buffers[right].iov_len) ? right : -1;
+    }
+
+    int fd;
+
+    // backend that owns this ring
+    uint64_t owner_id;
+
+    // registered buffers, and version of them
+    std::vector<struct iovec> buffers;
+    uint64_t buffers_version;
+
+    // submission queue
+    uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t *sq_array;
+    uint32_t sq_entries;
+    struct io_uring_sqe *sqes;
+
+    // completion queue
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+
+ private:
+    void *_sq_ptr, *_cq_ptr, *_sqes_ptr;
+    uint64_t _sq_size, _cq_size, _sqes_size;
+};
+
+
+// ring of the current thread
+static thread_local std::unique_ptr<POSCheckpointIOUring> __thread_ring;
+
+
+bool POSCheckpointIOBackend_IoUring::is_supported(){
+    static bool is_supported = [](){
+        POSCheckpointIOUring ring;
+        return ring.setup(/* depth */ 1) == POS_SUCCESS;
+    }();
+    return is_supported;
+}
+
+
+pos_retval_t POSCheckpointIOBackend_IoUring::writev(int fd, const struct iovec* iov, int iovcnt, uint64_t offset){
+    return this->__transfer(fd, iov, iovcnt, offset, /* is_write */ true);
+}
+
+
+pos_retval_t POSCheckpointIOBackend_IoUring::read(int fd, void* buf, uint64_t size, uint64_t offset){
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    return this->__transfer(fd, &iov, 1, offset, /* is_write */ false);
+}
+
+
+pos_retval_t POSCheckpointIOBackend_IoUring::__transfer(int fd, const struct iovec* iov, int iovcnt, uint64_t offset, bool is_write){
+    pos_retval_t retval = POS_SUCCESS;
+    uint64_t i, j, len, nb_inflight = 0, nb_fixed = 0, nb_bytes = 0, to_submit = 0, buffers_version;
+    uint32_t tail, head, index;
+    int64_t nb_transferred;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    std::vector<struct iovec> new_buffers;
+    POSCheckpointIOUring *ring;
+
+    typedef struct request {
+        uint8_t *ptr;
+        uint64_t size;
+        uint64_t offset;
+        int buf_index;
+    } request_t;
+    std::vector<request_t> requests;
+    request_t request;
+
+    // obtain the ring of this thread
+    ring = __thread_ring.get();
+    if(unlikely(ring == nullptr || ring->owner_id != this->_id)){
+        __thread_ring.reset(new POSCheckpointIOUring());
+        POS_CHECK_POINTER(ring = __thread_ring.get());
+        if(unlikely(POS_SUCCESS != ring->setup(this->_options.queue_depth))){
+            POS_WARN_C("failed to setup io_uring: errno(%d)", errno);
+            __thread_ring.reset();
+            retval = POS_FAILED;
+            goto exit;
+        }
+        ring->owner_id = this->_id;
+    }
+
+    // sync registered buffers
+    if(unlikely(ring->buffers_version != this->_buffers_version.load())){
+        buffers_version = this->__get_buffers(new_buffers);
+        if(unlikely(POS_SUCCESS != ring->register_buffers(new_buffers))){
+            POS_WARN_C("failed to register buffers to io_uring, use unregistered buffers: errno(%d)", errno);
+        }
+        ring->buffers_version = buffers_version;
+    }
+
+    // split into requests
+    for(i=0; i<static_cast<uint64_t>(iovcnt); i++){
+        for(j=0; j<iov[i].iov_len; j+=len){
+            len = std::min(iov[i].iov_len - j, this->_options.request_size);
+            request.ptr = reinterpret_cast<uint8_t*>(iov[i].iov_base) + j;
+            request.size = len;
+            request.offset = offset;
+            request.buf_index = ring->find_buffer(request.ptr, len);
+            requests.push_back(request);
+            offset += len;
+            nb_bytes += len;
+        }
+    }
+
+    for(i=0; i<requests.size() || nb_inflight > 0; ){
+        // fill the submission queue
+        tail = *ring->sq_tail;
+        while(i < requests.size() && nb_inflight < ring->sq_entries){
+            index = tail & ring->sq_mask;
+            sqe = &(ring->sqes[index]);
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            if(requests[i].buf_index >= 0){
+                sqe->opcode = is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe->buf_index = requests[i].buf_index;
+                nb_fixed += 1;
+            } else {
+                sqe->opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+            }
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(requests[i].ptr);
+            sqe->len = requests[i].size;
+            sqe->off = requests[i].offset;
+            sqe->user_data = i;
+            ring->sq_array[index] = index;
+            tail++; i++; nb_inflight++; to_submit++;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        // submit and wait for at least one completion
+        if(unlikely(syscall(
+            __NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0
+        ) < 0)){
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY){ to_submit = 0; continue; }
+
+            // the state of the ring is unknown, drop it and let the next call recreate one
+            POS_WARN_C("failed to submit io_uring requests: errno(%d)", errno);
+            __thread_ring.reset();
+            retval = POS_FAILED;
+            goto exit;
+        }
+        to_submit = 0;
+
+        // reap completions
+        head = *ring->cq_head;
+        while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)){
+            cqe = &(ring->cqes[head & ring->cq_mask]);
+            request = requests[cqe->user_data];
+            nb_transferred = cqe->res;
+            if(unlikely(nb_transferred < 0)){
+                POS_WARN_C(
+                    "io_uring request failed: is_write(%d), offset(%lu), size(%lu), errno(%ld)",
+                    is_write, request.offset, request.size, -nb_transferred
+                );
+                retval = POS_FAILED;
+            } else if(unlikely(static_cast<uint64_t>(nb_transferred) < request.size)){
+                // finish short transfer synchronously
+                while(static_cast<uint64_t>(nb_transferred) < request.size){
+                    int64_t nb = is_write
+                        ? pwrite(fd, request.ptr + nb_transferred, request.size - nb_transferred, request.offset + nb_transferred)
+                        : pread(fd, request.ptr + nb_transferred, request.size - nb_transferred, request.offset + nb_transferred);
+                    if(nb < 0 && errno == EINTR){ continue; }
+                    if(unlikely(nb <= 0)){ retval = POS_FAILED; break; }
+                    nb_transferred += nb;
+                }
+            }
+            head++;
+            nb_inflight--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(is_write){ this->_stat.nb_write_bytes += nb_bytes; } else { this->_stat.nb_read_bytes += nb_bytes; }
+        this->_stat.nb_requests += requests.size();
+        this->_stat.nb_fixed_requests += nb_fixed;
+    }
+
+exit:
+    return retval;
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_retention.h"
+#include "pos/include/utils/timer.h"
+
+
+void POSCheckpointRetentionPolicy_KeepLast::apply(std::vector<pos_ckpt_retained_version_t>& versions){
+    std::map<POSCheckpointRetentionTarget*, std::vector<uint64_t>> target_versions;
+    uint64_t i;
+
+    for(i=0; i<versions.size(); i++){ target_versions[versions[i].target].push_back(i); }
+
+    for(auto &pair : target_versions){
+        if(pair.second.size() <= this->_nb_versions){ continue; }
+
+        // newest first
+        std::sort(pair.second.begin(), pair.second.end(), [&versions](uint64_t a, uint64_t b){
+            return versions[a].version > versions[b].version;
+        });
+        for(i=this->_nb_versions; i<pair.second.size(); i++){
+            if(!versions[pair.second[i]].is_latest){ versions[pair.second[i]].is_reclaimed = true; }
+        }
+    }
+}
+
+
+void POSCheckpointRetentionPolicy_KeepByAge::apply(std::vector<pos_ckpt_retained_version_t>& versions){
+    for(pos_ckpt_retained_version_t &version : versions){
+        if(!version.is_latest && version.age_ms > static_cast<double>(this->_max_age_ms)){
+            version.is_reclaimed = true;
+        }
+    }
+}
+
+
+void POSCheckpointRetentionPolicy_MemoryBudget::apply(std::vector<pos_ckpt_retained_version_t>& versions){
+    std::vector<uint64_t> candidates;
+    uint64_t i, retained_bytes = 0;
+
+    for(i=0; i<versions.size(); i++){
+        if(versions[i].is_reclaimed){ continue; }
+        retained_bytes += versions[i].size;
+        if(!versions[i].is_latest){ candidates.push_back(i); }
+    }
+    if(retained_bytes <= this->_budget){ return; }
+
+    // oldest first
+    std::sort(candidates.begin(), candidates.end(), [&versions](uint64_t a, uint64_t b){
+        return versions[a].tick < versions[b].tick;
+    });
+    for(i=0; i<candidates.size() && retained_bytes > this->_budget; i++){
+        versions[candidates[i]].is_reclaimed = true;
+        retained_bytes -= versions[candidates[i]].size;
+    }
+}
+
+
+POSCheckpointRetention* POSCheckpointRetention::get_instance(){
+    static POSCheckpointRetention retention;
+    return &retention;
+}
+
+
+POSCheckpointRetention::~POSCheckpointRetention(){
+    this->stop();
+}
+
+
+void POSCheckpointRetention::add_target(POSCheckpointRetentionTarget* target){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    POS_CHECK_POINTER(target);
+    this->_targets.insert(target);
+    this->_stat.nb_targets = this->_targets.size();
+}
+
+
+void POSCheckpointRetention::remove_target(POSCheckpointRetentionTarget* target){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_targets.erase(target);
+    this->_stat.nb_targets = this->_targets.size();
+}
+
+
+void POSCheckpointRetention::set_policies(std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>> policies){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_policies = std::move(policies);
+}
+
+
+pos_retval_t POSCheckpointRetention::parse(
+    const std::string& desp, std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>>& policies
+){
+    pos_retval_t retval = POS_SUCCESS;
+    std::shared_ptr<POSCheckpointRetentionPolicy> budget_policy;
+    std::string item, key;
+    uint64_t begin = 0, end, colon, value;
+
+    policies.clear();
+    while(begin < desp.size()){
+        if((end = desp.find(',', begin)) == std::string::npos){ end = desp.size(); }
+        item = desp.substr(begin, end - begin);
+        begin = end + 1;
+        if(item.size() == 0){ continue; }
+
+        if(unlikely((colon = item.find(':')) == std::string::npos)){
+            POS_WARN("failed to parse checkpoint retention policy, invalid item %s", item.c_str());
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        key = item.substr(0, colon);
+        try {
+            value = std::stoull(item.substr(colon + 1));
+        } catch (const std::invalid_argument& e) {
+            POS_WARN("failed to parse checkpoint retention policy %s: %s", item.c_str(), e.what());
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        } catch (const std::out_of_range& e) {
+            POS_WARN("failed to parse checkpoint retention policy %s: %s", item.c_str(), e.what());
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+
+        if(key == "last"){
+            if(unlikely(value == 0)){
+                POS_WARN("failed to parse checkpoint retention policy, should keep at least one version");
+                retval = POS_FAILED_INVALID_INPUT;
+                goto exit;
+            }
+            policies.push_back(std::make_shared<POSCheckpointRetentionPolicy_KeepLast>(value));
+        } else if(key == "age_ms"){
+            policies.push_back(std::make_shared<POSCheckpointRetentionPolicy_KeepByAge>(value));
+        } else if(key == "budget"){
+            budget_policy = std::make_shared<POSCheckpointRetentionPolicy_MemoryBudget>(value);
+        } else {
+            POS_WARN("failed to parse checkpoint retention policy, unknown policy %s", key.c_str());
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+    }
+    if(budget_policy != nullptr){ policies.push_back(budget_policy); }
+
+exit:
+    if(unlikely(retval != POS_SUCCESS)){ policies.clear(); }
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointRetention::start(uint64_t interval_ms){
+    pos_retval_t retval = POS_SUCCESS;
+
+    if(unlikely(interval_ms == 0)){
+        POS_WARN_C("failed to start checkpoint retention, zero interval");
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    this->stop();
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        {
+            std::lock_guard<std::mutex> notify_lock(this->_notify_mutex);
+            this->_interval_ms = interval_ms;
+            this->_is_stop = false;
+            this->_is_notified = false;
+        }
+        POS_CHECK_POINTER(this->_thread = new std::thread(&POSCheckpointRetention::__sweep_routine, this));
+    }
+    POS_DEBUG_C("checkpoint retention started: interval(%lu ms)", interval_ms);
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointRetention::stop(){
+    std::thread *thread;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(this->_thread == nullptr){ return; }
+        thread = this->_thread;
+        this->_thread = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> notify_lock(this->_notify_mutex);
+        this->_is_stop = true;
+        this->_cv.notify_all();
+    }
+
+    if(thread->joinable()){ thread->join(); }
+    delete thread;
+}
+
+
+void POSCheckpointRetention::notify(){
+    // only takes _notify_mutex, which isn't held while sweeping
+    std::lock_guard<std::mutex> notify_lock(this->_notify_mutex);
+    this->_is_notified = true;
+    this->_cv.notify_all();
+}
+
+
+pos_retval_t POSCheckpointRetention::sweep(uint64_t now_tick){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->__sweep(now_tick);
+}
+
+
+void POSCheckpointRetention::get_stat(pos_ckpt_retention_stat_t& stat){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    stat = this->_stat;
+}
+
+
+pos_retval_t POSCheckpointRetention::__sweep(uint64_t now_tick){
+    pos_retval_t retval = POS_SUCCESS, tmp_retval;
+    std::vector<pos_ckpt_retained_version_t> versions;
+    std::map<POSCheckpointRetentionTarget*, uint64_t> latest_versions;
+    POSUtilHpetTimer timer;
+    uint64_t i, nb_retained_versions = 0, retained_bytes = 0;
+
+    timer.start();
+    if(now_tick == 0){ now_tick = POSUtilTscTimer::get_tsc(); }
+
+    for(POSCheckpointRetentionTarget *target : this->_targets){
+        target->get_retained_versions(versions);
+    }
+    for(pos_ckpt_retained_version_t &version : versions){
+        if(latest_versions.count(version.target) == 0 || latest_versions[version.target] < version.version){
+            latest_versions[version.target] = version.version;
+        }
+    }
+    for(pos_ckpt_retained_version_t &version : versions){
+        version.is_latest = (latest_versions[version.target] == version.version);
+        version.age_ms = now_tick > version.tick ? this->_tsc_timer.tick_range_to_ms(now_tick, version.tick) : 0;
+        version.is_reclaimed = false;
+    }
+
+    for(std::shared_ptr<POSCheckpointRetentionPolicy> &policy : this->_policies){
+        policy->apply(versions);
+    }
+
+    for(i=0; i<versions.size(); i++){
+        // the latest version is never reclaimed, whatever the policies decide
+        if(versions[i].is_reclaimed && !versions[i].is_latest){
+            tmp_retval = versions[i].target->reclaim_version(versions[i].version);
+            if(likely(tmp_retval == POS_SUCCESS)){
+                this->_stat.nb_reclaimed_versions += 1;
+                this->_stat.reclaimed_bytes += versions[i].size;
+                continue;
+            }
+            // the version might be invalidated by the target itself since collected
+            if(tmp_retval == POS_FAILED_NOT_EXIST){ continue; }
+            // the version is still in use, it stays retained until a later sweep
+            if(tmp_retval == POS_FAILED_NOT_READY){
+                nb_retained_versions += 1;
+                retained_bytes += versions[i].size;
+                continue;
+            }
+            POS_WARN_C("failed to reclaim checkpoint version: version(%lu), retval(%u)", versions[i].version, tmp_retval);
+            if(retval == POS_SUCCESS){ retval = tmp_retval; }
+        }
+        nb_retained_versions += 1;
+        retained_bytes += versions[i].size;
+    }
+
+    this->_stat.nb_retained_versions = nb_retained_versions;
+    this->_stat.retained_bytes = retained_bytes;
+    this->_stat.nb_sweeps += 1;
+    this->_stat.last_sweep_ms = timer.stop_get_ms();
+
+    return retval;
+}
+
+
+void POSCheckpointRetention::__sweep_routine(){
+    std::unique_lock<std::mutex> notify_lock(this->_notify_mutex);
+
+    while(!this->_is_stop){
+        this->_cv.wait_for(notify_lock, std::chrono::milliseconds(this->_interval_ms), [this]{
+            return this->_is_stop || this->_is_notified;
+        });
+        if(unlikely(this->_is_stop)){ break; }
+        this->_is_notified = false;
+
+        // notifications during the sweep are kept in _is_notified, and trigger the next sweep
+        notify_lock.unlock();
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->__sweep(/* now_tick */ 0);
+        }
+        notify_lock.lock();
+    }
+}
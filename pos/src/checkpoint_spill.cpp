@@ -0,0 +1,330 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <condition_variable>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_spill.h"
+#include "pos/include/utils/timer.h"
+
+
+POSCheckpointSpill* POSCheckpointSpill::get_instance(){
+    static POSCheckpointSpill spill;
+    return &spill;
+}
+
+
+POSCheckpointSpill::POSCheckpointSpill()
+    :   _budget(0), _resident_bytes(0), _peak_resident_bytes(0), _spill_dir("/tmp"), _fd(-1), _file_size(0),
+        _file_used_size(0), _nb_spills(0), _spilled_bytes(0), _nb_loads(0), _loaded_bytes(0) {}
+
+
+POSCheckpointSpill::~POSCheckpointSpill(){
+    if(this->_fd >= 0){ close(this->_fd); }
+}
+
+
+void POSCheckpointSpill::add_target(POSCheckpointSpillTarget* target){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    POS_CHECK_POINTER(target);
+    this->_targets.insert(target);
+}
+
+
+void POSCheckpointSpill::remove_target(POSCheckpointSpillTarget* target){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_targets.erase(target);
+}
+
+
+void POSCheckpointSpill::set_budget(uint64_t budget){
+    this->_budget = budget;
+    // a larger budget might unblock waiting admissions
+    this->_cv.notify_all();
+}
+
+
+pos_retval_t POSCheckpointSpill::set_spill_dir(const std::string& dir){
+    pos_retval_t retval = POS_SUCCESS;
+    std::lock_guard<std::mutex> lock(this->_file_mutex);
+
+    if(unlikely(!std::filesystem::is_directory(dir))){
+        POS_WARN_C("failed to set spill directory, no directory exists: dir(%s)", dir.c_str());
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+    if(unlikely(this->_file_used_size > 0)){
+        POS_WARN_C("failed to set spill directory, there're spilled versions in the current spill file");
+        retval = POS_FAILED_ALREADY_EXIST;
+        goto exit;
+    }
+
+    // the new file is created under the new directory on the next spill
+    if(this->_fd >= 0){
+        close(this->_fd);
+        this->_fd = -1;
+    }
+    this->_file_size = 0;
+    this->_free_extents.clear();
+    this->_spill_dir = dir;
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointSpill::admit(uint64_t size){
+    uint64_t budget, resident_bytes;
+    POSUtilHpetTimer timer;
+    bool is_stalled = false;
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    this->_stat.nb_admits += 1;
+
+    while(true){
+        budget = this->_budget;
+        resident_bytes = this->_resident_bytes;
+        if(likely(budget == 0 || resident_bytes + size <= budget)){ break; }
+
+        if(unlikely(!is_stalled)){
+            is_stalled = true;
+            this->_stat.nb_stalls += 1;
+            timer.start();
+        }
+
+        if(this->__relieve(resident_bytes + size - budget) > 0){ continue; }
+
+        // nothing could be released now, wait for committing / persisting to finish, or give up
+        if(timer.stop_get_ms() >= static_cast<double>(admit_timeout_ms)){
+            this->_stat.nb_overcommits += 1;
+            POS_DEBUG_C(
+                "admitted beyond the budget of host checkpoint memory: size(%lu), resident(%lu), budget(%lu)",
+                size, resident_bytes, budget
+            );
+            break;
+        }
+        this->_cv.wait_for(lock, std::chrono::milliseconds(kAdmitRetryMs));
+    }
+
+    if(is_stalled){ this->_stat.stall_ms += timer.stop_get_ms(); }
+}
+
+
+void POSCheckpointSpill::on_allocated(uint64_t size){
+    uint64_t resident_bytes = (this->_resident_bytes += size);
+    uint64_t peak = this->_peak_resident_bytes;
+
+    while(unlikely(resident_bytes > peak) && !this->_peak_resident_bytes.compare_exchange_weak(peak, resident_bytes)){}
+}
+
+
+void POSCheckpointSpill::on_released(uint64_t size){
+    POS_ASSERT(this->_resident_bytes >= size);
+    this->_resident_bytes -= size;
+    this->_cv.notify_all();
+}
+
+
+pos_retval_t POSCheckpointSpill::spill_out(const void* data, uint64_t size, uint64_t* offset){
+    pos_retval_t retval = POS_SUCCESS;
+    uint64_t aligned_size, done = 0;
+    int64_t nb_bytes;
+    typename std::multimap<uint64_t, uint64_t>::iterator extent_iter;
+    std::unique_lock<std::mutex> lock(this->_file_mutex);
+
+    POS_CHECK_POINTER(data);
+    POS_CHECK_POINTER(offset);
+    POS_ASSERT(size > 0);
+
+    if(unlikely(POS_SUCCESS != (retval = this->__open_file()))){ goto exit; }
+
+    // best-fit free room, or append to the file
+    aligned_size = (size + kSpillAlignment - 1) / kSpillAlignment * kSpillAlignment;
+    if((extent_iter = this->_free_extents.lower_bound(aligned_size)) != this->_free_extents.end()){
+        *offset = extent_iter->second;
+        if(extent_iter->first > aligned_size){
+            this->_free_extents.insert({ extent_iter->first - aligned_size, *offset + aligned_size });
+        }
+        this->_free_extents.erase(extent_iter);
+    } else {
+        *offset = this->_file_size;
+        this->_file_size += aligned_size;
+    }
+    this->_file_used_size += aligned_size;
+
+    // the room is owned by the caller now, write without holding the lock
+    lock.unlock();
+    while(done < size){
+        nb_bytes = pwrite(this->_fd, reinterpret_cast<const uint8_t*>(data) + done, size - done, *offset + done);
+        if(unlikely(nb_bytes <= 0)){
+            if(nb_bytes < 0 && errno == EINTR){ continue; }
+            POS_WARN_C("failed to write spill file: offset(%lu), size(%lu), errno(%d)", *offset, size, errno);
+            this->spill_discard(*offset, size);
+            retval = POS_FAILED;
+            goto exit;
+        }
+        done += nb_bytes;
+    }
+
+    lock.lock();
+    this->_nb_spills += 1;
+    this->_spilled_bytes += size;
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointSpill::spill_in(uint64_t offset, void* data, uint64_t size){
+    pos_retval_t retval = POS_SUCCESS;
+    uint64_t done = 0;
+    int64_t nb_bytes;
+
+    POS_CHECK_POINTER(data);
+    POS_ASSERT(this->_fd >= 0);
+
+    while(done < size){
+        nb_bytes = pread(this->_fd, reinterpret_cast<uint8_t*>(data) + done, size - done, offset + done);
+        if(unlikely(nb_bytes <= 0)){
+            if(nb_bytes < 0 && errno == EINTR){ continue; }
+            POS_WARN_C("failed to read spill file: offset(%lu), size(%lu), errno(%d)", offset, size, errno);
+            retval = POS_FAILED;
+            goto exit;
+        }
+        done += nb_bytes;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_file_mutex);
+        this->_nb_loads += 1;
+        this->_loaded_bytes += size;
+    }
+    this->spill_discard(offset, size);
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointSpill::spill_discard(uint64_t offset, uint64_t size){
+    uint64_t aligned_size = (size + kSpillAlignment - 1) / kSpillAlignment * kSpillAlignment;
+    std::lock_guard<std::mutex> lock(this->_file_mutex);
+
+    POS_ASSERT(this->_file_used_size >= aligned_size);
+    this->_file_used_size -= aligned_size;
+
+    /*!
+     *  \note   the room isn't coalesced with its neighbours, as slots of a handle come in the same size
+     *          every round; the whole file is dropped once nothing is spilled
+     */
+    if(this->_file_used_size == 0){
+        this->_free_extents.clear();
+        this->_file_size = 0;
+        if(unlikely(ftruncate(this->_fd, 0) != 0)){
+            POS_WARN_C("failed to truncate spill file: errno(%d)", errno);
+        }
+    } else {
+        this->_free_extents.insert({ aligned_size, offset });
+    }
+}
+
+
+void POSCheckpointSpill::get_stat(pos_ckpt_spill_stat_t& stat){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    std::lock_guard<std::mutex> file_lock(this->_file_mutex);
+
+    stat = this->_stat;
+    stat.budget = this->_budget;
+    stat.resident_bytes = this->_resident_bytes;
+    stat.peak_resident_bytes = this->_peak_resident_bytes;
+    stat.file_size = this->_file_size;
+    stat.file_used_size = this->_file_used_size;
+    stat.nb_spills = this->_nb_spills;
+    stat.spilled_bytes = this->_spilled_bytes;
+    stat.nb_loads = this->_nb_loads;
+    stat.loaded_bytes = this->_loaded_bytes;
+}
+
+
+uint64_t POSCheckpointSpill::__relieve(uint64_t size){
+    uint64_t i, released = 0, trimmed;
+    std::vector<pos_ckpt_spill_candidate_t> candidates;
+
+    // cached slots hold no state, release them first
+    for(POSCheckpointSpillTarget *target : this->_targets){
+        trimmed = target->trim_cached();
+        released += trimmed;
+        this->_stat.trimmed_bytes += trimmed;
+        if(released >= size){ goto exit; }
+    }
+
+    // then spill the oldest committed versions
+    for(POSCheckpointSpillTarget *target : this->_targets){
+        target->get_spill_candidates(candidates);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const pos_ckpt_spill_candidate_t& a, const pos_ckpt_spill_candidate_t& b){
+        return a.tick < b.tick;
+    });
+    for(i=0; i<candidates.size() && released < size; i++){
+        // the version might be accessed or invalidated since collected
+        if(likely(POS_SUCCESS == candidates[i].target->spill_version(candidates[i].version))){
+            released += candidates[i].size;
+        }
+    }
+
+exit:
+    return released;
+}
+
+
+pos_retval_t POSCheckpointSpill::__open_file(){
+    pos_retval_t retval = POS_SUCCESS;
+    std::string path;
+
+    if(likely(this->_fd >= 0)){ goto exit; }
+
+    path = this->_spill_dir + std::string("/pos_ckpt_spill_XXXXXX");
+    if(unlikely((this->_fd = mkstemp(path.data())) < 0)){
+        POS_WARN_C("failed to create spill file: path(%s), errno(%d)", path.c_str(), errno);
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+    // no one else opens the file, and it's reclaimed by the OS once we exit
+    unlink(path.c_str());
+    POS_DEBUG_C("created spill file of host checkpoint memory under %s", this->_spill_dir.c_str());
+
+exit:
+    return retval;
+}
@@ -0,0 +1,989 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/un.h>
+
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/checkpoint_storage.h"
+#include "pos/include/persist_executor.h"
+
+
+/* ========================== common ========================== */
+// storages opened so far: URI -> storage
+static std::map<std::string, std::shared_ptr<POSCheckpointStorage>> __ckpt_storages;
+static std::mutex __ckpt_storages_mutex;
+
+// index of the next upload of memory / local backends
+static std::atomic<uint64_t> __ckpt_storage_nb_uploads(0);
+
+
+static pos_retval_t __pwrite_all(int fd, const void* data, uint64_t size, uint64_t offset){
+    const uint8_t *ptr = reinterpret_cast<const uint8_t*>(data);
+    int64_t nb_bytes;
+
+    while(size > 0){
+        nb_bytes = pwrite(fd, ptr, size, offset);
+        if(unlikely(nb_bytes <= 0)){
+            if(nb_bytes < 0 && errno == EINTR){ continue; }
+            return POS_FAILED;
+        }
+        ptr += nb_bytes;
+        offset += nb_bytes;
+        size -= nb_bytes;
+    }
+    return POS_SUCCESS;
+}
+
+
+static pos_retval_t __pread_all(int fd, void* dst, uint64_t size, uint64_t offset){
+    uint8_t *ptr = reinterpret_cast<uint8_t*>(dst);
+    int64_t nb_bytes;
+
+    while(size > 0){
+        nb_bytes = pread(fd, ptr, size, offset);
+        if(unlikely(nb_bytes <= 0)){
+            if(nb_bytes < 0 && errno == EINTR){ continue; }
+            return POS_FAILED;
+        }
+        ptr += nb_bytes;
+        offset += nb_bytes;
+        size -= nb_bytes;
+    }
+    return POS_SUCCESS;
+}
+
+
+static pos_retval_t __send_all(int fd, const void* data, uint64_t size){
+    const uint8_t *ptr = reinterpret_cast<const uint8_t*>(data);
+    int64_t nb_bytes;
+
+    while(size > 0){
+        nb_bytes = send(fd, ptr, size, MSG_NOSIGNAL);
+        if(unlikely(nb_bytes <= 0)){
+            if(nb_bytes < 0 && errno == EINTR){ continue; }
+            return POS_FAILED;
+        }
+        ptr += nb_bytes;
+        size -= nb_bytes;
+    }
+    return POS_SUCCESS;
+}
+
+
+static pos_retval_t __recv_all(int fd, void* dst, uint64_t size){
+    uint8_t *ptr = reinterpret_cast<uint8_t*>(dst);
+    int64_t nb_bytes;
+
+    while(size > 0){
+        nb_bytes = recv(fd, ptr, size, MSG_WAITALL);
+        if(unlikely(nb_bytes <= 0)){
+            if(nb_bytes < 0 && errno == EINTR){ continue; }
+            return POS_FAILED;
+        }
+        ptr += nb_bytes;
+        size -= nb_bytes;
+    }
+    return POS_SUCCESS;
+}
+
+
+pos_retval_t POSCheckpointStorage::open(const std::string& uri, std::shared_ptr<POSCheckpointStorage>& storage){
+    pos_retval_t retval = POS_SUCCESS;
+    std::string scheme, location;
+    uint64_t pos;
+    std::lock_guard<std::mutex> lock(__ckpt_storages_mutex);
+
+    if(likely(__ckpt_storages.count(uri) > 0)){
+        storage = __ckpt_storages[uri];
+        goto exit;
+    }
+
+    if((pos = uri.find("://")) == std::string::npos){
+        scheme = "file";
+        location = uri;
+    } else {
+        scheme = uri.substr(0, pos);
+        location = uri.substr(pos + 3);
+    }
+    while(location.size() > 1 && location.back() == '/'){ location.pop_back(); }
+    if(unlikely(location.size() == 0)){
+        POS_WARN("failed to open checkpoint storage, empty location: uri(%s)", uri.c_str());
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    if(scheme == "mem"){
+        storage = std::make_shared<POSCheckpointStorage_Memory>(uri, location);
+    } else if(scheme == "file"){
+        storage = std::make_shared<POSCheckpointStorage_Local>(uri, location);
+    } else if(scheme == "obj"){
+        storage = std::make_shared<POSCheckpointStorage_Object>(uri, location);
+    } else {
+        POS_WARN("failed to open checkpoint storage, unknown scheme: uri(%s)", uri.c_str());
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+    POS_CHECK_POINTER(storage.get());
+    __ckpt_storages[uri] = storage;
+
+exit:
+    return retval;
+}
+
+
+bool POSCheckpointStorage::exists(const std::string& uri){
+    std::shared_ptr<POSCheckpointStorage> storage;
+    if(unlikely(POS_SUCCESS != POSCheckpointStorage::open(uri, storage))){ return false; }
+    return storage->exists();
+}
+
+
+pos_retval_t POSCheckpointStorage::put(const std::string& name, const void* data, uint64_t size){
+    pos_retval_t retval = POS_SUCCESS;
+    uint64_t upload_id, nb_parts, part_size = POSCheckpointStorage::part_size;
+
+    POS_ASSERT(part_size > 0);
+    if(unlikely(POS_SUCCESS != (retval = this->begin_upload(name, &upload_id)))){
+        POS_WARN_C("failed to start uploading checkpoint object: uri(%s), name(%s)", this->_uri.c_str(), name.c_str());
+        goto exit;
+    }
+
+    nb_parts = (size + part_size - 1) / part_size;
+    retval = POSPersistExecutor::get_instance()->parallel_for(nb_parts, [&](uint64_t i) -> pos_retval_t {
+        uint64_t offset = i * part_size;
+        return this->upload_part(
+            upload_id, offset, reinterpret_cast<const uint8_t*>(data) + offset, std::min(part_size, size - offset)
+        );
+    });
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to upload checkpoint object: uri(%s), name(%s)", this->_uri.c_str(), name.c_str());
+        this->abort_upload(upload_id);
+        goto exit;
+    }
+
+    if(unlikely(POS_SUCCESS != (retval = this->complete_upload(upload_id)))){
+        POS_WARN_C("failed to complete uploading checkpoint object: uri(%s), name(%s)", this->_uri.c_str(), name.c_str());
+    }
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointStorage::get(const std::string& name, void* dst, uint64_t size){
+    uint64_t nb_parts, part_size = POSCheckpointStorage::part_size;
+
+    POS_ASSERT(part_size > 0);
+    nb_parts = (size + part_size - 1) / part_size;
+    return POSPersistExecutor::get_instance()->parallel_for(nb_parts, [&](uint64_t i) -> pos_retval_t {
+        uint64_t offset = i * part_size;
+        return this->read_range(name, offset, reinterpret_cast<uint8_t*>(dst) + offset, std::min(part_size, size - offset));
+    });
+}
+
+
+/* ========================== memory backend ========================== */
+// memfd of in-memory objects: <location>/<name> -> file descriptor
+static std::map<std::string, int> __ckpt_mem_objects;
+
+// prepared locations
+static std::set<std::string> __ckpt_mem_locations;
+
+static std::mutex __ckpt_mem_mutex;
+
+
+pos_retval_t POSCheckpointStorage_Memory::prepare(){
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    std::string prefix = this->_location + "/";
+    typename std::map<std::string, int>::iterator iter;
+
+    iter = __ckpt_mem_objects.lower_bound(prefix);
+    while(iter != __ckpt_mem_objects.end() && iter->first.compare(0, prefix.size(), prefix) == 0){
+        close(iter->second);
+        iter = __ckpt_mem_objects.erase(iter);
+    }
+    __ckpt_mem_locations.insert(this->_location);
+
+    return POS_SUCCESS;
+}
+
+
+bool POSCheckpointStorage_Memory::exists(){
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    return __ckpt_mem_locations.count(this->_location) > 0;
+}
+
+
+pos_retval_t POSCheckpointStorage_Memory::begin_upload(const std::string& name, uint64_t* upload_id){
+    int fd;
+
+    POS_CHECK_POINTER(upload_id);
+    if(unlikely((fd = memfd_create(name.c_str(), MFD_CLOEXEC)) < 0)){
+        POS_WARN_C("failed to create memfd: name(%s), errno(%d)", name.c_str(), errno);
+        return POS_FAILED;
+    }
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    *upload_id = __ckpt_storage_nb_uploads.fetch_add(1) + 1;
+    this->_uploads[*upload_id] = std::make_pair(name, fd);
+
+    return POS_SUCCESS;
+}
+
+
+pos_retval_t POSCheckpointStorage_Memory::upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size){
+    int fd;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(unlikely(this->_uploads.count(upload_id) == 0)){ return POS_FAILED_NOT_EXIST; }
+        fd = this->_uploads[upload_id].second;
+    }
+
+    // the memfd isn't closed until the upload completes or aborts, which happens after all parts
+    return __pwrite_all(fd, data, size, offset);
+}
+
+
+pos_retval_t POSCheckpointStorage_Memory::complete_upload(uint64_t upload_id){
+    std::pair<std::string, int> upload;
+    std::string key;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(unlikely(this->_uploads.count(upload_id) == 0)){ return POS_FAILED_NOT_EXIST; }
+        upload = this->_uploads[upload_id];
+        this->_uploads.erase(upload_id);
+    }
+
+    key = this->_location + "/" + upload.first;
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    if(__ckpt_mem_objects.count(key) > 0){ close(__ckpt_mem_objects[key]); }
+    __ckpt_mem_objects[key] = upload.second;
+
+    return POS_SUCCESS;
+}
+
+
+void POSCheckpointStorage_Memory::abort_upload(uint64_t upload_id){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if(this->_uploads.count(upload_id) == 0){ return; }
+    close(this->_uploads[upload_id].second);
+    this->_uploads.erase(upload_id);
+}
+
+
+pos_retval_t POSCheckpointStorage_Memory::get_size(const std::string& name, uint64_t* size){
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    std::string key = this->_location + "/" + name;
+    struct stat sb;
+
+    POS_CHECK_POINTER(size);
+    if(unlikely(__ckpt_mem_objects.count(key) == 0)){ return POS_FAILED_NOT_EXIST; }
+    if(unlikely(fstat(__ckpt_mem_objects[key], &sb) != 0)){ return POS_FAILED; }
+    *size = sb.st_size;
+
+    return POS_SUCCESS;
+}
+
+
+pos_retval_t POSCheckpointStorage_Memory::read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size){
+    pos_retval_t retval;
+    int fd;
+
+    if(unlikely((fd = this->__dup_fd(name)) < 0)){ return POS_FAILED_NOT_EXIST; }
+    retval = __pread_all(fd, dst, size, offset);
+    close(fd);
+
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Memory::remove(const std::string& name){
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    std::string key = this->_location + "/" + name;
+
+    if(unlikely(__ckpt_mem_objects.count(key) == 0)){ return POS_FAILED_NOT_EXIST; }
+    close(__ckpt_mem_objects[key]);
+    __ckpt_mem_objects.erase(key);
+
+    return POS_SUCCESS;
+}
+
+
+int POSCheckpointStorage_Memory::open_fd(const std::string& name, bool is_write){
+    std::string key = this->_location + "/" + name;
+    int fd;
+
+    if(!is_write){ return this->__dup_fd(name); }
+
+    if(unlikely((fd = memfd_create(name.c_str(), MFD_CLOEXEC)) < 0)){
+        POS_WARN_C("failed to create memfd: name(%s), errno(%d)", name.c_str(), errno);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    if(__ckpt_mem_objects.count(key) > 0){ close(__ckpt_mem_objects[key]); }
+    __ckpt_mem_objects[key] = fd;
+
+    return dup(fd);
+}
+
+
+int POSCheckpointStorage_Memory::__dup_fd(const std::string& name){
+    std::lock_guard<std::mutex> lock(__ckpt_mem_mutex);
+    std::string key = this->_location + "/" + name;
+
+    if(unlikely(__ckpt_mem_objects.count(key) == 0)){ return -1; }
+    return fcntl(__ckpt_mem_objects[key], F_DUPFD_CLOEXEC, 0);
+}
+
+
+/* ========================== local backend ========================== */
+pos_retval_t POSCheckpointStorage_Local::prepare(){
+    pos_retval_t retval = POS_SUCCESS;
+
+    try {
+        if(std::filesystem::exists(this->_dir)){ std::filesystem::remove_all(this->_dir); }
+        std::filesystem::create_directories(this->_dir);
+    } catch (const std::filesystem::filesystem_error& e) {
+        POS_WARN_C("failed to prepare checkpoint directory: dir(%s), %s", this->_dir.c_str(), e.what());
+        retval = POS_FAILED;
+    }
+
+    return retval;
+}
+
+
+bool POSCheckpointStorage_Local::exists(){
+    return std::filesystem::is_directory(this->_dir);
+}
+
+
+pos_retval_t POSCheckpointStorage_Local::begin_upload(const std::string& name, uint64_t* upload_id){
+    pos_ckpt_storage_upload_t upload;
+
+    POS_CHECK_POINTER(upload_id);
+    *upload_id = __ckpt_storage_nb_uploads.fetch_add(1) + 1;
+    upload.name = name;
+    upload.tmp_path = this->get_local_path(name) + ".upload-" + std::to_string(*upload_id);
+    if(unlikely((upload.fd = ::open(upload.tmp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644)) < 0)){
+        POS_WARN_C("failed to create file to upload: path(%s), errno(%d)", upload.tmp_path.c_str(), errno);
+        return POS_FAILED;
+    }
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_uploads[*upload_id] = upload;
+
+    return POS_SUCCESS;
+}
+
+
+pos_retval_t POSCheckpointStorage_Local::upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size){
+    int fd;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(unlikely(this->_uploads.count(upload_id) == 0)){ return POS_FAILED_NOT_EXIST; }
+        fd = this->_uploads[upload_id].fd;
+    }
+
+    return __pwrite_all(fd, data, size, offset);
+}
+
+
+pos_retval_t POSCheckpointStorage_Local::complete_upload(uint64_t upload_id){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_storage_upload_t upload;
+    std::string path;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(unlikely(this->_uploads.count(upload_id) == 0)){ return POS_FAILED_NOT_EXIST; }
+        upload = this->_uploads[upload_id];
+        this->_uploads.erase(upload_id);
+    }
+
+    path = this->get_local_path(upload.name);
+    if(unlikely(fsync(upload.fd) != 0 || rename(upload.tmp_path.c_str(), path.c_str()) != 0)){
+        POS_WARN_C("failed to complete uploading file: path(%s), errno(%d)", path.c_str(), errno);
+        unlink(upload.tmp_path.c_str());
+        retval = POS_FAILED;
+    }
+    close(upload.fd);
+
+    return retval;
+}
+
+
+void POSCheckpointStorage_Local::abort_upload(uint64_t upload_id){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if(this->_uploads.count(upload_id) == 0){ return; }
+    close(this->_uploads[upload_id].fd);
+    unlink(this->_uploads[upload_id].tmp_path.c_str());
+    this->_uploads.erase(upload_id);
+}
+
+
+pos_retval_t POSCheckpointStorage_Local::get_size(const std::string& name, uint64_t* size){
+    struct stat sb;
+
+    POS_CHECK_POINTER(size);
+    if(unlikely(stat(this->get_local_path(name).c_str(), &sb) != 0)){
+        return errno == ENOENT ? POS_FAILED_NOT_EXIST : POS_FAILED;
+    }
+    *size = sb.st_size;
+
+    return POS_SUCCESS;
+}
+
+
+pos_retval_t POSCheckpointStorage_Local::read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size){
+    pos_retval_t retval;
+    int fd;
+
+    if(unlikely((fd = ::open(this->get_local_path(name).c_str(), O_RDONLY | O_CLOEXEC)) < 0)){
+        return errno == ENOENT ? POS_FAILED_NOT_EXIST : POS_FAILED;
+    }
+    retval = __pread_all(fd, dst, size, offset);
+    close(fd);
+
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Local::remove(const std::string& name){
+    if(unlikely(unlink(this->get_local_path(name).c_str()) != 0)){
+        return errno == ENOENT ? POS_FAILED_NOT_EXIST : POS_FAILED;
+    }
+    return POS_SUCCESS;
+}
+
+
+int POSCheckpointStorage_Local::open_fd(const std::string& name, bool is_write){
+    return is_write
+        ? ::open(this->get_local_path(name).c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644)
+        : ::open(this->get_local_path(name).c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+
+/* ========================== object backend ========================== */
+POSCheckpointStorage_Object::~POSCheckpointStorage_Object(){
+    for(int fd : this->_conns){ close(fd); }
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::prepare(){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    retval = this->__request(kPOS_CkptObjOp_Prepare, this->_prefix, 0, 0, 0, nullptr, nullptr, response);
+    if(likely(retval == POS_SUCCESS)){ retval = static_cast<pos_retval_t>(response.retval); }
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to prepare checkpoint objects: uri(%s), retval(%d)", this->_uri.c_str(), retval);
+        goto exit;
+    }
+    this->_is_prepared = true;
+
+exit:
+    return retval;
+}
+
+
+bool POSCheckpointStorage_Object::exists(){
+    pos_ckpt_obj_msg_t response;
+
+    if(this->_is_prepared){ return true; }
+    if(unlikely(POS_SUCCESS != this->__request(kPOS_CkptObjOp_Exists, this->_prefix, 0, 0, 0, nullptr, nullptr, response))){
+        return false;
+    }
+    return response.retval == POS_SUCCESS;
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::begin_upload(const std::string& name, uint64_t* upload_id){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    POS_CHECK_POINTER(upload_id);
+    retval = this->__request(kPOS_CkptObjOp_BeginUpload, this->__key(name), 0, 0, 0, nullptr, nullptr, response);
+    if(likely(retval == POS_SUCCESS)){
+        retval = static_cast<pos_retval_t>(response.retval);
+        *upload_id = response.upload_id;
+    }
+
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::upload_part(uint64_t upload_id, uint64_t offset, const void* data, uint64_t size){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    retval = this->__request(kPOS_CkptObjOp_UploadPart, "", upload_id, offset, size, data, nullptr, response);
+    return retval == POS_SUCCESS ? static_cast<pos_retval_t>(response.retval) : retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::complete_upload(uint64_t upload_id){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    retval = this->__request(kPOS_CkptObjOp_CompleteUpload, "", upload_id, 0, 0, nullptr, nullptr, response);
+    return retval == POS_SUCCESS ? static_cast<pos_retval_t>(response.retval) : retval;
+}
+
+
+void POSCheckpointStorage_Object::abort_upload(uint64_t upload_id){
+    pos_ckpt_obj_msg_t response;
+    this->__request(kPOS_CkptObjOp_AbortUpload, "", upload_id, 0, 0, nullptr, nullptr, response);
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::get_size(const std::string& name, uint64_t* size){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    POS_CHECK_POINTER(size);
+    retval = this->__request(kPOS_CkptObjOp_GetSize, this->__key(name), 0, 0, 0, nullptr, nullptr, response);
+    if(likely(retval == POS_SUCCESS)){
+        retval = static_cast<pos_retval_t>(response.retval);
+        *size = response.size;
+    }
+
+    return retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::read_range(const std::string& name, uint64_t offset, void* dst, uint64_t size){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    POS_CHECK_POINTER(dst);
+    retval = this->__request(kPOS_CkptObjOp_GetRange, this->__key(name), 0, offset, size, nullptr, dst, response);
+    return retval == POS_SUCCESS ? static_cast<pos_retval_t>(response.retval) : retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::remove(const std::string& name){
+    pos_retval_t retval;
+    pos_ckpt_obj_msg_t response;
+
+    retval = this->__request(kPOS_CkptObjOp_Remove, this->__key(name), 0, 0, 0, nullptr, nullptr, response);
+    return retval == POS_SUCCESS ? static_cast<pos_retval_t>(response.retval) : retval;
+}
+
+
+pos_retval_t POSCheckpointStorage_Object::__request(
+    pos_ckpt_obj_op_t op, const std::string& key, uint64_t upload_id, uint64_t offset, uint64_t size,
+    const void* payload, void* dst, pos_ckpt_obj_msg_t& response
+){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_obj_msg_t request;
+    struct sockaddr_un addr;
+    std::string endpoint;
+    int fd = -1;
+
+    // take an idle connection, or connect a new one
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(this->_conns.size() > 0){
+            fd = this->_conns.back();
+            this->_conns.pop_back();
+        }
+    }
+    if(fd < 0){
+        endpoint = POSCheckpointStorage_Object::endpoint;
+        memset(&addr, 0, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        if(unlikely(endpoint.size() >= sizeof(addr.sun_path))){
+            POS_WARN_C("failed to connect to object store, endpoint is too long: endpoint(%s)", endpoint.c_str());
+            retval = POS_FAILED;
+            goto exit;
+        }
+        memcpy(addr.sun_path, endpoint.c_str(), endpoint.size());
+        if(unlikely(
+                (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+            ||  connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(struct sockaddr_un)) != 0
+        )){
+            POS_WARN_C("failed to connect to object store: endpoint(%s), errno(%d)", endpoint.c_str(), errno);
+            retval = POS_FAILED;
+            goto exit;
+        }
+    }
+
+    memset(&request, 0, sizeof(pos_ckpt_obj_msg_t));
+    request.op = op;
+    request.upload_id = upload_id;
+    request.offset = offset;
+    request.size = size;
+    request.key_size = key.size();
+
+    if(unlikely(
+            POS_SUCCESS != __send_all(fd, &request, sizeof(pos_ckpt_obj_msg_t))
+        ||  POS_SUCCESS != __send_all(fd, key.c_str(), key.size())
+        ||  (payload != nullptr && POS_SUCCESS != __send_all(fd, payload, size))
+        ||  POS_SUCCESS != __recv_all(fd, &response, sizeof(pos_ckpt_obj_msg_t))
+    )){
+        POS_WARN_C("failed to communicate with object store: op(%u), errno(%d)", op, errno);
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+    // the range is received straight into the destination
+    if(dst != nullptr && response.retval == POS_SUCCESS){
+        if(unlikely(response.size != size || POS_SUCCESS != __recv_all(fd, dst, size))){
+            POS_WARN_C("failed to receive range from object store: key(%s), errno(%d)", key.c_str(), errno);
+            retval = POS_FAILED;
+            goto exit;
+        }
+    }
+
+exit:
+    if(fd >= 0){
+        if(likely(retval == POS_SUCCESS)){
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_conns.push_back(fd);
+        } else {
+            // the state of the connection is unknown
+            close(fd);
+        }
+    }
+    return retval;
+}
+
+
+/* ========================== object store stand-in ========================== */
+pos_retval_t POSCheckpointObjectServer::start(const std::string& endpoint, const std::string& root){
+    pos_retval_t retval = POS_SUCCESS;
+    struct sockaddr_un addr;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    if(unlikely(this->_listen_fd >= 0)){
+        retval = POS_FAILED_ALREADY_EXIST;
+        goto exit;
+    }
+
+    try {
+        std::filesystem::create_directories(root + "/.uploads");
+    } catch (const std::filesystem::filesystem_error& e) {
+        POS_WARN_C("failed to create root directory of object store: root(%s), %s", root.c_str(), e.what());
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    if(unlikely(endpoint.size() >= sizeof(addr.sun_path))){
+        POS_WARN_C("failed to start object store, endpoint is too long: endpoint(%s)", endpoint.c_str());
+        retval = POS_FAILED;
+        goto exit;
+    }
+    memcpy(addr.sun_path, endpoint.c_str(), endpoint.size());
+
+    unlink(endpoint.c_str());
+    if(unlikely(
+            (this->_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+        ||  bind(this->_listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(struct sockaddr_un)) != 0
+        ||  listen(this->_listen_fd, 128) != 0
+    )){
+        POS_WARN_C("failed to listen on endpoint of object store: endpoint(%s), errno(%d)", endpoint.c_str(), errno);
+        if(this->_listen_fd >= 0){ close(this->_listen_fd); }
+        this->_listen_fd = -1;
+        retval = POS_FAILED;
+        goto exit;
+    }
+
+    this->_endpoint = endpoint;
+    this->_root = root;
+    this->_is_stop = false;
+    this->_accept_thread = std::thread(&POSCheckpointObjectServer::__accept_routine, this);
+    POS_DEBUG_C("object store started: endpoint(%s), root(%s)", endpoint.c_str(), root.c_str());
+
+exit:
+    return retval;
+}
+
+
+void POSCheckpointObjectServer::stop(){
+    std::vector<std::thread> serve_threads;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(this->_listen_fd < 0){ return; }
+        this->_is_stop = true;
+        shutdown(this->_listen_fd, SHUT_RDWR);
+    }
+    if(this->_accept_thread.joinable()){ this->_accept_thread.join(); }
+
+    // serving threads exit once their connections are shut down
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        for(int fd : this->_conns){ shutdown(fd, SHUT_RDWR); }
+        serve_threads.swap(this->_serve_threads);
+    }
+    for(std::thread &thread : serve_threads){ if(thread.joinable()){ thread.join(); } }
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    for(auto &pair : this->_uploads){
+        close(pair.second.second);
+        unlink((this->_root + "/.uploads/" + std::to_string(pair.first)).c_str());
+    }
+    this->_uploads.clear();
+    close(this->_listen_fd);
+    this->_listen_fd = -1;
+    unlink(this->_endpoint.c_str());
+}
+
+
+void POSCheckpointObjectServer::__accept_routine(){
+    int fd;
+
+    while(true){
+        fd = accept4(this->_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(unlikely(this->_is_stop)){
+            if(fd >= 0){ close(fd); }
+            break;
+        }
+        if(unlikely(fd < 0)){
+            if(errno == EINTR || errno == ECONNABORTED){ continue; }
+            POS_WARN_C("failed to accept connection of object store: errno(%d)", errno);
+            break;
+        }
+        this->_conns.push_back(fd);
+        this->_serve_threads.emplace_back(&POSCheckpointObjectServer::__serve_routine, this, fd);
+    }
+}
+
+
+void POSCheckpointObjectServer::__serve_routine(int fd){
+    pos_ckpt_obj_msg_t request;
+    std::string key;
+    std::vector<uint8_t> buf;
+
+    while(true){
+        if(POS_SUCCESS != __recv_all(fd, &request, sizeof(pos_ckpt_obj_msg_t))){ break; }
+        if(unlikely(request.key_size > kMaxKeySize)){
+            POS_WARN_C("drop connection of object store, key is too long: size(%u)", request.key_size);
+            break;
+        }
+        key.resize(request.key_size);
+        if(POS_SUCCESS != __recv_all(fd, key.data(), request.key_size)){ break; }
+        if(POS_SUCCESS != this->__serve(fd, request, key, buf)){ break; }
+    }
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_conns.erase(std::find(this->_conns.begin(), this->_conns.end(), fd));
+    close(fd);
+}
+
+
+pos_retval_t POSCheckpointObjectServer::__serve(int fd, const pos_ckpt_obj_msg_t& request, const std::string& key, std::vector<uint8_t>& buf){
+    pos_retval_t retval = POS_SUCCESS;
+    pos_ckpt_obj_msg_t response;
+    std::pair<std::string, int> upload;
+    std::string path = this->_root + "/" + key, staged_path;
+    struct stat sb;
+    int file_fd;
+    off_t file_offset;
+    int64_t nb_bytes;
+    uint64_t left;
+    bool has_key = request.op != kPOS_CkptObjOp_UploadPart && request.op != kPOS_CkptObjOp_CompleteUpload
+                && request.op != kPOS_CkptObjOp_AbortUpload;
+
+    memset(&response, 0, sizeof(pos_ckpt_obj_msg_t));
+    response.op = request.op;
+    response.retval = POS_SUCCESS;
+
+    // the part is received anyway, so that the connection stays in sync
+    if(request.op == kPOS_CkptObjOp_UploadPart){
+        if(buf.size() < request.size){ buf.resize(request.size); }
+        if(unlikely(POS_SUCCESS != __recv_all(fd, buf.data(), request.size))){ return POS_FAILED; }
+    }
+
+    if(unlikely(has_key && !__is_valid_key(key))){
+        response.retval = POS_FAILED_INVALID_INPUT;
+        goto response;
+    }
+
+    switch(request.op){
+    case kPOS_CkptObjOp_Prepare:
+        try {
+            if(std::filesystem::exists(path)){ std::filesystem::remove_all(path); }
+            std::filesystem::create_directories(path);
+        } catch (const std::filesystem::filesystem_error& e) {
+            POS_WARN_C("failed to prepare objects: key(%s), %s", key.c_str(), e.what());
+            response.retval = POS_FAILED;
+        }
+        break;
+
+    case kPOS_CkptObjOp_Exists:
+        response.retval = std::filesystem::is_directory(path) ? POS_SUCCESS : POS_FAILED_NOT_EXIST;
+        break;
+
+    case kPOS_CkptObjOp_BeginUpload:
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            response.upload_id = ++this->_nb_uploads;
+            staged_path = this->_root + "/.uploads/" + std::to_string(response.upload_id);
+            if(unlikely((file_fd = ::open(staged_path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644)) < 0)){
+                POS_WARN_C("failed to stage object: key(%s), errno(%d)", key.c_str(), errno);
+                response.retval = POS_FAILED;
+                break;
+            }
+            this->_uploads[response.upload_id] = std::make_pair(key, file_fd);
+        }
+        break;
+
+    case kPOS_CkptObjOp_UploadPart:
+        // the staged object might be completed or aborted meanwhile, write through a duplicate
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if(unlikely(this->_uploads.count(request.upload_id) == 0)){
+                response.retval = POS_FAILED_NOT_EXIST;
+                break;
+            }
+            file_fd = fcntl(this->_uploads[request.upload_id].second, F_DUPFD_CLOEXEC, 0);
+        }
+        if(unlikely(file_fd < 0 || POS_SUCCESS != __pwrite_all(file_fd, buf.data(), request.size, request.offset))){
+            POS_WARN_C("failed to write part of object: upload_id(%lu), errno(%d)", request.upload_id, errno);
+            response.retval = POS_FAILED;
+        }
+        if(file_fd >= 0){ close(file_fd); }
+        break;
+
+    case kPOS_CkptObjOp_CompleteUpload:
+    case kPOS_CkptObjOp_AbortUpload:
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if(unlikely(this->_uploads.count(request.upload_id) == 0)){
+                response.retval = POS_FAILED_NOT_EXIST;
+                break;
+            }
+            upload = this->_uploads[request.upload_id];
+            this->_uploads.erase(request.upload_id);
+        }
+        staged_path = this->_root + "/.uploads/" + std::to_string(request.upload_id);
+        path = this->_root + "/" + upload.first;
+        if(request.op == kPOS_CkptObjOp_CompleteUpload){
+            try {
+                std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+            } catch (const std::filesystem::filesystem_error& e) {
+                POS_WARN_C("failed to create directory of object: key(%s), %s", upload.first.c_str(), e.what());
+            }
+            if(unlikely(fsync(upload.second) != 0 || rename(staged_path.c_str(), path.c_str()) != 0)){
+                POS_WARN_C("failed to complete object: key(%s), errno(%d)", upload.first.c_str(), errno);
+                response.retval = POS_FAILED;
+                unlink(staged_path.c_str());
+            }
+        } else {
+            unlink(staged_path.c_str());
+        }
+        close(upload.second);
+        break;
+
+    case kPOS_CkptObjOp_GetSize:
+        if(unlikely(stat(path.c_str(), &sb) != 0)){
+            response.retval = errno == ENOENT ? POS_FAILED_NOT_EXIST : POS_FAILED;
+            break;
+        }
+        response.size = sb.st_size;
+        break;
+
+    case kPOS_CkptObjOp_GetRange:
+        if(unlikely((file_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC)) < 0)){
+            response.retval = errno == ENOENT ? POS_FAILED_NOT_EXIST : POS_FAILED;
+            break;
+        }
+        if(unlikely(fstat(file_fd, &sb) != 0 || request.offset + request.size > static_cast<uint64_t>(sb.st_size))){
+            response.retval = POS_FAILED;
+            close(file_fd);
+            break;
+        }
+
+        // the range follows the response, sent from the page cache without copying
+        response.size = request.size;
+        if(unlikely(POS_SUCCESS != __send_all(fd, &response, sizeof(pos_ckpt_obj_msg_t)))){
+            close(file_fd);
+            return POS_FAILED;
+        }
+        file_offset = request.offset;
+        left = request.size;
+        while(left > 0){
+            nb_bytes = sendfile(fd, file_fd, &file_offset, left);
+            if(unlikely(nb_bytes <= 0)){
+                if(nb_bytes < 0 && errno == EINTR){ continue; }
+                retval = POS_FAILED;
+                break;
+            }
+            left -= nb_bytes;
+        }
+        close(file_fd);
+        return retval;
+
+    case kPOS_CkptObjOp_Remove:
+        if(unlikely(unlink(path.c_str()) != 0)){
+            response.retval = errno == ENOENT ? POS_FAILED_NOT_EXIST : POS_FAILED;
+        }
+        break;
+
+    default:
+        response.retval = POS_FAILED_INVALID_INPUT;
+    }
+
+response:
+    return __send_all(fd, &response, sizeof(pos_ckpt_obj_msg_t));
+}
+
+
+bool POSCheckpointObjectServer::__is_valid_key(const std::string& key){
+    uint64_t begin = 0, end;
+    std::string component;
+
+    if(key.size() == 0){ return false; }
+    while(begin <= key.size()){
+        if((end = key.find('/', begin)) == std::string::npos){ end = key.size(); }
+        component = key.substr(begin, end - begin);
+        if(component.size() == 0 || component == "." || component == ".."){ return false; }
+        if(begin == 0 && component == ".uploads"){ return false; }
+        begin = end + 1;
+    }
+    return true;
+}
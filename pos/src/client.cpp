@@ -28,6 +28,10 @@
 #include "pos/include/handle.h"
 #include "pos/include/client.h"
 #include "pos/include/api_context.h"
+#include "pos/include/apicxt_log.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_storage.h"
+#include "pos/include/restore_scheduler.h"
 #include "pos/include/proto/client.pb.h"
 #include "pos/include/proto/apicxt.pb.h"
 
@@ -38,20 +42,42 @@ POSClient::POSClient(pos_client_uuid_t id, __pid_t pid, pos_client_cxt_t cxt, PO
         status(kPOS_ClientStatus_CreatePending),
         _api_inst_pc(0), 
         _cxt(cxt),
-        _ws(ws)
-{}
+        _ws(ws),
+        _apicxt_pool(nullptr),
+        _lazy_reload_thread(nullptr),
+        _is_lazy_reload_stop(false),
+        _restore_s_tick(0),
+        _restore_nb_on_demand_reloads(0),
+        _restore_nb_background_reloads(0),
+        _is_restore_first_api_pending(false)
+{
+    POS_CHECK_POINTER(this->_apicxt_pool = new POSAPIContextPool());
+}
 
 
 POSClient::POSClient() 
     :   id(0),
         pid(0),
         status(kPOS_ClientStatus_CreatePending),
-        _ws(nullptr)
+        _ws(nullptr),
+        _apicxt_pool(nullptr),
+        _lazy_reload_thread(nullptr),
+        _is_lazy_reload_stop(false),
+        _restore_s_tick(0),
+        _restore_nb_on_demand_reloads(0),
+        _restore_nb_background_reloads(0),
+        _is_restore_first_api_pending(false)
 {
     POS_ERROR_C("shouldn't call, just for passing compilation");
 }
 
 
+POSClient::~POSClient(){
+    // all work queue elements drawn from the pool are destroyed along with it
+    if(this->_apicxt_pool != nullptr){ delete this->_apicxt_pool; }
+}
+
+
 void POSClient::init(bool is_restoring){
     pos_retval_t retval = POS_SUCCESS;
     std::map<pos_u64id_t, POSAPIContext_QE_t*> apicxt_sequence_map;
@@ -83,12 +109,16 @@ exit:
          */
         if(is_restoring == false){
             this->status = kPOS_ClientStatus_Active;
+            this->wake_daemons();
         }
     }
 }
 
 
 void POSClient::deinit(){
+    // the background filler of lazy restore might still access handles
+    this->__stop_lazy_reload();
+
     this->deinit_handle_managers();
 
     if(this->_cxt.trace_resource){
@@ -99,6 +129,7 @@ void POSClient::deinit(){
 
     // stop parser and worker to poll
     this->status = kPOS_ClientStatus_Hang;
+    this->wake_daemons();
 
     // destory queue group
     this->__destory_qgroup();
@@ -111,13 +142,13 @@ exit:
 pos_retval_t POSClient::persist(std::string& ckpt_dir){
     pos_retval_t retval = POS_SUCCESS;
     pos_protobuf::Bin_POSClient client_binary;
-    std::ofstream ckpt_file_stream;
-    std::string ckpt_file_path;
+    std::string serialized;
+    POSCheckpointImageWriter *ckpt_image;
 
     POS_ASSERT(ckpt_dir.size() > 0);
 
     // verify the path exists
-    if(unlikely(!std::filesystem::exists(ckpt_dir))){
+    if(unlikely(!POSCheckpointStorage::exists(ckpt_dir))){
         POS_WARN_C(
             "failed to persist client state, no ckpt directory exists, this is a bug: ckpt_dir(%s)",
             ckpt_dir.c_str()
@@ -131,92 +162,176 @@ pos_retval_t POSClient::persist(std::string& ckpt_dir){
     client_binary.set_pid(this->pid);
     client_binary.set_job_name(this->_cxt.job_name);
 
-    // form the path to the checkpoint file of this handle
-    ckpt_file_path = ckpt_dir + std::string("/c.bin");
-
-    // write to file
-    ckpt_file_stream.open(ckpt_file_path, std::ios::binary | std::ios::out);
-    if(!ckpt_file_stream){
-        POS_WARN_C(
-            "failed to dump client to file, failed to open file: path(%s)",
-            ckpt_file_path.c_str()
-        );
+    if(!client_binary.SerializeToString(&serialized)){
+        POS_WARN_C("failed to dump client, protobuf failed to serialize");
         retval = POS_FAILED;
         goto exit;
     }
-    if(!client_binary.SerializeToOstream(&ckpt_file_stream)){
-        POS_WARN_C(
-            "failed to dump client to file, protobuf failed to dump: path(%s)",
-            ckpt_file_path.c_str()
-        );
+
+    // append to the checkpoint image
+    if(unlikely(nullptr == (ckpt_image = POSCheckpointImageWriter::open(ckpt_dir)))){
+        POS_WARN_C("failed to dump client, failed to open checkpoint image: ckpt_dir(%s)", ckpt_dir.c_str());
         retval = POS_FAILED;
         goto exit;
     }
+    retval = ckpt_image->append(
+        /* type */ kPOS_CkptImageRecord_Client,
+        /* resource_type_id */ 0,
+        /* id */ 0,
+        /* version */ 0,
+        /* data */ serialized.data(),
+        /* size */ serialized.size()
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to dump client to image: retval(%u)", retval);
+    }
 
 exit:
-    if(ckpt_file_stream.is_open()){ ckpt_file_stream.close(); }
     return retval;
 }
 
 
-pos_retval_t POSClient::restore_handles(std::string& ckpt_dir){
+pos_retval_t POSClient::restore_handles(std::shared_ptr<POSCheckpointImage> ckpt_image){
     pos_retval_t retval = POS_SUCCESS, dirty_retval = POS_SUCCESS;
     uint64_t i;
-    std::tuple<pos_resource_typeid_t, pos_u64id_t> handle_info;
+    bool is_lazy;
+    std::function<pos_retval_t()> thread_init;
     std::map<pos_resource_typeid_t, std::vector<pos_u64id_t>> handle_map;
+    std::vector<const pos_ckpt_image_entry_t*> entries, delta_entries, verified_entries;
+    std::vector<pos_retval_t> verify_results;
+    std::map<const pos_ckpt_image_entry_t*, pos_retval_t> corrupted_entries;
+    pos_ckpt_image_verify_stat_t verify_stat;
+    const pos_ckpt_image_entry_t *entry;
+    uint64_t nb_delta_records = 0, nb_delta_bytes = 0;
+    void *meta, *state;
+    uint64_t meta_size, state_size;
 
     std::vector<POSHandle*> handle_list;
     typename std::map<pos_resource_typeid_t, std::vector<pos_u64id_t>>::iterator map_iter;
     POSHandle *handle;
 
-    auto __deassemble_file_name = [](const std::string& filename) -> std::tuple<pos_resource_typeid_t, pos_u64id_t> {
-        std::string baseName = filename.substr(0, filename.find_last_of('.'));
-        std::stringstream ss(baseName);
-        std::string part;
-        std::vector<std::string> parts;
-
-        while (std::getline(ss, part, '-')) { parts.push_back(part); }
-        POS_ASSERT(parts.size() == 3);
-        POS_ASSERT(parts[0] == std::string("h"));
-        
-        return std::make_tuple(
-            std::stoul(parts[1]),
-            std::stoull(parts[2])
-        );
-    };
+    POS_CHECK_POINTER(ckpt_image.get());
+    POS_CHECK_POINTER(this->_ws);
 
-    POS_ASSERT(ckpt_dir.size() > 0);
-    if (!std::filesystem::exists(ckpt_dir) || !std::filesystem::is_directory(ckpt_dir)) {
-        POS_WARN_C("failed to restore handles, ckpt directory not exist: %s", ckpt_dir.c_str())
-        retval = POS_FAILED_INVALID_INPUT;
-        goto exit;
+    is_lazy = this->__is_lazy_restore_enabled();
+    {
+        std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+        this->_restore_stat = pos_client_restore_stat_t();
+        this->_restore_stat.is_lazy = is_lazy;
+    }
+    this->_restore_s_tick = this->_ws->tsc_timer.get_tsc();
+    this->_restore_nb_on_demand_reloads.store(0);
+    this->_restore_nb_background_reloads.store(0);
+    this->_is_restore_first_api_pending.store(true);
+
+    // reallocate handles in the handle manager, records are located directly through the image index
+    ckpt_image->get_entries(kPOS_CkptImageRecord_Handle, entries);
+
+    // verify all records to be restored (along with their deltas) at once, so that checksums
+    // are computed in parallel instead of record by record
+    for(i=0; i<entries.size(); i++){
+        POS_CHECK_POINTER(entry = entries[i]);
+        verified_entries.push_back(entry);
+        ckpt_image->get_deltas(entry->resource_type_id, entry->id, delta_entries);
+        verified_entries.insert(verified_entries.end(), delta_entries.begin(), delta_entries.end());
     }
+    ckpt_image->verify_entries(verified_entries, verify_results, &verify_stat);
+    for(i=0; i<verified_entries.size(); i++){
+        if(unlikely(verify_results[i] != POS_SUCCESS)){ corrupted_entries[verified_entries[i]] = verify_results[i]; }
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+        this->_restore_stat.nb_verified_bytes = verify_stat.nb_bytes;
+        this->_restore_stat.verify_ms = verify_stat.duration_ms;
+    }
+    POS_DEBUG_C(
+        "verified checkpoint records: #records(%lu), #chunks(%lu), size(%lu Bytes), duration(%lf ms)",
+        verify_stat.nb_records, verify_stat.nb_chunks, verify_stat.nb_bytes, verify_stat.duration_ms
+    );
 
-    // reallocate handles in the handle manager
-    for (const auto& entry : std::filesystem::directory_iterator(ckpt_dir)) {
-        if (    entry.is_regular_file() 
-            &&  entry.path().extension() == ".bin"
-            &&  entry.path().filename().string().rfind("h-", 0) == 0
-        ){
-            handle_info = __deassemble_file_name(entry.path().filename().string());
-            retval = this->__reallocate_single_handle(
-                /* ckpt_file */ entry.path().string(),
-                /* rid */ std::get<0>(handle_info),
-                /* hid */ std::get<1>(handle_info)
+    for(i=0; i<entries.size(); i++){
+        POS_CHECK_POINTER(entry = entries[i]);
+        if(unlikely(corrupted_entries.count(entry) > 0)){
+            dirty_retval = retval = corrupted_entries[entry];
+            POS_WARN_C(
+                "failed to restore handle, corrupted record: rid(%u), hid(%lu)", entry->resource_type_id, entry->id
             );
-            if(unlikely(retval != POS_SUCCESS)){
-                dirty_retval = retval;
-                POS_WARN_C(
-                    "failed to restore handle: rid(%u), hid(%lu), retval(%u)",
-                    std::get<0>(handle_info),
-                    std::get<1>(handle_info),
-                    retval
-                );
-                continue;
+            continue;
+        }
+        if(unlikely(POS_SUCCESS != (
+            retval = ckpt_image->get_section(entry, &meta, &meta_size, &state, &state_size)
+        ))){
+            dirty_retval = retval;
+            POS_WARN_C(
+                "failed to restore handle, corrupted record: rid(%u), hid(%lu)", entry->resource_type_id, entry->id
+            );
+            continue;
+        }
+        retval = this->__reallocate_single_handle(
+            /* mapped */ meta,
+            /* size */ meta_size,
+            /* state */ state,
+            /* state_size */ state_size,
+            /* rid */ entry->resource_type_id,
+            /* hid */ entry->id
+        );
+        if(unlikely(retval != POS_SUCCESS)){
+            dirty_retval = retval;
+            POS_WARN_C(
+                "failed to restore handle: rid(%u), hid(%lu), retval(%u)",
+                entry->resource_type_id, entry->id, retval
+            );
+            continue;
+        }
+
+        // attach the deltas committed on top of the state, they're applied in order after the state is reloaded
+        ckpt_image->get_deltas(entry->resource_type_id, entry->id, delta_entries);
+        if(delta_entries.size() > 0){
+            POS_CHECK_POINTER(this->handle_managers[entry->resource_type_id]);
+            POS_CHECK_POINTER(
+                handle = this->handle_managers[entry->resource_type_id]->get_handle_by_id(entry->id)
+            );
+            handle->restore_state_deltas.clear();
+            for(const pos_ckpt_image_entry_t *delta_entry : delta_entries){
+                pos_ckpt_delta_section_t delta;
+                void *delta_meta, *delta_section;
+                if(unlikely(corrupted_entries.count(delta_entry) > 0)){
+                    dirty_retval = retval = corrupted_entries[delta_entry];
+                    POS_WARN_C(
+                        "failed to restore handle delta, corrupted record: rid(%u), hid(%lu)",
+                        entry->resource_type_id, entry->id
+                    );
+                    continue;
+                }
+                if(unlikely(
+                    POS_SUCCESS != (retval = ckpt_image->get_section(
+                            delta_entry, &delta_meta, &delta.meta_size, &delta_section, &delta.section_size
+                        ))
+                )){
+                    dirty_retval = retval;
+                    POS_WARN_C(
+                        "failed to restore handle delta, corrupted record: rid(%u), hid(%lu)",
+                        entry->resource_type_id, entry->id
+                    );
+                    continue;
+                }
+                delta.meta = delta_meta;
+                delta.section = delta_section;
+                handle->restore_state_deltas.push_back(delta);
+                nb_delta_bytes += delta.section_size;
             }
-            handle_map[std::get<0>(handle_info)].push_back(std::get<1>(handle_info));
-            POS_DEBUG_C("restored handle: rid(%lu), hid(%lu)", std::get<0>(handle_info), std::get<1>(handle_info));
+            std::sort(
+                handle->restore_state_deltas.begin(), handle->restore_state_deltas.end(),
+                [](const pos_ckpt_delta_section_t& a, const pos_ckpt_delta_section_t& b){
+                    return POSCheckpointDeltaChain::get_delta_seq(a.meta, a.meta_size)
+                            < POSCheckpointDeltaChain::get_delta_seq(b.meta, b.meta_size);
+                }
+            );
+            nb_delta_records += handle->restore_state_deltas.size();
         }
+
+        handle_map[entry->resource_type_id].push_back(entry->id);
+        POS_DEBUG_C("restored handle: rid(%lu), hid(%lu)", entry->resource_type_id, entry->id);
     }
 
     // reassign each handle's parent handles
@@ -237,36 +352,77 @@ pos_retval_t POSClient::restore_handles(std::string& ckpt_dir){
         }
     }
     
-    // restore handle and its state
-    // TODO: this part can be async and on-demand
-    for(i=0; i<handle_list.size(); i++){
-        POS_CHECK_POINTER(handle = handle_list[i]);
+    // restore handles and their states, layer by layer along the parent edges;
+    // under lazy restore, states are deferred to their first use or the background filler
+    thread_init = this->__get_restore_thread_init();
+    {
+        POSRestoreScheduler<POSHandle> scheduler(this->__get_nb_restore_threads());
 
-        // restore handle
-        retval = handle->restore();
+        retval = scheduler.schedule(handle_list);
         if(unlikely(retval != POS_SUCCESS)){
             dirty_retval = retval;
-            POS_WARN_C(
-                "failed to restore resource on device: client_addr(%p), rid(%u)",
-                handle->client_addr,
-                handle->resource_type_id
-            );
+            POS_WARN_C("failed to schedule the restore of handles");
             goto exit;
         }
 
-        // restore state
-        if(handle->state_size > 0){
-            retval = handle->reload_state( /* stream_id */ 0);
-            if(unlikely(retval != POS_SUCCESS)){
-                dirty_retval = retval;
-                POS_WARN_C(
-                    "failed to restore resource state on device: client_addr(%p), rid(%u)",
-                    handle->client_addr,
-                    handle->resource_type_id
-                );
-                goto exit;
+        retval = scheduler.run(thread_init, /* stream_id */ 0, /* with_state */ !is_lazy);
+        scheduler.print_stat();
+        if(unlikely(retval != POS_SUCCESS)){
+            dirty_retval = retval;
+            goto exit;
+        }
+    }
+    if(!is_lazy){
+        for(POSHandle *restored_handle : handle_list){ this->__release_restored_state(ckpt_image.get(), restored_handle); }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+        this->_restore_stat.nb_handles = handle_list.size();
+        this->_restore_stat.nb_delta_records = nb_delta_records;
+        this->_restore_stat.nb_delta_bytes = nb_delta_bytes;
+    }
+    if(nb_delta_records > 0){
+        POS_LOG_C("restored with deltas: #delta records(%lu), delta size(%lu Bytes)", nb_delta_records, nb_delta_bytes);
+    }
+
+    if(is_lazy){
+        this->__stop_lazy_reload();
+        this->_lazy_handles.clear();
+        for(POSHandle *lazy_handle : handle_list){
+            if(lazy_handle->state_size == 0){ continue; }
+            lazy_handle->mark_state_reload_pending();
+            this->_lazy_handles.push_back(lazy_handle);
+        }
+
+        // reload most recently modified states first, and smaller ones first among the same version,
+        // as both are more likely to be touched by the application soon
+        std::stable_sort(
+            this->_lazy_handles.begin(), this->_lazy_handles.end(),
+            [](POSHandle* a, POSHandle* b){
+                if(a->latest_version != b->latest_version){ return a->latest_version > b->latest_version; }
+                return a->state_size < b->state_size;
             }
+        );
+
+        {
+            std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+            this->_restore_stat.nb_lazy_handles = this->_lazy_handles.size();
         }
+
+        // the deferred states are mapped from the image, so it's held until all of them are reloaded
+        this->_lazy_ckpt_image = ckpt_image;
+        this->_is_lazy_reload_stop.store(false);
+        this->_lazy_reload_thread = new std::thread(&POSClient::__lazy_reload_routine, this, thread_init);
+        POS_CHECK_POINTER(this->_lazy_reload_thread);
+        POS_LOG_C(
+            "lazy restore: #handles(%lu), #deferred states(%lu)", handle_list.size(), this->_lazy_handles.size()
+        );
+    } else {
+        std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+        this->_restore_stat.total_restore_ms = this->_ws->tsc_timer.tick_range_to_ms(
+            this->_ws->tsc_timer.get_tsc(), this->_restore_s_tick
+        );
     }
 
 exit:
@@ -274,32 +430,184 @@ exit:
 }
 
 
-pos_retval_t POSClient::restore_apicxts(std::string& ckpt_dir){
+void POSClient::__lazy_reload_routine(std::function<pos_retval_t()> thread_init){
+    pos_retval_t retval;
+    uint64_t i, nb_failed = 0;
+    bool is_reloaded;
+    double total_restore_ms;
+
+    if(thread_init != nullptr){
+        if(unlikely(POS_SUCCESS != (retval = thread_init()))){
+            POS_WARN_C("failed to initialize the background filler of lazy restore: retval(%u)", retval);
+            goto exit;
+        }
+    }
+
+    for(i=0; i<this->_lazy_handles.size(); i++){
+        if(unlikely(this->_is_lazy_reload_stop.load(std::memory_order_relaxed))){
+            POS_DEBUG_C("background filler of lazy restore stopped: #remain(%lu)", this->_lazy_handles.size() - i);
+            goto exit;
+        }
+        is_reloaded = false;
+        retval = this->_lazy_handles[i]->reload_state_if_pending(/* stream_id */ 0, &is_reloaded);
+        if(unlikely(retval != POS_SUCCESS)){
+            nb_failed += 1;
+            continue;
+        }
+        if(is_reloaded){
+            this->_restore_nb_background_reloads.fetch_add(1, std::memory_order_relaxed);
+            this->__release_restored_state(this->_lazy_ckpt_image.get(), this->_lazy_handles[i]);
+        }
+    }
+
+    total_restore_ms = this->_ws->tsc_timer.tick_range_to_ms(this->_ws->tsc_timer.get_tsc(), this->_restore_s_tick);
+    {
+        std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+        this->_restore_stat.total_restore_ms = total_restore_ms;
+    }
+    if(unlikely(nb_failed > 0)){
+        POS_WARN_C("failed to reload some deferred states: #failed(%lu)", nb_failed);
+    }
+    POS_LOG_C(
+        "lazy restore finished: total(%.2lf ms), #on-demand(%lu), #background(%lu)",
+        total_restore_ms,
+        this->_restore_nb_on_demand_reloads.load(),
+        this->_restore_nb_background_reloads.load()
+    );
+
+exit:
+    ;
+}
+
+
+void POSClient::__stop_lazy_reload(){
+    if(this->_lazy_reload_thread != nullptr){
+        this->_is_lazy_reload_stop.store(true);
+        if(this->_lazy_reload_thread->joinable()){ this->_lazy_reload_thread->join(); }
+        delete this->_lazy_reload_thread;
+        this->_lazy_reload_thread = nullptr;
+    }
+    this->_lazy_handles.clear();
+    this->_lazy_ckpt_image.reset();
+}
+
+
+void POSClient::__release_restored_state(POSCheckpointImage* ckpt_image, POSHandle* handle){
+    const pos_ckpt_image_entry_t *entry;
+    std::vector<const pos_ckpt_image_entry_t*> delta_entries;
+
+    POS_CHECK_POINTER(ckpt_image);
+    POS_CHECK_POINTER(handle);
+
+    if(handle->state_size == 0){ return; }
+
+    if(likely(nullptr != (entry = ckpt_image->find(kPOS_CkptImageRecord_Handle, handle->resource_type_id, handle->id)))){
+        ckpt_image->release_section(entry);
+    }
+    ckpt_image->get_deltas(handle->resource_type_id, handle->id, delta_entries);
+    for(const pos_ckpt_image_entry_t *delta_entry : delta_entries){ ckpt_image->release_section(delta_entry); }
+
+    // the state is on the device now, and the sections above might be unmapped
+    handle->restore_state_mapped = nullptr;
+    handle->restore_state_mapped_size = 0;
+    handle->restore_state_deltas.clear();
+}
+
+
+void POSClient::__record_first_api(){
+    double time_to_first_api_ms;
+
+    // only the first caller records
+    if(this->_is_restore_first_api_pending.exchange(false) == false){ return; }
+
+    POS_CHECK_POINTER(this->_ws);
+    time_to_first_api_ms = this->_ws->tsc_timer.tick_range_to_ms(this->_ws->tsc_timer.get_tsc(), this->_restore_s_tick);
+    {
+        std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+        this->_restore_stat.time_to_first_api_ms = time_to_first_api_ms;
+    }
+    POS_LOG_C("time to the first API after restore: %.2lf ms", time_to_first_api_ms);
+}
+
+
+void POSClient::get_restore_stat(pos_client_restore_stat_t& stat){
+    std::lock_guard<std::mutex> lock(this->_restore_stat_mutex);
+    stat = this->_restore_stat;
+    stat.nb_on_demand_reloads = this->_restore_nb_on_demand_reloads.load();
+    stat.nb_background_reloads = this->_restore_nb_background_reloads.load();
+}
+
+
+bool POSClient::__is_lazy_restore_enabled(){
+    std::string val;
+
+    POS_CHECK_POINTER(this->_ws);
+    if(likely(POS_SUCCESS == this->_ws->ws_conf.get(POSWorkspaceConf::kRuntimeRestoreLazyEnabled, val))){
+        return val == std::string("1");
+    }
+
+    return false;
+}
+
+
+uint32_t POSClient::__get_nb_restore_threads(){
+    uint64_t nb_threads = 0;
+    std::string val;
+
+    POS_CHECK_POINTER(this->_ws);
+    if(likely(POS_SUCCESS == this->_ws->ws_conf.get(POSWorkspaceConf::kRuntimeRestoreThreads, val))){
+        if(unlikely(POS_SUCCESS != POSWorkspaceConf::parse_u64(val, "failed to obtain restore threads", nb_threads))){
+            nb_threads = 0;
+        }
+    }
+
+    return static_cast<uint32_t>(nb_threads);
+}
+
+
+pos_retval_t POSClient::restore_apicxts(POSCheckpointImage* ckpt_image){
     pos_retval_t retval = POS_SUCCESS;
-    pos_u64id_t apicxt_id;
+    uint64_t i;
+    std::vector<const pos_ckpt_image_entry_t*> entries;
+    const pos_ckpt_image_entry_t *entry;
+    POSAPIContextLogReader apicxt_log;
+    const pos_apicxt_log_frame_header_t *frame;
+    const void *frame_data;
+
+    POS_CHECK_POINTER(ckpt_image);
+
+    // records are returned in ascending order of API context index
+    ckpt_image->get_entries(kPOS_CkptImageRecord_APIContext, entries);
+    for(i=0; i<entries.size(); i++){
+        POS_CHECK_POINTER(entry = entries[i]);
+        if(unlikely(POS_SUCCESS != (retval = ckpt_image->verify(entry)))){
+            POS_WARN_C("failed to reload api context, corrupted record: id(%lu)", entry->id);
+            goto exit;
+        }
+        retval = this->__reload_apicxt(ckpt_image->get_data(entry), entry->size);
+        if(unlikely(retval != POS_SUCCESS)){
+            POS_WARN_C("failed to reload api context: id(%lu)", entry->id);
+            goto exit;
+        }
+    }
 
-    POS_ASSERT(ckpt_dir.size() > 0);
-    if (!std::filesystem::exists(ckpt_dir) || !std::filesystem::is_directory(ckpt_dir)) {
-        POS_WARN_C("failed to restore api contexts, ckpt directory not exist: %s", ckpt_dir.c_str())
-        retval = POS_FAILED_INVALID_INPUT;
+    // API contexts dumped by the worker are framed in the API context log, which is read sequentially
+    if(unlikely(POS_SUCCESS != (retval = apicxt_log.open(ckpt_image)))){
+        POS_WARN_C("failed to reload api contexts, corrupted API context log");
         goto exit;
     }
-
-    for (const auto& entry : std::filesystem::directory_iterator(ckpt_dir)) {
-        if (    entry.is_regular_file() 
-            &&  entry.path().extension() == ".bin"
-            &&  entry.path().filename().string().rfind("a-", 0) == 0
-        ){
-            retval = this->__reload_apicxt(entry.path().string());
-            if(unlikely(retval != POS_SUCCESS)){
-                POS_WARN_C(
-                    "failed to reload api context: ckpt_file(%s)",
-                    entry.path().string().c_str()
-                );
-                goto exit;
-            }
+    while(POS_SUCCESS == (retval = apicxt_log.next(&frame, &frame_data))){
+        retval = this->__reload_apicxt(frame_data, frame->size);
+        if(unlikely(retval != POS_SUCCESS)){
+            POS_WARN_C("failed to reload api context: id(%lu)", frame->id);
+            goto exit;
         }
     }
+    if(unlikely(retval != POS_FAILED_NOT_EXIST)){
+        POS_WARN_C("failed to reload api contexts, truncated API context log");
+        goto exit;
+    }
+    retval = POS_SUCCESS;
 
 exit:
     return retval;
@@ -332,7 +640,8 @@ pos_retval_t POSClient::push_q(void *qe){
         );
 
         if constexpr (qdir == kPOS_QueueDirection_Rpc2Parser){
-            this->_apicxt_rpc2parser_wq->push(apictx_qe);
+            // the id of the wqe is the ordering stamp, so that the parser receives APIs in the order of ids
+            this->_apicxt_rpc2parser_wq->push_stamped(apictx_qe, apictx_qe->id);
         } else { // qdir == kPOS_QueueDirection_Parser2Worker
             this->_apicxt_parser2worker_wq->push(apictx_qe);
         }
@@ -352,6 +661,9 @@ pos_retval_t POSClient::push_q(void *qe){
         } else { // qdir == kPOS_QueueDirection_Rpc2Worker
             this->_apicxt_rpc2worker_cq->push(apictx_qe);
         }
+
+        // notify the RPC thread that might wait on this API instance
+        apictx_qe->mark_completed();
     }
 
     // api context ckptdag queue 
@@ -425,6 +737,78 @@ template pos_retval_t POSClient::push_q<kPOS_QueueDirection_Oob2Parser, kPOS_Que
 template pos_retval_t POSClient::push_q<kPOS_QueueDirection_Oob2Parser, kPOS_QueueType_Cmd_CQ>(void *qe);
 
 
+template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
+pos_retval_t POSClient::push_q(std::vector<POSAPIContext_QE_t*>* qes){
+    pos_retval_t retval = POS_SUCCESS;
+    POSLockFreeQueue<POSAPIContext_QE_t*> *apicxt_q;
+
+    static_assert(
+            qtype == kPOS_QueueType_ApiCxt_WQ || qtype == kPOS_QueueType_ApiCxt_CQ
+        ||  qtype == kPOS_QueueType_ApiCxt_CkptDag_WQ
+        ||  qtype == kPOS_QueueType_ApiCxt_Trace_WQ,
+        "invalid queue type obtained"
+    );
+
+    POS_CHECK_POINTER(qes);
+
+    // api context worker queue
+    if constexpr (qtype == kPOS_QueueType_ApiCxt_WQ){
+        static_assert(
+            qdir == kPOS_QueueDirection_Parser2Worker,
+            "batch of ApiCxt_WQE can only be pushed to parser2worker queue, as rpc2parser queue is stamped by each RPC thread"
+        );
+        apicxt_q = this->_apicxt_parser2worker_wq;
+    }
+
+    // api context completion queue
+    if constexpr (qtype == kPOS_QueueType_ApiCxt_CQ){
+        static_assert(
+            qdir == kPOS_QueueDirection_Rpc2Parser || qdir == kPOS_QueueDirection_Rpc2Worker,
+            "ApiCxt_CQE can only be pushed to rpc2parser or rpc2worker queue"
+        );
+        if constexpr (qdir == kPOS_QueueDirection_Rpc2Parser){
+            apicxt_q = this->_apicxt_rpc2parser_cq;
+        } else { // qdir == kPOS_QueueDirection_Rpc2Worker
+            apicxt_q = this->_apicxt_rpc2worker_cq;
+        }
+    }
+
+    // api context ckptdag queue
+    if constexpr (qtype == kPOS_QueueType_ApiCxt_CkptDag_WQ) {
+        static_assert(
+            qdir == kPOS_QueueDirection_WorkerLocal,
+            "ApiCxt_CkptDag_WQE can only be pushed to worker local queue"
+        );
+        apicxt_q = this->_apicxt_workerlocal_ckptdag_wq;
+    }
+
+    // api context trace queue
+    if constexpr (qtype == kPOS_QueueType_ApiCxt_Trace_WQ) {
+        static_assert(
+            qdir == kPOS_QueueDirection_ParserLocal,
+            "ApiCxt_Trace_WQE can only be pushed to parser local queue"
+        );
+        apicxt_q = this->_apicxt_parserlocal_trace_wq;
+    }
+
+    POS_CHECK_POINTER(apicxt_q);
+    apicxt_q->push_n(qes->data(), qes->size());
+
+    // notify the RPC threads that might wait on these API instances
+    if constexpr (qtype == kPOS_QueueType_ApiCxt_CQ){
+        for(POSAPIContext_QE_t *apictx_qe : *qes){ apictx_qe->mark_completed(); }
+    }
+
+exit:
+    return retval;
+}
+template pos_retval_t POSClient::push_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_CQ>(std::vector<POSAPIContext_QE_t*>* qes);
+template pos_retval_t POSClient::push_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(std::vector<POSAPIContext_QE_t*>* qes);
+template pos_retval_t POSClient::push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(std::vector<POSAPIContext_QE_t*>* qes);
+template pos_retval_t POSClient::push_q<kPOS_QueueDirection_WorkerLocal, kPOS_QueueType_ApiCxt_CkptDag_WQ>(std::vector<POSAPIContext_QE_t*>* qes);
+template pos_retval_t POSClient::push_q<kPOS_QueueDirection_ParserLocal, kPOS_QueueType_ApiCxt_Trace_WQ>(std::vector<POSAPIContext_QE_t*>* qes);
+
+
 template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
 pos_retval_t POSClient::clear_q(){
     pos_retval_t retval = POS_SUCCESS;
@@ -444,9 +828,9 @@ pos_retval_t POSClient::clear_q(){
             "ApiCxt_WQE can only be located within rpc2parser or parser2worker queue"
         );
         if constexpr (qdir == kPOS_QueueDirection_Rpc2Parser){
-            this->_apicxt_rpc2parser_wq->drain();
+            this->_apicxt_rpc2parser_wq->drain([](POSAPIContext_QE_t* qe){ qe->put_ref(); });
         } else { // qdir == kPOS_QueueDirection_Parser2Worker
-            this->_apicxt_parser2worker_wq->drain();
+            this->_apicxt_parser2worker_wq->drain([](POSAPIContext_QE_t* qe){ qe->put_ref(); });
         }
     }
 
@@ -457,9 +841,9 @@ pos_retval_t POSClient::clear_q(){
             "ApiCxt_CQE can only be located within rpc2parser or rpc2worker queue"
         );
         if constexpr (qdir == kPOS_QueueDirection_Rpc2Parser){
-            this->_apicxt_rpc2parser_cq->drain();
+            this->_apicxt_rpc2parser_cq->drain([](POSAPIContext_QE_t* qe){ qe->put_ref(); });
         } else { // qdir == kPOS_QueueDirection_Rpc2Worker
-            this->_apicxt_rpc2worker_cq->drain();
+            this->_apicxt_rpc2worker_cq->drain([](POSAPIContext_QE_t* qe){ qe->put_ref(); });
         }
     }
 
@@ -469,7 +853,7 @@ pos_retval_t POSClient::clear_q(){
             qdir == kPOS_QueueDirection_WorkerLocal,
             "ApiCxt_CkptDag_WQE can only be located within worker local queue"
         );
-        this->_apicxt_workerlocal_ckptdag_wq->drain();
+        this->_apicxt_workerlocal_ckptdag_wq->drain([](POSAPIContext_QE_t* qe){ qe->put_ref(); });
     }
 
     // api context trace queue 
@@ -478,7 +862,7 @@ pos_retval_t POSClient::clear_q(){
             qdir == kPOS_QueueDirection_ParserLocal,
             "ApiCxt_CkptDag_WQE can only be located within parser local queue"
         );
-        this->_apicxt_parserlocal_trace_wq->drain();
+        this->_apicxt_parserlocal_trace_wq->drain([](POSAPIContext_QE_t* qe){ qe->put_ref(); });
     }
 
     // command work queue
@@ -525,10 +909,11 @@ template pos_retval_t POSClient::clear_q<kPOS_QueueDirection_Oob2Parser, kPOS_Qu
 
 
 template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
-pos_retval_t POSClient::poll_q(std::vector<POSAPIContext_QE*>* qes){
+pos_retval_t POSClient::poll_q(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes){
     pos_retval_t retval = POS_SUCCESS;
-    POSAPIContext_QE *apicxt_qe;
-    POSLockFreeQueue<POSAPIContext_QE_t*> *apicxt_q;
+    uint64_t nb_polled = 0, nb_to_poll, nb_popped, base;
+    POSLockFreeQueue<POSAPIContext_QE_t*> *apicxt_q = nullptr;
+    POSMPSCQueue<POSAPIContext_QE_t*> *apicxt_mpsc_q = nullptr;
 
     static_assert(
             qtype == kPOS_QueueType_ApiCxt_WQ 
@@ -547,7 +932,8 @@ pos_retval_t POSClient::poll_q(std::vector<POSAPIContext_QE*>* qes){
             "POSAPIContext_WQE can only be poll from rpc2parser or parser2worker queue"
         );
         if constexpr (qdir == kPOS_QueueDirection_Rpc2Parser){
-            apicxt_q = this->_apicxt_rpc2parser_wq;
+            // multi-producer queue, merged by the ordering stamps
+            apicxt_mpsc_q = this->_apicxt_rpc2parser_wq;
         } else { // kPOS_QueueDirection_Parser2Worker
             apicxt_q = this->_apicxt_parser2worker_wq;
         }
@@ -584,20 +970,32 @@ pos_retval_t POSClient::poll_q(std::vector<POSAPIContext_QE*>* qes){
         apicxt_q = this->_apicxt_parserlocal_trace_wq;
     }
 
-    POS_CHECK_POINTER(apicxt_q);
-    while(POS_SUCCESS == apicxt_q->dequeue(apicxt_qe)){
-        qes->push_back(apicxt_qe);
+    POS_ASSERT(apicxt_q != nullptr || apicxt_mpsc_q != nullptr);
+
+    // pop in chunks directly into the vector, until the queue is empty or the batch is full
+    while(nb_polled < max_nb_qes){
+        nb_to_poll = std::min<uint64_t>(max_nb_qes - nb_polled, kPollChunkSize);
+        base = qes->size();
+        qes->resize(base + nb_to_poll);
+        if(apicxt_mpsc_q != nullptr){
+            nb_popped = apicxt_mpsc_q->pop_n(qes->data() + base, nb_to_poll);
+        } else {
+            nb_popped = apicxt_q->pop_n(qes->data() + base, nb_to_poll);
+        }
+        qes->resize(base + nb_popped);
+        nb_polled += nb_popped;
+        if(nb_popped < nb_to_poll){ break; }
     }
 
 exit:
     return retval;
 }
-template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_WQ>(std::vector<POSAPIContext_QE*>* qes);
-template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(std::vector<POSAPIContext_QE*>* qes);
-template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_WorkerLocal, kPOS_QueueType_ApiCxt_CkptDag_WQ>(std::vector<POSAPIContext_QE*>* qes);
-template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_ParserLocal, kPOS_QueueType_ApiCxt_Trace_WQ>(std::vector<POSAPIContext_QE*>* qes);
-template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_CQ>(std::vector<POSAPIContext_QE*>* qes);
-template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(std::vector<POSAPIContext_QE*>* qes);
+template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_WQ>(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes);
+template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes);
+template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_WorkerLocal, kPOS_QueueType_ApiCxt_CkptDag_WQ>(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes);
+template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_ParserLocal, kPOS_QueueType_ApiCxt_Trace_WQ>(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes);
+template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_CQ>(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes);
+template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(std::vector<POSAPIContext_QE*>* qes, uint64_t max_nb_qes);
 
 
 template<pos_queue_direction_t qdir, pos_queue_type_t qtype>
@@ -653,12 +1051,56 @@ template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_
 template pos_retval_t POSClient::poll_q<kPOS_QueueDirection_Oob2Parser, kPOS_QueueType_Cmd_CQ>(std::vector<POSCommand_QE_t*>* qes);
 
 
+void POSClient::get_daemon_wait_policy(pos_wait_policy_t& policy){
+    std::string val;
+
+    policy = pos_wait_policy_t();
+    POS_CHECK_POINTER(this->_ws);
+
+    try {
+        if(likely(POS_SUCCESS == this->_ws->ws_conf.get(POSWorkspaceConf::kRuntimeDaemonSpinRounds, val))){
+            policy.nb_spin_rounds = std::stoull(val);
+        }
+        if(likely(POS_SUCCESS == this->_ws->ws_conf.get(POSWorkspaceConf::kRuntimeDaemonYieldRounds, val))){
+            policy.nb_yield_rounds = std::stoull(val);
+        }
+        if(likely(POS_SUCCESS == this->_ws->ws_conf.get(POSWorkspaceConf::kRuntimeDaemonParkTimeoutUs, val))){
+            policy.park_timeout_us = std::stoull(val);
+        }
+    } catch (const std::exception& e) {
+        POS_WARN_C("failed to parse daemon wait policy, use default: %s", e.what());
+        policy = pos_wait_policy_t();
+    }
+}
+
+
+uint64_t POSClient::get_daemon_poll_batch_size(){
+    std::string val;
+    uint64_t batch_size = kDefaultDaemonPollBatchSize;
+
+    POS_CHECK_POINTER(this->_ws);
+
+    try {
+        if(likely(POS_SUCCESS == this->_ws->ws_conf.get(POSWorkspaceConf::kRuntimeDaemonPollBatchSize, val))){
+            batch_size = std::stoull(val);
+        }
+    } catch (const std::exception& e) {
+        POS_WARN_C("failed to parse daemon poll batch size, use default: %s", e.what());
+        batch_size = kDefaultDaemonPollBatchSize;
+    }
+    if(unlikely(batch_size == 0)){ batch_size = kDefaultDaemonPollBatchSize; }
+
+    return batch_size;
+}
+
+
 pos_retval_t POSClient::__create_qgroup(){
     pos_retval_t retval = POS_SUCCESS;
 
     // rpc2parser apicxt work queue
-    this->_apicxt_rpc2parser_wq = new POSLockFreeQueue<POSAPIContext_QE_t*>();
+    this->_apicxt_rpc2parser_wq = new POSMPSCQueue<POSAPIContext_QE_t*>();
     POS_CHECK_POINTER(this->_apicxt_rpc2parser_wq);
+    this->_apicxt_rpc2parser_wq->set_wait_event(&this->_parser_wait_event);
     POS_DEBUG_C("created rpc2parser apicxt WQ: uuid(%lu)", this->id);
 
     // rpc2parser apicxt completion queue
@@ -669,6 +1111,7 @@ pos_retval_t POSClient::__create_qgroup(){
     // parser2worker apicxt work queue
     this->_apicxt_parser2worker_wq = new POSLockFreeQueue<POSAPIContext_QE_t*>();
     POS_CHECK_POINTER(this->_apicxt_parser2worker_wq);
+    this->_apicxt_parser2worker_wq->set_wait_event(&this->_worker_wait_event);
     POS_DEBUG_C("created parser2worker apicxt WQ: uuid(%lu)", this->id);
 
     // rpc2worker apicxt completion queue
@@ -689,16 +1132,19 @@ pos_retval_t POSClient::__create_qgroup(){
     // parser2worker cmd work queue
     this->_cmd_parser2worker_wq = new POSLockFreeQueue<POSCommand_QE_t*>();
     POS_CHECK_POINTER(this->_cmd_parser2worker_wq);
+    this->_cmd_parser2worker_wq->set_wait_event(&this->_worker_wait_event);
     POS_DEBUG_C("created parser2worker cmd WQ: uuid(%lu)", this->id);
 
     // parser2worker cmd completion queue
     this->_cmd_parser2worker_cq = new POSLockFreeQueue<POSCommand_QE_t*>();
     POS_CHECK_POINTER(this->_cmd_parser2worker_cq);
+    this->_cmd_parser2worker_cq->set_wait_event(&this->_parser_wait_event);
     POS_DEBUG_C("created parser2worker cmd CQ: uuid(%lu)", this->id);
 
     // oob2parser cmd work queue
     this->_cmd_oob2parser_wq = new POSLockFreeQueue<POSCommand_QE_t*>();
     POS_CHECK_POINTER(this->_cmd_oob2parser_wq);
+    this->_cmd_oob2parser_wq->set_wait_event(&this->_parser_wait_event);
     POS_DEBUG_C("created oob2parser cmd WQ: uuid(%lu)", this->id);
 
     // oob2parser cmd completion queue
@@ -778,7 +1224,7 @@ exit:
 }
 
 
-pos_retval_t POSClient::__reload_apicxt(const std::string& ckpt_file){
+pos_retval_t POSClient::__reload_apicxt(const void* mapped, uint64_t size){
     pos_retval_t retval = POS_SUCCESS;
     POSAPIContext_QE_t *apicxt;
     uint64_t i;
@@ -786,14 +1232,12 @@ pos_retval_t POSClient::__reload_apicxt(const std::string& ckpt_file){
     pos_u64id_t hid;
     POSHandle *handle;
 
-    POS_ASSERT(ckpt_file.size() > 0);
+    POS_CHECK_POINTER(mapped);
     
-    POS_CHECK_POINTER(apicxt = new POSAPIContext_QE_t(this, ckpt_file));
+    POS_CHECK_POINTER(apicxt = new POSAPIContext_QE_t(this, mapped, size));
     if(unlikely(apicxt->client == nullptr)){
-        POS_WARN_C(
-            "failed to restore apicxt from binary checkpoint file: ckpt_file(%s)",
-            ckpt_file.c_str()
-        );
+        POS_WARN_C("failed to restore apicxt from checkpoint record");
+        apicxt->put_ref();
         retval = POS_FAILED;
         goto exit;
     }
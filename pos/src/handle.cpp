@@ -27,6 +27,8 @@
 #include "pos/include/log.h"
 #include "pos/include/api_context.h"
 #include "pos/include/checkpoint.h"
+#include "pos/include/checkpoint_spill.h"
+#include "pos/include/checkpoint_storage.h"
 #include "pos/include/proto/handle.pb.h"
 #include "google/protobuf/port_def.inc"
 
@@ -77,7 +79,27 @@ bool POSHandle::is_client_addr_in_range(void *addr, uint64_t *offset){
 
 
 pos_retval_t POSHandle::checkpoint_commit_sync(uint64_t version_id, std::string ckpt_dir, uint64_t stream_id) {
-    return this->__commit(version_id, stream_id, /* from_cache */ false, /* is_sync */ true, ckpt_dir);
+    pos_retval_t retval;
+
+    // the state deferred by lazy restore must be on the device before being checkpointed
+    if(unlikely(POS_SUCCESS != (retval = this->reload_state_if_pending(stream_id)))){
+        goto exit;
+    }
+
+    // wait for room of the host-side slot within the budget of host checkpoint memory
+    POSCheckpointSpill::get_instance()->admit(this->state_size);
+
+    retval = this->__commit(version_id, stream_id, /* from_cache */ false, /* is_sync */ true, ckpt_dir);
+    if(likely(retval == POS_SUCCESS)){ this->checkpoint_settle(version_id); }
+
+exit:
+    return retval;
+}
+
+
+void POSHandle::checkpoint_settle(uint64_t version_id){
+    // handles committed through the delta chain have no host-side slot inside the bag
+    if(this->ckpt_bag != nullptr){ this->ckpt_bag->settle_checkpoint_slot(version_id); }
 }
 
 
@@ -85,6 +107,11 @@ pos_retval_t POSHandle::checkpoint_add(uint64_t version_id, uint64_t stream_id)
     pos_retval_t retval = POS_SUCCESS;
     uint8_t old_counter;
 
+    // the state deferred by lazy restore must be on the device before being checkpointed
+    if(unlikely(POS_SUCCESS != (retval = this->reload_state_if_pending(stream_id)))){
+        goto exit;
+    }
+
     /*!
         *  \brief  [case]  the adding has been finished, nothing need to do
         */
@@ -98,7 +125,10 @@ pos_retval_t POSHandle::checkpoint_add(uint64_t version_id, uint64_t stream_id)
         /*!
             *  \brief  [case]  no adding on this handle yet, we conduct sync on-device copy from the origin buffer
             *  \note   this process must be sync, as there could have commit process waiting on this adding to be finished
+            *  \note   the added state is committed to a host-side slot later, so we wait for its room within the
+            *          budget of host checkpoint memory here, which holds back the caller rather than failing
             */
+        POSCheckpointSpill::get_instance()->admit(this->state_size);
         retval = this->__add(version_id, stream_id);
         this->_state_preserve_counter.store(3, std::memory_order_relaxed);
     } else if (old_counter == 1) {
@@ -116,6 +146,14 @@ exit:
 
 pos_retval_t POSHandle::checkpoint_commit_async(uint64_t version_id, uint64_t stream_id){ 
     pos_retval_t retval = POS_SUCCESS;
+
+    // the state deferred by lazy restore must be on the device before being checkpointed
+    if(unlikely(POS_SUCCESS != (retval = this->reload_state_if_pending(stream_id)))){
+        return retval;
+    }
+
+    // wait for room of the host-side slot within the budget of host checkpoint memory
+    POSCheckpointSpill::get_instance()->admit(this->state_size);
     
     #if POS_CONF_EVAL_CkptEnablePipeline == 1
         //  if the on-device cache is enabled, the cache should be added previously by checkpoint_add,
@@ -185,13 +223,13 @@ exit:
 
 pos_retval_t POSHandle::__persist(POSCheckpointSlot* ckpt_slot, std::string ckpt_dir, uint64_t stream_id){
     pos_retval_t retval = POS_SUCCESS, prev_retval;
-    std::future<pos_retval_t> persist_future;
+    POSCheckpointImageWriter *ckpt_image;
 
     // no directory specified, skip persisting
     if(ckpt_dir.size() == 0){ goto exit; }
 
     // verify the path exists
-    if(unlikely(!std::filesystem::exists(ckpt_dir))){
+    if(unlikely(!POSCheckpointStorage::exists(ckpt_dir))){
         POS_WARN_C(
             "failed to persist checkpoint, no ckpt directory exists, this is a bug: ckpt_dir(%s)",
             ckpt_dir.c_str()
@@ -200,25 +238,34 @@ pos_retval_t POSHandle::__persist(POSCheckpointSlot* ckpt_slot, std::string ckpt
         goto exit;
     }
 
-    // collect previous persisting thread if any
-    if(this->_persist_thread != nullptr){
+    // collect previous persisting task if any
+    if(this->_persist_future.valid()){
         if(unlikely(POS_SUCCESS != (prev_retval = this->sync_persist()))){
             POS_WARN_C("pervious persisting is failed: retval(%u)", prev_retval);
         }
     }
 
-    this->_persist_promise = new std::promise<pos_retval_t>;
-    POS_CHECK_POINTER(this->_persist_promise);
+    // obtain the image of this checkpoint, and announce the append so that
+    // the image won't be sealed before this persisting finished
+    ckpt_image = POSCheckpointImageWriter::open(ckpt_dir);
+    if(unlikely(ckpt_image == nullptr)){
+        POS_WARN_C("failed to persist checkpoint, failed to open checkpoint image: ckpt_dir(%s)", ckpt_dir.c_str());
+        retval = POS_FAILED;
+        goto exit;
+    }
+    ckpt_image->prepare_append();
+
+    // the slot mustn't be spilled before it's persisted
+    if(ckpt_slot != nullptr){ ckpt_slot->nb_pins += 1; }
 
-    // persist asynchronously
-    this->_persist_thread = new std::thread(
-        [](POSHandle* handle, POSCheckpointSlot* ckpt_slot, std::string ckpt_dir, uint64_t stream_id){
-            pos_retval_t retval = handle->__persist_async_thread(ckpt_slot, ckpt_dir, stream_id);
-            handle->_persist_promise->set_value(retval);
+    // persist asynchronously, tagged by the checkpoint directory so that the dump could wait for
+    // all its persisting tasks via POSPersistExecutor::flush
+    this->_persist_future = POSPersistExecutor::get_instance()->submit(
+        [this, ckpt_slot, ckpt_image, stream_id]() -> pos_retval_t {
+            return this->__persist_async_thread(ckpt_slot, ckpt_image, stream_id);
         },
-        this, ckpt_slot, ckpt_dir, stream_id
+        /* tag */ ckpt_dir
     );
-    POS_CHECK_POINTER(this->_persist_thread);
 
 exit:
     return retval;
@@ -227,23 +274,9 @@ exit:
 
 pos_retval_t POSHandle::sync_persist(){
     pos_retval_t retval = POS_SUCCESS;
-    std::future<pos_retval_t> persist_future;
-
-    if(this->_persist_thread != nullptr){
-        POS_ASSERT(this->_persist_promise != nullptr);
-        persist_future = this->_persist_promise->get_future();
-        persist_future.wait();
-        retval = persist_future.get();
-
-        // ref: https://en.cppreference.com/w/cpp/thread/thread/%7Ethread
-        if(this->_persist_thread->joinable()){
-            this->_persist_thread->join();
-        }
 
-        delete this->_persist_thread;
-        this->_persist_thread = nullptr;
-        delete this->_persist_promise;
-        this->_persist_promise = nullptr;
+    if(this->_persist_future.valid()){
+        retval = this->_persist_future.get();
     } else {
         retval = POS_FAILED_NOT_EXIST;
     }
@@ -261,7 +294,11 @@ pos_retval_t POSHandle::persist_sync(std::string ckpt_dir, bool with_state){
     if(with_state == true){
         // try persist with state
         if(this->status == kPOS_HandleStatus_Active){
+            if(unlikely(POS_SUCCESS != (retval = this->reload_state_if_pending(/* stream_id */ 0)))){
+                goto exit;
+            }
             retval = this->__commit(this->latest_version, /* stream_id */ 0, /* from_cache */ false, /* is_sync */ true, ckpt_dir);
+            if(likely(retval == POS_SUCCESS)){ this->checkpoint_settle(this->latest_version); }
             goto exit;
         } else {
             POS_WARN_C("failed to persist with state, hanlde isn't active, omit state");
@@ -271,7 +308,7 @@ pos_retval_t POSHandle::persist_sync(std::string ckpt_dir, bool with_state){
     // persist without state
     retval = this->__persist(nullptr, ckpt_dir, 0);
     if(unlikely(retval != POS_SUCCESS)){
-        POS_WARN_C("failed to run persist thread");
+        POS_WARN_C("failed to submit persisting task");
         goto exit;
     }
     retval = this->sync_persist();
@@ -281,15 +318,15 @@ exit:
 }
 
 
-pos_retval_t POSHandle::__persist_async_thread(POSCheckpointSlot* ckpt_slot, std::string ckpt_dir, uint64_t stream_id){
+pos_retval_t POSHandle::__persist_async_thread(POSCheckpointSlot* ckpt_slot, POSCheckpointImageWriter* ckpt_image, uint64_t stream_id){
     pos_retval_t retval = POS_SUCCESS;
     uint64_t i, actual_state_size;
-    std::string ckpt_file_path;
-    std::ofstream ckpt_file_stream;
+    std::string serialized, delta_serialized;
+    bool is_appended = false;
     google::protobuf::Message *handle_binary = nullptr, *_base_binary = nullptr;
     pos_protobuf::Bin_POSHandle *base_binary = nullptr;
 
-    POS_ASSERT(std::filesystem::exists(ckpt_dir));
+    POS_CHECK_POINTER(ckpt_image);
 
     if(unlikely(POS_SUCCESS != (
         retval = this->__sync_stream(stream_id)
@@ -328,8 +365,8 @@ pos_retval_t POSHandle::__persist_async_thread(POSCheckpointSlot* ckpt_slot, std
 
     // ==================== 3. state ====================
     if(ckpt_slot != nullptr){
-        // TODO: we must ensure the ckpt_slot won't be released until this ckpt ends!
-        //      we haven't do that!
+        //! \note   the slot is pinned by __persist until this routine ends, so that it's neither
+        //          reclaimed by the retention engine nor spilled while being written
 
         //! \note   we adopt state size inside ckpt slot first, as we might persiting a host-side state
         //          that have dynamic state size that not recorded inside the handle
@@ -343,40 +380,69 @@ pos_retval_t POSHandle::__persist_async_thread(POSCheckpointSlot* ckpt_slot, std
         // POS_ERROR_C("serialize stateful handle without providing checkpoint slot, this is a bug");
     }
     
+    //! \note   the state itself isn't serialized into the protobuf, it's written to the raw section
+    //          of the record straight from the checkpoint slot
     if(ckpt_slot != nullptr){
         base_binary->set_state_type(static_cast<uint32_t>(ckpt_slot->state_type));
-        base_binary->set_state(reinterpret_cast<const char*>(ckpt_slot->expose_pointer()), actual_state_size);
     }
 
-    // form the path to the checkpoint file of this handle
-    ckpt_file_path = ckpt_dir 
-                    + std::string("/h-")
-                    + std::to_string(this->resource_type_id) 
-                    + std::string("-")
-                    + std::to_string(this->id)
-                    + std::string(".bin");
-
-    // write to file
-    ckpt_file_stream.open(ckpt_file_path, std::ios::binary | std::ios::out);
-    if(!ckpt_file_stream){
-        POS_WARN_C(
-            "failed to dump checkpoint to file, failed to open file: path(%s)",
-            ckpt_file_path.c_str()
-        );
+    if(!handle_binary->SerializeToString(&serialized)){
+        POS_WARN_C("failed to dump checkpoint, protobuf failed to serialize: server_addr(%p)", this->server_addr);
         retval = POS_FAILED;
         goto exit;
     }
-    if(!handle_binary->SerializeToOstream(&ckpt_file_stream)){
-        POS_WARN_C(
-            "failed to dump checkpoint to file, protobuf failed to dump: path(%s)",
-            ckpt_file_path.c_str()
-        );
-        retval = POS_FAILED;
+
+    // ==================== 4. deltas on top of the state ====================
+    //! \note  the image is standalone, so the whole chain on top of the persisted base is appended;
+    //          deltas go ahead of the handle record, as the record completes the prepared append,
+    //          after which the image could be sealed at any time
+    if(this->ckpt_delta_chain != nullptr && ckpt_slot != nullptr){
+        const std::vector<pos_ckpt_delta_link_t>& links = this->ckpt_delta_chain->get_links();
+        if(links.size() > 0 && links[0].slot == ckpt_slot){
+            for(i=1; i<links.size(); i++){
+                this->ckpt_delta_chain->serialize_delta_meta(links[i], /* seq */ i, delta_serialized);
+                retval = ckpt_image->append_section(
+                    /* type */ kPOS_CkptImageRecord_HandleDelta,
+                    /* resource_type_id */ this->resource_type_id,
+                    /* id */ this->id,
+                    /* version */ links[i].version,
+                    /* meta */ delta_serialized.data(),
+                    /* meta_size */ delta_serialized.size(),
+                    /* section */ links[i].slot->expose_pointer(),
+                    /* section_size */ links[i].slot->get_state_size()
+                );
+                if(unlikely(retval != POS_SUCCESS)){
+                    POS_WARN_C(
+                        "failed to dump checkpoint delta to image: server_addr(%p), seq(%lu), retval(%u)",
+                        this->server_addr, i, retval
+                    );
+                    goto exit;
+                }
+            }
+        }
+    }
+
+    // ==================== 5. the handle record ====================
+    is_appended = true;
+    retval = ckpt_image->append_section(
+        /* type */ kPOS_CkptImageRecord_Handle,
+        /* resource_type_id */ this->resource_type_id,
+        /* id */ this->id,
+        /* version */ this->latest_version,
+        /* meta */ serialized.data(),
+        /* meta_size */ serialized.size(),
+        /* section */ ckpt_slot != nullptr ? ckpt_slot->expose_pointer() : nullptr,
+        /* section_size */ ckpt_slot != nullptr ? actual_state_size : 0,
+        /* is_prepared */ true
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to dump checkpoint to image: server_addr(%p), retval(%u)", this->server_addr, retval);
         goto exit;
     }
 
 exit:
-    if(ckpt_file_stream.is_open()){ ckpt_file_stream.close(); }
+    if(unlikely(is_appended == false)){ ckpt_image->cancel_append(); }
+    if(ckpt_slot != nullptr){ ckpt_slot->nb_pins -= 1; }
     return retval;
 }
 
@@ -405,8 +471,8 @@ pos_retval_t POSHandle::reload_state(uint64_t stream_id){
     pos_retval_t retval = POS_FAILED_NOT_EXIST;
 
     POS_ASSERT(this->state_size > 0);
-    POS_CHECK_POINTER(this->restore_binary_mapped);
-    POS_ASSERT(this->restore_binary_mapped_size > 0);
+    POS_CHECK_POINTER(this->restore_state_mapped);
+    POS_ASSERT(this->restore_state_mapped_size > 0);
 
     if(unlikely(this->status != kPOS_HandleStatus_Active)){
         POS_WARN(
@@ -417,11 +483,69 @@ pos_retval_t POSHandle::reload_state(uint64_t stream_id){
         goto exit;
     }
 
-    return this->__reload_state(
-        /* mapped */ this->restore_binary_mapped,
-        /* ckpt_file_size */ this->restore_binary_mapped_size,
+    retval = this->__reload_state(
+        /* state */ this->restore_state_mapped,
+        /* state_size */ this->restore_state_mapped_size,
         /* stream_id */ stream_id
     );
+    if(unlikely(retval != POS_SUCCESS) || likely(this->restore_state_deltas.size() == 0)){
+        goto exit;
+    }
+
+    // apply deltas of incremental checkpoint on top of the base, in the order of the chain
+    for(pos_ckpt_delta_section_t &delta : this->restore_state_deltas){
+        retval = POSCheckpointDeltaChain::apply_delta(
+            delta.meta, delta.meta_size, delta.section, delta.section_size,
+            [&](const void* src, uint64_t offset, uint64_t size) -> pos_retval_t {
+                if(unlikely(offset + size > this->state_size)){ return POS_FAILED_INVALID_INPUT; }
+                return this->__reload_state_range(src, offset, size, stream_id);
+            }
+        );
+        if(unlikely(retval != POS_SUCCESS)){
+            POS_WARN(
+                "failed to apply checkpoint delta while reloading handle state: server_addr(%p), retval(%d)",
+                this->server_addr, retval
+            );
+            goto exit;
+        }
+    }
+    retval = this->__sync_stream(stream_id);
+
+exit:
+    return retval;
+}
+
+
+pos_retval_t POSHandle::reload_state_if_pending(uint64_t stream_id, bool* is_reloaded){
+    pos_retval_t retval = POS_SUCCESS;
+
+    if(is_reloaded != nullptr){ *is_reloaded = false; }
+
+    if(likely(!this->is_state_reload_pending())){
+        goto exit;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_state_reload_mutex);
+
+        // reloaded by others while waiting the lock
+        if(!this->_is_state_reload_pending.load(std::memory_order_relaxed)){
+            goto exit;
+        }
+
+        retval = this->reload_state(stream_id);
+        if(unlikely(retval != POS_SUCCESS)){
+            POS_WARN(
+                "failed to reload pending state: client_addr(%p), resource_type_id(%u), retval(%d)",
+                this->client_addr, this->resource_type_id, retval
+            );
+            goto exit;
+        }
+
+        this->mark_state_status(kPOS_HandleStatus_StateReady);
+        this->_is_state_reload_pending.store(false, std::memory_order_release);
+        if(is_reloaded != nullptr){ *is_reloaded = true; }
+    }
 
 exit:
     return retval;
@@ -17,7 +17,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <filesystem>
+#include <memory>
 
 #include "pos/include/common.h"
 #include "pos/include/oob.h"
@@ -27,6 +27,9 @@
 #include "pos/include/workspace.h"
 #include "pos/include/agent.h"
 #include "pos/include/command.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_storage.h"
+#include "pos/include/persist_executor.h"
 
 #include "pos/cuda_impl/client.h"
 
@@ -45,6 +48,7 @@ namespace cli_ckpt_dump {
         std::string retmsg;
         POSCommand_QE_t* cmd;
         std::vector<POSCommand_QE_t*> cmds;
+        std::shared_ptr<POSCheckpointStorage> storage;
 
         POS_CHECK_POINTER(payload = (oob_payload_t*)msg->payload);
         
@@ -64,14 +68,16 @@ namespace cli_ckpt_dump {
         cmd->ckpt_dir = std::string(payload->ckpt_dir) 
                         + std::string("/phos");
 
-        // make sure the directory exist
-        if (std::filesystem::exists(cmd->ckpt_dir)) {
-            std::filesystem::remove_all(cmd->ckpt_dir);
-        }
-        try {
-            std::filesystem::create_directories(cmd->ckpt_dir);
-        } catch (const std::filesystem::filesystem_error& e) {
-            retmsg = std::string("failed to create dir: ") + e.what();
+        // wait for leftover persisting of a previous dump to the same location, and release its
+        // completion record, so that this dump neither races with it nor inherits its failure
+        POSPersistExecutor::get_instance()->flush(cmd->ckpt_dir).wait();
+
+        // make sure the (empty) checkpoint location exist, the directory could be a storage URI
+        if(unlikely(
+                POS_SUCCESS != POSCheckpointStorage::open(cmd->ckpt_dir, storage)
+            ||  POS_SUCCESS != storage->prepare()
+        )){
+            retmsg = std::string("failed to create ckpt location: ") + cmd->ckpt_dir;
             payload->retval = POS_FAILED;
             memcpy(payload->retmsg, retmsg.c_str(), retmsg.size());
             goto response;
@@ -106,16 +112,33 @@ namespace cli_ckpt_dump {
                 retmsg = "see posd log for more details";
             }
             memcpy(payload->retmsg, retmsg.c_str(), retmsg.size());
+            POSPersistExecutor::get_instance()->flush(cmd->ckpt_dir).wait();
+            POSCheckpointImageWriter::seal(cmd->ckpt_dir);
             goto response;
         }
         
-        // before remove client, we persist the state of the client
-        if(unlikely(POS_SUCCESS != (payload->retval = client->persist(cmd->ckpt_dir)))){
+        // before remove client, we persist the state of the client, and wait
+        // until all persisting tasks of this dump are finished
+        POSPersistExecutor::get_instance()->submit(
+            [client, cmd]() -> pos_retval_t { return client->persist(cmd->ckpt_dir); },
+            /* tag */ cmd->ckpt_dir
+        );
+        if(unlikely(POS_SUCCESS != (payload->retval = POSPersistExecutor::get_instance()->flush(cmd->ckpt_dir).get()))){
             POS_WARN("failed to persist the state of client");
             retmsg = "see posd log for more details";
             memcpy(payload->retmsg, retmsg.c_str(), retmsg.size());
         }
 
+        // the client is the last record of this dump, finalize the checkpoint image
+        if(unlikely(POS_SUCCESS != POSCheckpointImageWriter::seal(cmd->ckpt_dir))){
+            POS_WARN("failed to seal checkpoint image");
+            if(payload->retval == POS_SUCCESS){
+                retmsg = "see posd log for more details";
+                payload->retval = POS_FAILED;
+                memcpy(payload->retmsg, retmsg.c_str(), retmsg.size());
+            }
+        }
+
         // remove client
         if(likely(cmds[0]->retval == POS_SUCCESS)){
             ws->remove_client(cmd->client_id);
@@ -18,6 +18,7 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <memory>
 
 #include "pos/include/common.h"
 #include "pos/include/oob.h"
@@ -27,6 +28,8 @@
 #include "pos/include/workspace.h"
 #include "pos/include/agent.h"
 #include "pos/include/command.h"
+#include "pos/include/checkpoint_image.h"
+#include "pos/include/checkpoint_storage.h"
 #include "pos/cuda_impl/client.h"
 
 
@@ -43,7 +46,8 @@ namespace cli_restore {
         oob_payload_t *payload;
         std::string retmsg;
         POSClient *client;
-        std::string ckpt_dir, client_ckpt_path;
+        std::string ckpt_dir;
+        std::shared_ptr<POSCheckpointImage> ckpt_image;
 
         POS_CHECK_POINTER(ws);
         POS_CHECK_POINTER(oob_server);
@@ -52,21 +56,24 @@ namespace cli_restore {
 
         // make sure the directory exist
         ckpt_dir = std::string(payload->ckpt_dir) + std::string("/phos");
-        if (!std::filesystem::exists(ckpt_dir)) {
+        if (!POSCheckpointStorage::exists(ckpt_dir)) {
             payload->retval = POS_FAILED_NOT_EXIST;
             retmsg = std::string("no ckpt dir exist: ") + ckpt_dir.c_str();
             goto response;
         }
 
-        // restore client in the workspace
-        POS_LOG("try restore client");
-        client_ckpt_path = ckpt_dir + std::string("/c.bin");
-        if (!std::filesystem::exists(client_ckpt_path)) {
-            payload->retval = POS_FAILED_NOT_EXIST;
-            retmsg = std::string("ckpt corrupted: no client data");
+        // open the checkpoint image, all records are accessed in-place through its index;
+        // the image is shared with the client, which might keep it until lazily restored states are reloaded
+        ckpt_image = std::make_shared<POSCheckpointImage>();
+        POS_CHECK_POINTER(ckpt_image.get());
+        if(unlikely(POS_SUCCESS != (payload->retval = ckpt_image->open(ckpt_dir)))){
+            retmsg = std::string("ckpt corrupted: failed to open checkpoint image");
             goto response;
         }
-        if(unlikely(POS_SUCCESS != (payload->retval = ws->restore_client(client_ckpt_path, &client)))){
+
+        // restore client in the workspace
+        POS_LOG("try restore client");
+        if(unlikely(POS_SUCCESS != (payload->retval = ws->restore_client(ckpt_image.get(), &client)))){
             retmsg = std::string("see posd log for more details");
             goto response;
         }
@@ -76,7 +83,7 @@ namespace cli_restore {
 
         // restore handle in the client handle manager
         if(unlikely(POS_SUCCESS != (
-            payload->retval = client->restore_handles(ckpt_dir)
+            payload->retval = client->restore_handles(ckpt_image)
         ))){
             retmsg = std::string("see posd log for more details");
             goto response;
@@ -85,7 +92,7 @@ namespace cli_restore {
 
         // reload unexecuted APIs in the client queue (async thread)
         if(unlikely(POS_SUCCESS != (
-            payload->retval = client->restore_apicxts(ckpt_dir)
+            payload->retval = client->restore_apicxts(ckpt_image.get())
         ))){
             retmsg = std::string("see posd log for more details");
             goto response;
@@ -94,6 +101,7 @@ namespace cli_restore {
 
         // now it's time to let client start to work
         client->status = kPOS_ClientStatus_Active;
+        client->wake_daemons();
 
     response:
         POS_ASSERT(retmsg.size() < kServerRetMsgMaxLen);
@@ -21,6 +21,7 @@
 #include "pos/include/client.h"
 #include "pos/include/transport.h"
 #include "pos/include/parser.h"
+#include "pos/include/checkpoint_arena.h"
 
 
 POSParser::POSParser(POSWorkspace* ws, POSClient* client) 
@@ -46,11 +47,17 @@ pos_retval_t POSParser::init(){
     if(unlikely(POS_SUCCESS != this->init_ps_functions())){
         POS_ERROR_C_DETAIL("failed to insert functions");
     }
+
+    POS_CHECK_POINTER(this->_ws->api_mgnr);
+    this->_ws->api_mgnr->build_dispatch_table(this->_parser_functions, this->_parser_function_table);
+
+    return POS_SUCCESS;
 }
 
 
 void POSParser::shutdown(){ 
     this->_stop_flag = true;
+    this->_client->get_parser_wait_event()->notify();
     if(this->_daemon_thread != nullptr){
         if(this->_daemon_thread->joinable()){
             this->_daemon_thread->join();
@@ -63,27 +70,49 @@ void POSParser::shutdown(){
 
 
 void POSParser::__daemon(){
-    uint64_t i, api_id;
+    uint64_t i, api_id, nb_polled;
+    uint32_t api_index;
     pos_retval_t parser_retval, cmd_retval;
-    POSAPIMeta_t api_meta;
+    const POSAPIMeta_t *api_meta;
     uint64_t last_ckpt_tick = 0, current_tick;
+    uint64_t poll_batch_size;
     POSAPIContext_QE* apicxt_wqe;
-    std::vector<POSAPIContext_QE*> apicxt_wqes;
+    std::vector<POSAPIContext_QE*> apicxt_wqes, worker_wqes;
     POSCommand_QE_t *cmd_wqe;
     std::vector<POSCommand_QE_t*> cmd_wqes;
+    pos_wait_policy_t wait_policy;
 
     if(unlikely(POS_SUCCESS != this->daemon_init())){
         POS_WARN_C("failed to init daemon, worker daemon exit");
         return;
     }
 
+    // spin, then yield, then park while all queues are empty
+    this->_client->get_daemon_wait_policy(wait_policy);
+    POSWaitStrategy wait_strategy(this->_client->get_parser_wait_event(), wait_policy);
+
+    // process at most a batch of apicxt per round, so that commands are still digested under heavy load
+    poll_batch_size = this->_client->get_daemon_poll_batch_size();
+    apicxt_wqes.reserve(poll_batch_size);
+    worker_wqes.reserve(poll_batch_size);
+
+    // checkpoint memory allocated by this thread (e.g., prefilled slots) is accounted to the client
+    POSCheckpointArena::set_thread_client(this->_client->id);
+
     while(!_stop_flag){
+        wait_strategy.begin_round();
+
         // if the client isn't ready, the queue might not exist, we can't do any queue operation
-        if(this->_client->status != kPOS_ClientStatus_Active){ continue; }
+        if(this->_client->status != kPOS_ClientStatus_Active){
+            wait_strategy.end_round(/* has_work */ false);
+            continue;
+        }
 
         // step 1: digest cmd from oob work queue
+        nb_polled = 0;
         cmd_wqes.clear();
         this->_client->poll_q<kPOS_QueueDirection_Oob2Parser, kPOS_QueueType_Cmd_WQ>(&cmd_wqes);
+        nb_polled += cmd_wqes.size();
         for(i=0; i<cmd_wqes.size(); i++){
             POS_CHECK_POINTER(cmd_wqe = cmd_wqes[i]);
             this->__process_cmd(cmd_wqe);
@@ -92,6 +121,7 @@ void POSParser::__daemon(){
         // step 2: digest cmd from worker completion queue
         cmd_wqes.clear();
         this->_client->poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_Cmd_CQ>(&cmd_wqes);
+        nb_polled += cmd_wqes.size();
         for(i=0; i<cmd_wqes.size(); i++){
             POS_CHECK_POINTER(cmd_wqe = cmd_wqes[i]);
             this->__process_cmd(cmd_wqe);
@@ -99,30 +129,36 @@ void POSParser::__daemon(){
 
         // step 3: digest apicxt from rpc work queue
         apicxt_wqes.clear();
-        this->_client->poll_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_WQ>(&apicxt_wqes);
+        worker_wqes.clear();
+        this->_client->poll_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_WQ>(&apicxt_wqes, poll_batch_size);
+        nb_polled += apicxt_wqes.size();
 
         for(i=0; i<apicxt_wqes.size(); i++){
             POS_CHECK_POINTER(apicxt_wqe = apicxt_wqes[i]);
 
             api_id = apicxt_wqe->api_cxt->api_id;
-            api_meta = _ws->api_mgnr->api_metas[api_id];
+            api_index = this->_ws->api_mgnr->get_api_index(api_id);
 
         #if POS_CONF_RUNTIME_EnableDebugCheck
-            if(unlikely(_parser_functions.count(api_id) == 0)){
+            if(unlikely(
+                api_index == POSApiManager::kInvalidApiIndex || this->_parser_function_table[api_index] == nullptr
+            )){
                 POS_ERROR_C_DETAIL(
                     "runtime has no parser function for api %lu, need to implement", api_id
                 );
             }
         #endif
 
+            api_meta = &(this->_ws->api_mgnr->get_api_meta_by_index(api_index));
+
             apicxt_wqe->parser_s_tick = POSUtilTscTimer::get_tsc();
-            parser_retval = (*(this->_parser_functions[api_id]))(this->_ws, this, apicxt_wqe);
+            parser_retval = (*(this->_parser_function_table[api_index]))(this->_ws, this, apicxt_wqe);
             apicxt_wqe->parser_e_tick = POSUtilTscTimer::get_tsc();
 
             // set the return code
             apicxt_wqe->api_cxt->return_code = this->_ws->api_mgnr->cast_pos_retval(
                 /* pos_retval */ parser_retval, 
-                /* library_id */ api_meta.library_id
+                /* library_id */ api_meta->library_id
             );
 
             if(unlikely(POS_SUCCESS != parser_retval)){
@@ -132,7 +168,9 @@ void POSParser::__daemon(){
                 );
                 apicxt_wqe->status = kPOS_API_Execute_Status_Parser_Failed;
                 apicxt_wqe->return_tick = POSUtilTscTimer::get_tsc();
+                apicxt_wqe->get_ref();
                 this->_client->template push_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_CQ>(apicxt_wqe);
+                apicxt_wqe->put_ref();
                 continue;
             }
 
@@ -143,7 +181,7 @@ void POSParser::__daemon(){
              *              situation, which is passthrough addressed
              *  TODO: delete this block, should be implement in autogen system
              */
-            if(unlikely(api_meta.api_type == kPOS_API_Type_Delete_Resource)){
+            if(unlikely(api_meta->api_type == kPOS_API_Type_Delete_Resource)){
                 POS_DEBUG_C("api(%lu) is type of Delete_Resource, set as \"Return_After_Parse\"", api_id);
                 apicxt_wqe->status = kPOS_API_Execute_Status_Return_After_Parse;
             }
@@ -156,21 +194,33 @@ void POSParser::__daemon(){
                 ||  apicxt_wqe->status == kPOS_API_Execute_Status_Return_Without_Worker
             ){
                 apicxt_wqe->return_tick = POSUtilTscTimer::get_tsc();
-                this->_client->template push_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_CQ>(apicxt_wqe);
                 apicxt_wqe->has_return = true;
+                apicxt_wqe->get_ref();
+                this->_client->template push_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_CQ>(apicxt_wqe);
             }
 
             // launch the wqe to parser trace queue, if in resource trace mode
             if(this->_client->_cxt.trace_resource == true){
+                apicxt_wqe->get_ref();
                 this->_client->template push_q<kPOS_QueueDirection_ParserLocal, kPOS_QueueType_ApiCxt_Trace_WQ>(apicxt_wqe);
             }
 
             // skip those APIs that doesn't need worker support
-            if(apicxt_wqe->status == kPOS_API_Execute_Status_Return_Without_Worker){ continue; }
+            if(apicxt_wqe->status == kPOS_API_Execute_Status_Return_Without_Worker){
+                apicxt_wqe->put_ref();
+                continue;
+            }
+
+            // insert apicxt_wqe to worker queue, along with the reference held by the pipeline
+            worker_wqes.push_back(apicxt_wqe);
+        }
 
-            // insert apicxt_wqe to worker queue
-            this->_client->template push_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(apicxt_wqe);
+        // launch the parsed batch to the worker at once
+        if(worker_wqes.size() > 0){
+            this->_client->template push_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&worker_wqes);
         }
+
+        wait_strategy.end_round(/* has_work */ nb_polled > 0);
     }
 }
 
@@ -210,6 +260,10 @@ pos_retval_t POSParser::__process_cmd(POSCommand_QE_t *cmd){
                     POS_CHECK_POINTER(handle = hm->get_handle_by_id(i));
                     cmd->record_predump_handles(handle);
                 }
+
+                // consume handles modified since the previous checkpoint op
+                hm->get_modified_handles(&(cmd->dirty_handles));
+                hm->clear_modified_handle();
             }
             cmd->type = cmd->type == kPOS_Command_Oob2Parser_PreDump 
                         ? kPOS_Command_Parser2Worker_PreDump
@@ -224,6 +278,17 @@ pos_retval_t POSParser::__process_cmd(POSCommand_QE_t *cmd){
     /* ========== Ckpt CQ Command from worker thread ========== */
     case kPOS_Command_Parser2Worker_PreDump:
     case kPOS_Command_Parser2Worker_Dump:
+        // the checkpoint op failed, handles modified before it remain modified for the next one
+        if(unlikely(cmd->retval != POS_SUCCESS)){
+            for(i=0; i<cmd->dirty_handles.size(); i++){
+                POS_CHECK_POINTER(handle = cmd->dirty_handles[i]);
+                POS_CHECK_POINTER(
+                    hm = pos_get_client_typed_hm(this->_client, handle->resource_type_id, POSHandleManager<POSHandle>)
+                );
+                hm->record_modified_handle(handle);
+            }
+        }
+
         cmd->type = cmd->type == kPOS_Command_Parser2Worker_PreDump 
                     ? kPOS_Command_Oob2Parser_PreDump
                     : kPOS_Command_Oob2Parser_Dump;
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2024 The PhoenixOS Authors. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "pos/include/common.h"
+#include "pos/include/log.h"
+#include "pos/include/persist_executor.h"
+
+
+POSPersistExecutor* POSPersistExecutor::get_instance(){
+    static POSPersistExecutor executor;
+    return &executor;
+}
+
+
+POSPersistExecutor::~POSPersistExecutor(){
+    this->deinit();
+}
+
+
+pos_retval_t POSPersistExecutor::init(uint32_t nb_threads, uint64_t queue_capacity){
+    pos_retval_t retval = POS_SUCCESS;
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    if(unlikely(queue_capacity == 0)){
+        POS_WARN_C("failed to init persist executor, zero queue capacity");
+        retval = POS_FAILED_INVALID_INPUT;
+        goto exit;
+    }
+
+    // wait for other reconfiguration
+    this->_reconfig_cv.wait(lock, [this]{ return !this->_is_stop; });
+
+    if(this->_threads.size() > 0){ this->__stop(lock); }
+    this->__start(nb_threads, queue_capacity);
+
+exit:
+    return retval;
+}
+
+
+void POSPersistExecutor::deinit(){
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    this->_reconfig_cv.wait(lock, [this]{ return !this->_is_stop; });
+    if(this->_threads.size() > 0){ this->__stop(lock); }
+}
+
+
+void POSPersistExecutor::__start(uint32_t nb_threads, uint64_t queue_capacity){
+    uint32_t i;
+
+    if(nb_threads == 0){
+        nb_threads = std::thread::hardware_concurrency();
+        if(unlikely(nb_threads == 0)){ nb_threads = 1; }
+    }
+
+    this->_queue_capacity = queue_capacity;
+    for(i=0; i<nb_threads; i++){
+        this->_threads.push_back(new std::thread(&POSPersistExecutor::__worker_routine, this));
+        POS_CHECK_POINTER(this->_threads.back());
+    }
+
+    this->_stat.nb_threads = nb_threads;
+    this->_stat.queue_capacity = queue_capacity;
+
+    POS_DEBUG_C("persist executor started: #threads(%u), queue_capacity(%lu)", nb_threads, queue_capacity);
+}
+
+
+void POSPersistExecutor::__stop(std::unique_lock<std::mutex>& lock){
+    std::vector<std::thread*> threads;
+
+    this->_is_stop = true;
+    this->_not_empty_cv.notify_all();
+    threads.swap(this->_threads);
+
+    // workers exit once the queue is drained
+    lock.unlock();
+    for(std::thread *thread : threads){
+        if(thread->joinable()){ thread->join(); }
+        delete thread;
+    }
+    lock.lock();
+
+    this->_is_stop = false;
+    this->_stat.nb_threads = 0;
+    this->_reconfig_cv.notify_all();
+    this->_not_full_cv.notify_all();
+}
+
+
+std::future<pos_retval_t> POSPersistExecutor::submit(std::function<pos_retval_t()> task, const std::string& tag){
+    pos_persist_task_t *persist_task;
+    std::future<pos_retval_t> future;
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    POS_CHECK_POINTER(persist_task = new pos_persist_task_t);
+    persist_task->func = std::move(task);
+    persist_task->tag = tag;
+    future = persist_task->promise.get_future();
+
+    // wait for reconfiguration
+    this->_reconfig_cv.wait(lock, [this]{ return !this->_is_stop; });
+
+    if(unlikely(this->_threads.size() == 0)){
+        this->__start(/* nb_threads */ 0, kDefaultQueueCapacity);
+    }
+
+    // backpressure
+    if(this->_queue.size() >= this->_queue_capacity){
+        this->_stat.nb_blocked += 1;
+        this->_not_full_cv.wait(lock, [this]{
+            return !this->_is_stop && this->_queue.size() < this->_queue_capacity;
+        });
+    }
+
+    if(tag.size() > 0){ this->_groups[tag].nb_pending += 1; }
+    this->_queue.push_back(persist_task);
+    this->_stat.nb_submitted += 1;
+    this->_not_empty_cv.notify_one();
+
+    return future;
+}
+
+
+std::future<pos_retval_t> POSPersistExecutor::flush(const std::string& tag){
+    std::promise<pos_retval_t> promise;
+    std::future<pos_retval_t> future = promise.get_future();
+    typename std::map<std::string, pos_persist_group_t>::iterator group_iter;
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    group_iter = this->_groups.find(tag);
+    if(group_iter == this->_groups.end()){
+        promise.set_value(POS_SUCCESS);
+    } else if(group_iter->second.nb_pending == 0){
+        promise.set_value(group_iter->second.retval);
+        this->_groups.erase(group_iter);
+    } else {
+        group_iter->second.waiters.push_back(std::move(promise));
+    }
+
+    return future;
+}
+
+
+pos_retval_t POSPersistExecutor::parallel_for(
+    uint64_t nb_items, std::function<pos_retval_t(uint64_t)> func, uint32_t max_nb_helpers
+){
+    /*!
+     *  \brief  state shared by the calling thread and helpers, helpers that start after all items
+     *          are claimed would still access it after parallel_for returns
+     */
+    typedef struct parallel_for_state {
+        std::function<pos_retval_t(uint64_t)> func;
+        uint64_t nb_items;
+        std::atomic<uint64_t> next;
+        std::atomic<uint64_t> nb_done;
+        pos_retval_t retval;
+        std::mutex mutex;
+        std::condition_variable done_cv;
+    } parallel_for_state_t;
+
+    uint64_t i, nb_helpers;
+    pos_persist_task_t *persist_task;
+    std::shared_ptr<parallel_for_state_t> state;
+
+    auto __run_items = [](std::shared_ptr<parallel_for_state_t> state) -> pos_retval_t {
+        uint64_t index;
+        pos_retval_t retval;
+        while((index = state->next.fetch_add(1)) < state->nb_items){
+            retval = state->func(index);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if(unlikely(retval != POS_SUCCESS && state->retval == POS_SUCCESS)){ state->retval = retval; }
+            if(state->nb_done.fetch_add(1) + 1 == state->nb_items){ state->done_cv.notify_all(); }
+        }
+        return POS_SUCCESS;
+    };
+
+    if(unlikely(nb_items == 0)){ return POS_SUCCESS; }
+
+    POS_CHECK_POINTER(state = std::make_shared<parallel_for_state_t>());
+    state->func = std::move(func);
+    state->nb_items = nb_items;
+    state->next = 0;
+    state->nb_done = 0;
+    state->retval = POS_SUCCESS;
+
+    // queue helpers without blocking, the calling thread would process the rest by itself
+    if(nb_items > 1){
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(unlikely(this->_threads.size() == 0 && !this->_is_stop)){
+            this->__start(/* nb_threads */ 0, kDefaultQueueCapacity);
+        }
+        nb_helpers = max_nb_helpers > 0 ? max_nb_helpers : this->_threads.size();
+        nb_helpers = std::min<uint64_t>(nb_helpers, nb_items - 1);
+        for(i=0; i<nb_helpers && !this->_is_stop && this->_queue.size() < this->_queue_capacity; i++){
+            POS_CHECK_POINTER(persist_task = new pos_persist_task_t);
+            persist_task->func = [__run_items, state](){ return __run_items(state); };
+            this->_queue.push_back(persist_task);
+            this->_stat.nb_submitted += 1;
+            this->_not_empty_cv.notify_one();
+        }
+    }
+
+    __run_items(state);
+
+    // only items claimed by running helpers are left
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done_cv.wait(lock, [&state]{ return state->nb_done.load() == state->nb_items; });
+    return state->retval;
+}
+
+
+void POSPersistExecutor::get_stat(pos_persist_executor_stat_t& stat){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    stat = this->_stat;
+}
+
+
+void POSPersistExecutor::__worker_routine(){
+    pos_retval_t retval;
+    pos_persist_task_t *persist_task;
+    typename std::map<std::string, pos_persist_group_t>::iterator group_iter;
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    while(true){
+        this->_not_empty_cv.wait(lock, [this]{ return this->_queue.size() > 0 || this->_is_stop; });
+        if(unlikely(this->_queue.size() == 0)){ break; }
+
+        persist_task = this->_queue.front();
+        this->_queue.pop_front();
+        this->_not_full_cv.notify_one();
+
+        lock.unlock();
+        retval = persist_task->func();
+        persist_task->promise.set_value(retval);
+        lock.lock();
+
+        this->_stat.nb_finished += 1;
+        if(unlikely(retval != POS_SUCCESS)){ this->_stat.nb_failed += 1; }
+
+        if(persist_task->tag.size() > 0){
+            group_iter = this->_groups.find(persist_task->tag);
+            POS_ASSERT(group_iter != this->_groups.end());
+            if(unlikely(retval != POS_SUCCESS && group_iter->second.retval == POS_SUCCESS)){
+                group_iter->second.retval = retval;
+            }
+            group_iter->second.nb_pending -= 1;
+            if(group_iter->second.nb_pending == 0 && group_iter->second.waiters.size() > 0){
+                for(std::promise<pos_retval_t> &waiter : group_iter->second.waiters){
+                    waiter.set_value(group_iter->second.retval);
+                }
+                this->_groups.erase(group_iter);
+            } else if(group_iter->second.nb_pending == 0 && group_iter->second.retval == POS_SUCCESS){
+                // nothing to report, flushing a released tag also returns POS_SUCCESS
+                this->_groups.erase(group_iter);
+            }
+        }
+
+        delete persist_task;
+    }
+}
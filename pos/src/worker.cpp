@@ -30,7 +30,11 @@
 #include "pos/include/worker.h"
 #include "pos/include/utils/lockfree_queue.h"
 #include "pos/include/api_context.h"
+#include "pos/include/apicxt_log.h"
 #include "pos/include/trace.h"
+#include "pos/include/checkpoint_arena.h"
+#include "pos/include/checkpoint_retention.h"
+#include "pos/include/persist_executor.h"
 
 
 POSWorker::POSWorker(POSWorkspace* ws, POSClient* client) : _max_wqe_id(0) {
@@ -72,11 +76,17 @@ pos_retval_t POSWorker::init(){
     if(unlikely(POS_SUCCESS != this->init_wk_functions())){
         POS_ERROR_C_DETAIL("failed to insert functions");
     }
+
+    POS_CHECK_POINTER(this->_ws->api_mgnr);
+    this->_ws->api_mgnr->build_dispatch_table(this->_launch_functions, this->_launch_function_table);
+
+    return POS_SUCCESS;
 }
 
 
 void POSWorker::shutdown(){ 
     this->_stop_flag = true;
+    this->_client->get_worker_wait_event()->notify();
     if(this->_daemon_thread != nullptr){
         if(this->_daemon_thread->joinable()){
             this->_daemon_thread->join();
@@ -123,6 +133,9 @@ void POSWorker::__daemon(){
         return;
     }
 
+    // checkpoint memory allocated by this thread is accounted to the client
+    POSCheckpointArena::set_thread_client(this->_client->id);
+
     #if POS_CONF_EVAL_MigrOptLevel == 0
         // case: continuous checkpoint
         #if POS_CONF_EVAL_CkptOptLevel <= 1
@@ -140,21 +153,37 @@ void POSWorker::__daemon(){
 
 
 void POSWorker::__daemon_ckpt_sync(){
-    uint64_t i, api_id;
+    uint64_t i, api_id, nb_polled, poll_batch_size;
+    uint32_t api_index;
     pos_retval_t launch_retval;
-    POSAPIMeta_t api_meta;
+    const POSAPIMeta_t *api_meta;
     POSAPIContext_QE *wqe;
     std::vector<POSAPIContext_QE*> wqes;
     POSCommand_QE_t *cmd_wqe;
     std::vector<POSCommand_QE_t*> cmd_wqes;
+    pos_wait_policy_t wait_policy;
+
+    // spin, then yield, then park while all queues are empty
+    this->_client->get_daemon_wait_policy(wait_policy);
+    POSWaitStrategy wait_strategy(this->_client->get_worker_wait_event(), wait_policy);
+
+    // execute at most a batch of apicxt per round, so that commands are still digested under heavy load
+    poll_batch_size = this->_client->get_daemon_poll_batch_size();
+    wqes.reserve(poll_batch_size);
 
     while(!_stop_flag){
+        wait_strategy.begin_round();
+
         // if the client isn't ready, the queue might not exist, we can't do any queue operation
-        if(this->_client->status != kPOS_ClientStatus_Active){ continue; }
+        if(this->_client->status != kPOS_ClientStatus_Active){
+            wait_strategy.end_round(/* has_work */ false);
+            continue;
+        }
 
         // step 1: digest cmd from parser work queue
         cmd_wqes.clear();
         this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_Cmd_WQ>(&cmd_wqes);
+        nb_polled = cmd_wqes.size();
         for(i=0; i<cmd_wqes.size(); i++){
             POS_CHECK_POINTER(cmd_wqe = cmd_wqes[i]);
             this->__process_cmd(cmd_wqe);
@@ -162,7 +191,8 @@ void POSWorker::__daemon_ckpt_sync(){
 
         // step 2: digest apicxt from parser work queue
         wqes.clear();
-        this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&wqes);
+        this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&wqes, poll_batch_size);
+        nb_polled += wqes.size();
 
         for(i=0; i<wqes.size(); i++){
             POS_CHECK_POINTER(wqe = wqes[i]);
@@ -171,29 +201,49 @@ void POSWorker::__daemon_ckpt_sync(){
             wqe->worker_s_tick = POSUtilTscTimer::get_tsc();
             
             api_id = wqe->api_cxt->api_id;
-            api_meta = this->_ws->api_mgnr->api_metas[api_id];
-
-            // check and restore broken handles
-            if(unlikely(POS_SUCCESS != __restore_broken_handles(wqe, &api_meta))){
-                POS_WARN_C("failed to check / restore broken handles: api_id(%lu)", api_id);
-                continue;
-            }
+            api_index = this->_ws->api_mgnr->get_api_index(api_id);
 
         #if POS_CONF_RUNTIME_EnableDebugCheck
-            if(unlikely(this->_launch_functions.count(api_id) == 0)){
+            if(unlikely(
+                api_index == POSApiManager::kInvalidApiIndex || this->_launch_function_table[api_index] == nullptr
+            )){
                 POS_ERROR_C_DETAIL(
                     "runtime has no worker launch function for api %lu, need to implement", api_id
                 );
             }
         #endif
 
-            launch_retval = (*(this->_launch_functions[api_id]))(this->_ws, wqe);
+            api_meta = &(this->_ws->api_mgnr->get_api_meta_by_index(api_index));
+
+            // check and restore broken handles, the API fails without launching if any handle can't be restored
+            if(unlikely(POS_SUCCESS != (launch_retval = __restore_broken_handles(wqe, api_meta)))){
+                POS_WARN_C("failed to check / restore broken handles: api_id(%lu)", api_id);
+                wqe->worker_e_tick = POSUtilTscTimer::get_tsc();
+                wqe->api_cxt->return_code = _ws->api_mgnr->cast_pos_retval(
+                    /* pos_retval */ launch_retval, 
+                    /* library_id */ api_meta->library_id
+                );
+                wqe->status = kPOS_API_Execute_Status_Worker_Failed;
+                if(wqe->has_return == false){
+                    wqe->return_tick = POSUtilTscTimer::get_tsc();
+                    wqe->has_return = true;
+                    wqe->get_ref();
+                    this->_client->template push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(wqe);
+                }
+                POS_ASSERT(wqe->id >= this->_max_wqe_id);
+                this->_max_wqe_id = wqe->id;
+                wqe->put_ref();
+                continue;
+            }
+
+            launch_retval = (*(this->_launch_function_table[api_index]))(this->_ws, wqe);
             wqe->worker_e_tick = POSUtilTscTimer::get_tsc();
+            this->_client->record_api_executed();
 
             // cast return code
             wqe->api_cxt->return_code = _ws->api_mgnr->cast_pos_retval(
                 /* pos_retval */ launch_retval, 
-                /* library_id */ api_meta.library_id
+                /* library_id */ api_meta->library_id
             );
 
             // check whether the execution is success
@@ -201,16 +251,43 @@ void POSWorker::__daemon_ckpt_sync(){
                 wqe->status = kPOS_API_Execute_Status_Worker_Failed;
             }
 
+        #if POS_CONF_EVAL_CkptEnableIncremental == 1 && POS_CONF_EVAL_CkptOptLevel == 1
+            // a failed API might still have written partially, so its ranges are recorded as well
+            this->__record_modified_ranges(wqe);
+        #endif
+
             // check whether we need to return to frontend
             if(wqe->has_return == false){
                 // we only return the QE back to frontend when it hasn't been returned before
                 wqe->return_tick = POSUtilTscTimer::get_tsc();
-                this->_client->template push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(wqe);
                 wqe->has_return = true;
+                wqe->get_ref();
+                this->_client->template push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(wqe);
             }
 
             POS_ASSERT(wqe->id >= this->_max_wqe_id);
             this->_max_wqe_id = wqe->id;
+
+            // release the reference held by the processing pipeline
+            wqe->put_ref();
+        }
+
+        wait_strategy.end_round(/* has_work */ nb_polled > 0);
+    }
+}
+
+
+void POSWorker::__record_modified_ranges(POSAPIContext_QE_t* wqe){
+    POS_CHECK_POINTER(wqe);
+
+    for(POSHandleView_t &view : wqe->output_handle_views){
+        if(view.handle->ckpt_delta_chain != nullptr){
+            view.handle->ckpt_delta_chain->record_modified_range(view.offset, view.size);
+        }
+    }
+    for(POSHandleView_t &view : wqe->inout_handle_views){
+        if(view.handle->ckpt_delta_chain != nullptr){
+            view.handle->ckpt_delta_chain->record_modified_range(view.offset, view.size);
         }
     }
 }
@@ -218,7 +295,7 @@ void POSWorker::__daemon_ckpt_sync(){
 
 pos_retval_t POSWorker::__checkpoint_handle_sync(POSCommand_QE_t *cmd){
     pos_retval_t retval = POS_SUCCESS;
-    uint64_t nb_ckpt_handles = 0, ckpt_size = 0;
+    uint64_t nb_ckpt_handles = 0, ckpt_size = 0, full_ckpt_size = 0;
     typename std::set<POSHandle*>::iterator set_iter;
 
     POS_CHECK_POINTER(cmd);
@@ -247,7 +324,11 @@ pos_retval_t POSWorker::__checkpoint_handle_sync(POSCommand_QE_t *cmd){
         }
 
         nb_ckpt_handles += 1;
-        ckpt_size += handle->state_size;
+        full_ckpt_size += handle->state_size;
+        // handles with delta chain only copy the chunks modified since their last commit
+        ckpt_size += handle->ckpt_delta_chain != nullptr
+                        ? handle->ckpt_delta_chain->get_last_commit_size()
+                        : handle->state_size;
     }
 
     // for dump, we also need to save dump handles
@@ -275,6 +356,7 @@ pos_retval_t POSWorker::__checkpoint_handle_sync(POSCommand_QE_t *cmd){
             }
 
             nb_ckpt_handles += 1;
+            full_ckpt_size += handle->state_size;
             ckpt_size += handle->state_size;
         }
     }
@@ -283,12 +365,20 @@ pos_retval_t POSWorker::__checkpoint_handle_sync(POSCommand_QE_t *cmd){
     retval = this->sync();
     if(unlikely(retval != POS_SUCCESS)){
         POS_WARN_C("checkpoint unfinished: failed to synchronize");
+        goto exit;
+    }
+
+    // make sure all persisting tasks of this dump are finished
+    retval = POSPersistExecutor::get_instance()->flush(cmd->ckpt_dir).get();
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("checkpoint unfinished: failed to persist: retval(%u)", retval);
     } else {
         // TODO: record to trace
         POS_LOG(
-            "checkpoint finished: #finished_handles(%lu), size(%lu Bytes)",
-            nb_ckpt_handles, ckpt_size
+            "checkpoint finished: #finished_handles(%lu), #dirty_handles(%lu), size(%lu Bytes), full size(%lu Bytes)",
+            nb_ckpt_handles, cmd->dirty_handles.size(), ckpt_size, full_ckpt_size
         );
+        POSCheckpointRetention::get_instance()->notify();
     }
 
 exit:
@@ -297,7 +387,7 @@ exit:
 
 
 pos_retval_t POSWorker::__process_cmd(POSCommand_QE_t *cmd){
-    pos_retval_t retval = POS_SUCCESS;
+    pos_retval_t retval = POS_SUCCESS, persist_retval;
     POSHandleManager<POSHandle>* hm;
     POSHandle *handle;
     uint64_t i, nb_ckpt_wqes;
@@ -325,25 +415,44 @@ pos_retval_t POSWorker::__process_cmd(POSCommand_QE_t *cmd){
         // pre-dump is done here
         if(cmd->type == kPOS_Command_Parser2Worker_PreDump){ goto reply_parser; }
 
-        // for dump, we also need to save unexecuted APIs
-        nb_ckpt_wqes = 0;
-        while(max_wqe_id < this->_client->_api_inst_pc-1 && this->_max_wqe_id < this->_client->_api_inst_pc-1){
-            // we need to make sure we drain all unexecuted APIs
-            // POS_LOG("max_wqe_id: %lu, _api_inst_pc-1:%lu", max_wqe_id, this->_client->_api_inst_pc - 1);
-            wqes.clear();
-            this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&wqes);
-            for(i=0; i<wqes.size(); i++){
-                POS_CHECK_POINTER(wqe = wqes[i]);
-                POS_CHECK_POINTER(wqe->api_cxt);
-                if(unlikely(POS_SUCCESS != (retval = wqe->persist</* with_params */ true>(cmd->ckpt_dir)))){
-                    POS_WARN_C("failed to do checkpointing of unexecuted APIs");
-                    goto reply_parser;
+        // for dump, we also need to save unexecuted APIs, which are framed into the API context log of
+        // the dump, and flushed to the checkpoint image batch by batch
+        {
+            POSAPIContextLogWriter apicxt_log(cmd->ckpt_dir);
+            pos_apicxt_log_stat_t apicxt_log_stat;
+
+            nb_ckpt_wqes = 0;
+            while(max_wqe_id < this->_client->_api_inst_pc-1 && this->_max_wqe_id < this->_client->_api_inst_pc-1){
+                // we need to make sure we drain all unexecuted APIs
+                // POS_LOG("max_wqe_id: %lu, _api_inst_pc-1:%lu", max_wqe_id, this->_client->_api_inst_pc - 1);
+                wqes.clear();
+                this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&wqes);
+                for(i=0; i<wqes.size(); i++){
+                    POS_CHECK_POINTER(wqe = wqes[i]);
+                    POS_CHECK_POINTER(wqe->api_cxt);
+                    // keep draining on failure, so that all drained APIs are released
+                    if(unlikely(POS_SUCCESS != (persist_retval = wqe->persist</* with_params */ true>(&apicxt_log)))){
+                        retval = persist_retval;
+                    }
+                    nb_ckpt_wqes += 1;
+                    max_wqe_id = (wqe->id > max_wqe_id) ? wqe->id : max_wqe_id;
+                    wqe->put_ref();
                 }
-                nb_ckpt_wqes += 1;
-                max_wqe_id = (wqe->id > max_wqe_id) ? wqe->id : max_wqe_id;
             }
+            if(unlikely(POS_SUCCESS != (persist_retval = apicxt_log.flush()))){ retval = persist_retval; }
+            if(unlikely(POS_SUCCESS != (persist_retval = POSPersistExecutor::get_instance()->flush(cmd->ckpt_dir).get()))){
+                retval = persist_retval;
+            }
+            if(unlikely(retval != POS_SUCCESS)){
+                POS_WARN_C("failed to do checkpointing of unexecuted APIs");
+                goto reply_parser;
+            }
+            apicxt_log_stat = apicxt_log.get_stat();
+            POS_LOG_C(
+                "finished dumping unexecuted APIs: nb_ckpt_wqes(%lu), nb_segments(%lu), size(%lu)",
+                nb_ckpt_wqes, apicxt_log_stat.nb_segments, apicxt_log_stat.size
+            );
         }
-        POS_LOG_C("finished dumping unexecuted APIs: nb_ckpt_wqes(%lu)", nb_ckpt_wqes);
 
         // tear down all handles inside the client
         if(unlikely(POS_SUCCESS != (retval = this->_client->tear_down_all_handles()))){
@@ -372,22 +481,38 @@ exit:
 
 
 void POSWorker::__daemon_ckpt_async(){
-    uint64_t i, api_id;
+    uint64_t i, api_id, nb_polled, poll_batch_size;
+    uint32_t api_index;
     pos_retval_t launch_retval, tmp_retval;
-    POSAPIMeta_t api_meta;
+    const POSAPIMeta_t *api_meta;
     POSAPIContext_QE *wqe;
     std::vector<POSAPIContext_QE*> wqes;
     POSCommand_QE_t *cmd_wqe;
     std::vector<POSCommand_QE_t*> cmd_wqes;
+    pos_wait_policy_t wait_policy;
     POSHandle *handle;
 
+    // spin, then yield, then park while all queues are empty
+    this->_client->get_daemon_wait_policy(wait_policy);
+    POSWaitStrategy wait_strategy(this->_client->get_worker_wait_event(), wait_policy);
+
+    // execute at most a batch of apicxt per round, so that commands are still digested under heavy load
+    poll_batch_size = this->_client->get_daemon_poll_batch_size();
+    wqes.reserve(poll_batch_size);
+
     while(!_stop_flag){
+        wait_strategy.begin_round();
+
         // if the client isn't ready, the queue might not exist, we can't do any queue operation
-        if(this->_client->status != kPOS_ClientStatus_Active){ continue; }
+        if(this->_client->status != kPOS_ClientStatus_Active){
+            wait_strategy.end_round(/* has_work */ false);
+            continue;
+        }
 
         // step 1: digest cmd from parser work queue
         cmd_wqes.clear();
         this->_client->poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_Cmd_WQ>(&cmd_wqes);
+        nb_polled = cmd_wqes.size();
         for(i=0; i<cmd_wqes.size(); i++){
             POS_CHECK_POINTER(cmd_wqe = cmd_wqes[i]);
             this->__process_cmd(cmd_wqe);
@@ -395,7 +520,8 @@ void POSWorker::__daemon_ckpt_async(){
 
         // step 2: digest apicxt from parser work queue
         wqes.clear();
-        this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&wqes);
+        this->_client->template poll_q<kPOS_QueueDirection_Parser2Worker, kPOS_QueueType_ApiCxt_WQ>(&wqes, poll_batch_size);
+        nb_polled += wqes.size();
 
         for(i=0; i<wqes.size(); i++){
             POS_CHECK_POINTER(wqe = wqes[i]);
@@ -406,27 +532,45 @@ void POSWorker::__daemon_ckpt_async(){
              *  \brief  if the async ckpt thread is active, we cache this wqe for potential recomputation while restoring
              */
             if(unlikely(this->async_ckpt_cxt.is_active == true)){
+                wqe->get_ref();
                 this->_client->template push_q<kPOS_QueueDirection_WorkerLocal, kPOS_QueueType_ApiCxt_CkptDag_WQ>(wqe);
             }
 
             POS_CHECK_POINTER(wqe->api_cxt);
             api_id = wqe->api_cxt->api_id;
-            api_meta = this->_ws->api_mgnr->api_metas[api_id];
-
-            // check and restore broken handles
-            if(unlikely(POS_SUCCESS != __restore_broken_handles(wqe, &api_meta))){
-                POS_WARN_C("failed to check / restore broken handles: api_id(%lu)", api_id);
-                continue;
-            }
+            api_index = this->_ws->api_mgnr->get_api_index(api_id);
 
             #if POS_CONF_RUNTIME_EnableDebugCheck
-                if(unlikely(_launch_functions.count(api_id) == 0)){
+                if(unlikely(
+                    api_index == POSApiManager::kInvalidApiIndex || this->_launch_function_table[api_index] == nullptr
+                )){
                     POS_ERROR_C_DETAIL(
                         "runtime has no worker launch function for api %lu, need to implement", api_id
                     );
                 }
             #endif
 
+            api_meta = &(this->_ws->api_mgnr->get_api_meta_by_index(api_index));
+
+            // check and restore broken handles, the API fails without launching if any handle can't be restored
+            if(unlikely(POS_SUCCESS != (launch_retval = __restore_broken_handles(wqe, api_meta)))){
+                POS_WARN_C("failed to check / restore broken handles: api_id(%lu)", api_id);
+                wqe->worker_e_tick = POSUtilTscTimer::get_tsc();
+                wqe->api_cxt->return_code = _ws->api_mgnr->cast_pos_retval(
+                    /* pos_retval */ launch_retval, 
+                    /* library_id */ api_meta->library_id
+                );
+                wqe->status = kPOS_API_Execute_Status_Worker_Failed;
+                if(wqe->has_return == false){
+                    wqe->return_tick = POSUtilTscTimer::get_tsc();
+                    wqe->has_return = true;
+                    wqe->get_ref();
+                    this->_client->template push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(wqe);
+                }
+                wqe->put_ref();
+                continue;
+            }
+
             if(unlikely(this->async_ckpt_cxt.is_active == true)){
                 /*!
                 *  \brief  before launching the API, we need to preserve the state of all stateful resources for checkpointing
@@ -488,13 +632,14 @@ void POSWorker::__daemon_ckpt_async(){
             } // this->async_ckpt_cxt.is_active == true
             
         
-            launch_retval = (*(_launch_functions[api_id]))(_ws, wqe);
+            launch_retval = (*(this->_launch_function_table[api_index]))(this->_ws, wqe);
             wqe->worker_e_tick = POSUtilTscTimer::get_tsc();
+            this->_client->record_api_executed();
 
             // cast return code
             wqe->api_cxt->return_code = _ws->api_mgnr->cast_pos_retval(
                 /* pos_retval */ launch_retval, 
-                /* library_id */ api_meta.library_id
+                /* library_id */ api_meta->library_id
             );
 
             // check whether the execution is success
@@ -506,10 +651,16 @@ void POSWorker::__daemon_ckpt_async(){
             if(wqe->has_return == false){
                 // we only return the QE back to frontend when it hasn't been returned before
                 wqe->return_tick = POSUtilTscTimer::get_tsc();
-                this->_client->template push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(wqe);
                 wqe->has_return = true;
+                wqe->get_ref();
+                this->_client->template push_q<kPOS_QueueDirection_Rpc2Worker, kPOS_QueueType_ApiCxt_CQ>(wqe);
             }
+
+            // release the reference held by the processing pipeline
+            wqe->put_ref();
         }
+
+        wait_strategy.end_round(/* has_work */ nb_polled > 0);
     }
 }
 
@@ -533,6 +684,9 @@ void POSWorker::__checkpoint_async_thread() {
     POS_CHECK_POINTER(cmd = this->async_ckpt_cxt.cmd);
     POS_ASSERT(this->_ckpt_stream_id != 0);
 
+    // checkpoint memory allocated by this thread is accounted to the client
+    POSCheckpointArena::set_thread_client(this->_client->id);
+
 #if POS_CONF_EVAL_CkptEnablePipeline == 1
     POS_ASSERT(this->_ckpt_commit_stream_id != 0);
 #endif
@@ -595,6 +749,8 @@ void POSWorker::__checkpoint_async_thread() {
         if(unlikely(retval != POS_SUCCESS)){
             POS_WARN("failed to sync the commit within ckpt thread: server_addr(%p), version_id(%lu)", handle->server_addr, checkpoint_version);
             dirty_retval = retval;
+        } else {
+            handle->checkpoint_settle(checkpoint_version);
         }
 
         POS_TRACE_TICK_APPEND(ckpt, ckpt_commit);
@@ -619,6 +775,8 @@ void POSWorker::__checkpoint_async_thread() {
         if(unlikely(retval != POS_SUCCESS)){
             POS_WARN("failed to sync the commit within ckpt thread: server_addr(%p), version_id(%lu)", handle->server_addr, checkpoint_version);
             dirty_retval = retval;
+        } else {
+            handle->checkpoint_settle(checkpoint_version);
         }
 
         POS_TRACE_TICK_APPEND(ckpt, ckpt_commit);
@@ -634,6 +792,9 @@ void POSWorker::__checkpoint_async_thread() {
     // mark overlap ckpt stop immediately
     this->async_ckpt_cxt.is_active = false;
 
+    // new versions are committed, so that older ones could be reclaimed
+    POSCheckpointRetention::get_instance()->notify();
+
     // collect the statistic of of this checkpoint round
     #if POS_CONF_RUNTIME_EnableTrace
         POS_LOG(
@@ -709,6 +870,7 @@ pos_retval_t POSWorker::__process_cmd(POSCommand_QE_t *cmd){
     POSHandle *handle;
     uint64_t i;
     typename std::set<POSHandle*>::iterator handle_set_iter;
+    std::vector<POSAPIContext_QE*> ckpt_dag_wqes;
 
     POS_CHECK_POINTER(cmd);
 
@@ -760,8 +922,10 @@ pos_retval_t POSWorker::__process_cmd(POSCommand_QE_t *cmd){
             delete this->async_ckpt_cxt.thread;
         }
 
-        // clear the ckpt dag queue
-        this->_client->clear_q<kPOS_QueueDirection_WorkerLocal, kPOS_QueueType_ApiCxt_CkptDag_WQ>();
+        // clear the ckpt dag queue, and release the references it holds
+        ckpt_dag_wqes.clear();
+        this->_client->template poll_q<kPOS_QueueDirection_WorkerLocal, kPOS_QueueType_ApiCxt_CkptDag_WQ>(&ckpt_dag_wqes);
+        for(POSAPIContext_QE *ckpt_dag_wqe : ckpt_dag_wqes){ ckpt_dag_wqe->put_ref(); }
 
         // reset checkpoint version map
         this->async_ckpt_cxt.checkpoint_version_map.clear();
@@ -793,13 +957,13 @@ exit:
 #endif // POS_CONF_EVAL_CkptOptLevel
 
 
-pos_retval_t POSWorker::__restore_broken_handles(POSAPIContext_QE* wqe, POSAPIMeta_t* api_meta){
+pos_retval_t POSWorker::__restore_broken_handles(POSAPIContext_QE* wqe, const POSAPIMeta_t* api_meta){
     pos_retval_t retval = POS_SUCCESS;
     
     POS_CHECK_POINTER(wqe);
     POS_CHECK_POINTER(api_meta);
 
-    auto __restore_broken_hendles_per_direction = [&](std::vector<POSHandleView_t>& handle_view_vec){
+    auto __restore_broken_hendles_per_direction = [&](std::vector<POSHandleView_t>& handle_view_vec, bool with_state){
         uint64_t i;
         POSHandle::pos_broken_handle_list_t broken_handle_list;
         POSHandle *broken_handle;
@@ -850,13 +1014,26 @@ pos_retval_t POSWorker::__restore_broken_handles(POSAPIContext_QE* wqe, POSAPIMe
             } // while (1)
 
         } // foreach handle_view_vec
+
+        // step 2: reload states deferred by lazy restore
+        if(with_state){
+            for(i=0; i<handle_view_vec.size(); i++){
+                if(unlikely(POS_SUCCESS != this->_client->reload_pending_state(handle_view_vec[i].handle))){
+                    POS_WARN_C(
+                        "failed to reload deferred state: resource_type(%s), client_addr(%p)",
+                        handle_view_vec[i].handle->get_resource_name().c_str(), handle_view_vec[i].handle->client_addr
+                    );
+                    retval = POS_FAILED;
+                }
+            }
+        }
     };
 
-    __restore_broken_hendles_per_direction(wqe->input_handle_views);
-    __restore_broken_hendles_per_direction(wqe->output_handle_views);
-    __restore_broken_hendles_per_direction(wqe->inout_handle_views);
-    __restore_broken_hendles_per_direction(wqe->create_handle_views);
-    __restore_broken_hendles_per_direction(wqe->delete_handle_views);
+    __restore_broken_hendles_per_direction(wqe->input_handle_views, /* with_state */ true);
+    __restore_broken_hendles_per_direction(wqe->output_handle_views, /* with_state */ true);
+    __restore_broken_hendles_per_direction(wqe->inout_handle_views, /* with_state */ true);
+    __restore_broken_hendles_per_direction(wqe->create_handle_views, /* with_state */ false);
+    __restore_broken_hendles_per_direction(wqe->delete_handle_views, /* with_state */ false);
 
 exit:
     return retval;
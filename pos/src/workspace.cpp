@@ -18,6 +18,11 @@
 #include <string>
 #include <filesystem>
 #include "pos/include/workspace.h"
+#include "pos/include/checkpoint_arena.h"
+#include "pos/include/checkpoint_delta.h"
+#include "pos/include/checkpoint_retention.h"
+#include "pos/include/checkpoint_spill.h"
+#include "pos/include/checkpoint_storage.h"
 #include "pos/include/proto/handle.pb.h"
 #include "pos/include/proto/client.pb.h"
 
@@ -40,6 +45,13 @@ POSWorkspaceConf::POSWorkspaceConf(POSWorkspace *root_ws){
     this->_runtime_daemon_log_path = POS_CONF_RUNTIME_DefaultDaemonLogPath;
     this->_runtime_trace_resource = false;
     this->_runtime_trace_performance = false;
+    this->_runtime_persist_nb_threads = 0;
+    this->_runtime_persist_queue_capacity = POSPersistExecutor::kDefaultQueueCapacity;
+    this->_runtime_ckpt_client_quota = 0;
+    this->_runtime_ckpt_spill_dir = "/tmp";
+    this->_runtime_restore_nb_threads = 0;
+    this->_runtime_restore_lazy = false;
+    this->_runtime_daemon_poll_batch_size = POSClient::kDefaultDaemonPollBatchSize;
 
     // evaluation configurations
     this->_eval_ckpt_interval_tick = this->_root_ws->tsc_timer.ms_to_tick(
@@ -48,6 +60,23 @@ POSWorkspaceConf::POSWorkspaceConf(POSWorkspace *root_ws){
 }
 
 
+pos_retval_t POSWorkspaceConf::parse_u64(const std::string& val, const char* what, uint64_t& out){
+    pos_retval_t retval = POS_SUCCESS;
+
+    try {
+        out = std::stoull(val);
+    } catch (const std::invalid_argument& e) {
+        POS_WARN("%s: %s", what, e.what());
+        retval = POS_FAILED_INVALID_INPUT;
+    } catch (const std::out_of_range& e) {
+        POS_WARN("%s: %s", what, e.what());
+        retval = POS_FAILED_INVALID_INPUT;
+    }
+
+    return retval;
+}
+
+
 pos_retval_t POSWorkspaceConf::set(ConfigType conf_type, std::string val){
     pos_retval_t retval = POS_SUCCESS;
     std::lock_guard<std::mutex> lock(this->_mutex);
@@ -85,24 +114,303 @@ pos_retval_t POSWorkspaceConf::set(ConfigType conf_type, std::string val){
         this->_runtime_trace_dir = val;
         break;
 
-    case kEvalCkptIntervfalMs:
-        try {
-            _tmp = std::stoull(val);
-        } catch (const std::invalid_argument& e) {
-            POS_WARN_C("failed to set ckpt interval: %s", e.what());
+    case kRuntimePersistThreads:
+    case kRuntimePersistQueueCapacity:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set persist executor", _tmp)))){
+            goto exit;
+        }
+        if(conf_type == kRuntimePersistThreads){
+            this->_runtime_persist_nb_threads = static_cast<uint32_t>(_tmp);
+        } else {
+            this->_runtime_persist_queue_capacity = _tmp;
+        }
+        retval = POSPersistExecutor::get_instance()->init(
+            this->_runtime_persist_nb_threads, this->_runtime_persist_queue_capacity
+        );
+        if(likely(retval == POS_SUCCESS)){
+            POS_LOG_C(
+                "set persist executor: #threads(%u), queue_capacity(%lu)",
+                this->_runtime_persist_nb_threads, this->_runtime_persist_queue_capacity
+            );
+        }
+        break;
+
+    case kRuntimeCkptIOBackend:
+    case kRuntimeCkptIOQueueDepth:
+    case kRuntimeCkptIODirectEnabled:
+        if(conf_type == kRuntimeCkptIOBackend){
+            if(val == "io_uring"){
+                this->_runtime_ckpt_io_options.type = kPOS_CkptIOBackend_IoUring;
+            } else if(val == "posix"){
+                this->_runtime_ckpt_io_options.type = kPOS_CkptIOBackend_Posix;
+            } else {
+                POS_WARN_C("failed to set checkpoint I/O backend, unknown backend %s", val.c_str());
+                retval = POS_FAILED_INVALID_INPUT;
+                goto exit;
+            }
+        } else if(conf_type == kRuntimeCkptIOQueueDepth){
+            if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set checkpoint I/O queue depth", _tmp)))){
+                goto exit;
+            }
+            this->_runtime_ckpt_io_options.queue_depth = static_cast<uint32_t>(_tmp);
+        } else {
+            this->_runtime_ckpt_io_options.use_direct_io = (val == "true");
+        }
+        retval = POSCheckpointIOBackend::init(this->_runtime_ckpt_io_options);
+        if(unlikely(retval == POS_FAILED_NOT_ENABLED)){
+            POS_WARN_C("io_uring is unavailable, checkpoint I/O falls back to POSIX backend");
+            retval = POS_SUCCESS;
+        }
+        if(likely(retval == POS_SUCCESS)){
+            POS_LOG_C(
+                "set checkpoint I/O backend: type(%u), queue_depth(%u), direct_io(%s)",
+                POSCheckpointIOBackend::get_instance()->get_options().type,
+                this->_runtime_ckpt_io_options.queue_depth,
+                this->_runtime_ckpt_io_options.use_direct_io ? "true" : "false"
+            );
+        }
+        break;
+
+    case kRuntimeCkptDedupChunkSize:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set checkpoint dedup chunk size", _tmp)))){
+            goto exit;
+        }
+        // chunks are stored at aligned positions, so that they could be written with direct I/O
+        if(unlikely(_tmp % POSCheckpointImageWriter::kSectionAlignment != 0)){
+            POS_WARN_C(
+                "failed to set checkpoint dedup chunk size: should be a multiple of %lu",
+                POSCheckpointImageWriter::kSectionAlignment
+            );
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        // only applies to images opened afterwards
+        POSCheckpointImageWriter::dedup_chunk_size = _tmp;
+        POS_LOG_C("set checkpoint dedup chunk size: %lu%s", _tmp, _tmp == 0 ? " (disabled)" : "");
+        break;
+
+    case kRuntimeCkptCompressCodecs:
+        {
+            // format: <resource type index>:<codec>[,<resource type index>:<codec>...], empty for disabling
+            std::map<pos_resource_typeid_t, pos_ckpt_codec_t> codecs;
+            std::string item;
+            pos_ckpt_codec_t codec;
+            uint64_t begin = 0, end, colon;
+
+            while(begin < val.size()){
+                if((end = val.find(',', begin)) == std::string::npos){ end = val.size(); }
+                item = val.substr(begin, end - begin);
+                begin = end + 1;
+                if(item.size() == 0){ continue; }
+
+                if(unlikely((colon = item.find(':')) == std::string::npos)){
+                    POS_WARN_C("failed to set checkpoint compress codecs, invalid item %s", item.c_str());
+                    retval = POS_FAILED_INVALID_INPUT;
+                    goto exit;
+                }
+                if(unlikely(POS_SUCCESS != (retval = parse_u64(item.substr(0, colon), "failed to set checkpoint compress codecs", _tmp)))){
+                    goto exit;
+                }
+                codec = POSCheckpointCodec::parse(item.substr(colon + 1));
+                if(unlikely(codec == kPOS_CkptCodec_Unknown)){
+                    POS_WARN_C("failed to set checkpoint compress codecs, unknown codec %s", item.c_str());
+                    retval = POS_FAILED_INVALID_INPUT;
+                    goto exit;
+                }
+                if(unlikely(!POSCheckpointCodec::get_instance()->is_available(codec))){
+                    POS_WARN_C("codec %s is unavailable, handles of type %lu won't be compressed", item.c_str(), _tmp);
+                }
+                codecs[static_cast<pos_resource_typeid_t>(_tmp)] = codec;
+            }
+
+            // only applies to images opened afterwards
+            POSCheckpointImageWriter::compress_codecs = codecs;
+            POS_LOG_C("set checkpoint compress codecs: %s", val.size() > 0 ? val.c_str() : "(disabled)");
+        }
+        break;
+
+    case kRuntimeCkptCompressFrameSize:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set checkpoint compress frame size", _tmp)))){
+            goto exit;
+        }
+        // frames are compressed as single LZ4 blocks, which are limited to 2GB
+        if(unlikely(_tmp == 0 || _tmp > GB(1))){
+            POS_WARN_C("failed to set checkpoint compress frame size: should be within (0, 1GB]");
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        POSCheckpointImageWriter::compress_frame_size = _tmp;
+        POS_LOG_C("set checkpoint compress frame size: %lu", _tmp);
+        break;
+
+    case kRuntimeCkptRetentionPolicies:
+        {
+            // format: <policy>:<value>[,<policy>:<value>...], empty for disabling
+            std::vector<std::shared_ptr<POSCheckpointRetentionPolicy>> policies;
+
+            if(unlikely(POS_SUCCESS != (retval = POSCheckpointRetention::parse(val, policies)))){
+                POS_WARN_C("failed to set checkpoint retention policies: %s", val.c_str());
+                goto exit;
+            }
+            POSCheckpointRetention::get_instance()->set_policies(policies);
+            if(policies.size() > 0){
+                retval = POSCheckpointRetention::get_instance()->start();
+            } else {
+                POSCheckpointRetention::get_instance()->stop();
+            }
+            this->_runtime_ckpt_retention_policies = val;
+            POS_LOG_C("set checkpoint retention policies: %s", val.size() > 0 ? val.c_str() : "(disabled)");
+        }
+        break;
+
+    case kRuntimeCkptHostMemBudget:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set host checkpoint memory budget", _tmp)))){
+            goto exit;
+        }
+        POSCheckpointSpill::get_instance()->set_budget(_tmp);
+        POS_LOG_C("set host checkpoint memory budget: %lu bytes%s", _tmp, _tmp == 0 ? " (unlimited)" : "");
+        break;
+
+    case kRuntimeCkptHostMemClientQuota:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set host checkpoint memory quota of clients", _tmp)))){
+            goto exit;
+        }
+        // only applies to clients created afterwards
+        this->_runtime_ckpt_client_quota = _tmp;
+        POS_LOG_C("set host checkpoint memory quota of clients: %lu bytes%s", _tmp, _tmp == 0 ? " (unlimited)" : "");
+        break;
+
+    case kRuntimeCkptSpillDir:
+        if(unlikely(POS_SUCCESS != (retval = POSCheckpointSpill::get_instance()->set_spill_dir(val)))){
+            POS_WARN_C("failed to set checkpoint spill directory: %s", val.c_str());
+            goto exit;
+        }
+        this->_runtime_ckpt_spill_dir = val;
+        POS_LOG_C("set checkpoint spill directory: %s", val.c_str());
+        break;
+
+    case kRuntimeCkptObjectEndpoint:
+        if(unlikely(val.size() == 0)){
+            POS_WARN_C("failed to set checkpoint object endpoint, empty endpoint");
             retval = POS_FAILED_INVALID_INPUT;
             goto exit;
-        } catch (const std::out_of_range& e) {
-            POS_WARN_C("failed to set ckpt interval: %s", e.what());
+        }
+        POSCheckpointStorage_Object::endpoint = val;
+        POS_LOG_C("set checkpoint object endpoint: %s", val.c_str());
+        break;
+
+    case kRuntimeCkptObjectServeDir:
+        this->_runtime_ckpt_object_server.stop();
+        if(val.size() > 0){
+            retval = this->_runtime_ckpt_object_server.start(POSCheckpointStorage_Object::endpoint, val);
+            if(unlikely(retval != POS_SUCCESS)){
+                POS_WARN_C(
+                    "failed to serve checkpoint objects: endpoint(%s), dir(%s)",
+                    POSCheckpointStorage_Object::endpoint.c_str(), val.c_str()
+                );
+                this->_runtime_ckpt_object_serve_dir.clear();
+                goto exit;
+            }
+        }
+        this->_runtime_ckpt_object_serve_dir = val;
+        POS_LOG_C("set checkpoint object serving directory: %s", val.size() > 0 ? val.c_str() : "(none)");
+        break;
+
+    case kRuntimeRestoreThreads:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set restore threads", _tmp)))){
+            goto exit;
+        }
+        this->_runtime_restore_nb_threads = static_cast<uint32_t>(_tmp);
+        POS_LOG_C("set restore threads: #threads(%u)", this->_runtime_restore_nb_threads);
+        break;
+
+    case kRuntimeRestoreLazyEnabled:
+        if(val == "true"){
+            this->_runtime_restore_lazy = true;
+            POS_LOG_C("set lazy restore as enabled");
+        } else {
+            this->_runtime_restore_lazy = false;
+            POS_LOG_C("set lazy restore as disabled");
+        }
+        break;
+
+    case kRuntimeDaemonSpinRounds:
+    case kRuntimeDaemonYieldRounds:
+    case kRuntimeDaemonParkTimeoutUs:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set daemon wait policy", _tmp)))){
+            goto exit;
+        }
+        if(conf_type == kRuntimeDaemonSpinRounds){
+            this->_runtime_daemon_wait_policy.nb_spin_rounds = _tmp;
+        } else if(conf_type == kRuntimeDaemonYieldRounds){
+            this->_runtime_daemon_wait_policy.nb_yield_rounds = _tmp;
+        } else {
+            if(unlikely(_tmp == 0)){
+                POS_WARN_C("failed to set daemon wait policy: park timeout should be positive");
+                retval = POS_FAILED_INVALID_INPUT;
+                goto exit;
+            }
+            this->_runtime_daemon_wait_policy.park_timeout_us = _tmp;
+        }
+        POS_LOG_C(
+            "set daemon wait policy: #spin_rounds(%lu), #yield_rounds(%lu), park_timeout(%lu us)",
+            this->_runtime_daemon_wait_policy.nb_spin_rounds,
+            this->_runtime_daemon_wait_policy.nb_yield_rounds,
+            this->_runtime_daemon_wait_policy.park_timeout_us
+        );
+        break;
+
+    case kRuntimeDaemonPollBatchSize:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set daemon poll batch size", _tmp)))){
+            goto exit;
+        }
+        if(unlikely(_tmp == 0)){
+            POS_WARN_C("failed to set daemon poll batch size: batch size should be positive");
             retval = POS_FAILED_INVALID_INPUT;
             goto exit;
         }
+        this->_runtime_daemon_poll_batch_size = _tmp;
+        POS_LOG_C("set daemon poll batch size: %lu", _tmp);
+        break;
+
+    case kEvalCkptIntervfalMs:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set ckpt interval", _tmp)))){
+            goto exit;
+        }
         this->_eval_ckpt_interval_tick = static_cast<uint64_t>(
             this->_root_ws->tsc_timer.ms_to_tick(_tmp)
         );
         this->_eval_ckpt_interval_ms = _tmp;
         break;
 
+    case kEvalCkptChunkSize:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set ckpt chunk size", _tmp)))){
+            goto exit;
+        }
+        if(unlikely(_tmp == 0)){
+            POS_WARN_C("failed to set ckpt chunk size: chunk size should be positive");
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        // only applies to delta chains created afterwards
+        POSCheckpointDeltaChain::default_chunk_size = _tmp;
+        POS_LOG_C("set ckpt chunk size: %lu", _tmp);
+        break;
+
+    case kEvalCkptBaseInterval:
+        if(unlikely(POS_SUCCESS != (retval = parse_u64(val, "failed to set ckpt base interval", _tmp)))){
+            goto exit;
+        }
+        if(unlikely(_tmp == 0)){
+            POS_WARN_C("failed to set ckpt base interval: base interval should be positive");
+            retval = POS_FAILED_INVALID_INPUT;
+            goto exit;
+        }
+        // only applies to delta chains created afterwards
+        POSCheckpointDeltaChain::default_base_interval = _tmp;
+        POS_LOG_C("set ckpt base interval: %lu", _tmp);
+        break;
+
     default:
         POS_ERROR_C_DETAIL("unknown config type %u, this is a bug", conf_type);
         break;
@@ -136,10 +444,106 @@ pos_retval_t POSWorkspaceConf::get(ConfigType conf_type, std::string& val){
         val = this->_runtime_trace_dir;
         break;
 
+    case kRuntimePersistThreads:
+        val = std::to_string(this->_runtime_persist_nb_threads);
+        break;
+
+    case kRuntimePersistQueueCapacity:
+        val = std::to_string(this->_runtime_persist_queue_capacity);
+        break;
+
+    case kRuntimeCkptIOBackend:
+        val = this->_runtime_ckpt_io_options.type == kPOS_CkptIOBackend_Posix ? "posix" : "io_uring";
+        break;
+
+    case kRuntimeCkptIOQueueDepth:
+        val = std::to_string(this->_runtime_ckpt_io_options.queue_depth);
+        break;
+
+    case kRuntimeCkptIODirectEnabled:
+        val = std::to_string(this->_runtime_ckpt_io_options.use_direct_io);
+        break;
+
+    case kRuntimeCkptDedupChunkSize:
+        val = std::to_string(POSCheckpointImageWriter::dedup_chunk_size);
+        break;
+
+    case kRuntimeCkptCompressCodecs:
+        val.clear();
+        for(auto &pair : POSCheckpointImageWriter::compress_codecs){
+            if(val.size() > 0){ val += ","; }
+            val += std::to_string(pair.first) + ":" + POSCheckpointCodec::get_name(pair.second);
+        }
+        break;
+
+    case kRuntimeCkptCompressFrameSize:
+        val = std::to_string(POSCheckpointImageWriter::compress_frame_size);
+        break;
+
+    case kRuntimeCkptRetentionPolicies:
+        val = this->_runtime_ckpt_retention_policies;
+        break;
+
+    case kRuntimeCkptHostMemBudget:
+        {
+            pos_ckpt_spill_stat_t stat;
+            POSCheckpointSpill::get_instance()->get_stat(stat);
+            val = std::to_string(stat.budget);
+        }
+        break;
+
+    case kRuntimeCkptHostMemClientQuota:
+        val = std::to_string(this->_runtime_ckpt_client_quota);
+        break;
+
+    case kRuntimeCkptSpillDir:
+        val = this->_runtime_ckpt_spill_dir;
+        break;
+
+    case kRuntimeCkptObjectEndpoint:
+        val = POSCheckpointStorage_Object::endpoint;
+        break;
+
+    case kRuntimeCkptObjectServeDir:
+        val = this->_runtime_ckpt_object_serve_dir;
+        break;
+
+    case kRuntimeRestoreThreads:
+        val = std::to_string(this->_runtime_restore_nb_threads);
+        break;
+
+    case kRuntimeRestoreLazyEnabled:
+        val = std::to_string(this->_runtime_restore_lazy);
+        break;
+
+    case kRuntimeDaemonSpinRounds:
+        val = std::to_string(this->_runtime_daemon_wait_policy.nb_spin_rounds);
+        break;
+
+    case kRuntimeDaemonYieldRounds:
+        val = std::to_string(this->_runtime_daemon_wait_policy.nb_yield_rounds);
+        break;
+
+    case kRuntimeDaemonParkTimeoutUs:
+        val = std::to_string(this->_runtime_daemon_wait_policy.park_timeout_us);
+        break;
+
+    case kRuntimeDaemonPollBatchSize:
+        val = std::to_string(this->_runtime_daemon_poll_batch_size);
+        break;
+
     case kEvalCkptIntervfalMs:
         val = std::to_string(this->_eval_ckpt_interval_ms);
         break;
 
+    case kEvalCkptChunkSize:
+        val = std::to_string(POSCheckpointDeltaChain::default_chunk_size);
+        break;
+
+    case kEvalCkptBaseInterval:
+        val = std::to_string(POSCheckpointDeltaChain::default_base_interval);
+        break;
+
     default:
         POS_ERROR_C_DETAIL("unknown config type %u, this is a bug", conf_type);
         break;
@@ -198,8 +602,37 @@ POSWorkspace::~POSWorkspace(){
 
 
 pos_retval_t POSWorkspace::init(){
+    pos_retval_t retval;
+
     POS_DEBUG_C("initializing POS workspace...")
-    return this->__init();
+
+    retval = POSPersistExecutor::get_instance()->init(
+        this->ws_conf._runtime_persist_nb_threads, this->ws_conf._runtime_persist_queue_capacity
+    );
+    if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to start persist executor");
+        goto exit;
+    }
+
+    retval = POSCheckpointIOBackend::init(this->ws_conf._runtime_ckpt_io_options);
+    if(unlikely(retval == POS_FAILED_NOT_ENABLED)){
+        POS_WARN_C("io_uring is unavailable, checkpoint I/O falls back to POSIX backend");
+    } else if(unlikely(retval != POS_SUCCESS)){
+        POS_WARN_C("failed to create checkpoint I/O backend");
+        goto exit;
+    }
+
+    retval = this->__init();
+    if(unlikely(retval != POS_SUCCESS)){
+        goto exit;
+    }
+
+    // all API metadata are registered by the platform, remap them for dispatching
+    POS_CHECK_POINTER(this->api_mgnr);
+    this->api_mgnr->build_dense_index();
+
+exit:
+    return retval;
 }
 
 
@@ -221,6 +654,9 @@ pos_retval_t POSWorkspace::deinit(){
         }
     }
 
+    POS_DEBUG_C("stopping persist executor...");
+    POSPersistExecutor::get_instance()->deinit();
+
     POS_DEBUG_C("deinit platform-specific context...");
     return this->__deinit();
 }
@@ -255,6 +691,7 @@ pos_retval_t POSWorkspace::create_client(pos_create_client_param_t& param, POSCl
     }
     this->_client_map[(*clnt)->id] = (*clnt);
     this->_pid_client_map[param.pid] = (*clnt);
+    POSCheckpointArena::get_instance()->set_client_quota((*clnt)->id, this->ws_conf._runtime_ckpt_client_quota);
     POS_DEBUG_C("create client: addr(%p), uuid(%lu), pid(%d)", (*clnt), (*clnt)->id, param.pid);
 
 exit:
@@ -302,25 +739,32 @@ exit:
 }
 
 
-pos_retval_t POSWorkspace::restore_client(std::string& ckpt_file, POSClient** clnt){
+pos_retval_t POSWorkspace::restore_client(POSCheckpointImage* ckpt_image, POSClient** clnt){
     pos_retval_t retval = POS_SUCCESS;
     pos_protobuf::Bin_POSClient client_binary;
-    std::ifstream input;
+    const pos_ckpt_image_entry_t *entry;
     pos_create_client_param create_param;
     pos_client_uuid_t client_uuid;
     pid_t client_pid;
     std::string client_job_name;
 
     POS_CHECK_POINTER(clnt);
+    POS_CHECK_POINTER(ckpt_image);
     
-    input.open(ckpt_file, std::ios::in | std::ios::binary);
-    if(!input){
-        POS_WARN_C("failed to open client ckpt file");
+    entry = ckpt_image->find(kPOS_CkptImageRecord_Client);
+    if(unlikely(entry == nullptr)){
+        POS_WARN_C("failed to restore client, no client record inside the checkpoint image");
+        retval = POS_FAILED_NOT_EXIST;
+        goto exit;
+    }
+
+    if(unlikely(POS_SUCCESS != ckpt_image->verify(entry))){
+        POS_WARN_C("failed to restore client, corrupted client record");
         retval = POS_FAILED;
         goto exit;
     }
 
-    if (!client_binary.ParseFromIstream(&input)) {
+    if (!client_binary.ParseFromArray(ckpt_image->get_data(entry), entry->size)) {
         POS_WARN_C("failed to deserialize client ckpt");
         retval = POS_FAILED;
         goto exit;
@@ -349,10 +793,10 @@ pos_retval_t POSWorkspace::restore_client(std::string& ckpt_file, POSClient** cl
     }
     this->_client_map[(*clnt)->id] = (*clnt);
     this->_pid_client_map[(*clnt)->pid] = (*clnt);
+    POSCheckpointArena::get_instance()->set_client_quota((*clnt)->id, this->ws_conf._runtime_ckpt_client_quota);
     POS_DEBUG_C("restore client: addr(%p), uuid(%lu), pid(%d)", (*clnt), (*clnt)->id, (*clnt)->pid);
 
 exit:
-    if(input.is_open()){ input.close(); }
     return retval;
 }
 
@@ -385,9 +829,11 @@ int POSWorkspace::pos_process(
     uint64_t i;
     int retval, prev_error_code = 0;
     POSClient *client;
-    POSAPIMeta_t api_meta;
+    uint32_t api_index;
+    const POSAPIMeta_t *api_meta;
     bool has_prev_error = false;
     POSAPIContext_QE* wqe;
+    uint64_t wqe_id;
     std::vector<POSAPIContext_QE*> cqes;
     POSAPIContext_QE* cqe;
 
@@ -406,19 +852,18 @@ int POSWorkspace::pos_process(
     POS_CHECK_POINTER(client = _client_map[uuid]);
     
     // check whether the metadata of the API was recorded
-#if POS_CONF_RUNTIME_EnableDebugCheck
-    if(unlikely(this->api_mgnr->api_metas.count(api_id) == 0)){
+    api_index = this->api_mgnr->get_api_index(api_id);
+    if(unlikely(api_index == POSApiManager::kInvalidApiIndex)){
         POS_WARN_C_DETAIL(
             "no api metadata was recorded in the api manager: api_id(%lu)", api_id
         );
         return POS_FAILED_NOT_EXIST;
     }
-#endif // POS_CONF_RUNTIME_EnableDebugCheck
 
-    api_meta = api_mgnr->api_metas[api_id];
+    api_meta = &(this->api_mgnr->get_api_meta_by_index(api_index));
 
-    // generate new work queue element
-    wqe = new POSAPIContext_QE(
+    // generate new work queue element, drawn from the pool of the client
+    wqe = client->get_apicxt_pool()->alloc_qe(
         /* api_id*/ api_id,
         /* uuid */ uuid,
         /* param_desps */ param_desps,
@@ -429,6 +874,14 @@ int POSWorkspace::pos_process(
     );
     POS_CHECK_POINTER(wqe);
 
+    /*!
+     *  \note  the reference of the work queue element is held by the processing pipeline, and the wqe
+     *          might be recycled once it's pushed, so we record its id here; for sync call, we hold
+     *          another reference while waiting for its completion
+     */
+    wqe_id = wqe->id;
+    if(unlikely(api_meta->is_sync)){ wqe->get_ref(); }
+
     /*!
      *  \brief  push to the work queue
      *  \note   during restore, we resume the gpu first, then cpu, so this push is safe
@@ -437,57 +890,55 @@ int POSWorkspace::pos_process(
     client->push_q<kPOS_QueueDirection_Rpc2Parser, kPOS_QueueType_ApiCxt_WQ>(wqe);
 
     /*!
-     *  \note   if this is a sync call, we need to block until cqe is obtained
+     *  \note   if this is a sync call, we need to block until the parser / worker completes it
      */
-    if(unlikely(api_meta.is_sync)){
-        while(1){
-            if(unlikely(
-                POS_SUCCESS != (client->template poll_q<kPOS_QueueDirection_Rpc2Parser,kPOS_QueueType_ApiCxt_CQ>(&cqes))
-            )){
-                POS_ERROR_C_DETAIL("failed to poll runtime cq");
-            }
-
-            if(unlikely(
-                POS_SUCCESS != (client->template poll_q<kPOS_QueueDirection_Rpc2Worker,kPOS_QueueType_ApiCxt_CQ>(&cqes))
-            )){
-                POS_ERROR_C_DETAIL("failed to poll worker cq");
-            }
-
-        #if POS_CONF_RUNTIME_EnableDebugCheck
-            if(cqes.size() > 0){
-                POS_DEBUG_C("polling completion queue, obtain %lu elements: uuid(%lu)", cqes.size(), uuid);
-            }
-        #endif
+    if(unlikely(api_meta->is_sync)){
+        wqe->wait_completed();
+        retval = wqe->api_cxt->return_code;
+
+        // the wqe is already in one of the completion queues, along with previous async APIs
+        if(unlikely(
+            POS_SUCCESS != (client->template poll_q<kPOS_QueueDirection_Rpc2Parser,kPOS_QueueType_ApiCxt_CQ>(&cqes))
+        )){
+            POS_ERROR_C_DETAIL("failed to poll runtime cq");
+        }
 
-            for(i=0; i<cqes.size(); i++){
-                POS_CHECK_POINTER(cqe = cqes[i]);
+        if(unlikely(
+            POS_SUCCESS != (client->template poll_q<kPOS_QueueDirection_Rpc2Worker,kPOS_QueueType_ApiCxt_CQ>(&cqes))
+        )){
+            POS_ERROR_C_DETAIL("failed to poll worker cq");
+        }
 
-                // found the called sync api
-                if(cqe->id == wqe->id){
-                    // we should NOT do this assumtion here!
-                    // POS_ASSERT(i == cqes.size() - 1);
+    #if POS_CONF_RUNTIME_EnableDebugCheck
+        if(cqes.size() > 0){
+            POS_DEBUG_C("polling completion queue, obtain %lu elements: uuid(%lu)", cqes.size(), uuid);
+        }
+    #endif
 
-                    // setup return code
-                    retval = has_prev_error ? prev_error_code : cqe->api_cxt->return_code;
+        for(i=0; i<cqes.size(); i++){
+            POS_CHECK_POINTER(cqe = cqes[i]);
 
-                    goto exit;
-                }
-
-                // record previous async error
-                if(unlikely(
-                    cqe->status == kPOS_API_Execute_Status_Parser_Failed
-                    || cqe->status == kPOS_API_Execute_Status_Worker_Failed
-                )){
-                    has_prev_error = true;
-                    prev_error_code = cqe->api_cxt->return_code;
-                }
+            // record previous async error
+            if(unlikely(
+                cqe->id < wqe_id
+                && (cqe->status == kPOS_API_Execute_Status_Parser_Failed
+                    || cqe->status == kPOS_API_Execute_Status_Worker_Failed)
+            )){
+                has_prev_error = true;
+                prev_error_code = cqe->api_cxt->return_code;
             }
 
-            cqes.clear();
+            // release the reference held by the completion queue
+            cqe->put_ref();
         }
+
+        // setup return code
+        if(unlikely(has_prev_error)){ retval = prev_error_code; }
+
+        wqe->put_ref();
     } else {
         // if this is a async call, we directly return success
-        retval = api_mgnr->cast_pos_retval(POS_SUCCESS, api_meta.library_id);
+        retval = api_mgnr->cast_pos_retval(POS_SUCCESS, api_meta->library_id);
     }
 
 exit: